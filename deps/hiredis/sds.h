@@ -33,23 +33,91 @@
 
 #include <sys/types.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 typedef char *sds;
 
-struct sdshdr {
-    int len;
-    int free;
+/* Keep the header layout in sync with src/sds.h: Redis tools link both
+ * the Redis sds implementation and this one, and strings created by one
+ * are accessed with the inline functions of the other. */
+struct __attribute__ ((__packed__)) sdshdr8 {
+    uint8_t len; /* used */
+    uint8_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
     char buf[];
 };
+struct __attribute__ ((__packed__)) sdshdr16 {
+    uint16_t len; /* used */
+    uint16_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr32 {
+    uint32_t len; /* used */
+    uint32_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
+    char buf[];
+};
+struct __attribute__ ((__packed__)) sdshdr64 {
+    uint64_t len; /* used */
+    uint64_t alloc; /* excluding the header and null terminator */
+    unsigned char flags; /* 3 lsb of type, 5 unused bits */
+    char buf[];
+};
+
+#define SDS_TYPE_8  1
+#define SDS_TYPE_16 2
+#define SDS_TYPE_32 3
+#define SDS_TYPE_64 4
+#define SDS_TYPE_MASK 7
+#define SDS_TYPE_BITS 3
+#define SDS_HDR_VAR(T,s) struct sdshdr##T *sh = (void*)((s)-(sizeof(struct sdshdr##T)));
+#define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
 
 static inline size_t sdslen(const sds s) {
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    return sh->len;
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_8: return SDS_HDR(8,s)->len;
+        case SDS_TYPE_16: return SDS_HDR(16,s)->len;
+        case SDS_TYPE_32: return SDS_HDR(32,s)->len;
+        case SDS_TYPE_64: return SDS_HDR(64,s)->len;
+    }
+    return 0;
+}
+
+static inline size_t sdsalloc(const sds s) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_8: return SDS_HDR(8,s)->alloc;
+        case SDS_TYPE_16: return SDS_HDR(16,s)->alloc;
+        case SDS_TYPE_32: return SDS_HDR(32,s)->alloc;
+        case SDS_TYPE_64: return SDS_HDR(64,s)->alloc;
+    }
+    return 0;
 }
 
 static inline size_t sdsavail(const sds s) {
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-    return sh->free;
+    return sdsalloc(s)-sdslen(s);
+}
+
+static inline void sdssetlen(sds s, size_t newlen) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_8: SDS_HDR(8,s)->len = newlen; break;
+        case SDS_TYPE_16: SDS_HDR(16,s)->len = newlen; break;
+        case SDS_TYPE_32: SDS_HDR(32,s)->len = newlen; break;
+        case SDS_TYPE_64: SDS_HDR(64,s)->len = newlen; break;
+    }
+}
+
+static inline void sdssetalloc(sds s, size_t newlen) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_8: SDS_HDR(8,s)->alloc = newlen; break;
+        case SDS_TYPE_16: SDS_HDR(16,s)->alloc = newlen; break;
+        case SDS_TYPE_32: SDS_HDR(32,s)->alloc = newlen; break;
+        case SDS_TYPE_64: SDS_HDR(64,s)->alloc = newlen; break;
+    }
 }
 
 sds sdsnewlen(const void *init, size_t initlen);
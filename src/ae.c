@@ -30,6 +30,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "fmacros.h"
 #include <stdio.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -48,13 +49,17 @@
 #ifdef HAVE_EVPORT
 #include "ae_evport.c"
 #else
-    #ifdef HAVE_EPOLL
-    #include "ae_epoll.c"
+    #ifdef HAVE_IOURING
+    #include "ae_iouring.c"
     #else
-        #ifdef HAVE_KQUEUE
-        #include "ae_kqueue.c"
+        #ifdef HAVE_EPOLL
+        #include "ae_epoll.c"
         #else
-        #include "ae_select.c"
+            #ifdef HAVE_KQUEUE
+            #include "ae_kqueue.c"
+            #else
+            #include "ae_select.c"
+            #endif
         #endif
     #endif
 #endif
@@ -77,7 +82,12 @@ aeEventLoop *aeCreateEventLoop(int setsize) {
     eventLoop->lastTime = time(NULL);
 
     // 初始化时间事件结构
-    eventLoop->timeEventHead = NULL;
+    eventLoop->timeEventsHeap = NULL;
+    eventLoop->timeEventsCount = 0;
+    eventLoop->timeEventsHeapSize = 0;
+    eventLoop->timeEventsTable = NULL;
+    eventLoop->timeEventsTableSize = 0;
+    eventLoop->timeEventsTableUsed = 0;
     eventLoop->timeEventNextId = 0;
 
     eventLoop->stop = 0;
@@ -103,9 +113,15 @@ err:
  * 删除事件处理器
  */
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+
     aeApiFree(eventLoop);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
+    for (j = 0; j < eventLoop->timeEventsCount; j++)
+        zfree(eventLoop->timeEventsHeap[j]);
+    zfree(eventLoop->timeEventsHeap);
+    zfree(eventLoop->timeEventsTable);
     zfree(eventLoop);
 }
 
@@ -216,6 +232,153 @@ static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms)
     *ms = when_ms;
 }
 
+/* ----------------------------- Timers heap -------------------------------
+ * Time events are stored in a binary min-heap ordered by fire time, so the
+ * nearest timer is always at index 0, and insertions and deletions are
+ * O(log(N)). Every event remembers its position in the heap, and an hash
+ * table indexed by id allows aeDeleteTimeEvent() to find it in O(1).
+ *
+ * 时间事件保存在按执行时间排序的最小堆中，最近的时间事件总是位于堆顶，
+ * 添加和删除的复杂度都为 O(log(N)) 。
+ * 另外使用一个以 id 为键的哈希表，在 O(1) 复杂度内根据 id 查找事件。
+ * ------------------------------------------------------------------------ */
+
+/* Return true if the time event 'a' fires before 'b'. */
+static int aeTimeEventBefore(aeTimeEvent *a, aeTimeEvent *b) {
+    return a->when_sec < b->when_sec ||
+           (a->when_sec == b->when_sec && a->when_ms < b->when_ms);
+}
+
+/* Store 'te' at position 'idx' of the heap. */
+static void aeHeapSet(aeEventLoop *eventLoop, int idx, aeTimeEvent *te) {
+    eventLoop->timeEventsHeap[idx] = te;
+    te->heap_index = idx;
+}
+
+/* Move the event at position 'idx' up, until its parent fires before it. */
+static void aeHeapSiftUp(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent **heap = eventLoop->timeEventsHeap;
+    aeTimeEvent *te = heap[idx];
+
+    while (idx > 0) {
+        int parent = (idx-1)/2;
+
+        if (!aeTimeEventBefore(te,heap[parent])) break;
+        aeHeapSet(eventLoop,idx,heap[parent]);
+        idx = parent;
+    }
+    aeHeapSet(eventLoop,idx,te);
+}
+
+/* Move the event at position 'idx' down, until it fires before both its
+ * children. */
+static void aeHeapSiftDown(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent **heap = eventLoop->timeEventsHeap;
+    aeTimeEvent *te = heap[idx];
+    int count = eventLoop->timeEventsCount;
+
+    while (1) {
+        int child = idx*2+1;
+
+        if (child >= count) break;
+        if (child+1 < count && aeTimeEventBefore(heap[child+1],heap[child]))
+            child++;
+        if (!aeTimeEventBefore(heap[child],te)) break;
+        aeHeapSet(eventLoop,idx,heap[child]);
+        idx = child;
+    }
+    aeHeapSet(eventLoop,idx,te);
+}
+
+/* Add the event to the heap. Returns AE_ERR on out of memory. */
+static int aeHeapInsert(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (eventLoop->timeEventsCount == eventLoop->timeEventsHeapSize) {
+        int size = eventLoop->timeEventsHeapSize ?
+                   eventLoop->timeEventsHeapSize*2 : 16;
+        aeTimeEvent **heap = zrealloc(eventLoop->timeEventsHeap,
+                                      sizeof(aeTimeEvent*)*size);
+
+        if (heap == NULL) return AE_ERR;
+        eventLoop->timeEventsHeap = heap;
+        eventLoop->timeEventsHeapSize = size;
+    }
+    aeHeapSet(eventLoop,eventLoop->timeEventsCount++,te);
+    aeHeapSiftUp(eventLoop,te->heap_index);
+    return AE_OK;
+}
+
+/* Remove the event from the heap, replacing it with the last one. */
+static void aeHeapRemove(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    int idx = te->heap_index;
+    aeTimeEvent *last = eventLoop->timeEventsHeap[--eventLoop->timeEventsCount];
+
+    te->heap_index = -1;
+    if (last == te) return;
+    aeHeapSet(eventLoop,idx,last);
+    if (idx > 0 && aeTimeEventBefore(last,eventLoop->timeEventsHeap[(idx-1)/2]))
+        aeHeapSiftUp(eventLoop,idx);
+    else
+        aeHeapSiftDown(eventLoop,idx);
+}
+
+/* Ids are sequential, so the low bits are a perfect hash function. */
+static aeTimeEvent **aeTableBucket(aeEventLoop *eventLoop, long long id) {
+    return eventLoop->timeEventsTable +
+           (id & (eventLoop->timeEventsTableSize-1));
+}
+
+/* Add the event to the id table, growing the table if the number of
+ * events exceeds the number of buckets. Returns AE_ERR on out of memory. */
+static int aeTableInsert(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeEvent **bucket;
+
+    if (eventLoop->timeEventsTableUsed >= eventLoop->timeEventsTableSize) {
+        unsigned long oldsize = eventLoop->timeEventsTableSize, j;
+        aeTimeEvent **oldtable = eventLoop->timeEventsTable;
+        unsigned long size = oldsize ? oldsize*2 : 16;
+        aeTimeEvent **table = zcalloc(sizeof(aeTimeEvent*)*size);
+
+        if (table == NULL) return AE_ERR;
+        eventLoop->timeEventsTable = table;
+        eventLoop->timeEventsTableSize = size;
+        for (j = 0; j < oldsize; j++) {
+            aeTimeEvent *e = oldtable[j], *next;
+
+            while(e) {
+                next = e->hnext;
+                bucket = aeTableBucket(eventLoop,e->id);
+                e->hnext = *bucket;
+                *bucket = e;
+                e = next;
+            }
+        }
+        zfree(oldtable);
+    }
+    bucket = aeTableBucket(eventLoop,te->id);
+    te->hnext = *bucket;
+    *bucket = te;
+    eventLoop->timeEventsTableUsed++;
+    return AE_OK;
+}
+
+/* Remove the event with the given id from the id table, and return it.
+ * NULL is returned if there is no such event. */
+static aeTimeEvent *aeTableRemove(aeEventLoop *eventLoop, long long id) {
+    aeTimeEvent **ref, *te;
+
+    if (eventLoop->timeEventsTableSize == 0) return NULL;
+    ref = aeTableBucket(eventLoop,id);
+    while((te = *ref) != NULL) {
+        if (te->id == id) {
+            *ref = te->hnext;
+            eventLoop->timeEventsTableUsed--;
+            return te;
+        }
+        ref = &te->hnext;
+    }
+    return NULL;
+}
+
 /*
  * 创建时间事件
  */
@@ -237,11 +400,19 @@ long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
+    te->heap_index = -1;
+    te->next = NULL;
 
-    // 将新事件放入表头
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
-
+    // 将新事件添加到最小堆和 id 索引表
+    if (aeTableInsert(eventLoop,te) == AE_ERR) {
+        zfree(te);
+        return AE_ERR;
+    }
+    if (aeHeapInsert(eventLoop,te) == AE_ERR) {
+        aeTableRemove(eventLoop,id);
+        zfree(te);
+        return AE_ERR;
+    }
     return id;
 }
 
@@ -250,29 +421,23 @@ long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
  */
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te, *prev = NULL;
-
-    te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
+    aeTimeEvent *te = aeTableRemove(eventLoop,id);
 
-            if (te->finalizerProc)
-                te->finalizerProc(eventLoop, te->clientData);
+    if (te == NULL) return AE_ERR; /* NO event with the specified ID found */
 
-            zfree(te);
+    if (te->finalizerProc)
+        te->finalizerProc(eventLoop, te->clientData);
 
-            return AE_OK;
-        }
-        prev = te;
-        te = te->next;
+    /* Events out of the heap are referenced by processTimeEvents(), that
+     * will free them: just mark them as deleted. */
+    // 正在执行或者被推迟的事件由 processTimeEvents() 负责释放
+    if (te->heap_index == -1) {
+        te->id = AE_DELETED_EVENT_ID;
+    } else {
+        aeHeapRemove(eventLoop,te);
+        zfree(te);
     }
-
-    return AE_ERR; /* NO event with the specified ID found */
+    return AE_OK;
 }
 
 /* Search the first timer to fire.
@@ -280,27 +445,12 @@ int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
  * put in sleep without to delay any event.
  * If there are no timers NULL is returned.
  *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
+ * This is O(1) since the nearest timer is on top of the heap. */
 // 寻找里目前时间最近的时间事件
-// 因为链表是乱序的，所以查找复杂度为 O（N）
+// 最近的时间事件总是位于堆顶，所以查找复杂度为 O(1)
 static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
-    }
-    return nearest;
+    return eventLoop->timeEventsCount ? eventLoop->timeEventsHeap[0] : NULL;
 }
 
 /* Process time events
@@ -309,7 +459,7 @@ static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
  */
 static int processTimeEvents(aeEventLoop *eventLoop) {
     int processed = 0;
-    aeTimeEvent *te;
+    aeTimeEvent *te, *postponed = NULL;
     long long maxId;
     time_t now = time(NULL);
 
@@ -324,67 +474,81 @@ static int processTimeEvents(aeEventLoop *eventLoop) {
     // 通过重置事件的运行时间，
     // 防止因时间穿插（skew）而造成的事件处理混乱
     if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
+        int j;
+
+        /* All the events get the same fire time: still a valid heap. */
+        for (j = 0; j < eventLoop->timeEventsCount; j++) {
+            eventLoop->timeEventsHeap[j]->when_sec = 0;
+            eventLoop->timeEventsHeap[j]->when_ms = 0;
         }
     }
     // 更新最后一次处理时间事件的时间
     eventLoop->lastTime = now;
 
-    te = eventLoop->timeEventHead;
     maxId = eventLoop->timeEventNextId-1;
-    while(te) {
+    while(eventLoop->timeEventsCount) {
         long now_sec, now_ms;
         long long id;
+        int retval;
+
+        te = eventLoop->timeEventsHeap[0];
 
-        // 跳过无效事件
+        /* Don't process events registered by event handlers itself in
+         * order to don't loop forever: they are moved out of the heap
+         * and added back once done. */
+        // 跳过在处理过程中新创建的事件
         if (te->id > maxId) {
-            te = te->next;
+            aeHeapRemove(eventLoop,te);
+            te->next = postponed;
+            postponed = te;
             continue;
         }
-        
+
         // 获取当前时间
         aeGetTime(&now_sec, &now_ms);
 
-        // 如果当前时间等于或等于事件的执行时间，那么执行这个事件
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
+        // 堆顶事件尚未到达，其他事件也都没有到达
+        if (now_sec < te->when_sec ||
+            (now_sec == te->when_sec && now_ms < te->when_ms)) break;
 
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            /* After an event is processed our time event list may
-             * no longer be the same, so we restart from head.
-             * Still we make sure to don't process events registered
-             * by event handlers itself in order to don't loop forever.
-             * To do so we saved the max ID we want to handle.
-             *
-             * FUTURE OPTIMIZATIONS:
-             * Note that this is NOT great algorithmically. Redis uses
-             * a single time event so it's not a problem but the right
-             * way to do this is to add the new elements on head, and
-             * to flag deleted elements in a special way for later
-             * deletion (putting references to the nodes to delete into
-             * another linked list). */
-
-            // 记录是否有需要循环执行这个事件时间
-            if (retval != AE_NOMORE) {
-                // 是的， retval 毫秒之后继续执行这个时间事件
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                // 不，将这个事件删除
-                aeDeleteTimeEvent(eventLoop, id);
-            }
+        /* Remove the event from the heap while executing it: this way the
+         * handler can delete or create timers (itself included) safely. */
+        aeHeapRemove(eventLoop,te);
+        id = te->id;
+        retval = te->timeProc(eventLoop, id, te->clientData);
+        processed++;
 
-            // 因为执行事件之后，事件列表可能已经被改变了
-            // 因此需要将 te 放回表头，继续开始执行事件
-            te = eventLoop->timeEventHead;
+        if (te->id == AE_DELETED_EVENT_ID) {
+            // 事件在执行过程中被删除
+            zfree(te);
+        } else if (retval != AE_NOMORE) {
+            // 是的， retval 毫秒之后继续执行这个时间事件
+            aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
+            if (aeHeapInsert(eventLoop,te) == AE_ERR) {
+                aeTableRemove(eventLoop,id);
+                if (te->finalizerProc)
+                    te->finalizerProc(eventLoop, te->clientData);
+                zfree(te);
+            }
         } else {
-            te = te->next;
+            // 不，将这个事件删除
+            aeTableRemove(eventLoop,id);
+            if (te->finalizerProc)
+                te->finalizerProc(eventLoop, te->clientData);
+            zfree(te);
+        }
+    }
+
+    /* Add back the events created by the handlers. */
+    while(postponed) {
+        te = postponed;
+        postponed = te->next;
+        te->next = NULL;
+        if (te->id == AE_DELETED_EVENT_ID) {
+            zfree(te);
+        } else if (aeHeapInsert(eventLoop,te) == AE_ERR) {
+            aeDeleteTimeEvent(eventLoop,te->id);
+            zfree(te);
         }
     }
     return processed;
@@ -565,3 +729,162 @@ char *aeGetApiName(void) {
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
     eventLoop->beforesleep = beforesleep;
 }
+
+#ifdef AE_TEST_MAIN
+#include <assert.h>
+
+/* Timers microbenchmark and sanity test. Build with:
+ * cc -O2 -DAE_TEST_MAIN ae.c zmalloc.c -o ae-test */
+
+#define AE_TEST_TIMERS 100000
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Check that every event fires not before its parent in the heap, and
+ * that the id table agrees with the heap. */
+static void checkHeap(aeEventLoop *el) {
+    int j;
+
+    for (j = 0; j < el->timeEventsCount; j++) {
+        aeTimeEvent *te = el->timeEventsHeap[j];
+
+        assert(te->heap_index == j);
+        if (j > 0) assert(!aeTimeEventBefore(te,el->timeEventsHeap[(j-1)/2]));
+    }
+    assert((unsigned long)el->timeEventsCount == el->timeEventsTableUsed);
+}
+
+static int neverFires(struct aeEventLoop *el, long long id, void *data) {
+    AE_NOTUSED(el); AE_NOTUSED(id); AE_NOTUSED(data);
+    assert(0);
+    return AE_NOMORE;
+}
+
+static long fired, last_sec, last_ms, finalized;
+
+static int firesOnce(struct aeEventLoop *el, long long id, void *data) {
+    AE_NOTUSED(el); AE_NOTUSED(id); AE_NOTUSED(data);
+    fired++;
+    return AE_NOMORE;
+}
+
+/* Delete the event with the id passed as private data, and itself. */
+static int deletesTimers(struct aeEventLoop *el, long long id, void *data) {
+    fired++;
+    assert(aeDeleteTimeEvent(el,(long long)(long)data) == AE_OK);
+    assert(aeDeleteTimeEvent(el,id) == AE_OK);
+    return 10;
+}
+
+/* Fires three times, creating a new timer each time. */
+static int repeats(struct aeEventLoop *el, long long id, void *data) {
+    AE_NOTUSED(id);
+    fired++;
+    aeCreateTimeEvent(el,0,firesOnce,NULL,NULL);
+    if (++*(int*)data == 3) return AE_NOMORE;
+    return 1;
+}
+
+static void countFinalized(struct aeEventLoop *el, void *data) {
+    AE_NOTUSED(el); AE_NOTUSED(data);
+    finalized++;
+}
+
+/* Fail if a timer fires before the previous one. */
+static int checksOrder(struct aeEventLoop *el, long long id, void *data) {
+    aeTimeEvent *te = data;
+    AE_NOTUSED(el); AE_NOTUSED(id);
+
+    assert(te->when_sec > last_sec ||
+           (te->when_sec == last_sec && te->when_ms >= last_ms));
+    last_sec = te->when_sec;
+    last_ms = te->when_ms;
+    fired++;
+    return AE_NOMORE;
+}
+
+int main(void) {
+    aeEventLoop *el = aeCreateEventLoop(64);
+    long long *ids = zmalloc(sizeof(long long)*AE_TEST_TIMERS);
+    long long start;
+    int j, counter = 0;
+
+    srand(time(NULL));
+
+    printf("Create %d timers: ", AE_TEST_TIMERS); {
+        start = usec();
+        for (j = 0; j < AE_TEST_TIMERS; j++) {
+            ids[j] = aeCreateTimeEvent(el,3600000+rand()%3600000,
+                                       neverFires,NULL,NULL);
+        }
+        printf("%lld usec\n", usec()-start);
+        checkHeap(el);
+    }
+
+    printf("Process events 100000 times with %d timers pending: ",
+        AE_TEST_TIMERS); {
+        start = usec();
+        for (j = 0; j < 100000; j++)
+            aeProcessEvents(el,AE_TIME_EVENTS|AE_DONT_WAIT);
+        printf("%lld usec\n", usec()-start);
+    }
+
+    printf("Delete %d timers in random order: ", AE_TEST_TIMERS); {
+        for (j = AE_TEST_TIMERS-1; j > 0; j--) {
+            int r = rand()%(j+1);
+            long long tmp = ids[j];
+            ids[j] = ids[r];
+            ids[r] = tmp;
+        }
+        start = usec();
+        for (j = 0; j < AE_TEST_TIMERS; j++) {
+            assert(aeDeleteTimeEvent(el,ids[j]) == AE_OK);
+            if (j == AE_TEST_TIMERS/2) checkHeap(el);
+        }
+        printf("%lld usec\n", usec()-start);
+        assert(el->timeEventsCount == 0);
+        assert(aeDeleteTimeEvent(el,ids[0]) == AE_ERR);
+    }
+
+    printf("Timers fire in order: "); {
+        fired = last_sec = last_ms = 0;
+        for (j = 0; j < 1000; j++) {
+            long long id = aeCreateTimeEvent(el,rand()%20,checksOrder,
+                                             NULL,NULL);
+            /* Pass the event itself, on head of its bucket, to the
+             * handler. */
+            aeTimeEvent *te = *aeTableBucket(el,id);
+            te->clientData = te;
+        }
+        while (el->timeEventsCount) aeProcessEvents(el,AE_TIME_EVENTS);
+        assert(fired == 1000);
+        printf("OK\n");
+    }
+
+    printf("Handlers creating and deleting timers: "); {
+        long long other;
+
+        fired = finalized = 0;
+        other = aeCreateTimeEvent(el,100000,neverFires,NULL,countFinalized);
+        aeCreateTimeEvent(el,0,deletesTimers,(void*)(long)other,
+                          countFinalized);
+        aeCreateTimeEvent(el,0,repeats,&counter,countFinalized);
+        while (el->timeEventsCount) {
+            aeProcessEvents(el,AE_TIME_EVENTS);
+            checkHeap(el);
+        }
+        assert(counter == 3);
+        assert(fired == 1+3+3);
+        assert(finalized == 3);
+        printf("OK\n");
+    }
+
+    zfree(ids);
+    aeDeleteEventLoop(el);
+    return 0;
+}
+#endif
@@ -59,6 +59,10 @@
  */
 #define AE_NOMORE -1
 
+/* Marks a time event deleted while it was not in the heap (being executed,
+ * or postponed by processTimeEvents()): it is freed later. */
+#define AE_DELETED_EVENT_ID -1
+
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
@@ -110,8 +114,14 @@ typedef struct aeTimeEvent {
     // 多路复用库的私有数据
     void *clientData;
 
-    // 指向下个时间事件结构，形成链表
-    struct aeTimeEvent *next;
+    // 事件在最小堆中的索引，不在堆中时为 -1
+    int heap_index; /* Position in the timers heap, -1 if not in the heap. */
+
+    // 指向 id 索引表中同一个桶的下个事件
+    struct aeTimeEvent *hnext; /* Next event in the same id table bucket. */
+
+    // 指向下个被推迟处理的时间事件，形成链表
+    struct aeTimeEvent *next; /* Used by processTimeEvents() only. */
 
 } aeTimeEvent;
 
@@ -143,8 +153,14 @@ typedef struct aeEventLoop {
     aeFileEvent *events; /* Registered events */
     // 已就绪的文件事件
     aeFiredEvent *fired; /* Fired events */
-    // 时间事件
-    aeTimeEvent *timeEventHead;
+    // 时间事件，按执行时间排列的最小堆
+    aeTimeEvent **timeEventsHeap; /* Binary min-heap ordered by fire time. */
+    int timeEventsCount;          /* Number of time events in the heap. */
+    int timeEventsHeapSize;       /* Allocated slots in timeEventsHeap. */
+    // 以 id 为键的时间事件索引表
+    aeTimeEvent **timeEventsTable; /* Hash table id -> event (chained). */
+    unsigned long timeEventsTableSize; /* Number of buckets, power of two. */
+    unsigned long timeEventsTableUsed; /* Number of events in the table. */
     // 事件处理器的开关
     int stop;
     // 多路复用库的私有数据
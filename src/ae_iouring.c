@@ -0,0 +1,374 @@
+/* Linux io_uring(7) based ae.c module
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This backend uses one-shot IORING_OP_POLL_ADD requests to wait for the
+ * readiness of the file descriptors, so it exposes exactly the same
+ * semantics of the other backends to ae.c. The difference with epoll is
+ * that registering, modifying and removing events costs no system call:
+ * requests are just queued in the submission ring, and sent to the kernel
+ * together with the wait for completions, in a single io_uring_enter(2)
+ * call per event loop iteration.
+ *
+ * A one-shot poll request completes once the descriptor is ready, so every
+ * fired descriptor is armed again at the next aeApiPoll() call: if it is
+ * still ready the request completes immediately, like level triggered
+ * epoll would report it again.
+ *
+ * Every request carries the descriptor and a per-descriptor generation
+ * number in its user data. The generation is incremented every time the
+ * request of a descriptor is replaced, so completions of old requests
+ * (cancelled, or that were in flight while the descriptor was closed and
+ * reused) are recognized and ignored.
+ *
+ * The liburing library is not used: the rings are set up directly with
+ * the raw system calls. Kernel 5.11 or greater is required
+ * (IORING_FEAT_EXT_ARG, to wait for completions with a timeout). */
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+
+/* Max number of requests queued before they are submitted to the kernel
+ * without waiting for the next aeApiPoll() call. */
+#define AE_IOURING_SQ_ENTRIES 4096
+
+/* User data of the requests: generation in the high 32 bits, fd in the
+ * low 32 bits. Removal requests use the reserved generation below, their
+ * completions are always ignored. */
+#define AE_IOURING_GEN_REMOVE 0xffffffffULL
+#define AE_IOURING_UDATA(gen,fd) (((unsigned long long)(gen)<<32)|(unsigned)(fd))
+
+typedef struct aeApiState {
+    int ringfd;
+    /* Submission ring. */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_pending;        /* SQEs queued but not yet submitted. */
+    /* Completion ring. */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Mapped memory, to unmap it on exit. */
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    /* Per file descriptor state. */
+    unsigned *gen;              /* Generation of the current request. */
+    short *armed;               /* Poll mask of the request in flight, 0 if
+                                   there is no request in flight. */
+    int *rearm;                 /* Fds that fired and must be armed again. */
+    int rearm_count;
+} aeApiState;
+
+static int aeIoUringSetup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int aeIoUringEnter(int ringfd, unsigned to_submit,
+                          unsigned min_complete, unsigned flags,
+                          void *arg, size_t argsz)
+{
+    return (int) syscall(__NR_io_uring_enter, ringfd, to_submit,
+                         min_complete, flags, arg, argsz);
+}
+
+/* Submit the queued requests without waiting for completions. */
+static int aeApiSubmit(aeApiState *state) {
+    while (state->sq_pending) {
+        int retval = aeIoUringEnter(state->ringfd,state->sq_pending,0,0,
+                                    NULL,0);
+        if (retval == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        state->sq_pending -= retval;
+    }
+    return 0;
+}
+
+/* Get a free submission queue entry, submitting the queued requests first
+ * if the ring is full. */
+static struct io_uring_sqe *aeApiGetSqe(aeApiState *state) {
+    unsigned tail = *state->sq_tail, idx;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(state->sq_head,__ATOMIC_ACQUIRE) ==
+        *state->sq_mask+1)
+    {
+        aeApiSubmit(state);
+    }
+    idx = tail & *state->sq_mask;
+    sqe = state->sqes+idx;
+    memset(sqe,0,sizeof(*sqe));
+    state->sq_array[idx] = idx;
+    __atomic_store_n(state->sq_tail,tail+1,__ATOMIC_RELEASE);
+    state->sq_pending++;
+    return sqe;
+}
+
+/* Queue the removal of the request in flight for 'fd', if any. */
+static void aeApiDisarm(aeApiState *state, int fd) {
+    struct io_uring_sqe *sqe;
+
+    if (!state->armed[fd]) return;
+    sqe = aeApiGetSqe(state);
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = AE_IOURING_UDATA(state->gen[fd],fd);
+    sqe->user_data = AE_IOURING_UDATA(AE_IOURING_GEN_REMOVE,fd);
+    state->armed[fd] = 0;
+    state->gen[fd]++;
+    if (state->gen[fd] == AE_IOURING_GEN_REMOVE) state->gen[fd] = 0;
+}
+
+/* Queue a poll request for 'fd' for the events in the ae 'mask'. */
+static void aeApiArm(aeApiState *state, int fd, int mask) {
+    struct io_uring_sqe *sqe;
+    unsigned events = 0;
+
+    if (mask & AE_READABLE) events |= POLLIN;
+    if (mask & AE_WRITABLE) events |= POLLOUT;
+
+    sqe = aeApiGetSqe(state);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    sqe->poll32_events = events;
+    sqe->user_data = AE_IOURING_UDATA(state->gen[fd],fd);
+    state->armed[fd] = mask;
+}
+
+static void aeApiUnmap(aeApiState *state) {
+    if (state->sqes) munmap(state->sqes,state->sqes_size);
+    if (state->cq_ring && state->cq_ring != state->sq_ring)
+        munmap(state->cq_ring,state->cq_ring_size);
+    if (state->sq_ring) munmap(state->sq_ring,state->sq_ring_size);
+}
+
+static int aeApiCreate(aeEventLoop *eventLoop) {
+    aeApiState *state = zcalloc(sizeof(aeApiState));
+    struct io_uring_params p;
+    unsigned cq_entries = 1;
+    char *sq, *cq;
+
+    if (!state) return -1;
+    state->ringfd = -1;
+
+    /* Every fd has at most a poll request and a removal in flight. */
+    while (cq_entries < (unsigned)eventLoop->setsize*2+AE_IOURING_SQ_ENTRIES)
+        cq_entries *= 2;
+    memset(&p,0,sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cq_entries;
+    state->ringfd = aeIoUringSetup(AE_IOURING_SQ_ENTRIES,&p);
+    if (state->ringfd == -1) goto err;
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        errno = ENOSYS;
+        goto err;
+    }
+
+    /* Map the rings. */
+    state->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    state->cq_ring_size = p.cq_off.cqes +
+                          p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_ring_size > state->sq_ring_size)
+            state->sq_ring_size = state->cq_ring_size;
+        state->cq_ring_size = state->sq_ring_size;
+    }
+    state->sq_ring = mmap(NULL,state->sq_ring_size,PROT_READ|PROT_WRITE,
+                          MAP_SHARED|MAP_POPULATE,state->ringfd,
+                          IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED) {
+        state->sq_ring = NULL;
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        state->cq_ring = state->sq_ring;
+    } else {
+        state->cq_ring = mmap(NULL,state->cq_ring_size,PROT_READ|PROT_WRITE,
+                              MAP_SHARED|MAP_POPULATE,state->ringfd,
+                              IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED) {
+            state->cq_ring = NULL;
+            goto err;
+        }
+    }
+    state->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL,state->sqes_size,PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE,state->ringfd,
+                       IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) {
+        state->sqes = NULL;
+        goto err;
+    }
+
+    sq = state->sq_ring;
+    state->sq_head = (unsigned*)(sq+p.sq_off.head);
+    state->sq_tail = (unsigned*)(sq+p.sq_off.tail);
+    state->sq_mask = (unsigned*)(sq+p.sq_off.ring_mask);
+    state->sq_array = (unsigned*)(sq+p.sq_off.array);
+    cq = state->cq_ring;
+    state->cq_head = (unsigned*)(cq+p.cq_off.head);
+    state->cq_tail = (unsigned*)(cq+p.cq_off.tail);
+    state->cq_mask = (unsigned*)(cq+p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe*)(cq+p.cq_off.cqes);
+
+    state->gen = zcalloc(sizeof(unsigned)*eventLoop->setsize);
+    state->armed = zcalloc(sizeof(short)*eventLoop->setsize);
+    state->rearm = zmalloc(sizeof(int)*eventLoop->setsize);
+    eventLoop->apidata = state;
+    return 0;
+
+err:
+    aeApiUnmap(state);
+    if (state->ringfd != -1) close(state->ringfd);
+    zfree(state);
+    return -1;
+}
+
+static void aeApiFree(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+
+    aeApiUnmap(state);
+    close(state->ringfd);
+    zfree(state->gen);
+    zfree(state->armed);
+    zfree(state->rearm);
+    zfree(state);
+}
+
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+
+    mask |= eventLoop->events[fd].mask; /* Merge old events */
+    if (state->armed[fd] == mask) return 0;
+    aeApiDisarm(state,fd);
+    aeApiArm(state,fd,mask);
+    return 0;
+}
+
+static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeApiState *state = eventLoop->apidata;
+    int mask = eventLoop->events[fd].mask & (~delmask);
+
+    /* Poll requests can't be modified: the request in flight is removed,
+     * and a new one is queued for the events still monitored, if any. */
+    aeApiDisarm(state,fd);
+    if (mask != AE_NONE) {
+        aeApiArm(state,fd,mask);
+    } else {
+        /* The poll request holds a reference to the file: submit the
+         * removal now, so that the caller closing the fd really closes
+         * it (sending the FIN to clients). */
+        aeApiSubmit(state);
+    }
+}
+
+static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned head, tail;
+    int j, retval, numevents = 0;
+
+    /* Arm again the descriptors that fired in the previous iteration, and
+     * are still monitored by requests not yet replaced. */
+    for (j = 0; j < state->rearm_count; j++) {
+        int fd = state->rearm[j];
+        int mask = fd <= eventLoop->maxfd ? eventLoop->events[fd].mask :
+                                            AE_NONE;
+
+        if (mask != AE_NONE && state->armed[fd] == 0)
+            aeApiArm(state,fd,mask);
+    }
+    state->rearm_count = 0;
+
+    /* Submit all the queued requests and wait for completions with a
+     * single system call. */
+    memset(&arg,0,sizeof(arg));
+    if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec*1000;
+        arg.ts = (unsigned long long)(unsigned long)&ts;
+    }
+    retval = aeIoUringEnter(state->ringfd,state->sq_pending,1,
+                            IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                            &arg,sizeof(arg));
+    if (retval > 0) state->sq_pending -= retval;
+    /* On timeout or signal nothing may have been submitted, and with a full
+     * completion ring (EBUSY) the completions must be processed first: in
+     * all the cases we go on, requests still queued are submitted below or
+     * at the next call. */
+    if (state->sq_pending && aeApiSubmit(state) == -1 && errno != EBUSY)
+        return -1;
+
+    /* Process the completions. */
+    head = *state->cq_head;
+    tail = __atomic_load_n(state->cq_tail,__ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = state->cqes+(head & *state->cq_mask);
+        unsigned gen = cqe->user_data >> 32;
+        int fd = (int)(cqe->user_data & 0xffffffff);
+        int res = cqe->res;
+
+        head++;
+        /* Ignore removals and completions of replaced requests. */
+        if (gen == AE_IOURING_GEN_REMOVE || fd >= eventLoop->setsize ||
+            gen != state->gen[fd] || state->armed[fd] == 0) continue;
+
+        /* The request completed: no request is in flight for this fd now,
+         * remember to arm it again in the next iteration. */
+        state->armed[fd] = 0;
+        state->gen[fd]++;
+        if (state->gen[fd] == AE_IOURING_GEN_REMOVE) state->gen[fd] = 0;
+        state->rearm[state->rearm_count++] = fd;
+
+        if (res > 0) {
+            int mask = 0;
+
+            if (res & POLLIN) mask |= AE_READABLE;
+            if (res & POLLOUT) mask |= AE_WRITABLE;
+            if (res & POLLERR) mask |= AE_WRITABLE;
+            if (res & POLLHUP) mask |= AE_WRITABLE;
+            eventLoop->fired[numevents].fd = fd;
+            eventLoop->fired[numevents].mask = mask;
+            numevents++;
+        }
+    }
+    __atomic_store_n(state->cq_head,head,__ATOMIC_RELEASE);
+    return numevents;
+}
+
+static char *aeApiName(void) {
+    return "io_uring";
+}
@@ -678,7 +678,7 @@ int loadAppendOnlyFile(char *filename) {
         if (!(loops++ % 1000)) {
             // rbd.c/loadingProgress
             loadingProgress(ftello(fp));
-            aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+            processEventsWhileBlocked();
         }
 
         // 出错或 EOF
@@ -769,7 +769,7 @@ int rioWriteBulkObject(rio *r, robj *obj) {
      * in a child process when this function is called). */
     if (obj->encoding == REDIS_ENCODING_INT) {
         return rioWriteBulkLongLong(r,(long)obj->ptr);
-    } else if (obj->encoding == REDIS_ENCODING_RAW) {
+    } else if (sdsEncodedObject(obj)) {
         return rioWriteBulkString(r,obj->ptr,sdslen(obj->ptr));
     } else {
         redisPanic("Unknown string encoding");
@@ -786,52 +786,36 @@ int rioWriteBulkObject(rio *r, robj *obj) {
 int rewriteListObject(rio *r, robj *key, robj *o) {
     long long count = 0, items = listTypeLength(o);
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *zl = o->ptr;
-        unsigned char *p = ziplistIndex(zl,0);
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklist *list = o->ptr;
+        quicklistIter *li = quicklistGetIterator(list, AL_START_HEAD);
+        quicklistEntry entry;
 
-        while(ziplistGet(p,&vstr,&vlen,&vlong)) {
+        while (quicklistNext(li,&entry)) {
             if (count == 0) {
                 int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
                     REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
 
-                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
-                if (rioWriteBulkString(r,"RPUSH",5) == 0) return 0;
-                if (rioWriteBulkObject(r,key) == 0) return 0;
+                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0 ||
+                    rioWriteBulkString(r,"RPUSH",5) == 0 ||
+                    rioWriteBulkObject(r,key) == 0) goto werr;
             }
-            if (vstr) {
-                if (rioWriteBulkString(r,(char*)vstr,vlen) == 0) return 0;
+            if (entry.value) {
+                if (rioWriteBulkString(r,(char*)entry.value,entry.sz) == 0)
+                    goto werr;
             } else {
-                if (rioWriteBulkLongLong(r,vlong) == 0) return 0;
+                if (rioWriteBulkLongLong(r,entry.longval) == 0) goto werr;
             }
-            p = ziplistNext(zl,p);
             if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
             items--;
         }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        list *list = o->ptr;
-        listNode *ln;
-        listIter li;
-
-        listRewind(list,&li);
-        while((ln = listNext(&li))) {
-            robj *eleobj = listNodeValue(ln);
-
-            if (count == 0) {
-                int cmd_items = (items > REDIS_AOF_REWRITE_ITEMS_PER_CMD) ?
-                    REDIS_AOF_REWRITE_ITEMS_PER_CMD : items;
+        quicklistReleaseIterator(li);
+        return 1;
 
-                if (rioWriteBulkCount(r,'*',2+cmd_items) == 0) return 0;
-                if (rioWriteBulkString(r,"RPUSH",5) == 0) return 0;
-                if (rioWriteBulkObject(r,key) == 0) return 0;
-            }
-            if (rioWriteBulkObject(r,eleobj) == 0) return 0;
-            if (++count == REDIS_AOF_REWRITE_ITEMS_PER_CMD) count = 0;
-            items--;
-        }
+werr:
+        // 写入出错，释放迭代器，让被解压的节点重新压缩
+        quicklistReleaseIterator(li);
+        return 0;
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -900,7 +884,7 @@ int rewriteSetObject(rio *r, robj *key, robj *o) {
 int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
     long long count = 0, items = zsetLength(o);
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = o->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -908,13 +892,13 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
         long long vll;
         double score;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpFirst(zl);
         redisAssert(eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         while (eptr != NULL) {
-            redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+            redisAssert(lpGetValue(eptr,&vstr,&vlen,&vll));
             score = zzlGetScore(sptr);
 
             if (count == 0) {
@@ -983,12 +967,12 @@ int rewriteSortedSetObject(rio *r, robj *key, robj *o) {
  * 出错返回 0 ，成功返回非 0 值。
  */
 static int rioWriteHashIteratorCursor(rio *r, hashTypeIterator *hi, int what) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             return rioWriteBulkString(r, (char*)vstr, vlen);
         } else {
@@ -1039,6 +1023,186 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
     return 1;
 }
 
+/* Emit the commands needed to rebuild a roaring encoded bitmap.
+ *
+ * A sparse bitmap is rebuilt with a SETBIT for every set bit, followed by
+ * a SETBIT clearing the last bit of the string to restore its length, so
+ * that neither the rewrite nor the loading of the AOF need the
+ * uncompressed string. Denser bitmaps, where the SETBIT commands would be
+ * larger than the string itself, are emitted as a plain SET.
+ *
+ * The function returns 0 on error, 1 on success. */
+/*
+ * 将重建 roaring 位图所需的命令写入到 r 。
+ *
+ * 稀疏位图为每个被设置的位写入一个 SETBIT 命令，
+ * 并用一个清除最后一位的 SETBIT 恢复字符串的长度，
+ * 这样重写和载入 AOF 时都不必展开位图。
+ * 如果 SETBIT 命令比字符串本身还大，那么写入一个 SET 命令。
+ *
+ * 失败返回 0 ，成功返回 1 。
+ */
+int rewriteRoaringObject(rio *r, robj *key, robj *o) {
+    roaring *rb = o->ptr;
+    uint64_t nbits = (uint64_t)rb->bytes*8;
+    int64_t bit = 0;
+
+    /* Every SETBIT command takes about 32 bytes of AOF. */
+    if (roaringCount(rb)*32 >= rb->bytes) {
+        char cmd[]="*3\r\n$3\r\nSET\r\n";
+        unsigned char *buf = zmalloc(rb->bytes);
+        int retval;
+
+        roaringToBytes(rb,buf);
+        retval = rioWrite(r,cmd,sizeof(cmd)-1) &&
+                 rioWriteBulkObject(r,key) &&
+                 rioWriteBulkString(r,(char*)buf,rb->bytes);
+        zfree(buf);
+        return retval;
+    }
+
+    while ((bit = roaringFirst(rb,bit,nbits-1,1)) != -1) {
+        if (rioWriteBulkCount(r,'*',4) == 0) return 0;
+        if (rioWriteBulkString(r,"SETBIT",6) == 0) return 0;
+        if (rioWriteBulkObject(r,key) == 0) return 0;
+        if (rioWriteBulkLongLong(r,bit) == 0) return 0;
+        if (rioWriteBulkString(r,"1",1) == 0) return 0;
+        bit++;
+    }
+
+    /* Extend the string to its length, unless the last bit is set. */
+    if (!roaringGetBit(rb,nbits-1)) {
+        if (rioWriteBulkCount(r,'*',4) == 0) return 0;
+        if (rioWriteBulkString(r,"SETBIT",6) == 0) return 0;
+        if (rioWriteBulkObject(r,key) == 0) return 0;
+        if (rioWriteBulkLongLong(r,nbits-1) == 0) return 0;
+        if (rioWriteBulkString(r,"0",1) == 0) return 0;
+    }
+    return 1;
+}
+
+/* Write the stream ID 'id' as a bulk string. */
+static int rioWriteBulkStreamID(rio *r, streamID *id) {
+    char buf[STREAM_ID_STR_SIZE];
+    int len = snprintf(buf,sizeof(buf),"%llu-%llu",
+                       (unsigned long long)id->ms,
+                       (unsigned long long)id->seq);
+
+    return rioWriteBulkString(r,buf,len);
+}
+
+/* Emit the commands needed to rebuild a stream object: an XADD with the
+ * explicit ID of every entry, an XSETID restoring the last ID (that may
+ * belong to a deleted entry), and for every consumer group an XGROUP
+ * CREATE followed by an XCLAIM ... FORCE for every pending entry.
+ *
+ * The function returns 0 on error, 1 on success. */
+/*
+ * 将重建流对象所需的命令写入到 r ：每个项一个带有明确 ID 的 XADD ，
+ * 一个恢复最后 ID 的 XSETID ，以及每个消费者组的 XGROUP CREATE ，
+ * 和组内每个待确认项的 XCLAIM ... FORCE 。
+ */
+int rewriteStreamObject(rio *r, robj *key, robj *o) {
+    stream *s = o->ptr;
+    streamIterator si;
+    streamID id;
+    int64_t numfields;
+    dictIterator *di;
+    dictEntry *de;
+
+    if (s->length) {
+        /* Reconstruct the stream data using XADD commands. */
+        streamIteratorStart(&si,s,NULL,NULL,0);
+        while(streamIteratorGetID(&si,&id,&numfields)) {
+            if (rioWriteBulkCount(r,'*',3+numfields*2) == 0 ||
+                rioWriteBulkString(r,"XADD",4) == 0 ||
+                rioWriteBulkObject(r,key) == 0 ||
+                rioWriteBulkStreamID(r,&id) == 0)
+            {
+                streamIteratorStop(&si);
+                return 0;
+            }
+            while(numfields--) {
+                unsigned char *field, *value;
+                int64_t field_len, value_len;
+
+                streamIteratorGetField(&si,&field,&value,&field_len,&value_len);
+                if (rioWriteBulkString(r,(char*)field,field_len) == 0 ||
+                    rioWriteBulkString(r,(char*)value,value_len) == 0)
+                {
+                    streamIteratorStop(&si);
+                    return 0;
+                }
+            }
+        }
+        streamIteratorStop(&si);
+    } else {
+        /* An empty stream is created adding an entry and trimming it
+         * away in the same XADD. The ID is fixed by the XSETID below. */
+        id = s->last_id;
+        if (id.ms == 0 && id.seq == 0) id.seq = 1;
+        if (rioWriteBulkCount(r,'*',7) == 0 ||
+            rioWriteBulkString(r,"XADD",4) == 0 ||
+            rioWriteBulkObject(r,key) == 0 ||
+            rioWriteBulkString(r,"MAXLEN",6) == 0 ||
+            rioWriteBulkString(r,"0",1) == 0 ||
+            rioWriteBulkStreamID(r,&id) == 0 ||
+            rioWriteBulkString(r,"x",1) == 0 ||
+            rioWriteBulkString(r,"y",1) == 0) return 0;
+    }
+
+    /* Restore the last ID of the stream. */
+    if (rioWriteBulkCount(r,'*',3) == 0 ||
+        rioWriteBulkString(r,"XSETID",6) == 0 ||
+        rioWriteBulkObject(r,key) == 0 ||
+        rioWriteBulkStreamID(r,&s->last_id) == 0) return 0;
+
+    /* Create all the consumer groups and their pending entries. */
+    if (s->cgroups == NULL) return 1;
+    di = dictGetIterator(s->cgroups);
+    while((de = dictNext(di)) != NULL) {
+        sds name = dictGetKey(de);
+        streamCG *cg = dictGetVal(de);
+        streamIndexNode *node;
+
+        if (rioWriteBulkCount(r,'*',5) == 0 ||
+            rioWriteBulkString(r,"XGROUP",6) == 0 ||
+            rioWriteBulkString(r,"CREATE",6) == 0 ||
+            rioWriteBulkObject(r,key) == 0 ||
+            rioWriteBulkString(r,name,sdslen(name)) == 0 ||
+            rioWriteBulkStreamID(r,&cg->last_id) == 0) goto werr;
+
+        /* XCLAIM <key> <group> <consumer> 0 <id> TIME <delivery-time>
+         *        RETRYCOUNT <count> JUSTID FORCE */
+        for (node = streamIndexFirst(cg->pel); node;
+             node = streamIndexNext(node))
+        {
+            streamNACK *nack = node->value;
+            sds consumer = nack->consumer->name;
+
+            if (rioWriteBulkCount(r,'*',12) == 0 ||
+                rioWriteBulkString(r,"XCLAIM",6) == 0 ||
+                rioWriteBulkObject(r,key) == 0 ||
+                rioWriteBulkString(r,name,sdslen(name)) == 0 ||
+                rioWriteBulkString(r,consumer,sdslen(consumer)) == 0 ||
+                rioWriteBulkString(r,"0",1) == 0 ||
+                rioWriteBulkStreamID(r,&node->id) == 0 ||
+                rioWriteBulkString(r,"TIME",4) == 0 ||
+                rioWriteBulkLongLong(r,nack->delivery_time) == 0 ||
+                rioWriteBulkString(r,"RETRYCOUNT",10) == 0 ||
+                rioWriteBulkLongLong(r,nack->delivery_count) == 0 ||
+                rioWriteBulkString(r,"JUSTID",6) == 0 ||
+                rioWriteBulkString(r,"FORCE",5) == 0) goto werr;
+        }
+    }
+    dictReleaseIterator(di);
+    return 1;
+
+werr:
+    dictReleaseIterator(di);
+    return 0;
+}
+
 /* Write a sequence of commands able to fully rebuild the dataset into
  * "filename". Used both by REWRITEAOF and BGREWRITEAOF.
  *
@@ -1057,8 +1221,8 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
  * 重写失败返回 REDIS_ERR ，成功返回 REDIS_OK 。
  */
 int rewriteAppendOnlyFile(char *filename) {
-    dictIterator *di = NULL;
-    dictEntry *de;
+    kvtableIterator *di = NULL;
+    kvEntry *e;
     rio aof;
     FILE *fp;
     char tmpfile[256];
@@ -1080,13 +1244,9 @@ int rewriteAppendOnlyFile(char *filename) {
     for (j = 0; j < server.dbnum; j++) {
         char selectcmd[] = "*2\r\n$6\r\nSELECT\r\n";
         redisDb *db = server.db+j;
-        dict *d = db->dict;
-        if (dictSize(d) == 0) continue;
-        di = dictGetSafeIterator(d);
-        if (!di) {
-            fclose(fp);
-            return REDIS_ERR;
-        }
+        kvtable *t = db->keyspace;
+        if (kvtableSize(t) == 0) continue;
+        di = kvtableGetIterator(t);
 
         /* SELECT the new DB */
         // 切换到合适的数据库上
@@ -1095,20 +1255,24 @@ int rewriteAppendOnlyFile(char *filename) {
 
         /* Iterate this DB writing every entry */
         // 遍历数据库的所有 key-value 对
-        while((de = dictNext(di)) != NULL) {
+        while((e = kvtableNext(di)) != NULL) {
             sds keystr;
             robj key, *o;
             long long expiretime;
 
-            keystr = dictGetKey(de);
-            o = dictGetVal(de);
+            keystr = kvtableGetKey(e);
+            o = kvtableGetVal(e);
             initStaticStringObject(key,keystr);
 
-            expiretime = getExpire(db,&key);
+            expiretime = kvtableGetExpire(e);
 
             /* Save the key and associated value */
             // 保存 key 和 value
-            if (o->type == REDIS_STRING) {
+            if (o->type == REDIS_STRING &&
+                o->encoding == REDIS_ENCODING_ROARING)
+            {
+                if (rewriteRoaringObject(&aof,&key,o) == 0) goto werr;
+            } else if (o->type == REDIS_STRING) {
                 /* Emit a SET command */
                 char cmd[]="*3\r\n$3\r\nSET\r\n";
                 if (rioWrite(&aof,cmd,sizeof(cmd)-1) == 0) goto werr;
@@ -1123,6 +1287,8 @@ int rewriteAppendOnlyFile(char *filename) {
                 if (rewriteSortedSetObject(&aof,&key,o) == 0) goto werr;
             } else if (o->type == REDIS_HASH) {
                 if (rewriteHashObject(&aof,&key,o) == 0) goto werr;
+            } else if (o->type == REDIS_STREAM) {
+                if (rewriteStreamObject(&aof,&key,o) == 0) goto werr;
             } else {
                 redisPanic("Unknown object type");
             }
@@ -1142,7 +1308,7 @@ int rewriteAppendOnlyFile(char *filename) {
                 if (rioWriteBulkLongLong(&aof,expiretime) == 0) goto werr;
             }
         }
-        dictReleaseIterator(di);
+        kvtableReleaseIterator(di);
     }
 
     /* Make sure data will not remain on the OS's output buffers */
@@ -1168,7 +1334,7 @@ werr:
     fclose(fp);
     unlink(tmpfile);
     redisLog(REDIS_WARNING,"Write error writing append only file on disk: %s", strerror(errno));
-    if (di) dictReleaseIterator(di);
+    if (di) kvtableReleaseIterator(di);
     return REDIS_ERR;
 }
 
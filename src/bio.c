@@ -1,16 +1,19 @@
 /* Background I/O service for Redis.
  *
  * This file implements operations that we need to perform in the background.
- * Currently there is only a single operation, that is a background close(2)
- * system call. This is needed as when the process is the last owner of a
- * reference to a file closing it means unlinking it, and the deletion of the
- * file is slow, blocking the server.
+ * Currently there are three operations:
+ *
+ * 1) A background close(2) system call. This is needed as when the process
+ *    is the last owner of a reference to a file closing it means unlinking
+ *    it, and the deletion of the file is slow, blocking the server.
+ * 2) AOF fsync(2), so that the main thread does not block on the disk.
+ * 3) Lazy freeing of big values and whole databases unlinked from the
+ *    keyspace, used by UNLINK, FLUSHDB/FLUSHALL ASYNC and the lazyfree
+ *    options (see lazyfree.c).
  *
  * In the future we'll either continue implementing new things we need or
  * we'll switch to libeio. However there are probably long term uses for this
- * file as we may want to put here Redis specific background tasks (for instance
- * it is not impossible that we'll need a non blocking FLUSHDB/FLUSHALL
- * implementation).
+ * file as we may want to put here Redis specific background tasks.
  *
  * DESIGN
  * ------
@@ -201,6 +204,15 @@ void *bioProcessBackgroundJobs(void *arg) {
             close((long)job->arg1);
         } else if (type == REDIS_BIO_AOF_FSYNC) {
             aof_fsync((long)job->arg1);
+        } else if (type == REDIS_BIO_LAZY_FREE) {
+            /* What we free changes depending on what arguments are set:
+             * arg1 -> free the object at pointer.
+             * arg2 -> free a keyspace table (a Redis DB). */
+            // 释放一个对象，或者释放一个数据库的键空间
+            if (job->arg1)
+                lazyfreeFreeObjectFromBioThread(job->arg1);
+            else if (job->arg2)
+                lazyfreeFreeDatabaseFromBioThread(job->arg2);
         } else {
             redisPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
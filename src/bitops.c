@@ -30,10 +30,19 @@
 
 #include "redis.h"
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 /* -----------------------------------------------------------------------------
  * Helpers and low level bit functions.
  * -------------------------------------------------------------------------- */
 
+#define BITOP_AND   0
+#define BITOP_OR    1
+#define BITOP_XOR   2
+#define BITOP_NOT   3
+
 /* This helper function used by GETBIT / SETBIT parses the bit offset arguemnt
  * making sure an error is returned if it is negative or if it overflows
  * Redis 512 MB limit for the string value. */
@@ -57,8 +66,11 @@ static int getBitOffsetFromArgument(redisClient *c, robj *o, size_t *offset) {
 
 /* Count number of bits set in the binary array pointed by 's' and long
  * 'count' bytes. The implementation of this function is required to
- * work with a input string length up to 512 MB. */
-long popcount(void *s, long count) {
+ * work with a input string length up to 512 MB.
+ *
+ * This is the portable version, used when no faster kernel is available
+ * for the CPU we are running on, see popcount(). */
+static long popcountScalar(void *s, long count) {
     long bits = 0;
     unsigned char *p;
     uint32_t *p4 = s;
@@ -93,15 +105,335 @@ long popcount(void *s, long count) {
     return bits;
 }
 
+#ifdef HAVE_X86_SIMD
+/* Hardware accelerated kernels.
+ *
+ * The kernels are compiled with the target function attribute and selected
+ * at runtime according to the CPU, so the binary still runs on any x86_64
+ * CPU, exactly like the intset.c SIMD search.
+ *
+ * 硬件加速的实现：
+ * 使用 target 属性编译，在运行时根据 CPU 支持的指令集选择，
+ * 不支持的 CPU 上仍然使用可移植的实现。 */
+
+/* Count bits using the POPCNT instruction, 64 bits at a time. Four
+ * independent counters are used so that the POPCNT instructions of the
+ * same iteration don't depend on each other. */
+__attribute__((target("popcnt")))
+static long popcountPopcnt(void *s, long count) {
+    unsigned char *p = s;
+    uint64_t a, b, c, d;
+    long b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+
+    while(count >= 32) {
+        memcpy(&a,p,8);
+        memcpy(&b,p+8,8);
+        memcpy(&c,p+16,8);
+        memcpy(&d,p+24,8);
+        b0 += __builtin_popcountll(a);
+        b1 += __builtin_popcountll(b);
+        b2 += __builtin_popcountll(c);
+        b3 += __builtin_popcountll(d);
+        p += 32;
+        count -= 32;
+    }
+    while(count >= 8) {
+        memcpy(&a,p,8);
+        b0 += __builtin_popcountll(a);
+        p += 8;
+        count -= 8;
+    }
+    while(count--) b0 += __builtin_popcount(*p++);
+    return b0+b1+b2+b3;
+}
+
+/* Population count of every 64 bit lane of 'v', using the nibble lookup
+ * table with PSHUFB and the sum of absolute differences to add the bytes. */
+__attribute__((target("avx2")))
+static inline __m256i popcount256(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(
+        0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+        0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v,low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi32(v,4),low_mask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup,lo),
+                                  _mm256_shuffle_epi8(lookup,hi));
+    return _mm256_sad_epu8(cnt,_mm256_setzero_si256());
+}
+
+/* Carry save adder: given the three inputs a, b and c, sets 'l' to the
+ * bits of weight 1 and 'h' to the bits of weight 2 of their sum. */
+#define POPCOUNT_CSA(h,l,a,b,c) do { \
+    __m256i _u = _mm256_xor_si256(a,b); \
+    h = _mm256_or_si256(_mm256_and_si256(a,b),_mm256_and_si256(_u,c)); \
+    l = _mm256_xor_si256(_u,c); \
+} while(0)
+
+#define POPCOUNT_LOAD(p,i) _mm256_loadu_si256((const __m256i*)(p)+(i))
+
+/* Harley-Seal population count, see "Faster Population Counts Using AVX2
+ * Instructions" by Mula, Kurz and Lemire.
+ *
+ * Blocks of 16 vectors are reduced with a tree of carry save adders into
+ * the 'ones', 'twos', 'fours', 'eights' accumulators, so that the actual
+ * (expensive) vector population count is performed only once per 16
+ * vectors, on the 'sixteens' output. */
+__attribute__((target("avx2,popcnt")))
+static long popcountAVX2(void *s, long count) {
+    unsigned char *p = s;
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256();
+    __m256i twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256();
+    __m256i eights = _mm256_setzero_si256();
+    __m256i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+    uint64_t lanes[4];
+    long bits;
+
+    while(count >= 32*16) {
+        POPCOUNT_CSA(twosA,ones,ones,POPCOUNT_LOAD(p,0),POPCOUNT_LOAD(p,1));
+        POPCOUNT_CSA(twosB,ones,ones,POPCOUNT_LOAD(p,2),POPCOUNT_LOAD(p,3));
+        POPCOUNT_CSA(foursA,twos,twos,twosA,twosB);
+        POPCOUNT_CSA(twosA,ones,ones,POPCOUNT_LOAD(p,4),POPCOUNT_LOAD(p,5));
+        POPCOUNT_CSA(twosB,ones,ones,POPCOUNT_LOAD(p,6),POPCOUNT_LOAD(p,7));
+        POPCOUNT_CSA(foursB,twos,twos,twosA,twosB);
+        POPCOUNT_CSA(eightsA,fours,fours,foursA,foursB);
+        POPCOUNT_CSA(twosA,ones,ones,POPCOUNT_LOAD(p,8),POPCOUNT_LOAD(p,9));
+        POPCOUNT_CSA(twosB,ones,ones,POPCOUNT_LOAD(p,10),POPCOUNT_LOAD(p,11));
+        POPCOUNT_CSA(foursA,twos,twos,twosA,twosB);
+        POPCOUNT_CSA(twosA,ones,ones,POPCOUNT_LOAD(p,12),POPCOUNT_LOAD(p,13));
+        POPCOUNT_CSA(twosB,ones,ones,POPCOUNT_LOAD(p,14),POPCOUNT_LOAD(p,15));
+        POPCOUNT_CSA(foursB,twos,twos,twosA,twosB);
+        POPCOUNT_CSA(eightsB,fours,fours,foursA,foursB);
+        POPCOUNT_CSA(sixteens,eights,eights,eightsA,eightsB);
+        total = _mm256_add_epi64(total,popcount256(sixteens));
+        p += 32*16;
+        count -= 32*16;
+    }
+    total = _mm256_slli_epi64(total,4);
+    total = _mm256_add_epi64(total,
+                _mm256_slli_epi64(popcount256(eights),3));
+    total = _mm256_add_epi64(total,
+                _mm256_slli_epi64(popcount256(fours),2));
+    total = _mm256_add_epi64(total,
+                _mm256_slli_epi64(popcount256(twos),1));
+    total = _mm256_add_epi64(total,popcount256(ones));
+    while(count >= 32) {
+        total = _mm256_add_epi64(total,popcount256(POPCOUNT_LOAD(p,0)));
+        p += 32;
+        count -= 32;
+    }
+    _mm256_storeu_si256((__m256i*)lanes,total);
+    bits = lanes[0]+lanes[1]+lanes[2]+lanes[3];
+    return bits + popcountPopcnt(p,count);
+}
+
+/* Compute 'len' bytes of the BITOP AND, OR or XOR of the 'numkeys' strings
+ * at 'src' (or the NOT of src[0]) into 'res', 128 bytes at a time.
+ * All the source strings must be at least 'len' bytes.
+ *
+ * Returns the number of bytes processed, that is 'len' rounded down to
+ * a multiple of 128: the caller is in charge of the rest. */
+#define BITOP_AVX2_LOOP(vop) do { \
+    for (i = 1; i < numkeys; i++) { \
+        unsigned char *sp = src[i]+j; \
+        a0 = vop(a0,_mm256_loadu_si256((const __m256i*)sp)); \
+        a1 = vop(a1,_mm256_loadu_si256((const __m256i*)(sp+32))); \
+        a2 = vop(a2,_mm256_loadu_si256((const __m256i*)(sp+64))); \
+        a3 = vop(a3,_mm256_loadu_si256((const __m256i*)(sp+96))); \
+    } \
+} while(0)
+
+__attribute__((target("avx2")))
+static long bitopAVX2(int op, unsigned char *res, unsigned char **src,
+                      long numkeys, long len)
+{
+    const __m256i allones = _mm256_set1_epi8(-1);
+    __m256i a0, a1, a2, a3;
+    long i, j;
+
+    for (j = 0; j+128 <= len; j += 128) {
+        a0 = _mm256_loadu_si256((const __m256i*)(src[0]+j));
+        a1 = _mm256_loadu_si256((const __m256i*)(src[0]+j+32));
+        a2 = _mm256_loadu_si256((const __m256i*)(src[0]+j+64));
+        a3 = _mm256_loadu_si256((const __m256i*)(src[0]+j+96));
+
+        /* Different branches per different operations for speed. */
+        switch(op) {
+        case BITOP_AND: BITOP_AVX2_LOOP(_mm256_and_si256); break;
+        case BITOP_OR:  BITOP_AVX2_LOOP(_mm256_or_si256); break;
+        case BITOP_XOR: BITOP_AVX2_LOOP(_mm256_xor_si256); break;
+        default:
+            a0 = _mm256_xor_si256(a0,allones);
+            a1 = _mm256_xor_si256(a1,allones);
+            a2 = _mm256_xor_si256(a2,allones);
+            a3 = _mm256_xor_si256(a3,allones);
+            break;
+        }
+        _mm256_storeu_si256((__m256i*)(res+j),a0);
+        _mm256_storeu_si256((__m256i*)(res+j+32),a1);
+        _mm256_storeu_si256((__m256i*)(res+j+64),a2);
+        _mm256_storeu_si256((__m256i*)(res+j+96),a3);
+    }
+    return j;
+}
+
+typedef long popcountProc(void *s, long count);
+typedef long bitopProc(int op, unsigned char *res, unsigned char **src,
+                       long numkeys, long len);
+
+/* Kernels selected on first use. popcountImpl falls back to the portable
+ * version, while bitopKernel stays NULL if the CPU has no AVX2 support,
+ * and in that case BITOP uses the word at a time loop. */
+static int bitopsSimdInitialized = 0;
+static popcountProc *popcountImpl = popcountScalar;
+static bitopProc *bitopKernel = NULL;
+
+static void bitopsSimdInit(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        popcountImpl = popcountAVX2;
+        bitopKernel = bitopAVX2;
+    } else if (__builtin_cpu_supports("popcnt")) {
+        popcountImpl = popcountPopcnt;
+    }
+    bitopsSimdInitialized = 1;
+}
+#endif
+
+/* Count number of bits set in the binary array pointed by 's' and long
+ * 'count' bytes, using the fastest implementation available.
+ *
+ * 计算 s 指向的 count 个字节中，值为 1 的二进制位的数量。 */
+long popcount(void *s, long count) {
+#ifdef HAVE_X86_SIMD
+    if (!bitopsSimdInitialized) bitopsSimdInit();
+    return popcountImpl(s,count);
+#else
+    return popcountScalar(s,count);
+#endif
+}
+
+/* Return the position of the first bit set to one (if 'bit' is 1) or
+ * zero (if 'bit' is 0) in the bitmap starting at 's' and long 'count' bytes.
+ *
+ * 返回 s 指向的 count 个字节中，第一个值为 bit 的二进制位的位置。
+ *
+ * The function is guaranteed to never return a value greater than
+ * count*8 (the first bit outside the string), and returns -1 only when
+ * looking for a set bit and there is none.
+ *
+ * The bitmap is scanned a word at a time, skipping all the words that
+ * are all zeros or all ones respectively when we are looking for ones
+ * or zeros: only the first word that is not skipped is inspected bit
+ * by bit. */
+long redisBitpos(void *s, unsigned long count, int bit) {
+    unsigned long *l;
+    unsigned char *c;
+    unsigned long skipval, word = 0;
+    long pos = 0; /* Position of bit, to return to the caller. */
+    unsigned long j;
+
+    /* Skip initial bits not aligned to sizeof(unsigned long) byte by byte. */
+    skipval = bit ? 0 : UCHAR_MAX;
+    c = (unsigned char*) s;
+    while((unsigned long)c & (sizeof(*l)-1) && count) {
+        if (*c != skipval) break;
+        c++;
+        count--;
+        pos += 8;
+    }
+
+    /* Skip bits with full word step. */
+    skipval = bit ? 0 : ULONG_MAX;
+    l = (unsigned long*) c;
+    while (count >= sizeof(*l)) {
+        if (*l != skipval) break;
+        l++;
+        count -= sizeof(*l);
+        pos += sizeof(*l)*8;
+    }
+
+    /* Load bytes into "word" considering the first byte as the most
+     * significant (we basically consider it as written in big endian, since
+     * we consider the string as a set of bits from left to right, with the
+     * first bit at position zero.
+     *
+     * Note that the loading is designed to work even when the bytes left
+     * (count) are less than a full word. We pad it with zero on the right. */
+    c = (unsigned char*)l;
+    for (j = 0; j < sizeof(*l); j++) {
+        word <<= 8;
+        if (count) {
+            word |= *c;
+            c++;
+            count--;
+        }
+    }
+
+    /* Special case:
+     * If bits in the string are all zero and we are looking for one,
+     * return -1 to signal that there is not a single "1" in the whole
+     * string. This can't happen when we are looking for "0" as we assume
+     * that the right of the string is zero padded. */
+    if (bit == 1 && word == 0) return -1;
+
+    /* Last word left: the position of the bit we are looking for is the
+     * number of leading bits that are different from it. When looking for
+     * zeros the word is inverted, this can't be all zeros since the word
+     * was not skipped, or is zero padded on the right. */
+    if (bit == 0) word = ~word;
+    return pos + __builtin_clzl(word);
+}
+
+/* Compute BITOP when at least one of the sources is a roaring encoded
+ * bitmap. The other sources are compressed as well, so that neither the
+ * operation nor the result ever need the uncompressed bitmap, that may be
+ * hundreds of megabytes for a sparse bitmap.
+ *
+ * 当至少一个输入是 roaring 位图时，在压缩格式上执行 BITOP ：
+ * 其他输入也会先被压缩，所以无需展开可能多达数百 MB 的稀疏位图。 */
+static roaring *bitopRoaring(int op, robj **objects, long numkeys) {
+    roaring *res = NULL, *r, *tmp;
+    long j;
+
+    for (j = 0; j < numkeys; j++) {
+        int owned = 1;
+
+        if (objects[j] == NULL) {
+            r = roaringNew();
+        } else if (objects[j]->encoding == REDIS_ENCODING_ROARING) {
+            r = objects[j]->ptr;
+            owned = 0;
+        } else {
+            r = roaringFromBytes(objects[j]->ptr,sdslen(objects[j]->ptr));
+        }
+
+        if (j == 0) {
+            if (op == BITOP_NOT) {
+                res = roaringNot(r);
+            } else if (owned) {
+                res = r;
+                continue;
+            } else {
+                res = roaringDup(r);
+            }
+        } else {
+            tmp = roaringBitop(op,res,r);
+            roaringFree(res);
+            res = tmp;
+        }
+        if (owned) roaringFree(r);
+    }
+    roaringRunOptimize(res);
+    return res;
+}
+
 /* -----------------------------------------------------------------------------
  * Bits related string commands: GETBIT, SETBIT, BITCOUNT, BITOP.
  * -------------------------------------------------------------------------- */
 
-#define BITOP_AND   0
-#define BITOP_OR    1
-#define BITOP_XOR   2
-#define BITOP_NOT   3
-
 /* SETBIT key offset bitvalue */
 void setbitCommand(redisClient *c) {
     robj *o;
@@ -123,35 +455,39 @@ void setbitCommand(redisClient *c) {
         return;
     }
 
+    /* Bitmaps created by SETBIT start roaring encoded, so that a sparse
+     * bitmap only uses memory for the bits actually set. Strings created
+     * by other commands keep their encoding.
+     *
+     * SETBIT 创建的位图使用 roaring 编码，稀疏位图只为被设置的位占用内存。
+     * 其他命令创建的字符串保持原来的编码。 */
     o = lookupKeyWrite(c->db,c->argv[1]);
     if (o == NULL) {
-        o = createObject(REDIS_STRING,sdsempty());
+        o = createRoaringObject();
         dbAdd(c->db,c->argv[1],o);
     } else {
         if (checkType(c,o,REDIS_STRING)) return;
-
-        /* Create a copy when the object is shared or encoded. */
-        if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
-            robj *decoded = getDecodedObject(o);
-            o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
-            decrRefCount(decoded);
-            dbOverwrite(c->db,c->argv[1],o);
-        }
+        if (o->encoding != REDIS_ENCODING_ROARING)
+            o = dbUnshareStringValue(c->db,c->argv[1],o);
     }
 
-    /* Grow sds value to the right length if necessary */
-    byte = bitoffset >> 3;
-    o->ptr = sdsgrowzero(o->ptr,byte+1);
-
-    /* Get current values */
-    byteval = ((uint8_t*)o->ptr)[byte];
-    bit = 7 - (bitoffset & 0x7);
-    bitval = byteval & (1 << bit);
-
-    /* Update byte with new bit value and return original value */
-    byteval &= ~(1 << bit);
-    byteval |= ((on & 0x1) << bit);
-    ((uint8_t*)o->ptr)[byte] = byteval;
+    if (o->encoding == REDIS_ENCODING_ROARING) {
+        bitval = roaringSetBit(o->ptr,bitoffset,on);
+    } else {
+        /* Grow sds value to the right length if necessary */
+        byte = bitoffset >> 3;
+        o->ptr = sdsgrowzero(o->ptr,byte+1);
+
+        /* Get current values */
+        byteval = ((uint8_t*)o->ptr)[byte];
+        bit = 7 - (bitoffset & 0x7);
+        bitval = byteval & (1 << bit);
+
+        /* Update byte with new bit value and return original value */
+        byteval &= ~(1 << bit);
+        byteval |= ((on & 0x1) << bit);
+        ((uint8_t*)o->ptr)[byte] = byteval;
+    }
     signalModifiedKey(c->db,c->argv[1]);
     server.dirty++;
     addReply(c, bitval ? shared.cone : shared.czero);
@@ -173,7 +509,9 @@ void getbitCommand(redisClient *c) {
 
     byte = bitoffset >> 3;
     bit = 7 - (bitoffset & 0x7);
-    if (o->encoding != REDIS_ENCODING_RAW) {
+    if (o->encoding == REDIS_ENCODING_ROARING) {
+        bitval = roaringGetBit(o->ptr,bitoffset);
+    } else if (!sdsEncodedObject(o)) {
         if (byte < (size_t)ll2string(llbuf,sizeof(llbuf),(long)o->ptr))
             bitval = llbuf[byte] & (1 << bit);
     } else {
@@ -194,6 +532,8 @@ void bitopCommand(redisClient *c) {
     long *len, maxlen = 0; /* Array of length of src strings, and max len. */
     long minlen = 0;    /* Min len among the input keys. */
     unsigned char *res = NULL; /* Resulting string. */
+    roaring *rres = NULL; /* Resulting bitmap, if any source is roaring. */
+    int roaringsrc = 0; /* True if at least a source is roaring encoded. */
 
     /* Parse the operation name. */
     if ((opname[0] == 'a' || opname[0] == 'A') && !strcasecmp(opname,"and"))
@@ -241,15 +581,26 @@ void bitopCommand(redisClient *c) {
             zfree(objects);
             return;
         }
-        objects[j] = getDecodedObject(o);
-        src[j] = objects[j]->ptr;
-        len[j] = sdslen(objects[j]->ptr);
+        if (o->encoding == REDIS_ENCODING_ROARING) {
+            /* Compressed bitmaps are not decoded, see bitopRoaring(). */
+            incrRefCount(o);
+            objects[j] = o;
+            src[j] = NULL;
+            len[j] = ((roaring*)o->ptr)->bytes;
+            roaringsrc = 1;
+        } else {
+            objects[j] = getDecodedObject(o);
+            src[j] = objects[j]->ptr;
+            len[j] = sdslen(objects[j]->ptr);
+        }
         if (len[j] > maxlen) maxlen = len[j];
         if (j == 0 || len[j] < minlen) minlen = len[j];
     }
 
     /* Compute the bit operation, if at least one string is not empty. */
-    if (maxlen) {
+    if (maxlen && roaringsrc) {
+        rres = bitopRoaring(op,objects,numkeys);
+    } else if (maxlen) {
         res = (unsigned char*) sdsnewlen(NULL,maxlen);
         unsigned char output, byte;
         long i;
@@ -258,13 +609,22 @@ void bitopCommand(redisClient *c) {
          * can take a fast path that performs much better than the
          * vanilla algorithm. */
         j = 0;
+#ifdef HAVE_X86_SIMD
+        /* Use the AVX2 kernel if available, for any number of keys. */
+        if (!bitopsSimdInitialized) bitopsSimdInit();
+        if (minlen && bitopKernel) {
+            j = bitopKernel(op,res,src,numkeys,minlen);
+            minlen -= j;
+        }
+#endif
         if (minlen && numkeys <= 16) {
             unsigned long *lp[16];
-            unsigned long *lres = (unsigned long*) res;
+            unsigned long *lres = (unsigned long*) (res+j);
 
             /* Note: sds pointer is always aligned to 8 byte boundary. */
-            memcpy(lp,src,sizeof(unsigned long*)*numkeys);
-            memcpy(res,src[0],minlen);
+            for (i = 0; i < numkeys; i++)
+                lp[i] = (unsigned long*) (src[i]+j);
+            memcpy(res+j,src[0]+j,minlen);
 
             /* Different branches per different operations for speed (sorry). */
             if (op == BITOP_AND) {
@@ -344,7 +704,12 @@ void bitopCommand(redisClient *c) {
 
     /* Store the computed value into the target key */
     if (maxlen) {
-        o = createObject(REDIS_STRING,res);
+        if (rres) {
+            o = createObject(REDIS_STRING,rres);
+            o->encoding = REDIS_ENCODING_ROARING;
+        } else {
+            o = createObject(REDIS_STRING,res);
+        }
         setKey(c->db,targetkey,o);
         decrRefCount(o);
     } else if (dbDelete(c->db,targetkey)) {
@@ -366,10 +731,14 @@ void bitcountCommand(redisClient *c) {
         checkType(c,o,REDIS_STRING)) return;
 
     /* Set the 'p' pointer to the string, that can be just a stack allocated
-     * array if our string was integer encoded. */
+     * array if our string was integer encoded. Roaring bitmaps are
+     * counted directly. */
     if (o->encoding == REDIS_ENCODING_INT) {
         p = (unsigned char*) llbuf;
         strlen = ll2string(llbuf,sizeof(llbuf),(long)o->ptr);
+    } else if (o->encoding == REDIS_ENCODING_ROARING) {
+        p = NULL;
+        strlen = ((roaring*)o->ptr)->bytes;
     } else {
         p = (unsigned char*) o->ptr;
         strlen = sdslen(o->ptr);
@@ -404,6 +773,109 @@ void bitcountCommand(redisClient *c) {
     } else {
         long bytes = end-start+1;
 
-        addReplyLongLong(c,popcount(p+start,bytes));
+        if (p == NULL)
+            addReplyLongLong(c,roaringCountRange(o->ptr,
+                (uint64_t)start*8,(uint64_t)end*8+7));
+        else
+            addReplyLongLong(c,popcount(p+start,bytes));
+    }
+}
+
+/* BITPOS key bit [start [end]] */
+void bitposCommand(redisClient *c) {
+    robj *o;
+    long bit, start, end, strlen;
+    unsigned char *p;
+    char llbuf[32];
+    int end_given = 0;
+
+    /* Parse the bit argument to understand what we are looking for, set
+     * or clear bits. */
+    if (getLongFromObjectOrReply(c,c->argv[2],&bit,NULL) != REDIS_OK)
+        return;
+    if (bit != 0 && bit != 1) {
+        addReplyError(c, "The bit argument must be 1 or 0.");
+        return;
+    }
+
+    /* If the key does not exist, from our point of view it is an infinite
+     * array of 0 bits. If the user is looking for the fist clear bit return 0,
+     * If the user is looking for the first set bit, return -1. */
+    if ((o = lookupKeyRead(c->db,c->argv[1])) == NULL) {
+        addReplyLongLong(c, bit ? -1 : 0);
+        return;
+    }
+    if (checkType(c,o,REDIS_STRING)) return;
+
+    /* Set the 'p' pointer to the string, that can be just a stack allocated
+     * array if our string was integer encoded. Roaring bitmaps are
+     * searched directly. */
+    if (o->encoding == REDIS_ENCODING_INT) {
+        p = (unsigned char*) llbuf;
+        strlen = ll2string(llbuf,sizeof(llbuf),(long)o->ptr);
+    } else if (o->encoding == REDIS_ENCODING_ROARING) {
+        p = NULL;
+        strlen = ((roaring*)o->ptr)->bytes;
+    } else {
+        p = (unsigned char*) o->ptr;
+        strlen = sdslen(o->ptr);
+    }
+
+    /* Parse start/end range if any. */
+    if (c->argc == 4 || c->argc == 5) {
+        if (getLongFromObjectOrReply(c,c->argv[3],&start,NULL) != REDIS_OK)
+            return;
+        if (c->argc == 5) {
+            if (getLongFromObjectOrReply(c,c->argv[4],&end,NULL) != REDIS_OK)
+                return;
+            end_given = 1;
+        } else {
+            end = strlen-1;
+        }
+        /* Convert negative indexes */
+        if (start < 0) start = strlen+start;
+        if (end < 0) end = strlen+end;
+        if (start < 0) start = 0;
+        if (end < 0) end = 0;
+        if (end >= strlen) end = strlen-1;
+    } else if (c->argc == 3) {
+        /* The whole string. */
+        start = 0;
+        end = strlen-1;
+    } else {
+        /* Syntax error. */
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+
+    /* For empty ranges (start > end) we return -1 as an empty range does
+     * not contain a 0 nor a 1. */
+    if (start > end) {
+        addReplyLongLong(c, -1);
+    } else if (p == NULL) {
+        long long pos = roaringFirst(o->ptr,(uint64_t)start*8,
+                                     (uint64_t)end*8+7,bit);
+
+        /* Same as below: without an explicit end the string is considered
+         * zero padded on the right. */
+        if (pos == -1 && bit == 0 && !end_given) pos = (long long)(end+1)*8;
+        addReplyLongLong(c,pos);
+    } else {
+        long bytes = end-start+1;
+        long pos = redisBitpos(p+start,bytes,bit);
+
+        /* If we are looking for clear bits, and the user specified an exact
+         * range with start-end, we can't consider the right of the range as
+         * zero padded (as we do when no explicit end is given).
+         *
+         * So if redisBitpos() returns the first bit outside the range,
+         * we return -1 to the caller, to mean, in the specified range there
+         * is not a single "0" bit. */
+        if (end_given && bit == 0 && pos == bytes*8) {
+            addReplyLongLong(c,-1);
+            return;
+        }
+        if (pos != -1) pos += start*8; /* Adjust for the bytes we skipped. */
+        addReplyLongLong(c,pos);
     }
 }
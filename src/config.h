@@ -63,6 +63,9 @@
 /* Test for polling API */
 #ifdef __linux__
 #define HAVE_EPOLL 1
+#ifdef USE_IOURING
+#define HAVE_IOURING 1
+#endif
 #endif
 
 #if (defined(__APPLE__) && defined(MAC_OS_X_VERSION_10_6)) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
@@ -164,5 +167,12 @@
 #endif
 #endif
 
+/* SSE4.2 / AVX2 kernels compiled with the target function attribute and
+ * selected at runtime with __builtin_cpu_supports(). */
+#if defined(__x86_64__) && (BYTE_ORDER == LITTLE_ENDIAN) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define HAVE_X86_SIMD 1
+#endif
+
 
 #endif
@@ -44,22 +44,24 @@ void SlotToKeyDel(robj *key);
  *
  * T = O(1)
  */
-robj *lookupKey(redisDb *db, robj *key) {
-
-    // 查找 key 对象
-    dictEntry *de = dictFind(db->dict,key->ptr);
-
+/* Return the value of the keyspace entry 'e', updating its access time. */
+static robj *lookupKeyEntry(kvEntry *e) {
     // 存在？
-    if (de) {
+    if (e) {
         // 取出 key 对应的值对象
-        robj *val = dictGetVal(de);
+        robj *val = kvtableGetVal(e);
 
         /* Update the access time for the aging algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
         // 如果条件允许，那么更新 lru 时间
-        if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
-            val->lru = server.lruclock;
+        if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+            if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+                updateLFU(val);
+            } else {
+                val->lru = server.lruclock;
+            }
+        }
 
         return val;
     } else {
@@ -68,6 +70,29 @@ robj *lookupKey(redisDb *db, robj *key) {
     }
 }
 
+robj *lookupKey(redisDb *db, robj *key) {
+    // 查找 key 对象
+    return lookupKeyEntry(kvtableFind(db->keyspace,key->ptr));
+}
+
+/* Lookup the key and, if it is expired, delete it. The expire time is
+ * stored in the keyspace entry, so this is a single lookup. */
+/*
+ * 查找 key ，如果 key 已经过期，那么将它删除
+ *
+ * 过期时间保存在键空间节点中，所以只需要查找一次
+ */
+static robj *lookupKeyExpireIfNeeded(redisDb *db, robj *key) {
+    kvEntry *e = kvtableFind(db->keyspace,key->ptr);
+
+    // 检查 key 是否过期，如果是的话，将它删除
+    // （附属节点不会删除过期 key ，也即 e 仍然有效）
+    if (e && kvtableGetExpire(e) != KVTABLE_NO_EXPIRE &&
+        expireIfNeededAt(db,key,kvtableGetExpire(e)) &&
+        server.masterhost == NULL) return NULL;
+    return lookupKeyEntry(e);
+}
+
 /* 
  * 为进行读操作而读取数据库
  */
@@ -75,11 +100,8 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
 
     robj *val;
 
-    // 检查 key 是否过期，如果是的话，将它删除
-    expireIfNeeded(db,key);
-
     // 查找 key ，并根据查找结果更新命中/不命中数
-    val = lookupKey(db,key);
+    val = lookupKeyExpireIfNeeded(db,key);
     if (val == NULL)
         server.stat_keyspace_misses++;
     else
@@ -96,8 +118,7 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  * 这个函数不更新命中/不命中计数
  */
 robj *lookupKeyWrite(redisDb *db, robj *key) {
-    expireIfNeeded(db,key);
-    return lookupKey(db,key);
+    return lookupKeyExpireIfNeeded(db,key);
 }
 
 /*
@@ -134,9 +155,9 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
     // 键（字符串）
     sds copy = sdsdup(key->ptr);
     // 保存 键-值 对
-    int retval = dictAdd(db->dict, copy, val);
+    kvEntry *e = kvtableAdd(db->keyspace, copy, val);
 
-    redisAssertWithInfo(NULL,key,retval == REDIS_OK);
+    redisAssertWithInfo(NULL,key,e != NULL);
 
     if (server.cluster_enabled) SlotToKeyAdd(key);
  }
@@ -154,12 +175,44 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
     // 取出节点
-    struct dictEntry *de = dictFind(db->dict,key->ptr);
-    
-    redisAssertWithInfo(NULL,key,de != NULL);
+    kvEntry *e = kvtableFind(db->keyspace,key->ptr);
+    robj *old;
+
+    redisAssertWithInfo(NULL,key,e != NULL);
 
     // 用新值覆盖旧值
-    dictReplace(db->dict, key->ptr, val);
+    old = kvtableGetVal(e);
+    kvtableSetVal(e,val);
+    if (server.lazyfree_lazy_server_del)
+        freeObjAsync(old);
+    else
+        decrRefCount(old);
+}
+
+/* Prepare the string object stored at 'key' to be modified destructively
+ * to implement commands like SETBIT or PFADD.
+ *
+ * 为就地修改（例如 SETBIT 、 PFADD）准备 key 所保存的字符串对象。
+ *
+ * An object is safe to modify in place only when it is not shared and
+ * its value is a plain RAW sds string. Otherwise an unshared RAW copy of
+ * the value is created, stored at 'key' in place of the old one, and
+ * returned to the caller.
+ *
+ * 只有未被共享、并且以 RAW 编码保存的对象才能被直接修改，
+ * 否则创建一个 RAW 编码的副本，用它替换 key 原来的值，并返回这个副本。
+ *
+ * The object 'o' must be the one currently stored at 'key' and must be
+ * of type REDIS_STRING. */
+robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o) {
+    redisAssert(o->type == REDIS_STRING);
+    if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
+        robj *decoded = getDecodedObject(o);
+        o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
+        decrRefCount(decoded);
+        dbOverwrite(db,key,o);
+    }
+    return o;
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -199,7 +252,7 @@ void setKey(redisDb *db, robj *key, robj *val) {
  * 是的话返回 1 ，否则返回 0 
  */
 int dbExists(redisDb *db, robj *key) {
-    return dictFind(db->dict,key->ptr) != NULL;
+    return kvtableFind(db->keyspace,key->ptr) != NULL;
 }
 
 /* Return a random key, in form of a Redis object.
@@ -213,23 +266,23 @@ int dbExists(redisDb *db, robj *key) {
  * 函数只返回未过期的 key
  */
 robj *dbRandomKey(redisDb *db) {
-    struct dictEntry *de;
+    kvEntry *e;
 
     while(1) {
         sds key;
         robj *keyobj;
 
-        // 从字典中返回随机值， O(N)
-        de = dictGetRandomKey(db->dict);
+        // 从键空间中返回随机节点
+        e = kvtableGetFairRandomEntry(db->keyspace);
         // 数据库为空
-        if (de == NULL) return NULL;
+        if (e == NULL) return NULL;
 
         // 取出值对象
-        key = dictGetKey(de);
+        key = kvtableGetKey(e);
         keyobj = createStringObject(key,sdslen(key));
         // 检查 key 是否已过期
-        if (dictFind(db->expires,key)) {
-            if (expireIfNeeded(db,keyobj)) {
+        if (kvtableGetExpire(e) != KVTABLE_NO_EXPIRE) {
+            if (expireIfNeededAt(db,keyobj,kvtableGetExpire(e))) {
                 decrRefCount(keyobj);
                 // 这个 key 已过期，继续寻找下个 key
                 continue; /* search for another key. This expired. */
@@ -240,18 +293,13 @@ robj *dbRandomKey(redisDb *db) {
     }
 }
 
-/* Delete a key, value, and associated expiration entry if any, from the DB */
+/* Delete a key, value, and associated expiration if any, from the DB */
 /*
  * 从数据库中删除 key ，key 对应的值，以及对应的过期时间（如果有的话）
  */
-int dbDelete(redisDb *db, robj *key) {
-    /* Deleting an entry from the expires dict will not free the sds of
-     * the key, because it is shared with the main dictionary. */
-    // 先删除过期时间
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
-
-    // 删除 key 和 value
-    if (dictDelete(db->dict,key->ptr) == DICT_OK) {
+int dbSyncDelete(redisDb *db, robj *key) {
+    // 删除 key 、 value 和过期时间
+    if (kvtableDelete(db->keyspace,key->ptr) == KVTABLE_OK) {
         if (server.cluster_enabled) SlotToKeyDel(key);
         return 1;
     } else {
@@ -259,22 +307,36 @@ int dbDelete(redisDb *db, robj *key) {
     }
 }
 
+/* This is a wrapper whose behavior depends on the Redis lazy free
+ * configuration. Deletes the key synchronously or asynchronously. */
+/*
+ * 根据 lazyfree-lazy-server-del 选项，同步或者异步地删除 key
+ */
+int dbDelete(redisDb *db, robj *key) {
+    return server.lazyfree_lazy_server_del ? dbAsyncDelete(db,key) :
+                                             dbSyncDelete(db,key);
+}
+
 /*
  * 清空所有数据库
  *
  * T = O(N^2)
  */
-long long emptyDb() {
+long long emptyDb(int flags) {
+    int async = (flags & REDIS_EMPTYDB_ASYNC);
     int j;
     long long removed = 0;
 
     // 清空所有数据库, O(N^2)
     for (j = 0; j < server.dbnum; j++) {
-        removed += dictSize(server.db[j].dict);
-        // O(N)
-        dictEmpty(server.db[j].dict);
-        // O(N)
-        dictEmpty(server.db[j].expires);
+        removed += kvtableSize(server.db[j].keyspace);
+        if (async) {
+            // 由后台线程释放旧的键空间
+            emptyDbAsync(&server.db[j]);
+        } else {
+            // O(N)
+            kvtableEmpty(server.db[j].keyspace);
+        }
     }
     
     // 返回清除的 key 数量
@@ -327,26 +389,61 @@ void signalFlushedDb(int dbid) {
  * Type agnostic commands operating on the key space
  *----------------------------------------------------------------------------*/
 
+/* Return the set of flags to use for the emptyDb() call for FLUSHALL
+ * and FLUSHDB commands.
+ *
+ * Currently the command just attempts to parse the "ASYNC" option. It
+ * also checks if the command arity is wrong.
+ *
+ * On success REDIS_OK is returned and the flags are stored in *flags,
+ * otherwise REDIS_ERR is returned and the function sends an error to the
+ * client. */
+int getFlushCommandFlags(redisClient *c, int *flags) {
+    /* Parse the optional ASYNC option. */
+    if (c->argc > 1) {
+        if (c->argc > 2 || strcasecmp(c->argv[1]->ptr,"async")) {
+            addReply(c,shared.syntaxerr);
+            return REDIS_ERR;
+        }
+        *flags = REDIS_EMPTYDB_ASYNC;
+    } else {
+        *flags = REDIS_EMPTYDB_NO_FLAGS;
+    }
+    return REDIS_OK;
+}
+
 /*
  * 清空客户端当前所使用的数据库
+ *
+ * FLUSHDB [ASYNC]
  */
 void flushdbCommand(redisClient *c) {
-    server.dirty += dictSize(c->db->dict);
+    int flags;
+
+    if (getFlushCommandFlags(c,&flags) == REDIS_ERR) return;
+    server.dirty += kvtableSize(c->db->keyspace);
     signalFlushedDb(c->db->id);
-    dictEmpty(c->db->dict);
-    dictEmpty(c->db->expires);
+    if (flags & REDIS_EMPTYDB_ASYNC) {
+        emptyDbAsync(c->db);
+    } else {
+        kvtableEmpty(c->db->keyspace);
+    }
     addReply(c,shared.ok);
 }
 
 /*
  * 清空所有数据库
+ *
+ * FLUSHALL [ASYNC]
  */
 void flushallCommand(redisClient *c) {
+    int flags;
 
+    if (getFlushCommandFlags(c,&flags) == REDIS_ERR) return;
     signalFlushedDb(-1);
 
     // 清空所有数据库
-    server.dirty += emptyDb();
+    server.dirty += emptyDb(flags);
 
     addReply(c,shared.ok);
 
@@ -366,14 +463,17 @@ void flushallCommand(redisClient *c) {
     server.dirty++;
 }
 
+/* This command implements DEL and UNLINK. */
 /*
  * 从数据库中删除所有给定 key
  */
-void delCommand(redisClient *c) {
+void delGenericCommand(redisClient *c, int lazy) {
     int deleted = 0, j;
 
     for (j = 1; j < c->argc; j++) {
-        if (dbDelete(c->db,c->argv[j])) {
+        int retval = lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                            dbDelete(c->db,c->argv[j]);
+        if (retval) {
             signalModifiedKey(c->db,c->argv[j]);
             server.dirty++;
             deleted++;
@@ -383,6 +483,19 @@ void delCommand(redisClient *c) {
     addReplyLongLong(c,deleted);
 }
 
+void delCommand(redisClient *c) {
+    delGenericCommand(c,0);
+}
+
+/*
+ * UNLINK 命令的实现
+ *
+ * 和 DEL 一样删除给定的键，但大的值会交给后台线程释放
+ */
+void unlinkCommand(redisClient *c) {
+    delGenericCommand(c,1);
+}
+
 /*
  * 检查给定 key 是否存在
  */
@@ -443,8 +556,8 @@ void randomkeyCommand(redisClient *c) {
  * 查找和给定模式匹配的 key
  */
 void keysCommand(redisClient *c) {
-    dictIterator *di;
-    dictEntry *de;
+    kvtableIterator *ki;
+    kvEntry *e;
 
     sds pattern = c->argv[1]->ptr;
 
@@ -454,36 +567,323 @@ void keysCommand(redisClient *c) {
     void *replylen = addDeferredMultiBulkLength(c);
 
     // 指向当前数据库的 key space
-    di = dictGetSafeIterator(c->db->dict);
+    ki = kvtableGetIterator(c->db->keyspace);
     // key 的匹配模式
     allkeys = (pattern[0] == '*' && pattern[1] == '\0');
-    while((de = dictNext(di)) != NULL) {
-        sds key = dictGetKey(de);
+    while((e = kvtableNext(ki)) != NULL) {
+        sds key = kvtableGetKey(e);
+        long long when = kvtableGetExpire(e);
         robj *keyobj;
 
         // 检查当前迭代到的 key 是否匹配，如果是的话，将它返回
         if (allkeys || stringmatchlen(pattern,plen,key,sdslen(key),0)) {
             keyobj = createStringObject(key,sdslen(key));
             // 只返回不过期的 key
-            if (expireIfNeeded(c->db,keyobj) == 0) {
+            // （删除迭代器当前所在的节点是安全的）
+            if (when == KVTABLE_NO_EXPIRE ||
+                expireIfNeededAt(c->db,keyobj,when) == 0)
+            {
                 addReplyBulk(c,keyobj);
                 numkeys++;
             }
             decrRefCount(keyobj);
         }
     }
-    dictReleaseIterator(di);
+    kvtableReleaseIterator(ki);
 
     setDeferredMultiBulkLength(c,replylen,numkeys);
 }
 
+/* This callback is used by scanGenericCommand in order to collect elements
+ * returned by the dictionary iterator into a list. */
+/*
+ * scanGenericCommand 使用的回调函数，
+ * 将字典迭代器返回的元素收集到列表中。
+ */
+void scanCallback(void *privdata, const dictEntry *de) {
+    void **pd = (void**) privdata;
+    list *keys = pd[0];
+    robj *o = pd[1];
+    robj *key, *val = NULL;
+
+    if (o->type == REDIS_SET) {
+        key = dictGetKey(de);
+        incrRefCount(key);
+    } else if (o->type == REDIS_HASH) {
+        key = dictGetKey(de);
+        incrRefCount(key);
+        val = dictGetVal(de);
+        incrRefCount(val);
+    } else if (o->type == REDIS_ZSET) {
+        key = dictGetKey(de);
+        incrRefCount(key);
+        val = createStringObjectFromLongDouble(*(double*)dictGetVal(de));
+    } else {
+        redisPanic("Type not handled in SCAN callback.");
+    }
+
+    listAddNodeTail(keys, key);
+    if (val) listAddNodeTail(keys, val);
+}
+
+/* The same for the keys returned by kvtableScan() in the SCAN command. */
+/*
+ * SCAN 命令使用的回调函数，将键空间中的键收集到列表中。
+ */
+void keyspaceScanCallback(void *privdata, const kvEntry *e) {
+    list *keys = privdata;
+    sds sdskey = kvtableGetKey(e);
+
+    listAddNodeTail(keys, createStringObject(sdskey, sdslen(sdskey)));
+}
+
+/* Try to parse a SCAN cursor stored at object 'o':
+ * if the cursor is valid, store it as unsigned integer into *cursor and
+ * returns REDIS_OK. Otherwise return REDIS_ERR and send an error to the
+ * client. */
+int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor) {
+    char *eptr;
+
+    /* Use strtoul() because we need an *unsigned* long, so
+     * getLongLongFromObject() does not cover the whole cursor space. */
+    errno = 0;
+    *cursor = strtoul(o->ptr, &eptr, 10);
+    if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' || errno == ERANGE)
+    {
+        addReplyError(c, "invalid cursor");
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* This command implements SCAN, HSCAN and SSCAN commands.
+ * If object 'o' is passed, then it must be a Hash, Set or Zset object, otherwise
+ * if 'o' is NULL the command will operate on the dictionary associated with
+ * the current database.
+ *
+ * SCAN 、 SSCAN 、 HSCAN 和 ZSCAN 命令的实现。
+ * 如果给定了对象 o ，那么它必须是一个哈希、集合或者有序集合对象，
+ * 如果 o 为 NULL ，那么命令迭代当前数据库的键空间。
+ *
+ * When 'o' is not NULL the function assumes that the first argument in
+ * the client arguments vector is a key so it skips it before iterating
+ * in order to parse options.
+ *
+ * In the case of a Hash object the function returns both the field and value
+ * of every element on the Hash. */
+void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
+    int rv;
+    int i, j;
+    char buf[REDIS_LONGSTR_SIZE];
+    list *keys = listCreate();
+    listNode *node, *nextnode;
+    long count = 10;
+    sds pat;
+    int patlen, use_pattern = 0;
+    dict *ht;
+
+    /* Object must be NULL (to iterate keys names), or the type of the object
+     * must be Set, Sorted Set, or Hash. */
+    redisAssert(o == NULL || o->type == REDIS_SET || o->type == REDIS_HASH ||
+                o->type == REDIS_ZSET);
+
+    /* Set i to the first option argument. The previous one is the cursor. */
+    // 跳过命令名、（键名）和游标参数
+    i = (o == NULL) ? 2 : 3; /* Skip the key argument if needed. */
+
+    /* Step 1: Parse options. */
+    // 1) 分析 COUNT 和 MATCH 选项
+    while (i < c->argc) {
+        j = c->argc - i;
+        if (!strcasecmp(c->argv[i]->ptr, "count") && j >= 2) {
+            if (getLongFromObjectOrReply(c, c->argv[i+1], &count, NULL)
+                != REDIS_OK)
+            {
+                goto cleanup;
+            }
+
+            if (count < 1) {
+                addReply(c,shared.syntaxerr);
+                goto cleanup;
+            }
+
+            i += 2;
+        } else if (!strcasecmp(c->argv[i]->ptr, "match") && j >= 2) {
+            pat = c->argv[i+1]->ptr;
+            patlen = sdslen(pat);
+
+            /* The pattern always matches if it is exactly "*", so it is
+             * equivalent to disabling it. */
+            use_pattern = !(pat[0] == '*' && patlen == 1);
+
+            i += 2;
+        } else {
+            addReply(c,shared.syntaxerr);
+            goto cleanup;
+        }
+    }
+
+    /* Step 2: Iterate the collection.
+     *
+     * Note that if the object is encoded with a listpack or an intset there
+     * is no cursor state to keep: such objects are small by definition, so
+     * we return everything in a single call, with a zero cursor. */
+    // 2) 迭代集合
+    // 以 listpack 或者 intset 编码的对象都很小，所以一次返回全部元素，
+    // 并将游标设为 0
+
+    /* Handle the case of a hash table. */
+    ht = NULL;
+    if (o == NULL) {
+        /* The keyspace. */
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
+        ht = o->ptr;
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
+        ht = o->ptr;
+        count *= 2; /* We return key / value for this type. */
+    } else if (o->type == REDIS_ZSET && o->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = o->ptr;
+        ht = zs->dict;
+        count *= 2; /* We return key / value for this type. */
+    }
+
+    if (o == NULL) {
+        /* Every iteration returns the keys of a bucket chain. */
+        long maxiterations = count*10;
+
+        do {
+            cursor = kvtableScan(c->db->keyspace, cursor,
+                                 keyspaceScanCallback, keys);
+        } while (cursor &&
+              maxiterations-- &&
+              listLength(keys) < (unsigned long)count);
+    } else if (ht) {
+        void *privdata[2];
+        /* We set the max number of iterations to ten times the specified
+         * COUNT, so if the hash table is in a pathological state (very
+         * sparsely populated) we avoid to block too much time at the cost
+         * of returning no or very few elements. */
+        long maxiterations = count*10;
+
+        /* We pass two pointers to the callback: the list to which it will
+         * add new elements, and the object containing the dictionary so that
+         * it is possible to fetch more data in a type-dependent way. */
+        privdata[0] = keys;
+        privdata[1] = o;
+        do {
+            cursor = dictScan(ht, cursor, scanCallback, privdata);
+        } while (cursor &&
+              maxiterations-- &&
+              listLength(keys) < (unsigned long)count);
+    } else if (o->type == REDIS_SET) {
+        int pos = 0;
+        int64_t ll;
+
+        while(intsetGet(o->ptr,pos++,&ll))
+            listAddNodeTail(keys,createStringObjectFromLongLong(ll));
+        cursor = 0;
+    } else if (o->type == REDIS_HASH || o->type == REDIS_ZSET) {
+        unsigned char *p = lpFirst(o->ptr);
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vll;
+
+        while(p) {
+            lpGetValue(p,&vstr,&vlen,&vll);
+            listAddNodeTail(keys,
+                (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
+                                 createStringObjectFromLongLong(vll));
+            p = lpNext(o->ptr,p);
+        }
+        cursor = 0;
+    } else {
+        redisPanic("Not handled encoding in SCAN.");
+    }
+
+    /* Step 3: Filter elements. */
+    // 3) 过滤不匹配模式的元素，以及已经过期的键
+    node = listFirst(keys);
+    while (node) {
+        robj *kobj = listNodeValue(node);
+        nextnode = listNextNode(node);
+        int filter = 0;
+
+        /* Filter element if it does not match the pattern. */
+        if (!filter && use_pattern) {
+            if (sdsEncodedObject(kobj)) {
+                if (!stringmatchlen(pat, patlen, kobj->ptr, sdslen(kobj->ptr), 0))
+                    filter = 1;
+            } else {
+                char buf[REDIS_LONGSTR_SIZE];
+                int len;
+
+                redisAssert(kobj->encoding == REDIS_ENCODING_INT);
+                len = ll2string(buf,sizeof(buf),(long)kobj->ptr);
+                if (!stringmatchlen(pat, patlen, buf, len, 0)) filter = 1;
+            }
+        }
+
+        /* Filter element if it is an expired key. */
+        if (!filter && o == NULL && expireIfNeeded(c->db, kobj)) filter = 1;
+
+        /* Remove the element and its associted value if needed. */
+        if (filter) {
+            decrRefCount(kobj);
+            listDelNode(keys, node);
+        }
+
+        /* If this is a hash or a sorted set, we have a flat list of
+         * key-value elements, so if this element was filtered, remove the
+         * value, or skip it if it was not filtered: we only match keys. */
+        if (o && (o->type == REDIS_ZSET || o->type == REDIS_HASH)) {
+            node = nextnode;
+            nextnode = listNextNode(node);
+            if (filter) {
+                kobj = listNodeValue(node);
+                decrRefCount(kobj);
+                listDelNode(keys, node);
+            }
+        }
+        node = nextnode;
+    }
+
+    /* Step 4: Reply to the client. */
+    // 4) 回复新的游标，以及迭代到的元素
+    addReplyMultiBulkLen(c, 2);
+    rv = snprintf(buf, sizeof(buf), "%lu", cursor);
+    redisAssert(rv < (int)sizeof(buf));
+    addReplyBulkCBuffer(c, buf, rv);
+
+    addReplyMultiBulkLen(c, listLength(keys));
+    while ((node = listFirst(keys)) != NULL) {
+        robj *kobj = listNodeValue(node);
+        addReplyBulk(c, kobj);
+        decrRefCount(kobj);
+        listDelNode(keys, node);
+    }
+
+cleanup:
+    listSetFreeMethod(keys,decrRefCount);
+    listRelease(keys);
+}
+
+/* The SCAN command completely relies on scanGenericCommand. */
+/*
+ * SCAN 命令的实现
+ */
+void scanCommand(redisClient *c) {
+    unsigned long cursor;
+    if (parseScanCursorOrReply(c,c->argv[1],&cursor) == REDIS_ERR) return;
+    scanGenericCommand(c,NULL,cursor);
+}
+
 /*
  * DBSIZE 命令的实现
  *
  * 返回数据库键值对数量
  */
 void dbsizeCommand(redisClient *c) {
-    addReplyLongLong(c,dictSize(c->db->dict));
+    addReplyLongLong(c,kvtableSize(c->db->keyspace));
 }
 
 /*
@@ -514,6 +914,7 @@ void typeCommand(redisClient *c) {
         case REDIS_SET: type = "set"; break;
         case REDIS_ZSET: type = "zset"; break;
         case REDIS_HASH: type = "hash"; break;
+        case REDIS_STREAM: type = "stream"; break;
         default: type = "unknown"; break;
         }
     }
@@ -673,23 +1074,24 @@ void moveCommand(redisClient *c) {
  * 移除 key 的过期时间
  */
 int removeExpire(redisDb *db, robj *key) {
-    /* An expire may only be removed if there is a corresponding entry in the
-     * main dict. Otherwise, the key will never be freed. */
-    redisAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictDelete(db->expires,key->ptr) == DICT_OK;
+    kvEntry *e = kvtableFind(db->keyspace,key->ptr);
+
+    /* An expire may only be removed from an existing key. */
+    redisAssertWithInfo(NULL,key,e != NULL);
+    if (kvtableGetExpire(e) == KVTABLE_NO_EXPIRE) return 0;
+    kvtableSetExpire(db->keyspace,e,KVTABLE_NO_EXPIRE);
+    return 1;
 }
 
 /*
  * 为 key 设置过期时间
  */
 void setExpire(redisDb *db, robj *key, long long when) {
-    dictEntry *kde, *de;
+    kvEntry *e = kvtableFind(db->keyspace,key->ptr);
 
-    /* Reuse the sds from the main dict in the expire dict */
-    kde = dictFind(db->dict,key->ptr);
-    redisAssertWithInfo(NULL,key,kde != NULL);
-    de = dictReplaceRaw(db->expires,dictGetKey(kde));
-    dictSetSignedIntegerVal(de,when);
+    // 过期时间保存在键空间节点中
+    redisAssertWithInfo(NULL,key,e != NULL);
+    kvtableSetExpire(db->keyspace,e,when);
 }
 
 /* Return the expire time of the specified key, or -1 if no expire
@@ -701,22 +1103,16 @@ void setExpire(redisDb *db, robj *key, long long when) {
  * 那么返回 -1
  */
 long long getExpire(redisDb *db, robj *key) {
-    dictEntry *de;
+    kvEntry *e;
 
     /* No expire? return ASAP */
-    // 数据库的过期记录中没有任何数据
-    // 或者，过期记录中没有和 key 关联的时间
+    // 数据库中没有带过期时间的 key ，或者 key 不存在，
     // 那么直接返回
-    if (dictSize(db->expires) == 0 ||
-       (de = dictFind(db->expires,key->ptr)) == NULL) return -1;
+    if (kvtableVolatileSize(db->keyspace) == 0 ||
+       (e = kvtableFind(db->keyspace,key->ptr)) == NULL) return -1;
 
-    /* The entry was found in the expire dict, this means it should also
-     * be present in the main dict (safety check). */
-    // 确保 key 在数据库中必定存在（安全性检查）
-    redisAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-
-    // 取出字典值中保存的整数值
-    return dictGetSignedIntegerVal(de);
+    // 取出节点中保存的过期时间（没有过期时间时为 -1）
+    return kvtableGetExpire(e);
 }
 
 /* Propagate expires into slaves and the AOF file.
@@ -763,8 +1159,15 @@ void propagateExpire(redisDb *db, robj *key) {
  */
 int expireIfNeeded(redisDb *db, robj *key) {
     // 取出 key 的过期时间
-    long long when = getExpire(db,key);
+    return expireIfNeededAt(db,key,getExpire(db,key));
+}
 
+/* Like expireIfNeeded() but 'when' is the already known expire time of
+ * the key, or -1 if the key is not volatile. */
+/*
+ * 和 expireIfNeeded() 一样，但 key 的过期时间 when 由调用者给出
+ */
+int expireIfNeededAt(redisDb *db, robj *key, long long when) {
     // key 没有过期时间，直接返回
     if (when < 0) return 0; /* No expire for this key */
 
@@ -823,7 +1226,7 @@ int expireIfNeeded(redisDb *db, robj *key) {
  */
 void expireGenericCommand(redisClient *c, long long basetime, int unit) {
 
-    dictEntry *de;
+    kvEntry *e;
 
     robj *key = c->argv[1], 
          *param = c->argv[2];
@@ -840,8 +1243,8 @@ void expireGenericCommand(redisClient *c, long long basetime, int unit) {
     when += basetime;
 
     // 取出键
-    de = dictFind(c->db->dict,key->ptr);
-    if (de == NULL) {
+    e = kvtableFind(c->db->keyspace,key->ptr);
+    if (e == NULL) {
         // 键不存在，返回 0
         addReply(c,shared.czero);
         return;
@@ -872,7 +1275,7 @@ void expireGenericCommand(redisClient *c, long long basetime, int unit) {
     // 否则，设置 key 的过期时间
     } else {
 
-        setExpire(c->db,key,when);
+        kvtableSetExpire(c->db->keyspace,e,when);
 
         addReply(c,shared.cone);
         signalModifiedKey(c->db,key);
@@ -928,10 +1331,7 @@ void pttlCommand(redisClient *c) {
 }
 
 void persistCommand(redisClient *c) {
-    dictEntry *de;
-
-    de = dictFind(c->db->dict,c->argv[1]->ptr);
-    if (de == NULL) {
+    if (!dbExists(c->db,c->argv[1])) {
         addReply(c,shared.czero);
     } else {
         if (removeExpire(c->db,c->argv[1])) {
@@ -1016,6 +1416,51 @@ int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *num
     return keys;
 }
 
+/* XREAD [BLOCK <milliseconds>] [COUNT <count>] [GROUP <group> <consumer>]
+ *       STREAMS key_1 key_2 ... key_N ID_1 ID_2 ... ID_N
+ *
+ * The keys are the first half of the arguments after STREAMS. */
+int *xreadGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags) {
+    int i, num = 0, *keys, streams_pos = -1;
+    REDIS_NOTUSED(cmd);
+    REDIS_NOTUSED(flags);
+
+    /* We need to seek the last argument that contains "STREAMS", because
+     * other arguments before may contain it (for example the group name). */
+    for (i = 1; i < argc; i++) {
+        char *arg = argv[i]->ptr;
+
+        if (!strcasecmp(arg,"block")) {
+            i++; /* Skip option argument. */
+        } else if (!strcasecmp(arg,"count")) {
+            i++; /* Skip option argument. */
+        } else if (!strcasecmp(arg,"group")) {
+            i += 2; /* Skip option argument. */
+        } else if (!strcasecmp(arg,"noack")) {
+            /* Nothing to do. */
+        } else if (!strcasecmp(arg,"streams")) {
+            streams_pos = i;
+            break;
+        } else {
+            break; /* Syntax error. */
+        }
+    }
+    if (streams_pos != -1) num = argc - streams_pos - 1;
+
+    /* Syntax error. */
+    if (streams_pos == -1 || num == 0 || num % 2 != 0) {
+        *numkeys = 0;
+        return NULL;
+    }
+    num /= 2; /* We have half the keys as there are arguments because
+                 there are also the IDs, one per key. */
+
+    keys = zmalloc(sizeof(int)*num);
+    for (i = streams_pos+1; i < argc-num; i++) keys[i-streams_pos-1] = i;
+    *numkeys = num;
+    return keys;
+}
+
 /* Slot to Key API. This is used by Redis Cluster in order to obtain in
  * a fast way a key that belongs to a specified hash slot. This is useful
  * while rehashing the cluster. */
@@ -107,8 +107,8 @@ void mixObjectDigest(unsigned char *digest, robj *o) {
 void computeDatasetDigest(unsigned char *final) {
     unsigned char digest[20];
     char buf[128];
-    dictIterator *di = NULL;
-    dictEntry *de;
+    kvtableIterator *ki = NULL;
+    kvEntry *e;
     int j;
     uint32_t aux;
 
@@ -117,8 +117,8 @@ void computeDatasetDigest(unsigned char *final) {
     for (j = 0; j < server.dbnum; j++) {
         redisDb *db = server.db+j;
 
-        if (dictSize(db->dict) == 0) continue;
-        di = dictGetIterator(db->dict);
+        if (kvtableSize(db->keyspace) == 0) continue;
+        ki = kvtableGetIterator(db->keyspace);
 
         /* hash the DB id, so the same dataset moved in a different
          * DB will lead to a different digest */
@@ -126,22 +126,22 @@ void computeDatasetDigest(unsigned char *final) {
         mixDigest(final,&aux,sizeof(aux));
 
         /* Iterate this DB writing every entry */
-        while((de = dictNext(di)) != NULL) {
+        while((e = kvtableNext(ki)) != NULL) {
             sds key;
             robj *keyobj, *o;
             long long expiretime;
 
             memset(digest,0,20); /* This key-val digest */
-            key = dictGetKey(de);
+            key = kvtableGetKey(e);
             keyobj = createStringObject(key,sdslen(key));
 
             mixDigest(digest,key,sdslen(key));
 
-            o = dictGetVal(de);
+            o = kvtableGetVal(e);
 
             aux = htonl(o->type);
             mixDigest(digest,&aux,sizeof(aux));
-            expiretime = getExpire(db,keyobj);
+            expiretime = kvtableGetExpire(e);
 
             /* Save the key and associated value */
             if (o->type == REDIS_STRING) {
@@ -166,7 +166,7 @@ void computeDatasetDigest(unsigned char *final) {
             } else if (o->type == REDIS_ZSET) {
                 unsigned char eledigest[20];
 
-                if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+                if (o->encoding == REDIS_ENCODING_LISTPACK) {
                     unsigned char *zl = o->ptr;
                     unsigned char *eptr, *sptr;
                     unsigned char *vstr;
@@ -174,13 +174,13 @@ void computeDatasetDigest(unsigned char *final) {
                     long long vll;
                     double score;
 
-                    eptr = ziplistIndex(zl,0);
+                    eptr = lpFirst(zl);
                     redisAssert(eptr != NULL);
-                    sptr = ziplistNext(zl,eptr);
+                    sptr = lpNext(zl,eptr);
                     redisAssert(sptr != NULL);
 
                     while (eptr != NULL) {
-                        redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+                        redisAssert(lpGetValue(eptr,&vstr,&vlen,&vll));
                         score = zzlGetScore(sptr);
 
                         memset(eledigest,0,20);
@@ -233,6 +233,31 @@ void computeDatasetDigest(unsigned char *final) {
                     xorDigest(digest,eledigest,20);
                 }
                 hashTypeReleaseIterator(hi);
+            } else if (o->type == REDIS_STREAM) {
+                stream *s = o->ptr;
+                streamIterator si;
+                streamID id;
+                int64_t numfields;
+
+                /* Entries are ordered: mix them in sequence, together with
+                 * the last ID. Consumer groups are not part of the digest. */
+                streamIteratorStart(&si,s,NULL,NULL,0);
+                while(streamIteratorGetID(&si,&id,&numfields)) {
+                    streamEncodeID(buf,&id);
+                    mixDigest(digest,buf,sizeof(streamID));
+                    while(numfields--) {
+                        unsigned char *field, *value;
+                        int64_t field_len, value_len;
+
+                        streamIteratorGetField(&si,&field,&value,
+                                               &field_len,&value_len);
+                        mixDigest(digest,field,field_len);
+                        mixDigest(digest,value,value_len);
+                    }
+                }
+                streamIteratorStop(&si);
+                streamEncodeID(buf,&s->last_id);
+                mixDigest(digest,buf,sizeof(streamID));
             } else {
                 redisPanic("Unknown object type");
             }
@@ -242,7 +267,7 @@ void computeDatasetDigest(unsigned char *final) {
             xorDigest(final,digest,20);
             decrRefCount(keyobj);
         }
-        dictReleaseIterator(di);
+        kvtableReleaseIterator(ki);
     }
 }
 
@@ -261,7 +286,7 @@ void debugCommand(redisClient *c) {
             addReply(c,shared.err);
             return;
         }
-        emptyDb();
+        emptyDb(REDIS_EMPTYDB_NO_FLAGS);
         if (rdbLoad(server.rdb_filename) != REDIS_OK) {
             addReplyError(c,"Error trying to load the RDB dump");
             return;
@@ -269,7 +294,7 @@ void debugCommand(redisClient *c) {
         redisLog(REDIS_WARNING,"DB reloaded by DEBUG RELOAD");
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"loadaof")) {
-        emptyDb();
+        emptyDb(REDIS_EMPTYDB_NO_FLAGS);
         if (loadAppendOnlyFile(server.aof_filename) != REDIS_OK) {
             addReply(c,shared.err);
             return;
@@ -278,24 +303,45 @@ void debugCommand(redisClient *c) {
         redisLog(REDIS_WARNING,"Append Only File loaded by DEBUG LOADAOF");
         addReply(c,shared.ok);
     } else if (!strcasecmp(c->argv[1]->ptr,"object") && c->argc == 3) {
-        dictEntry *de;
+        kvEntry *e;
         robj *val;
         char *strenc;
 
-        if ((de = dictFind(c->db->dict,c->argv[2]->ptr)) == NULL) {
+        if ((e = kvtableFind(c->db->keyspace,c->argv[2]->ptr)) == NULL) {
             addReply(c,shared.nokeyerr);
             return;
         }
-        val = dictGetVal(de);
+        char extra[128] = {0};
+
+        val = kvtableGetVal(e);
         strenc = strEncoding(val->encoding);
 
+        // 对于 quicklist ，额外返回节点数量和压缩情况
+        if (val->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = val->ptr;
+            quicklistNode *node;
+            unsigned long sz = 0;
+            unsigned int compressed = 0;
+
+            for (node = ql->head; node; node = node->next) {
+                sz += node->sz;
+                if (node->encoding == QUICKLIST_NODE_ENCODING_LZF)
+                    compressed++;
+            }
+            snprintf(extra,sizeof(extra),
+                " ql_nodes:%u ql_avg_node:%.2f ql_ziplist_max:%d"
+                " ql_compressed_nodes:%u ql_uncompressed_size:%lu",
+                ql->len, ql->len ? (double)ql->count/ql->len : 0,
+                ql->fill, compressed, sz);
+        }
+
         addReplyStatusFormat(c,
             "Value at:%p refcount:%d "
             "encoding:%s serializedlength:%lld "
-            "lru:%d lru_seconds_idle:%lu",
+            "lru:%d lru_seconds_idle:%llu%s",
             (void*)val, val->refcount,
             strenc, (long long) rdbSavedObjectLen(val),
-            val->lru, estimateObjectIdleTime(val));
+            val->lru, estimateObjectIdleTime(val)/1000, extra);
     } else if (!strcasecmp(c->argv[1]->ptr,"populate") && c->argc == 3) {
         long keys, j;
         robj *key, *val;
@@ -366,7 +412,7 @@ void _redisAssertPrintClientInfo(redisClient *c) {
         char *arg;
 
         if (c->argv[j]->type == REDIS_STRING &&
-            c->argv[j]->encoding == REDIS_ENCODING_RAW)
+            sdsEncodedObject(c->argv[j]))
         {
             arg = (char*) c->argv[j]->ptr;
         } else {
@@ -383,7 +429,7 @@ void redisLogObjectDebugInfo(robj *o) {
     redisLog(REDIS_WARNING,"Object type: %d", o->type);
     redisLog(REDIS_WARNING,"Object encoding: %d", o->encoding);
     redisLog(REDIS_WARNING,"Object refcount: %d", o->refcount);
-    if (o->type == REDIS_STRING && o->encoding == REDIS_ENCODING_RAW) {
+    if (o->type == REDIS_STRING && sdsEncodedObject(o)) {
         redisLog(REDIS_WARNING,"Object raw string len: %d", sdslen(o->ptr));
         if (sdslen(o->ptr) < 4096)
             redisLog(REDIS_WARNING,"Object raw string content: \"%s\"", (char*)o->ptr);
@@ -397,6 +443,9 @@ void redisLogObjectDebugInfo(robj *o) {
         redisLog(REDIS_WARNING,"Sorted set size: %d", (int) zsetLength(o));
         if (o->encoding == REDIS_ENCODING_SKIPLIST)
             redisLog(REDIS_WARNING,"Skiplist level: %d", (int) ((zset*)o->ptr)->zsl->level);
+    } else if (o->type == REDIS_STREAM) {
+        redisLog(REDIS_WARNING,"Stream length: %llu", (unsigned long long) ((stream*)o->ptr)->length);
+        redisLog(REDIS_WARNING,"Stream blocks: %lu", ((stream*)o->ptr)->index->length);
     }
 }
 
@@ -654,12 +703,12 @@ void logCurrentClient(void) {
      * selected DB, and if so print info about the associated object. */
     if (cc->argc >= 1) {
         robj *val, *key;
-        dictEntry *de;
+        kvEntry *e;
 
         key = getDecodedObject(cc->argv[1]);
-        de = dictFind(cc->db->dict, key->ptr);
-        if (de) {
-            val = dictGetVal(de);
+        e = kvtableFind(cc->db->keyspace, key->ptr);
+        if (e) {
+            val = kvtableGetVal(e);
             redisLog(REDIS_WARNING,"key '%s' found in DB containing the following object:", key->ptr);
             redisLogObjectDebugInfo(val);
         }
@@ -901,6 +901,291 @@ dictEntry *dictGetRandomKey(dict *d)
     return he;
 }
 
+/* This function samples the dictionary to return a few keys from random
+ * locations.
+ *
+ * It does not guarantee to return all the keys specified in 'count', nor
+ * it does guarantee to return non-duplicated elements, however it will make
+ * some effort to do both things.
+ *
+ * Returned pointers to hash table entries are stored into 'des' that
+ * points to an array of dictEntry pointers. The array must have room for
+ * at least 'count' elements, that is the argument we pass to the function
+ * to tell how many random elements we need.
+ *
+ * The function returns the number of items stored into 'des', that may
+ * be less than 'count' if the hash table has less than 'count' elements
+ * inside, or if not enough elements were found in a reasonable amount of
+ * steps.
+ *
+ * Note that this function is not suitable when you need a good distribution
+ * of the returned items, but only when you need to "sample" a given number
+ * of continuous elements to run some kind of algorithm or to produce
+ * statistics. However the function is much faster than dictGetRandomKey()
+ * at producing N elements: the buckets are visited sequentially, starting
+ * from a random position, instead of paying a cache miss for every random
+ * probe, and sparse tables don't require many probes to find a non empty
+ * bucket. */
+/*
+ * 从字典的一个随机位置开始，连续地取出最多 count 个节点，保存到 des 数组中。
+ *
+ * 函数不保证返回 count 个节点，也不保证节点不重复。
+ * 返回值为实际保存到 des 中的节点数量。
+ *
+ * 返回的节点分布不如 dictGetRandomKey() 均匀，
+ * 但是按顺序访问连续的桶，比调用 N 次 dictGetRandomKey() 要快得多，
+ * 适合用于采样。
+ *
+ * T = O(N)
+ */
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
+    unsigned long j; /* internal hash table id, 0 or 1. */
+    unsigned long tables; /* 1 or 2 tables? */
+    unsigned long stored = 0, maxsizemask;
+    unsigned long maxsteps;
+    unsigned long i, emptylen = 0; /* Continuous empty entries so far. */
+
+    if (dictSize(d) < count) count = dictSize(d);
+    maxsteps = count*10;
+
+    /* Try to do a rehashing work proportional to 'count'. */
+    // 进行和 count 成比例的 rehash 工作
+    for (j = 0; j < count; j++) {
+        if (dictIsRehashing(d))
+            _dictRehashStep(d);
+        else
+            break;
+    }
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxsizemask = d->ht[0].sizemask;
+    if (tables > 1 && maxsizemask < d->ht[1].sizemask)
+        maxsizemask = d->ht[1].sizemask;
+
+    /* Pick a random point inside the larger table. */
+    // 在较大的哈希表中随机选取一个起点
+    i = random() & maxsizemask;
+    while(stored < count && maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            dictEntry *he;
+
+            /* Invariant of the dict.c rehashing: up to the indexes already
+             * visited in ht[0] during the rehashing, there are no populated
+             * buckets, so we can skip ht[0] for indexes between 0 and idx-1. */
+            // rehash 过程中，ht[0] 中索引小于 rehashidx 的桶都是空的
+            if (tables == 2 && j == 0 && i < (unsigned long) d->rehashidx) {
+                /* Moreover, if we are currently out of range in the second
+                 * table, there will be no elements in both tables up to
+                 * the current rehashing index, so we jump if possible.
+                 * (this happens when going from big to small table). */
+                if (i >= d->ht[1].size) i = d->rehashidx;
+                continue;
+            }
+            if (i >= d->ht[j].size) continue; /* Out of range for this table. */
+            he = d->ht[j].table[i];
+
+            /* Count contiguous empty buckets, and jump to other
+             * locations if they reach 'count' (with a minimum of 5). */
+            // 连续遇到太多空桶时，跳到另一个随机位置
+            if (he == NULL) {
+                emptylen++;
+                if (emptylen >= 5 && emptylen > count) {
+                    i = random() & maxsizemask;
+                    emptylen = 0;
+                }
+            } else {
+                emptylen = 0;
+                while (he) {
+                    /* Collect all the elements of the buckets found non
+                     * empty while iterating. */
+                    *des = he;
+                    des++;
+                    he = he->next;
+                    stored++;
+                    if (stored == count) return stored;
+                }
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
+/* This is like dictGetRandomKey() from the POV of the API, but will do more
+ * work to ensure a better distribution of the returned element.
+ *
+ * This function improves the distribution because the dictGetRandomKey()
+ * problem is that it selects a random bucket, then it selects a random
+ * element from the chain in the bucket. However elements being in different
+ * chain lengths will have different probabilities of being reported. With
+ * this function instead what we do is to consider a "linear" range of the
+ * table that may be constituted of N buckets with chains of different
+ * lengths appearing one after the other. Then we report a random element
+ * in the range. In this way we smooth away the problem of different chain
+ * lengths. It is also cheaper on sparse tables, where dictGetRandomKey()
+ * probes many empty buckets. */
+/*
+ * 从字典中返回一个随机节点，分布比 dictGetRandomKey() 更均匀：
+ * 先用 dictGetSomeKeys() 取出一段连续的节点，再从中随机选择一个。
+ *
+ * 如果字典为空，返回 NULL 。
+ */
+#define GETFAIR_NUM_ENTRIES 15
+dictEntry *dictGetFairRandomKey(dict *d) {
+    dictEntry *entries[GETFAIR_NUM_ENTRIES];
+    unsigned int count = dictGetSomeKeys(d,entries,GETFAIR_NUM_ENTRIES);
+
+    /* Note that dictGetSomeKeys() may return zero elements in an unlucky
+     * run even if there are actually elements inside the hash table. So
+     * when we get zero, we call the true dictGetRandomKey() that will always
+     * yield the element if the hash table has at least one. */
+    if (count == 0) return dictGetRandomKey(d);
+    return entries[random() % count];
+}
+
+/* Function to reverse bits. Algorithm from:
+ * http://graphics.stanford.edu/~seander/bithacks.html#ReverseParallel */
+static unsigned long rev(unsigned long v) {
+    unsigned long s = 8 * sizeof(v); // bit size; must be power of 2
+    unsigned long mask = ~0;
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+/* dictScan() is used to iterate over the elements of a dictionary.
+ *
+ * dictScan() 用于迭代字典中的元素。
+ *
+ * Iterating works in the following way:
+ *
+ * 1) Initially you call the function using a cursor (v) value of 0.
+ * 2) The function performs one step of the iteration, and returns the
+ *    new cursor value that you must use in the next call.
+ * 3) When the returned cursor is 0, the iteration is complete.
+ *
+ * 迭代的方式如下：
+ * 1) 一开始使用 0 作为游标（v）调用函数。
+ * 2) 函数执行一步迭代，并返回下次调用时要使用的新游标。
+ * 3) 当函数返回的游标为 0 时，迭代完成。
+ *
+ * The function guarantees that all the elements that are present in the
+ * dictionary from the start to the end of the iteration are returned.
+ * However it is possible that some element is returned multiple times.
+ *
+ * 函数保证在迭代开始到结束期间一直存在于字典中的元素都会被返回，
+ * 但同一个元素可能会被返回多次。
+ *
+ * For every element returned, the callback 'fn' is called with 'privdata'
+ * as its first argument and the dictionary entry 'de' as second argument.
+ *
+ * HOW IT WORKS.
+ *
+ * The cursor is a bucket index whose bits are incremented starting from the
+ * most significant one (reverse binary increment), instead of from the
+ * least significant one as in a normal increment.
+ *
+ * Hash tables are always power of two in size and use chaining, so the
+ * position of an element in a given table is the bitwise AND between its
+ * hash and SIZE-1. When the table grows, the elements of bucket N are
+ * found in the buckets of the bigger table whose low bits are equal to N,
+ * and when it shrinks the buckets sharing the same low bits are merged.
+ * Incrementing the high bits first means that the buckets already visited
+ * are never visited again (at most once more for a shrink) after a resize,
+ * so no element is missed whatever happens between two calls.
+ *
+ * 游标是一个桶索引，但它是从最高位开始进位的（反向二进制递增）。
+ * 因为哈希表的大小总是 2 的幂，元素的位置由哈希值的低位决定，
+ * 所以不论两次调用之间哈希表是扩展还是收缩，
+ * 已经访问过的桶都不会因此丢失元素。
+ *
+ * While rehashing both tables are scanned: the cursor is used to visit the
+ * bucket of the smaller table, and then all the buckets of the bigger table
+ * that are expansions of that bucket.
+ *
+ * 在 rehash 进行期间，两个哈希表都会被扫描：
+ * 先访问小表中游标指向的桶，然后访问大表中由这个桶扩展而来的所有桶。
+ *
+ * T = O(1) amortized per returned element
+ */
+unsigned long dictScan(dict *d,
+                       unsigned long v,
+                       dictScanFunction *fn,
+                       void *privdata)
+{
+    dictht *t0, *t1;
+    const dictEntry *de;
+    unsigned long m0, m1;
+
+    if (dictSize(d) == 0) return 0;
+
+    if (!dictIsRehashing(d)) {
+        t0 = &(d->ht[0]);
+        m0 = t0->sizemask;
+
+        /* Emit entries at cursor */
+        // 返回游标指向的桶中的所有元素
+        de = t0->table[v & m0];
+        while (de) {
+            fn(privdata, de);
+            de = de->next;
+        }
+
+    } else {
+        t0 = &d->ht[0];
+        t1 = &d->ht[1];
+
+        /* Make sure t0 is the smaller and t1 is the bigger table */
+        // 确保 t0 是较小的表，t1 是较大的表
+        if (t0->size > t1->size) {
+            t0 = &d->ht[1];
+            t1 = &d->ht[0];
+        }
+
+        m0 = t0->sizemask;
+        m1 = t1->sizemask;
+
+        /* Emit entries at cursor */
+        de = t0->table[v & m0];
+        while (de) {
+            fn(privdata, de);
+            de = de->next;
+        }
+
+        /* Iterate over indices in larger table that are the expansion
+         * of the index pointed to by the cursor in the smaller table */
+        // 访问大表中由小表游标扩展而来的所有桶
+        do {
+            /* Emit entries at cursor */
+            de = t1->table[v & m1];
+            while (de) {
+                fn(privdata, de);
+                de = de->next;
+            }
+
+            /* Increment bits not covered by the smaller mask */
+            v = (((v | m0) + 1) & ~m0) | (v & m0);
+
+            /* Continue while bits covered by mask difference is non-zero */
+        } while (v & (m0 ^ m1));
+    }
+
+    /* Set unmasked bits so incrementing the reversed cursor
+     * operates on the masked bits of the smaller table */
+    // 设置掩码以外的位，使得反向递增只作用于掩码覆盖的位
+    v |= ~m0;
+
+    /* Increment the reverse cursor */
+    // 反向递增游标
+    v = rev(v);
+    v++;
+    v = rev(v);
+
+    return v;
+}
+
 /* ------------------------- private functions ------------------------------ */
 
 /* Expand the hash table if needed */
@@ -1171,3 +1456,82 @@ dictType dictTypeHeapStringCopyKeyValue = {
     _dictStringDestructor,         /* val destructor */
 };
 #endif
+
+#ifdef DICT_BENCHMARK_MAIN
+
+/* Sampling benchmark: compares dictGetRandomKey() with dictGetSomeKeys().
+ * The keyspace table has its own benchmark in kvtable.c. Build with:
+ * cc -O2 -DDICT_BENCHMARK_MAIN dict.c zmalloc.c -o dict-benchmark
+ * and run "./dict-benchmark <numkeys>" (default 10M keys). */
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+static unsigned int benchHash(const void *key) {
+    return dictGenHashFunction(key,strlen(key));
+}
+
+static int benchKeyCompare(void *privdata, const void *key1, const void *key2) {
+    DICT_NOTUSED(privdata);
+    return strcmp(key1,key2) == 0;
+}
+
+static dictType benchDictType = {
+    benchHash, NULL, NULL, benchKeyCompare, NULL, NULL
+};
+
+static char *benchKey(long j) {
+    char buf[32];
+    int len = snprintf(buf,sizeof(buf),"key:%ld",j);
+    char *key = zmalloc(len+1);
+
+    memcpy(key,buf,len+1);
+    return key;
+}
+
+/* Sample 16 keys at a time with dictGetRandomKey() and dictGetSomeKeys(),
+ * from a full table and from the same table after deleting 90% of it. */
+static void benchSampling(char **keys, long numkeys) {
+    dict *d = dictCreate(&benchDictType,NULL);
+    dictEntry *des[16];
+    long long start, sum = 0;
+    long j, rounds = numkeys/16;
+    int pass, k;
+
+    for (j = 0; j < numkeys; j++) dictAdd(d,keys[j],keys[j]);
+    while (dictIsRehashing(d)) dictRehash(d,100);
+    for (pass = 0; pass < 2; pass++) {
+        start = usec();
+        for (j = 0; j < rounds; j++)
+            for (k = 0; k < 16; k++) sum += (long)dictGetRandomKey(d)->key & 1;
+        printf("%s table: 16 x dictGetRandomKey() %lld ns/sample\n",
+            pass ? "sparse" : "full  ", (usec()-start)*1000/(rounds*16));
+        start = usec();
+        for (j = 0; j < rounds; j++) {
+            unsigned int count = dictGetSomeKeys(d,des,16);
+            for (k = 0; k < (int)count; k++) sum += (long)des[k]->key & 1;
+        }
+        printf("%s table: dictGetSomeKeys(16)    %lld ns/sample (%lld)\n",
+            pass ? "sparse" : "full  ", (usec()-start)*1000/(rounds*16), sum);
+        /* Delete 90% of the keys without letting the table shrink. */
+        for (j = 0; j < numkeys; j++) if (j % 10) dictDelete(d,keys[j]);
+    }
+    dictRelease(d);
+}
+
+int main(int argc, char **argv) {
+    long numkeys = (argc == 2) ? atol(argv[1]) : 10000000;
+    char **keys = zmalloc(sizeof(char*)*numkeys);
+    long j;
+
+    for (j = 0; j < numkeys; j++) keys[j] = benchKey(j);
+    printf("%ld keys\n", numkeys);
+    benchSampling(keys,numkeys);
+    for (j = 0; j < numkeys; j++) zfree(keys[j]);
+    zfree(keys);
+    return 0;
+}
+#endif
@@ -0,0 +1,533 @@
+/* GEO commands -- geospatial indexing on top of sorted sets.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "geohash.h"
+
+/* A geo set is a plain sorted set, where the score of every member is the
+ * 52 bits geohash of its position (see geohash.c). So GEOADD is just a
+ * ZADD, propagated to the AOF and the slaves as such, and all the sorted
+ * set commands work on geo sets.
+ *
+ * Radius queries scan the score ranges of the cell of the center and of
+ * its neighbors: O(log(N)+M) with N elements in the set and M elements in
+ * the scanned cells, instead of a full scan of the set.
+ *
+ * 地理位置集合就是普通的有序集，每个成员的分值是它的位置的 52 位 geohash 。
+ * GEOADD 就是一个 ZADD ，并以 ZADD 的形式传播到 AOF 和附属节点。
+ * 半径查询只扫描中心所在格子以及周围格子的分值范围，
+ * 复杂度为 O(log(N)+M) 。 */
+
+/* Points found by a radius query. */
+typedef struct geoPoint {
+    double longitude;
+    double latitude;
+    double dist;    /* Distance from the center, in meters. */
+    double score;
+    sds member;
+} geoPoint;
+
+typedef struct geoArray {
+    geoPoint *array;
+    size_t buckets;
+    size_t used;
+} geoArray;
+
+/* ------------------------------ Helpers -------------------------------- */
+
+static geoArray *geoArrayCreate(void) {
+    geoArray *ga = zmalloc(sizeof(*ga));
+
+    ga->array = NULL;
+    ga->buckets = 0;
+    ga->used = 0;
+    return ga;
+}
+
+/* Return a new, uninitialized, point at the end of the array. */
+static geoPoint *geoArrayAppend(geoArray *ga) {
+    if (ga->used == ga->buckets) {
+        ga->buckets = (ga->buckets == 0) ? 8 : ga->buckets*2;
+        ga->array = zrealloc(ga->array,sizeof(geoPoint)*ga->buckets);
+    }
+    return ga->array+(ga->used++);
+}
+
+static void geoArrayFree(geoArray *ga) {
+    size_t i;
+
+    for (i = 0; i < ga->used; i++) sdsfree(ga->array[i].member);
+    zfree(ga->array);
+    zfree(ga);
+}
+
+/* Decode the score of a geo set member into its longitude and latitude,
+ * xy[0] and xy[1]. */
+static int decodeGeohash(double bits, double *xy) {
+    GeoHashBits hash = { .bits = (uint64_t)bits, .step = GEO_STEP_MAX };
+
+    return geohashDecodeToLongLatWGS84(hash,xy);
+}
+
+/* Parse the longitude and latitude at argv[0] and argv[1] into xy. */
+static int extractLongLatOrReply(redisClient *c, robj **argv, double *xy) {
+    if (getDoubleFromObjectOrReply(c,argv[0],&xy[0],NULL) != REDIS_OK ||
+        getDoubleFromObjectOrReply(c,argv[1],&xy[1],NULL) != REDIS_OK)
+        return REDIS_ERR;
+    if (xy[0] < GEO_LONG_MIN || xy[0] > GEO_LONG_MAX ||
+        xy[1] < GEO_LAT_MIN || xy[1] > GEO_LAT_MAX)
+    {
+        addReplyErrorFormat(c,"invalid longitude,latitude pair %f,%f",
+            xy[0],xy[1]);
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* Lookup the position of 'member' in the geo set. */
+static int longLatFromMember(robj *zobj, robj *member, double *xy) {
+    double score;
+
+    if (zsetScore(zobj,member,&score) == REDIS_ERR) return REDIS_ERR;
+    if (!decodeGeohash(score,xy)) return REDIS_ERR;
+    return REDIS_OK;
+}
+
+/* Return the number of meters in the unit named by 'unit', or -1 after
+ * replying with an error. */
+static double extractUnitOrReply(redisClient *c, robj *unit) {
+    char *u = unit->ptr;
+
+    if (!strcasecmp(u,"m")) return 1;
+    if (!strcasecmp(u,"km")) return 1000;
+    if (!strcasecmp(u,"ft")) return 0.3048;
+    if (!strcasecmp(u,"mi")) return 1609.34;
+    addReplyError(c,"unsupported unit provided. please use m, km, ft, mi");
+    return -1;
+}
+
+/* Parse the "<radius> <unit>" pair at argv[0] and argv[1]. Returns the
+ * radius in meters, storing the unit in '*conversion', or -1 after
+ * replying with an error. */
+static double extractDistanceOrReply(redisClient *c, robj **argv,
+                                     double *conversion)
+{
+    double distance, to_meters;
+
+    if (getDoubleFromObjectOrReply(c,argv[0],&distance,
+                                   "need numeric radius") != REDIS_OK)
+        return -1;
+    if (distance < 0) {
+        addReplyError(c,"radius cannot be negative");
+        return -1;
+    }
+    if ((to_meters = extractUnitOrReply(c,argv[1])) < 0) return -1;
+    *conversion = to_meters;
+    return distance * to_meters;
+}
+
+/* Distances are replied as bulk strings with 4 decimal digits. */
+static void addReplyDoubleDistance(redisClient *c, double d) {
+    char dbuf[128];
+    int dlen = snprintf(dbuf,sizeof(dbuf),"%.4f",d);
+
+    addReplyBulkCBuffer(c,dbuf,dlen);
+}
+
+/* ------------------------------ Queries -------------------------------- */
+
+/* If the point with the given score is within 'radius' meters from
+ * (lon, lat), append it to 'ga' and return it, otherwise return NULL. */
+static geoPoint *geoAppendIfWithinRadius(geoArray *ga, double lon, double lat,
+                                         double radius, double score)
+{
+    double xy[2], dist;
+    geoPoint *gp;
+
+    if (!decodeGeohash(score,xy)) return NULL;
+    dist = geohashGetDistance(lon,lat,xy[0],xy[1]);
+    if (dist > radius) return NULL;
+
+    gp = geoArrayAppend(ga);
+    gp->longitude = xy[0];
+    gp->latitude = xy[1];
+    gp->dist = dist;
+    gp->score = score;
+    gp->member = NULL;
+    return gp;
+}
+
+/* Append to 'ga' the members with score in [min, max) that are within
+ * 'radius' meters from (lon, lat). Returns the number of points added.
+ *
+ * 将分值在 [min, max) 之内，并且和 (lon, lat) 的距离不超过 radius 米的
+ * 成员添加到 ga ，返回添加的数量。 */
+static int geoGetPointsInRange(robj *zobj, double min, double max,
+                               double lon, double lat, double radius,
+                               geoArray *ga)
+{
+    zrangespec range = { .min = min, .max = max, .minex = 0, .maxex = 1 };
+    size_t origincount = ga->used;
+    geoPoint *gp;
+
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *zl = zobj->ptr, *eptr, *sptr;
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vlong;
+        double score;
+
+        if ((eptr = zzlFirstInRange(zl,range)) == NULL) return 0;
+        sptr = lpNext(zl,eptr);
+        while (eptr) {
+            score = zzlGetScore(sptr);
+            if (score >= max) break;
+            if ((gp = geoAppendIfWithinRadius(ga,lon,lat,radius,score))) {
+                redisAssert(lpGetValue(eptr,&vstr,&vlen,&vlong));
+                gp->member = vstr ? sdsnewlen(vstr,vlen) :
+                                    sdsfromlonglong(vlong);
+            }
+            zzlNext(zl,&eptr,&sptr);
+        }
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = zobj->ptr;
+        zskiplistNode *ln;
+
+        if ((ln = zslFirstInRange(zs->zsl,range)) == NULL) return 0;
+        while (ln && ln->score < max) {
+            if ((gp = geoAppendIfWithinRadius(ga,lon,lat,radius,ln->score))) {
+                robj *o = getDecodedObject(ln->obj);
+
+                gp->member = sdsdup(o->ptr);
+                decrRefCount(o);
+            }
+            ln = ln->level[0].forward;
+        }
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+    return ga->used - origincount;
+}
+
+/* Append to 'ga' the points of the cells of 'n' within 'radius' meters
+ * from (lon, lat). Returns the number of points added. */
+static int membersOfAllNeighbors(robj *zobj, GeoHashRadius *n, double lon,
+                                 double lat, double radius, geoArray *ga)
+{
+    GeoHashBits cells[9];
+    int j, k, count = 0;
+
+    cells[0] = n->hash;
+    cells[1] = n->neighbors.north;
+    cells[2] = n->neighbors.south;
+    cells[3] = n->neighbors.east;
+    cells[4] = n->neighbors.west;
+    cells[5] = n->neighbors.north_east;
+    cells[6] = n->neighbors.north_west;
+    cells[7] = n->neighbors.south_east;
+    cells[8] = n->neighbors.south_west;
+
+    for (j = 0; j < 9; j++) {
+        GeoHashBits next = cells[j];
+
+        /* Skip the cells excluded by geohashGetAreasByRadiusWGS84(). */
+        if (cells[j].step == 0) continue;
+        /* With big cells some of the neighbors are the same cell. */
+        for (k = 0; k < j; k++) {
+            if (cells[k].step && cells[k].bits == cells[j].bits) break;
+        }
+        if (k != j) continue;
+
+        next.bits++;
+        count += geoGetPointsInRange(zobj,geohashAlign52Bits(cells[j]),
+                                     geohashAlign52Bits(next),
+                                     lon,lat,radius,ga);
+    }
+    return count;
+}
+
+static int sortGeoPointAsc(const void *a, const void *b) {
+    const geoPoint *gpa = a, *gpb = b;
+
+    if (gpa->dist == gpb->dist) return 0;
+    return (gpa->dist < gpb->dist) ? -1 : 1;
+}
+
+static int sortGeoPointDesc(const void *a, const void *b) {
+    return -sortGeoPointAsc(a,b);
+}
+
+/* ------------------------------ Commands ------------------------------- */
+
+/* GEOADD key longitude latitude member [longitude latitude member ...]
+ *
+ * The command is rewritten as a ZADD with the geohashes as scores and
+ * executed as such. */
+void geoaddCommand(redisClient *c) {
+    int elements, argc, i;
+    robj **argv;
+
+    if ((c->argc - 2) % 3 != 0) {
+        addReplyError(c,"syntax error. Try GEOADD key [x1] [y1] [name1] "
+                        "[x2] [y2] [name2] ... ");
+        return;
+    }
+
+    elements = (c->argc - 2) / 3;
+    argc = 2 + elements*2;
+    argv = zcalloc(sizeof(robj*)*argc);
+    argv[0] = createStringObject("zadd",4);
+    argv[1] = c->argv[1];
+    incrRefCount(argv[1]);
+
+    for (i = 0; i < elements; i++) {
+        double xy[2];
+        GeoHashBits hash;
+
+        if (extractLongLatOrReply(c,c->argv+2+i*3,xy) == REDIS_ERR) {
+            for (i = 0; i < argc; i++)
+                if (argv[i]) decrRefCount(argv[i]);
+            zfree(argv);
+            return;
+        }
+        geohashEncodeWGS84(xy[0],xy[1],GEO_STEP_MAX,&hash);
+        argv[2+i*2] = createObject(REDIS_STRING,
+                                   sdsfromlonglong(geohashAlign52Bits(hash)));
+        argv[3+i*2] = c->argv[4+i*3];
+        incrRefCount(argv[3+i*2]);
+    }
+
+    replaceClientCommandVector(c,argc,argv);
+    zaddCommand(c);
+}
+
+#define RADIUS_COORDS 1
+#define RADIUS_MEMBER 2
+
+#define SORT_NONE 0
+#define SORT_ASC 1
+#define SORT_DESC 2
+
+/* GEORADIUS key longitude latitude radius unit [options]
+ * GEORADIUSBYMEMBER key member radius unit [options]
+ *
+ * Options: WITHDIST, WITHHASH, WITHCOORD, ASC, DESC, COUNT <count>. */
+static void georadiusGeneric(redisClient *c, int type) {
+    robj *zobj;
+    double xy[2], radius, conversion;
+    int base_args, i;
+    int withdist = 0, withhash = 0, withcoords = 0, option_length;
+    int sort = SORT_NONE;
+    long long count = 0;
+    size_t returned;
+    GeoHashRadius georadius;
+    geoArray *ga;
+
+    if ((zobj = lookupKeyReadOrReply(c,c->argv[1],shared.emptymultibulk))
+        == NULL || checkType(c,zobj,REDIS_ZSET)) return;
+
+    /* Find the center of the query. */
+    if (type == RADIUS_COORDS) {
+        base_args = 6;
+        if (extractLongLatOrReply(c,c->argv+2,xy) == REDIS_ERR) return;
+    } else {
+        base_args = 5;
+        if (longLatFromMember(zobj,c->argv[2],xy) == REDIS_ERR) {
+            addReplyError(c,"could not decode requested zset member");
+            return;
+        }
+    }
+
+    if ((radius = extractDistanceOrReply(c,c->argv+base_args-2,
+                                         &conversion)) < 0) return;
+
+    /* Parse the options. */
+    for (i = base_args; i < c->argc; i++) {
+        char *arg = c->argv[i]->ptr;
+        int remaining = c->argc - i - 1;
+
+        if (!strcasecmp(arg,"withdist")) {
+            withdist = 1;
+        } else if (!strcasecmp(arg,"withhash")) {
+            withhash = 1;
+        } else if (!strcasecmp(arg,"withcoord")) {
+            withcoords = 1;
+        } else if (!strcasecmp(arg,"asc")) {
+            sort = SORT_ASC;
+        } else if (!strcasecmp(arg,"desc")) {
+            sort = SORT_DESC;
+        } else if (!strcasecmp(arg,"count") && remaining > 0) {
+            if (getLongLongFromObjectOrReply(c,c->argv[i+1],&count,NULL)
+                != REDIS_OK) return;
+            if (count <= 0) {
+                addReplyError(c,"COUNT must be > 0");
+                return;
+            }
+            i++;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    /* COUNT returns the nearest points unless DESC is given. */
+    if (count != 0 && sort == SORT_NONE) sort = SORT_ASC;
+
+    /* Collect the points of the cells around the center. */
+    ga = geoArrayCreate();
+    if (geohashGetAreasByRadiusWGS84(xy[0],xy[1],radius,&georadius))
+        membersOfAllNeighbors(zobj,&georadius,xy[0],xy[1],radius,ga);
+
+    if (ga->used == 0) {
+        addReply(c,shared.emptymultibulk);
+        geoArrayFree(ga);
+        return;
+    }
+
+    if (sort == SORT_ASC)
+        qsort(ga->array,ga->used,sizeof(geoPoint),sortGeoPointAsc);
+    else if (sort == SORT_DESC)
+        qsort(ga->array,ga->used,sizeof(geoPoint),sortGeoPointDesc);
+
+    returned = (count == 0 || ga->used < (size_t)count) ? ga->used : count;
+    option_length = withdist + withhash + withcoords;
+    addReplyMultiBulkLen(c,returned);
+    for (i = 0; (size_t)i < returned; i++) {
+        geoPoint *gp = ga->array+i;
+
+        /* With options every point is an array: the member, then the
+         * requested fields. */
+        if (option_length) addReplyMultiBulkLen(c,option_length+1);
+        addReplyBulkCBuffer(c,gp->member,sdslen(gp->member));
+        if (withdist) addReplyDoubleDistance(c,gp->dist/conversion);
+        if (withhash) addReplyLongLong(c,(long long)gp->score);
+        if (withcoords) {
+            addReplyMultiBulkLen(c,2);
+            addReplyDouble(c,gp->longitude);
+            addReplyDouble(c,gp->latitude);
+        }
+    }
+    geoArrayFree(ga);
+}
+
+void georadiusCommand(redisClient *c) {
+    georadiusGeneric(c,RADIUS_COORDS);
+}
+
+void georadiusByMemberCommand(redisClient *c) {
+    georadiusGeneric(c,RADIUS_MEMBER);
+}
+
+/* GEOHASH key member [member ...]
+ *
+ * Reply the standard 11 characters geohash string of every member. */
+void geohashCommand(redisClient *c) {
+    static const char *geoalphabet = "0123456789bcdefghjkmnpqrstuvwxyz";
+    robj *zobj;
+    int j, i;
+
+    if ((zobj = lookupKeyRead(c->db,c->argv[1])) != NULL &&
+        checkType(c,zobj,REDIS_ZSET)) return;
+
+    addReplyMultiBulkLen(c,c->argc-2);
+    for (j = 2; j < c->argc; j++) {
+        GeoHashRange long_range = {-180, 180};
+        GeoHashRange lat_range = {-90, 90};
+        GeoHashBits hash;
+        double xy[2];
+        char buf[11];
+
+        if (zobj == NULL || longLatFromMember(zobj,c->argv[j],xy) != REDIS_OK) {
+            addReply(c,shared.nullbulk);
+            continue;
+        }
+
+        /* Scores use the latitude range of the mercator projection: the
+         * standard geohash is computed with the [-90,90] range. 52 bits
+         * are 10 characters and 2 bits, the last character is zero padded. */
+        geohashEncode(&long_range,&lat_range,xy[0],xy[1],GEO_STEP_MAX,&hash);
+        for (i = 0; i < 10; i++)
+            buf[i] = geoalphabet[(hash.bits >> (52-((i+1)*5))) & 0x1f];
+        buf[10] = geoalphabet[(hash.bits & 3) << 3];
+        addReplyBulkCBuffer(c,buf,sizeof(buf));
+    }
+}
+
+/* GEOPOS key member [member ...]
+ *
+ * Reply the longitude and latitude of every member. */
+void geoposCommand(redisClient *c) {
+    robj *zobj;
+    int j;
+
+    if ((zobj = lookupKeyRead(c->db,c->argv[1])) != NULL &&
+        checkType(c,zobj,REDIS_ZSET)) return;
+
+    addReplyMultiBulkLen(c,c->argc-2);
+    for (j = 2; j < c->argc; j++) {
+        double xy[2];
+
+        if (zobj == NULL || longLatFromMember(zobj,c->argv[j],xy) != REDIS_OK) {
+            addReply(c,shared.nullmultibulk);
+            continue;
+        }
+        addReplyMultiBulkLen(c,2);
+        addReplyDouble(c,xy[0]);
+        addReplyDouble(c,xy[1]);
+    }
+}
+
+/* GEODIST key member1 member2 [unit]
+ *
+ * Reply the distance between two members, or a null reply if one of them
+ * does not exist. */
+void geodistCommand(redisClient *c) {
+    double to_meters = 1, xyxy[4];
+    robj *zobj;
+
+    if (c->argc == 5) {
+        if ((to_meters = extractUnitOrReply(c,c->argv[4])) < 0) return;
+    } else if (c->argc > 5) {
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+
+    if ((zobj = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk)) == NULL ||
+        checkType(c,zobj,REDIS_ZSET)) return;
+
+    if (longLatFromMember(zobj,c->argv[2],xyxy) == REDIS_ERR ||
+        longLatFromMember(zobj,c->argv[3],xyxy+2) == REDIS_ERR)
+    {
+        addReply(c,shared.nullbulk);
+        return;
+    }
+    addReplyDoubleDistance(c,
+        geohashGetDistance(xyxy[0],xyxy[1],xyxy[2],xyxy[3]) / to_meters);
+}
@@ -0,0 +1,354 @@
+/* Geohash -- encoding of longitude/latitude pairs as interleaved integers,
+ * used by the GEO commands to index points in sorted sets.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* A point is encoded scaling its longitude and latitude to integers of
+ * 'step' bits each, inside the ranges of the projection, then interleaving
+ * the bits: longitude in the odd bits, latitude in the even bits. With 26
+ * bits per coordinate the hash is a 52 bits integer, that is stored as the
+ * score of a sorted set element without loss of precision.
+ *
+ * The interleaving makes the hashes of the points in a cell share the same
+ * prefix: every point of a cell of a given step has its 52 bits score in
+ * the range [bits << (52-step*2), (bits+1) << (52-step*2)). So the points
+ * near a position are found with a few range scans of the sorted set: the
+ * cell containing the position, and its eight neighbors, with a step such
+ * that the cells are at least as big as the searched radius.
+ *
+ * 经纬度被缩放为 step 位的整数，然后交错组合：经度占奇数位，纬度占偶数位。
+ * 每个坐标 26 位时，哈希值是一个 52 位整数，可以无损地保存为有序集的分值。
+ * 同一个格子中的点有相同的前缀，所以查找附近的点只需要对有序集进行几次
+ * 范围扫描：中心所在的格子，以及它周围的八个格子。 */
+
+#include <math.h>
+#include "geohash.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define D_R (M_PI / 180.0)
+#define MERCATOR_MAX 20037726.37
+
+/* Earth radius used by the distance computations, in meters. */
+#define EARTH_RADIUS_IN_METERS 6372797.560856
+
+static inline double deg_rad(double ang) { return ang * D_R; }
+static inline double rad_deg(double ang) { return ang / D_R; }
+
+/* Interleave the lower 32 bits of x (even bits) and y (odd bits). */
+static inline uint64_t interleave64(uint32_t xlo, uint32_t ylo) {
+    static const uint64_t B[] = {0x5555555555555555ULL, 0x3333333333333333ULL,
+                                 0x0F0F0F0F0F0F0F0FULL, 0x00FF00FF00FF00FFULL,
+                                 0x0000FFFF0000FFFFULL};
+    static const unsigned int S[] = {1, 2, 4, 8, 16};
+    uint64_t x = xlo, y = ylo;
+    int j;
+
+    for (j = 4; j >= 0; j--) {
+        x = (x | (x << S[j])) & B[j];
+        y = (y | (y << S[j])) & B[j];
+    }
+    return x | (y << 1);
+}
+
+/* The reverse of interleave64(): even bits in the lower 32 bits of the
+ * result, odd bits in the higher 32 bits. */
+static inline uint64_t deinterleave64(uint64_t interleaved) {
+    static const uint64_t B[] = {0x5555555555555555ULL, 0x3333333333333333ULL,
+                                 0x0F0F0F0F0F0F0F0FULL, 0x00FF00FF00FF00FFULL,
+                                 0x0000FFFF0000FFFFULL, 0x00000000FFFFFFFFULL};
+    static const unsigned int S[] = {0, 1, 2, 4, 8, 16};
+    uint64_t x = interleaved, y = interleaved >> 1;
+    int j;
+
+    for (j = 0; j <= 5; j++) {
+        x = (x | (x >> S[j])) & B[j];
+        y = (y | (y >> S[j])) & B[j];
+    }
+    return x | (y << 32);
+}
+
+/* Encode the point with 'step' bits per coordinate. Returns 0 if the point
+ * is outside the ranges. */
+int geohashEncode(const GeoHashRange *long_range, const GeoHashRange *lat_range,
+                  double longitude, double latitude, uint8_t step,
+                  GeoHashBits *hash)
+{
+    double lat_offset, long_offset;
+    uint64_t cells = 1ULL << step;
+    uint64_t ilat, ilong;
+
+    if (step == 0 || step > 32 ||
+        latitude < lat_range->min || latitude > lat_range->max ||
+        longitude < long_range->min || longitude > long_range->max)
+        return 0;
+
+    lat_offset = (latitude - lat_range->min) /
+                 (lat_range->max - lat_range->min);
+    long_offset = (longitude - long_range->min) /
+                  (long_range->max - long_range->min);
+
+    /* The maximum of a range belongs to the last cell. */
+    ilat = lat_offset * cells;
+    ilong = long_offset * cells;
+    if (ilat >= cells) ilat = cells-1;
+    if (ilong >= cells) ilong = cells-1;
+
+    hash->bits = interleave64(ilat,ilong);
+    hash->step = step;
+    return 1;
+}
+
+int geohashEncodeWGS84(double longitude, double latitude, uint8_t step,
+                       GeoHashBits *hash)
+{
+    GeoHashRange long_range = {GEO_LONG_MIN, GEO_LONG_MAX};
+    GeoHashRange lat_range = {GEO_LAT_MIN, GEO_LAT_MAX};
+
+    return geohashEncode(&long_range,&lat_range,longitude,latitude,step,hash);
+}
+
+/* Compute the area of the cell represented by 'hash'. */
+int geohashDecode(const GeoHashRange *long_range, const GeoHashRange *lat_range,
+                  GeoHashBits hash, GeoHashArea *area)
+{
+    uint64_t sep = deinterleave64(hash.bits);
+    double lat_scale = lat_range->max - lat_range->min;
+    double long_scale = long_range->max - long_range->min;
+    double cells = (double)(1ULL << hash.step);
+    uint32_t ilat = sep, ilong = sep >> 32;
+
+    if (hash.step == 0) return 0;
+    area->hash = hash;
+    area->latitude.min = lat_range->min + (ilat / cells) * lat_scale;
+    area->latitude.max = lat_range->min + ((ilat + 1) / cells) * lat_scale;
+    area->longitude.min = long_range->min + (ilong / cells) * long_scale;
+    area->longitude.max = long_range->min + ((ilong + 1) / cells) * long_scale;
+    return 1;
+}
+
+int geohashDecodeWGS84(GeoHashBits hash, GeoHashArea *area) {
+    GeoHashRange long_range = {GEO_LONG_MIN, GEO_LONG_MAX};
+    GeoHashRange lat_range = {GEO_LAT_MIN, GEO_LAT_MAX};
+
+    return geohashDecode(&long_range,&lat_range,hash,area);
+}
+
+/* Decode the hash as the center of its cell, xy[0] being the longitude and
+ * xy[1] the latitude. */
+int geohashDecodeToLongLatWGS84(GeoHashBits hash, double *xy) {
+    GeoHashArea area;
+
+    if (!geohashDecodeWGS84(hash,&area)) return 0;
+    xy[0] = (area.longitude.min + area.longitude.max) / 2;
+    xy[1] = (area.latitude.min + area.latitude.max) / 2;
+    if (xy[0] > GEO_LONG_MAX) xy[0] = GEO_LONG_MAX;
+    if (xy[0] < GEO_LONG_MIN) xy[0] = GEO_LONG_MIN;
+    if (xy[1] > GEO_LAT_MAX) xy[1] = GEO_LAT_MAX;
+    if (xy[1] < GEO_LAT_MIN) xy[1] = GEO_LAT_MIN;
+    return 1;
+}
+
+/* Move the hash by one cell along the longitude (odd bits) or the latitude
+ * (even bits), in the direction 'd' (1 or -1). The coordinate is
+ * incremented or decremented without touching the other one's bits: the
+ * bits of the other coordinate are filled with ones (or zeroed) so that
+ * the carry (or borrow) goes through them. Moves wrap around the edges. */
+static void geohashMove(GeoHashBits *hash, int odd, int d) {
+    uint64_t mask = odd ? 0xaaaaaaaaaaaaaaaaULL : 0x5555555555555555ULL;
+    uint64_t other = ~mask;
+    uint64_t used = 0xffffffffffffffffULL >> (64 - hash->step * 2);
+    uint64_t v = hash->bits & mask;
+    uint64_t fill = other & used;
+    uint64_t one = odd ? 2 : 1;
+
+    if (d > 0) {
+        v = (v | fill) + one;
+    } else {
+        v = v - one;
+    }
+    v &= mask & used;
+    hash->bits = (hash->bits & other) | v;
+}
+
+void geohashNeighbors(const GeoHashBits *hash, GeoHashNeighbors *neighbors) {
+    neighbors->east = *hash;
+    neighbors->west = *hash;
+    neighbors->north = *hash;
+    neighbors->south = *hash;
+    neighbors->south_east = *hash;
+    neighbors->south_west = *hash;
+    neighbors->north_east = *hash;
+    neighbors->north_west = *hash;
+
+    geohashMove(&neighbors->east,1,1);
+    geohashMove(&neighbors->west,1,-1);
+    geohashMove(&neighbors->south,0,-1);
+    geohashMove(&neighbors->north,0,1);
+
+    geohashMove(&neighbors->south_east,1,1);
+    geohashMove(&neighbors->south_east,0,-1);
+    geohashMove(&neighbors->south_west,1,-1);
+    geohashMove(&neighbors->south_west,0,-1);
+    geohashMove(&neighbors->north_east,1,1);
+    geohashMove(&neighbors->north_east,0,1);
+    geohashMove(&neighbors->north_west,1,-1);
+    geohashMove(&neighbors->north_west,0,1);
+}
+
+/* Return the hash as the 52 bits score of the first point of its cell. */
+uint64_t geohashAlign52Bits(GeoHashBits hash) {
+    return hash.bits << (52 - hash.step * 2);
+}
+
+/* Return the biggest step whose cells are still at least as large as
+ * 'range_meters', so that the cell of the center and its neighbors cover
+ * the whole radius. */
+uint8_t geohashEstimateStepsByRadius(double range_meters, double lat) {
+    int step = 1;
+
+    if (range_meters == 0) return GEO_STEP_MAX;
+    while (range_meters < MERCATOR_MAX) {
+        range_meters *= 2;
+        step++;
+    }
+    step -= 2; /* Make sure the range is included in most of the cases. */
+
+    /* Cells get narrower towards the poles. */
+    if (lat > 66 || lat < -66) {
+        step--;
+        if (lat > 80 || lat < -80) step--;
+    }
+
+    if (step < 1) step = 1;
+    if (step > GEO_STEP_MAX) step = GEO_STEP_MAX;
+    return step;
+}
+
+/* Compute the bounding box of the circle: bounds[0] and bounds[2] are the
+ * minimum and maximum longitude, bounds[1] and bounds[3] the minimum and
+ * maximum latitude. The box may exceed the valid ranges. The longitude
+ * span is computed at the latitude of the circle nearest to a pole, so the
+ * box is never smaller than the circle. */
+void geohashBoundingBox(double longitude, double latitude, double radius_meters,
+                        double *bounds)
+{
+    double lat_delta = rad_deg(radius_meters/EARTH_RADIUS_IN_METERS);
+    double max_lat = fabs(latitude) + lat_delta;
+    double long_delta = 360;
+
+    if (max_lat < 90)
+        long_delta = rad_deg(radius_meters/EARTH_RADIUS_IN_METERS/
+                             cos(deg_rad(max_lat)));
+    bounds[0] = longitude - long_delta;
+    bounds[2] = longitude + long_delta;
+    bounds[1] = latitude - lat_delta;
+    bounds[3] = latitude + lat_delta;
+}
+
+#define GZERO(s) do { (s).bits = 0; (s).step = 0; } while(0)
+
+/* Compute the cells to scan to find all the points within 'radius_meters'
+ * from the given position. Returns 0 if the position can't be encoded. */
+int geohashGetAreasByRadiusWGS84(double longitude, double latitude,
+                                 double radius_meters, GeoHashRadius *r)
+{
+    double bounds[4];
+    uint8_t steps;
+
+    geohashBoundingBox(longitude,latitude,radius_meters,bounds);
+    steps = geohashEstimateStepsByRadius(radius_meters,latitude);
+
+    /* The estimate is approximated: use bigger cells until the neighbors
+     * reach at least 'radius_meters' from the center in every direction. */
+    while (1) {
+        GeoHashArea north, south, east, west;
+
+        if (!geohashEncodeWGS84(longitude,latitude,steps,&r->hash)) return 0;
+        geohashNeighbors(&r->hash,&r->neighbors);
+        geohashDecodeWGS84(r->hash,&r->area);
+        if (steps == 1) break;
+
+        geohashDecodeWGS84(r->neighbors.north,&north);
+        geohashDecodeWGS84(r->neighbors.south,&south);
+        geohashDecodeWGS84(r->neighbors.east,&east);
+        geohashDecodeWGS84(r->neighbors.west,&west);
+        if (geohashGetDistance(longitude,latitude,longitude,
+                               north.latitude.max) >= radius_meters &&
+            geohashGetDistance(longitude,latitude,longitude,
+                               south.latitude.min) >= radius_meters &&
+            geohashGetDistance(longitude,latitude,east.longitude.max,
+                               latitude) >= radius_meters &&
+            geohashGetDistance(longitude,latitude,west.longitude.min,
+                               latitude) >= radius_meters) break;
+        steps--;
+    }
+
+    /* Skip the neighbors outside the bounding box: if the center cell
+     * already extends past a side of the box, the cells on that side are
+     * useless. */
+    if (steps >= 2) {
+        if (r->area.latitude.min < bounds[1]) {
+            GZERO(r->neighbors.south);
+            GZERO(r->neighbors.south_west);
+            GZERO(r->neighbors.south_east);
+        }
+        if (r->area.latitude.max > bounds[3]) {
+            GZERO(r->neighbors.north);
+            GZERO(r->neighbors.north_east);
+            GZERO(r->neighbors.north_west);
+        }
+        if (r->area.longitude.min < bounds[0]) {
+            GZERO(r->neighbors.west);
+            GZERO(r->neighbors.south_west);
+            GZERO(r->neighbors.north_west);
+        }
+        if (r->area.longitude.max > bounds[2]) {
+            GZERO(r->neighbors.east);
+            GZERO(r->neighbors.south_east);
+            GZERO(r->neighbors.north_east);
+        }
+    }
+    return 1;
+}
+
+/* Distance in meters between two points, with the haversine formula. */
+double geohashGetDistance(double lon1d, double lat1d,
+                          double lon2d, double lat2d)
+{
+    double lat1r = deg_rad(lat1d), lon1r = deg_rad(lon1d);
+    double lat2r = deg_rad(lat2d), lon2r = deg_rad(lon2d);
+    double u = sin((lat2r - lat1r) / 2);
+    double v = sin((lon2r - lon1r) / 2);
+
+    return 2.0 * EARTH_RADIUS_IN_METERS *
+           asin(sqrt(u * u + cos(lat1r) * cos(lat2r) * v * v));
+}
@@ -0,0 +1,104 @@
+/* Geohash -- encoding of longitude/latitude pairs as interleaved integers,
+ * used by the GEO commands to index points in sorted sets.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __GEOHASH_H
+#define __GEOHASH_H
+
+#include <stdint.h>
+
+/* 26 bits per coordinate: a 52 bits hash, that a double (the score of a
+ * sorted set element) represents exactly. */
+#define GEO_STEP_MAX 26
+
+/* Limits of the EPSG:900913 / EPSG:3785 / OSGEO:41001 projection. Points
+ * near the poles can't be indexed. */
+#define GEO_LAT_MIN -85.05112878
+#define GEO_LAT_MAX 85.05112878
+#define GEO_LONG_MIN -180
+#define GEO_LONG_MAX 180
+
+typedef struct {
+    uint64_t bits;
+    uint8_t step;   /* Bits per coordinate. */
+} GeoHashBits;
+
+typedef struct {
+    double min;
+    double max;
+} GeoHashRange;
+
+/* The area of the cell represented by a hash. */
+typedef struct {
+    GeoHashBits hash;
+    GeoHashRange longitude;
+    GeoHashRange latitude;
+} GeoHashArea;
+
+typedef struct {
+    GeoHashBits north;
+    GeoHashBits east;
+    GeoHashBits west;
+    GeoHashBits south;
+    GeoHashBits north_east;
+    GeoHashBits south_east;
+    GeoHashBits north_west;
+    GeoHashBits south_west;
+} GeoHashNeighbors;
+
+/* The cells to scan in order to find every point inside a radius: the
+ * cell of the center and its neighbors. Cells not intersecting the
+ * radius bounding box are zeroed (bits = 0, step = 0). */
+typedef struct {
+    GeoHashBits hash;
+    GeoHashArea area;
+    GeoHashNeighbors neighbors;
+} GeoHashRadius;
+
+int geohashEncode(const GeoHashRange *long_range, const GeoHashRange *lat_range,
+                  double longitude, double latitude, uint8_t step,
+                  GeoHashBits *hash);
+int geohashEncodeWGS84(double longitude, double latitude, uint8_t step,
+                       GeoHashBits *hash);
+int geohashDecode(const GeoHashRange *long_range, const GeoHashRange *lat_range,
+                  GeoHashBits hash, GeoHashArea *area);
+int geohashDecodeWGS84(GeoHashBits hash, GeoHashArea *area);
+int geohashDecodeToLongLatWGS84(GeoHashBits hash, double *xy);
+void geohashNeighbors(const GeoHashBits *hash, GeoHashNeighbors *neighbors);
+uint64_t geohashAlign52Bits(GeoHashBits hash);
+uint8_t geohashEstimateStepsByRadius(double range_meters, double lat);
+void geohashBoundingBox(double longitude, double latitude, double radius_meters,
+                        double *bounds);
+int geohashGetAreasByRadiusWGS84(double longitude, double latitude,
+                                 double radius_meters, GeoHashRadius *r);
+double geohashGetDistance(double lon1d, double lat1d,
+                          double lon2d, double lat2d);
+
+#endif
@@ -31,10 +31,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "config.h"
 #include "intset.h"
 #include "zmalloc.h"
 #include "endianconv.h"
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 /* Note that these encodings are ordered, so:
  * INTSET_ENC_INT16 < INTSET_ENC_INT32 < INTSET_ENC_INT64. */
 #define INTSET_ENC_INT16 (sizeof(int16_t))
@@ -135,6 +140,182 @@ static intset *intsetResize(intset *is, uint32_t len) {
     return is;
 }
 
+#ifdef HAVE_X86_SIMD
+/* SIMD search.
+ *
+ * The binary search in intsetSearch() is full of unpredictable branches,
+ * and for the last steps it touches memory that is already in the same
+ * cache lines. So when a SIMD kernel is available we only bisect until
+ * the window is INTSET_SIMD_WINDOW bytes, then count with vector compares
+ * how many elements of the window are smaller than the value: since the
+ * intset is sorted, this is the position of the value (or the position
+ * where it should be inserted).
+ *
+ * The kernels are compiled for SSE4.2 and AVX2 with the target attribute,
+ * and selected at runtime according to the CPU, so the binary still runs
+ * on any x86_64 CPU.
+ *
+ * SIMD 查找：
+ * 先用二分查找将范围缩小到 INTSET_SIMD_WINDOW 字节，
+ * 然后用向量比较计算范围内小于 value 的元素数量，
+ * 因为 intset 是有序的，这个数量就是 value 的位置（或者插入位置）。
+ * 根据 CPU 是否支持 SSE4.2 或者 AVX2 ，在运行时选择对应的实现。 */
+#define INTSET_SIMD_WINDOW 256
+
+typedef uint32_t intsetCountLessProc(const void *a, uint32_t n, int64_t v);
+
+/* Scalar versions, used for the tail of the window. */
+static uint32_t intsetCountLess16Scalar(const void *a, uint32_t n, int64_t v) {
+    const int16_t *e = a;
+    uint32_t count = 0, i;
+    for (i = 0; i < n; i++) count += e[i] < v;
+    return count;
+}
+
+static uint32_t intsetCountLess32Scalar(const void *a, uint32_t n, int64_t v) {
+    const int32_t *e = a;
+    uint32_t count = 0, i;
+    for (i = 0; i < n; i++) count += e[i] < v;
+    return count;
+}
+
+static uint32_t intsetCountLess64Scalar(const void *a, uint32_t n, int64_t v) {
+    const int64_t *e = a;
+    uint32_t count = 0, i;
+    for (i = 0; i < n; i++) count += e[i] < v;
+    return count;
+}
+
+/* The movemask of a byte compare has one bit per byte, so every element
+ * that is smaller than 'v' sets sizeof(element) bits. */
+__attribute__((target("sse4.2")))
+static uint32_t intsetCountLess16SSE(const void *a, uint32_t n, int64_t v) {
+    const int16_t *e = a;
+    __m128i vv = _mm_set1_epi16((int16_t)v);
+    uint32_t count = 0, i;
+
+    for (i = 0; i+8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(e+i));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi16(vv,x)));
+    }
+    return count/2 + intsetCountLess16Scalar(e+i,n-i,v);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t intsetCountLess32SSE(const void *a, uint32_t n, int64_t v) {
+    const int32_t *e = a;
+    __m128i vv = _mm_set1_epi32((int32_t)v);
+    uint32_t count = 0, i;
+
+    for (i = 0; i+4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(e+i));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi32(vv,x)));
+    }
+    return count/4 + intsetCountLess32Scalar(e+i,n-i,v);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t intsetCountLess64SSE(const void *a, uint32_t n, int64_t v) {
+    const int64_t *e = a;
+    __m128i vv = _mm_set1_epi64x(v);
+    uint32_t count = 0, i;
+
+    for (i = 0; i+2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(e+i));
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi64(vv,x)));
+    }
+    return count/8 + intsetCountLess64Scalar(e+i,n-i,v);
+}
+
+__attribute__((target("avx2")))
+static uint32_t intsetCountLess16AVX2(const void *a, uint32_t n, int64_t v) {
+    const int16_t *e = a;
+    __m256i vv = _mm256_set1_epi16((int16_t)v);
+    uint32_t count = 0, i;
+
+    for (i = 0; i+16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(e+i));
+        count += __builtin_popcount(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi16(vv,x)));
+    }
+    return count/2 + intsetCountLess16Scalar(e+i,n-i,v);
+}
+
+__attribute__((target("avx2")))
+static uint32_t intsetCountLess32AVX2(const void *a, uint32_t n, int64_t v) {
+    const int32_t *e = a;
+    __m256i vv = _mm256_set1_epi32((int32_t)v);
+    uint32_t count = 0, i;
+
+    for (i = 0; i+8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(e+i));
+        count += __builtin_popcount(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi32(vv,x)));
+    }
+    return count/4 + intsetCountLess32Scalar(e+i,n-i,v);
+}
+
+__attribute__((target("avx2")))
+static uint32_t intsetCountLess64AVX2(const void *a, uint32_t n, int64_t v) {
+    const int64_t *e = a;
+    __m256i vv = _mm256_set1_epi64x(v);
+    uint32_t count = 0, i;
+
+    for (i = 0; i+4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(e+i));
+        count += __builtin_popcount(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi64(vv,x)));
+    }
+    return count/8 + intsetCountLess64Scalar(e+i,n-i,v);
+}
+
+/* Kernels for the 16, 32 and 64 bit encodings, selected on first use.
+ * They stay NULL if the CPU has neither SSE4.2 nor AVX2, and in that
+ * case intsetSearch() uses the plain binary search. */
+static int intsetSimdInitialized = 0;
+static intsetCountLessProc *intsetCountLess16 = NULL;
+static intsetCountLessProc *intsetCountLess32 = NULL;
+static intsetCountLessProc *intsetCountLess64 = NULL;
+
+static void intsetSimdInit(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        intsetCountLess16 = intsetCountLess16AVX2;
+        intsetCountLess32 = intsetCountLess32AVX2;
+        intsetCountLess64 = intsetCountLess64AVX2;
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        intsetCountLess16 = intsetCountLess16SSE;
+        intsetCountLess32 = intsetCountLess32SSE;
+        intsetCountLess64 = intsetCountLess64SSE;
+    }
+    intsetSimdInitialized = 1;
+}
+
+/* Search 'value' between the indexes 'min' and 'max' (inclusive) using
+ * the SIMD kernel 'countless'. Same return value of intsetSearch(). */
+static uint8_t intsetSearchSimd(intset *is, int64_t value, uint32_t *pos,
+                                int min, int max, intsetCountLessProc *countless)
+{
+    uint32_t enc = intrev32ifbe(is->encoding);
+    uint32_t window = INTSET_SIMD_WINDOW/enc;
+    uint32_t idx;
+
+    /* Bisect until the window is small enough. */
+    while ((uint32_t)(max-min+1) > window) {
+        int mid = (min+max)/2;
+        if (value > _intsetGetEncoded(is,mid,enc))
+            min = mid+1;
+        else
+            max = mid;
+    }
+
+    idx = min + countless(is->contents+min*enc,max-min+1,value);
+    if (pos) *pos = idx;
+    return idx < intrev32ifbe(is->length) &&
+           _intsetGetEncoded(is,idx,enc) == value;
+}
+#endif
+
 /*
  * 查找 value 在 is 中的索引
  *
@@ -169,6 +350,18 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
+#ifdef HAVE_X86_SIMD
+    if (!intsetSimdInitialized) intsetSimdInit();
+    if (intsetCountLess16) {
+        uint32_t enc = intrev32ifbe(is->encoding);
+        intsetCountLessProc *countless =
+            (enc == INTSET_ENC_INT64) ? intsetCountLess64 :
+            (enc == INTSET_ENC_INT32) ? intsetCountLess32 :
+                                        intsetCountLess16;
+        return intsetSearchSimd(is,value,pos,min,max,countless);
+    }
+#endif
+
     // 在 is 元素数组中进行二分查找 
     while(max >= min) {
         mid = (min+max)/2;
@@ -419,6 +612,8 @@ size_t intsetBlobLen(intset *is) {
 
 #ifdef INTSET_TEST_MAIN
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 void intsetRepr(intset *is) {
     int i;
@@ -450,13 +645,13 @@ void _assert(char *estr, char *file, int line) {
 }
 
 intset *createSet(int bits, int size) {
-    uint64_t mask = (1<<bits)-1;
+    uint64_t mask = ((uint64_t)1<<bits)-1;
     uint64_t i, value;
     intset *is = intsetNew();
 
     for (i = 0; i < size; i++) {
-        if (bits > 32) {
-            value = (rand()*rand()) & mask;
+        if (bits > 30) {
+            value = (((uint64_t)rand()<<32)|rand()) & mask;
         } else {
             value = rand() & mask;
         }
@@ -488,7 +683,7 @@ int main(int argc, char **argv) {
     uint8_t success;
     int i;
     intset *is;
-    sranddev();
+    srand(time(NULL)^getpid());
 
     printf("Value encodings: "); {
         assert(_intsetValueEncoding(-32768) == INTSET_ENC_INT16);
@@ -600,6 +795,72 @@ int main(int argc, char **argv) {
         printf("%ld lookups, %ld element set, %lldusec\n",num,size,usec()-start);
     }
 
+#ifdef HAVE_X86_SIMD
+    printf("SIMD search matches the binary search: "); {
+        int bits[] = {14, 30, 62}, b, size;
+        intsetCountLessProc *c16, *c32, *c64;
+
+        intsetSimdInit();
+        c16 = intsetCountLess16; c32 = intsetCountLess32; c64 = intsetCountLess64;
+        for (b = 0; b < 3; b++) {
+            for (size = 1; size < 2000; size = size*3+1) {
+                is = createSet(bits[b],size);
+                for (i = 0; i < 2000; i++) {
+                    int64_t v = (i & 1) ? _intsetGet(is,rand()%intrev32ifbe(is->length)) :
+                                          _intsetGet(is,0)+rand()%(1<<(bits[b] > 30 ? 30 : bits[b]));
+                    uint32_t p1, p2;
+                    uint8_t f1, f2;
+
+                    intsetCountLess16 = c16; intsetCountLess32 = c32; intsetCountLess64 = c64;
+                    f1 = intsetSearch(is,v,&p1);
+                    intsetCountLess16 = intsetCountLess32 = intsetCountLess64 = NULL;
+                    f2 = intsetSearch(is,v,&p2);
+                    assert(f1 == f2 && p1 == p2);
+                }
+                zfree(is);
+            }
+        }
+        intsetCountLess16 = c16; intsetCountLess32 = c32; intsetCountLess64 = c64;
+        ok();
+    }
+
+    printf("Lookups, SIMD vs binary search:\n"); {
+        long num = 1000000;
+        int sizes[] = {512, 8192}, bits[] = {14, 30, 62}, s, b;
+        intsetCountLessProc *c16, *c32, *c64;
+        long long start, simd, scalar;
+        int64_t keys[4096];
+
+        intsetSimdInit();
+        c16 = intsetCountLess16; c32 = intsetCountLess32; c64 = intsetCountLess64;
+        for (s = 0; s < 2; s++) {
+            for (b = 0; b < 3; b++) {
+                uint32_t len;
+                is = createSet(bits[b],sizes[s]);
+                len = intrev32ifbe(is->length);
+
+                for (i = 0; i < 4096; i++) keys[i] = _intsetGet(is,rand()%len);
+
+                intsetCountLess16 = c16; intsetCountLess32 = c32; intsetCountLess64 = c64;
+                start = usec();
+                for (i = 0; i < num; i++) intsetSearch(is,keys[i&4095],NULL);
+                simd = usec()-start;
+
+                intsetCountLess16 = intsetCountLess32 = intsetCountLess64 = NULL;
+                start = usec();
+                for (i = 0; i < num; i++) intsetSearch(is,keys[i&4095],NULL);
+                scalar = usec()-start;
+
+                printf("  %u elements, %d bytes encoding: simd %lld usec, "
+                       "binary search %lld usec\n", len,
+                       intrev32ifbe(is->encoding), simd, scalar);
+                zfree(is);
+            }
+        }
+        intsetCountLess16 = c16; intsetCountLess32 = c32; intsetCountLess64 = c64;
+    }
+#endif
+
     printf("Stress add+delete: "); {
         int i, v1, v2;
         is = intsetNew();
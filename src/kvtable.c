@@ -0,0 +1,1094 @@
+/* Keyspace table -- a cache line aware hash table holding the keys of a
+ * Redis database together with their expire times.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* OVERVIEW
+ * ========
+ *
+ * The keyspace of a database used to be two dicts: the main dict mapping
+ * keys to values, and the expires dict mapping every volatile key to its
+ * expire time. Reading a volatile key cost two hash lookups, each one
+ * loading a bucket pointer and then walking a chain of separately
+ * allocated dictEntry structures, and every TTL cost a second dictEntry.
+ *
+ * The kvtable keeps a key, its value and its expire time in the same
+ * kvEntry, and indexes the entries with buckets of exactly one cache line:
+ *
+ *   +----------+---------+--------+------------------------+--------+
+ *   | presence | tags[6] | unused | entries[6] (8 bytes)   | next   |
+ *   +----------+---------+--------+------------------------+--------+
+ *
+ * 'presence' has a bit for every used slot, and 'tags' holds 8 bits of the
+ * hash of the key in every slot. A lookup reads the bucket, compares the
+ * tag with the tags of the used slots, and only dereferences the entries
+ * whose tag matches: a lookup of an existing key usually touches the
+ * bucket and the entry, a lookup of a missing key usually just the
+ * bucket. When the 6 slots are used, further entries go in buckets
+ * chained with 'next'. The table grows when there are KVTABLE_BUCKET_FILL
+ * entries per bucket on average, so chains are short.
+ *
+ * Entries are allocated one by one and never move, so a kvEntry pointer
+ * stays valid until the entry is deleted, even across a rehash.
+ *
+ * As in dict.c there are two tables and the table is rehashed
+ * incrementally, one bucket chain at a time, by lookups, inserts and
+ * deletes, and by the server cron with kvtableRehashMilliseconds().
+ * Iterators pause rehashing. kvtableScan() uses the same reverse binary
+ * cursor as dictScan(), bucket chain by bucket chain.
+ *
+ * The volatile entries are also referenced by a dense array, and every
+ * volatile entry remembers its index in it, so that the active expire
+ * cycle and the volatile-* eviction policies can sample them in O(1).
+ * Removing an entry from the array moves the last entry in its place.
+ *
+ * 数据库的键空间原本由两个字典组成：主字典和保存过期时间的 expires 字典，
+ * 读取一个带有过期时间的键需要两次哈希查找。
+ *
+ * kvtable 把键、值和过期时间保存在同一个节点里，
+ * 并且使用正好一个缓存行大小的桶来索引节点：
+ * 桶里保存每个槽位的 8 位哈希标签，查找时只访问标签相同的节点。
+ * 桶满之后，新的节点放到链接的下一个桶中。
+ *
+ * 和 dict.c 一样，表使用两个哈希表进行渐进式 rehash 。
+ * 带有过期时间的节点另外由一个紧凑的数组引用，用于随机取样。 */
+
+#include "fmacros.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "kvtable.h"
+#include "zmalloc.h"
+
+/* As for dicts, resizing is disabled while there is a child saving the
+ * dataset, unless there are more than kvtable_force_resize_ratio times the
+ * normal number of entries per bucket. */
+static int kvtable_can_resize = 1;
+static unsigned int kvtable_force_resize_ratio = 5;
+
+/* Bits of presence used by the slots of a full bucket. */
+#define KVTABLE_BUCKET_FULL ((1<<KVTABLE_BUCKET_SLOTS)-1)
+
+/* The bucket index uses the low bits of the hash, the tag the high ones. */
+#define kvtableHashTag(h) ((uint8_t)((h) >> 24))
+#define kvtableHashKey(t, key) (t)->type->hashFunction(key)
+#define kvtableCompareKeys(t, key1, key2) \
+    (t)->type->keyCompare(NULL, key1, key2)
+
+/* -------------------------- private prototypes ---------------------------- */
+
+static int _kvtableExpandIfNeeded(kvtable *t);
+static unsigned long _kvtableNextPower(unsigned long size);
+
+/* ----------------------------- Buckets ---------------------------------- */
+
+/*
+ * 返回桶内所有标签等于 tag 的已使用槽位
+ */
+static unsigned int _kvtableBucketMatch(kvBucket *b, uint8_t tag) {
+    unsigned int mask = 0;
+    int s;
+
+    for (s = 0; s < KVTABLE_BUCKET_SLOTS; s++)
+        if (b->tags[s] == tag) mask |= 1<<s;
+    return mask & b->presence;
+}
+
+/*
+ * 将节点放到桶链中的第一个空槽位，所有桶都满时链接一个新桶
+ */
+static void _kvtableBucketInsert(kvBucket *b, kvEntry *e, uint8_t tag) {
+    int s;
+
+    while (b->presence == KVTABLE_BUCKET_FULL) {
+        if (b->next == NULL) b->next = zcalloc(sizeof(kvBucket));
+        b = b->next;
+    }
+    s = __builtin_ctz(~b->presence);
+    b->presence |= 1<<s;
+    b->tags[s] = tag;
+    b->entries[s] = e;
+}
+
+/*
+ * 桶链中是否没有任何节点
+ */
+static int _kvtableChainIsEmpty(kvBucket *b) {
+    while (b) {
+        if (b->presence) return 0;
+        b = b->next;
+    }
+    return 1;
+}
+
+/*
+ * 释放桶链中链接在 head 之后的所有（空）桶
+ */
+static void _kvtableFreeChain(kvBucket *head) {
+    kvBucket *b = head->next, *next;
+
+    while (b) {
+        next = b->next;
+        zfree(b);
+        b = next;
+    }
+    head->next = NULL;
+}
+
+/* ------------------------- Volatile entries ------------------------------ */
+
+static void _kvtableVolatileAdd(kvtable *t, kvEntry *e) {
+    if (t->volatile_used == t->volatile_size) {
+        t->volatile_size = t->volatile_size ? t->volatile_size*2 : 4;
+        t->volatile_entries = zrealloc(t->volatile_entries,
+            sizeof(kvEntry*)*t->volatile_size);
+    }
+    e->vidx = t->volatile_used;
+    t->volatile_entries[t->volatile_used++] = e;
+}
+
+/* Remove 'e' from the volatile array, moving the last entry in its place. */
+static void _kvtableVolatileRemove(kvtable *t, kvEntry *e) {
+    kvEntry *last = t->volatile_entries[--t->volatile_used];
+
+    t->volatile_entries[e->vidx] = last;
+    last->vidx = e->vidx;
+    if (t->volatile_size > 4 && t->volatile_used < t->volatile_size/4) {
+        t->volatile_size /= 2;
+        t->volatile_entries = zrealloc(t->volatile_entries,
+            sizeof(kvEntry*)*t->volatile_size);
+    }
+}
+
+/* ------------------------------ Tables ----------------------------------- */
+
+static void _kvtableReset(kvtableHt *ht) {
+    ht->buckets = NULL;
+    ht->size = 0;
+    ht->sizemask = 0;
+    ht->used = 0;
+}
+
+/*
+ * 创建一个新的键空间表
+ */
+kvtable *kvtableCreate(kvtableType *type) {
+    kvtable *t = zmalloc(sizeof(*t));
+
+    t->type = type;
+    _kvtableReset(&t->ht[0]);
+    _kvtableReset(&t->ht[1]);
+    t->rehashidx = -1;
+    t->iterators = 0;
+    t->volatile_entries = NULL;
+    t->volatile_used = 0;
+    t->volatile_size = 0;
+    return t;
+}
+
+static void _kvtableFreeEntry(kvtable *t, kvEntry *e) {
+    if (t->type->keyDestructor) t->type->keyDestructor(NULL,e->key);
+    if (t->type->valDestructor) t->type->valDestructor(NULL,e->val);
+    zfree(e);
+}
+
+/*
+ * 释放哈希表中的所有节点和桶
+ *
+ * T = O(N)
+ */
+static void _kvtableClear(kvtable *t, kvtableHt *ht) {
+    unsigned long i;
+
+    for (i = 0; i < ht->size; i++) {
+        kvBucket *b = &ht->buckets[i], *next;
+        int s;
+
+        while (b) {
+            for (s = 0; s < KVTABLE_BUCKET_SLOTS; s++)
+                if (b->presence & (1<<s)) _kvtableFreeEntry(t,b->entries[s]);
+            next = b->next;
+            if (b != &ht->buckets[i]) zfree(b);
+            b = next;
+        }
+    }
+    zfree(ht->buckets);
+    _kvtableReset(ht);
+}
+
+/*
+ * 删除表中的所有节点，但不释放表本身
+ */
+void kvtableEmpty(kvtable *t) {
+    _kvtableClear(t,&t->ht[0]);
+    _kvtableClear(t,&t->ht[1]);
+    t->rehashidx = -1;
+    t->iterators = 0;
+    zfree(t->volatile_entries);
+    t->volatile_entries = NULL;
+    t->volatile_used = 0;
+    t->volatile_size = 0;
+}
+
+/*
+ * 删除并释放整个表
+ */
+void kvtableRelease(kvtable *t) {
+    kvtableEmpty(t);
+    zfree(t);
+}
+
+/*
+ * 创建一个有 size 个桶（向上取整为 2 的幂）的新哈希表，
+ * 如果表不为空，那么开始渐进式 rehash 。
+ */
+int kvtableExpand(kvtable *t, unsigned long size) {
+    kvtableHt n;
+    unsigned long realsize = _kvtableNextPower(size);
+
+    if (kvtableIsRehashing(t) || realsize == t->ht[0].size)
+        return KVTABLE_ERR;
+
+    n.size = realsize;
+    n.sizemask = realsize-1;
+    n.buckets = zcalloc(realsize*sizeof(kvBucket));
+    n.used = 0;
+
+    if (t->ht[0].buckets == NULL) {
+        t->ht[0] = n;
+        return KVTABLE_OK;
+    }
+    t->ht[1] = n;
+    t->rehashidx = 0;
+    return KVTABLE_OK;
+}
+
+/*
+ * 将表缩小到能以 KVTABLE_BUCKET_FILL 的平均负载容纳所有节点的最小大小
+ */
+int kvtableResize(kvtable *t) {
+    unsigned long minimal;
+
+    if (!kvtable_can_resize || kvtableIsRehashing(t)) return KVTABLE_ERR;
+    minimal = t->ht[0].used/KVTABLE_BUCKET_FILL;
+    if (minimal < KVTABLE_HT_INITIAL_SIZE) minimal = KVTABLE_HT_INITIAL_SIZE;
+    return kvtableExpand(t,minimal);
+}
+
+/*
+ * 如果表的填充率低于 minfill% ，那么返回 1
+ */
+int kvtableNeedsResize(kvtable *t, int minfill) {
+    unsigned long size = kvtableBuckets(t), used = kvtableSize(t);
+
+    return size > KVTABLE_HT_INITIAL_SIZE && used &&
+           (used*100/(size*KVTABLE_BUCKET_FILL) < (unsigned long)minfill);
+}
+
+/*
+ * 执行 N 步渐进式 rehash ，每步迁移 ht[0] 中的一个桶链。
+ *
+ * 如果执行之后还有节点需要 rehash ，那么返回 1 ，否则返回 0 。
+ */
+int kvtableRehash(kvtable *t, int n) {
+    int empty_visits = n*10;
+
+    if (!kvtableIsRehashing(t)) return 0;
+
+    while (n-- && t->ht[0].used != 0) {
+        kvBucket *head, *b, *next;
+
+        /* Note that rehashidx can't overflow as we are sure there are more
+         * elements because ht[0].used != 0 */
+        assert(t->ht[0].size > (unsigned long)t->rehashidx);
+        while (_kvtableChainIsEmpty(&t->ht[0].buckets[t->rehashidx])) {
+            _kvtableFreeChain(&t->ht[0].buckets[t->rehashidx]);
+            t->rehashidx++;
+            if (--empty_visits == 0) return 1;
+        }
+
+        head = b = &t->ht[0].buckets[t->rehashidx];
+        while (b) {
+            int s;
+
+            for (s = 0; s < KVTABLE_BUCKET_SLOTS; s++) {
+                kvEntry *e;
+                unsigned int h;
+
+                if (!(b->presence & (1<<s))) continue;
+                e = b->entries[s];
+                h = kvtableHashKey(t,e->key);
+                _kvtableBucketInsert(&t->ht[1].buckets[h & t->ht[1].sizemask],
+                                     e,kvtableHashTag(h));
+                t->ht[0].used--;
+                t->ht[1].used++;
+            }
+            next = b->next;
+            if (b != head) zfree(b);
+            b = next;
+        }
+        memset(head,0,sizeof(*head));
+        t->rehashidx++;
+    }
+
+    // ht[0] 已经为空，用 ht[1] 代替它
+    if (t->ht[0].used == 0) {
+        unsigned long i;
+
+        /* Free the empty chained buckets left by deletions. */
+        for (i = t->rehashidx; i < t->ht[0].size; i++)
+            _kvtableFreeChain(&t->ht[0].buckets[i]);
+        zfree(t->ht[0].buckets);
+        t->ht[0] = t->ht[1];
+        _kvtableReset(&t->ht[1]);
+        t->rehashidx = -1;
+        return 0;
+    }
+    return 1;
+}
+
+static long long _kvtableTimeInMilliseconds(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000)+(tv.tv_usec/1000);
+}
+
+/* Rehash for an amount of time between ms milliseconds and ms+1 milliseconds */
+int kvtableRehashMilliseconds(kvtable *t, int ms) {
+    long long start = _kvtableTimeInMilliseconds();
+    int rehashes = 0;
+
+    while(kvtableRehash(t,100)) {
+        rehashes += 100;
+        if (_kvtableTimeInMilliseconds()-start > ms) break;
+    }
+    return rehashes;
+}
+
+/*
+ * 在没有迭代器的情况下，执行一步 rehash
+ */
+static void _kvtableRehashStep(kvtable *t) {
+    if (t->iterators == 0) kvtableRehash(t,1);
+}
+
+/* ------------------------------ Lookups ---------------------------------- */
+
+/* Search 'key' (whose hash is 'h') in both tables. On success return the
+ * bucket holding it, and set '*table' and '*slot'. */
+static kvBucket *_kvtableLookup(kvtable *t, const void *key, unsigned int h,
+                                int *table, int *slot)
+{
+    uint8_t tag = kvtableHashTag(h);
+    int j;
+
+    for (j = 0; j <= 1; j++) {
+        kvtableHt *ht = &t->ht[j];
+        kvBucket *b;
+
+        if (ht->size == 0) break;
+        b = &ht->buckets[h & ht->sizemask];
+        while (b) {
+            unsigned int match = _kvtableBucketMatch(b,tag);
+
+            while (match) {
+                int s = __builtin_ctz(match);
+
+                if (kvtableCompareKeys(t,key,b->entries[s]->key)) {
+                    *table = j;
+                    *slot = s;
+                    return b;
+                }
+                match &= match-1;
+            }
+            b = b->next;
+        }
+        if (!kvtableIsRehashing(t)) break;
+    }
+    return NULL;
+}
+
+/*
+ * 返回包含 key 的节点，找不到返回 NULL
+ *
+ * T = O(1)
+ */
+kvEntry *kvtableFind(kvtable *t, const void *key) {
+    kvBucket *b;
+    int table, slot;
+
+    if (kvtableSize(t) == 0) return NULL;
+    if (kvtableIsRehashing(t)) _kvtableRehashStep(t);
+    b = _kvtableLookup(t,key,kvtableHashKey(t,key),&table,&slot);
+    return b ? b->entries[slot] : NULL;
+}
+
+/*
+ * 添加一个没有过期时间的新节点并返回它，如果 key 已经存在，那么返回 NULL
+ *
+ * T = O(1)
+ */
+kvEntry *kvtableAdd(kvtable *t, void *key, void *val) {
+    kvtableHt *ht;
+    kvEntry *e;
+    unsigned int h;
+    int table, slot;
+
+    if (kvtableIsRehashing(t)) _kvtableRehashStep(t);
+    _kvtableExpandIfNeeded(t);
+
+    h = kvtableHashKey(t,key);
+    if (_kvtableLookup(t,key,h,&table,&slot)) return NULL;
+
+    /* While rehashing new entries always go in the new table. */
+    ht = kvtableIsRehashing(t) ? &t->ht[1] : &t->ht[0];
+    e = zmalloc(sizeof(*e));
+    e->key = key;
+    e->val = val;
+    e->expire = KVTABLE_NO_EXPIRE;
+    e->vidx = 0;
+    _kvtableBucketInsert(&ht->buckets[h & ht->sizemask],e,kvtableHashTag(h));
+    ht->used++;
+    return e;
+}
+
+/*
+ * 删除并释放包含 key 的节点
+ *
+ * 找到并成功删除返回 KVTABLE_OK ，找不到返回 KVTABLE_ERR
+ *
+ * T = O(1)
+ */
+int kvtableDelete(kvtable *t, const void *key) {
+    kvBucket *b, *head;
+    kvEntry *e;
+    unsigned int h;
+    int table, slot;
+
+    if (kvtableSize(t) == 0) return KVTABLE_ERR;
+    if (kvtableIsRehashing(t)) _kvtableRehashStep(t);
+
+    h = kvtableHashKey(t,key);
+    b = _kvtableLookup(t,key,h,&table,&slot);
+    if (b == NULL) return KVTABLE_ERR;
+
+    e = b->entries[slot];
+    b->presence &= ~(1<<slot);
+    t->ht[table].used--;
+
+    /* Unlink a chained bucket left empty, unless an iterator may be
+     * positioned on it. */
+    head = &t->ht[table].buckets[h & t->ht[table].sizemask];
+    if (b != head && b->presence == 0 && t->iterators == 0) {
+        kvBucket *prev = head;
+
+        while (prev->next != b) prev = prev->next;
+        prev->next = b->next;
+        zfree(b);
+    }
+
+    if (e->expire != KVTABLE_NO_EXPIRE) _kvtableVolatileRemove(t,e);
+    _kvtableFreeEntry(t,e);
+    return KVTABLE_OK;
+}
+
+/*
+ * 设置节点的过期时间， when 为 KVTABLE_NO_EXPIRE 时移除过期时间
+ *
+ * T = O(1)
+ */
+void kvtableSetExpire(kvtable *t, kvEntry *e, long long when) {
+    if (when == KVTABLE_NO_EXPIRE) {
+        if (e->expire != KVTABLE_NO_EXPIRE) _kvtableVolatileRemove(t,e);
+    } else if (e->expire == KVTABLE_NO_EXPIRE) {
+        _kvtableVolatileAdd(t,e);
+    }
+    e->expire = when;
+}
+
+/* ----------------------------- Iterators --------------------------------- */
+
+/*
+ * 创建一个迭代器，迭代器释放之前 rehash 会暂停
+ */
+kvtableIterator *kvtableGetIterator(kvtable *t) {
+    kvtableIterator *iter = zmalloc(sizeof(*iter));
+
+    iter->t = t;
+    iter->table = 0;
+    iter->index = -1;
+    iter->bucket = NULL;
+    iter->slot = 0;
+    t->iterators++;
+    return iter;
+}
+
+/*
+ * 返回迭代器指向的下一个节点，迭代完毕返回 NULL
+ */
+kvEntry *kvtableNext(kvtableIterator *iter) {
+    while (1) {
+        kvBucket *b = iter->bucket;
+        kvtableHt *ht;
+
+        if (b) {
+            while (iter->slot < KVTABLE_BUCKET_SLOTS) {
+                int s = iter->slot++;
+
+                if (b->presence & (1<<s)) return b->entries[s];
+            }
+            iter->bucket = b->next;
+            iter->slot = 0;
+            continue;
+        }
+
+        // 前进到下一个桶，如果 ht[0] 迭代完毕并且正在 rehash ，
+        // 那么继续迭代 ht[1]
+        ht = &iter->t->ht[iter->table];
+        iter->index++;
+        if (iter->index >= (long)ht->size) {
+            if (kvtableIsRehashing(iter->t) && iter->table == 0) {
+                iter->table++;
+                iter->index = 0;
+                ht = &iter->t->ht[1];
+            } else {
+                return NULL;
+            }
+        }
+        iter->bucket = &ht->buckets[iter->index];
+        iter->slot = 0;
+    }
+}
+
+void kvtableReleaseIterator(kvtableIterator *iter) {
+    iter->t->iterators--;
+    zfree(iter);
+}
+
+/* ----------------------------- Sampling ---------------------------------- */
+
+/* Number of entries in the chain starting at 'head'. */
+static unsigned int _kvtableChainCount(kvBucket *head) {
+    unsigned int count = 0;
+
+    for (; head; head = head->next) count += __builtin_popcount(head->presence);
+    return count;
+}
+
+/* Return the entry at position 'pos' of the chain starting at 'head'. */
+static kvEntry *_kvtableChainGet(kvBucket *head, unsigned int pos) {
+    kvBucket *b;
+    int s;
+
+    for (b = head; b; b = b->next) {
+        for (s = 0; s < KVTABLE_BUCKET_SLOTS; s++) {
+            if (!(b->presence & (1<<s))) continue;
+            if (pos-- == 0) return b->entries[s];
+        }
+    }
+    return NULL; /* Not reached. */
+}
+
+/* Return up to 'count' distinct entries starting from a random bucket and
+ * walking the buckets sequentially, stopping after count*10 buckets.
+ * Every bucket of every table is visited at most once, so an entry is
+ * never returned twice.
+ *
+ * Slots are filled in insertion order, so taking the first entries of a
+ * bucket would favour the oldest keys: only one entry starting at a random
+ * position is taken from every chain, unless the table has fewer buckets
+ * than the requested entries.
+ *
+ * 从随机的桶开始顺序访问各个桶，返回最多 count 个不同的节点。
+ * 槽位按照插入顺序使用，所以每个桶链只从随机位置开始取一个节点，
+ * 以免取样偏向较早添加的键。 */
+unsigned int kvtableGetSomeEntries(kvtable *t, kvEntry **des, unsigned int count) {
+    unsigned long j, i, maxsizemask, visited = 0;
+    unsigned long maxsteps;
+    unsigned int stored = 0;
+    int tables;
+
+    if (kvtableSize(t) < count) count = kvtableSize(t);
+    if (count == 0) return 0;
+    maxsteps = count*10;
+
+    /* Try to do a rehashing work proportional to 'count'. */
+    for (j = 0; j < count; j++) {
+        if (kvtableIsRehashing(t))
+            _kvtableRehashStep(t);
+        else
+            break;
+    }
+
+    tables = kvtableIsRehashing(t) ? 2 : 1;
+    maxsizemask = t->ht[0].sizemask;
+    if (tables > 1 && maxsizemask < t->ht[1].sizemask)
+        maxsizemask = t->ht[1].sizemask;
+
+    i = random() & maxsizemask;
+    while (stored < count && maxsteps-- && visited++ <= maxsizemask) {
+        for (j = 0; j < (unsigned long)tables; j++) {
+            kvBucket *b;
+            unsigned int n;
+
+            /* Indexes past the end of the smaller table are only found in
+             * the bigger one, and ht[0] is empty up to rehashidx. */
+            if (i >= t->ht[j].size) continue;
+            if (tables == 2 && j == 0 && i < (unsigned long)t->rehashidx)
+                continue;
+            b = &t->ht[j].buckets[i];
+            if ((n = _kvtableChainCount(b)) != 0) {
+                unsigned int pos = random() % n, k;
+
+                for (k = 0; k < n; k++) {
+                    des[stored++] = _kvtableChainGet(b,(pos+k) % n);
+                    if (stored == count) return stored;
+                }
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
+/* Return a random entry of a random non empty bucket chain. */
+static kvEntry *_kvtableGetRandomEntry(kvtable *t) {
+    kvBucket *head;
+    unsigned long h;
+
+    if (kvtableSize(t) == 0) return NULL;
+    if (kvtableIsRehashing(t)) _kvtableRehashStep(t);
+
+    do {
+        if (kvtableIsRehashing(t)) {
+            /* ht[0] is empty up to rehashidx. */
+            h = t->rehashidx +
+                (random() % (kvtableBuckets(t) - t->rehashidx));
+            head = (h >= t->ht[0].size) ?
+                   &t->ht[1].buckets[h - t->ht[0].size] :
+                   &t->ht[0].buckets[h];
+        } else {
+            head = &t->ht[0].buckets[random() & t->ht[0].sizemask];
+        }
+    } while (_kvtableChainIsEmpty(head));
+
+    return _kvtableChainGet(head,random() % _kvtableChainCount(head));
+}
+
+/* Return a random entry out of a kvtableGetSomeEntries() run, which is
+ * less biased toward the entries of short chains than picking a random
+ * chain first.
+ *
+ * 从 kvtableGetSomeEntries() 返回的节点中随机返回一个。 */
+#define GETFAIR_NUM_ENTRIES 20
+kvEntry *kvtableGetFairRandomEntry(kvtable *t) {
+    kvEntry *entries[GETFAIR_NUM_ENTRIES];
+    unsigned int count = kvtableGetSomeEntries(t,entries,GETFAIR_NUM_ENTRIES);
+
+    if (count == 0) return _kvtableGetRandomEntry(t);
+    return entries[random() % count];
+}
+
+/* Return up to 'count' distinct random volatile entries. Random indexes
+ * are drawn until 'count' different ones are found, which is cheap as the
+ * callers sample a few entries at a time: when there are not more than
+ * 'count' volatile entries all of them are returned.
+ *
+ * 随机返回最多 count 个不同的带有过期时间的节点。 */
+unsigned int kvtableGetSomeVolatile(kvtable *t, kvEntry **des, unsigned int count) {
+    unsigned long used = t->volatile_used;
+    unsigned int stored = 0, j;
+
+    if (used <= count) {
+        memcpy(des,t->volatile_entries,sizeof(kvEntry*)*used);
+        return used;
+    }
+    while (stored < count) {
+        kvEntry *e = t->volatile_entries[random() % used];
+
+        for (j = 0; j < stored; j++)
+            if (des[j] == e) break;
+        if (j == stored) des[stored++] = e;
+    }
+    return stored;
+}
+
+/*
+ * 随机返回一个带有过期时间的节点，没有这种节点时返回 NULL
+ */
+kvEntry *kvtableGetRandomVolatile(kvtable *t) {
+    if (t->volatile_used == 0) return NULL;
+    return t->volatile_entries[random() % t->volatile_used];
+}
+
+/* ------------------------------- Scan ------------------------------------ */
+
+/* Function to reverse bits. Algorithm from:
+ * http://graphics.stanford.edu/~seander/bithacks.html#ReverseParallel */
+static unsigned long rev(unsigned long v) {
+    unsigned long s = 8 * sizeof(v); // bit size; must be power of 2
+    unsigned long mask = ~0;
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+static void _kvtableScanChain(kvBucket *b, kvtableScanFunction *fn, void *privdata) {
+    while (b) {
+        int s;
+
+        for (s = 0; s < KVTABLE_BUCKET_SLOTS; s++)
+            if (b->presence & (1<<s)) fn(privdata,b->entries[s]);
+        b = b->next;
+    }
+}
+
+/* kvtableScan() iterates the table with the same guarantees of dictScan():
+ * every entry present from the start to the end of the iteration is
+ * returned at least once. The cursor is a bucket index incremented from
+ * its most significant bit, see dictScan() in dict.c for the details.
+ *
+ * 和 dictScan() 一样使用反向二进制递增的游标迭代表中的节点，
+ * 每次调用返回一个（rehash 时是多个）桶链中的所有节点。 */
+unsigned long kvtableScan(kvtable *t,
+                          unsigned long v,
+                          kvtableScanFunction *fn,
+                          void *privdata)
+{
+    kvtableHt *t0, *t1;
+    unsigned long m0, m1;
+
+    if (kvtableSize(t) == 0) return 0;
+
+    if (!kvtableIsRehashing(t)) {
+        t0 = &t->ht[0];
+        m0 = t0->sizemask;
+        _kvtableScanChain(&t0->buckets[v & m0],fn,privdata);
+    } else {
+        t0 = &t->ht[0];
+        t1 = &t->ht[1];
+
+        /* Make sure t0 is the smaller and t1 is the bigger table */
+        if (t0->size > t1->size) {
+            t0 = &t->ht[1];
+            t1 = &t->ht[0];
+        }
+        m0 = t0->sizemask;
+        m1 = t1->sizemask;
+
+        _kvtableScanChain(&t0->buckets[v & m0],fn,privdata);
+
+        /* Iterate over indices in larger table that are the expansion
+         * of the index pointed to by the cursor in the smaller table */
+        do {
+            _kvtableScanChain(&t1->buckets[v & m1],fn,privdata);
+
+            /* Increment bits not covered by the smaller mask */
+            v = (((v | m0) + 1) & ~m0) | (v & m0);
+
+            /* Continue while bits covered by mask difference is non-zero */
+        } while (v & (m0 ^ m1));
+    }
+
+    /* Set unmasked bits so incrementing the reversed cursor
+     * operates on the masked bits of the smaller table */
+    v |= ~m0;
+
+    /* Increment the reverse cursor */
+    v = rev(v);
+    v++;
+    v = rev(v);
+
+    return v;
+}
+
+/* ------------------------- private functions ------------------------------ */
+
+/*
+ * 根据需要，扩展表的大小
+ */
+static int _kvtableExpandIfNeeded(kvtable *t) {
+    if (kvtableIsRehashing(t)) return KVTABLE_OK;
+    if (t->ht[0].size == 0) return kvtableExpand(t,KVTABLE_HT_INITIAL_SIZE);
+
+    if (t->ht[0].used >= t->ht[0].size*KVTABLE_BUCKET_FILL &&
+        (kvtable_can_resize ||
+         t->ht[0].used/t->ht[0].size >
+            KVTABLE_BUCKET_FILL*kvtable_force_resize_ratio))
+    {
+        return kvtableExpand(t,t->ht[0].size*2);
+    }
+    return KVTABLE_OK;
+}
+
+static unsigned long _kvtableNextPower(unsigned long size) {
+    unsigned long i = KVTABLE_HT_INITIAL_SIZE;
+
+    if (size >= LONG_MAX) return LONG_MAX;
+    while(1) {
+        if (i >= size)
+            return i;
+        i *= 2;
+    }
+}
+
+void kvtableEnableResize(void) {
+    kvtable_can_resize = 1;
+}
+
+void kvtableDisableResize(void) {
+    kvtable_can_resize = 0;
+}
+
+#ifdef KVTABLE_BENCHMARK_MAIN
+
+/* Keyspace benchmark: the same keys are stored in a main dict plus an
+ * expires dict, the layout used before the kvtable, and in a kvtable. For
+ * both layouts it measures the memory used by the table (the keys are
+ * allocated beforehand and not counted), the insertion, a
+ * lookup of the value and the TTL of random existing keys, a lookup of
+ * missing keys, sampling 20 volatile keys as the active expire cycle does,
+ * and the deletion of every key. The kvtable is also checked against the
+ * keys it should contain. Build with:
+ * cc -O2 -DKVTABLE_BENCHMARK_MAIN -DUSE_JEMALLOC -I../deps/jemalloc/include \
+ *    kvtable.c dict.c zmalloc.c ../deps/jemalloc/lib/libjemalloc.a \
+ *    -lpthread -ldl -o kvtable-benchmark
+ * and run "./kvtable-benchmark <numkeys> [dict|kvtable|both] [volatile%]".
+ * A single layout can be run to benchmark sizes whose two layouts don't
+ * fit in memory at the same time. By default all the keys are volatile. */
+
+#include "dict.h"
+
+#define BENCH_MISSES 1000000
+
+static int benchVolatilePerc = 100;
+#define benchIsVolatile(j) ((j) % 100 < benchVolatilePerc)
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+static unsigned int benchHash(const void *key) {
+    return dictGenHashFunction(key,strlen(key));
+}
+
+static int benchKeyCompare(void *privdata, const void *key1, const void *key2) {
+    DICT_NOTUSED(privdata);
+    return strcmp(key1,key2) == 0;
+}
+
+static dictType benchDictType = {
+    benchHash, NULL, NULL, benchKeyCompare, NULL, NULL
+};
+
+static kvtableType benchKvtableType = {
+    benchHash, benchKeyCompare, NULL, NULL
+};
+
+static char *benchKey(const char *prefix, long j) {
+    char buf[32];
+    int len = snprintf(buf,sizeof(buf),"%s:%ld",prefix,j);
+    char *key = zmalloc(len+1);
+
+    memcpy(key,buf,len+1);
+    return key;
+}
+
+/* A cheap random generator, so that the benchmark measures the tables. */
+static unsigned long long benchSeed;
+static unsigned long benchRandom(void) {
+    benchSeed ^= benchSeed << 13;
+    benchSeed ^= benchSeed >> 7;
+    benchSeed ^= benchSeed << 17;
+    return benchSeed;
+}
+
+static void benchReport(const char *name, const char *op, long long start,
+                        long ops, long long sum) {
+    printf("%-8s %-22s %5lld ns/op (%lld)\n",
+        name, op, (usec()-start)*1000/ops, sum);
+}
+
+static void benchDict(char **keys, long numkeys, char **misses) {
+    dict *d = dictCreate(&benchDictType,NULL);
+    dict *expires = dictCreate(&benchDictType,NULL);
+    size_t mem = zmalloc_used_memory();
+    dictEntry *des[20];
+    long long start, sum = 0;
+    long j;
+
+    start = usec();
+    for (j = 0; j < numkeys; j++) {
+        dictAdd(d,keys[j],keys[j]);
+        if (benchIsVolatile(j)) {
+            dictEntry *de = dictAddRaw(expires,keys[j]);
+            dictSetSignedIntegerVal(de,j);
+        }
+    }
+    while (dictIsRehashing(d)) dictRehash(d,100);
+    while (dictIsRehashing(expires)) dictRehash(expires,100);
+    benchReport("dict","insert",start,numkeys,0);
+    printf("dict     memory %.1f MB, %.1f bytes/key\n",
+        (double)(zmalloc_used_memory()-mem)/(1024*1024),
+        (double)(zmalloc_used_memory()-mem)/numkeys);
+
+    /* The lookup of the server before the kvtable: find the entry in the
+     * main dict, then the expire in the expires dict. */
+    benchSeed = 1234;
+    start = usec();
+    for (j = 0; j < numkeys; j++) {
+        char *key = keys[benchRandom() % numkeys];
+        dictEntry *de = dictFind(d,key), *ede;
+
+        ede = dictSize(expires) ? dictFind(expires,key) : NULL;
+        sum += (ede ? dictGetSignedIntegerVal(ede) : -1) +
+               ((long)dictGetVal(de) & 1);
+    }
+    benchReport("dict","lookup+TTL",start,numkeys,sum);
+
+    start = usec();
+    for (j = 0; j < BENCH_MISSES; j++)
+        sum += dictFind(d,misses[j]) != NULL;
+    benchReport("dict","lookup missing key",start,BENCH_MISSES,sum);
+
+    start = usec();
+    for (j = 0; j < numkeys/20; j++) {
+        unsigned int count = dictGetSomeKeys(expires,des,20), k;
+
+        for (k = 0; k < count; k++) sum += dictGetSignedIntegerVal(des[k]);
+    }
+    benchReport("dict","sample 20 volatile",start,numkeys/20,sum);
+
+    start = usec();
+    for (j = 0; j < numkeys; j++) {
+        dictDelete(expires,keys[j]);
+        dictDelete(d,keys[j]);
+    }
+    benchReport("dict","delete",start,numkeys,0);
+    dictRelease(d);
+    dictRelease(expires);
+}
+
+static void benchScanCount(void *privdata, const kvEntry *e) {
+    (*(long*)privdata)++;
+    (void) e;
+}
+
+static void benchKvtable(char **keys, long numkeys, char **misses) {
+    kvtable *t = kvtableCreate(&benchKvtableType);
+    size_t mem = zmalloc_used_memory();
+    kvEntry *des[20];
+    unsigned long cursor = 0;
+    long long start, sum = 0;
+    long j, scanned = 0;
+
+    start = usec();
+    for (j = 0; j < numkeys; j++) {
+        kvEntry *e = kvtableAdd(t,keys[j],keys[j]);
+
+        if (benchIsVolatile(j)) kvtableSetExpire(t,e,j);
+    }
+    while (kvtableIsRehashing(t)) kvtableRehash(t,100);
+    benchReport("kvtable","insert",start,numkeys,0);
+    printf("kvtable  memory %.1f MB, %.1f bytes/key\n",
+        (double)(zmalloc_used_memory()-mem)/(1024*1024),
+        (double)(zmalloc_used_memory()-mem)/numkeys);
+
+    benchSeed = 1234;
+    start = usec();
+    for (j = 0; j < numkeys; j++) {
+        kvEntry *e = kvtableFind(t,keys[benchRandom() % numkeys]);
+
+        sum += kvtableGetExpire(e) + ((long)kvtableGetVal(e) & 1);
+    }
+    benchReport("kvtable","lookup+TTL",start,numkeys,sum);
+
+    start = usec();
+    for (j = 0; j < BENCH_MISSES; j++)
+        sum += kvtableFind(t,misses[j]) != NULL;
+    benchReport("kvtable","lookup missing key",start,BENCH_MISSES,sum);
+
+    start = usec();
+    for (j = 0; j < numkeys/20; j++) {
+        unsigned int count = kvtableGetSomeVolatile(t,des,20), k;
+
+        for (k = 0; k < count; k++) sum += kvtableGetExpire(des[k]);
+    }
+    benchReport("kvtable","sample 20 volatile",start,numkeys/20,sum);
+
+    /* Check that every key is there with its expire, and that a scan
+     * returns all of them. */
+    for (j = 0; j < numkeys; j++) {
+        kvEntry *e = kvtableFind(t,keys[j]);
+
+        assert(e && kvtableGetVal(e) == keys[j]);
+        assert(kvtableGetExpire(e) == (benchIsVolatile(j) ? j : -1));
+    }
+    do {
+        cursor = kvtableScan(t,cursor,benchScanCount,&scanned);
+    } while (cursor);
+    assert(scanned == numkeys);
+
+    start = usec();
+    for (j = 0; j < numkeys; j++) kvtableDelete(t,keys[j]);
+    benchReport("kvtable","delete",start,numkeys,0);
+    assert(kvtableSize(t) == 0 && kvtableVolatileSize(t) == 0);
+    kvtableRelease(t);
+}
+
+int main(int argc, char **argv) {
+    long numkeys = (argc >= 2) ? atol(argv[1]) : 10000000;
+    char *layout = (argc >= 3) ? argv[2] : "both";
+    char **keys = zmalloc(sizeof(char*)*numkeys);
+    char **misses = zmalloc(sizeof(char*)*BENCH_MISSES);
+    long j;
+
+    for (j = 0; j < numkeys; j++) keys[j] = benchKey("key",j);
+    for (j = 0; j < BENCH_MISSES; j++) misses[j] = benchKey("miss",j);
+    if (argc >= 4) benchVolatilePerc = atoi(argv[3]);
+    printf("%ld keys, %d%% volatile\n", numkeys, benchVolatilePerc);
+    if (strcmp(layout,"kvtable")) benchDict(keys,numkeys,misses);
+    if (strcmp(layout,"dict")) benchKvtable(keys,numkeys,misses);
+    for (j = 0; j < numkeys; j++) zfree(keys[j]);
+    for (j = 0; j < BENCH_MISSES; j++) zfree(misses[j]);
+    zfree(keys);
+    zfree(misses);
+    return 0;
+}
+#endif
@@ -0,0 +1,220 @@
+/* Keyspace table -- a cache line aware hash table holding the keys of a
+ * Redis database together with their expire times.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __KVTABLE_H
+#define __KVTABLE_H
+
+#include <stdint.h>
+
+#define KVTABLE_OK 0
+#define KVTABLE_ERR 1
+
+/* Entry slots in a bucket: with the presence byte, the tags and the link to
+ * the next bucket of the chain a bucket is exactly 64 bytes. */
+#define KVTABLE_BUCKET_SLOTS 6
+
+/* Initial number of buckets of a table. */
+#define KVTABLE_HT_INITIAL_SIZE 4
+
+/* The table grows when there are on average KVTABLE_BUCKET_FILL entries
+ * per bucket, so that most buckets never need a chained bucket. */
+#define KVTABLE_BUCKET_FILL 5
+
+/* The expire of a key without a time to live. */
+#define KVTABLE_NO_EXPIRE -1
+
+/*
+ * 键空间节点
+ *
+ * 过期时间和键值对保存在同一个节点里，
+ * 所以读取一个带有过期时间的键只需要一次查找。
+ */
+typedef struct kvEntry {
+
+    // 键
+    void *key;
+
+    // 值
+    void *val;
+
+    // 以毫秒为单位的过期时间， KVTABLE_NO_EXPIRE 表示没有过期时间
+    long long expire;
+
+    // 节点在带过期时间的节点数组中的索引（只在 expire 不为 -1 时有效）
+    unsigned long vidx;
+
+} kvEntry;
+
+/* A bucket fills exactly one cache line. A lookup compares the 8 bits tag
+ * of the hash with the tags of the used slots first, and only dereferences
+ * the entries whose tag matches.
+ *
+ * 桶的大小正好是一个缓存行。查找时先对比哈希值的 8 位标签，
+ * 只有标签相同的节点才需要访问。 */
+typedef struct kvBucket {
+
+    // 已使用的槽位，每个槽位一位
+    uint8_t presence;
+
+    // 每个槽位中节点的哈希标签
+    uint8_t tags[KVTABLE_BUCKET_SLOTS];
+
+    uint8_t unused;
+
+    // 节点指针
+    kvEntry *entries[KVTABLE_BUCKET_SLOTS];
+
+    // 桶满时链接的下一个桶
+    struct kvBucket *next;
+
+} kvBucket;
+
+/*
+ * 特定于类型的一簇处理函数
+ */
+typedef struct kvtableType {
+    // 计算键的哈希值函数
+    unsigned int (*hashFunction)(const void *key);
+    // 对比两个键的函数
+    int (*keyCompare)(void *privdata, const void *key1, const void *key2);
+    // 键的释构函数
+    void (*keyDestructor)(void *privdata, void *key);
+    // 值的释构函数
+    void (*valDestructor)(void *privdata, void *obj);
+} kvtableType;
+
+/*
+ * 哈希表
+ */
+typedef struct kvtableHt {
+
+    // 桶数组
+    kvBucket *buckets;
+
+    // 桶数组的大小
+    unsigned long size;
+
+    // 桶数组的长度掩码，用于计算索引值
+    unsigned long sizemask;
+
+    // 哈希表现有的节点数量
+    unsigned long used;
+
+} kvtableHt;
+
+/*
+ * 键空间表
+ *
+ * 和字典一样使用两个哈希表实现渐进式 rehash 。
+ * 带有过期时间的节点另外保存在一个紧凑的数组里，用于随机取样。
+ */
+typedef struct kvtable {
+
+    // 特定于类型的处理函数
+    kvtableType *type;
+
+    // 哈希表（2个）
+    kvtableHt ht[2];
+
+    // 记录 rehash 进度的标志，值为-1 表示 rehash 未进行
+    long rehashidx;
+
+    // 当前正在运作的迭代器数量
+    int iterators;
+
+    // 带有过期时间的节点
+    kvEntry **volatile_entries;
+
+    // 带有过期时间的节点数量，以及数组的大小
+    unsigned long volatile_used;
+    unsigned long volatile_size;
+
+} kvtable;
+
+/*
+ * 迭代器
+ *
+ * 迭代器运作期间 rehash 会暂停，所以可以删除当前节点，
+ * 也可以查找和添加节点（新添加的节点不一定会被返回）。
+ */
+typedef struct kvtableIterator {
+
+    // 正在迭代的表
+    kvtable *t;
+
+    // 正在迭代的哈希表的号码（0 或者 1），以及桶数组的索引
+    int table;
+    long index;
+
+    // 当前桶和桶内的槽位
+    kvBucket *bucket;
+    int slot;
+
+} kvtableIterator;
+
+// kvtableScan() 对每个返回的节点调用的回调函数
+typedef void (kvtableScanFunction)(void *privdata, const kvEntry *e);
+
+/* ------------------------------- Macros ------------------------------------*/
+#define kvtableGetKey(e) ((e)->key)
+#define kvtableGetVal(e) ((e)->val)
+#define kvtableGetExpire(e) ((e)->expire)
+#define kvtableSetVal(e, _val_) do { (e)->val = (_val_); } while(0)
+#define kvtableSize(t) ((t)->ht[0].used+(t)->ht[1].used)
+#define kvtableBuckets(t) ((t)->ht[0].size+(t)->ht[1].size)
+#define kvtableVolatileSize(t) ((t)->volatile_used)
+#define kvtableIsRehashing(t) ((t)->rehashidx != -1)
+
+/* API */
+kvtable *kvtableCreate(kvtableType *type);
+void kvtableRelease(kvtable *t);
+void kvtableEmpty(kvtable *t);
+int kvtableExpand(kvtable *t, unsigned long size);
+int kvtableResize(kvtable *t);
+int kvtableNeedsResize(kvtable *t, int minfill);
+kvEntry *kvtableFind(kvtable *t, const void *key);
+kvEntry *kvtableAdd(kvtable *t, void *key, void *val);
+int kvtableDelete(kvtable *t, const void *key);
+void kvtableSetExpire(kvtable *t, kvEntry *e, long long when);
+kvtableIterator *kvtableGetIterator(kvtable *t);
+kvEntry *kvtableNext(kvtableIterator *iter);
+void kvtableReleaseIterator(kvtableIterator *iter);
+unsigned int kvtableGetSomeEntries(kvtable *t, kvEntry **des, unsigned int count);
+kvEntry *kvtableGetFairRandomEntry(kvtable *t);
+unsigned int kvtableGetSomeVolatile(kvtable *t, kvEntry **des, unsigned int count);
+kvEntry *kvtableGetRandomVolatile(kvtable *t);
+unsigned long kvtableScan(kvtable *t, unsigned long v, kvtableScanFunction *fn, void *privdata);
+int kvtableRehash(kvtable *t, int n);
+int kvtableRehashMilliseconds(kvtable *t, int ms);
+void kvtableEnableResize(void);
+void kvtableDisableResize(void);
+
+#endif /* __KVTABLE_H */
@@ -0,0 +1,207 @@
+/* Lazy freeing of keys and databases.
+ *
+ * Freeing a big aggregate value (a list, set, sorted set or hash with
+ * millions of elements) means one free() call per element, so deleting it
+ * can block the server for a long time. The functions in this file unlink
+ * the value from the keyspace immediately, so that it is no longer
+ * reachable, and hand the actual reclaiming to the REDIS_BIO_LAZY_FREE
+ * background thread (see bio.c).
+ *
+ * 惰性释放（lazy free）：
+ * 释放一个包含数百万元素的聚合值需要对每个元素调用一次 free() ，
+ * 这可能会阻塞服务器很长时间。
+ * 本文件中的函数会立即将值从键空间中移除（客户端从此无法再访问到它），
+ * 然后交给 REDIS_BIO_LAZY_FREE 后台线程去真正释放内存。
+ *
+ * Objects handed to the background thread may still have some of their
+ * elements referenced by the main thread, for instance by the reply list of
+ * a client, so this requires reference counting to be atomic. Where atomic
+ * builtins are not available (see HAVE_ATOMIC in config.h) everything is
+ * freed synchronously.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "bio.h"
+
+void SlotToKeyDel(robj *key);
+
+/* Number of objects queued for the background thread and not yet freed. */
+// 等待后台线程释放的对象数量
+static size_t lazyfree_objects = 0;
+
+#ifdef HAVE_ATOMIC
+#define lazyfreeIncrPending(n) __sync_add_and_fetch(&lazyfree_objects,(n))
+#define lazyfreeDecrPending(n) __sync_sub_and_fetch(&lazyfree_objects,(n))
+#define lazyfreeGetPending() __sync_add_and_fetch(&lazyfree_objects,0)
+#else
+#define lazyfreeIncrPending(n) (lazyfree_objects += (n))
+#define lazyfreeDecrPending(n) (lazyfree_objects -= (n))
+#define lazyfreeGetPending() (lazyfree_objects)
+#endif
+
+/* Return the number of objects waiting to be freed by the background
+ * thread. Reported in INFO. */
+size_t lazyfreeGetPendingObjectsCount(void) {
+    return lazyfreeGetPending();
+}
+
+/* Return the amount of work needed in order to free an object: roughly the
+ * number of allocations to release. Objects encoded as a single allocation
+ * (ziplists, intsets, strings) always return 1.
+ *
+ * 返回释放一个对象所需的工作量，也即是大约需要释放多少块内存。
+ * 以单块内存编码的对象（ziplist 、 intset 和字符串）总是返回 1 。 */
+size_t lazyfreeGetFreeEffort(robj *obj) {
+    if (obj->type == REDIS_LIST && obj->encoding == REDIS_ENCODING_QUICKLIST) {
+        return ((quicklist*)obj->ptr)->len;
+    } else if (obj->type == REDIS_SET && obj->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)obj->ptr);
+    } else if (obj->type == REDIS_ZSET &&
+               obj->encoding == REDIS_ENCODING_SKIPLIST)
+    {
+        return ((zset*)obj->ptr)->zsl->length;
+    } else if (obj->type == REDIS_HASH && obj->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)obj->ptr);
+    } else if (obj->type == REDIS_STRING &&
+               obj->encoding == REDIS_ENCODING_ROARING)
+    {
+        return ((roaring*)obj->ptr)->len;
+    } else if (obj->type == REDIS_STREAM) {
+        stream *s = obj->ptr;
+        size_t effort = s->index->length;
+
+        /* Every pending entry of the consumer groups is an allocation. */
+        if (s->cgroups) {
+            dictIterator *di = dictGetIterator(s->cgroups);
+            dictEntry *de;
+
+            while((de = dictNext(di)) != NULL) {
+                streamCG *cg = dictGetVal(de);
+                effort += cg->pel->length + dictSize(cg->consumers);
+            }
+            dictReleaseIterator(di);
+        }
+        return effort;
+    } else {
+        return 1; /* Everything else is a single allocation. */
+    }
+}
+
+/* Release the reference to 'o' owned by the keyspace. If this is the last
+ * reference and freeing the object is expensive, the object is freed by the
+ * background thread, otherwise it is freed synchronously.
+ *
+ * 释放键空间持有的对象 o 的引用。
+ * 如果这是最后一个引用，并且释放对象的代价较高，那么由后台线程来释放它，
+ * 否则同步地释放。 */
+void freeObjAsync(robj *o) {
+#ifdef HAVE_ATOMIC
+    /* If the object is shared (for instance it is in the reply list of a
+     * client) freeing it now just means decrementing the refcount. */
+    if (o->refcount == 1 &&
+        lazyfreeGetFreeEffort(o) > REDIS_LAZYFREE_THRESHOLD)
+    {
+        lazyfreeIncrPending(1);
+        bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,o,NULL,NULL);
+        return;
+    }
+#endif
+    decrRefCount(o);
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * The value is reclaimed by freeObjAsync(). Returns 1 if the key was
+ * deleted, 0 if it did not exist.
+ *
+ * 从数据库中删除给定的键、值以及过期时间（如果有的话），
+ * 值交给 freeObjAsync() 去释放。
+ * 删除成功返回 1 ，键不存在返回 0 。 */
+int dbAsyncDelete(redisDb *db, robj *key) {
+    kvEntry *e;
+    robj *val;
+
+    if ((e = kvtableFind(db->keyspace,key->ptr)) == NULL) return 0;
+
+    /* Take the value away from the entry, so that deleting the entry does
+     * not free it: dictRedisObjectDestructor ignores NULL values. The
+     * expire is stored in the entry and goes away with it. */
+    // 取走节点中的值，这样删除节点时就不会释放它
+    val = kvtableGetVal(e);
+    kvtableSetVal(e,NULL);
+    kvtableDelete(db->keyspace,key->ptr);
+    if (server.cluster_enabled) SlotToKeyDel(key);
+
+    freeObjAsync(val);
+    return 1;
+}
+
+/* Empty a Redis DB asynchronously: the DB gets a fresh empty keyspace
+ * right away, while the old one is released by the background thread.
+ *
+ * 异步地清空数据库：
+ * 数据库立即换上新的空白键空间，而旧的键空间则由后台线程释放。 */
+void emptyDbAsync(redisDb *db) {
+    kvtable *oldkeyspace = db->keyspace;
+
+    db->keyspace = kvtableCreate(&dbKvtableType);
+    lazyfreeFreeKeyspaceAsync(oldkeyspace);
+}
+
+/* Release the keyspace 't' (no longer referenced by the server) on the
+ * background thread. Small keyspaces are freed synchronously. */
+void lazyfreeFreeKeyspaceAsync(kvtable *t) {
+#ifdef HAVE_ATOMIC
+    size_t count = kvtableSize(t);
+
+    if (count > REDIS_LAZYFREE_THRESHOLD) {
+        lazyfreeIncrPending(count);
+        bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,NULL,t,NULL);
+        return;
+    }
+#endif
+    kvtableRelease(t);
+}
+
+/* Release objects from the lazyfree thread. It's just decrRefCount()
+ * updating the count of objects to release. */
+void lazyfreeFreeObjectFromBioThread(robj *o) {
+    decrRefCount(o);
+    lazyfreeDecrPending(1);
+}
+
+/* Release a database keyspace from the lazyfree thread. */
+void lazyfreeFreeDatabaseFromBioThread(kvtable *t) {
+    size_t numkeys = kvtableSize(t);
+
+    kvtableRelease(t);
+    lazyfreeDecrPending(numkeys);
+}
@@ -0,0 +1,1120 @@
+/* Listpack -- A compact list of strings and integers, designed to replace
+ * the ziplist.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* LISTPACK OVERALL LAYOUT
+ * =======================
+ *
+ * <total-bytes> <num-elements> <element-1> ... <element-N> <end>
+ *
+ * <total-bytes> is a 32 bit unsigned integer with the size of the whole
+ * listpack, header and terminator included.
+ *
+ * <num-elements> is a 16 bit unsigned integer with the number of elements.
+ * When it is 65535 the number of elements is unknown and lpLength() has to
+ * scan the listpack to compute it.
+ *
+ * <end> is a single byte set to 255 (0xFF).
+ *
+ * All the integers are stored in little endian.
+ *
+ * LISTPACK ENTRIES
+ * ================
+ *
+ * <encoding-type><element-data><element-tot-len>
+ *
+ * Unlike ziplist entries, that start with the length of the *previous*
+ * entry, a listpack entry ends with its *own* length <element-tot-len>
+ * (the size of the encoding and of the data). So an entry never changes
+ * when its neighbours change, and inserting, deleting or updating an entry
+ * never needs to rewrite the following ones: there are no cascading
+ * updates. The list can still be traversed from right to left, since
+ * the length of the previous entry is just before the current one.
+ *
+ * <element-tot-len> is a variable length integer, stored so that it can
+ * be parsed from right to left: every byte holds 7 bits, the most
+ * significant bit is set if there are more bytes on the left. Entries up
+ * to 127 bytes use a single byte.
+ *
+ * The encoding byte:
+ *
+ * 0xxxxxxx                     7 bit unsigned integer.
+ * 10xxxxxx                     string of up to 63 bytes.
+ * 110xxxxx yyyyyyyy            13 bit signed integer.
+ * 1110xxxx yyyyyyyy            string of up to 4095 bytes.
+ * 11110000 <4 bytes len>       string of up to 2^32-1 bytes.
+ * 11110001 <2 bytes>           16 bit signed integer.
+ * 11110010 <3 bytes>           24 bit signed integer.
+ * 11110011 <4 bytes>           32 bit signed integer.
+ * 11110100 <8 bytes>           64 bit signed integer.
+ * 11111111                     end of listpack.
+ */
+
+/*
+ * listpack 是 ziplist 的替代品。
+ *
+ * 和 ziplist 不同，listpack 的每个节点在自己的末尾保存自己的长度，
+ * 而不是在开头保存前一个节点的长度：
+ * 因此修改一个节点永远不会影响其他节点，不会出现连锁更新。
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <assert.h>
+#include "zmalloc.h"
+#include "util.h"
+#include "ziplist.h"
+#include "listpack.h"
+
+#define LP_HDR_SIZE 6       /* 32 bit total len + 16 bit number of elements. */
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+#define LP_MAX_INT_ENCODING_LEN 9
+#define LP_MAX_BACKLEN_SIZE 5
+#define LP_ENCODING_INT 0
+#define LP_ENCODING_STRING 1
+
+#define LP_ENCODING_7BIT_UINT 0
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_IS_7BIT_UINT(byte) (((byte)&LP_ENCODING_7BIT_UINT_MASK)==LP_ENCODING_7BIT_UINT)
+
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_IS_6BIT_STR(byte) (((byte)&LP_ENCODING_6BIT_STR_MASK)==LP_ENCODING_6BIT_STR)
+
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_IS_13BIT_INT(byte) (((byte)&LP_ENCODING_13BIT_INT_MASK)==LP_ENCODING_13BIT_INT)
+
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_IS_12BIT_STR(byte) (((byte)&LP_ENCODING_12BIT_STR_MASK)==LP_ENCODING_12BIT_STR)
+
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+#define LP_ENCODING_32BIT_STR 0xF0
+
+#define LP_EOF 0xFF
+
+#define LP_ENCODING_6BIT_STR_LEN(p) ((p)[0] & 0x3F)
+#define LP_ENCODING_12BIT_STR_LEN(p) ((((p)[0] & 0xF) << 8) | (p)[1])
+#define LP_ENCODING_32BIT_STR_LEN(p) (((uint32_t)(p)[1]<<0) | \
+                                      ((uint32_t)(p)[2]<<8) | \
+                                      ((uint32_t)(p)[3]<<16) | \
+                                      ((uint32_t)(p)[4]<<24))
+
+#define lpGetTotalBytes(p)           (((uint32_t)(p)[0]<<0) | \
+                                      ((uint32_t)(p)[1]<<8) | \
+                                      ((uint32_t)(p)[2]<<16) | \
+                                      ((uint32_t)(p)[3]<<24))
+
+#define lpGetNumElements(p)          (((uint32_t)(p)[4]<<0) | \
+                                      ((uint32_t)(p)[5]<<8))
+#define lpSetTotalBytes(p,v) do { \
+    (p)[0] = (v)&0xff; \
+    (p)[1] = ((v)>>8)&0xff; \
+    (p)[2] = ((v)>>16)&0xff; \
+    (p)[3] = ((v)>>24)&0xff; \
+} while(0)
+
+#define lpSetNumElements(p,v) do { \
+    (p)[4] = (v)&0xff; \
+    (p)[5] = ((v)>>8)&0xff; \
+} while(0)
+
+/* Create a new, empty listpack. */
+/*
+ * 创建一个新的空 listpack
+ *
+ * T = O(1)
+ */
+unsigned char *lpNew(void) {
+    unsigned char *lp = zmalloc(LP_HDR_SIZE+1);
+
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+/* Free the specified listpack. */
+void lpFree(unsigned char *lp) {
+    zfree(lp);
+}
+
+/* Return the total number of bytes the listpack is composed of. */
+/*
+ * 返回 listpack 占用的字节数
+ */
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+/* Check if the string 'ele' of length 'size' can be encoded as an integer,
+ * and if so store the encoded integer in 'intenc' and its size in 'enclen',
+ * returning LP_ENCODING_INT. Otherwise return LP_ENCODING_STRING, with
+ * 'enclen' set to the size of the string encoding (header + data). */
+/*
+ * 为字符串 ele 选择编码：能编码为整数的话，
+ * 整数编码保存在 intenc 中，返回 LP_ENCODING_INT ，
+ * 否则返回 LP_ENCODING_STRING 。
+ *
+ * enclen 被设置为节点编码和数据的总长度（不包括 backlen）。
+ */
+static int lpEncodeGetType(unsigned char *ele, uint32_t size, unsigned char *intenc, uint64_t *enclen) {
+    long long v;
+
+    if (size <= 20 && string2ll((char*)ele,size,&v)) {
+        if (v >= 0 && v <= 127) {
+            /* Single byte 0-127 integer. */
+            intenc[0] = v;
+            *enclen = 1;
+        } else if (v >= -4096 && v <= 4095) {
+            /* 13 bit integer. */
+            if (v < 0) v = ((int64_t)1<<13)+v;
+            intenc[0] = (v>>8)|LP_ENCODING_13BIT_INT;
+            intenc[1] = v&0xff;
+            *enclen = 2;
+        } else if (v >= -32768 && v <= 32767) {
+            /* 16 bit integer. */
+            if (v < 0) v = ((int64_t)1<<16)+v;
+            intenc[0] = LP_ENCODING_16BIT_INT;
+            intenc[1] = v&0xff;
+            intenc[2] = v>>8;
+            *enclen = 3;
+        } else if (v >= -8388608 && v <= 8388607) {
+            /* 24 bit integer. */
+            if (v < 0) v = ((int64_t)1<<24)+v;
+            intenc[0] = LP_ENCODING_24BIT_INT;
+            intenc[1] = v&0xff;
+            intenc[2] = (v>>8)&0xff;
+            intenc[3] = v>>16;
+            *enclen = 4;
+        } else if (v >= -2147483648LL && v <= 2147483647LL) {
+            /* 32 bit integer. */
+            if (v < 0) v = ((int64_t)1<<32)+v;
+            intenc[0] = LP_ENCODING_32BIT_INT;
+            intenc[1] = v&0xff;
+            intenc[2] = (v>>8)&0xff;
+            intenc[3] = (v>>16)&0xff;
+            intenc[4] = v>>24;
+            *enclen = 5;
+        } else {
+            /* 64 bit integer. */
+            uint64_t uv = v;
+            intenc[0] = LP_ENCODING_64BIT_INT;
+            intenc[1] = uv&0xff;
+            intenc[2] = (uv>>8)&0xff;
+            intenc[3] = (uv>>16)&0xff;
+            intenc[4] = (uv>>24)&0xff;
+            intenc[5] = (uv>>32)&0xff;
+            intenc[6] = (uv>>40)&0xff;
+            intenc[7] = (uv>>48)&0xff;
+            intenc[8] = uv>>56;
+            *enclen = 9;
+        }
+        return LP_ENCODING_INT;
+    } else {
+        if (size < 64) *enclen = 1+size;
+        else if (size < 4096) *enclen = 2+size;
+        else *enclen = 5+(uint64_t)size;
+        return LP_ENCODING_STRING;
+    }
+}
+
+/* Store the reverse-encoded length 'l' in 'buf', returning the number of
+ * bytes needed. If 'buf' is NULL only the size is returned. */
+/*
+ * 将节点长度 l 编码到 buf 中（从右向左解析的格式），返回所需的字节数。
+ * buf 为 NULL 时只返回字节数。
+ */
+static unsigned long lpEncodeBacklen(unsigned char *buf, uint64_t l) {
+    if (l <= 127) {
+        if (buf) buf[0] = l;
+        return 1;
+    } else if (l < 16383) {
+        if (buf) {
+            buf[0] = l>>7;
+            buf[1] = (l&127)|128;
+        }
+        return 2;
+    } else if (l < 2097151) {
+        if (buf) {
+            buf[0] = l>>14;
+            buf[1] = ((l>>7)&127)|128;
+            buf[2] = (l&127)|128;
+        }
+        return 3;
+    } else if (l < 268435455) {
+        if (buf) {
+            buf[0] = l>>21;
+            buf[1] = ((l>>14)&127)|128;
+            buf[2] = ((l>>7)&127)|128;
+            buf[3] = (l&127)|128;
+        }
+        return 4;
+    } else {
+        if (buf) {
+            buf[0] = l>>28;
+            buf[1] = ((l>>21)&127)|128;
+            buf[2] = ((l>>14)&127)|128;
+            buf[3] = ((l>>7)&127)|128;
+            buf[4] = (l&127)|128;
+        }
+        return 5;
+    }
+}
+
+/* Decode the backlen whose last byte is pointed by 'p'. */
+/*
+ * 从右向左解码 backlen ，p 指向 backlen 的最后一个字节
+ */
+static uint64_t lpDecodeBacklen(unsigned char *p) {
+    uint64_t val = 0;
+    uint64_t shift = 0;
+
+    do {
+        val |= (uint64_t)(p[0] & 127) << shift;
+        if (!(p[0] & 128)) break;
+        shift += 7;
+        p--;
+    } while(shift <= 28);
+    return val;
+}
+
+/* Encode the string 's' of length 'len' at 'buf'. */
+static void lpEncodeString(unsigned char *buf, unsigned char *s, uint32_t len) {
+    if (len < 64) {
+        buf[0] = len | LP_ENCODING_6BIT_STR;
+        memcpy(buf+1,s,len);
+    } else if (len < 4096) {
+        buf[0] = (len >> 8) | LP_ENCODING_12BIT_STR;
+        buf[1] = len & 0xff;
+        memcpy(buf+2,s,len);
+    } else {
+        buf[0] = LP_ENCODING_32BIT_STR;
+        buf[1] = len & 0xff;
+        buf[2] = (len >> 8) & 0xff;
+        buf[3] = (len >> 16) & 0xff;
+        buf[4] = (len >> 24) & 0xff;
+        memcpy(buf+5,s,len);
+    }
+}
+
+/* Return the size of the encoding and data of the entry pointed by 'p',
+ * without the backlen. */
+/*
+ * 返回 p 所指向节点的编码和数据的长度（不包括 backlen）
+ */
+static uint32_t lpCurrentEncodedSize(unsigned char *p) {
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(p[0])) return 1+LP_ENCODING_6BIT_STR_LEN(p);
+    if (LP_ENCODING_IS_13BIT_INT(p[0])) return 2;
+    if (LP_ENCODING_IS_12BIT_STR(p[0])) return 2+LP_ENCODING_12BIT_STR_LEN(p);
+    if (p[0] == LP_ENCODING_16BIT_INT) return 3;
+    if (p[0] == LP_ENCODING_24BIT_INT) return 4;
+    if (p[0] == LP_ENCODING_32BIT_INT) return 5;
+    if (p[0] == LP_ENCODING_64BIT_INT) return 9;
+    if (p[0] == LP_ENCODING_32BIT_STR) return 5+LP_ENCODING_32BIT_STR_LEN(p);
+    if (p[0] == LP_EOF) return 1;
+    assert(NULL);
+    return 0;
+}
+
+/* Skip the entry pointed by 'p', returning the address of the next one
+ * (or of the terminator). */
+static unsigned char *lpSkip(unsigned char *p) {
+    unsigned long entrylen = lpCurrentEncodedSize(p);
+    entrylen += lpEncodeBacklen(NULL,entrylen);
+    return p+entrylen;
+}
+
+/* Return the element after 'p', or NULL if 'p' is the last one. */
+/*
+ * 返回 p 之后的节点，如果 p 已经是最后一个节点，返回 NULL
+ *
+ * T = O(1)
+ */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    ((void) lp); /* lp is only used by the assertion below. */
+    assert(p >= lp+LP_HDR_SIZE && p < lp+lpGetTotalBytes(lp));
+    if (p[0] == LP_EOF) return NULL;
+    p = lpSkip(p);
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return the element before 'p', or NULL if 'p' is the first one. 'p' may
+ * point to the terminator, to get the last element. */
+/*
+ * 返回 p 之前的节点，如果 p 已经是第一个节点，返回 NULL
+ *
+ * T = O(1)
+ */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    uint64_t prevlen;
+
+    if (p-lp == LP_HDR_SIZE) return NULL;
+    p--; /* Seek the last byte of the previous entry backlen. */
+    prevlen = lpDecodeBacklen(p);
+    prevlen += lpEncodeBacklen(NULL,prevlen);
+    return p-prevlen+1; /* Seek the first byte of the previous entry. */
+}
+
+/* Return the first element of the listpack, or NULL if it is empty. */
+unsigned char *lpFirst(unsigned char *lp) {
+    unsigned char *p = lp+LP_HDR_SIZE;
+
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return the last element of the listpack, or NULL if it is empty. */
+unsigned char *lpLast(unsigned char *lp) {
+    unsigned char *p = lp+lpGetTotalBytes(lp)-1; /* Seek EOF element. */
+    return lpPrev(lp,p);
+}
+
+/* Return the number of elements of the listpack. This is O(1) unless the
+ * listpack has 65535 or more elements, in which case it is computed by
+ * scanning the whole listpack. */
+/*
+ * 返回 listpack 的节点数量
+ *
+ * 节点数量小于 65535 时 T = O(1) ，否则 T = O(N)
+ */
+unsigned long lpLength(unsigned char *lp) {
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned long count = 0;
+    unsigned char *p;
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) return numele;
+
+    /* Too many elements inside the listpack: count them. */
+    p = lpFirst(lp);
+    while(p) {
+        count++;
+        p = lpNext(lp,p);
+    }
+
+    /* If the count is again within range of the header numele field,
+     * set it. */
+    if (count < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,count);
+    return count;
+}
+
+/* Get the value of the element pointed by 'p', with the same interface
+ * of ziplistGet(): if the element is a string '*sval' and '*slen' are set,
+ * otherwise '*sval' is set to NULL and the integer is stored in '*lval'.
+ * Returns 0 if 'p' is NULL or points to the terminator, 1 otherwise. */
+/*
+ * 取出 p 所指向节点的值
+ *
+ * 如果节点保存的是字符串，那么将字符串指针保存到 *sval ，长度保存到 *slen ；
+ * 如果节点保存的是整数，那么 *sval 被设为 NULL ，整数保存到 *lval 。
+ *
+ * p 为 NULL 或者指向末端时返回 0 ，否则返回 1 。
+ *
+ * T = O(1)
+ */
+unsigned int lpGetValue(unsigned char *p, unsigned char **sval, unsigned int *slen, long long *lval) {
+    int64_t val;
+    uint64_t uval, negstart, negmax;
+
+    if (p == NULL || p[0] == LP_EOF) return 0;
+    if (sval) *sval = NULL;
+
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) {
+        negstart = UINT64_MAX; /* 7 bit ints are always positive. */
+        negmax = 0;
+        uval = p[0] & 0x7f;
+    } else if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+        *slen = LP_ENCODING_6BIT_STR_LEN(p);
+        *sval = p+1;
+        return 1;
+    } else if (LP_ENCODING_IS_13BIT_INT(p[0])) {
+        uval = ((p[0]&0x1f)<<8) | p[1];
+        negstart = (uint64_t)1<<12;
+        negmax = 8191;
+    } else if (p[0] == LP_ENCODING_16BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8;
+        negstart = (uint64_t)1<<15;
+        negmax = UINT16_MAX;
+    } else if (p[0] == LP_ENCODING_24BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16;
+        negstart = (uint64_t)1<<23;
+        negmax = UINT32_MAX>>8;
+    } else if (p[0] == LP_ENCODING_32BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16 |
+               (uint64_t)p[4]<<24;
+        negstart = (uint64_t)1<<31;
+        negmax = UINT32_MAX;
+    } else if (p[0] == LP_ENCODING_64BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16 |
+               (uint64_t)p[4]<<24 |
+               (uint64_t)p[5]<<32 |
+               (uint64_t)p[6]<<40 |
+               (uint64_t)p[7]<<48 |
+               (uint64_t)p[8]<<56;
+        negstart = (uint64_t)1<<63;
+        negmax = UINT64_MAX;
+    } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
+        *slen = LP_ENCODING_12BIT_STR_LEN(p);
+        *sval = p+2;
+        return 1;
+    } else if (p[0] == LP_ENCODING_32BIT_STR) {
+        *slen = LP_ENCODING_32BIT_STR_LEN(p);
+        *sval = p+5;
+        return 1;
+    } else {
+        assert(NULL);
+        return 0;
+    }
+
+    /* We reach this code path only for integer encodings: convert the
+     * unsigned value to its signed two's complement value. */
+    if (uval >= negstart) {
+        uval = negmax-uval;
+        val = uval;
+        val = -val-1;
+    } else {
+        val = uval;
+    }
+    *lval = val;
+    return 1;
+}
+
+/* Insert, delete or replace the element 'ele' of length 'size' at the
+ * position 'p', according to 'where':
+ *
+ * LP_BEFORE: insert 'ele' before 'p' (p may be the terminator, to append).
+ * LP_AFTER: insert 'ele' after 'p'.
+ * LP_REPLACE: replace the element at 'p' with 'ele'.
+ *
+ * If 'ele' is NULL the element at 'p' is deleted.
+ *
+ * Returns the new listpack, or NULL if the listpack would be bigger than
+ * 4GB. If 'newp' is not NULL it is set to the address of the inserted
+ * element, or to the element after the deleted one (NULL if there is
+ * none), so that the caller can continue iterating. */
+/*
+ * 根据 where 参数，在 p 的前面或者后面插入 ele ，或者用 ele 替换 p 。
+ * ele 为 NULL 时，删除 p 所指向的节点。
+ *
+ * 由于节点只保存自己的长度，这个操作只需要一次 memmove ，
+ * 不会引起其他节点的连锁更新。
+ *
+ * T = O(N)
+ */
+unsigned char *lpInsert(unsigned char *lp, unsigned char *ele, uint32_t size, unsigned char *p, int where, unsigned char **newp) {
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    unsigned char backlen[LP_MAX_BACKLEN_SIZE];
+    uint64_t enclen = 0;
+    int enctype = LP_ENCODING_STRING;
+    unsigned long backlen_size = 0, poff;
+    uint64_t old_listpack_bytes, new_listpack_bytes;
+    uint32_t replaced_len = 0;
+    unsigned char *dst;
+
+    /* An element pointer set to NULL means deletion, which is conceptually
+     * replacing the element with a zero-length element. */
+    if (ele == NULL) where = LP_REPLACE;
+
+    /* If we need to insert after the current element, we just jump to the
+     * next element (that could be the EOF one) and handle the case of
+     * inserting before. */
+    if (where == LP_AFTER) {
+        p = lpSkip(p);
+        where = LP_BEFORE;
+    }
+
+    /* Store the offset of the element 'p', so that we can obtain its
+     * address again after a reallocation. */
+    poff = p-lp;
+
+    /* Calling lpEncodeGetType() results into the encoded version of the
+     * element to be stored into 'intenc' in case it is representable as
+     * an integer: in that case, the function returns LP_ENCODING_INT.
+     * Otherwise if LP_ENCODING_STRING is returned, we'll have to call
+     * lpEncodeString() to actually write the encoded string on place
+     * later. */
+    if (ele) {
+        enctype = lpEncodeGetType(ele,size,intenc,&enclen);
+        backlen_size = lpEncodeBacklen(backlen,enclen);
+    }
+
+    /* We need to also encode the backward-parsable length of the element
+     * and append it to the end: this allows to traverse the listpack from
+     * the end to the start. */
+    old_listpack_bytes = lpGetTotalBytes(lp);
+    if (where == LP_REPLACE) {
+        replaced_len = lpCurrentEncodedSize(p);
+        replaced_len += lpEncodeBacklen(NULL,replaced_len);
+    }
+
+    new_listpack_bytes = old_listpack_bytes + enclen + backlen_size
+                         - replaced_len;
+    if (new_listpack_bytes > UINT32_MAX) return NULL;
+
+    /* We now need to reallocate in order to make space or shrink the
+     * allocation (in case 'when' value is LP_REPLACE and the new element is
+     * smaller). However we do that before memmoving the memory to
+     * make room just when we are sure we'll get the new space, or after
+     * moving, when we are sure the trailing memory is no longer needed. */
+    dst = lp + poff; /* May be updated after reallocation. */
+
+    /* Realloc before: we need more room. */
+    if (new_listpack_bytes > old_listpack_bytes) {
+        lp = zrealloc(lp,new_listpack_bytes);
+        dst = lp + poff;
+    }
+
+    /* Setup the listpack relocating the elements to make the exact room
+     * we need to store the new one. */
+    if (where == LP_BEFORE) {
+        memmove(dst+enclen+backlen_size,dst,old_listpack_bytes-poff);
+    } else { /* LP_REPLACE. */
+        long lendiff = (enclen+backlen_size)-replaced_len;
+        memmove(dst+replaced_len+lendiff,
+                dst+replaced_len,
+                old_listpack_bytes-poff-replaced_len);
+    }
+
+    /* Realloc after: we need to free space. */
+    if (new_listpack_bytes < old_listpack_bytes) {
+        lp = zrealloc(lp,new_listpack_bytes);
+        dst = lp + poff;
+    }
+
+    /* Store the entry. */
+    if (newp) {
+        *newp = dst;
+        /* In case of deletion, set 'newp' to NULL if the next element is
+         * the EOF element. */
+        if (!ele && dst[0] == LP_EOF) *newp = NULL;
+    }
+    if (ele) {
+        if (enctype == LP_ENCODING_INT) {
+            memcpy(dst,intenc,enclen);
+        } else {
+            lpEncodeString(dst,ele,size);
+        }
+        dst += enclen;
+        memcpy(dst,backlen,backlen_size);
+        dst += backlen_size;
+    }
+
+    /* Update header. */
+    if (where != LP_REPLACE || ele == NULL) {
+        uint32_t num_elements = lpGetNumElements(lp);
+        if (num_elements != LP_HDR_NUMELE_UNKNOWN) {
+            if (ele)
+                num_elements++;
+            else
+                num_elements--;
+            lpSetNumElements(lp,num_elements);
+        }
+    }
+    lpSetTotalBytes(lp,new_listpack_bytes);
+    return lp;
+}
+
+/* Append the specified element 'ele' of length 'size' at the end of the
+ * listpack. */
+unsigned char *lpAppend(unsigned char *lp, unsigned char *ele, uint32_t size) {
+    unsigned char *eofptr = lp + lpGetTotalBytes(lp) - 1;
+    return lpInsert(lp,ele,size,eofptr,LP_BEFORE,NULL);
+}
+
+/* Prepend the specified element 'ele' of length 'size' at the start of
+ * the listpack. */
+unsigned char *lpPrepend(unsigned char *lp, unsigned char *ele, uint32_t size) {
+    return lpInsert(lp,ele,size,lp+LP_HDR_SIZE,LP_BEFORE,NULL);
+}
+
+/* Remove the element pointed by 'p'. If 'newp' is not NULL it is set to
+ * the element that followed the deleted one, or NULL. */
+/*
+ * 删除 p 所指向的节点，
+ * newp 被设置为被删除节点之后的节点（如果有的话）
+ */
+unsigned char *lpDelete(unsigned char *lp, unsigned char *p, unsigned char **newp) {
+    return lpInsert(lp,NULL,0,p,LP_REPLACE,newp);
+}
+
+/* Delete 'num' consecutive elements starting at the element at 'index'
+ * (negative indexes count from the tail). */
+/*
+ * 从 index 开始，删除 num 个连续的节点
+ *
+ * T = O(N)
+ */
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned long num) {
+    unsigned char *first, *tail;
+    unsigned long deleted = 0;
+    uint32_t totbytes, numele;
+
+    if (num == 0) return lp;
+    if ((first = lpSeek(lp,index)) == NULL) return lp;
+
+    /* Find the end of the range: a single memmove removes all of it. */
+    tail = first;
+    while (num-- && tail[0] != LP_EOF) {
+        tail = lpSkip(tail);
+        deleted++;
+    }
+
+    totbytes = lpGetTotalBytes(lp);
+    memmove(first,tail,lp+totbytes-tail);
+    totbytes -= tail-first;
+    lpSetTotalBytes(lp,totbytes);
+    numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(lp,numele-deleted);
+    lp = zrealloc(lp,totbytes);
+    return lp;
+}
+
+/* Return the element at the specified index, or NULL if out of range.
+ * Negative indexes are taken from the tail: -1 is the last element.
+ * The listpack is scanned from the nearest end. */
+/*
+ * 返回给定索引上的节点，负数索引从表尾开始计数。
+ * 索引超出范围时返回 NULL 。
+ *
+ * T = O(N)
+ */
+unsigned char *lpSeek(unsigned char *lp, long index) {
+    int forward = 1; /* Seek forward by default. */
+    unsigned long numele = lpLength(lp);
+    unsigned char *ele;
+
+    /* Convert the index into a positive index, then decide the direction
+     * that requires the less steps. */
+    if (index < 0) index = (long)numele+index;
+    if (index < 0) return NULL; /* Index still < 0 means out of range. */
+    if ((unsigned long)index >= numele) return NULL;
+
+    if ((unsigned long)index > numele/2) {
+        forward = 0;
+        /* Right to left scanning always expects a negative index. */
+        index -= numele;
+    }
+
+    if (forward) {
+        ele = lpFirst(lp);
+        while (index > 0 && ele) {
+            ele = lpNext(lp,ele);
+            index--;
+        }
+    } else {
+        ele = lpLast(lp);
+        while (index < -1 && ele) {
+            ele = lpPrev(lp,ele);
+            index++;
+        }
+    }
+    return ele;
+}
+
+/* Compare the element pointed by 'p' with the string 's' of length 'slen'.
+ * Return 1 if equal. */
+/*
+ * 对比 p 所指向节点的值和字符串 s ，相等返回 1 ，否则返回 0 。
+ *
+ * T = O(N)
+ */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll, sll;
+
+    if (!lpGetValue(p,&vstr,&vlen,&vll)) return 0;
+    if (vstr) return vlen == slen && memcmp(vstr,s,slen) == 0;
+    /* Integer element: compare it with the string converted to an
+     * integer, only if it is in canonical form. */
+    if (slen > 20 || !string2ll((char*)s,slen,&sll)) return 0;
+    return vll == sll;
+}
+
+/* Find the element equal to the string 's' of length 'slen', starting at
+ * 'p' and skipping 'skip' elements between every comparison (this is
+ * useful for listpacks holding field-value pairs). Returns NULL if the
+ * element is not found.
+ *
+ * A string that can be encoded as an integer is always stored with an
+ * integer encoding, so we check only once what 's' looks like, and then
+ * only entries of the same kind are compared. Strings are rejected on the
+ * length prefix and the first byte before calling memcmp(), and every
+ * entry is skipped using the length we just decoded, without calling
+ * lpNext() and decoding the header again. */
+/*
+ * 从 p 开始查找值等于 s 的节点，每次对比之间跳过 skip 个节点。
+ * 找不到时返回 NULL 。
+ *
+ * 可以编码为整数的字符串总是以整数编码保存，
+ * 所以只需要判断一次 s 是否整数，之后只对比同一类型的节点：
+ * 字符串节点先对比长度和第一个字节，再调用 memcmp() 。
+ *
+ * T = O(N)
+ */
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen, unsigned int skip) {
+    unsigned int skipcnt = 0;
+    long long sll = 0;
+    int sisint;
+
+    ((void) lp);
+    if (p == NULL) return NULL;
+    sisint = slen <= 20 && string2ll((char*)s,slen,&sll);
+
+    while (p[0] != LP_EOF) {
+        unsigned char *vstr = NULL;
+        uint32_t vlen = 0, entrylen;
+
+        /* Decode the string length prefix, if any. */
+        if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+            vlen = LP_ENCODING_6BIT_STR_LEN(p);
+            vstr = p+1;
+        } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
+            vlen = LP_ENCODING_12BIT_STR_LEN(p);
+            vstr = p+2;
+        } else if (p[0] == LP_ENCODING_32BIT_STR) {
+            vlen = LP_ENCODING_32BIT_STR_LEN(p);
+            vstr = p+5;
+        }
+
+        if (skipcnt == 0) {
+            if (vstr) {
+                if (!sisint && vlen == slen &&
+                    (slen == 0 || (vstr[0] == s[0] &&
+                                   memcmp(vstr,s,slen) == 0))) return p;
+            } else if (sisint) {
+                unsigned int l;
+                long long vll;
+
+                lpGetValue(p,&vstr,&l,&vll);
+                if (vll == sll) return p;
+                vstr = NULL;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+
+        entrylen = vstr ? (uint32_t)(vstr-p)+vlen : lpCurrentEncodedSize(p);
+        p += entrylen+lpEncodeBacklen(NULL,entrylen);
+    }
+    return NULL;
+}
+
+/* Convert a ziplist blob into a listpack with the same elements. The
+ * ziplist is not freed. */
+/*
+ * 将 ziplist 转换为包含同样元素的 listpack（用于载入旧的 RDB 文件）
+ */
+unsigned char *lpFromZiplist(unsigned char *zl) {
+    unsigned char *lp = lpNew();
+    unsigned char *p = ziplistIndex(zl,0);
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+
+    while (ziplistGet(p,&vstr,&vlen,&vll)) {
+        if (vstr) {
+            lp = lpAppend(lp,vstr,vlen);
+        } else {
+            vlen = ll2string(buf,sizeof(buf),vll);
+            lp = lpAppend(lp,(unsigned char*)buf,vlen);
+        }
+        p = ziplistNext(zl,p);
+    }
+    return lp;
+}
+
+#ifdef LISTPACK_TEST_MAIN
+#include <sys/time.h>
+#include "testhelp.h"
+
+/* Tests and a benchmark against ziplist. Build with:
+ * cc -O2 -DLISTPACK_TEST_MAIN listpack.c ziplist.c zmalloc.c util.c \
+ *    endianconv.c -lm -o listpack-test */
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Return the element at 'p' as a string, in 'buf'. */
+static char *lpTestGet(unsigned char *p, char *buf) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+
+    assert(lpGetValue(p,&vstr,&vlen,&vll));
+    if (vstr) {
+        memcpy(buf,vstr,vlen);
+        buf[vlen] = '\0';
+    } else {
+        ll2string(buf,32,vll);
+    }
+    return buf;
+}
+
+/* The straightforward lpFind(), decoding every entry with lpGetValue() and
+ * moving with lpNext(): used to check and benchmark the real one. */
+static unsigned char *lpFindSlow(unsigned char *lp, unsigned char *p, unsigned char *s, unsigned int slen, unsigned int skip) {
+    unsigned int skipcnt = 0;
+
+    while (p) {
+        if (skipcnt == 0) {
+            if (lpCompare(p,s,slen)) return p;
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpNext(lp,p);
+    }
+    return NULL;
+}
+
+int main(void) {
+    char buf[8192];
+    unsigned char *lp, *p, *zl;
+    long long start;
+    int j;
+
+    {
+        lp = lpNew();
+        lp = lpAppend(lp,(unsigned char*)"foo",3);
+        lp = lpAppend(lp,(unsigned char*)"1024",4);
+        lp = lpPrepend(lp,(unsigned char*)"hello",5);
+        lp = lpAppend(lp,(unsigned char*)"-100000",7);
+        test_cond("lpLength() after appends and prepends", lpLength(lp) == 4);
+        test_cond("lpSeek() forward",
+            !strcmp(lpTestGet(lpSeek(lp,0),buf),"hello") &&
+            !strcmp(lpTestGet(lpSeek(lp,1),buf),"foo"));
+        test_cond("lpSeek() backward",
+            !strcmp(lpTestGet(lpSeek(lp,-1),buf),"-100000") &&
+            !strcmp(lpTestGet(lpSeek(lp,-2),buf),"1024"));
+        test_cond("lpSeek() out of range",
+            lpSeek(lp,4) == NULL && lpSeek(lp,-5) == NULL);
+        test_cond("lpCompare() and lpFind() with integers",
+            lpCompare(lpSeek(lp,2),(unsigned char*)"1024",4) &&
+            !lpCompare(lpSeek(lp,2),(unsigned char*)"01024",5) &&
+            lpFind(lp,lpFirst(lp),(unsigned char*)"-100000",7,0) ==
+                lpLast(lp));
+        test_cond("lpFind() with skip",
+            lpFind(lp,lpFirst(lp),(unsigned char*)"foo",3,1) == NULL &&
+            lpFind(lp,lpFirst(lp),(unsigned char*)"1024",4,1) ==
+                lpSeek(lp,2));
+
+        p = lpSeek(lp,1);
+        lp = lpDelete(lp,p,&p);
+        test_cond("lpDelete() returns the next element",
+            lpLength(lp) == 3 && !strcmp(lpTestGet(p,buf),"1024"));
+        p = lpLast(lp);
+        lp = lpDelete(lp,p,&p);
+        test_cond("lpDelete() of the last element", p == NULL &&
+            lpLength(lp) == 2);
+        lp = lpInsert(lp,(unsigned char*)"bar",3,lpFirst(lp),LP_AFTER,&p);
+        test_cond("lpInsert() after the first element",
+            !strcmp(lpTestGet(p,buf),"bar") &&
+            !strcmp(lpTestGet(lpSeek(lp,1),buf),"bar"));
+        lp = lpInsert(lp,(unsigned char*)"x",1,lpFirst(lp),LP_REPLACE,&p);
+        test_cond("lpInsert() replacing an element",
+            lpLength(lp) == 3 && !strcmp(lpTestGet(lpFirst(lp),buf),"x"));
+        lp = lpDeleteRange(lp,0,2);
+        test_cond("lpDeleteRange()", lpLength(lp) == 1 &&
+            !strcmp(lpTestGet(lpFirst(lp),buf),"1024"));
+        lpFree(lp);
+    }
+
+    {
+        /* Every integer encoding and string length class, read back in
+         * both directions. */
+        long long ints[] = {0,127,128,-1,4095,-4096,4096,32767,-32768,
+            8388607,-8388608,2147483647LL,-2147483648LL,
+            9223372036854775807LL,-9223372036854775807LL-1};
+        int lens[] = {0,1,63,64,4095,4096,5000};
+        int nints = sizeof(ints)/sizeof(ints[0]);
+        int nlens = sizeof(lens)/sizeof(lens[0]);
+        int ok = 1;
+
+        lp = lpNew();
+        for (j = 0; j < nints; j++) {
+            int len = ll2string(buf,sizeof(buf),ints[j]);
+            lp = lpAppend(lp,(unsigned char*)buf,len);
+        }
+        for (j = 0; j < nlens; j++) {
+            memset(buf,'a'+j,lens[j]);
+            lp = lpAppend(lp,(unsigned char*)buf,lens[j]);
+        }
+        p = lpFirst(lp);
+        for (j = 0; j < nints; j++) {
+            unsigned char *vstr;
+            unsigned int vlen;
+            long long vll;
+
+            lpGetValue(p,&vstr,&vlen,&vll);
+            if (vstr || vll != ints[j]) ok = 0;
+            p = lpNext(lp,p);
+        }
+        test_cond("Integer encodings", ok);
+        p = lpLast(lp);
+        for (j = nlens-1; j >= 0; j--) {
+            unsigned char *vstr;
+            unsigned int vlen;
+            long long vll;
+
+            lpGetValue(p,&vstr,&vlen,&vll);
+            if (vlen != (unsigned)lens[j] ||
+                (vlen && vstr[vlen-1] != 'a'+j)) ok = 0;
+            p = lpPrev(lp,p);
+        }
+        test_cond("String encodings, traversing backward", ok);
+        lpFree(lp);
+    }
+
+    {
+        /* 70000 elements: the count no longer fits the header. */
+        lp = lpNew();
+        for (j = 0; j < 70000; j++) lp = lpAppend(lp,(unsigned char*)"a",1);
+        test_cond("lpLength() with more than 65535 elements",
+            lpLength(lp) == 70000);
+        lp = lpDeleteRange(lp,0,10000);
+        test_cond("lpLength() back in the header range",
+            lpLength(lp) == 60000);
+        lpFree(lp);
+    }
+
+    {
+        zl = ziplistNew();
+        zl = ziplistPush(zl,(unsigned char*)"foo",3,ZIPLIST_TAIL);
+        zl = ziplistPush(zl,(unsigned char*)"-42",3,ZIPLIST_TAIL);
+        lp = lpFromZiplist(zl);
+        test_cond("lpFromZiplist()", lpLength(lp) == 2 &&
+            !strcmp(lpTestGet(lpFirst(lp),buf),"foo") &&
+            !strcmp(lpTestGet(lpLast(lp),buf),"-42"));
+        zfree(zl);
+        lpFree(lp);
+    }
+
+    {
+        /* Inserting an entry of 250-253 bytes before entries of 250 bytes
+         * makes every ziplist entry grow its prevlen field from 1 to 5
+         * bytes (cascading update). The listpack does a single memmove. */
+        int count = 1000;
+
+        memset(buf,'x',sizeof(buf));
+        zl = ziplistNew();
+        lp = lpNew();
+        for (j = 0; j < count; j++) {
+            zl = ziplistPush(zl,(unsigned char*)buf,250,ZIPLIST_TAIL);
+            lp = lpAppend(lp,(unsigned char*)buf,250);
+        }
+        start = usec();
+        for (j = 0; j < 1000; j++) {
+            unsigned char *q = ziplistIndex(zl,0);
+            zl = ziplistInsert(zl,q,(unsigned char*)buf,260);
+            q = ziplistIndex(zl,0);
+            zl = ziplistDelete(zl,&q);
+        }
+        printf("ziplist: 1000 head insert+delete of a 260 bytes entry before "
+               "%d entries of 250 bytes: %lld usec\n", count, usec()-start);
+        start = usec();
+        for (j = 0; j < 1000; j++) {
+            lp = lpPrepend(lp,(unsigned char*)buf,260);
+            lp = lpDelete(lp,lpFirst(lp),NULL);
+        }
+        printf("listpack: same workload: %lld usec\n", usec()-start);
+        printf("ziplist %zu bytes, listpack %zu bytes\n",
+            ziplistBlobLen(zl), lpBytes(lp));
+        zfree(zl);
+        lpFree(lp);
+    }
+
+    {
+        /* A hash of 512 fields, like with the default hash-max-ziplist-entries:
+         * look up fields and values with both implementations. */
+        int fields = 512, ok = 1, len;
+        unsigned char *a, *b;
+
+        lp = lpNew();
+        for (j = 0; j < fields; j++) {
+            len = snprintf(buf,sizeof(buf),"field:%d",j);
+            lp = lpAppend(lp,(unsigned char*)buf,len);
+            len = (j % 3) ? snprintf(buf,sizeof(buf),"%d",j*7) :
+                            snprintf(buf,sizeof(buf),"value:%d",j);
+            lp = lpAppend(lp,(unsigned char*)buf,len);
+        }
+        for (j = 0; j < fields*4; j++) {
+            int k = j % (fields+16);
+            len = (j & 1) ? snprintf(buf,sizeof(buf),"field:%d",k) :
+                            snprintf(buf,sizeof(buf),"%d",k*7);
+            a = lpFind(lp,lpFirst(lp),(unsigned char*)buf,len,j & 1);
+            b = lpFindSlow(lp,lpFirst(lp),(unsigned char*)buf,len,j & 1);
+            if (a != b) ok = 0;
+        }
+        test_cond("lpFind() matches the entry by entry scan", ok);
+
+        start = usec();
+        for (j = 0; j < 100000; j++) {
+            len = snprintf(buf,sizeof(buf),"field:%d",j % fields);
+            lpFind(lp,lpFirst(lp),(unsigned char*)buf,len,1);
+        }
+        printf("lpFind: 100000 lookups in a %d fields hash: %lld usec\n",
+            fields, usec()-start);
+        start = usec();
+        for (j = 0; j < 100000; j++) {
+            len = snprintf(buf,sizeof(buf),"field:%d",j % fields);
+            lpFindSlow(lp,lpFirst(lp),(unsigned char*)buf,len,1);
+        }
+        printf("entry by entry scan: same lookups: %lld usec\n",
+            usec()-start);
+        lpFree(lp);
+    }
+
+    test_report()
+    return 0;
+}
+#endif
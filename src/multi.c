@@ -461,7 +461,7 @@ void touchWatchedKeysOnFlush(int dbid) {
             // 那么打开客户端的 REDIS_DIRTY_CAS 选项
             // O(1)
             if (dbid == -1 || wk->db->id == dbid) {
-                if (dictFind(wk->db->dict, wk->key->ptr) != NULL)
+                if (kvtableFind(wk->db->keyspace, wk->key->ptr) != NULL)
                     c->flags |= REDIS_DIRTY_CAS;
             }
         }
@@ -29,15 +29,32 @@
 
 #include "redis.h"
 #include <sys/uio.h>
+#include <pthread.h>
 
 static void setProtocolError(redisClient *c, int pos);
 
+/* True while processEventsWhileBlocked() is serving clients from inside a
+ * long operation: reads are not postponed to the I/O threads then. */
+static int processing_events_while_blocked = 0;
+
 /* To evaluate the output buffer size of a client we need to get size of
  * allocated objects, however we can't used zmalloc_size() directly on sds
  * strings because of the trick they use to work (the header is before the
  * returned pointer), so we use this helper function. */
 size_t zmalloc_size_sds(sds s) {
-    return zmalloc_size(s-sizeof(struct sdshdr));
+    return zmalloc_size(sdsAllocPtr(s));
+}
+
+/* Return the amount of memory used by the sds string at object->ptr
+ * for a string object. EMBSTR strings are allocated together with the
+ * object, so zmalloc_size_sds() can't be used: their length is used. */
+size_t getStringObjectSdsUsedMemory(robj *o) {
+    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
+    switch(o->encoding) {
+    case REDIS_ENCODING_RAW: return zmalloc_size_sds(o->ptr);
+    case REDIS_ENCODING_EMBSTR: return sdslen(o->ptr);
+    default: return 0; /* Just integer encoding for now. */
+    }
 }
 
 void *dupClientReplyValue(void *o) {
@@ -94,6 +111,7 @@ redisClient *createClient(int fd) {
     c->multibulklen = 0;
     c->bulklen = -1;
     c->sentlen = 0;
+    c->io_sent_objects = 0;
 
     // 状态
     c->flags = 0;
@@ -110,6 +128,15 @@ redisClient *createClient(int fd) {
     // 附属监听端口
     c->slave_listening_port = 0;
 
+    // 复制偏移量
+    c->reploff = 0;
+    c->repl_ack_off = 0;
+    c->repl_ack_time = 0;
+    c->psync_initial_offset = 0;
+    c->replrunid[0] = '\0';
+    c->slave_capa = REDIS_SLAVE_CAPA_NONE;
+    c->repl_put_online_on_ack = 0;
+
     // 回复
     c->reply = listCreate();
     c->reply_bytes = 0;
@@ -122,9 +149,14 @@ redisClient *createClient(int fd) {
     listSetDupMethod(c->reply,dupClientReplyValue);
 
     // 阻塞 POP 相关
-    c->bpop.keys = dictCreate(&setDictType,NULL);
+    c->bpop.btype = REDIS_BPOP_LIST;
+    c->bpop.keys = dictCreate(&objectKeyPointerValueDictType,NULL);
     c->bpop.timeout = 0;
     c->bpop.target = NULL;
+    c->bpop.xread_count = 0;
+    c->bpop.xread_group = NULL;
+    c->bpop.xread_consumer = NULL;
+    c->bpop.xread_group_noack = 0;
 
     //
     c->io_keys = listCreate();
@@ -148,24 +180,30 @@ redisClient *createClient(int fd) {
     return c;
 }
 
+/* Return true if the specified client has pending reply buffers to write to
+ * the socket. */
+// 客户端是否有尚未发送的回复
+int clientHasPendingReplies(redisClient *c) {
+    return c->bufpos || listLength(c->reply);
+}
+
 /* This function is called every time we are going to transmit new data
  * to the client. The behavior is the following:
  *
  * 这个函数在每次发送新数据到客户端时调用。它的行为如下：
  *
  * If the client should receive new data (normal clients will) the function
- * returns REDIS_OK, and make sure to install the write handler in our event
- * loop so that when the socket is writable new data gets written.
+ * returns REDIS_OK, and make sure to queue the client in the list of clients
+ * with pending writes, so that beforeSleep() writes the new data to the
+ * socket before re-entering the event loop.
  *
  * 如果客户端允许接受新数据（通常情况下都是这样），那么函数返回 REDIS_OK 。
- * 并将写处理器装入到事件处理循环中，从而在套接字可用时将新数据写入。
+ * 并将客户端放入等待写入的队列，由 beforeSleep() 将新数据写入套接字。
  *
  * If the client should not receive new data, because it is a fake client
- * or a slave, or because the setup of the write handler failed, the function
- * returns REDIS_ERR.
+ * or a master, the function returns REDIS_ERR.
  *
- * 当客户端为伪客户端、附属节点，或者设置事件写处理器失败时，
- * 函数返回 REDIS_ERR 。
+ * 当客户端为伪客户端或者主节点时，函数返回 REDIS_ERR 。
  *
  * Typically gets called every time a reply is built, before adding more
  * data to the clients output buffers. If the function returns REDIS_ERR no
@@ -176,11 +214,36 @@ redisClient *createClient(int fd) {
  */
 int prepareClientToWrite(redisClient *c) {
     if (c->flags & REDIS_LUA_CLIENT) return REDIS_OK;
+    // 不回复主节点，除非正在发送 REPLCONF ACK
+    if ((c->flags & REDIS_MASTER) &&
+        !(c->flags & REDIS_MASTER_FORCE_REPLY)) return REDIS_ERR;
     if (c->fd <= 0) return REDIS_ERR; /* Fake client */
-    if (c->bufpos == 0 && listLength(c->reply) == 0 &&
-        (c->replstate == REDIS_REPL_NONE || c->replstate == REDIS_REPL_ONLINE) &&
-        aeCreateFileEvent(server.el, c->fd, AE_WRITABLE, sendReplyToClient, c) == AE_ERR)
-        return REDIS_ERR;
+
+    /* The client is waiting for (or being served by) an I/O thread: the
+     * write will be scheduled by the main thread once the read is done. */
+    // 客户端正在等待 I/O 线程读入，读入完成之后再安排写入
+    if (c->flags & REDIS_PENDING_READ) return REDIS_OK;
+
+    /* Schedule the client to write the output buffers to the socket only
+     * if not already done (there were no pending writes already and the
+     * client was yet not flagged), and, for slaves, if the slave can
+     * actually receive writes at this stage. */
+    if (!clientHasPendingReplies(c) &&
+        !(c->flags & REDIS_PENDING_WRITE) &&
+        (c->replstate == REDIS_REPL_NONE ||
+         (c->replstate == REDIS_REPL_ONLINE && !c->repl_put_online_on_ack)))
+    {
+        /* Here instead of installing the write handler, we just flag the
+         * client and put it into a list of clients that have something
+         * to write to the socket. This way before re-entering the event
+         * loop, we can try to directly write to the client sockets avoiding
+         * a system call. We'll only really install the write handler if
+         * we'll not be able to write the whole reply at once. */
+        // 将客户端放入等待写入的队列，在进入事件循环之前直接写入回复，
+        // 只有在套接字无法一次写入全部回复时才安装写事件处理器
+        c->flags |= REDIS_PENDING_WRITE;
+        listAddNodeHead(server.clients_pending_write,c);
+    }
     return REDIS_OK;
 }
 
@@ -248,7 +311,7 @@ void _addReplyObjectToList(redisClient *c, robj *o) {
         incrRefCount(o);
         listAddNodeTail(c->reply,o);
         // 更新总字节数
-        c->reply_bytes += zmalloc_size_sds(o->ptr);
+        c->reply_bytes += getStringObjectSdsUsedMemory(o);
 
     // 非空链表
     } else {
@@ -259,19 +322,19 @@ void _addReplyObjectToList(redisClient *c, robj *o) {
         // 如果最后一个节点所保存的回复，加上新回复，
         // 内容总长度小于等于 REDIS_REPLY_CHUNK_BYTES 
         // 那么将新回复追加到节点回复当中。
-        if (tail->ptr != NULL &&
+        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
             sdslen(tail->ptr)+sdslen(o->ptr) <= REDIS_REPLY_CHUNK_BYTES)
         {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(tail);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
+            c->reply_bytes += getStringObjectSdsUsedMemory(tail);
         
         // 否则，为新回复单独创建一个节点
         } else {
             incrRefCount(o);
             listAddNodeTail(c->reply,o);
-            c->reply_bytes += zmalloc_size_sds(o->ptr);
+            c->reply_bytes += getStringObjectSdsUsedMemory(o);
         }
     }
 
@@ -300,13 +363,13 @@ void _addReplySdsToList(redisClient *c, sds s) {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
+        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
             sdslen(tail->ptr)+sdslen(s) <= REDIS_REPLY_CHUNK_BYTES)
         {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(tail);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
+            c->reply_bytes += getStringObjectSdsUsedMemory(tail);
             sdsfree(s);
         } else {
             listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
@@ -328,26 +391,26 @@ void _addReplyStringToList(redisClient *c, char *s, size_t len) {
 
     // 添加到列表
     if (listLength(c->reply) == 0) {
-        robj *o = createStringObject(s,len);
+        robj *o = createRawStringObject(s,len);
 
         listAddNodeTail(c->reply,o);
-        c->reply_bytes += zmalloc_size_sds(o->ptr);
+        c->reply_bytes += getStringObjectSdsUsedMemory(o);
     } else {
         tail = listNodeValue(listLast(c->reply));
 
         /* Append to this object when possible. */
-        if (tail->ptr != NULL &&
+        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
             sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
         {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(tail);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,len);
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
+            c->reply_bytes += getStringObjectSdsUsedMemory(tail);
         } else {
-            robj *o = createStringObject(s,len);
+            robj *o = createRawStringObject(s,len);
 
             listAddNodeTail(c->reply,o);
-            c->reply_bytes += zmalloc_size_sds(o->ptr);
+            c->reply_bytes += getStringObjectSdsUsedMemory(o);
         }
     }
 
@@ -376,7 +439,7 @@ void addReply(redisClient *c, robj *obj) {
      * If the encoding is RAW and there is room in the static buffer
      * we'll be able to send the object to the client without
      * messing with its page. */
-    if (obj->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(obj)) {
         // 如果 c->reply 链表中没有节点，并且缓存空间足够，
         // 那么将内容追加到 c->buf 的后部
         if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != REDIS_OK)
@@ -545,7 +608,7 @@ void setDeferredMultiBulkLength(redisClient *c, void *node, long length) {
         /* Only glue when the next node is non-NULL (an sds in this case) */
         if (next->ptr != NULL) {
             c->reply_bytes -= zmalloc_size_sds(len->ptr);
-            c->reply_bytes -= zmalloc_size_sds(next->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(next);
             len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
             c->reply_bytes += zmalloc_size_sds(len->ptr);
             listDelNode(c->reply,ln->next);
@@ -615,7 +678,7 @@ void addReplyMultiBulkLen(redisClient *c, long length) {
 void addReplyBulkLen(redisClient *c, robj *obj) {
     size_t len;
 
-    if (obj->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(obj)) {
         len = sdslen(obj->ptr);
     } else {
         long n = (long)obj->ptr;
@@ -790,6 +853,24 @@ void freeClient(redisClient *c) {
     /* If this is marked as current client unset it */
     if (server.current_client == c) server.current_client = NULL;
 
+    /* If it is our master that's beging disconnected we should make sure
+     * to cache the state to try a partial resynchronization later.
+     *
+     * Note that before doing this we make sure that the client is not in
+     * some unexpected state, by checking its flags. */
+    // 如果要释放的是主节点客户端，并且它的状态正常，
+    // 那么将它缓存起来，以便之后进行部分重同步
+    if (server.master && c->flags & REDIS_MASTER &&
+        !(c->flags & (REDIS_CLOSE_AFTER_REPLY|
+                      REDIS_CLOSE_ASAP|
+                      REDIS_BLOCKED|
+                      REDIS_UNBLOCKED|
+                      REDIS_PRE_PSYNC)))
+    {
+        replicationCacheMaster(c);
+        return;
+    }
+
     /* Note that if the client we are freeing is blocked into a blocking
      * call, we have to set querybuf to NULL *before* to call
      * unblockClientWaitingData() to avoid processInputBuffer() will get
@@ -810,15 +891,19 @@ void freeClient(redisClient *c) {
     dictRelease(c->pubsub_channels);
     listRelease(c->pubsub_patterns);
     /* Obvious cleanup */
-    aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
-    aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
     listRelease(c->reply);
     freeClientArgv(c);
-    close(c->fd);
-    /* Remove from the list of clients */
-    ln = listSearchKey(server.clients,c);
-    redisAssert(ln != NULL);
-    listDelNode(server.clients,ln);
+
+    /* Remove from the list of clients. A cached master has no socket and
+     * is not listed in server.clients, see replicationCacheMaster(). */
+    if (c->fd != -1) {
+        aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
+        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        close(c->fd);
+        ln = listSearchKey(server.clients,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients,ln);
+    }
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list with unblocked clients. */
     if (c->flags & REDIS_UNBLOCKED) {
@@ -836,19 +921,27 @@ void freeClient(redisClient *c) {
         ln = listSearchKey(l,c);
         redisAssert(ln != NULL);
         listDelNode(l,ln);
+        /* We need to remember the time when we started to have zero
+         * attached slaves, as after some time we'll free the replication
+         * backlog. */
+        if (!(c->flags & REDIS_MONITOR) && listLength(server.slaves) == 0)
+            server.repl_no_slaves_since = server.unixtime;
     }
 
     /* Case 2: we lost the connection with the master. */
-    if (c->flags & REDIS_MASTER) {
-        server.master = NULL;
-        server.repl_state = REDIS_REPL_CONNECT;
-        server.repl_down_since = server.unixtime;
-        /* We lost connection with our master, force our slaves to resync
-         * with us as well to load the new data set.
-         *
-         * If server.masterhost is NULL the user called SLAVEOF NO ONE so
-         * slave resync is not needed. */
-        if (server.masterhost != NULL) disconnectSlaves();
+    if (c->flags & REDIS_MASTER) replicationHandleMasterDisconnection();
+
+    /* Remove from the list of clients waiting for threaded I/O. */
+    // 从等待 I/O 的队列中删除客户端
+    if (c->flags & REDIS_PENDING_WRITE) {
+        ln = listSearchKey(server.clients_pending_write,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_write,ln);
+    }
+    if (c->flags & REDIS_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
     }
 
     /* If this client was scheduled for async freeing we need to remove it
@@ -889,23 +982,18 @@ void freeClientsInAsyncFreeQueue(void) {
 /*
  * 将所有回复发送到客户端
  */
-void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = privdata;
+/* Write data in output buffers to client. Return REDIS_OK if the client
+ * is still valid after the call, REDIS_ERR if it was freed. */
+// 将输出缓存中的回复写入客户端
+int writeToClient(int fd, redisClient *c, int handler_installed) {
     int nwritten = 0, totwritten = 0, objlen;
     size_t objmem;
     robj *o;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
 
-    while(c->bufpos > 0 || listLength(c->reply)) {
+    while(clientHasPendingReplies(c)) {
         if (c->bufpos > 0) {
-            if (c->flags & REDIS_MASTER) {
-                /* Don't reply to a master */
-                nwritten = c->bufpos - c->sentlen;
-            } else {
-                nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-                if (nwritten <= 0) break;
-            }
+            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
+            if (nwritten <= 0) break;
             c->sentlen += nwritten;
             totwritten += nwritten;
 
@@ -918,20 +1006,15 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         } else {
             o = listNodeValue(listFirst(c->reply));
             objlen = sdslen(o->ptr);
-            objmem = zmalloc_size_sds(o->ptr);
+            objmem = getStringObjectSdsUsedMemory(o);
 
             if (objlen == 0) {
                 listDelNode(c->reply,listFirst(c->reply));
                 continue;
             }
 
-            if (c->flags & REDIS_MASTER) {
-                /* Don't reply to a master */
-                nwritten = objlen - c->sentlen;
-            } else {
-                nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-                if (nwritten <= 0) break;
-            }
+            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
+            if (nwritten <= 0) break;
             c->sentlen += nwritten;
             totwritten += nwritten;
 
@@ -968,7 +1051,7 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
             redisLog(REDIS_VERBOSE,
                 "Error writing to client: %s", strerror(errno));
             freeClient(c);
-            return;
+            return REDIS_ERR;
         }
     }
 
@@ -976,16 +1059,68 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     if (totwritten > 0) c->lastinteraction = server.unixtime;
 
     // 回复全部发送完毕，删除事件处理器
-    if (c->bufpos == 0 && listLength(c->reply) == 0) {
+    if (!clientHasPendingReplies(c)) {
         c->sentlen = 0;
-        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        if (handler_installed) aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
         /* Close connection after entire reply has been sent. */
         // 如果状态为“回复完毕之后关闭”，那么关闭客户端
-        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClient(c);
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
+            freeClient(c);
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+}
+
+/* Write event handler. Just send data to the client. */
+// 写事件处理器
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+    writeToClient(fd,privdata,1);
+}
+
+/* This function is called just before entering the event loop, in the hope
+ * we can just write the replies to the client output buffer without any
+ * need to use a syscall in order to install the writable event handler,
+ * get it called, and so forth. The write handler is installed only when
+ * the socket can't accept the whole reply at once.
+ *
+ * 在进入事件循环之前直接向客户端写入回复，
+ * 只有在套接字无法一次写入全部回复时才安装写事件处理器。 */
+/* Write synchronously the client 'c', already removed from
+ * server.clients_pending_write, installing the write handler only if the
+ * socket can't accept the whole reply. */
+// 直接向客户端写入回复，无法全部写入时才安装写事件处理器
+static void writePendingClient(redisClient *c) {
+    /* Try to write buffers to the client socket. */
+    if (writeToClient(c->fd,c,0) == REDIS_ERR) return;
+
+    /* If there is nothing left, do nothing. Otherwise install
+     * the write handler. */
+    if (clientHasPendingReplies(c) &&
+        aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+            sendReplyToClient, c) == AE_ERR)
+    {
+        freeClientAsync(c);
     }
 }
 
+int handleClientsWithPendingWrites(void) {
+    int processed = listLength(server.clients_pending_write);
+
+    while(listLength(server.clients_pending_write)) {
+        listNode *ln = listFirst(server.clients_pending_write);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+        writePendingClient(c);
+    }
+    return processed;
+}
+
 /* resetClient prepare the client to process the next command */
 /*
  * 重置客户端的参数信息，等待下次命令
@@ -1218,6 +1353,15 @@ void processInputBuffer(redisClient *c) {
         if (c->argc == 0) {
             resetClient(c);
         } else {
+            /* If we are in the context of an I/O thread, we can't really
+             * execute the command here. All we can do is to flag the client
+             * as one that needs to process the command. */
+            // 在 I/O 线程中只解析命令，命令由主线程执行
+            if (c->flags & REDIS_PENDING_READ) {
+                c->flags |= REDIS_PENDING_COMMAND;
+                break;
+            }
+
             /* Only reset the client when the command was executed. */
             if (processCommand(c) == REDIS_OK)
                 resetClient(c);
@@ -1225,14 +1369,18 @@ void processInputBuffer(redisClient *c) {
     }
 }
 
-void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = (redisClient*) privdata;
+/* Read from the socket of the client, appending to the query buffer.
+ *
+ * Returns the number of bytes read, 0 if there is nothing to read right now,
+ * or -1 if the connection was closed or got an error. No global state is
+ * modified, so this function is also called from the I/O threads.
+ *
+ * 从客户端套接字读入数据到查询缓存，
+ * 这个函数不修改全局状态，所以 I/O 线程也可以调用它。 */
+static int readClientSocket(redisClient *c) {
     int nread, readlen;
     size_t qblen;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
 
-    server.current_client = c;
     readlen = REDIS_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1254,34 +1402,31 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
     
     // 读入到 buf
-    nread = read(fd, c->querybuf+qblen, readlen);
+    nread = read(c->fd, c->querybuf+qblen, readlen);
 
     // 处理读错误值和 EOF （客户端已关闭）
     if (nread == -1) {
-        if (errno == EAGAIN) {
-            nread = 0;
-        } else {
-            redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
-            return;
-        }
+        if (errno == EAGAIN) return 0;
+        redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
+        return -1;
     } else if (nread == 0) {
         redisLog(REDIS_VERBOSE, "Client closed connection");
-        freeClient(c);
-        return;
+        return -1;
     }
 
     // 根据读入情况更新客户端统计数据
-    if (nread) {
-        sdsIncrLen(c->querybuf,nread);
-        // 最后一次交互时间
-        c->lastinteraction = server.unixtime;
-    } else {
-        server.current_client = NULL;
-        return;
-    }
+    sdsIncrLen(c->querybuf,nread);
+    // 最后一次交互时间
+    c->lastinteraction = server.unixtime;
+    // 记录从主节点读入的复制流字节数
+    if (c->flags & REDIS_MASTER) c->reploff += nread;
+    return nread;
+}
 
-    // 读入缓存不能超过限制，否则断开并清除客户端
+/* Free the client if its query buffer is over the configured limit.
+ * Returns 1 if the client was freed, otherwise 0. */
+// 读入缓存不能超过限制，否则断开并清除客户端
+static int closeClientOnQueryBufferLimit(redisClient *c) {
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = getClientInfoString(c), bytes = sdsempty();
 
@@ -1290,8 +1435,49 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         sdsfree(ci);
         sdsfree(bytes);
         freeClient(c);
+        return 1;
+    }
+    return 0;
+}
+
+/* Return 1 if we want to handle the client read later using threaded I/O.
+ * This is called by the readable handler of the event loop.
+ * As a side effect of calling this function the client is put in the
+ * pending read clients and flagged as such. */
+// 如果客户端的读入应该交给 I/O 线程处理，那么将它放入等待读入的队列
+static int postponeClientRead(redisClient *c) {
+    if (server.io_threads_num > 1 && server.io_threads_do_reads &&
+        !processing_events_while_blocked &&
+        !(c->flags & (REDIS_MASTER|REDIS_SLAVE|REDIS_PENDING_READ)))
+    {
+        c->flags |= REDIS_PENDING_READ;
+        listAddNodeTail(server.clients_pending_read,c);
+        return 1;
+    }
+    return 0;
+}
+
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisClient *c = (redisClient*) privdata;
+    int nread;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(mask);
+
+    /* Check if we want to read from the client later when exiting from
+     * the event loop. This is the case if threaded I/O is enabled. */
+    if (postponeClientRead(c)) return;
+
+    server.current_client = c;
+    nread = readClientSocket(c);
+    if (nread == -1) {
+        freeClient(c);
+        return;
+    } else if (nread == 0) {
+        server.current_client = NULL;
         return;
     }
+    if (closeClientOnQueryBufferLimit(c)) return;
 
     // 执行命令
     processInputBuffer(c);
@@ -1464,6 +1650,21 @@ void rewriteClientCommandVector(redisClient *c, int argc, ...) {
     va_end(ap);
 }
 
+/* Replace the command vector of the client with 'argv', that the client
+ * takes ownership of, together with the references of its objects. The
+ * old vector is freed. Used by commands that are executed as a different
+ * command, like GEOADD that runs (and is propagated as) a ZADD. */
+void replaceClientCommandVector(redisClient *c, int argc, robj **argv) {
+    int j;
+
+    for (j = 0; j < c->argc; j++) decrRefCount(c->argv[j]);
+    zfree(c->argv);
+    c->argv = argv;
+    c->argc = argc;
+    c->cmd = lookupCommand(c->argv[0]->ptr);
+    redisAssertWithInfo(c,NULL,c->cmd != NULL);
+}
+
 /* Rewrite a single item in the command vector.
  * The new val ref count is incremented, and the old decremented. */
 void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
@@ -1583,6 +1784,9 @@ int checkClientOutputBufferLimits(redisClient *c) {
 void asyncCloseClientOnOutputBufferLimitReached(redisClient *c) {
     redisAssert(c->reply_bytes < ULONG_MAX-(1024*64));
     if (c->reply_bytes == 0 || c->flags & REDIS_CLOSE_ASAP) return;
+    /* Replies added from an I/O thread (protocol errors) can't schedule the
+     * client to be closed: the limit is checked again at the next reply. */
+    if (c->flags & REDIS_PENDING_READ) return;
     if (checkClientOutputBufferLimits(c)) {
         sds client = getClientInfoString(c);
 
@@ -1601,14 +1805,390 @@ void flushSlavesOutputBuffers(void) {
     listRewind(server.slaves,&li);
     while((ln = listNext(&li))) {
         redisClient *slave = listNodeValue(ln);
-        int events;
 
-        events = aeGetFileEvents(server.el,slave->fd);
-        if (events & AE_WRITABLE &&
-            slave->replstate == REDIS_REPL_ONLINE &&
-            listLength(slave->reply))
+        /* Slaves with pending output are either queued for a write in
+         * beforeSleep() or have the write handler installed: write them
+         * synchronously in both the cases, removing the handler if the
+         * output is fully flushed. */
+        if (slave->replstate == REDIS_REPL_ONLINE &&
+            clientHasPendingReplies(slave))
+        {
+            writeToClient(slave->fd,slave,
+                aeGetFileEvents(server.el,slave->fd) & AE_WRITABLE);
+        }
+    }
+}
+
+/* This function is called by long operations (loading, busy scripts) that
+ * want to keep serving clients while blocked. Clients are read from the
+ * main thread, and the replies queued by the processed commands are
+ * written before returning, since beforeSleep() is not called meanwhile.
+ * A single iteration is performed: commands like SCRIPT KILL must be able
+ * to stop the blocking operation before the next commands are processed.
+ *
+ * 在载入数据或者执行脚本等长时间操作中处理事件 */
+int processEventsWhileBlocked(void) {
+    int count;
+
+    processing_events_while_blocked = 1;
+    count = aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+    count += handleClientsWithPendingWritesUsingThreads();
+    processing_events_while_blocked = 0;
+    return count;
+}
+
+/* ==========================================================================
+ * Threaded I/O
+ *
+ * Commands are always executed by the main thread. What the I/O threads do
+ * is the work around the execution: reading from the client sockets and
+ * parsing the query buffers into argv vectors, and writing the replies.
+ *
+ * Clients are collected by the main thread in server.clients_pending_read
+ * and server.clients_pending_write while processing events, and served in
+ * parallel from beforeSleep(): the clients are spread across the threads,
+ * the main thread serves its own share, then waits for the other threads.
+ * So no other data structure is accessed concurrently: while the threads
+ * run the main thread only waits.
+ *
+ * Replies are objects that may be shared among clients, so the I/O threads
+ * never release them: the number of objects fully sent is recorded in the
+ * client, and the main thread removes them from the reply list later.
+ *
+ * I/O 线程只负责读入、解析命令和写入回复，命令总是在主线程中执行。
+ * ========================================================================== */
+
+static pthread_t io_threads[REDIS_IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_threads_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t io_threads_done_cond = PTHREAD_COND_INITIALIZER;
+// 每个线程等待处理的客户端数量，为 0 表示线程空闲
+static unsigned long io_threads_pending[REDIS_IO_THREADS_MAX_NUM];
+// 每个线程要处理的客户端
+static list *io_threads_list[REDIS_IO_THREADS_MAX_NUM];
+// 当前的操作：读入或写入
+static int io_threads_op;
+
+/* Read and parse the query buffer of a client. If a whole command is
+ * available it is parsed and the client is flagged with
+ * REDIS_PENDING_COMMAND, but not executed. */
+// 从 I/O 线程中读入并解析命令
+static void readClientFromThread(redisClient *c) {
+    int nread = readClientSocket(c);
+
+    if (nread == -1) {
+        c->flags |= REDIS_IO_ERROR;
+        return;
+    }
+    /* Nothing to parse, or a query buffer over the limit that the main
+     * thread is going to close. */
+    if (nread == 0 ||
+        sdslen(c->querybuf) > server.client_max_querybuf_len) return;
+    processInputBuffer(c);
+}
+
+/* Write the output buffers of a client from an I/O thread. This is like
+ * sendReplyToClient(), but the reply objects fully sent are just counted
+ * in c->io_sent_objects: see the top comment of this section. */
+// 从 I/O 线程中向客户端写入回复
+static void writeClientFromThread(redisClient *c) {
+    int nwritten = 0, totwritten = 0, objlen;
+    listNode *ln = listFirst(c->reply);
+    robj *o;
+
+    c->io_sent_objects = 0;
+    while(c->bufpos > 0 || ln) {
+        if (c->bufpos > 0) {
+            nwritten = write(c->fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
+            if (nwritten <= 0) break;
+            c->sentlen += nwritten;
+            totwritten += nwritten;
+
+            /* If the buffer was sent, set bufpos to zero to continue with
+             * the remainder of the reply. */
+            if (c->sentlen == c->bufpos) {
+                c->bufpos = 0;
+                c->sentlen = 0;
+            }
+        } else {
+            o = listNodeValue(ln);
+            objlen = sdslen(o->ptr);
+
+            if (objlen == 0) {
+                c->io_sent_objects++;
+                ln = listNextNode(ln);
+                continue;
+            }
+
+            nwritten = write(c->fd,((char*)o->ptr)+c->sentlen,
+                             objlen-c->sentlen);
+            if (nwritten <= 0) break;
+            c->sentlen += nwritten;
+            totwritten += nwritten;
+
+            /* If we fully sent the object on head go to the next one */
+            if (c->sentlen == objlen) {
+                c->io_sent_objects++;
+                ln = listNextNode(ln);
+                c->sentlen = 0;
+            }
+        }
+        /* Don't let a single client monopolize the thread, unless we are
+         * over the maxmemory limit, see sendReplyToClient(). */
+        if (totwritten > REDIS_MAX_WRITE_PER_EVENT &&
+            (server.maxmemory == 0 ||
+             zmalloc_used_memory() < server.maxmemory)) break;
+    }
+
+    if (nwritten == -1 && errno != EAGAIN) {
+        redisLog(REDIS_VERBOSE,
+            "Error writing to client: %s", strerror(errno));
+        c->flags |= REDIS_IO_ERROR;
+    }
+    if (totwritten > 0) c->lastinteraction = server.unixtime;
+}
+
+/* Complete in the main thread the write of a client performed by
+ * writeClientFromThread(): release the objects sent, then install the
+ * writable handler if the socket could not accept all the output. */
+// 在主线程中完成回复的写入
+static void finishClientWrite(redisClient *c) {
+    while (c->io_sent_objects) {
+        listNode *ln = listFirst(c->reply);
+        robj *o = listNodeValue(ln);
+
+        if (sdslen(o->ptr)) c->reply_bytes -= getStringObjectSdsUsedMemory(o);
+        listDelNode(c->reply,ln);
+        c->io_sent_objects--;
+    }
+
+    if (c->flags & REDIS_IO_ERROR) {
+        freeClient(c);
+        return;
+    }
+
+    if (clientHasPendingReplies(c)) {
+        // 套接字已满，安装写事件处理器，等待套接字可写
+        if (aeCreateFileEvent(server.el,c->fd,AE_WRITABLE,
+                              sendReplyToClient,c) == AE_ERR)
+            freeClientAsync(c);
+    } else {
+        c->sentlen = 0;
+        /* Close connection after entire reply has been sent. */
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClient(c);
+    }
+}
+
+/* Schedule the write of a client that has pending output and nothing that
+ * is going to write it yet. Used after reading from the I/O threads, since
+ * replies can't be scheduled while the client is being read. */
+static void scheduleClientWrite(redisClient *c) {
+    if (c->flags & (REDIS_PENDING_WRITE|REDIS_CLOSE_ASAP)) return;
+    if (!clientHasPendingReplies(c)) return;
+    if (aeGetFileEvents(server.el,c->fd) & AE_WRITABLE) return;
+
+    c->flags |= REDIS_PENDING_WRITE;
+    listAddNodeHead(server.clients_pending_write,c);
+}
+
+/* Serve all the clients assigned to the I/O thread 'id'. */
+static void processClientsOfThread(int id) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(io_threads_list[id],&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        if (io_threads_op == REDIS_IO_THREADS_OP_WRITE)
+            writeClientFromThread(c);
+        else
+            readClientFromThread(c);
+    }
+}
+
+// I/O 线程的主函数
+void *IOThreadMain(void *myid) {
+    /* The ID is the thread number (from 0 to server.iothreads_num-1), and is
+     * used by the thread to just manipulate a single sub-array of clients. */
+    int id = (unsigned long) myid;
+
+    pthread_mutex_lock(&io_threads_mutex);
+    while(1) {
+        // 等待主线程分配任务
+        while (io_threads_pending[id] == 0)
+            pthread_cond_wait(&io_threads_work_cond,&io_threads_mutex);
+        pthread_mutex_unlock(&io_threads_mutex);
+
+        processClientsOfThread(id);
+
+        // 通知主线程任务已完成
+        pthread_mutex_lock(&io_threads_mutex);
+        io_threads_pending[id] = 0;
+        pthread_cond_signal(&io_threads_done_cond);
+    }
+    return NULL;
+}
+
+/* Initialize the data structures needed for threaded I/O, and spawn the
+ * I/O threads (the main thread counts as the first one). */
+// 初始化 I/O 线程
+void initThreadedIO(void) {
+    int j;
+
+    for (j = 0; j < server.io_threads_num; j++) {
+        io_threads_list[j] = listCreate();
+        io_threads_pending[j] = 0;
+        if (j == 0) continue; /* Thread 0 is the main thread. */
+
+        if (pthread_create(&io_threads[j],NULL,IOThreadMain,
+                           (void*)(unsigned long)j) != 0)
         {
-            sendReplyToClient(server.el,slave->fd,slave,0);
+            redisLog(REDIS_WARNING,"Fatal: Can't initialize I/O threads.");
+            exit(1);
+        }
+    }
+}
+
+/* Spread the clients of 'clients' across 'nthreads' threads, run the
+ * operation 'op' on all of them, and wait for the threads to finish.
+ * The main thread serves the first share of clients itself. */
+static void runThreadedIO(list *clients, int op, int nthreads) {
+    listIter li;
+    listNode *ln;
+    int j, item_id = 0;
+
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+        listAddNodeTail(io_threads_list[item_id % nthreads],c);
+        item_id++;
+    }
+
+    io_threads_op = op;
+    if (nthreads > 1) {
+        pthread_mutex_lock(&io_threads_mutex);
+        for (j = 1; j < nthreads; j++)
+            io_threads_pending[j] = listLength(io_threads_list[j]);
+        pthread_cond_broadcast(&io_threads_work_cond);
+        pthread_mutex_unlock(&io_threads_mutex);
+    }
+
+    processClientsOfThread(0);
+
+    if (nthreads > 1) {
+        pthread_mutex_lock(&io_threads_mutex);
+        for (j = 1; j < nthreads; j++) {
+            while (io_threads_pending[j])
+                pthread_cond_wait(&io_threads_done_cond,&io_threads_mutex);
+        }
+        pthread_mutex_unlock(&io_threads_mutex);
+    }
+
+    for (j = 0; j < nthreads; j++) {
+        while (listLength(io_threads_list[j]))
+            listDelNode(io_threads_list[j],listFirst(io_threads_list[j]));
+    }
+}
+
+/* Return the number of threads to use to serve 'pending' clients: when
+ * there are just a few clients it is not worth to wake up the threads. */
+static int threadsForPendingClients(unsigned long pending) {
+    if (server.io_threads_num == 1 ||
+        pending < (unsigned long)server.io_threads_num*2) return 1;
+    return server.io_threads_num;
+}
+
+/* Read and parse the clients in server.clients_pending_read using the I/O
+ * threads, then execute their commands from the main thread.
+ * Returns the number of clients processed. */
+// 使用 I/O 线程读入客户端的命令，然后在主线程中执行
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+    int nthreads;
+
+    if (processed == 0) return 0;
+    nthreads = threadsForPendingClients(processed);
+    runThreadedIO(server.clients_pending_read,REDIS_IO_THREADS_OP_READ,
+                  nthreads);
+    if (nthreads > 1) server.stat_io_reads_processed += processed;
+
+    /* Run the commands in the main thread. Clients are removed from the
+     * list one by one, since executing a command may free other clients
+     * of the list (CLIENT KILL). */
+    while(listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        if (c->flags & REDIS_IO_ERROR) {
+            freeClient(c);
+            continue;
+        }
+        if (closeClientOnQueryBufferLimit(c)) continue;
+
+        server.current_client = c;
+        if (c->flags & REDIS_PENDING_COMMAND) {
+            c->flags &= ~REDIS_PENDING_COMMAND;
+            if (processCommand(c) == REDIS_OK) resetClient(c);
         }
+        /* The I/O thread parsed just the first command: process the rest
+         * of the query buffer. */
+        processInputBuffer(c);
+        server.current_client = NULL;
+
+        scheduleClientWrite(c);
+    }
+    return processed;
+}
+
+/* Write the replies of the clients in server.clients_pending_write using
+ * the I/O threads. Returns the number of clients processed. */
+// 使用 I/O 线程向客户端写入回复
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+    int nthreads;
+    listIter li;
+    listNode *ln;
+
+    if (processed == 0) return 0;
+
+    /* Slaves are always served by the main thread: write them
+     * synchronously before spreading the other clients across threads. */
+    // 附属节点总是由主线程处理
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        if (!(c->flags & REDIS_SLAVE)) continue;
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+        writePendingClient(c);
+    }
+
+    nthreads = threadsForPendingClients(
+        listLength(server.clients_pending_write));
+    /* Not worth to use the threads: write synchronously. */
+    if (nthreads == 1) {
+        handleClientsWithPendingWrites();
+        return processed;
+    }
+    server.stat_io_writes_processed +=
+        listLength(server.clients_pending_write);
+    runThreadedIO(server.clients_pending_write,REDIS_IO_THREADS_OP_WRITE,
+                  nthreads);
+
+    while(listLength(server.clients_pending_write)) {
+        redisClient *c;
+
+        ln = listFirst(server.clients_pending_write);
+        c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+        finishClientWrite(c);
     }
+    return processed;
 }
@@ -46,19 +46,78 @@ robj *createObject(int type, void *ptr) {
     o->ptr = ptr;
     o->refcount = 1;
 
-    /* Set the LRU to the current lruclock (minutes resolution). */
-    o->lru = server.lruclock;
+    /* Set the LRU to the current lruclock (seconds resolution), or
+     * alternatively the LFU counter. */
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        o->lru = (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    } else {
+        o->lru = server.lruclock;
+    }
 
     return o;
 }
 
+/* Create a string object with encoding REDIS_ENCODING_RAW, that is a plain
+ * string object where o->ptr points to a proper sds string. */
 /*
- * 根据给定字符数组，创建一个 String 对象
+ * 根据给定字符数组，创建一个 RAW 编码的 String 对象
  */
-robj *createStringObject(char *ptr, size_t len) {
+robj *createRawStringObject(char *ptr, size_t len) {
     return createObject(REDIS_STRING,sdsnewlen(ptr,len));
 }
 
+/* Create a string object with encoding REDIS_ENCODING_EMBSTR, that is
+ * an object where the sds string is actually an unmodifiable string
+ * allocated in the same chunk as the object itself. */
+/*
+ * 创建一个 EMBSTR 编码的 String 对象，
+ * 对象和 sds 字符串保存在同一块内存中，字符串不可修改
+ */
+robj *createEmbeddedStringObject(char *ptr, size_t len) {
+    robj *o = zmalloc(sizeof(robj)+sizeof(struct sdshdr8)+len+1);
+    struct sdshdr8 *sh = (void*)(o+1);
+
+    o->type = REDIS_STRING;
+    o->encoding = REDIS_ENCODING_EMBSTR;
+    o->ptr = sh+1;
+    o->refcount = 1;
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        o->lru = (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    } else {
+        o->lru = server.lruclock;
+    }
+
+    sh->len = len;
+    sh->alloc = len;
+    sh->flags = SDS_TYPE_8;
+    if (ptr) {
+        memcpy(sh->buf,ptr,len);
+        sh->buf[len] = '\0';
+    } else {
+        memset(sh->buf,0,len+1);
+    }
+    return o;
+}
+
+/* Create a string object with EMBSTR encoding if it is smaller than
+ * REDIS_ENCODING_EMBSTR_SIZE_LIMIT, otherwise the RAW encoding is
+ * used.
+ *
+ * The current limit of 44 is chosen so that the biggest string object
+ * we allocate as EMBSTR will still fit into the 64 byte arena of jemalloc:
+ * 16 bytes of robj, 3 bytes of sdshdr8 header, 44 bytes and the null term. */
+/*
+ * 根据给定字符数组，创建一个 String 对象，
+ * 短字符串使用 EMBSTR 编码，长字符串使用 RAW 编码
+ */
+#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 44
+robj *createStringObject(char *ptr, size_t len) {
+    if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT)
+        return createEmbeddedStringObject(ptr,len);
+    else
+        return createRawStringObject(ptr,len);
+}
+
 /*
  * 根据给定数字值 value ，创建一个 String 对象
  */
@@ -114,41 +173,49 @@ robj *createStringObjectFromLongDouble(long double value) {
     return createStringObject(buf,len);
 }
 
+/* Duplicate a string object, with the guarantee that the returned object
+ * has the same encoding as the original one.
+ *
+ * This function also guarantees that duplicating a small integer object
+ * (or a string object that contains a representation of a small integer)
+ * will always result in a fresh object that is unshared (refcount == 1).
+ *
+ * The resulting object always has refcount set to 1. */
 /*
- * 复制一个 String 对象的副本
+ * 复制一个 String 对象的副本，副本的编码和原对象相同
  */
 robj *dupStringObject(robj *o) {
-    redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-    return createStringObject(o->ptr,sdslen(o->ptr));
+    robj *d;
+
+    redisAssert(o->type == REDIS_STRING);
+
+    switch(o->encoding) {
+    case REDIS_ENCODING_RAW:
+        return createRawStringObject(o->ptr,sdslen(o->ptr));
+    case REDIS_ENCODING_EMBSTR:
+        return createEmbeddedStringObject(o->ptr,sdslen(o->ptr));
+    case REDIS_ENCODING_INT:
+        d = createObject(REDIS_STRING, NULL);
+        d->encoding = REDIS_ENCODING_INT;
+        d->ptr = o->ptr;
+        return d;
+    default:
+        redisPanic("Wrong encoding.");
+        break;
+    }
 }
 
 /*
  * 创建一个 list 对象
+ *
+ * 列表使用 quicklist 编码，
+ * 节点大小和压缩深度由 list-max-ziplist-size 和 list-compress-depth 决定
  */
-robj *createListObject(void) {
-    // 使用双端链表(adlist)
-    list *l = listCreate();
-
-    // 创建对象
+robj *createQuicklistObject(void) {
+    quicklist *l = quicklistNew(server.list_max_ziplist_size,
+                                server.list_compress_depth);
     robj *o = createObject(REDIS_LIST,l);
-
-    // 因为列表里的值也是其他对象
-    // 所以要设置 decrRefCount 作为值的释放器
-    listSetFreeMethod(l,decrRefCount);
-
-    // 设置编码
-    o->encoding = REDIS_ENCODING_LINKEDLIST;
-
-    return o;
-}
-
-/*
- * 创建一个 ziplist 对象
- */
-robj *createZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(REDIS_LIST,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_QUICKLIST;
     return o;
 }
 
@@ -176,9 +243,9 @@ robj *createIntsetObject(void) {
  * 创建一个 hash 对象
  */
 robj *createHashObject(void) {
-    unsigned char *zl = ziplistNew();
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_HASH, zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -201,12 +268,30 @@ robj *createZsetObject(void) {
 }
 
 /*
- * 创建一个 ziplist 表示的 zset 对象
+ * 创建一个 listpack 表示的 zset 对象
  */
-robj *createZsetZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
+robj *createZsetListpackObject(void) {
+    unsigned char *zl = lpNew();
     robj *o = createObject(REDIS_ZSET,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    o->encoding = REDIS_ENCODING_LISTPACK;
+    return o;
+}
+
+/*
+ * 创建一个空的 roaring 位图编码的字符串对象
+ */
+robj *createRoaringObject(void) {
+    robj *o = createObject(REDIS_STRING,roaringNew());
+    o->encoding = REDIS_ENCODING_ROARING;
+    return o;
+}
+
+/*
+ * 创建一个空的流对象
+ */
+robj *createStreamObject(void) {
+    robj *o = createObject(REDIS_STREAM,streamNew());
+    o->encoding = REDIS_ENCODING_STREAM;
     return o;
 }
 
@@ -216,6 +301,8 @@ robj *createZsetZiplistObject(void) {
 void freeStringObject(robj *o) {
     if (o->encoding == REDIS_ENCODING_RAW) {
         sdsfree(o->ptr);
+    } else if (o->encoding == REDIS_ENCODING_ROARING) {
+        roaringFree(o->ptr);
     }
 }
 
@@ -223,16 +310,10 @@ void freeStringObject(robj *o) {
  * 释放 list 对象
  */
 void freeListObject(robj *o) {
-    switch (o->encoding) {
-    // 释放双端链表
-    case REDIS_ENCODING_LINKEDLIST:
-        listRelease((list*) o->ptr);
-        break;
-    // 释放 ziplist 
-    case REDIS_ENCODING_ZIPLIST:
-        zfree(o->ptr);
-        break;
-    default:
+    // 释放 quicklist
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistRelease(o->ptr);
+    } else {
         redisPanic("Unknown list encoding type");
     }
 }
@@ -268,8 +349,8 @@ void freeZsetObject(robj *o) {
         zslFree(zs->zsl);
         zfree(zs);
         break;
-    // ziplist 表示
-    case REDIS_ENCODING_ZIPLIST:
+    // listpack 表示
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -286,8 +367,8 @@ void freeHashObject(robj *o) {
     case REDIS_ENCODING_HT:
         dictRelease((dict*) o->ptr);
         break;
-    // ziplist 表示
-    case REDIS_ENCODING_ZIPLIST:
+    // listpack 表示
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -296,11 +377,28 @@ void freeHashObject(robj *o) {
     }
 }
 
+/*
+ * 释放流对象
+ */
+void freeStreamObject(robj *o) {
+    freeStream(o->ptr);
+}
+
+/* Reference counting is atomic when possible: the elements of an aggregate
+ * value freed by the lazyfree thread (see lazyfree.c) may still be referenced
+ * by the main thread, for instance by the reply list of a client. */
 /*
  * 增加对象的引用计数
+ *
+ * 在可能的情况下，引用计数的修改是原子操作：
+ * 由惰性释放线程释放的聚合值中的元素，可能仍然被主线程引用（比如客户端的回复链表）。
  */
 void incrRefCount(robj *o) {
+#ifdef HAVE_ATOMIC
+    __sync_add_and_fetch(&o->refcount,1);
+#else
     o->refcount++;
+#endif
 }
 
 /*
@@ -313,7 +411,11 @@ void decrRefCount(void *obj) {
 
     if (o->refcount <= 0) redisPanic("decrRefCount against refcount <= 0");
 
-    if (o->refcount == 1) {
+#ifdef HAVE_ATOMIC
+    if (__sync_sub_and_fetch(&o->refcount,1) == 0) {
+#else
+    if (--o->refcount == 0) {
+#endif
         // 如果引用数降为 0 
         // 根据对象类型，调用相应的对象释放函数来释放对象的值
         switch(o->type) {
@@ -322,13 +424,11 @@ void decrRefCount(void *obj) {
         case REDIS_SET: freeSetObject(o); break;
         case REDIS_ZSET: freeZsetObject(o); break;
         case REDIS_HASH: freeHashObject(o); break;
+        case REDIS_STREAM: freeStreamObject(o); break;
         default: redisPanic("Unknown object type"); break;
         }
         // 释放对象本身
         zfree(o);
-    } else {
-        // 否则，只降低引用数
-        o->refcount--;
     }
 }
 
@@ -386,10 +486,20 @@ int isObjectRepresentableAsLongLong(robj *o, long long *llval) {
 robj *tryObjectEncoding(robj *o) {
     long value;
     sds s = o->ptr;
+    size_t len;
+
+    /* Make sure this is a string object, the only type we encode
+     * in this function. Other types use encoded memory efficient
+     * representations but are handled by the commands implementing
+     * the type. */
+    // 只尝试对 string 对象进行编码
+    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
 
+    /* We try some specialized encoding only for objects that are
+     * RAW or EMBSTR encoded, in other words objects that are still
+     * in represented by an actually array of chars. */
     // 对象已编码?
-    if (o->encoding != REDIS_ENCODING_RAW)
-        return o; /* Already encoded */
+    if (!sdsEncodedObject(o)) return o;
 
     /* It's not safe to encode shared objects: shared objects can be shared
      * everywhere in the "object space" of Redis. Encoded objects can only
@@ -397,14 +507,44 @@ robj *tryObjectEncoding(robj *o) {
      // 不对共享对象进行编码
      if (o->refcount > 1) return o;
 
-    /* Currently we try to encode only strings */
-    // 只尝试对 string 对象进行编码
-    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-
-    /* Check if we can represent this string as a long integer */
+    /* Check if we can represent this string as a long integer.
+     * Note that we are sure that a string larger than 21 chars is not
+     * representable as a 64 bit integer. */
     // 尝试将字符串值转换为 long 整数
-    // 转换失败直接返回 o ，转换成功时继续执行
-    if (!string2l(s,sdslen(s),&value)) return o;
+    len = sdslen(s);
+    if (len > 21 || !string2l(s,len,&value)) {
+        /* If the string is small and is still RAW encoded,
+         * try the EMBSTR encoding which is more efficient.
+         * In this representation the object and the SDS string are
+         * allocated in the same chunk of memory to save space and
+         * cache misses. */
+        // 短字符串转换为 EMBSTR 编码
+        if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT) {
+            robj *emb;
+
+            if (o->encoding == REDIS_ENCODING_EMBSTR) return o;
+            emb = createEmbeddedStringObject(s,len);
+            decrRefCount(o);
+            return emb;
+        }
+
+        /* We can't encode the object...
+         *
+         * Do the last try, and at least optimize the SDS string inside
+         * the string object to require little space, in case there
+         * is more than 10% of free space at the end of the SDS string.
+         *
+         * We do that only for relatively large strings as this branch
+         * is only entered if the length of the string is greater than
+         * REDIS_ENCODING_EMBSTR_SIZE_LIMIT. */
+        // 释放 sds 末尾多余的空间
+        if (o->encoding == REDIS_ENCODING_RAW &&
+            sdsavail(s) > len/10)
+        {
+            o->ptr = sdsRemoveFreeSpace(o->ptr);
+        }
+        return o;
+    }
 
     /* Ok, this object can be encoded...
      *
@@ -424,8 +564,9 @@ robj *tryObjectEncoding(robj *o) {
         return shared.integers[value];
     } else {
         // value 不属于共享范围，将它保存到对象 o 中
+        // EMBSTR 编码的字符串和对象在同一块内存中，无须释放
+        if (o->encoding == REDIS_ENCODING_RAW) sdsfree(o->ptr);
         o->encoding = REDIS_ENCODING_INT;   // 更新编码方式
-        sdsfree(o->ptr);        // 释放旧值
         o->ptr = (void*) value; // 设置新值
 
         return o;
@@ -444,7 +585,7 @@ robj *getDecodedObject(robj *o) {
     robj *dec;
 
     // 返回未编码对象
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         incrRefCount(o);
         return o;
     }
@@ -459,6 +600,15 @@ robj *getDecodedObject(robj *o) {
         ll2string(buf,32,(long)o->ptr);
         dec = createStringObject(buf,strlen(buf));
         return dec;
+    } else if (o->type == REDIS_STRING &&
+               o->encoding == REDIS_ENCODING_ROARING)
+    {
+        roaring *r = o->ptr;
+        sds s = sdsnewlen(NULL,r->bytes);
+
+        // 将位图展开为一个新的字符串，输入对象保持不变
+        roaringToBytes(r,(unsigned char*)s);
+        return createObject(REDIS_STRING,s);
     } else {
         redisPanic("Unknown encoding type");
     }
@@ -478,14 +628,14 @@ int compareStringObjects(robj *a, robj *b) {
     int bothsds = 1;
 
     if (a == b) return 0;
-    if (a->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(a)) {
         ll2string(bufa,sizeof(bufa),(long) a->ptr);
         astr = bufa;
         bothsds = 0;
     } else {
         astr = a->ptr;
     }
-    if (b->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(b)) {
         ll2string(bufb,sizeof(bufb),(long) b->ptr);
         bstr = bufb;
         bothsds = 0;
@@ -500,7 +650,10 @@ int compareStringObjects(robj *a, robj *b) {
  * this function is faster then checking for (compareStringObject(a,b) == 0)
  * because it can perform some more optimization. */
 int equalStringObjects(robj *a, robj *b) {
-    if (a->encoding != REDIS_ENCODING_RAW && b->encoding != REDIS_ENCODING_RAW){
+    if (a->encoding == REDIS_ENCODING_INT &&
+        b->encoding == REDIS_ENCODING_INT) {
+        /* If both strings are integer encoded just check if the stored
+         * long is the same. */
         return a->ptr == b->ptr;
     } else {
         return compareStringObjects(a,b) == 0;
@@ -509,8 +662,10 @@ int equalStringObjects(robj *a, robj *b) {
 
 size_t stringObjectLen(robj *o) {
     redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         return sdslen(o->ptr);
+    } else if (o->encoding == REDIS_ENCODING_ROARING) {
+        return ((roaring*)o->ptr)->bytes;
     } else {
         char buf[32];
 
@@ -518,6 +673,26 @@ size_t stringObjectLen(robj *o) {
     }
 }
 
+/* Convert in place a roaring encoded string into a raw one. Called by the
+ * commands that access the string bytes, like GET or GETRANGE: only the
+ * bit level commands work on the compressed encoding.
+ *
+ * 将 roaring 编码的字符串就地转换为 raw 编码。
+ * 只有位操作命令直接处理压缩编码，其他访问字符串内容的命令（比如 GET 和
+ * GETRANGE ）都需要先调用这个函数。 */
+void roaringObjectToRaw(robj *o) {
+    roaring *r;
+    sds s;
+
+    if (o->encoding != REDIS_ENCODING_ROARING) return;
+    r = o->ptr;
+    s = sdsnewlen(NULL,r->bytes);
+    roaringToBytes(r,(unsigned char*)s);
+    roaringFree(r);
+    o->ptr = s;
+    o->encoding = REDIS_ENCODING_RAW;
+}
+
 int getDoubleFromObject(robj *o, double *target) {
     double value;
     char *eptr;
@@ -526,7 +701,7 @@ int getDoubleFromObject(robj *o, double *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtod(o->ptr, &eptr);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -564,7 +739,7 @@ int getLongDoubleFromObject(robj *o, long double *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtold(o->ptr, &eptr);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -610,7 +785,7 @@ int getLongLongFromObject(
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
         // 根据不同编码，取出值
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtoll(o->ptr, &eptr, 10);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -672,19 +847,24 @@ int getLongFromObjectOrReply(redisClient *c, robj *o, long *target, const char *
 char *strEncoding(int encoding) {
     switch(encoding) {
     case REDIS_ENCODING_RAW: return "raw";
+    case REDIS_ENCODING_EMBSTR: return "embstr";
     case REDIS_ENCODING_INT: return "int";
     case REDIS_ENCODING_HT: return "hashtable";
     case REDIS_ENCODING_LINKEDLIST: return "linkedlist";
     case REDIS_ENCODING_ZIPLIST: return "ziplist";
     case REDIS_ENCODING_INTSET: return "intset";
     case REDIS_ENCODING_SKIPLIST: return "skiplist";
+    case REDIS_ENCODING_QUICKLIST: return "quicklist";
+    case REDIS_ENCODING_LISTPACK: return "listpack";
+    case REDIS_ENCODING_ROARING: return "roaring";
+    case REDIS_ENCODING_STREAM: return "stream";
     default: return "unknown";
     }
 }
 
-/* Given an object returns the min number of seconds the object was never
+/* Given an object returns the min number of milliseconds the object was never
  * requested, using an approximated LRU algorithm. */
-unsigned long estimateObjectIdleTime(robj *o) {
+unsigned long long estimateObjectIdleTime(robj *o) {
     if (server.lruclock >= o->lru) {
         return (server.lruclock - o->lru) * REDIS_LRU_CLOCK_RESOLUTION;
     } else {
@@ -696,10 +876,10 @@ unsigned long estimateObjectIdleTime(robj *o) {
 /* This is an helper function for the DEBUG command. We need to lookup keys
  * without any modification of LRU or other parameters. */
 robj *objectCommandLookup(redisClient *c, robj *key) {
-    dictEntry *de;
+    kvEntry *e;
 
-    if ((de = dictFind(c->db->dict,key->ptr)) == NULL) return NULL;
-    return (robj*) dictGetVal(de);
+    if ((e = kvtableFind(c->db->keyspace,key->ptr)) == NULL) return NULL;
+    return (robj*) kvtableGetVal(e);
 }
 
 robj *objectCommandLookupOrReply(redisClient *c, robj *key, robj *reply) {
@@ -729,9 +909,25 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
-        addReplyLongLong(c,estimateObjectIdleTime(o));
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is selected, idle time not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
+        addReplyLongLong(c,estimateObjectIdleTime(o)/1000);
+    // 查看访问频率
+    } else if (!strcasecmp(c->argv[1]->ptr,"freq") && c->argc == 3) {
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+                == NULL) return;
+        if (!REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is not selected, access frequency not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
+        /* LFUDecrAndReturn should be called in case of the key has not
+         * been accessed for a long time, because we update the access
+         * time only when the key is read or overwritten. */
+        addReplyLongLong(c,LFUDecrAndReturn(o));
     } else {
-        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime)");
+        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime|freq)");
     }
 }
 
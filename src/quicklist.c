@@ -0,0 +1,1398 @@
+/* quicklist.c - A doubly linked list of ziplists
+ *
+ * A quicklist is a linked list where every node holds a small ziplist
+ * instead of a single element. This keeps the memory efficiency of the
+ * ziplist encoding (no per element pointers and allocations) while push
+ * and pop operations at both ends stay O(1), since they only touch the
+ * bounded ziplist of the head or tail node.
+ *
+ * Interior nodes can optionally be compressed with LZF: 'compress' is the
+ * number of nodes at each end of the list that are always left
+ * uncompressed, so that the hot ends of a queue are never slowed down.
+ *
+ * quicklist 是一个由 ziplist 组成的双端链表：
+ * 每个节点保存一个大小受限的 ziplist ，
+ * 两端的 push 和 pop 操作只需要处理表头或表尾节点，复杂度仍为 O(1) ，
+ * 而中间节点可以选择使用 LZF 进行压缩，进一步节约内存。
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h> /* for memcpy */
+#include "quicklist.h"
+#include "zmalloc.h"
+#include "ziplist.h"
+#include "util.h"
+#include "lzf.h"
+
+/* Optimization levels for size-based filling.
+ *
+ * fill 为负数时，节点 ziplist 的最大字节数：
+ * -1 = 4kb, -2 = 8kb, -3 = 16kb, -4 = 32kb, -5 = 64kb */
+static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
+
+/* Maximum size in bytes of any multi-element ziplist.
+ * Larger values will live in their own isolated ziplists. */
+#define SIZE_SAFETY_LIMIT 8192
+
+/* Minimum ziplist size in bytes for attempting compression. */
+#define MIN_COMPRESS_BYTES 48
+
+/* Minimum size reduction in bytes to store compressed quicklistNode data.
+ * This also prevents us from storing compression if the compression
+ * resulted in a larger size than the original data. */
+#define MIN_COMPRESS_IMPROVE 8
+
+/* Fill and compress depth are stored in 16 bit fields. */
+#define FILL_MAX (1 << 15)
+#define COMPRESS_MAX (1 << 16)
+
+/* Create a new quicklist.
+ * Free with quicklistRelease().
+ *
+ * 创建一个新的空 quicklist ，默认每个节点的 ziplist 最多 8kb ，不压缩。 */
+quicklist *quicklistCreate(void) {
+    struct quicklist *quicklist;
+
+    quicklist = zmalloc(sizeof(*quicklist));
+    quicklist->head = quicklist->tail = NULL;
+    quicklist->len = 0;
+    quicklist->count = 0;
+    quicklist->compress = 0;
+    quicklist->fill = -2;
+    return quicklist;
+}
+
+void quicklistSetCompressDepth(quicklist *quicklist, int compress) {
+    if (compress > COMPRESS_MAX - 1) {
+        compress = COMPRESS_MAX - 1;
+    } else if (compress < 0) {
+        compress = 0;
+    }
+    quicklist->compress = compress;
+}
+
+void quicklistSetFill(quicklist *quicklist, int fill) {
+    if (fill > FILL_MAX - 1) {
+        fill = FILL_MAX - 1;
+    } else if (fill < -5) {
+        fill = -5;
+    } else if (fill == 0) {
+        fill = 1;
+    }
+    quicklist->fill = fill;
+}
+
+void quicklistSetOptions(quicklist *quicklist, int fill, int depth) {
+    quicklistSetFill(quicklist, fill);
+    quicklistSetCompressDepth(quicklist, depth);
+}
+
+/* Create a new quicklist with some default parameters. */
+quicklist *quicklistNew(int fill, int compress) {
+    quicklist *quicklist = quicklistCreate();
+    quicklistSetOptions(quicklist, fill, compress);
+    return quicklist;
+}
+
+static quicklistNode *quicklistCreateNode(void) {
+    quicklistNode *node;
+    node = zmalloc(sizeof(*node));
+    node->zl = NULL;
+    node->count = 0;
+    node->sz = 0;
+    node->next = node->prev = NULL;
+    node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+    node->recompress = 0;
+    node->extra = 0;
+    return node;
+}
+
+/* Return cached quicklist count */
+unsigned long quicklistCount(const quicklist *ql) { return ql->count; }
+
+/* Free entire quicklist.
+ *
+ * 释放整个 quicklist ，以及它的所有节点 */
+void quicklistRelease(quicklist *quicklist) {
+    unsigned long len;
+    quicklistNode *current, *next;
+
+    current = quicklist->head;
+    len = quicklist->len;
+    while (len--) {
+        next = current->next;
+
+        zfree(current->zl);
+        quicklist->count -= current->count;
+
+        zfree(current);
+
+        quicklist->len--;
+        current = next;
+    }
+    zfree(quicklist);
+}
+
+/* Compress the ziplist in 'node' and update encoding details.
+ * Returns 1 if ziplist compressed successfully.
+ * Returns 0 if compression failed or if ziplist too small to compress.
+ *
+ * 使用 LZF 压缩节点的 ziplist ，
+ * 只有压缩能带来足够的空间节约时，才会保存压缩后的数据。 */
+static int __quicklistCompressNode(quicklistNode *node) {
+    quicklistLZF *lzf;
+
+    node->recompress = 0;
+
+    /* Don't bother compressing small values */
+    if (node->sz < MIN_COMPRESS_BYTES) return 0;
+
+    lzf = zmalloc(sizeof(*lzf) + node->sz);
+
+    /* Cancel if compression fails or doesn't compress small enough */
+    if (((lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed,
+                                 node->sz)) == 0) ||
+        lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
+        /* lzf_compress aborts/rejects compression if value not compressable. */
+        zfree(lzf);
+        return 0;
+    }
+    lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
+    zfree(node->zl);
+    node->zl = (unsigned char *)lzf;
+    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    return 1;
+}
+
+/* Compress only uncompressed nodes. */
+#define quicklistCompressNode(_node)                                           \
+    do {                                                                       \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_RAW) {     \
+            __quicklistCompressNode((_node));                                  \
+        }                                                                      \
+    } while (0)
+
+/* Uncompress the ziplist in 'node' and update encoding details.
+ * Returns 1 on successful decode, 0 on failure to decode.
+ *
+ * 将节点解压回普通的 ziplist */
+static int __quicklistDecompressNode(quicklistNode *node) {
+    void *decompressed = zmalloc(node->sz);
+    quicklistLZF *lzf = (quicklistLZF *)node->zl;
+    if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
+        /* Someone requested decompress, but we can't decompress.  Not good. */
+        zfree(decompressed);
+        return 0;
+    }
+    zfree(lzf);
+    node->zl = decompressed;
+    node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+    return 1;
+}
+
+/* Decompress only compressed nodes. */
+#define quicklistDecompressNode(_node)                                         \
+    do {                                                                       \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+            __quicklistDecompressNode((_node));                                \
+        }                                                                      \
+    } while (0)
+
+/* Force node to not be immediately re-compresable */
+#define quicklistDecompressNodeForUse(_node)                                   \
+    do {                                                                       \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+            __quicklistDecompressNode((_node));                                \
+            (_node)->recompress = 1;                                           \
+        }                                                                      \
+    } while (0)
+
+/* Extract the raw LZF data from this quicklistNode.
+ * Pointer to LZF data is assigned to '*data'.
+ * Return value is the length of compressed LZF data. */
+size_t quicklistGetLzf(const quicklistNode *node, void **data) {
+    quicklistLZF *lzf = (quicklistLZF *)node->zl;
+    *data = lzf->compressed;
+    return lzf->sz;
+}
+
+#define quicklistAllowsCompression(_ql) ((_ql)->compress != 0)
+
+/* Force 'quicklist' to meet compression guidelines set by compress depth.
+ * The only way to guarantee interior nodes get compressed is to iterate
+ * to our "uncompressed" depth from both ends, then compress the nodes
+ * just beyond it (and 'node' itself if it's not within the depth).
+ *
+ * 确保 quicklist 两端 compress 个节点都处于未压缩状态，
+ * 并压缩刚好位于这个深度之外的节点，以及 node 本身（如果它位于中间的话）。 */
+static void __quicklistCompress(const quicklist *quicklist,
+                                quicklistNode *node) {
+    quicklistNode *forward, *reverse;
+    int depth = 0;
+    int in_depth = 0;
+
+    if (!quicklistAllowsCompression(quicklist) || !quicklist->head) return;
+
+    forward = quicklist->head;
+    reverse = quicklist->tail;
+    while (depth++ < quicklist->compress) {
+        quicklistDecompressNode(forward);
+        quicklistDecompressNode(reverse);
+
+        /* Nodes within the depth must stay uncompressed even if they were
+         * decompressed for usage while sitting in the middle of the list. */
+        forward->recompress = 0;
+        reverse->recompress = 0;
+
+        if (forward == node || reverse == node) in_depth = 1;
+
+        /* The two ends met: every node is within the uncompressed depth. */
+        if (forward == reverse || forward->next == reverse) return;
+
+        forward = forward->next;
+        reverse = reverse->prev;
+    }
+
+    if (!in_depth) quicklistCompressNode(node);
+
+    /* At this point, forward and reverse are one node beyond depth */
+    quicklistCompressNode(forward);
+    quicklistCompressNode(reverse);
+}
+
+/* Recompress 'node' if it was only temporarily decompressed for usage,
+ * otherwise enforce the compression depth around it. */
+#define quicklistCompress(_ql, _node)                                          \
+    do {                                                                       \
+        if ((_node)->recompress)                                               \
+            quicklistCompressNode((_node));                                    \
+        else                                                                   \
+            __quicklistCompress((_ql), (_node));                               \
+    } while (0)
+
+/* If we previously used quicklistDecompressNodeForUse(), just recompress. */
+#define quicklistRecompressOnly(_ql, _node)                                    \
+    do {                                                                       \
+        if ((_node)->recompress)                                               \
+            quicklistCompressNode((_node));                                    \
+    } while (0)
+
+/* Insert 'new_node' after 'old_node' if 'after' is 1.
+ * Insert 'new_node' before 'old_node' if 'after' is 0.
+ * Note: 'new_node' is *always* uncompressed, so if we assign it to
+ *       head or tail, we do not need to uncompress it.
+ *
+ * 将 new_node 插入到 old_node 之前或之后 */
+static void __quicklistInsertNode(quicklist *quicklist,
+                                  quicklistNode *old_node,
+                                  quicklistNode *new_node, int after) {
+    if (after) {
+        new_node->prev = old_node;
+        if (old_node) {
+            new_node->next = old_node->next;
+            if (old_node->next)
+                old_node->next->prev = new_node;
+            old_node->next = new_node;
+        }
+        if (quicklist->tail == old_node)
+            quicklist->tail = new_node;
+    } else {
+        new_node->next = old_node;
+        if (old_node) {
+            new_node->prev = old_node->prev;
+            if (old_node->prev)
+                old_node->prev->next = new_node;
+            old_node->prev = new_node;
+        }
+        if (quicklist->head == old_node)
+            quicklist->head = new_node;
+    }
+    /* If this insert creates the only element so far, initialize head/tail. */
+    if (quicklist->len == 0) {
+        quicklist->head = quicklist->tail = new_node;
+    }
+
+    quicklist->len++;
+
+    /* Update compression now that the list has one more node. */
+    if (old_node) quicklistCompress(quicklist, old_node);
+    __quicklistCompress(quicklist, new_node);
+}
+
+/* Wrappers for node inserting around existing node. */
+static void _quicklistInsertNodeBefore(quicklist *quicklist,
+                                       quicklistNode *old_node,
+                                       quicklistNode *new_node) {
+    __quicklistInsertNode(quicklist, old_node, new_node, 0);
+}
+
+static void _quicklistInsertNodeAfter(quicklist *quicklist,
+                                      quicklistNode *old_node,
+                                      quicklistNode *new_node) {
+    __quicklistInsertNode(quicklist, old_node, new_node, 1);
+}
+
+static int
+_quicklistNodeSizeMeetsOptimizationRequirement(const size_t sz,
+                                               const int fill) {
+    size_t offset;
+
+    if (fill >= 0) return 0;
+
+    offset = (-fill) - 1;
+    if (offset < (sizeof(optimization_level) / sizeof(*optimization_level))) {
+        if (sz <= optimization_level[offset]) {
+            return 1;
+        } else {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+}
+
+#define sizeMeetsSafetyLimit(sz) ((sz) <= SIZE_SAFETY_LIMIT)
+
+/* Return 1 if a new element of 'sz' bytes can be added to 'node' without
+ * exceeding the fill factor of the list.
+ *
+ * 检查 node 是否还能容纳一个长度为 sz 的新元素 */
+static int _quicklistNodeAllowInsert(const quicklistNode *node,
+                                     const int fill, const size_t sz) {
+    int ziplist_overhead;
+    unsigned int new_sz;
+
+    if (!node) return 0;
+
+    /* size of previous offset */
+    if (sz < 254)
+        ziplist_overhead = 1;
+    else
+        ziplist_overhead = 5;
+
+    /* size of forward offset */
+    if (sz < 64)
+        ziplist_overhead += 1;
+    else if (sz < 16384)
+        ziplist_overhead += 2;
+    else
+        ziplist_overhead += 5;
+
+    /* new_sz overestimates if 'sz' encodes to an integer type */
+    new_sz = node->sz + sz + ziplist_overhead;
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(new_sz, fill))
+        return 1;
+    else if (!sizeMeetsSafetyLimit(new_sz))
+        return 0;
+    else if ((int)node->count < fill)
+        return 1;
+    else
+        return 0;
+}
+
+/* Return 1 if the ziplists of 'a' and 'b' can be merged into a single
+ * node without exceeding the fill factor of the list. */
+static int _quicklistNodeAllowMerge(const quicklistNode *a,
+                                    const quicklistNode *b,
+                                    const int fill) {
+    unsigned int merge_sz;
+
+    if (!a || !b) return 0;
+
+    /* approximate merged ziplist size (- 11 to remove one ziplist
+     * header/trailer) */
+    merge_sz = a->sz + b->sz - 11;
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(merge_sz, fill))
+        return 1;
+    else if (!sizeMeetsSafetyLimit(merge_sz))
+        return 0;
+    else if ((int)(a->count + b->count) <= fill)
+        return 1;
+    else
+        return 0;
+}
+
+#define quicklistNodeUpdateSz(node)                                            \
+    do {                                                                       \
+        (node)->sz = ziplistBlobLen((node)->zl);                               \
+    } while (0)
+
+/* Add new entry to head node of quicklist.
+ *
+ * Returns 0 if used existing head.
+ * Returns 1 if new head created.
+ *
+ * 将值推入到 quicklist 的表头，表头节点已满时创建新的表头节点 */
+int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
+    quicklistNode *orig_head = quicklist->head;
+    if (_quicklistNodeAllowInsert(quicklist->head, quicklist->fill, sz)) {
+        quicklist->head->zl =
+            ziplistPush(quicklist->head->zl, value, sz, ZIPLIST_HEAD);
+        quicklistNodeUpdateSz(quicklist->head);
+    } else {
+        quicklistNode *node = quicklistCreateNode();
+        node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
+
+        quicklistNodeUpdateSz(node);
+        _quicklistInsertNodeBefore(quicklist, quicklist->head, node);
+    }
+    quicklist->count++;
+    quicklist->head->count++;
+    return (orig_head != quicklist->head);
+}
+
+/* Add new entry to tail node of quicklist.
+ *
+ * Returns 0 if used existing tail.
+ * Returns 1 if new tail created.
+ *
+ * 将值推入到 quicklist 的表尾，表尾节点已满时创建新的表尾节点 */
+int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
+    quicklistNode *orig_tail = quicklist->tail;
+    if (_quicklistNodeAllowInsert(quicklist->tail, quicklist->fill, sz)) {
+        quicklist->tail->zl =
+            ziplistPush(quicklist->tail->zl, value, sz, ZIPLIST_TAIL);
+        quicklistNodeUpdateSz(quicklist->tail);
+    } else {
+        quicklistNode *node = quicklistCreateNode();
+        node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_TAIL);
+
+        quicklistNodeUpdateSz(node);
+        _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
+    }
+    quicklist->count++;
+    quicklist->tail->count++;
+    return (orig_tail != quicklist->tail);
+}
+
+/* Create new node consisting of a pre-formed ziplist.
+ * Used for loading RDBs where entire ziplists have been stored
+ * to be retrieved later.
+ *
+ * 将一个完整的 ziplist 作为新节点添加到 quicklist 的表尾，
+ * 载入 RDB 时使用。 */
+void quicklistAppendZiplist(quicklist *quicklist, unsigned char *zl) {
+    quicklistNode *node = quicklistCreateNode();
+
+    node->zl = zl;
+    node->count = ziplistLen(node->zl);
+    node->sz = ziplistBlobLen(zl);
+
+    _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
+    quicklist->count += node->count;
+}
+
+/* Append all values of ziplist 'zl' individually into 'quicklist'.
+ *
+ * This allows us to restore old RDB ziplists into new quicklists
+ * with smaller ziplist sizes than the saved RDB ziplist.
+ *
+ * Returns 'quicklist' argument. Frees passed-in ziplist 'zl' */
+quicklist *quicklistAppendValuesFromZiplist(quicklist *quicklist,
+                                            unsigned char *zl) {
+    unsigned char *value;
+    unsigned int sz;
+    long long longval;
+    char longstr[32] = {0};
+
+    unsigned char *p = ziplistIndex(zl, 0);
+    while (ziplistGet(p, &value, &sz, &longval)) {
+        if (!value) {
+            /* Write the longval as a string so we can re-add it */
+            sz = ll2string(longstr, sizeof(longstr), longval);
+            value = (unsigned char *)longstr;
+        }
+        quicklistPushTail(quicklist, value, sz);
+        p = ziplistNext(zl, p);
+    }
+    zfree(zl);
+    return quicklist;
+}
+
+/* Create new (potentially multi-node) quicklist from a single existing ziplist.
+ *
+ * Returns new quicklist.  Frees passed-in ziplist 'zl'. */
+quicklist *quicklistCreateFromZiplist(int fill, int compress,
+                                      unsigned char *zl) {
+    return quicklistAppendValuesFromZiplist(quicklistNew(fill, compress), zl);
+}
+
+/* Unlink 'node' from the list and free it.
+ *
+ * 从 quicklist 中删除并释放节点 */
+static void __quicklistDelNode(quicklist *quicklist, quicklistNode *node) {
+    if (node->next)
+        node->next->prev = node->prev;
+    if (node->prev)
+        node->prev->next = node->next;
+
+    if (node == quicklist->tail) {
+        quicklist->tail = node->prev;
+    }
+
+    if (node == quicklist->head) {
+        quicklist->head = node->next;
+    }
+
+    quicklist->len--;
+    quicklist->count -= node->count;
+
+    /* If we deleted a node within our compress depth, we
+     * now have compressed nodes needing to be decompressed. */
+    __quicklistCompress(quicklist, NULL);
+
+    zfree(node->zl);
+    zfree(node);
+}
+
+/* Delete one entry from list given the node for the entry and a pointer
+ * to the entry in the node.
+ *
+ * Note: quicklistDelIndex() *requires* uncompressed nodes because you
+ *       already had to get *p from an uncompressed node somewhere.
+ *
+ * Returns 1 if the entire node was deleted, 0 if node still exists.
+ * Also updates in/out param 'p' with the next offset in the ziplist. */
+static int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
+                             unsigned char **p) {
+    int gone = 0;
+
+    node->zl = ziplistDelete(node->zl, p);
+    node->count--;
+    if (node->count == 0) {
+        gone = 1;
+        __quicklistDelNode(quicklist, node);
+    } else {
+        quicklistNodeUpdateSz(node);
+    }
+    quicklist->count--;
+    /* If we deleted the node, the original node is no longer valid */
+    return gone ? 1 : 0;
+}
+
+/* Delete one element represented by 'entry'
+ *
+ * 'entry' stores enough metadata to delete the proper position in
+ * the correct ziplist in the correct quicklist node.
+ *
+ * After the deletion the iterator is repositioned so that the next call
+ * to quicklistNext() returns the element following the deleted one in the
+ * direction of the iteration.
+ *
+ * 删除迭代器当前返回的元素，并调整迭代器，
+ * 让下一次 quicklistNext() 返回被删除元素的下一个元素。 */
+void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
+    quicklistNode *prev = entry->node->prev;
+    quicklistNode *next = entry->node->next;
+    int deleted_node = quicklistDelIndex((quicklist *)entry->quicklist,
+                                         entry->node, &entry->zi);
+
+    /* after delete, the zi is now invalid for any future usage. */
+    iter->zi = NULL;
+
+    /* If current node is deleted, we must update iterator node and offset. */
+    if (deleted_node) {
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = next;
+            iter->offset = 0;
+        } else if (iter->direction == AL_START_TAIL) {
+            iter->current = prev;
+            iter->offset = -1;
+        }
+    } else if (iter->direction == AL_START_HEAD) {
+        /* The element after the deleted one now lives at the same offset. */
+        iter->offset = entry->offset;
+    } else {
+        /* Going backwards the next element is the one just before the
+         * deleted offset. Express it as a negative offset so that reaching
+         * the start of the ziplist moves the iterator to the previous node. */
+        iter->offset = entry->offset - 1 - (long)entry->node->count;
+    }
+}
+
+/* Replace quicklist entry at offset 'index' by 'data' with length 'sz'.
+ *
+ * Returns 1 if replace happened.
+ * Returns 0 if replace failed and no changes happened.
+ *
+ * 将 index 位置上的元素替换为 data */
+int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
+                            int sz) {
+    quicklistEntry entry;
+    if (quicklistIndex(quicklist, index, &entry)) {
+        /* quicklistIndex provides an uncompressed node */
+        entry.node->zl = ziplistDelete(entry.node->zl, &entry.zi);
+        entry.node->zl = ziplistInsert(entry.node->zl, entry.zi, data, sz);
+        quicklistNodeUpdateSz(entry.node);
+        quicklistCompress(quicklist, entry.node);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Merge 'drop' into its neighbour 'keep' if the result still honours the
+ * fill factor of the list. 'drop' is freed on success, 'keep' is never
+ * freed, so callers may safely hold references to it.
+ *
+ * 如果合并后的节点大小仍然满足 fill 限制，
+ * 那么将 drop 节点的所有元素合并到相邻的 keep 节点，并删除 drop 。 */
+static void _quicklistMergeNodes(quicklist *quicklist, quicklistNode *keep,
+                                 quicklistNode *drop) {
+    unsigned char *p, *vstr;
+    unsigned int vlen;
+    long long vlong;
+    char buf[32];
+    int where;
+
+    if (!_quicklistNodeAllowMerge(keep, drop, quicklist->fill)) return;
+
+    quicklistDecompressNode(keep);
+    quicklistDecompressNode(drop);
+
+    /* Elements of a node following 'keep' are appended in order, elements
+     * of a node preceding it are prepended starting from the last one. */
+    if (drop == keep->next) {
+        where = ZIPLIST_TAIL;
+        p = ziplistIndex(drop->zl, 0);
+    } else {
+        where = ZIPLIST_HEAD;
+        p = ziplistIndex(drop->zl, -1);
+    }
+    while (ziplistGet(p, &vstr, &vlen, &vlong)) {
+        if (!vstr) {
+            vlen = ll2string(buf, sizeof(buf), vlong);
+            vstr = (unsigned char *)buf;
+        }
+        keep->zl = ziplistPush(keep->zl, vstr, vlen, where);
+        p = (where == ZIPLIST_TAIL) ? ziplistNext(drop->zl, p)
+                                    : ziplistPrev(drop->zl, p);
+    }
+    keep->count = ziplistLen(keep->zl);
+    quicklistNodeUpdateSz(keep);
+
+    /* The elements now belong to 'keep': don't subtract them twice. */
+    drop->count = 0;
+    __quicklistDelNode(quicklist, drop);
+    __quicklistCompress(quicklist, keep);
+}
+
+/* Split 'node' into two parts, parameterized by 'offset' and 'after'.
+ *
+ * The 'after' argument controls which quicklistNode gets returned.
+ * If 'after'==1, returned node has elements after 'offset'.
+ *                input node keeps elements up to 'offset', including 'offset'.
+ * If 'after'==0, returned node has elements up to 'offset', *excluding*
+ *                'offset'.
+ *                input node keeps elements after 'offset', including 'offset'.
+ *
+ * The input node must be uncompressed.
+ *
+ * Returns newly created node (not yet linked into the list). */
+static quicklistNode *_quicklistSplitNode(quicklistNode *node, int offset,
+                                          int after) {
+    size_t zl_sz = node->sz;
+
+    quicklistNode *new_node = quicklistCreateNode();
+    new_node->zl = zmalloc(zl_sz);
+
+    /* Copy original ziplist so we can split it */
+    memcpy(new_node->zl, node->zl, zl_sz);
+
+    /* -1 here means "continue deleting until the list ends" */
+    int orig_start = after ? offset + 1 : 0;
+    int orig_extent = after ? -1 : offset;
+    int new_start = after ? 0 : offset;
+    int new_extent = after ? offset + 1 : -1;
+
+    node->zl = ziplistDeleteRange(node->zl, orig_start, orig_extent);
+    node->count = ziplistLen(node->zl);
+    quicklistNodeUpdateSz(node);
+
+    new_node->zl = ziplistDeleteRange(new_node->zl, new_start, new_extent);
+    new_node->count = ziplistLen(new_node->zl);
+    quicklistNodeUpdateSz(new_node);
+
+    return new_node;
+}
+
+/* Insert a new entry before or after existing entry 'entry'.
+ *
+ * If after==1, the new value is inserted after 'entry', otherwise
+ * the new value is inserted before 'entry'.
+ *
+ * 在 entry 之前或之后插入新值，节点已满时，
+ * 会尝试使用相邻节点，或者创建新节点，或者分裂当前节点。 */
+static void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
+                             void *value, const size_t sz, int after) {
+    int full = 0, at_tail = 0, at_head = 0, full_next = 0, full_prev = 0;
+    int fill = quicklist->fill;
+    quicklistNode *node = entry->node;
+    quicklistNode *new_node = NULL;
+
+    if (!node) {
+        /* we have no reference node, so let's create only node in the list */
+        new_node = quicklistCreateNode();
+        new_node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        __quicklistInsertNode(quicklist, NULL, new_node, after);
+        quicklist->count++;
+        return;
+    }
+
+    /* Populate accounting flags for easier boolean checks later */
+    if (!_quicklistNodeAllowInsert(node, fill, sz)) full = 1;
+
+    if (after && (entry->offset == node->count - 1)) {
+        at_tail = 1;
+        if (!_quicklistNodeAllowInsert(node->next, fill, sz)) full_next = 1;
+    }
+
+    if (!after && (entry->offset == 0)) {
+        at_head = 1;
+        if (!_quicklistNodeAllowInsert(node->prev, fill, sz)) full_prev = 1;
+    }
+
+    /* Now determine where and how to insert the new element */
+    if (!full && after) {
+        quicklistDecompressNodeForUse(node);
+        unsigned char *next = ziplistNext(node->zl, entry->zi);
+        if (next == NULL) {
+            node->zl = ziplistPush(node->zl, value, sz, ZIPLIST_TAIL);
+        } else {
+            node->zl = ziplistInsert(node->zl, next, value, sz);
+        }
+        node->count++;
+        quicklistNodeUpdateSz(node);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (!full && !after) {
+        quicklistDecompressNodeForUse(node);
+        node->zl = ziplistInsert(node->zl, entry->zi, value, sz);
+        node->count++;
+        quicklistNodeUpdateSz(node);
+        quicklistRecompressOnly(quicklist, node);
+    } else if (full && at_tail && node->next && !full_next && after) {
+        /* If we are: at tail, next has free space, and inserting after:
+         *   - insert entry at head of next node. */
+        new_node = node->next;
+        quicklistDecompressNodeForUse(new_node);
+        new_node->zl = ziplistPush(new_node->zl, value, sz, ZIPLIST_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        quicklistRecompressOnly(quicklist, new_node);
+    } else if (full && at_head && node->prev && !full_prev && !after) {
+        /* If we are: at head, previous has free space, and inserting before:
+         *   - insert entry at tail of previous node. */
+        new_node = node->prev;
+        quicklistDecompressNodeForUse(new_node);
+        new_node->zl = ziplistPush(new_node->zl, value, sz, ZIPLIST_TAIL);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        quicklistRecompressOnly(quicklist, new_node);
+    } else if (full && ((at_tail && after) || (at_head && !after))) {
+        /* If we are: full, and our prev/next is full or missing, then:
+         *   - create new node and attach to quicklist */
+        new_node = quicklistCreateNode();
+        new_node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        __quicklistInsertNode(quicklist, node, new_node, after);
+    } else if (full) {
+        /* else, node is full we need to split it.
+         * covers both after and !after cases */
+        quicklistDecompressNodeForUse(node);
+        new_node = _quicklistSplitNode(node, entry->offset, after);
+        new_node->zl = ziplistPush(new_node->zl, value, sz,
+                                   after ? ZIPLIST_HEAD : ZIPLIST_TAIL);
+        new_node->count++;
+        quicklistNodeUpdateSz(new_node);
+        __quicklistInsertNode(quicklist, node, new_node, after);
+        quicklistRecompressOnly(quicklist, node);
+
+        /* The split may leave two half empty nodes next to each other:
+         * fold the node on the far side of 'new_node' into it. 'node'
+         * itself is never freed here since callers may still hold it. */
+        _quicklistMergeNodes(quicklist, new_node,
+                             after ? new_node->next : new_node->prev);
+    }
+
+    quicklist->count++;
+}
+
+void quicklistInsertBefore(quicklist *quicklist, quicklistEntry *entry,
+                           void *value, const size_t sz) {
+    _quicklistInsert(quicklist, entry, value, sz, 0);
+}
+
+void quicklistInsertAfter(quicklist *quicklist, quicklistEntry *entry,
+                          void *value, const size_t sz) {
+    _quicklistInsert(quicklist, entry, value, sz, 1);
+}
+
+/* Delete a range of elements from the quicklist.
+ *
+ * elements may span across multiple quicklistNodes, so we
+ * have to be careful about tracking where we start and end.
+ *
+ * Returns 1 if entries were deleted, 0 if nothing was deleted.
+ *
+ * 从 start 开始，删除 count 个元素 */
+int quicklistDelRange(quicklist *quicklist, const long start,
+                      const long count) {
+    quicklistEntry entry;
+    quicklistNode *node;
+    unsigned long extent;
+
+    if (count <= 0) return 0;
+
+    extent = count; /* range is inclusive of start position */
+
+    if (start >= 0 && extent > (quicklist->count - start)) {
+        /* if requesting delete more elements than exist, limit to list size. */
+        extent = quicklist->count - start;
+    } else if (start < 0 && extent > (unsigned long)(-start)) {
+        /* else, if at negative offset, limit max size to rest of list. */
+        extent = -start; /* c.f. LREM -29 29; just delete until end. */
+    }
+
+    if (!quicklistIndex(quicklist, start, &entry)) return 0;
+
+    node = entry.node;
+
+    /* iterate over next nodes until everything is deleted. */
+    while (extent) {
+        quicklistNode *next = node->next;
+        unsigned long del;
+
+        if (entry.offset == 0 && extent >= node->count) {
+            /* If we are deleting more than the count of this node, we
+             * can just delete the entire node without ziplist math. */
+            del = node->count;
+            __quicklistDelNode(quicklist, node);
+        } else {
+            /* Delete from 'offset' up to the end of the node, or up to
+             * 'extent' elements if the range ends inside this node. */
+            del = node->count - entry.offset;
+            if (del > extent) del = extent;
+
+            quicklistDecompressNodeForUse(node);
+            node->zl = ziplistDeleteRange(node->zl, entry.offset, del);
+            quicklistNodeUpdateSz(node);
+            node->count -= del;
+            quicklist->count -= del;
+            if (node->count == 0) {
+                __quicklistDelNode(quicklist, node);
+            } else {
+                quicklistRecompressOnly(quicklist, node);
+            }
+        }
+
+        extent -= del;
+        node = next;
+        entry.offset = 0;
+    }
+    return 1;
+}
+
+/* Passthrough to ziplistCompare() */
+int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len) {
+    return ziplistCompare(p1, p2, p2_len);
+}
+
+/* Returns a quicklist iterator 'iter'. After the initialization every
+ * call to quicklistNext() will return the next element of the quicklist.
+ *
+ * 创建一个 quicklist 迭代器 */
+quicklistIter *quicklistGetIterator(const quicklist *quicklist, int direction) {
+    quicklistIter *iter;
+
+    iter = zmalloc(sizeof(*iter));
+
+    if (direction == AL_START_HEAD) {
+        iter->current = quicklist->head;
+        iter->offset = 0;
+    } else {
+        iter->current = quicklist->tail;
+        iter->offset = -1;
+    }
+
+    iter->direction = direction;
+    iter->quicklist = quicklist;
+
+    iter->zi = NULL;
+
+    return iter;
+}
+
+/* Initialize an iterator at a specific offset 'idx' and make the iterator
+ * return nodes in 'direction' direction.
+ *
+ * Returns NULL if 'idx' is out of range. */
+quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
+                                         const int direction,
+                                         const long long idx) {
+    quicklistEntry entry;
+
+    if (quicklistIndex(quicklist, idx, &entry)) {
+        quicklistIter *base = quicklistGetIterator(quicklist, direction);
+        base->zi = NULL;
+        base->current = entry.node;
+        base->offset = entry.offset;
+        return base;
+    } else {
+        return NULL;
+    }
+}
+
+/* Release iterator.
+ * If we still have a valid current node, then re-encode current node. */
+void quicklistReleaseIterator(quicklistIter *iter) {
+    if (iter->current)
+        quicklistCompress(iter->quicklist, iter->current);
+
+    zfree(iter);
+}
+
+/* Get next element in iterator.
+ *
+ * Note: You must NOT insert into the list while iterating over it.
+ * You *may* delete from the list while iterating using the
+ * quicklistDelEntry() function.
+ * If you insert into the quicklist while iterating, you should
+ * re-create the iterator after your addition.
+ *
+ * quicklistIter *iter = quicklistGetIterator(quicklist,<direction>);
+ * quicklistEntry entry;
+ * while (quicklistNext(iter, &entry)) {
+ *     if (entry.value)
+ *          [[ use entry.value with entry.sz ]]
+ *     else
+ *          [[ use entry.longval ]]
+ * }
+ *
+ * Populates 'entry' with values for this iteration.
+ * Returns 0 when iteration is complete or if iteration not possible.
+ * If return value is 0, the contents of 'entry' are not valid.
+ *
+ * 返回迭代器的下一个元素，迭代完毕时返回 0 */
+int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
+    while (iter->current) {
+        quicklistNode *node = iter->current;
+
+        if (!iter->zi) {
+            /* If !zi, use current index. */
+            quicklistDecompressNodeForUse(node);
+            iter->zi = ziplistIndex(node->zl, iter->offset);
+        } else if (iter->direction == AL_START_HEAD) {
+            iter->zi = ziplistNext(node->zl, iter->zi);
+            iter->offset += 1;
+        } else {
+            iter->zi = ziplistPrev(node->zl, iter->zi);
+            iter->offset -= 1;
+        }
+
+        if (iter->zi) {
+            entry->quicklist = iter->quicklist;
+            entry->node = node;
+            entry->zi = iter->zi;
+            entry->offset = iter->offset < 0 ? node->count + iter->offset
+                                             : iter->offset;
+            entry->value = NULL;
+            entry->longval = -123456789;
+            entry->sz = 0;
+            ziplistGet(entry->zi, &entry->value, &entry->sz, &entry->longval);
+            return 1;
+        }
+
+        /* We ran out of ziplist entries.
+         * Pick next node, update offset, then re-run retrieval. */
+        quicklistCompress(iter->quicklist, node);
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = node->next;
+            iter->offset = 0;
+        } else {
+            iter->current = node->prev;
+            iter->offset = -1;
+        }
+        iter->zi = NULL;
+    }
+    return 0;
+}
+
+/* Populate 'entry' with the element at the specified zero-based index
+ * where 0 is the head, 1 is the element next to head
+ * and so on. Negative integers are used in order to count
+ * from the tail, -1 is the last element, -2 the penultimate
+ * and so on. If the index is out of range 0 is returned.
+ *
+ * The node holding the element is left decompressed: the caller is
+ * responsible for recompressing it once done (see quicklistCompress()).
+ *
+ * Returns 1 if element found
+ * Returns 0 if element not found
+ *
+ * 查找给定索引上的元素 */
+int quicklistIndex(const quicklist *quicklist, const long long idx,
+                   quicklistEntry *entry) {
+    quicklistNode *n;
+    unsigned long long accum = 0;
+    unsigned long long index;
+    int forward = idx < 0 ? 0 : 1; /* < 0 -> reverse, 0+ -> forward */
+
+    entry->quicklist = quicklist;
+    entry->node = NULL;
+    entry->zi = NULL;
+    entry->value = NULL;
+    entry->longval = -123456789;
+    entry->sz = 0;
+    entry->offset = 123456789;
+
+    if (!forward) {
+        index = (-idx) - 1;
+        n = quicklist->tail;
+    } else {
+        index = idx;
+        n = quicklist->head;
+    }
+
+    if (index >= quicklist->count) return 0;
+
+    while (n) {
+        if ((accum + n->count) > index) break;
+        accum += n->count;
+        n = forward ? n->next : n->prev;
+    }
+
+    if (!n) return 0;
+
+    entry->node = n;
+    if (forward) {
+        /* forward = normal head-to-tail offset. */
+        entry->offset = index - accum;
+    } else {
+        /* reverse = convert the tail-to-head offset to a head offset. */
+        entry->offset = n->count - 1 - (index - accum);
+    }
+
+    quicklistDecompressNodeForUse(entry->node);
+    entry->zi = ziplistIndex(entry->node->zl, entry->offset);
+    ziplistGet(entry->zi, &entry->value, &entry->sz, &entry->longval);
+    return 1;
+}
+
+/* Default pop function
+ *
+ * Returns malloc'd value from quicklist */
+static void *_quicklistSaver(unsigned char *data, unsigned int sz) {
+    unsigned char *vstr;
+    if (data) {
+        vstr = zmalloc(sz);
+        memcpy(vstr, data, sz);
+        return vstr;
+    }
+    return NULL;
+}
+
+/* pop from quicklist and return result in 'data' ptr.  Value of 'data'
+ * is the return value of 'saver' function pointer if the data is NOT a number.
+ *
+ * If the quicklist element is a long long, then the return value is returned in
+ * 'sval'.
+ *
+ * Return value of 0 means no elements available.
+ * Return value of 1 means check 'data' and 'sval' for values.
+ * If 'data' is set, use 'data' and 'sz'.  Otherwise, use 'sval'.
+ *
+ * 从 quicklist 的表头或表尾弹出一个元素 */
+int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
+                       unsigned int *sz, long long *sval,
+                       void *(*saver)(unsigned char *data, unsigned int sz)) {
+    unsigned char *p;
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    int pos = (where == QUICKLIST_HEAD) ? 0 : -1;
+
+    if (quicklist->count == 0) return 0;
+
+    if (data) *data = NULL;
+    if (sz) *sz = 0;
+    if (sval) *sval = -123456789;
+
+    quicklistNode *node;
+    if (where == QUICKLIST_HEAD && quicklist->head) {
+        node = quicklist->head;
+    } else if (where == QUICKLIST_TAIL && quicklist->tail) {
+        node = quicklist->tail;
+    } else {
+        return 0;
+    }
+
+    /* Head and tail are always outside of the compression depth. */
+    p = ziplistIndex(node->zl, pos);
+    if (ziplistGet(p, &vstr, &vlen, &vlong)) {
+        if (vstr) {
+            if (data) *data = saver(vstr, vlen);
+            if (sz) *sz = vlen;
+        } else {
+            if (data) *data = NULL;
+            if (sval) *sval = vlong;
+        }
+        quicklistDelIndex(quicklist, node, &p);
+        return 1;
+    }
+    return 0;
+}
+
+/* Return a malloc'd copy of data popped from quicklist */
+int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
+                 unsigned int *sz, long long *slong) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    if (quicklist->count == 0) return 0;
+    int ret = quicklistPopCustom(quicklist, where, &vstr, &vlen, &vlong,
+                                 _quicklistSaver);
+    if (data) *data = vstr;
+    if (slong) *slong = vlong;
+    if (sz) *sz = vlen;
+    return ret;
+}
+
+/* Wrapper to allow argument-based switching between HEAD/TAIL pop */
+void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
+                   int where) {
+    if (where == QUICKLIST_HEAD) {
+        quicklistPushHead(quicklist, value, sz);
+    } else if (where == QUICKLIST_TAIL) {
+        quicklistPushTail(quicklist, value, sz);
+    }
+}
+
+#ifdef QUICKLIST_TEST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/time.h>
+
+/* Walk the whole list checking that the cached counters, the links and
+ * the compression depth are all consistent. */
+static void ql_verify(quicklist *ql) {
+    quicklistNode *node = ql->head, *prev = NULL;
+    unsigned long count = 0;
+    unsigned int len = 0;
+
+    while (node) {
+        assert(node->prev == prev);
+        assert(node->count > 0);
+        if (node->encoding == QUICKLIST_NODE_ENCODING_RAW) {
+            assert(ziplistLen(node->zl) == node->count);
+            assert(ziplistBlobLen(node->zl) == node->sz);
+        }
+        if (ql->compress == 0 || len < ql->compress ||
+            len >= ql->len - ql->compress) {
+            /* Nodes within the depth must never be compressed. */
+            assert(node->encoding == QUICKLIST_NODE_ENCODING_RAW);
+        }
+        count += node->count;
+        len++;
+        prev = node;
+        node = node->next;
+    }
+    assert(ql->tail == prev);
+    assert(ql->len == len);
+    assert(ql->count == count);
+}
+
+/* Read the element at 'idx' into 'buf' as a string. */
+static void ql_get(quicklist *ql, long idx, char *buf) {
+    quicklistIter *iter = quicklistGetIteratorAtIdx(ql, AL_START_HEAD, idx);
+    quicklistEntry entry;
+
+    assert(iter && quicklistNext(iter, &entry));
+    if (entry.value) {
+        memcpy(buf, entry.value, entry.sz);
+        buf[entry.sz] = '\0';
+    } else {
+        ll2string(buf, 32, entry.longval);
+    }
+    quicklistReleaseIterator(iter);
+}
+
+/* Apply random operations both to a quicklist and to a plain array of
+ * integers used as reference, comparing the two after every step. */
+static void ql_fuzz(int fill, int depth, int iterations) {
+    quicklist *ql = quicklistNew(fill, depth);
+    long *ref = malloc(sizeof(long) * (iterations + 1));
+    long len = 0, j, i;
+    char buf[64];
+
+    for (i = 0; i < iterations; i++) {
+        long v = rand() % 100000, idx;
+        int op = rand() % 6;
+        int sz = snprintf(buf, sizeof(buf), "%ld", v);
+        quicklistEntry entry;
+        quicklistIter *iter;
+
+        if (op == 0 || len == 0) {
+            quicklistPushHead(ql, buf, sz);
+            memmove(ref + 1, ref, sizeof(long) * len);
+            ref[0] = v;
+            len++;
+        } else if (op == 1) {
+            quicklistPushTail(ql, buf, sz);
+            ref[len++] = v;
+        } else if (op == 2) {
+            /* Insert before or after a random element. */
+            int after = rand() % 2;
+            idx = rand() % len;
+            iter = quicklistGetIteratorAtIdx(ql, AL_START_HEAD, idx);
+            assert(quicklistNext(iter, &entry));
+            if (after) {
+                quicklistInsertAfter(ql, &entry, buf, sz);
+                idx++;
+            } else {
+                quicklistInsertBefore(ql, &entry, buf, sz);
+            }
+            quicklistReleaseIterator(iter);
+            memmove(ref + idx + 1, ref + idx, sizeof(long) * (len - idx));
+            ref[idx] = v;
+            len++;
+        } else if (op == 3) {
+            /* Delete a random element while iterating backwards. */
+            idx = rand() % len;
+            iter = quicklistGetIteratorAtIdx(ql, AL_START_TAIL, idx);
+            assert(quicklistNext(iter, &entry));
+            quicklistDelEntry(iter, &entry);
+            if (idx > 0) {
+                assert(quicklistNext(iter, &entry));
+                assert(entry.longval == ref[idx - 1]);
+            }
+            quicklistReleaseIterator(iter);
+            memmove(ref + idx, ref + idx + 1, sizeof(long) * (len - idx - 1));
+            len--;
+        } else if (op == 4) {
+            /* Delete a small random range. */
+            long start = rand() % len, count = 1 + rand() % 8;
+            if (count > len - start) count = len - start;
+            quicklistDelRange(ql, start, count);
+            memmove(ref + start, ref + start + count,
+                    sizeof(long) * (len - start - count));
+            len -= count;
+        } else {
+            idx = rand() % len;
+            assert(quicklistReplaceAtIndex(ql, idx, buf, sz));
+            ref[idx] = v;
+        }
+
+        ql_verify(ql);
+        assert((long)quicklistCount(ql) == len);
+        if (i % 64 == 0) {
+            for (j = 0; j < len; j++) {
+                ql_get(ql, j, buf);
+                assert(strtol(buf, NULL, 10) == ref[j]);
+            }
+        }
+    }
+
+    /* Drain the list from both ends. */
+    while (len) {
+        long long v;
+        unsigned char *data;
+        unsigned int sz;
+        int head = rand() % 2;
+
+        assert(quicklistPop(ql, head ? QUICKLIST_HEAD : QUICKLIST_TAIL,
+                            &data, &sz, &v));
+        assert(data == NULL && v == ref[head ? 0 : len - 1]);
+        if (head) memmove(ref, ref + 1, sizeof(long) * (len - 1));
+        len--;
+        ql_verify(ql);
+    }
+    assert(ql->head == NULL && ql->tail == NULL);
+
+    free(ref);
+    quicklistRelease(ql);
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (((long long)tv.tv_sec) * 1000000) + tv.tv_usec;
+}
+
+int main(int argc, char **argv) {
+    int fills[] = {-5, -2, -1, 1, 2, 4, 32, 128};
+    int depths[] = {0, 1, 2, 4};
+    unsigned int f, d;
+    long long start;
+    int j;
+
+    ((void) argc);
+    ((void) argv);
+
+    srand(1234);
+    for (f = 0; f < sizeof(fills) / sizeof(*fills); f++) {
+        for (d = 0; d < sizeof(depths) / sizeof(*depths); d++) {
+            printf("Fuzzing fill %d, compress depth %d... ", fills[f],
+                   depths[d]);
+            fflush(stdout);
+            ql_fuzz(fills[f], depths[d], 2000);
+            printf("OK\n");
+        }
+    }
+
+    printf("Benchmark push/pop of 1M elements at both ends:\n");
+    for (d = 0; d < 2; d++) {
+        quicklist *ql = quicklistNew(-2, d);
+        char buf[32];
+
+        start = usec();
+        for (j = 0; j < 1000000; j++) {
+            int sz = snprintf(buf, sizeof(buf), "element:%d", j);
+            quicklistPush(ql, buf, sz, j % 2 ? QUICKLIST_HEAD : QUICKLIST_TAIL);
+        }
+        printf("  compress %u: push %lld usec, %u nodes", d, usec() - start,
+               ql->len);
+        start = usec();
+        for (j = 0; j < 1000000; j++) {
+            unsigned char *data = NULL;
+            unsigned int sz;
+            long long v;
+            quicklistPop(ql, j % 2 ? QUICKLIST_HEAD : QUICKLIST_TAIL, &data,
+                         &sz, &v);
+            zfree(data);
+        }
+        printf(", pop %lld usec\n", usec() - start);
+        quicklistRelease(ql);
+    }
+    return 0;
+}
+#endif
@@ -237,41 +237,51 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
-    size_t comprlen, outlen;
+/* Save already LZF compressed data as an LZF encoded string, so that it can
+ * be loaded back with rdbLoadLzfStringObject(). 'original_len' is the size
+ * of the data once decompressed.
+ *
+ * 将已经使用 LZF 压缩过的数据以 LZF 编码字符串的形式写入到 rdb ，
+ * 比如 quicklist 中被压缩的节点可以直接保存，不必先解压再压缩。 */
+int rdbSaveLzfBlob(rio *rdb, void *data, size_t compress_len,
+                   size_t original_len) {
     unsigned char byte;
     int n, nwritten = 0;
-    void *out;
 
-    /* We require at least four bytes compression for this to be worth it */
-    if (len <= 4) return 0;
-    outlen = len-4;
-    if ((out = zmalloc(outlen+1)) == NULL) return 0;
-    comprlen = lzf_compress(s, len, out, outlen);
-    if (comprlen == 0) {
-        zfree(out);
-        return 0;
-    }
     /* Data compressed! Let's save it on disk */
     byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
-    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
+    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) return -1;
     nwritten += n;
 
-    if ((n = rdbSaveLen(rdb,comprlen)) == -1) goto writeerr;
+    if ((n = rdbSaveLen(rdb,compress_len)) == -1) return -1;
     nwritten += n;
 
-    if ((n = rdbSaveLen(rdb,len)) == -1) goto writeerr;
+    if ((n = rdbSaveLen(rdb,original_len)) == -1) return -1;
     nwritten += n;
 
-    if ((n = rdbWriteRaw(rdb,out,comprlen)) == -1) goto writeerr;
+    if ((n = rdbWriteRaw(rdb,data,compress_len)) == -1) return -1;
     nwritten += n;
 
-    zfree(out);
     return nwritten;
+}
+
+int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+    size_t comprlen, outlen;
+    int nwritten;
+    void *out;
 
-writeerr:
+    /* We require at least four bytes compression for this to be worth it */
+    if (len <= 4) return 0;
+    outlen = len-4;
+    if ((out = zmalloc(outlen+1)) == NULL) return 0;
+    comprlen = lzf_compress(s, len, out, outlen);
+    if (comprlen == 0) {
+        zfree(out);
+        return 0;
+    }
+    nwritten = rdbSaveLzfBlob(rdb,out,comprlen,len);
     zfree(out);
-    return -1;
+    return nwritten;
 }
 
 /*
@@ -377,7 +387,7 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
         return rdbSaveLongLongAsStringObject(rdb,(long)obj->ptr);
     } else {
         // 如果是字符串，直接写入 rdb
-        redisAssertWithInfo(NULL,obj,obj->encoding == REDIS_ENCODING_RAW);
+        redisAssertWithInfo(NULL,obj,sdsEncodedObject(obj));
         return rdbSaveRawString(rdb,obj->ptr,sdslen(obj->ptr));
     }
 }
@@ -496,15 +506,15 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     switch (o->type) {
     // 字符串
     case REDIS_STRING:
+        // roaring 位图
+        if (o->encoding == REDIS_ENCODING_ROARING)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING_ROARING);
         return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING);
     // 列表
     case REDIS_LIST:
-        // ziplist 编码
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_ZIPLIST);
-        // 双端链表
-        else if (o->encoding == REDIS_ENCODING_LINKEDLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST);
+        // quicklist 编码
+        if (o->encoding == REDIS_ENCODING_QUICKLIST)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_QUICKLIST);
         else
             redisPanic("Unknown list encoding");
     // 集合
@@ -519,9 +529,9 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
             redisPanic("Unknown set encoding");
     // 有序集 
     case REDIS_ZSET:
-        // ziplist
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_ZIPLIST);
+        // listpack
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_LISTPACK);
         // 跳跃表
         else if (o->encoding == REDIS_ENCODING_SKIPLIST)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET);
@@ -529,14 +539,17 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
             redisPanic("Unknown sorted set encoding");
     // 哈希
     case REDIS_HASH:
-        // ziplist
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_ZIPLIST);
+        // listpack
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_LISTPACK);
         // 字典
         else if (o->encoding == REDIS_ENCODING_HT)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH);
         else
             redisPanic("Unknown hash encoding");
+    // 流
+    case REDIS_STREAM:
+        return rdbSaveType(rdb,REDIS_RDB_TYPE_STREAM_LISTPACKS);
     default:
         redisPanic("Unknown object type");
     }
@@ -564,39 +577,126 @@ int rdbLoadObjectType(rio *rdb) {
  *
  * 出错返回 -1 ，写入成功返回 0 。
  */
+/* Save a stream ID as a 128 bit big endian raw string. */
+static int rdbSaveStreamID(rio *rdb, streamID *id) {
+    unsigned char rawid[sizeof(streamID)];
+
+    streamEncodeID(rawid,id);
+    return rdbSaveRawString(rdb,rawid,sizeof(rawid));
+}
+
+/* Save the consumer group 'cg' called 'name':
+ *
+ *   name | last_id | PEL size | [ID | delivery time | delivery count]...
+ *   | consumers | [name | seen time | PEL size | [ID]...]...
+ *
+ * The NACKs are saved with the group PEL, the consumer PELs just list the
+ * IDs they own.
+ *
+ * 保存消费者组。待确认项保存在组的 PEL 中，
+ * 消费者的 PEL 只保存它们拥有的项的 ID 。 */
+static int rdbSaveStreamCG(rio *rdb, sds name, streamCG *cg) {
+    streamIndexNode *node;
+    dictIterator *di;
+    dictEntry *de;
+    int n, nwritten = 0;
+
+    if ((n = rdbSaveRawString(rdb,(unsigned char*)name,sdslen(name))) == -1)
+        return -1;
+    nwritten += n;
+    if ((n = rdbSaveStreamID(rdb,&cg->last_id)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbSaveLen(rdb,cg->pel->length)) == -1) return -1;
+    nwritten += n;
+    for (node = streamIndexFirst(cg->pel); node; node = streamIndexNext(node)) {
+        streamNACK *nack = node->value;
+        uint64_t count = nack->delivery_count;
+
+        if (count > UINT32_MAX) count = UINT32_MAX;
+        if ((n = rdbSaveStreamID(rdb,&node->id)) == -1) return -1;
+        nwritten += n;
+        if ((n = rdbSaveMillisecondTime(rdb,nack->delivery_time)) == -1)
+            return -1;
+        nwritten += n;
+        if ((n = rdbSaveLen(rdb,count)) == -1) return -1;
+        nwritten += n;
+    }
+
+    if ((n = rdbSaveLen(rdb,dictSize(cg->consumers))) == -1) return -1;
+    nwritten += n;
+    di = dictGetIterator(cg->consumers);
+    while((de = dictNext(di)) != NULL) {
+        streamConsumer *consumer = dictGetVal(de);
+
+        if ((n = rdbSaveRawString(rdb,(unsigned char*)consumer->name,
+                                  sdslen(consumer->name))) == -1) goto werr;
+        nwritten += n;
+        if ((n = rdbSaveMillisecondTime(rdb,consumer->seen_time)) == -1)
+            goto werr;
+        nwritten += n;
+        if ((n = rdbSaveLen(rdb,consumer->pel->length)) == -1) goto werr;
+        nwritten += n;
+        for (node = streamIndexFirst(consumer->pel); node;
+             node = streamIndexNext(node))
+        {
+            if ((n = rdbSaveStreamID(rdb,&node->id)) == -1) goto werr;
+            nwritten += n;
+        }
+    }
+    dictReleaseIterator(di);
+    return nwritten;
+
+werr:
+    dictReleaseIterator(di);
+    return -1;
+}
+
 int rdbSaveObject(rio *rdb, robj *o) {
     int n, nwritten = 0;
 
-    if (o->type == REDIS_STRING) {
+    if (o->type == REDIS_STRING && o->encoding == REDIS_ENCODING_ROARING) {
+        /* Save a roaring bitmap as its serialized blob */
+        // 将 roaring 位图序列化为字符串保存
+        roaring *r = o->ptr;
+        size_t l = roaringBlobLen(r);
+        unsigned char *blob = zmalloc(l);
+
+        roaringSerialize(r,blob);
+        n = rdbSaveRawString(rdb,blob,l);
+        zfree(blob);
+        if (n == -1) return -1;
+        nwritten += n;
+    } else if (o->type == REDIS_STRING) {
         /* Save a string value */
         // 字符串直接保存
         if ((n = rdbSaveStringObject(rdb,o)) == -1) return -1;
         nwritten += n;
     } else if (o->type == REDIS_LIST) {
         /* Save a list value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            // 保存 ziplist 占用的字节数量
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
-
-            // 以字符串形式保存整个 ziplist
-            if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
-            nwritten += n;
-        } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-            list *list = o->ptr;
-            listIter li;
-            listNode *ln;
+        if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = o->ptr;
+            quicklistNode *node = ql->head;
 
-            // 保存入节点数量
-            if ((n = rdbSaveLen(rdb,listLength(list))) == -1) return -1;
+            // 保存节点数量
+            if ((n = rdbSaveLen(rdb,ql->len)) == -1) return -1;
             nwritten += n;
 
-            // 遍历所有链表节点，取出值，并以字符形式保存它们
-            listRewind(list,&li);
-            while((ln = listNext(&li))) {
-                robj *eleobj = listNodeValue(ln);
-                if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
-                nwritten += n;
-            }
+            // 以字符串形式逐个保存节点的 ziplist ，
+            // 已经被压缩的节点直接保存 LZF 数据
+            do {
+                if (node->encoding == QUICKLIST_NODE_ENCODING_LZF) {
+                    void *data;
+                    size_t compress_len = quicklistGetLzf(node,&data);
+                    if ((n = rdbSaveLzfBlob(rdb,data,compress_len,
+                                            node->sz)) == -1) return -1;
+                    nwritten += n;
+                } else {
+                    if ((n = rdbSaveRawString(rdb,node->zl,node->sz)) == -1)
+                        return -1;
+                    nwritten += n;
+                }
+            } while ((node = node->next));
         } else {
             redisPanic("Unknown list encoding");
         }
@@ -630,11 +730,11 @@ int rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == REDIS_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            // 保存 ziplist 占用的字节数
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            // 保存 listpack 占用的字节数
+            size_t l = lpBytes((unsigned char*)o->ptr);
             
-            // 将整个 ziplist 以字符串形式保存
+            // 将整个 listpack 以字符串形式保存
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
         } else if (o->encoding == REDIS_ENCODING_SKIPLIST) {
@@ -665,11 +765,11 @@ int rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == REDIS_HASH) {
         /* Save a hash value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            // 保存 ziplist 占用的字节数
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            // 保存 listpack 占用的字节数
+            size_t l = lpBytes((unsigned char*)o->ptr);
             
-            // 将整个 ziplist 保存为字符串
+            // 将整个 listpack 保存为字符串
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
 
@@ -700,6 +800,49 @@ int rdbSaveObject(rio *rdb, robj *o) {
             redisPanic("Unknown hash encoding");
         }
 
+    } else if (o->type == REDIS_STREAM) {
+        /* Save a stream: the listpack blocks with their master IDs, the
+         * last ID, and the consumer groups. The number of entries is not
+         * saved, it is computed again from the blocks on load. */
+        // 保存流：所有 listpack 块及其主 ID 、最后 ID ，以及消费者组
+        stream *s = o->ptr;
+        streamIndexNode *node;
+
+        if ((n = rdbSaveLen(rdb,s->index->length)) == -1) return -1;
+        nwritten += n;
+        for (node = streamIndexFirst(s->index); node;
+             node = streamIndexNext(node))
+        {
+            unsigned char *lp = node->value;
+
+            if ((n = rdbSaveStreamID(rdb,&node->id)) == -1) return -1;
+            nwritten += n;
+            if ((n = rdbSaveRawString(rdb,lp,lpBytes(lp))) == -1) return -1;
+            nwritten += n;
+        }
+
+        if ((n = rdbSaveStreamID(rdb,&s->last_id)) == -1) return -1;
+        nwritten += n;
+
+        if ((n = rdbSaveLen(rdb,s->cgroups ? dictSize(s->cgroups) : 0)) == -1)
+            return -1;
+        nwritten += n;
+        if (s->cgroups) {
+            dictIterator *di = dictGetIterator(s->cgroups);
+            dictEntry *de;
+
+            while((de = dictNext(di)) != NULL) {
+                if ((n = rdbSaveStreamCG(rdb,dictGetKey(de),
+                                         dictGetVal(de))) == -1)
+                {
+                    dictReleaseIterator(di);
+                    return -1;
+                }
+                nwritten += n;
+            }
+            dictReleaseIterator(di);
+        }
+
     } else {
         redisPanic("Unknown object type");
     }
@@ -754,92 +897,146 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
     return 1;
 }
 
-/* Save the DB on disk. Return REDIS_ERR on error, REDIS_OK on success */
+/* Produces a dump of the database in RDB format sending it to the specified
+ * Redis I/O channel. On success REDIS_OK is returned, otherwise REDIS_ERR
+ * is returned and part of the output, or all the output, can be
+ * missing because of I/O errors.
+ *
+ * When the function returns REDIS_ERR and if 'error' is not NULL, the
+ * integer pointed by 'error' is set to the value of errno just after the I/O
+ * error. */
 /*
- * 将数据库保存到磁盘上。成功返回 REDIS_OK ，失败返回 REDIS_ERR 。
+ * 将数据库以 RDB 格式写入到给定的 rio 中
+ *
+ * 成功返回 REDIS_OK ，出错返回 REDIS_ERR ，
+ * 并且在 error 不为 NULL 时，将出错时的 errno 保存到 error 中。
  */
-int rdbSave(char *filename) {
-    dictIterator *di = NULL;
-    dictEntry *de;
-    char tmpfile[256];
+int rdbSaveRio(rio *rdb, int *error) {
+    kvtableIterator *di = NULL;
+    kvEntry *e;
     char magic[10];
     int j;
     long long now = mstime();
-    FILE *fp;
-    rio rdb;
     uint64_t cksum;
 
-    // 以 "temp-<pid>.rdb" 格式创建临时文件名
-    snprintf(tmpfile,256,"temp-%d.rdb", (int) getpid());
-    fp = fopen(tmpfile,"w");
-    if (!fp) {
-        redisLog(REDIS_WARNING, "Failed opening .rdb for saving: %s",
-            strerror(errno));
-        return REDIS_ERR;
-    }
-
-    // 初始化 rio 文件
-    rioInitWithFile(&rdb,fp);
     // 如果有需要的话，设置校验和计算函数
     if (server.rdb_checksum)
-        rdb.update_cksum = rioGenericUpdateChecksum;
+        rdb->update_cksum = rioGenericUpdateChecksum;
     // 以 "REDIS <VERSION>" 格式写入文件头，以及 RDB 的版本
     snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
-    if (rdbWriteRaw(&rdb,magic,9) == -1) goto werr;
+    if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
 
     // 遍历所有数据库，保存它们的数据
     for (j = 0; j < server.dbnum; j++) {
         // 指向数据库
         redisDb *db = server.db+j;
         // 指向数据库 key space
-        dict *d = db->dict;
+        kvtable *t = db->keyspace;
         // 数据库为空， pass ，处理下个数据库
-        if (dictSize(d) == 0) continue;
+        if (kvtableSize(t) == 0) continue;
 
         // 创建迭代器
-        di = dictGetSafeIterator(d);
-        if (!di) {
-            fclose(fp);
-            return REDIS_ERR;
-        }
+        di = kvtableGetIterator(t);
 
         /* Write the SELECT DB opcode */
         // 记录正在使用的数据库的号码
-        if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_SELECTDB) == -1) goto werr;
-        if (rdbSaveLen(&rdb,j) == -1) goto werr;
+        if (rdbSaveType(rdb,REDIS_RDB_OPCODE_SELECTDB) == -1) goto werr;
+        if (rdbSaveLen(rdb,j) == -1) goto werr;
 
         /* Iterate this DB writing every entry */
         // 将数据库中的所有节点保存到 RDB 文件
-        while((de = dictNext(di)) != NULL) {
+        while((e = kvtableNext(di)) != NULL) {
             // 取出键
-            sds keystr = dictGetKey(de);
+            sds keystr = kvtableGetKey(e);
             // 取出值
             robj key, 
-                 *o = dictGetVal(de);
-            long long expire;
-            
+                 *o = kvtableGetVal(e);
+
             initStaticStringObject(key,keystr);
-            // 取出过期时间
-            expire = getExpire(db,&key);
-            if (rdbSaveKeyValuePair(&rdb,&key,o,expire,now) == -1) goto werr;
+            // 过期时间保存在节点中
+            if (rdbSaveKeyValuePair(rdb,&key,o,kvtableGetExpire(e),now) == -1)
+                goto werr;
         }
-        dictReleaseIterator(di);
+        kvtableReleaseIterator(di);
     }
     di = NULL; /* So that we don't release it again on error. */
 
     /* EOF opcode */
-    if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
 
     /* CRC64 checksum. It will be zero if checksum computation is disabled, the
      * loading code skips the check in this case. */
-    cksum = rdb.cksum;
+    cksum = rdb->cksum;
     memrev64ifbe(&cksum);
-    rioWrite(&rdb,&cksum,8);
+    if (rioWrite(rdb,&cksum,8) == 0) goto werr;
+    return REDIS_OK;
+
+werr:
+    if (error) *error = errno;
+    if (di) kvtableReleaseIterator(di);
+    return REDIS_ERR;
+}
+
+/* This is just a wrapper to rdbSaveRio() that additionally adds a prefix
+ * and a suffix to the generated RDB dump. The prefix is:
+ *
+ * $EOF:<40 bytes unguessable hex string>\r\n
+ *
+ * While the suffix is the 40 bytes hex string we announced in the prefix.
+ * This way processes receiving the payload can understand when it ends
+ * without doing any processing of the content. */
+/*
+ * 以带有 EOF 标记的格式写入 RDB ，用于无盘复制：
+ * 由于事先并不知道 RDB 的长度，附属节点通过结尾的 40 字节随机标记判断传输结束。
+ */
+int rdbSaveRioWithEOFMark(rio *rdb, int *error) {
+    char eofmark[REDIS_EOF_MARK_SIZE];
+
+    getRandomHexChars(eofmark,REDIS_EOF_MARK_SIZE);
+    if (error) *error = 0;
+    if (rioWrite(rdb,"$EOF:",5) == 0) goto werr;
+    if (rioWrite(rdb,eofmark,REDIS_EOF_MARK_SIZE) == 0) goto werr;
+    if (rioWrite(rdb,"\r\n",2) == 0) goto werr;
+    if (rdbSaveRio(rdb,error) == REDIS_ERR) goto werr;
+    if (rioWrite(rdb,eofmark,REDIS_EOF_MARK_SIZE) == 0) goto werr;
+    return REDIS_OK;
+
+werr: /* Write error. */
+    /* Set 'error' only if not already set by rdbSaveRio() call. */
+    if (error && *error == 0) *error = errno;
+    return REDIS_ERR;
+}
+
+/* Save the DB on disk. Return REDIS_ERR on error, REDIS_OK on success */
+/*
+ * 将数据库保存到磁盘上。成功返回 REDIS_OK ，失败返回 REDIS_ERR 。
+ */
+int rdbSave(char *filename) {
+    char tmpfile[256];
+    FILE *fp;
+    rio rdb;
+    int error;
+
+    // 以 "temp-<pid>.rdb" 格式创建临时文件名
+    snprintf(tmpfile,256,"temp-%d.rdb", (int) getpid());
+    fp = fopen(tmpfile,"w");
+    if (!fp) {
+        redisLog(REDIS_WARNING, "Failed opening .rdb for saving: %s",
+            strerror(errno));
+        return REDIS_ERR;
+    }
+
+    // 初始化 rio 文件
+    rioInitWithFile(&rdb,fp);
+    if (rdbSaveRio(&rdb,&error) == REDIS_ERR) {
+        errno = error;
+        goto werr;
+    }
 
     /* Make sure data will not remain on the OS's output buffers */
-    fflush(fp);
-    fsync(fileno(fp));
-    fclose(fp);
+    if (fflush(fp) == EOF) goto werr;
+    if (fsync(fileno(fp)) == -1) goto werr;
+    if (fclose(fp) == EOF) goto werr;
 
     /* Use RENAME to make sure the DB file is changed atomically only
      * if the generate DB file is ok. */
@@ -860,10 +1057,9 @@ int rdbSave(char *filename) {
     return REDIS_OK;
 
 werr:
+    redisLog(REDIS_WARNING,"Write error saving DB on disk: %s", strerror(errno));
     fclose(fp);
     unlink(tmpfile);
-    redisLog(REDIS_WARNING,"Write error saving DB on disk: %s", strerror(errno));
-    if (di) dictReleaseIterator(di);
     return REDIS_ERR;
 }
 
@@ -922,6 +1118,7 @@ int rdbSaveBackground(char *filename) {
         server.rdb_save_time_start = time(NULL);
         // 记录子进程的 id
         server.rdb_child_pid = childpid;
+        server.rdb_child_type = REDIS_RDB_CHILD_TYPE_DISK;
         // 在执行时关闭对数据库的 rehash
         // 避免 copy-on-write
         updateDictResizePolicy();
@@ -939,6 +1136,285 @@ void rdbRemoveTempFile(pid_t childpid) {
     unlink(tmpfile);
 }
 
+/* Spawn an RDB child that writes the RDB to the sockets of the slaves
+ * that are currently in REDIS_REPL_WAIT_BGSAVE_START state. All the slaves
+ * share the same snapshot pass and nothing is written on disk.
+ *
+ * The child reports back to the parent, using a pipe, which slaves received
+ * the whole payload, see backgroundSaveDoneHandlerSocket(). */
+/*
+ * 创建一个子进程，将 RDB 直接写入到所有等待 BGSAVE 开始的附属节点的套接字中，
+ * 整个过程不会写入磁盘。
+ *
+ * 子进程通过管道告知父进程各个附属节点的传输结果。
+ */
+int rdbSaveToSlavesSockets(void) {
+    int *fds;
+    int numfds;
+    listNode *ln;
+    listIter li;
+    pid_t childpid;
+    long long start;
+    int pipefds[2];
+
+    if (server.rdb_child_pid != -1) return REDIS_ERR;
+
+    /* Before to fork, create a pipe that will be used in order to
+     * send back to the parent the IDs of the slaves that successfully
+     * received all the writes. */
+    if (pipe(pipefds) == -1) return REDIS_ERR;
+    server.rdb_pipe_read_result_from_child = pipefds[0];
+    server.rdb_pipe_write_result_to_child = pipefds[1];
+
+    /* Collect the file descriptors of the slaves we want to transfer
+     * the RDB to, which are in WAIT_BGSAVE_START state. */
+    // 收集所有等待 BGSAVE 开始的附属节点的套接字
+    fds = zmalloc(sizeof(int)*listLength(server.slaves));
+    numfds = 0;
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        redisClient *slave = ln->value;
+
+        if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) {
+            fds[numfds++] = slave->fd;
+            replicationSetupSlaveForFullResync(slave,
+                server.master_repl_offset);
+            /* Put the socket in blocking mode to simplify RDB transfer.
+             * We'll restore it when the child returns (since duped socket
+             * will share the O_NONBLOCK attribute with the parent). */
+            anetBlock(NULL,slave->fd);
+            anetSendTimeout(NULL,slave->fd,server.repl_timeout*1000);
+        }
+    }
+
+    /* Create the child process. */
+    start = ustime();
+    if ((childpid = fork()) == 0) {
+        /* Child */
+        int retval;
+        rio slave_sockets;
+
+        rioInitWithFdset(&slave_sockets,fds,numfds);
+        zfree(fds);
+
+        // 子进程不接收网络数据
+        if (server.ipfd > 0) close(server.ipfd);
+        if (server.sofd > 0) close(server.sofd);
+
+        retval = rdbSaveRioWithEOFMark(&slave_sockets,NULL);
+        if (retval == REDIS_OK && rioFlush(&slave_sockets) == 0)
+            retval = REDIS_ERR;
+
+        if (retval == REDIS_OK) {
+            size_t private_dirty = zmalloc_get_private_dirty();
+
+            if (private_dirty) {
+                redisLog(REDIS_NOTICE,
+                    "RDB: %lu MB of memory used by copy-on-write",
+                    private_dirty/(1024*1024));
+            }
+
+            /* If we are returning OK, at least one slave was served
+             * with the RDB file as expected, so we need to send a report
+             * to the parent via the pipe. The format of the message is:
+             *
+             * <len> <slave[0].fd> <slave[0].error> ...
+             *
+             * len, slave fds, and slave errors, are all uint64_t integers,
+             * so basically the reply is composed of 64 bits for the len field
+             * plus 2 additional 64 bit integers for each entry, for a total
+             * of 'len' entries.
+             *
+             * 'error' is set to 0 if the transfer to that slave terminated
+             * with a success, or to the errno of the failed write. */
+            void *msg = zmalloc(sizeof(uint64_t)*(1+2*numfds));
+            uint64_t *len = msg;
+            uint64_t *ids = len+1;
+            int j, msglen;
+
+            *len = numfds;
+            for (j = 0; j < numfds; j++) {
+                *ids++ = slave_sockets.io.fdset.fds[j];
+                *ids++ = slave_sockets.io.fdset.state[j];
+            }
+
+            /* Write the message to the parent. If we have no good slaves or
+             * we are unable to transfer the message to the parent, we exit
+             * with an error so that the parent will abort the replication
+             * process with all the slaves that were waiting. */
+            msglen = sizeof(uint64_t)*(1+2*numfds);
+            if (*len == 0 ||
+                write(server.rdb_pipe_write_result_to_child,msg,msglen)
+                != msglen)
+            {
+                retval = REDIS_ERR;
+            }
+            zfree(msg);
+        }
+        rioFreeFdset(&slave_sockets);
+        exitFromChild((retval == REDIS_OK) ? 0 : 1);
+    } else {
+        /* Parent */
+        server.stat_fork_time = ustime()-start;
+        zfree(fds);
+        if (childpid == -1) {
+            redisLog(REDIS_WARNING,"Can't save in background: fork: %s",
+                strerror(errno));
+            /* Undo the state change. The caller will perform cleanup on
+             * all the slaves in WAIT_BGSAVE_START state, but an early call
+             * to replicationSetupSlaveForFullResync() turned it into
+             * WAIT_BGSAVE_END. */
+            listRewind(server.slaves,&li);
+            while((ln = listNext(&li))) {
+                redisClient *slave = ln->value;
+
+                if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_END) {
+                    slave->replstate = REDIS_REPL_WAIT_BGSAVE_START;
+                    anetNonBlock(NULL,slave->fd);
+                    anetSendTimeout(NULL,slave->fd,0);
+                }
+            }
+            close(pipefds[0]);
+            close(pipefds[1]);
+            return REDIS_ERR;
+        }
+        redisLog(REDIS_NOTICE,"Background RDB transfer started by pid %d",
+            childpid);
+        server.rdb_save_time_start = time(NULL);
+        server.rdb_child_pid = childpid;
+        server.rdb_child_type = REDIS_RDB_CHILD_TYPE_SOCKET;
+        updateDictResizePolicy();
+        return REDIS_OK;
+    }
+    return REDIS_OK; /* unreached */
+}
+
+/* Load a stream ID saved by rdbSaveStreamID(). */
+static int rdbLoadStreamID(rio *rdb, streamID *id) {
+    robj *aux = rdbLoadStringObject(rdb);
+    int valid;
+
+    if (aux == NULL) return REDIS_ERR;
+    valid = sdslen(aux->ptr) == sizeof(streamID);
+    if (valid) streamDecodeID(aux->ptr,id);
+    decrRefCount(aux);
+    return valid ? REDIS_OK : REDIS_ERR;
+}
+
+/* Load a stream saved by rdbSaveObject(). The payload may come from
+ * RESTORE, so it is checked: NULL is returned if it is not consistent.
+ *
+ * 载入流对象。数据可能来自 RESTORE ，不一致时返回 NULL 。 */
+static robj *rdbLoadStreamObject(rio *rdb) {
+    robj *o = createStreamObject(), *aux;
+    stream *s = o->ptr;
+    uint32_t blocks, groups, pending, consumers, i, j;
+    streamIndexNode *node;
+    streamID id;
+
+    /* Listpack blocks. */
+    if ((blocks = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) goto err;
+    for (i = 0; i < blocks; i++) {
+        unsigned char *lp;
+        int64_t count;
+
+        if (rdbLoadStreamID(rdb,&id) == REDIS_ERR) goto err;
+        if ((aux = rdbLoadStringObject(rdb)) == NULL) goto err;
+        if (!streamValidateListpack(aux->ptr,sdslen(aux->ptr),&count)) {
+            decrRefCount(aux);
+            goto err;
+        }
+        lp = zmalloc(sdslen(aux->ptr));
+        memcpy(lp,aux->ptr,sdslen(aux->ptr));
+        decrRefCount(aux);
+        if (!streamIndexInsert(s->index,&id,lp)) {
+            lpFree(lp);
+            goto err;
+        }
+        s->length += count;
+    }
+    if (rdbLoadStreamID(rdb,&s->last_id) == REDIS_ERR) goto err;
+
+    /* Consumer groups. */
+    if ((groups = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) goto err;
+    for (i = 0; i < groups; i++) {
+        streamCG *cg;
+
+        if ((aux = rdbLoadStringObject(rdb)) == NULL) goto err;
+        if (rdbLoadStreamID(rdb,&id) == REDIS_ERR) {
+            decrRefCount(aux);
+            goto err;
+        }
+        cg = streamCreateCG(s,aux->ptr,sdslen(aux->ptr),&id);
+        decrRefCount(aux);
+        if (cg == NULL) goto err; /* Duplicated group name. */
+
+        /* The group PEL, NACKs are assigned to consumers later. */
+        if ((pending = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) goto err;
+        for (j = 0; j < pending; j++) {
+            streamNACK *nack;
+            long long delivery_time;
+            uint32_t delivery_count;
+
+            if (rdbLoadStreamID(rdb,&id) == REDIS_ERR) goto err;
+            if ((delivery_time = rdbLoadMillisecondTime(rdb)) == -1) goto err;
+            if ((delivery_count = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                goto err;
+            nack = streamCreateNACK(NULL);
+            nack->delivery_time = delivery_time;
+            nack->delivery_count = delivery_count;
+            if (!streamIndexInsert(cg->pel,&id,nack)) {
+                zfree(nack);
+                goto err;
+            }
+        }
+
+        /* Consumers and the IDs they own. */
+        if ((consumers = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) goto err;
+        for (j = 0; j < consumers; j++) {
+            streamConsumer *consumer;
+            long long seen_time;
+
+            if ((aux = rdbLoadStringObject(rdb)) == NULL) goto err;
+            if (streamLookupConsumer(cg,aux->ptr,0) != NULL) {
+                decrRefCount(aux);
+                goto err;
+            }
+            consumer = streamLookupConsumer(cg,aux->ptr,1);
+            decrRefCount(aux);
+            if ((seen_time = rdbLoadMillisecondTime(rdb)) == -1) goto err;
+            consumer->seen_time = seen_time;
+
+            if ((pending = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                goto err;
+            while(pending--) {
+                streamNACK *nack;
+
+                if (rdbLoadStreamID(rdb,&id) == REDIS_ERR) goto err;
+                node = streamIndexFind(cg->pel,&id);
+                if (node == NULL) goto err;
+                nack = node->value;
+                if (nack->consumer != NULL) goto err;
+                nack->consumer = consumer;
+                streamIndexInsert(consumer->pel,&id,nack);
+            }
+        }
+
+        /* Every pending entry must be owned by a consumer. */
+        for (node = streamIndexFirst(cg->pel); node;
+             node = streamIndexNext(node))
+        {
+            if (((streamNACK*)node->value)->consumer == NULL) goto err;
+        }
+    }
+    return o;
+
+err:
+    decrRefCount(o);
+    return NULL;
+}
+
 /* Load a Redis object of the specified type from the specified file.
  * On success a newly allocated object is returned, otherwise NULL. */
 /*
@@ -962,36 +1438,33 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Read list value */
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a real list when there are too many entries */
-        if (len > server.list_max_ziplist_entries) {
-            o = createListObject();
-        } else {
-            o = createZiplistObject();
-        }
+        // 逐个读入元素，并推入到 quicklist 中
+        o = createQuicklistObject();
 
         /* Load every single element of the list */
         while(len--) {
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
+            dec = getDecodedObject(ele);
+            quicklistPushTail(o->ptr,dec->ptr,sdslen(dec->ptr));
+            decrRefCount(dec);
+            decrRefCount(ele);
+        }
 
-            /* If we are using a ziplist and the value is too big, convert
-             * the object to a real list. */
-            // 这一段可以用以下两句来代替
-            // listTypePush(o, ele, REDIS_TAIL);
-            // decrRefCount(ele);
-            if (o->encoding == REDIS_ENCODING_ZIPLIST &&
-                ele->encoding == REDIS_ENCODING_RAW &&
-                sdslen(ele->ptr) > server.list_max_ziplist_value)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
-
-            if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-                dec = getDecodedObject(ele);
-                o->ptr = ziplistPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
-                decrRefCount(dec);
-                decrRefCount(ele);
-            } else {
-                ele = tryObjectEncoding(ele);
-                listAddNodeTail(o->ptr,ele);
-            }
+    // 读取并返回 quicklist 编码的列表对象
+    } else if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST) {
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        o = createQuicklistObject();
+
+        // 每个节点的 ziplist 都以一个字符串的形式保存
+        while (len--) {
+            robj *aux = rdbLoadStringObject(rdb);
+            unsigned char *zl;
+
+            if (aux == NULL) return NULL;
+            zl = zmalloc(sdslen(aux->ptr));
+            memcpy(zl,aux->ptr,sdslen(aux->ptr));
+            decrRefCount(aux);
+            quicklistAppendZiplist(o->ptr,zl);
         }
 
     // 读取并返回集合对象
@@ -1059,7 +1532,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             if (rdbLoadDoubleValue(rdb,&score) == -1) return NULL;
 
             /* Don't care about integer-encoded strings. */
-            if (ele->encoding == REDIS_ENCODING_RAW &&
+            if (sdsEncodedObject(ele) &&
                 sdslen(ele->ptr) > maxelelen)
                     maxelelen = sdslen(ele->ptr);
 
@@ -1071,7 +1544,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Convert *after* loading, since sorted sets are not stored ordered. */
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(o,REDIS_ENCODING_LISTPACK);
 
     // 载入哈希
     } else if (rdbtype == REDIS_RDB_TYPE_HASH) {
@@ -1087,22 +1560,22 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
 
-        /* Load every field and value into the ziplist */
-        while (o->encoding == REDIS_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        while (o->encoding == REDIS_ENCODING_LISTPACK && len > 0) {
             robj *field, *value;
 
             len--;
             /* Load raw strings */
             field = rdbLoadStringObject(rdb);
             if (field == NULL) return NULL;
-            redisAssert(field->encoding == REDIS_ENCODING_RAW);
+            redisAssert(sdsEncodedObject(field));
             value = rdbLoadStringObject(rdb);
             if (value == NULL) return NULL;
-            redisAssert(field->encoding == REDIS_ENCODING_RAW);
+            redisAssert(sdsEncodedObject(field));
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            o->ptr = lpAppend(o->ptr, field->ptr, sdslen(field->ptr));
+            o->ptr = lpAppend(o->ptr, value->ptr, sdslen(value->ptr));
             /* Convert to hash table if size threshold is exceeded */
             if (sdslen(field->ptr) > server.hash_max_ziplist_value ||
                 sdslen(value->ptr) > server.hash_max_ziplist_value)
@@ -1142,7 +1615,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_SET_INTSET   ||
                rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == REDIS_RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_HASH_LISTPACK)
     {
         robj *aux = rdbLoadStringObject(rdb);
 
@@ -1165,10 +1640,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         switch(rdbtype) {
             // 2.6 之后已经废弃
             case REDIS_RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *zl = lpNew();
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -1177,14 +1652,14 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        zl = lpAppend(zl, fstr, flen);
+                        zl = lpAppend(zl, vstr, vlen);
                     }
 
                     zfree(o->ptr);
                     o->ptr = zl;
                     o->type = REDIS_HASH;
-                    o->encoding = REDIS_ENCODING_ZIPLIST;
+                    o->encoding = REDIS_ENCODING_LISTPACK;
 
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
@@ -1194,10 +1669,12 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 }
                 break;
             case REDIS_RDB_TYPE_LIST_ZIPLIST:
+                // 将旧格式的 ziplist 列表拆分成 quicklist
                 o->type = REDIS_LIST;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (ziplistLen(o->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+                o->encoding = REDIS_ENCODING_QUICKLIST;
+                o->ptr = quicklistCreateFromZiplist(server.list_max_ziplist_size,
+                                                    server.list_compress_depth,
+                                                    o->ptr);
                 break;
             case REDIS_RDB_TYPE_SET_INTSET:
                 o->type = REDIS_SET;
@@ -1206,21 +1683,51 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     setTypeConvert(o,REDIS_ENCODING_HT);
                 break;
             case REDIS_RDB_TYPE_ZSET_ZIPLIST:
-                o->type = REDIS_ZSET;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (zsetLength(o) > server.zset_max_ziplist_entries)
-                    zsetConvert(o,REDIS_ENCODING_SKIPLIST);
-                break;
             case REDIS_RDB_TYPE_HASH_ZIPLIST:
-                o->type = REDIS_HASH;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (hashTypeLength(o) > server.hash_max_ziplist_entries)
-                    hashTypeConvert(o, REDIS_ENCODING_HT);
+                /* Ziplist blobs saved by older versions are converted
+                 * into listpacks, our current small encoding. */
+                // 将旧版本保存的 ziplist 转换为 listpack
+                {
+                    unsigned char *lp = lpFromZiplist(o->ptr);
+                    zfree(o->ptr);
+                    o->ptr = lp;
+                }
+                /* Fall through. */
+            case REDIS_RDB_TYPE_ZSET_LISTPACK:
+            case REDIS_RDB_TYPE_HASH_LISTPACK:
+                o->encoding = REDIS_ENCODING_LISTPACK;
+                if (rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
+                    rdbtype == REDIS_RDB_TYPE_ZSET_LISTPACK)
+                {
+                    o->type = REDIS_ZSET;
+                    if (zsetLength(o) > server.zset_max_ziplist_entries)
+                        zsetConvert(o,REDIS_ENCODING_SKIPLIST);
+                } else {
+                    o->type = REDIS_HASH;
+                    if (hashTypeLength(o) > server.hash_max_ziplist_entries)
+                        hashTypeConvert(o, REDIS_ENCODING_HT);
+                }
                 break;
             default:
                 redisPanic("Unknown encoding");
                 break;
         }
+    } else if (rdbtype == REDIS_RDB_TYPE_STRING_ROARING) {
+        robj *aux = rdbLoadStringObject(rdb);
+        roaring *r;
+
+        if (aux == NULL) return NULL;
+        r = roaringDeserialize(aux->ptr,sdslen(aux->ptr));
+        decrRefCount(aux);
+
+        /* The payload may come from RESTORE: a blob that is not a valid
+         * bitmap is handled like a read error. */
+        // 数据可能来自 RESTORE ，无效的位图按读取错误处理
+        if (r == NULL) return NULL;
+        o = createObject(REDIS_STRING,r);
+        o->encoding = REDIS_ENCODING_ROARING;
+    } else if (rdbtype == REDIS_RDB_TYPE_STREAM_LISTPACKS) {
+        o = rdbLoadStreamObject(rdb);
     } else {
         redisPanic("Unknown object type");
     }
@@ -1260,15 +1767,109 @@ void stopLoading(void) {
     server.loading = 0;
 }
 
+/* Load the next entry of the RDB stream 'rdb'. SELECTDB opcodes switch
+ * '*db' to the right element of the 'dbs' array, keys are added to '*db'.
+ *
+ * 从 rdb 中载入下一个项目：
+ * 如果是 SELECTDB 操作码，那么将 *db 指向 dbs 数组中的对应数据库，
+ * 如果是键值对，那么将它添加到 *db 中。
+ *
+ * Returns REDIS_RDB_ENTRY_OK if an opcode or a key was processed,
+ * REDIS_RDB_ENTRY_EOF when the EOF opcode is reached, and
+ * REDIS_RDB_ENTRY_ERR on short read or corrupted payload. */
+int rdbLoadEntry(rio *rdb, redisDb *dbs, redisDb **db, long long now) {
+    uint32_t dbid;
+    int type;
+    long long expiretime = -1;
+    robj *key, *val;
+
+    /* Read type. */
+    // 读入类型标识符
+    if ((type = rdbLoadType(rdb)) == -1) return REDIS_RDB_ENTRY_ERR;
+
+    // 接下来的值是一个过期时间
+    if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
+        // 读取毫秒计数的过期时间
+        if ((expiretime = rdbLoadTime(rdb)) == -1) return REDIS_RDB_ENTRY_ERR;
+        /* We read the time so we need to read the object type again. */
+        // 读取下一个值（一个字符串 key ）的类型标识符
+        if ((type = rdbLoadType(rdb)) == -1) return REDIS_RDB_ENTRY_ERR;
+        /* the EXPIRETIME opcode specifies time in seconds, so convert
+         * into milliesconds. */
+         // 将毫秒转换为秒
+        expiretime *= 1000;
+    } else if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
+        /* Milliseconds precision expire times introduced with RDB
+         * version 3. */
+        // 读取毫秒计数的过期时间
+        if ((expiretime = rdbLoadMillisecondTime(rdb)) == -1)
+            return REDIS_RDB_ENTRY_ERR;
+        /* We read the time so we need to read the object type again. */
+        // 读取下一个值（一个字符串 key ）的类型标识符
+        if ((type = rdbLoadType(rdb)) == -1) return REDIS_RDB_ENTRY_ERR;
+    }
+
+    // 到达 EOF
+    if (type == REDIS_RDB_OPCODE_EOF) return REDIS_RDB_ENTRY_EOF;
+
+    /* Handle SELECT DB opcode as a special case */
+    // 数据库号码标识符
+    if (type == REDIS_RDB_OPCODE_SELECTDB) {
+        // 读取数据库号
+        if ((dbid = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+            return REDIS_RDB_ENTRY_ERR;
+        // 检查数据库号是否合法
+        if (dbid >= (unsigned)server.dbnum) {
+            redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+            exit(1);
+        }
+        *db = dbs+dbid;
+        return REDIS_RDB_ENTRY_OK;
+    }
+
+    /* Read key */
+    // 读入 key
+    if ((key = rdbLoadStringObject(rdb)) == NULL) return REDIS_RDB_ENTRY_ERR;
+
+    /* Read value */
+    // 读入 value
+    if ((val = rdbLoadObject(type,rdb)) == NULL) {
+        decrRefCount(key);
+        return REDIS_RDB_ENTRY_ERR;
+    }
+
+    /* Check if the key already expired. This function is used when loading
+     * an RDB file from disk, either at startup, or when an RDB was
+     * received from the master. In the latter case, the master is
+     * responsible for key expiry. If we would expire keys here, the
+     * snapshot taken by the master may not be reflected on the slave. */
+    // 如果 key 已经过期，那么释放 key 和 value
+    if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
+        decrRefCount(key);
+        decrRefCount(val);
+        return REDIS_RDB_ENTRY_OK;
+    }
+
+    /* Add the new object in the hash table */
+    // 将对象添加到数据库
+    dbAdd(*db,key,val);
+
+    /* Set the expire time if needed */
+    // 如果有过期时间，设置过期时间
+    if (expiretime != -1) setExpire(*db,key,expiretime);
+
+    decrRefCount(key);
+    return REDIS_RDB_ENTRY_OK;
+}
+
 /*
  * 读取 rdb 文件，并将其中的对象保存到内存中
  */
 int rdbLoad(char *filename) {
-    uint32_t dbid;
-    int type, rdbver;
+    int retval, rdbver;
     redisDb *db = server.db+0;
     char buf[1024];
-    long long expiretime, now = mstime();
+    long long now = mstime();
     long loops = 0;
     FILE *fp;
     rio rdb;
@@ -1304,91 +1905,20 @@ int rdbLoad(char *filename) {
 
     startLoading(fp);
     while(1) {
-        robj *key, *val;
-        expiretime = -1;
-
         /* Serve the clients from time to time */
         // 间隔性服务客户端
         if (!(loops++ % 1000)) {
             // 刷新载入进程信息
             loadingProgress(rioTell(&rdb));
             // 处理事件
-            aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+            processEventsWhileBlocked();
         }
 
-        /* Read type. */
-        // 读入类型标识符
-        if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-
-        // 接下来的值是一个过期时间
-        if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
-            // 读取毫秒计数的过期时间
-            if ((expiretime = rdbLoadTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            // 读取下一个值（一个字符串 key ）的类型标识符
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-            /* the EXPIRETIME opcode specifies time in seconds, so convert
-             * into milliesconds. */
-             // 将毫秒转换为秒
-            expiretime *= 1000;
-        } else if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
-            /* Milliseconds precision expire times introduced with RDB
-             * version 3. */
-            // 读取毫秒计数的过期时间
-            if ((expiretime = rdbLoadMillisecondTime(&rdb)) == -1) goto eoferr;
-            /* We read the time so we need to read the object type again. */
-            // 读取下一个值（一个字符串 key ）的类型标识符
-            if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
-        }
-    
-        // 到达 EOF ，跳出
-        if (type == REDIS_RDB_OPCODE_EOF)
-            break;
-
-        /* Handle SELECT DB opcode as a special case */
-        // 数据库号码标识符
-        if (type == REDIS_RDB_OPCODE_SELECTDB) {
-            // 读取数据库号
-            if ((dbid = rdbLoadLen(&rdb,NULL)) == REDIS_RDB_LENERR)
-                goto eoferr;
-            // 检查数据库号是否合法
-            if (dbid >= (unsigned)server.dbnum) {
-                redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
-                exit(1);
-            }
-            db = server.db+dbid;
-            continue;
-        }
-
-        /* Read key */
-        // 读入 key
-        if ((key = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
-
-        /* Read value */
-        // 读入 value
-        if ((val = rdbLoadObject(type,&rdb)) == NULL) goto eoferr;
-
-        /* Check if the key already expired. This function is used when loading
-         * an RDB file from disk, either at startup, or when an RDB was
-         * received from the master. In the latter case, the master is
-         * responsible for key expiry. If we would expire keys here, the
-         * snapshot taken by the master may not be reflected on the slave. */
-        // 如果 key 已经过期，那么释放 key 和 value
-        if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
-            decrRefCount(key);
-            decrRefCount(val);
-            continue;
-        }
-
-        /* Add the new object in the hash table */
-        // 将对象添加到数据库
-        dbAdd(db,key,val);
-
-        /* Set the expire time if needed */
-        // 如果有过期时间，设置过期时间
-        if (expiretime != -1) setExpire(db,key,expiretime);
-
-        decrRefCount(key);
+        /* Read the next key (or opcode) and add it to the current DB. */
+        // 读入下一个键值对（或者操作码），并将它添加到当前数据库
+        retval = rdbLoadEntry(&rdb,server.db,&db,now);
+        if (retval == REDIS_RDB_ENTRY_ERR) goto eoferr;
+        if (retval == REDIS_RDB_ENTRY_EOF) break;
     }
 
     /* Verify the checksum if RDB version is >= 5 */
@@ -1416,11 +1946,167 @@ eoferr: /* unexpected end of file is handled here with a fatal exit */
     return REDIS_ERR; /* Just to avoid warning */
 }
 
-/* A background saving child (BGSAVE) terminated its work. Handle this. */
+/* -----------------------------------------------------------------------------
+ * Asynchronous loading
+ *
+ * A slave receiving a full resynchronization can load the RDB payload into
+ * a fresh set of databases a few keys at a time from the event loop, while
+ * clients keep reading the old data set. Once the whole payload is loaded
+ * the two data sets are swapped with rdbAsyncLoadSwap().
+ *
+ * 异步载入：
+ * 附属节点在进行完整重同步时，可以在事件循环中分多次将 RDB 载入到一组新的数据库中，
+ * 与此同时，客户端仍然可以读取旧的数据集。
+ * 载入完成之后，通过 rdbAsyncLoadSwap() 以原子方式替换新旧两个数据集。
+ * -------------------------------------------------------------------------- */
+
+static struct {
+    FILE *fp;       /* RDB file being loaded. */
+    rio rdb;        /* Rio stream wrapping 'fp'. */
+    int rdbver;     /* RDB version from the header. */
+    redisDb *dbs;   /* Databases being populated (server.dbnum elements). */
+    redisDb *db;    /* DB currently selected by the payload. */
+} asyncLoad;
+
+/* Release the databases array 'dbs' created by rdbAsyncLoadStart().
+ * The dicts are freed by the lazyfree thread if slave-lazy-flush is set. */
+static void rdbAsyncLoadFreeDbs(redisDb *dbs) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        if (server.repl_slave_lazy_flush)
+            lazyfreeFreeKeyspaceAsync(dbs[j].keyspace);
+        else
+            kvtableRelease(dbs[j].keyspace);
+    }
+    zfree(dbs);
+}
+
+/* Open the RDB file and prepare the empty databases to populate.
+ * Returns REDIS_ERR if the file can't be opened or has a bad header. */
+int rdbAsyncLoadStart(char *filename) {
+    char buf[10];
+    struct stat sb;
+    int j;
+
+    redisAssert(!server.async_loading);
+    if ((asyncLoad.fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
+    rioInitWithFile(&asyncLoad.rdb,asyncLoad.fp);
+    if (server.rdb_checksum)
+        asyncLoad.rdb.update_cksum = rioGenericUpdateChecksum;
+
+    // 检查 rdb 文件头
+    if (rioRead(&asyncLoad.rdb,buf,9) == 0) goto werr;
+    buf[9] = '\0';
+    if (memcmp(buf,"REDIS",5) != 0) {
+        redisLog(REDIS_WARNING,"Wrong signature trying to load DB from file");
+        goto werr;
+    }
+    asyncLoad.rdbver = atoi(buf+5);
+    if (asyncLoad.rdbver < 1 || asyncLoad.rdbver > REDIS_RDB_VERSION) {
+        redisLog(REDIS_WARNING,"Can't handle RDB format version %d",
+            asyncLoad.rdbver);
+        goto werr;
+    }
+
+    // 创建用于载入数据的空白数据库
+    asyncLoad.dbs = zmalloc(sizeof(redisDb)*server.dbnum);
+    for (j = 0; j < server.dbnum; j++) {
+        asyncLoad.dbs[j].keyspace = kvtableCreate(&dbKvtableType);
+        asyncLoad.dbs[j].blocking_keys = NULL;
+        asyncLoad.dbs[j].ready_keys = NULL;
+        asyncLoad.dbs[j].watched_keys = NULL;
+        asyncLoad.dbs[j].id = j;
+    }
+    asyncLoad.db = asyncLoad.dbs;
+
+    server.async_loading = 1;
+    server.loading_start_time = time(NULL);
+    if (fstat(fileno(asyncLoad.fp),&sb) == -1)
+        server.loading_total_bytes = 1; /* just to avoid division by zero */
+    else
+        server.loading_total_bytes = sb.st_size;
+    server.loading_loaded_bytes = 0;
+    return REDIS_OK;
+
+werr:
+    fclose(asyncLoad.fp);
+    return REDIS_ERR;
+}
+
+/* Load keys for at most 'usec' microseconds.
+ *
+ * 在 usec 微秒之内尽可能多地载入键。
+ *
+ * Returns REDIS_RDB_ENTRY_OK if there is more to load, REDIS_RDB_ENTRY_EOF
+ * if the payload was loaded completely and the checksum (if any) matches,
+ * and REDIS_RDB_ENTRY_ERR on short read or corrupted payload. */
+int rdbAsyncLoadStep(long long usec) {
+    long long start = ustime(), now = start/1000;
+    long loops = 0;
+    int retval;
+
+    redisAssert(server.async_loading);
+    while(1) {
+        retval = rdbLoadEntry(&asyncLoad.rdb,asyncLoad.dbs,&asyncLoad.db,now);
+        if (retval != REDIS_RDB_ENTRY_OK) break;
+        /* Checking the time is costly, do it every 16 entries. */
+        if ((++loops & 15) == 0 && ustime()-start > usec) break;
+    }
+    loadingProgress(rioTell(&asyncLoad.rdb));
+    if (retval != REDIS_RDB_ENTRY_EOF) return retval;
+
+    /* Verify the checksum if RDB version is >= 5 */
+    // 检查校验和
+    if (asyncLoad.rdbver >= 5 && server.rdb_checksum) {
+        uint64_t cksum, expected = asyncLoad.rdb.cksum;
+
+        if (rioRead(&asyncLoad.rdb,&cksum,8) == 0) return REDIS_RDB_ENTRY_ERR;
+        memrev64ifbe(&cksum);
+        if (cksum == 0) {
+            redisLog(REDIS_WARNING,"RDB file was saved with checksum disabled: no check performed.");
+        } else if (cksum != expected) {
+            redisLog(REDIS_WARNING,"Wrong RDB checksum loading the DB asynchronously.");
+            return REDIS_RDB_ENTRY_ERR;
+        }
+    }
+    return REDIS_RDB_ENTRY_EOF;
+}
+
+/* Replace the served data set with the one just loaded, and release the
+ * old one. Clients never see a partially loaded data set. */
+void rdbAsyncLoadSwap(void) {
+    int j;
+
+    redisAssert(server.async_loading);
+    /* WATCHed keys are invalidated as if the old data set was flushed. */
+    signalFlushedDb(-1);
+    for (j = 0; j < server.dbnum; j++) {
+        kvtable *t = server.db[j].keyspace;
+
+        server.db[j].keyspace = asyncLoad.dbs[j].keyspace;
+        asyncLoad.dbs[j].keyspace = t;
+    }
+    rdbAsyncLoadFreeDbs(asyncLoad.dbs);
+    fclose(asyncLoad.fp);
+    server.async_loading = 0;
+}
+
+/* Abort an asynchronous load in progress, discarding what was loaded so
+ * far. The served data set is not touched. */
+void rdbAsyncLoadAbort(void) {
+    redisAssert(server.async_loading);
+    rdbAsyncLoadFreeDbs(asyncLoad.dbs);
+    fclose(asyncLoad.fp);
+    server.async_loading = 0;
+}
+
+/* A background saving child (BGSAVE) terminated its work. Handle this.
+ * This function covers the case of actual BGSAVEs. */
 /*
  * 根据 BGSAVE 子进程的返回值，对服务器状态进行更新
  */
-void backgroundSaveDoneHandler(int exitcode, int bysignal) {
+void backgroundSaveDoneHandlerDisk(int exitcode, int bysignal) {
     // 保存成功
     if (!bysignal && exitcode == 0) {
         redisLog(REDIS_NOTICE,
@@ -1442,13 +2128,130 @@ void backgroundSaveDoneHandler(int exitcode, int bysignal) {
 
     // 更新服务器状态
     server.rdb_child_pid = -1;
+    server.rdb_child_type = REDIS_RDB_CHILD_TYPE_NONE;
     server.rdb_save_time_last = time(NULL)-server.rdb_save_time_start;
     server.rdb_save_time_start = -1;
 
     /* Possibly there are slaves waiting for a BGSAVE in order to be served
      * (the first stage of SYNC is a bulk transfer of dump.rdb) */
     // 将 rdb 文件保存完毕的消息报告可能正在等待复制的附属节点
-    updateSlavesWaitingBgsave(exitcode == 0 ? REDIS_OK : REDIS_ERR);
+    updateSlavesWaitingBgsave((!bysignal && exitcode == 0) ? REDIS_OK : REDIS_ERR,
+        REDIS_RDB_CHILD_TYPE_DISK);
+}
+
+/* A background saving child (BGSAVE) terminated its work. Handle this.
+ * This function covers the case of RDB -> Salves socket transfers for
+ * diskless replication. */
+/*
+ * 处理无盘复制子进程的退出：
+ * 读取子进程通过管道发回的传输结果，释放传输失败的附属节点。
+ */
+void backgroundSaveDoneHandlerSocket(int exitcode, int bysignal) {
+    uint64_t *ok_slaves;
+
+    if (!bysignal && exitcode == 0) {
+        redisLog(REDIS_NOTICE,
+            "Background RDB transfer terminated with success");
+    } else if (!bysignal && exitcode != 0) {
+        redisLog(REDIS_WARNING, "Background transfer error");
+    } else {
+        redisLog(REDIS_WARNING,
+            "Background transfer terminated by signal %d", bysignal);
+    }
+    server.rdb_child_pid = -1;
+    server.rdb_child_type = REDIS_RDB_CHILD_TYPE_NONE;
+    server.rdb_save_time_start = -1;
+
+    /* If the child returns an OK exit code, read the set of slave fds
+     * and the associated status code. We'll terminate all the slaves
+     * in error state.
+     *
+     * If the process returned an error, consider the list of slaves that
+     * can continue to be emtpy, so that it's just a special case of the
+     * normal code path. */
+    ok_slaves = zmalloc(sizeof(uint64_t)); /* Make space for the count. */
+    ok_slaves[0] = 0;
+    if (!bysignal && exitcode == 0) {
+        int readlen = sizeof(uint64_t);
+
+        if (read(server.rdb_pipe_read_result_from_child, ok_slaves, readlen) ==
+                 readlen)
+        {
+            readlen = ok_slaves[0]*sizeof(uint64_t)*2;
+
+            /* Make space for enough elements as specified by the first
+             * uint64_t element in the array. */
+            ok_slaves = zrealloc(ok_slaves,sizeof(uint64_t)+readlen);
+            if (readlen &&
+                read(server.rdb_pipe_read_result_from_child, ok_slaves+1,
+                     readlen) != readlen)
+            {
+                ok_slaves[0] = 0;
+            }
+        }
+    }
+
+    close(server.rdb_pipe_read_result_from_child);
+    close(server.rdb_pipe_write_result_to_child);
+
+    /* We can continue the replication process with all the slaves that
+     * correctly received the full payload. Others are terminated. */
+    listNode *ln;
+    listIter li;
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        redisClient *slave = ln->value;
+
+        if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_END) {
+            uint64_t j;
+            int errorcode = 0;
+
+            /* Search for the slave in the reply. In order for a slave to
+             * continue the replication process, we need to find it in the
+             * list, and it must have an error code set to 0 (which means
+             * success). */
+            for (j = 0; j < ok_slaves[0]; j++) {
+                if ((uint64_t)slave->fd == ok_slaves[2*j+1]) {
+                    errorcode = ok_slaves[2*j+2];
+                    break; /* Found in slaves list. */
+                }
+            }
+            if (j == ok_slaves[0] || errorcode != 0) {
+                redisLog(REDIS_WARNING,
+                "Closing slave: child->slave RDB transfer failed: %s",
+                    (errorcode == 0) ? "RDB transfer child aborted"
+                                     : strerror(errorcode));
+                freeClient(slave);
+            } else {
+                /* Restore the socket as non-blocking. */
+                anetNonBlock(NULL,slave->fd);
+                anetSendTimeout(NULL,slave->fd,0);
+            }
+        }
+    }
+    zfree(ok_slaves);
+
+    updateSlavesWaitingBgsave((!bysignal && exitcode == 0) ? REDIS_OK : REDIS_ERR,
+        REDIS_RDB_CHILD_TYPE_SOCKET);
+}
+
+/* When a background RDB saving/transfer terminates, call the right handler. */
+/*
+ * 根据子进程的类型，调用对应的处理函数
+ */
+void backgroundSaveDoneHandler(int exitcode, int bysignal) {
+    switch(server.rdb_child_type) {
+    case REDIS_RDB_CHILD_TYPE_DISK:
+        backgroundSaveDoneHandlerDisk(exitcode,bysignal);
+        break;
+    case REDIS_RDB_CHILD_TYPE_SOCKET:
+        backgroundSaveDoneHandlerSocket(exitcode,bysignal);
+        break;
+    default:
+        redisPanic("Unknown RDB child type.");
+        break;
+    }
 }
 
 /*
@@ -41,7 +41,7 @@
 /*
  * RDB 的版本，当新版本不向就版本兼容时，增一
  */
-#define REDIS_RDB_VERSION 6
+#define REDIS_RDB_VERSION 10
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -100,12 +100,22 @@
 #define REDIS_RDB_TYPE_SET_INTSET    11
 #define REDIS_RDB_TYPE_ZSET_ZIPLIST  12
 #define REDIS_RDB_TYPE_HASH_ZIPLIST  13
+#define REDIS_RDB_TYPE_LIST_QUICKLIST 14
+#define REDIS_RDB_TYPE_HASH_LISTPACK 15
+#define REDIS_RDB_TYPE_ZSET_LISTPACK 16
+#define REDIS_RDB_TYPE_STRING_ROARING 17
+#define REDIS_RDB_TYPE_STREAM_LISTPACKS 18
 
 /* Test if a type is an object type. */
 /*
  * 检查给定类型是否对象
  */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 13))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 4) || (t >= 9 && t <= 18))
+
+/* Return values of rdbLoadEntry() and rdbAsyncLoadStep(). */
+#define REDIS_RDB_ENTRY_OK 0    /* An opcode or a key was loaded. */
+#define REDIS_RDB_ENTRY_EOF 1   /* The EOF opcode was reached. */
+#define REDIS_RDB_ENTRY_ERR -1  /* Short read or corrupted payload. */
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
 /*
@@ -125,9 +135,17 @@ uint32_t rdbLoadLen(rio *rdb, int *isencoded);
 int rdbSaveObjectType(rio *rdb, robj *o);
 int rdbLoadObjectType(rio *rdb);
 int rdbLoad(char *filename);
+int rdbLoadEntry(rio *rdb, redisDb *dbs, redisDb **db, long long now);
+int rdbAsyncLoadStart(char *filename);
+int rdbAsyncLoadStep(long long usec);
+void rdbAsyncLoadSwap(void);
+void rdbAsyncLoadAbort(void);
 int rdbSaveBackground(char *filename);
 void rdbRemoveTempFile(pid_t childpid);
 int rdbSave(char *filename);
+int rdbSaveRio(rio *rdb, int *error);
+int rdbSaveRioWithEOFMark(rio *rdb, int *error);
+int rdbSaveToSlavesSockets(void);
 int rdbSaveObject(rio *rdb, robj *o);
 off_t rdbSavedObjectLen(robj *o);
 off_t rdbSavedObjectPages(robj *o);
@@ -53,6 +53,11 @@
 #define REDIS_SET_INTSET 11
 #define REDIS_ZSET_ZIPLIST 12
 #define REDIS_HASH_ZIPLIST 13
+#define REDIS_LIST_QUICKLIST 14
+#define REDIS_HASH_LISTPACK 15
+#define REDIS_ZSET_LISTPACK 16
+#define REDIS_STRING_ROARING 17
+#define REDIS_STREAM_LISTPACKS 18
 
 /* Objects encoding. Some kind of objects like Strings and Hashes can be
  * internally represented in multiple ways. The 'encoding' field of the object
@@ -146,7 +151,7 @@ int checkType(unsigned char t) {
     /* In case a new object type is added, update the following 
      * condition as necessary. */
     return
-        (t >= REDIS_HASH_ZIPMAP && t <= REDIS_HASH_ZIPLIST) ||
+        (t >= REDIS_HASH_ZIPMAP && t <= REDIS_STREAM_LISTPACKS) ||
         t <= REDIS_HASH ||
         t >= REDIS_EXPIRETIME_MS;
 }
@@ -180,7 +185,7 @@ int processHeader() {
     }
 
     dump_version = (int)strtol(buf + 5, NULL, 10);
-    if (dump_version < 1 || dump_version > 6) {
+    if (dump_version < 1 || dump_version > 10) {
         ERROR("Unknown RDB format version: %d\n", dump_version);
     }
     return dump_version;
@@ -383,6 +388,75 @@ double* loadDoubleValue() {
     }
 }
 
+/* Streams are saved as: number of blocks, [master ID, listpack]..., last
+ * ID, number of groups, and for every group its name, last ID, PEL with
+ * delivery time and count, and the consumers with their PEL IDs. */
+int processStreamObject() {
+    uint32_t offset = CURR_OFFSET;
+    uint32_t blocks, groups, pending, consumers, i, j, k;
+
+    if ((blocks = loadLength(NULL)) == REDIS_RDB_LENERR) {
+        SHIFT_ERROR(offset, "Error reading stream blocks count");
+        return 0;
+    }
+    for (i = 0; i < blocks*2; i++) {
+        offset = CURR_OFFSET;
+        if (!processStringObject(NULL)) {
+            SHIFT_ERROR(offset, "Error reading stream block %d", i/2);
+            return 0;
+        }
+    }
+    offset = CURR_OFFSET;
+    if (!processStringObject(NULL) ||
+        (groups = loadLength(NULL)) == REDIS_RDB_LENERR)
+    {
+        SHIFT_ERROR(offset, "Error reading stream last ID or groups count");
+        return 0;
+    }
+    for (i = 0; i < groups; i++) {
+        offset = CURR_OFFSET;
+        if (!processStringObject(NULL) || !processStringObject(NULL) ||
+            (pending = loadLength(NULL)) == REDIS_RDB_LENERR)
+        {
+            SHIFT_ERROR(offset, "Error reading consumer group %d", i);
+            return 0;
+        }
+        for (j = 0; j < pending; j++) {
+            offset = CURR_OFFSET;
+            if (!processStringObject(NULL) ||
+                !processTime(REDIS_EXPIRETIME_MS) ||
+                loadLength(NULL) == REDIS_RDB_LENERR)
+            {
+                SHIFT_ERROR(offset, "Error reading pending entry %d of group %d", j, i);
+                return 0;
+            }
+        }
+        offset = CURR_OFFSET;
+        if ((consumers = loadLength(NULL)) == REDIS_RDB_LENERR) {
+            SHIFT_ERROR(offset, "Error reading consumers count of group %d", i);
+            return 0;
+        }
+        for (j = 0; j < consumers; j++) {
+            offset = CURR_OFFSET;
+            if (!processStringObject(NULL) ||
+                !processTime(REDIS_EXPIRETIME_MS) ||
+                (pending = loadLength(NULL)) == REDIS_RDB_LENERR)
+            {
+                SHIFT_ERROR(offset, "Error reading consumer %d of group %d", j, i);
+                return 0;
+            }
+            for (k = 0; k < pending; k++) {
+                offset = CURR_OFFSET;
+                if (!processStringObject(NULL)) {
+                    SHIFT_ERROR(offset, "Error reading pending ID %d of consumer %d", k, j);
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
 int processDoubleValue(double** store) {
     unsigned long offset = CURR_OFFSET;
     double *val = loadDoubleValue();
@@ -415,6 +489,7 @@ int loadPair(entry *e) {
 
     uint32_t length = 0;
     if (e->type == REDIS_LIST ||
+        e->type == REDIS_LIST_QUICKLIST ||
         e->type == REDIS_SET  ||
         e->type == REDIS_ZSET ||
         e->type == REDIS_HASH) {
@@ -431,12 +506,16 @@ int loadPair(entry *e) {
     case REDIS_SET_INTSET:
     case REDIS_ZSET_ZIPLIST:
     case REDIS_HASH_ZIPLIST:
+    case REDIS_HASH_LISTPACK:
+    case REDIS_ZSET_LISTPACK:
+    case REDIS_STRING_ROARING:
         if (!processStringObject(NULL)) {
             SHIFT_ERROR(offset, "Error reading entry value");
             return 0;
         }
     break;
     case REDIS_LIST:
+    case REDIS_LIST_QUICKLIST:
     case REDIS_SET:
         for (i = 0; i < length; i++) {
             offset = CURR_OFFSET;
@@ -474,6 +553,9 @@ int loadPair(entry *e) {
             }
         }
     break;
+    case REDIS_STREAM_LISTPACKS:
+        if (!processStreamObject()) return 0;
+    break;
     default:
         SHIFT_ERROR(offset, "Type not implemented");
         return 0;
@@ -748,6 +830,7 @@ int main(int argc, char **argv) {
     sprintf(types[REDIS_SET], "SET");
     sprintf(types[REDIS_ZSET], "ZSET");
     sprintf(types[REDIS_HASH], "HASH");
+    sprintf(types[REDIS_STREAM_LISTPACKS], "STREAM");
 
     /* Object types only used for dumping to disk */
     sprintf(types[REDIS_EXPIRETIME], "EXPIRETIME");
@@ -171,6 +171,7 @@ struct redisCommand redisCommandTable[] = {
     {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0},
     {"strlen",strlenCommand,2,"r",0,NULL,1,1,1,0,0},
     {"del",delCommand,-2,"w",0,noPreloadGetKeys,1,-1,1,0,0},
+    {"unlink",unlinkCommand,-2,"w",0,noPreloadGetKeys,1,-1,1,0,0},
     {"exists",existsCommand,2,"r",0,NULL,1,1,1,0,0},
     {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0},
     {"getbit",getbitCommand,3,"r",0,NULL,1,1,1,0,0},
@@ -204,6 +205,7 @@ struct redisCommand redisCommandTable[] = {
     {"scard",scardCommand,2,"r",0,NULL,1,1,1,0,0},
     {"spop",spopCommand,2,"wRs",0,NULL,1,1,1,0,0},
     {"srandmember",srandmemberCommand,-2,"rR",0,NULL,1,1,1,0,0},
+    {"sscan",sscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
     {"sinter",sinterCommand,-2,"rS",0,NULL,1,-1,1,0,0},
     {"sinterstore",sinterstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
     {"sunion",sunionCommand,-2,"rS",0,NULL,1,-1,1,0,0},
@@ -219,9 +221,14 @@ struct redisCommand redisCommandTable[] = {
     {"zunionstore",zunionstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
     {"zinterstore",zinterstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
     {"zrange",zrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
+    {"zscan",zscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
     {"zrangebyscore",zrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
     {"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
     {"zcount",zcountCommand,4,"r",0,NULL,1,1,1,0,0},
+    {"zremrangebylex",zremrangebylexCommand,4,"w",0,NULL,1,1,1,0,0},
+    {"zrangebylex",zrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0},
+    {"zrevrangebylex",zrevrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0},
+    {"zlexcount",zlexcountCommand,4,"r",0,NULL,1,1,1,0,0},
     {"zrevrange",zrevrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
     {"zcard",zcardCommand,2,"r",0,NULL,1,1,1,0,0},
     {"zscore",zscoreCommand,3,"r",0,NULL,1,1,1,0,0},
@@ -239,6 +246,7 @@ struct redisCommand redisCommandTable[] = {
     {"hkeys",hkeysCommand,2,"rS",0,NULL,1,1,1,0,0},
     {"hvals",hvalsCommand,2,"rS",0,NULL,1,1,1,0,0},
     {"hgetall",hgetallCommand,2,"r",0,NULL,1,1,1,0,0},
+    {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
     {"hexists",hexistsCommand,3,"r",0,NULL,1,1,1,0,0},
     {"incrby",incrbyCommand,3,"wm",0,NULL,1,1,1,0,0},
     {"decrby",decrbyCommand,3,"wm",0,NULL,1,1,1,0,0},
@@ -256,6 +264,7 @@ struct redisCommand redisCommandTable[] = {
     {"pexpire",pexpireCommand,3,"w",0,NULL,1,1,1,0,0},
     {"pexpireat",pexpireatCommand,3,"w",0,NULL,1,1,1,0,0},
     {"keys",keysCommand,2,"rS",0,NULL,0,0,0,0,0},
+    {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0},
     {"dbsize",dbsizeCommand,1,"r",0,NULL,0,0,0,0,0},
     {"auth",authCommand,2,"rs",0,NULL,0,0,0,0,0},
     {"ping",pingCommand,1,"r",0,NULL,0,0,0,0,0},
@@ -270,9 +279,10 @@ struct redisCommand redisCommandTable[] = {
     {"exec",execCommand,1,"sM",0,NULL,0,0,0,0,0},
     {"discard",discardCommand,1,"rs",0,NULL,0,0,0,0,0},
     {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
-    {"replconf",replconfCommand,-1,"ars",0,NULL,0,0,0,0,0},
-    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0},
+    {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
+    {"replconf",replconfCommand,-1,"arslt",0,NULL,0,0,0,0,0},
+    {"flushdb",flushdbCommand,-1,"w",0,NULL,0,0,0,0,0},
+    {"flushall",flushallCommand,-1,"w",0,NULL,0,0,0,0,0},
     {"sort",sortCommand,-2,"wm",0,NULL,1,1,1,0,0},
     {"info",infoCommand,-1,"rlt",0,NULL,0,0,0,0,0},
     {"monitor",monitorCommand,1,"ars",0,NULL,0,0,0,0,0},
@@ -302,7 +312,33 @@ struct redisCommand redisCommandTable[] = {
     {"script",scriptCommand,-2,"ras",0,NULL,0,0,0,0,0},
     {"time",timeCommand,1,"rR",0,NULL,0,0,0,0,0},
     {"bitop",bitopCommand,-4,"wm",0,NULL,2,-1,1,0,0},
-    {"bitcount",bitcountCommand,-2,"r",0,NULL,1,1,1,0,0}
+    {"bitcount",bitcountCommand,-2,"r",0,NULL,1,1,1,0,0},
+    {"bitpos",bitposCommand,-3,"r",0,NULL,1,1,1,0,0},
+    {"pfselftest",pfselftestCommand,1,"r",0,NULL,0,0,0,0,0},
+    {"pfadd",pfaddCommand,-2,"wm",0,NULL,1,1,1,0,0},
+    {"pfcount",pfcountCommand,-2,"w",0,NULL,1,-1,1,0,0},
+    {"pfmerge",pfmergeCommand,-2,"wm",0,NULL,1,-1,1,0,0},
+    {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0},
+    {"geoadd",geoaddCommand,-5,"wm",0,NULL,1,1,1,0,0},
+    {"georadius",georadiusCommand,-6,"r",0,NULL,1,1,1,0,0},
+    {"georadiusbymember",georadiusByMemberCommand,-5,"r",0,NULL,1,1,1,0,0},
+    {"geohash",geohashCommand,-2,"r",0,NULL,1,1,1,0,0},
+    {"geopos",geoposCommand,-2,"r",0,NULL,1,1,1,0,0},
+    {"geodist",geodistCommand,-4,"r",0,NULL,1,1,1,0,0},
+    {"xadd",xaddCommand,-5,"wmR",0,NULL,1,1,1,0,0},
+    {"xrange",xrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
+    {"xrevrange",xrevrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
+    {"xlen",xlenCommand,2,"r",0,NULL,1,1,1,0,0},
+    {"xdel",xdelCommand,-3,"w",0,NULL,1,1,1,0,0},
+    {"xtrim",xtrimCommand,-2,"w",0,NULL,1,1,1,0,0},
+    {"xsetid",xsetidCommand,3,"wm",0,NULL,1,1,1,0,0},
+    {"xread",xreadCommand,-4,"rs",0,xreadGetKeys,0,0,0,0,0},
+    {"xreadgroup",xreadCommand,-7,"wms",0,xreadGetKeys,0,0,0,0,0},
+    {"xgroup",xgroupCommand,-2,"wm",0,NULL,2,2,1,0,0},
+    {"xack",xackCommand,-4,"w",0,NULL,1,1,1,0,0},
+    {"xpending",xpendingCommand,-3,"r",0,NULL,1,1,1,0,0},
+    {"xclaim",xclaimCommand,-6,"w",0,NULL,1,1,1,0,0},
+    {"xinfo",xinfoCommand,-2,"r",0,NULL,2,2,1,0,0}
 };
 
 /*============================ Utility functions ============================ */
@@ -513,7 +549,7 @@ int dictEncObjKeyCompare(void *privdata, const void *key1,
 unsigned int dictEncObjHash(const void *key) {
     robj *o = (robj*) key;
 
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         return dictGenHashFunction(o->ptr, sdslen((sds)o->ptr));
     } else {
         if (o->encoding == REDIS_ENCODING_INT) {
@@ -553,11 +589,31 @@ dictType zsetDictType = {
     NULL                       /* val destructor */
 };
 
-/* Db->dict, keys are sds strings, vals are Redis objects. */
-dictType dbDictType = {
+/* Keys blocked on by a client (bpop.keys): Redis objects as keys, and for
+ * XREAD heap allocated stream IDs as values. */
+dictType objectKeyPointerValueDictType = {
+    dictEncObjHash,            /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictEncObjKeyCompare,      /* key compare */
+    dictRedisObjectDestructor, /* key destructor */
+    dictVanillaFree            /* val destructor */
+};
+
+/* Stream consumer groups and consumers by name. The keys are sds strings,
+ * the values are owned and released by the stream code. */
+dictType streamNamesDictType = {
+    dictSdsHash,               /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCompare,         /* key compare */
+    dictSdsDestructor,         /* key destructor */
+    NULL                       /* val destructor */
+};
+
+/* Db->keyspace, keys are sds strings, vals are Redis objects. */
+kvtableType dbKvtableType = {
     dictSdsHash,                /* hash function */
-    NULL,                       /* key dup */
-    NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
     dictRedisObjectDestructor   /* val destructor */
@@ -573,16 +629,6 @@ dictType shaScriptObjectDictType = {
     dictRedisObjectDestructor   /* val destructor */
 };
 
-/* Db->expires */
-dictType keyptrDictType = {
-    dictSdsHash,               /* hash function */
-    NULL,                      /* key dup */
-    NULL,                      /* val dup */
-    dictSdsKeyCompare,         /* key compare */
-    NULL,                      /* key destructor */
-    NULL                       /* val destructor */
-};
-
 /* Command table. sds string -> command struct pointer. */
 dictType commandTableDictType = {
     dictSdsCaseHash,           /* hash function */
@@ -671,13 +717,9 @@ void tryResizeHashTables(void) {
 
     for (j = 0; j < server.dbnum; j++) {
 
-        // 缩小键空间字典
-        if (htNeedsResize(server.db[j].dict))
-            dictResize(server.db[j].dict);
-
-        // 缩小过期时间字典
-        if (htNeedsResize(server.db[j].expires))
-            dictResize(server.db[j].expires);
+        // 缩小键空间表
+        if (kvtableNeedsResize(server.db[j].keyspace,REDIS_HT_MINFILL))
+            kvtableResize(server.db[j].keyspace);
     }
 }
 
@@ -693,14 +735,9 @@ void incrementallyRehash(void) {
     int j;
 
     for (j = 0; j < server.dbnum; j++) {
-        /* Keys dictionary */
-        if (dictIsRehashing(server.db[j].dict)) {
-            dictRehashMilliseconds(server.db[j].dict,1);
-            break; /* already used our millisecond for this loop... */
-        }
-        /* Expires */
-        if (dictIsRehashing(server.db[j].expires)) {
-            dictRehashMilliseconds(server.db[j].expires,1);
+        /* Keyspace table */
+        if (kvtableIsRehashing(server.db[j].keyspace)) {
+            kvtableRehashMilliseconds(server.db[j].keyspace,1);
             break; /* already used our millisecond for this loop... */
         }
     }
@@ -715,10 +752,13 @@ void incrementallyRehash(void) {
 // 在执行保存时关闭对数据库的 rehash 
 // 避免 copy-on-write 问题
 void updateDictResizePolicy(void) {
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
+    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
         dictEnableResize();
-    else
+        kvtableEnableResize();
+    } else {
         dictDisableResize();
+        kvtableDisableResize();
+    }
 }
 
 /* ======================= Cron: called every 100 ms ======================== */
@@ -727,59 +767,121 @@ void updateDictResizePolicy(void) {
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
- * keys that can be removed from the keyspace. */
+ * keys that can be removed from the keyspace.
+ *
+ * No more than REDIS_DBCRON_DBS_PER_CALL databases are tested at every
+ * iteration, and the next call resumes from the database following the
+ * last one tested, so that the time is distributed evenly across DBs.
+ *
+ * This kind of call is used when Redis detects that timelimit_exit is
+ * true, so there is more work to do, and we do it more incrementally from
+ * the beforeSleep() function of the event loop.
+ *
+ * Expire cycle type:
+ *
+ * If type is REDIS_EXPIRE_CYCLE_FAST the function will try to run a
+ * "fast" expire cycle that takes no longer than
+ * REDIS_EXPIRELOOKUPS_FAST_DURATION microseconds, and is not repeated
+ * again before the same amount of time.
+ *
+ * If type is REDIS_EXPIRE_CYCLE_SLOW, that normal expire cycle is
+ * executed, where the time limit is a percentage of the REDIS_HZ period
+ * as specified by the REDIS_EXPIRELOOKUPS_TIME_PERC define. */
 /*
  * 主动清除过期 key 
+ *
+ * 慢速周期由 serverCron 调用，
+ * 如果上一次周期因为超时而退出，那么 beforeSleep 会执行一次快速周期。
  */
-void activeExpireCycle(void) {
+void activeExpireCycle(int type) {
+    /* This function has some global state in order to continue the work
+     * incrementally across calls. */
+    // 上次处理到的数据库
+    static unsigned int current_db = 0; /* Last DB tested. */
+    // 上次执行是否因为超时而退出
+    static int timelimit_exit = 0;      /* Time limit hit in previous call? */
+    // 上次快速周期的开始时间
+    static long long last_fast_cycle = 0; /* When last fast cycle ran. */
+
     int j, iteration = 0;
-    long long start = ustime(), timelimit;
+    int dbs_per_call = REDIS_DBCRON_DBS_PER_CALL;
+    long long start = ustime(), timelimit, elapsed;
+    long total_sampled = 0, total_expired = 0;
+
+    if (type == REDIS_EXPIRE_CYCLE_FAST) {
+        /* Don't start a fast cycle if the previous cycle did not exit
+         * for time limit. Also don't repeat a fast cycle for the same period
+         * as the fast cycle total duration itself. */
+        if (!timelimit_exit) return;
+        if (start < last_fast_cycle + REDIS_EXPIRELOOKUPS_FAST_DURATION*2)
+            return;
+        last_fast_cycle = start;
+    }
+
+    /* We usually should test REDIS_DBCRON_DBS_PER_CALL per iteration, with
+     * two exceptions:
+     *
+     * 1) Don't test more DBs than we have.
+     * 2) If last time we hit the time limit, we want to scan all DBs
+     * in this iteration, as there is work to do in some DB and we don't want
+     * expired keys to use memory for too much time. */
+    if (dbs_per_call > server.dbnum || timelimit_exit)
+        dbs_per_call = server.dbnum;
 
     /* We can use at max REDIS_EXPIRELOOKUPS_TIME_PERC percentage of CPU time
      * per iteration. Since this function gets called with a frequency of
      * REDIS_HZ times per second, the following is the max amount of
      * microseconds we can spend in this function. */
-    // 这个函数可以使用的时长（毫秒）
+    // 这个函数可以使用的时长（微秒）
     timelimit = 1000000*REDIS_EXPIRELOOKUPS_TIME_PERC/REDIS_HZ/100;
+    timelimit_exit = 0;
     if (timelimit <= 0) timelimit = 1;
 
-    for (j = 0; j < server.dbnum; j++) {
+    if (type == REDIS_EXPIRE_CYCLE_FAST)
+        timelimit = REDIS_EXPIRELOOKUPS_FAST_DURATION; /* in microseconds. */
+
+    for (j = 0; j < dbs_per_call && timelimit_exit == 0; j++) {
         int expired;
-        redisDb *db = server.db+j;
+        redisDb *db = server.db+(current_db % server.dbnum);
+
+        /* Increment the DB now so we are sure if we run out of time
+         * in the current DB we'll restart from the next. This allows to
+         * distribute the time evenly across DBs. */
+        // 先增加计数，这样即使在这个数据库上超时，下次也会从下一个数据库开始
+        current_db++;
 
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
-            unsigned long num = dictSize(db->expires);
-            unsigned long slots = dictSlots(db->expires);
+            unsigned long num = kvtableVolatileSize(db->keyspace);
             long long now = mstime();
 
-            /* When there are less than 1% filled slots getting random
-             * keys is expensive, so stop here waiting for better times...
-             * The dictionary will be resized asap. */
-            // 过期字典里只有 %1 位置被占用，调用随机 key 的消耗比较高
-            // 等 key 多一点再来
-            if (num && slots > DICT_HT_INITIAL_SIZE &&
-                (num*100/slots < 1)) break;
+            /* If there is nothing to expire try next DB ASAP. */
+            if (num == 0) break;
 
             /* The main collection cycle. Sample random keys among keys
              * with an expire set, checking for expired ones. */
-            // 从过期字典中随机取出 key ，检查它是否过期
+            // 从带有过期时间的 key 中随机取样，检查它是否过期
             expired = 0;    // 被删除 key 计数
             if (num > REDIS_EXPIRELOOKUPS_PER_CRON) // 最多每次可查找的次数
                 num = REDIS_EXPIRELOOKUPS_PER_CRON;
-            while (num--) {
-                dictEntry *de;
-                long long t;
 
-                // 随机查找带有 TTL 的 key ，看它是否过期
-                // 如果数据库为空，跳出
-                if ((de = dictGetRandomKey(db->expires)) == NULL) break;
+            /* The volatile entries are sampled from a dense array, so
+             * sampling costs the same however sparse the keyspace is. The
+             * samples are distinct and deleting an expired key frees only
+             * its own entry, so the other samples stay valid. */
+            // 样本中的节点互不相同，删除一个过期 key 不会影响其他样本
+            kvEntry *samples[REDIS_EXPIRELOOKUPS_PER_CRON];
+            unsigned int count, k;
+
+            count = kvtableGetSomeVolatile(db->keyspace,samples,num);
+            for (k = 0; k < count; k++) {
+                kvEntry *e = samples[k];
 
-                t = dictGetSignedIntegerVal(de);
-                if (now > t) {
+                total_sampled++;
+                if (now > kvtableGetExpire(e)) {
                     // 已过期
-                    sds key = dictGetKey(de);
+                    sds key = kvtableGetKey(e);
                     robj *keyobj = createStringObject(key,sdslen(key));
 
                     propagateExpire(db,keyobj);
@@ -789,23 +891,43 @@ void activeExpireCycle(void) {
                     server.stat_expiredkeys++;
                 }
             }
+            total_expired += expired;
+
             /* We can't block forever here even if there are many keys to
              * expire. So after a given amount of milliseconds return to the
              * caller waiting for the other active expire cycle. */
             // 每次进行 16 次循环之后，检查时间是否超过，如果超过，则退出
             iteration++;
             if ((iteration & 0xf) == 0 && /* check once every 16 cycles. */
-                (ustime()-start) > timelimit) return;
-
+                (ustime()-start) > timelimit)
+            {
+                timelimit_exit = 1;
+                server.stat_expired_time_cap_reached_count++;
+                break;
+            }
         } while (expired > REDIS_EXPIRELOOKUPS_PER_CRON/4);
     }
+
+    elapsed = ustime()-start;
+    server.stat_expire_cycle_time_used += elapsed;
+
+    /* Update our estimate of keys existing but yet to be expired.
+     * Running average with this sample accounting for 5%. */
+    // 以滑动平均的方式估算已过期但仍未被删除的 key 所占的比例
+    double current_perc;
+    if (total_sampled) {
+        current_perc = (double)total_expired/total_sampled;
+    } else
+        current_perc = 0;
+    server.stat_expired_stale_perc = (current_perc*0.05)+
+                                     (server.stat_expired_stale_perc*0.95);
 }
 
 /*
  * 更新服务器的 LRU 时间
  */
 void updateLRUClock(void) {
-    server.lruclock = (server.unixtime/REDIS_LRU_CLOCK_RESOLUTION) &
+    server.lruclock = (mstime()/REDIS_LRU_CLOCK_RESOLUTION) &
                                                 REDIS_LRU_CLOCK_MAX;
 }
 
@@ -842,6 +964,7 @@ long long getOperationsPerSecond(void) {
  */
 int clientsCronHandleTimeout(redisClient *c) {
     time_t now = server.unixtime;
+    long long now_ms = mstime();
 
     if (server.maxidletime &&
         !(c->flags & REDIS_SLAVE) &&    /* no timeout for slaves */
@@ -856,7 +979,7 @@ int clientsCronHandleTimeout(redisClient *c) {
         return 1;
     } else if (c->flags & REDIS_BLOCKED) {
         // 返回空白回复给阻塞超时的客户端
-        if (c->bpop.timeout != 0 && c->bpop.timeout < now) {
+        if (c->bpop.timeout != 0 && c->bpop.timeout < now_ms) {
             addReply(c,shared.nullmultibulk);
             unblockClientWaitingData(c);
         }
@@ -994,14 +1117,14 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     // 对执行命令的时间进行采样分析
     run_with_period(100) trackOperationsPerSecond();
 
-    /* We have just 22 bits per object for LRU information.
-     * So we use an (eventually wrapping) LRU clock with 10 seconds resolution.
-     * 2^22 bits with 10 seconds resoluton is more or less 1.5 years.
+    /* We have just REDIS_LRU_BITS bits per object for LRU information.
+     * So we use an (eventually wrapping) LRU clock with 1 second resolution.
+     * 2^24 bits with 1 second resolution is more or less 194 days.
      *
-     * Note that even if this will wrap after 1.5 years it's not a problem,
+     * Note that even if this will wrap after 194 days it's not a problem,
      * everything will still work but just some object will appear younger
      * to Redis. But for this to happen a given object should never be touched
-     * for 1.5 years.
+     * for 194 days.
      *
      * Note that you can change the resolution altering the
      * REDIS_LRU_CLOCK_RESOLUTION define.
@@ -1028,11 +1151,11 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
         for (j = 0; j < server.dbnum; j++) {
             long long size, used, vkeys;
 
-            size = dictSlots(server.db[j].dict);
-            used = dictSize(server.db[j].dict);
-            vkeys = dictSize(server.db[j].expires);
+            size = kvtableBuckets(server.db[j].keyspace);
+            used = kvtableSize(server.db[j].keyspace);
+            vkeys = kvtableVolatileSize(server.db[j].keyspace);
             if (used || vkeys) {
-                redisLog(REDIS_VERBOSE,"DB %d: %lld keys (%lld volatile) in %lld slots HT.",j,used,vkeys,size);
+                redisLog(REDIS_VERBOSE,"DB %d: %lld keys (%lld volatile) in %lld buckets HT.",j,used,vkeys,size);
                 /* dictPrintStats(server.dict); */
             }
         }
@@ -1144,7 +1267,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
      * in order to guarantee a strict consistency. */
     // 如果服务器是主节点的话，进行过期键删除
     // 如果服务器是附属节点的话，那么等待主节点发来的 DEL 命令
-    if (server.masterhost == NULL) activeExpireCycle();
+    if (server.masterhost == NULL) activeExpireCycle(REDIS_EXPIRE_CYCLE_SLOW);
 
     /* Close clients that need to be closed asynchronous */
     // 关闭那些需要异步删除的客户端
@@ -1185,6 +1308,16 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     listNode *ln;
     redisClient *c;
 
+    /* Read, parse and execute the commands of the clients that were
+     * postponed to the I/O threads. */
+    // 使用 I/O 线程处理等待读入的客户端
+    handleClientsWithPendingReadsUsingThreads();
+
+    /* Run a fast expire cycle (the called function will return
+     * ASAP if a fast cycle is not needed). */
+    // 如果上次过期周期因为超时而退出，那么执行一次快速过期周期
+    if (server.masterhost == NULL) activeExpireCycle(REDIS_EXPIRE_CYCLE_FAST);
+
     /* Try to process pending commands for clients that were just unblocked. */
     // 处理所有刚被取消阻塞的客户端的缓存
     while (listLength(server.unblocked_clients)) {
@@ -1206,6 +1339,12 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     /* Write the AOF buffer on disk */
     // 如果有需要的话，尝试保存 AOF 到磁盘
     flushAppendOnlyFile(0);
+
+    /* Write the replies of the clients queued while processing events.
+     * This is done after the AOF write, so replies are never sent before
+     * the effects of the commands reach the AOF buffer on disk. */
+    // 使用 I/O 线程向客户端写入回复
+    handleClientsWithPendingWritesUsingThreads();
 }
 
 /* =========================== Server initialization ======================== */
@@ -1223,6 +1362,7 @@ void createSharedObjects(void) {
     shared.nullbulk = createObject(REDIS_STRING,sdsnew("$-1\r\n"));
     shared.nullmultibulk = createObject(REDIS_STRING,sdsnew("*-1\r\n"));
     shared.emptymultibulk = createObject(REDIS_STRING,sdsnew("*0\r\n"));
+    shared.emptyscan = createObject(REDIS_STRING,sdsnew("*2\r\n$1\r\n0\r\n*0\r\n"));
     shared.pong = createObject(REDIS_STRING,sdsnew("+PONG\r\n"));
     shared.queued = createObject(REDIS_STRING,sdsnew("+QUEUED\r\n"));
     shared.wrongtypeerr = createObject(REDIS_STRING,sdsnew(
@@ -1256,8 +1396,14 @@ void createSharedObjects(void) {
     shared.plus = createObject(REDIS_STRING,sdsnew("+"));
 
     for (j = 0; j < REDIS_SHARED_SELECT_CMDS; j++) {
+        char dictid_str[64];
+        int dictid_len;
+
+        dictid_len = ll2string(dictid_str,sizeof(dictid_str),j);
         shared.select[j] = createObject(REDIS_STRING,
-            sdscatprintf(sdsempty(),"select %d\r\n", j));
+            sdscatprintf(sdsempty(),
+                "*2\r\n$6\r\nSELECT\r\n$%d\r\n%s\r\n",
+                dictid_len, dictid_str));
     }
     shared.messagebulk = createStringObject("$7\r\nmessage\r\n",13);
     shared.pmessagebulk = createStringObject("$8\r\npmessage\r\n",14);
@@ -1269,6 +1415,9 @@ void createSharedObjects(void) {
     shared.rpop = createStringObject("RPOP",4);
     shared.lpop = createStringObject("LPOP",4);
     shared.lpush = createStringObject("LPUSH",5);
+    /* Lex range items meaning "-" and "+": they are compared by pointer. */
+    shared.minstring = createStringObject("minstring",9);
+    shared.maxstring = createStringObject("maxstring",9);
     for (j = 0; j < REDIS_SHARED_INTEGERS; j++) {
         shared.integers[j] = createObject(REDIS_STRING,(void*)(long)j);
         shared.integers[j]->encoding = REDIS_ENCODING_INT;
@@ -1312,6 +1461,8 @@ void initServerConfig() {
 
     // 是否正在载入数据？
     server.loading = 0;
+    server.async_loading = 0;
+    server.lazyfree_lazy_server_del = REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
 
     // log
     server.logfile = NULL; /* NULL = log on standard output */
@@ -1358,15 +1509,24 @@ void initServerConfig() {
     server.maxmemory = 0;
     server.maxmemory_policy = REDIS_MAXMEMORY_VOLATILE_LRU;
     server.maxmemory_samples = 3;
+    server.lfu_log_factor = REDIS_DEFAULT_LFU_LOG_FACTOR;
+    server.lfu_decay_time = REDIS_DEFAULT_LFU_DECAY_TIME;
+
+    // I/O 线程
+    server.io_threads_num = REDIS_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = REDIS_DEFAULT_IO_THREADS_DO_READS;
 
     // 压缩数据结构实体数量限制
     server.hash_max_ziplist_entries = REDIS_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = REDIS_HASH_MAX_ZIPLIST_VALUE;
-    server.list_max_ziplist_entries = REDIS_LIST_MAX_ZIPLIST_ENTRIES;
-    server.list_max_ziplist_value = REDIS_LIST_MAX_ZIPLIST_VALUE;
+    server.list_max_ziplist_size = REDIS_LIST_MAX_ZIPLIST_SIZE;
+    server.list_compress_depth = REDIS_LIST_COMPRESS_DEPTH;
     server.set_max_intset_entries = REDIS_SET_MAX_INTSET_ENTRIES;
     server.zset_max_ziplist_entries = REDIS_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = REDIS_ZSET_MAX_ZIPLIST_VALUE;
+    server.hll_sparse_max_bytes = REDIS_DEFAULT_HLL_SPARSE_MAX_BYTES;
+    server.stream_node_max_bytes = REDIS_STREAM_NODE_MAX_BYTES;
+    server.stream_node_max_entries = REDIS_STREAM_NODE_MAX_ENTRIES;
 
     // 关闭指示 flag
     server.shutdown_asap = 0;
@@ -1403,8 +1563,25 @@ void initServerConfig() {
     server.repl_state = REDIS_REPL_NONE;
     server.repl_syncio_timeout = REDIS_REPL_SYNCIO_TIMEOUT;
     server.repl_serve_stale_data = 1;
+    server.repl_slave_async_load = REDIS_DEFAULT_SLAVE_ASYNC_LOAD;
+    server.repl_async_load_timer = -1;
+    server.repl_slave_lazy_flush = REDIS_DEFAULT_SLAVE_LAZY_FLUSH;
     server.repl_slave_ro = 1;
     server.repl_down_since = time(NULL);
+    server.repl_master_runid[0] = '\0';
+    server.repl_master_initial_offset = -1;
+    server.cached_master = NULL;
+
+    /* Replication partial resync backlog */
+    server.repl_backlog = NULL;
+    server.repl_backlog_size = REDIS_DEFAULT_REPL_BACKLOG_SIZE;
+    server.repl_backlog_histlen = 0;
+    server.repl_backlog_idx = 0;
+    server.repl_backlog_off = 0;
+    server.repl_backlog_time_limit = REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT;
+    server.repl_no_slaves_since = time(NULL);
+    server.repl_diskless_sync = REDIS_DEFAULT_REPL_DISKLESS_SYNC;
+    server.repl_diskless_sync_delay = REDIS_DEFAULT_REPL_DISKLESS_SYNC_DELAY;
     server.slave_priority = REDIS_DEFAULT_SLAVE_PRIORITY;
 
     // 客户端输出缓存限制
@@ -1436,6 +1613,7 @@ void initServerConfig() {
     server.lpushCommand = lookupCommandByCString("lpush");
     server.lpopCommand = lookupCommandByCString("lpop");
     server.rpopCommand = lookupCommandByCString("rpop");
+    server.xreadgroupCommand = lookupCommandByCString("xreadgroup");
     
     /* Slow log */
     // 慢查询
@@ -1518,8 +1696,14 @@ void initServer() {
     server.clients = listCreate();
     // 要被关闭的客户端
     server.clients_to_close = listCreate();
+    // 等待 I/O 线程读入或写入的客户端
+    server.clients_pending_write = listCreate();
+    server.clients_pending_read = listCreate();
     // 附属节点
     server.slaves = listCreate();
+    // 复制流中最后一次 SELECT 的数据库，-1 表示下次必须重新发送 SELECT
+    server.slaveseldb = -1; /* Force to emit the first SELECT command. */
+    server.master_repl_offset = 0;
     // monitor 客户端
     server.monitors = listCreate();
     // 被取消阻塞的客户端
@@ -1535,6 +1719,12 @@ void initServer() {
 
     // 初始化事件状态
     server.el = aeCreateEventLoop(server.maxclients+1024);
+    if (server.el == NULL) {
+        redisLog(REDIS_WARNING,
+            "Failed creating the event loop (%s API): %s",
+            aeGetApiName(), strerror(errno));
+        exit(1);
+    }
     
     // 初始化数据库
     server.db = zmalloc(sizeof(redisDb)*server.dbnum);
@@ -1564,10 +1754,8 @@ void initServer() {
 
     // 初始化数据库
     for (j = 0; j < server.dbnum; j++) {
-        // key space
-        server.db[j].dict = dictCreate(&dbDictType,NULL);
-        // 过期空间
-        server.db[j].expires = dictCreate(&keyptrDictType,NULL);
+        // key space 和过期时间
+        server.db[j].keyspace = kvtableCreate(&dbKvtableType);
         // 被阻塞键
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         // 可解除阻塞的键
@@ -1575,6 +1763,7 @@ void initServer() {
         // 被 WATCH 命令监视的键
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
         // 数据库 ID
+        server.db[j].eviction_pool = evictionPoolAlloc();
         server.db[j].id = j;
     }
 
@@ -1589,6 +1778,7 @@ void initServer() {
 
     // BGSAVE 执行指示变量
     server.rdb_child_pid = -1;
+    server.rdb_child_type = REDIS_RDB_CHILD_TYPE_NONE;
     // BGREWRITEAOF 执行指示变量
     server.aof_child_pid = -1;
     // 初始化 AOF 重写缓存
@@ -1607,12 +1797,20 @@ void initServer() {
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
     server.stat_evictedkeys = 0;
+    server.stat_expired_stale_perc = 0;
+    server.stat_expired_time_cap_reached_count = 0;
+    server.stat_expire_cycle_time_used = 0;
     server.stat_starttime = time(NULL);
     server.stat_keyspace_misses = 0;
     server.stat_keyspace_hits = 0;
     server.stat_peak_memory = 0;
     server.stat_fork_time = 0;
     server.stat_rejected_conn = 0;
+    server.stat_sync_full = 0;
+    server.stat_sync_partial_ok = 0;
+    server.stat_sync_partial_err = 0;
+    server.stat_io_reads_processed = 0;
+    server.stat_io_writes_processed = 0;
     memset(server.ops_sec_samples,0,sizeof(server.ops_sec_samples));
     server.ops_sec_idx = 0;
     server.ops_sec_last_sample_time = mstime();
@@ -1663,6 +1861,9 @@ void initServer() {
 
     // 初始化后台 IO 
     bioInit();
+
+    // 初始化 I/O 线程
+    initThreadedIO();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -1798,7 +1999,7 @@ void propagate(struct redisCommand *cmd, int dbid, robj **argv, int argc,
 {
     if (server.aof_state != REDIS_AOF_OFF && flags & REDIS_PROPAGATE_AOF)
         feedAppendOnlyFile(cmd,dbid,argv,argc);
-    if (flags & REDIS_PROPAGATE_REPL && listLength(server.slaves))
+    if (flags & REDIS_PROPAGATE_REPL)
         replicationFeedSlaves(server.slaves,dbid,argv,argc);
 }
 
@@ -2065,7 +2266,7 @@ int processCommand(redisClient *c) {
 
         // 每次执行完命令之后，处理所有就绪列表
         if (listLength(server.ready_keys))
-            handleClientsBlockedOnLists();
+            handleClientsBlockedOnKeys();
     }
 
     return REDIS_OK;
@@ -2127,10 +2328,18 @@ int prepareForShutdown(int flags) {
         unlink(server.pidfile);
     }
 
-    /* Close the listening sockets. Apparently this allows faster restarts. */
+    /* Close the listening sockets. Apparently this allows faster restarts.
+     * The events are deleted first: event loop backends referencing the
+     * sockets (io_uring) would otherwise keep them open. */
     // 显式关闭文件，可能会让重启动快一点
-    if (server.ipfd != -1) close(server.ipfd);
-    if (server.sofd != -1) close(server.sofd);
+    if (server.ipfd != -1) {
+        aeDeleteFileEvent(server.el,server.ipfd,AE_READABLE);
+        close(server.ipfd);
+    }
+    if (server.sofd != -1) {
+        aeDeleteFileEvent(server.el,server.sofd,AE_READABLE);
+        close(server.sofd);
+    }
     if (server.unixsocket) {
         redisLog(REDIS_NOTICE,"Removing the unix socket file.");
         unlink(server.unixsocket); /* don't care if this fails */
@@ -2337,7 +2546,8 @@ sds genRedisInfoString(char *section) {
             "used_memory_peak_human:%s\r\n"
             "used_memory_lua:%lld\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
-            "mem_allocator:%s\r\n",
+            "mem_allocator:%s\r\n"
+            "lazyfree_pending_objects:%zu\r\n",
             zmalloc_used_memory(),
             hmem,
             zmalloc_get_rss(),
@@ -2345,7 +2555,8 @@ sds genRedisInfoString(char *section) {
             peak_hmem,
             ((long long)lua_gc(server.lua,LUA_GCCOUNT,0))*1024LL,
             zmalloc_get_fragmentation_ratio(),
-            ZMALLOC_LIB
+            ZMALLOC_LIB,
+            lazyfreeGetPendingObjectsCount()
             );
     }
 
@@ -2355,6 +2566,7 @@ sds genRedisInfoString(char *section) {
         info = sdscatprintf(info,
             "# Persistence\r\n"
             "loading:%d\r\n"
+            "async_loading:%d\r\n"
             "rdb_changes_since_last_save:%lld\r\n"
             "rdb_bgsave_in_progress:%d\r\n"
             "rdb_last_save_time:%ld\r\n"
@@ -2368,6 +2580,7 @@ sds genRedisInfoString(char *section) {
             "aof_current_rewrite_time_sec:%ld\r\n"
             "aof_last_bgrewrite_status:%s\r\n",
             server.loading,
+            server.async_loading,
             server.dirty,
             server.rdb_child_pid != -1,
             server.lastsave,
@@ -2401,7 +2614,7 @@ sds genRedisInfoString(char *section) {
                 server.aof_delayed_fsync);
         }
 
-        if (server.loading) {
+        if (server.loading || server.async_loading) {
             double perc;
             time_t eta, elapsed;
             off_t remaining_bytes = server.loading_total_bytes-
@@ -2442,26 +2655,42 @@ sds genRedisInfoString(char *section) {
             "total_commands_processed:%lld\r\n"
             "instantaneous_ops_per_sec:%lld\r\n"
             "rejected_connections:%lld\r\n"
+            "sync_full:%lld\r\n"
+            "sync_partial_ok:%lld\r\n"
+            "sync_partial_err:%lld\r\n"
             "expired_keys:%lld\r\n"
+            "expired_stale_perc:%.2f\r\n"
+            "expired_time_cap_reached_count:%lld\r\n"
+            "expire_cycle_cpu_milliseconds:%lld\r\n"
             "evicted_keys:%lld\r\n"
             "keyspace_hits:%lld\r\n"
             "keyspace_misses:%lld\r\n"
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
             "latest_fork_usec:%lld\r\n"
-            "migrate_cached_sockets:%ld\r\n",
+            "migrate_cached_sockets:%ld\r\n"
+            "io_threaded_reads_processed:%lld\r\n"
+            "io_threaded_writes_processed:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getOperationsPerSecond(),
             server.stat_rejected_conn,
+            server.stat_sync_full,
+            server.stat_sync_partial_ok,
+            server.stat_sync_partial_err,
             server.stat_expiredkeys,
+            server.stat_expired_stale_perc*100,
+            server.stat_expired_time_cap_reached_count,
+            server.stat_expire_cycle_time_used/1000,
             server.stat_evictedkeys,
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
             dictSize(server.pubsub_channels),
             listLength(server.pubsub_patterns),
             server.stat_fork_time,
-            dictSize(server.migrate_cached_sockets));
+            dictSize(server.migrate_cached_sockets),
+            server.stat_io_reads_processed,
+            server.stat_io_writes_processed);
     }
 
     /* Replication */
@@ -2503,8 +2732,10 @@ sds genRedisInfoString(char *section) {
                     (long)server.unixtime-server.repl_down_since);
             }
             info = sdscatprintf(info,
+                "slave_repl_offset:%lld\r\n"
                 "slave_priority:%d\r\n"
                 "slave_read_only:%d\r\n",
+                server.master ? server.master->reploff : -1,
                 server.slave_priority,
                 server.repl_slave_ro);
         }
@@ -2537,11 +2768,23 @@ sds genRedisInfoString(char *section) {
                     break;
                 }
                 if (state == NULL) continue;
-                info = sdscatprintf(info,"slave%d:%s,%d,%s\r\n",
-                    slaveid,ip,slave->slave_listening_port,state);
+                info = sdscatprintf(info,"slave%d:%s,%d,%s,%lld\r\n",
+                    slaveid,ip,slave->slave_listening_port,state,
+                    slave->repl_ack_off);
                 slaveid++;
             }
         }
+        info = sdscatprintf(info,
+            "master_repl_offset:%lld\r\n"
+            "repl_backlog_active:%d\r\n"
+            "repl_backlog_size:%lld\r\n"
+            "repl_backlog_first_byte_offset:%lld\r\n"
+            "repl_backlog_histlen:%lld\r\n",
+            server.master_repl_offset,
+            server.repl_backlog != NULL,
+            server.repl_backlog_size,
+            server.repl_backlog_off,
+            server.repl_backlog_histlen);
     }
 
     /* CPU */
@@ -2591,8 +2834,8 @@ sds genRedisInfoString(char *section) {
         for (j = 0; j < server.dbnum; j++) {
             long long keys, vkeys;
 
-            keys = dictSize(server.db[j].dict);
-            vkeys = dictSize(server.db[j].expires);
+            keys = kvtableSize(server.db[j].keyspace);
+            vkeys = kvtableVolatileSize(server.db[j].keyspace);
             if (keys || vkeys) {
                 info = sdscatprintf(info, "db%d:keys=%lld,expires=%lld\r\n",
                     j, keys, vkeys);
@@ -2623,13 +2866,212 @@ void monitorCommand(redisClient *c) {
     if (c->flags & REDIS_SLAVE) return;
 
     c->flags |= (REDIS_SLAVE|REDIS_MONITOR);
-    c->slaveseldb = 0;
     listAddNodeTail(server.monitors,c);
     addReply(c,shared.ok);
 }
 
 /* ============================ Maxmemory directive  ======================== */
 
+/* ----------------------------------------------------------------------------
+ * LFU (Least Frequently Used) implementation.
+ *
+ * We have 24 total bits of space in each object in order to implement
+ * an LFU (Least Frequently Used) eviction policy, since we re-use the
+ * LRU field for this purpose.
+ *
+ * We split the 24 bits into two fields:
+ *
+ *          16 bits      8 bits
+ *     +----------------+--------+
+ *     + Last decr time | LOG_C  |
+ *     +----------------+--------+
+ *
+ * LOG_C is a logarithmic counter that provides an indication of the access
+ * frequency. However this field must also be decremented otherwise what used
+ * to be a frequently accessed key in the past, will remain ranked like that
+ * forever, while we want the algorithm to adapt to access pattern changes.
+ *
+ * So the remaining 16 bits are used in order to store the "decrement time",
+ * a reduced-precision Unix time (we take 16 bits of the time converted
+ * in minutes since we don't care about wrapping around) of the last
+ * access, used to decay the LOG_C counter when the key is not accessed.
+ *
+ * New keys don't start at zero, in order to have the ability to collect
+ * some accesses before being trashed away, so they start at
+ * REDIS_LFU_INIT_VAL. The logarithmic increment performed on LOG_C takes
+ * care of REDIS_LFU_INIT_VAL when incrementing the key, so that keys
+ * starting at REDIS_LFU_INIT_VAL (or having a smaller value) have a very
+ * high chance of being incremented on access.
+ *
+ * During decrement, the value of the logarithmic counter is decremented by
+ * one every lfu_decay_time minutes without accesses.
+ * -------------------------------------------------------------------------- */
+
+/* Return the current time in minutes, just taking the least significant
+ * 16 bits. The returned time is suitable to be stored as LDT (last decrement
+ * time) for the LFU implementation. */
+// 返回分钟精度的当前时间的低 16 位
+unsigned long LFUGetTimeInMinutes(void) {
+    return (server.unixtime/60) & 65535;
+}
+
+/* Given an object last access time, compute the minimum number of minutes
+ * that elapsed since the last access. Handle overflow (ldt greater than
+ * the current 16 bits minutes time) considering the time as wrapping
+ * exactly once. */
+// 计算自上次访问以来经过的分钟数
+unsigned long LFUTimeElapsed(unsigned long ldt) {
+    unsigned long now = LFUGetTimeInMinutes();
+    if (now >= ldt) return now-ldt;
+    return 65535-ldt+now;
+}
+
+/* Logarithmically increment a counter. The greater is the current counter
+ * value the less likely is that it gets really incremented. Saturate it
+ * at 255. */
+// 以对数的方式增加计数器，计数器越大，增加的概率越低
+uint8_t LFULogIncr(uint8_t counter) {
+    if (counter == 255) return 255;
+    double r = (double)rand()/RAND_MAX;
+    double baseval = counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    double p = 1.0/(baseval*server.lfu_log_factor+1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/* Return the object frequency counter, decremented by one for every
+ * lfu_decay_time minutes elapsed since the last access. The LFU fields of
+ * the object are not updated: we update the access time and counter in an
+ * explicit way when the object is really accessed.
+ *
+ * This function is used in order to scan the dataset for the best object
+ * to evict, so it must not modify the sampled objects. */
+// 返回按经过的时间衰减之后的访问计数器，不修改对象本身
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long num_periods = server.lfu_decay_time ?
+        LFUTimeElapsed(ldt) / server.lfu_decay_time : 0;
+    if (num_periods)
+        counter = (num_periods > counter) ? 0 : counter - num_periods;
+    return counter;
+}
+
+/* Update the LFU fields of an object that is being accessed: first decay
+ * the counter if needed, then increment it and record the access time. */
+// 在对象被访问时更新 LFU 信息
+void updateLFU(robj *val) {
+    unsigned long counter = LFUDecrAndReturn(val);
+    counter = LFULogIncr(counter);
+    val->lru = (LFUGetTimeInMinutes()<<8) | counter;
+}
+
+/* Create a new eviction pool. */
+// 创建一个空的淘汰候选池
+struct evictionPoolEntry *evictionPoolAlloc(void) {
+    struct evictionPoolEntry *ep;
+    int j;
+
+    ep = zmalloc(sizeof(*ep)*REDIS_EVICTION_POOL_SIZE);
+    for (j = 0; j < REDIS_EVICTION_POOL_SIZE; j++) {
+        ep[j].idle = 0;
+        ep[j].key = NULL;
+    }
+    return ep;
+}
+
+/* This is an helper function for freeMemoryIfNeeded(), it is used in order
+ * to populate the evictionPool with a few entries every time we want to
+ * expire a key. Keys with idle time smaller than one of the current
+ * keys are added. Keys are always added if there are free entries.
+ *
+ * We insert keys on place in ascending order, so keys with the smaller
+ * idle time are on the left, and keys with the higher idle time on the
+ * right. */
+/*
+ * 从键空间中随机取出 maxmemory_samples 个键（volatile_only 为真时
+ * 只从带有过期时间的键中取样），
+ * 把闲置时间比池中元素更长的键按顺序插入到淘汰候选池中。
+ */
+#define EVICTION_SAMPLES_ARRAY_SIZE 16
+void evictionPoolPopulate(kvtable *keyspace, int volatile_only, struct evictionPoolEntry *pool) {
+    int j, k, count;
+    kvEntry *_samples[EVICTION_SAMPLES_ARRAY_SIZE];
+    kvEntry **samples;
+
+    /* Try to use a static buffer: this function is a big hit...
+     * Note: it was actually measured that this helps. */
+    if (server.maxmemory_samples <= EVICTION_SAMPLES_ARRAY_SIZE) {
+        samples = _samples;
+    } else {
+        samples = zmalloc(sizeof(samples[0])*server.maxmemory_samples);
+    }
+
+    // 一次性取出 maxmemory_samples 个样本
+    if (volatile_only)
+        count = kvtableGetSomeVolatile(keyspace,samples,
+                                       server.maxmemory_samples);
+    else
+        count = kvtableGetSomeEntries(keyspace,samples,
+                                      server.maxmemory_samples);
+    for (j = 0; j < count; j++) {
+        unsigned long long idle;
+        sds key = kvtableGetKey(samples[j]);
+        robj *o = kvtableGetVal(samples[j]);
+
+        /* Calculate the idle time according to the policy. This is called
+         * idle just because the code initially handled LRU, but is in fact
+         * just a score where an higher score means better candidate. */
+        // LFU 策略下，访问频率越低，分值越高
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            idle = 255-LFUDecrAndReturn(o);
+        } else {
+            idle = estimateObjectIdleTime(o);
+        }
+
+        /* Skip keys that are already in the pool: the same key sampled
+         * twice would only waste a slot. */
+        for (k = 0; k < REDIS_EVICTION_POOL_SIZE && pool[k].key; k++)
+            if (sdscmp(pool[k].key,key) == 0) break;
+        if (k < REDIS_EVICTION_POOL_SIZE && pool[k].key) continue;
+
+        /* Insert the element inside the pool.
+         * First, find the first empty bucket or the first populated
+         * bucket that has an idle time smaller than our idle time. */
+        k = 0;
+        while (k < REDIS_EVICTION_POOL_SIZE &&
+               pool[k].key &&
+               pool[k].idle < idle) k++;
+        if (k == 0 && pool[REDIS_EVICTION_POOL_SIZE-1].key != NULL) {
+            /* Can't insert if the element is < the worst element we have
+             * and there are no empty buckets. */
+            continue;
+        } else if (k < REDIS_EVICTION_POOL_SIZE && pool[k].key == NULL) {
+            /* Inserting into empty position. No setup needed before insert. */
+        } else {
+            /* Inserting in the middle. Now k points to the first element
+             * greater than the element to insert.  */
+            if (pool[REDIS_EVICTION_POOL_SIZE-1].key == NULL) {
+                /* Free space on the right? Insert at k shifting
+                 * all the elements from k to end to the right. */
+                memmove(pool+k+1,pool+k,
+                    sizeof(pool[0])*(REDIS_EVICTION_POOL_SIZE-k-1));
+            } else {
+                /* No free space on right? Insert at k-1 */
+                k--;
+                /* Shift all elements on the left of k (included) to the
+                 * left, so we discard the element with smaller idle time. */
+                sdsfree(pool[0].key);
+                memmove(pool,pool+1,sizeof(pool[0])*k);
+            }
+        }
+        pool[k].key = sdsdup(key);
+        pool[k].idle = idle;
+    }
+    if (samples != _samples) zfree(samples);
+}
+
 /* This function gets called when 'maxmemory' is set on the config file to limit
  * the max memory used by the server, before processing a command.
  *
@@ -2688,53 +3130,72 @@ int freeMemoryIfNeeded(void) {
 
         // 根据所使用的不同算法，释放数据库中过期键占用的空间
         for (j = 0; j < server.dbnum; j++) {
-            long bestval = 0; /* just to prevent warning */
+            long long bestval = 0; /* just to prevent warning */
             sds bestkey = NULL;
-            struct dictEntry *de;
+            kvEntry *e;
             redisDb *db = server.db+j;
-            dict *dict;
+            int volatile_only;
 
-            if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM)
-            {
-                dict = server.db[j].dict;
-            } else {
-                dict = server.db[j].expires;
-            }
-            if (dictSize(dict) == 0) continue;
+            // volatile-* 策略只淘汰带有过期时间的键
+            volatile_only =
+                server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_LRU &&
+                server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_LFU &&
+                server.maxmemory_policy != REDIS_MAXMEMORY_ALLKEYS_RANDOM;
+            if ((volatile_only ? kvtableVolatileSize(db->keyspace) :
+                                 kvtableSize(db->keyspace)) == 0) continue;
 
             /* volatile-random and allkeys-random policy */
             // 随机算法
             if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM ||
                 server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_RANDOM)
             {
-                de = dictGetRandomKey(dict);
-                bestkey = dictGetKey(de);
+                e = volatile_only ? kvtableGetRandomVolatile(db->keyspace) :
+                                    kvtableGetFairRandomEntry(db->keyspace);
+                bestkey = kvtableGetKey(e);
             }
 
-            /* volatile-lru and allkeys-lru policy */
-            // LRU 算法
+            /* volatile-lru, allkeys-lru, volatile-lfu and allkeys-lfu */
+            // LRU 和 LFU 算法
             else if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
+                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU ||
+                REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
             {
-                for (k = 0; k < server.maxmemory_samples; k++) {
-                    sds thiskey;
-                    long thisval;
-                    robj *o;
-
-                    de = dictGetRandomKey(dict);
-                    thiskey = dictGetKey(de);
-                    /* When policy is volatile-lru we need an additional lookup
-                     * to locate the real key, as dict is set to db->expires. */
-                    if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
-                        de = dictFind(db->dict, thiskey);
-                    o = dictGetVal(de);
-                    thisval = estimateObjectIdleTime(o);
-
-                    /* Higher idle time is better candidate for deletion */
-                    if (bestkey == NULL || thisval > bestval) {
-                        bestkey = thiskey;
-                        bestval = thisval;
+                struct evictionPoolEntry *pool = db->eviction_pool;
+
+                while(bestkey == NULL) {
+                    evictionPoolPopulate(db->keyspace, volatile_only,
+                                         db->eviction_pool);
+                    /* Go backward from best to worst element to evict. */
+                    // 从闲置时间最长的候选键开始查找
+                    for (k = REDIS_EVICTION_POOL_SIZE-1; k >= 0; k--) {
+                        if (pool[k].key == NULL) continue;
+                        e = kvtableFind(db->keyspace,pool[k].key);
+
+                        /* Remove the entry from the pool. */
+                        sdsfree(pool[k].key);
+                        /* Shift all elements on its right to left. */
+                        memmove(pool+k,pool+k+1,
+                            sizeof(pool[0])*(REDIS_EVICTION_POOL_SIZE-k-1));
+                        /* Clear the element on the right which is empty
+                         * since we shifted one position to the left.  */
+                        pool[REDIS_EVICTION_POOL_SIZE-1].key = NULL;
+                        pool[REDIS_EVICTION_POOL_SIZE-1].idle = 0;
+
+                        /* If the key exists (and for the volatile-*
+                         * policies, still has an expire) is our pick.
+                         * Otherwise it is a ghost and we need to try the
+                         * next element. */
+                        // 键可能已经被删除了（或者被移除了过期时间），
+                        // 这时尝试下一个候选键
+                        if (e && (!volatile_only ||
+                                  kvtableGetExpire(e) != KVTABLE_NO_EXPIRE))
+                        {
+                            bestkey = kvtableGetKey(e);
+                            break;
+                        } else {
+                            /* Ghost... */
+                            continue;
+                        }
                     }
                 }
             }
@@ -2742,13 +3203,24 @@ int freeMemoryIfNeeded(void) {
             /* volatile-ttl */
             // TTL 算法
             else if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_TTL) {
-                for (k = 0; k < server.maxmemory_samples; k++) {
+                kvEntry *_samples[EVICTION_SAMPLES_ARRAY_SIZE];
+                kvEntry **samples;
+                int count;
+
+                if (server.maxmemory_samples <= EVICTION_SAMPLES_ARRAY_SIZE)
+                    samples = _samples;
+                else
+                    samples = zmalloc(sizeof(samples[0])*
+                                      server.maxmemory_samples);
+                count = kvtableGetSomeVolatile(db->keyspace,samples,
+                                               server.maxmemory_samples);
+                for (k = 0; k < count; k++) {
                     sds thiskey;
-                    long thisval;
+                    long long thisval;
 
-                    de = dictGetRandomKey(dict);
-                    thiskey = dictGetKey(de);
-                    thisval = (long) dictGetVal(de);
+                    e = samples[k];
+                    thiskey = kvtableGetKey(e);
+                    thisval = kvtableGetExpire(e);
 
                     /* Expire sooner (minor expire unix timestamp) is better
                      * candidate for deletion */
@@ -2757,6 +3229,7 @@ int freeMemoryIfNeeded(void) {
                         bestval = thisval;
                     }
                 }
+                if (samples != _samples) zfree(samples);
             }
 
             /* Finally remove the selected key. */
@@ -54,11 +54,15 @@
 #include "ae.h"      /* Event driven programming library */
 #include "sds.h"     /* Dynamic safe strings */
 #include "dict.h"    /* Hash tables */
+#include "kvtable.h" /* Keyspace tables */
 #include "adlist.h"  /* Linked lists */
 #include "zmalloc.h" /* total memory usage aware version of malloc/free */
 #include "anet.h"    /* Networking the easy way */
 #include "ziplist.h" /* Compact list data structure */
+#include "listpack.h" /* Compact list of strings, no cascading updates */
+#include "quicklist.h" /* Lists are encoded as linked lists of ziplists */
 #include "intset.h"  /* Compact integer set structure */
+#include "roaring.h" /* Compressed bitmaps for sparse SETBIT strings */
 #include "version.h" /* Version macro */
 #include "util.h"    /* Misc functions useful in many places */
 
@@ -78,8 +82,18 @@
 // 数据库数量
 #define REDIS_DEFAULT_DBNUM     16
 #define REDIS_CONFIGLINE_MAX    1024
-#define REDIS_EXPIRELOOKUPS_PER_CRON    10 /* lookup 10 expires per loop */
+#define REDIS_EXPIRELOOKUPS_PER_CRON    20 /* lookup 20 expires per loop */
 #define REDIS_EXPIRELOOKUPS_TIME_PERC   25 /* CPU max % for keys collection */
+// 快速过期周期的最大执行时长（微秒）
+#define REDIS_EXPIRELOOKUPS_FAST_DURATION 1000 /* Microseconds */
+// 每次过期周期处理的数据库数量
+#define REDIS_DBCRON_DBS_PER_CALL 16
+
+/* Active expire cycle types: the slow cycle runs from serverCron, the fast
+ * one from beforeSleep when the previous cycle ran out of time. */
+// 过期周期的类型
+#define REDIS_EXPIRE_CYCLE_SLOW 0
+#define REDIS_EXPIRE_CYCLE_FAST 1
 // 每次事件执行时最大的可写入字节数
 // 写入超过这个值的写时间会被中断，等待下次继续写
 // 从而避免大回复独占服务器时间
@@ -88,6 +102,7 @@
 // 最大共享整数数值
 #define REDIS_SHARED_INTEGERS 10000
 #define REDIS_SHARED_BULKHDR_LEN 32
+#define REDIS_LONGSTR_SIZE      21 /* Bytes needed for long -> str */
 #define REDIS_MAX_LOGMSG_LEN    1024 /* Default maximum length of syslog messages */
 #define REDIS_AOF_REWRITE_PERC  100
 #define REDIS_AOF_REWRITE_MIN_SIZE (1024*1024)
@@ -99,7 +114,19 @@
 #define REDIS_DEFAULT_SLAVE_PRIORITY 100
 #define REDIS_REPL_TIMEOUT 60
 #define REDIS_REPL_PING_SLAVE_PERIOD 10
+#define REDIS_DEFAULT_REPL_BACKLOG_SIZE (1024*1024)    /* 1mb */
+#define REDIS_DEFAULT_REPL_BACKLOG_TIME_LIMIT (60*60)  /* 1 hour */
+#define REDIS_REPL_BACKLOG_MIN_SIZE (1024*16)          /* 16k */
+#define REDIS_DEFAULT_REPL_DISKLESS_SYNC 0
+#define REDIS_DEFAULT_REPL_DISKLESS_SYNC_DELAY 5
+#define REDIS_DEFAULT_SLAVE_ASYNC_LOAD 0
+#define REDIS_DEFAULT_SLAVE_LAZY_FLUSH 0
+#define REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL 0
+#define REDIS_LAZYFREE_THRESHOLD 64 /* Free effort to use the lazyfree thread */
+#define REDIS_ASYNC_LOAD_STEP_USEC 2000 /* Max time spent per async load step */
+#define REDIS_ASYNC_LOAD_PERIOD 1       /* Milliseconds between two steps */
 #define REDIS_RUN_ID_SIZE 40
+#define REDIS_EOF_MARK_SIZE 40
 #define REDIS_OPS_SEC_SAMPLES 16
 
 /* Protocol and I/O related defines */
@@ -135,6 +162,7 @@
 #define REDIS_SET 2
 #define REDIS_ZSET 3
 #define REDIS_HASH 4
+#define REDIS_STREAM 5
 
 /*
  * 对象编码
@@ -146,10 +174,15 @@
 #define REDIS_ENCODING_INT 1     /* Encoded as integer */
 #define REDIS_ENCODING_HT 2      /* Encoded as hash table */
 #define REDIS_ENCODING_ZIPMAP 3  /* Encoded as zipmap */
-#define REDIS_ENCODING_LINKEDLIST 4 /* Encoded as regular linked list */
+#define REDIS_ENCODING_LINKEDLIST 4 /* No longer used: old list encoding. */
 #define REDIS_ENCODING_ZIPLIST 5 /* Encoded as ziplist */
 #define REDIS_ENCODING_INTSET 6  /* Encoded as intset */
 #define REDIS_ENCODING_SKIPLIST 7  /* Encoded as skiplist */
+#define REDIS_ENCODING_QUICKLIST 8 /* Encoded as linked list of ziplists */
+#define REDIS_ENCODING_EMBSTR 9  /* Embedded sds string encoding */
+#define REDIS_ENCODING_LISTPACK 10 /* Encoded as listpack */
+#define REDIS_ENCODING_ROARING 11 /* Encoded as roaring bitmap */
+#define REDIS_ENCODING_STREAM 12 /* Encoded as listpacks indexed by ID */
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -198,6 +231,25 @@
 #define REDIS_CLOSE_ASAP (1<<10)/* Close this client ASAP */
 #define REDIS_UNIX_SOCKET (1<<11) /* Client connected via Unix domain socket */
 #define REDIS_DIRTY_EXEC (1<<12)  /* EXEC will fail for errors while queueing */
+#define REDIS_MASTER_FORCE_REPLY (1<<13)  /* Queue replies even if is master */
+#define REDIS_PRE_PSYNC (1<<14)   /* Instance don't understand PSYNC. */
+#define REDIS_PENDING_WRITE (1<<15) /* Client has output to send but a write
+                                       handler is yet not installed. */
+#define REDIS_PENDING_READ (1<<16)  /* The client has pending reads and was put
+                                       in the list of clients we can read
+                                       from. */
+#define REDIS_PENDING_COMMAND (1<<17) /* The client has a command parsed by an
+                                         I/O thread, ready to be executed. */
+#define REDIS_IO_ERROR (1<<18)    /* An I/O thread got an error or EOF on the
+                                     socket: free the client ASAP. */
+
+/* Threaded I/O */
+// I/O 线程的最大数量
+#define REDIS_IO_THREADS_MAX_NUM 128
+#define REDIS_IO_THREADS_OP_READ 0
+#define REDIS_IO_THREADS_OP_WRITE 1
+#define REDIS_DEFAULT_IO_THREADS_NUM 1  /* Single threaded by default. */
+#define REDIS_DEFAULT_IO_THREADS_DO_READS 0
 
 /* Client request types */
 #define REDIS_REQ_INLINE 1
@@ -218,8 +270,9 @@
 #define REDIS_REPL_CONNECT 1 /* Must connect to master */
 #define REDIS_REPL_CONNECTING 2 /* Connecting to master */
 #define REDIS_REPL_RECEIVE_PONG 3 /* Wait for PING reply */
-#define REDIS_REPL_TRANSFER 4 /* Receiving .rdb from master */
-#define REDIS_REPL_CONNECTED 5 /* Connected to master */
+#define REDIS_REPL_RECEIVE_PSYNC 4 /* Wait for PSYNC reply */
+#define REDIS_REPL_TRANSFER 5 /* Receiving .rdb from master */
+#define REDIS_REPL_CONNECTED 6 /* Connected to master */
 
 /* Synchronous read timeout - slave side */
 #define REDIS_REPL_SYNCIO_TIMEOUT 5
@@ -236,6 +289,15 @@
 #define REDIS_REPL_SEND_BULK 5 /* master is sending the bulk DB */
 #define REDIS_REPL_ONLINE 6 /* bulk DB already transmitted, receive updates */
 
+/* Slave capabilities, announced with REPLCONF capa. */
+#define REDIS_SLAVE_CAPA_NONE 0
+#define REDIS_SLAVE_CAPA_EOF (1<<0) /* Can parse the RDB EOF streaming format. */
+
+/* Kind of BGSAVE child currently running. */
+#define REDIS_RDB_CHILD_TYPE_NONE 0
+#define REDIS_RDB_CHILD_TYPE_DISK 1     /* RDB is written to disk. */
+#define REDIS_RDB_CHILD_TYPE_SOCKET 2   /* RDB is written to slave socket. */
+
 /* List related stuff 
  *
  * 列表头/尾
@@ -282,12 +344,19 @@
  */
 #define REDIS_HASH_MAX_ZIPLIST_ENTRIES 512
 #define REDIS_HASH_MAX_ZIPLIST_VALUE 64
-#define REDIS_LIST_MAX_ZIPLIST_ENTRIES 512
-#define REDIS_LIST_MAX_ZIPLIST_VALUE 64
+#define REDIS_LIST_MAX_ZIPLIST_SIZE -2
+#define REDIS_LIST_COMPRESS_DEPTH 0
 #define REDIS_SET_MAX_INTSET_ENTRIES 512
 #define REDIS_ZSET_MAX_ZIPLIST_ENTRIES 128
 #define REDIS_ZSET_MAX_ZIPLIST_VALUE 64
 
+/* HyperLogLog defines */
+#define REDIS_DEFAULT_HLL_SPARSE_MAX_BYTES 3000
+
+/* Stream defines */
+#define REDIS_STREAM_NODE_MAX_BYTES 4096
+#define REDIS_STREAM_NODE_MAX_ENTRIES 100
+
 /* Sets operations codes 
  *
  * 集合操作代号
@@ -303,6 +372,24 @@
 #define REDIS_MAXMEMORY_ALLKEYS_LRU 3
 #define REDIS_MAXMEMORY_ALLKEYS_RANDOM 4
 #define REDIS_MAXMEMORY_NO_EVICTION 5
+#define REDIS_MAXMEMORY_VOLATILE_LFU 6
+#define REDIS_MAXMEMORY_ALLKEYS_LFU 7
+
+/* True if the maxmemory policy uses the robj lru bits as LFU counter. */
+// 是否正在使用 LFU 淘汰策略
+#define REDIS_MAXMEMORY_IS_LFU(policy) \
+    ((policy) == REDIS_MAXMEMORY_VOLATILE_LFU || \
+     (policy) == REDIS_MAXMEMORY_ALLKEYS_LFU)
+
+/* LFU defaults. With LFU policies the 24 bits of robj->lru are split into
+ * 16 bits of access time, in minutes, and an 8 bits logarithmic access
+ * counter. New objects start with REDIS_LFU_INIT_VAL so that they have a
+ * chance to accumulate accesses before being evicted. */
+// 使用 LFU 时，lru 的高 16 位保存分钟精度的访问时间，
+// 低 8 位保存对数访问计数器
+#define REDIS_LFU_INIT_VAL 5
+#define REDIS_DEFAULT_LFU_LOG_FACTOR 10
+#define REDIS_DEFAULT_LFU_DECAY_TIME 1
 
 /* Scripting */
 #define REDIS_LUA_TIME_LIMIT 5000 /* milliseconds */
@@ -347,8 +434,9 @@
 /* A redis object, that is a type able to hold a string / list / set */
 
 /* The actual Redis Object */
-#define REDIS_LRU_CLOCK_MAX ((1<<21)-1) /* Max value of obj->lru */
-#define REDIS_LRU_CLOCK_RESOLUTION 10 /* LRU clock resolution in seconds */
+#define REDIS_LRU_BITS 24
+#define REDIS_LRU_CLOCK_MAX ((1<<REDIS_LRU_BITS)-1) /* Max value of obj->lru */
+#define REDIS_LRU_CLOCK_RESOLUTION 1000 /* LRU clock resolution in ms */
 /*
  * Redis 对象
  */
@@ -357,14 +445,11 @@ typedef struct redisObject {
     // 类型
     unsigned type:4;        
 
-    // 不使用(对齐位)
-    unsigned notused:2;
-
     // 编码方式
     unsigned encoding:4;
 
     // LRU 时间（相对于 server.lruclock）
-    unsigned lru:22;
+    unsigned lru:REDIS_LRU_BITS; /* lru time (relative to server.lruclock) */
 
     // 引用计数
     int refcount;
@@ -388,20 +473,45 @@ typedef struct redisObject {
     _var.ptr = _ptr; \
 } while(0);
 
+/* True if the string object is represented by an sds string, either RAW
+ * or EMBSTR encoded. */
+// 字符串对象是否以 sds 保存（RAW 或者 EMBSTR 编码）
+#define sdsEncodedObject(objptr) (objptr->encoding == REDIS_ENCODING_RAW || objptr->encoding == REDIS_ENCODING_EMBSTR)
+
+#include "stream.h" /* Stream data type, needs robj */
+
 /*
  * 数据库结构
  */
+/* To improve the quality of the LRU approximation we take a set of keys
+ * that are good candidate for eviction across freeMemoryIfNeeded() calls.
+ *
+ * Entries inside the eviction pool are taken ordered by idle time, putting
+ * greater idle times to the right (ascending order).
+ *
+ * Empty entries have the key pointer set to NULL. */
+/*
+ * 淘汰候选池中的元素，按闲置时间从小到大排列
+ */
+#define REDIS_EVICTION_POOL_SIZE 16
+struct evictionPoolEntry {
+    // 对象的闲置时间
+    unsigned long long idle;    /* Object idle time. */
+    // 键名
+    sds key;                    /* Key name. */
+};
+
 typedef struct redisDb {
-    // key space，包括键值对象
-    dict *dict;                 /* The keyspace for this DB */
-    // 保存 key 的过期时间
-    dict *expires;              /* Timeout of keys with a timeout set */
+    // key space，包括键值对象以及 key 的过期时间
+    kvtable *keyspace;          /* The keys, values and timeouts of this DB */
     // 正因为某个/某些 key 而被阻塞的客户端
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP) */
     // 某个/某些接收到 PUSH 命令的阻塞 key
     dict *ready_keys;           /* Blocked keys that received a PUSH */
     // 正在监视某个/某些 key 的所有客户端
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
+    // 淘汰候选池
+    struct evictionPoolEntry *eviction_pool;    /* Eviction pool of keys */
     // 数据库的号码
     int id;
 } redisDb;
@@ -433,20 +543,41 @@ typedef struct multiState {
  * 记录客户端的阻塞状态
  */
 typedef struct blockingState {
+    // 阻塞的类型：列表或者流
+    int btype;              /* REDIS_BPOP_LIST or REDIS_BPOP_STREAM. */
+
     // 阻塞客户端的任意多个 key
+    // 对于流，值是客户端等待的 ID ：只返回大于这个 ID 的项
     dict *keys;             /* The keys we are waiting to terminate a blocking
-                             * operation such as BLPOP. Otherwise NULL. */
-    // 超时时间
-    // 如果 UNIX 的当前时间大于等于这个值的话，
+                             * operation such as BLPOP or XREAD. For XREAD
+                             * the value is the streamID we are waiting
+                             * entries greater than. */
+    // 超时时间（毫秒）
+    // 如果当前时间大于等于这个值的话，
     // 那么取消对客户端的阻塞
-    time_t timeout;         /* Blocking operation timeout. If UNIX current time
-                             * is >= timeout then the operation timed out. */
+    long long timeout;      /* Blocking operation timeout. If the current time
+                             * in milliseconds is >= timeout then the
+                             * operation timed out. */
     // 在阻塞被取消时接受元素的 key
     // 只用于 BRPOPLPUSH 命令
     robj *target;           /* The key that should receive the element,
                              * for BRPOPLPUSH. */
+
+    /* XREAD and XREADGROUP options. */
+    size_t xread_count;     /* Max number of entries to return. */
+    robj *xread_group;      /* XREADGROUP group name, otherwise NULL. */
+    robj *xread_consumer;   /* XREADGROUP consumer name. */
+    int xread_group_noack;  /* XREADGROUP NOACK option. */
 } blockingState;
 
+/* Blocking operation types, see blockingState.btype. */
+#define REDIS_BPOP_LIST 1       /* BLPOP & co. */
+#define REDIS_BPOP_STREAM 2     /* XREAD and XREADGROUP. */
+
+/* Units for getTimeoutFromObjectOrReply(). */
+#define REDIS_UNIT_SECONDS 0
+#define REDIS_UNIT_MILLISECONDS 1
+
 /* The following structure represents a node in the server.ready_keys list,
  * where we accumulate all the keys that had clients blocked with a blocking
  * operation such as B[LR]POP, but received new data in the context of the
@@ -510,13 +641,15 @@ typedef struct redisClient {
 
     // 统计数据
     int sentlen;
+    // I/O 线程已经完整发送，但仍未释放的回复对象数量
+    int io_sent_objects;    /* Reply objects sent by an I/O thread, still to
+                               be removed from the reply list. */
     time_t ctime;           /* Client creation time */
     time_t lastinteraction; /* time of the last interaction, used for timeout */
     time_t obuf_soft_limit_reached_time;
     int flags;              /* REDIS_SLAVE | REDIS_MONITOR | REDIS_MULTI ... */
 
     // 复制功能相关
-    int slaveseldb;         /* slave selected db, if this client is a slave */
     int authenticated;      /* when requirepass is non-NULL */
     // 客户端当前的同步状态
     int replstate;          /* replication state if this is a slave */
@@ -527,6 +660,20 @@ typedef struct redisClient {
     // 同步数据库文件的大小
     off_t repldbsize;       /* replication DB file size */
     int slave_listening_port; /* As configured with: SLAVECONF listening-port */
+    // 主节点客户端：已经从复制流中读入的偏移量
+    long long reploff;      /* replication offset if this is our master */
+    // 附属节点通过 REPLCONF ACK 确认的偏移量
+    long long repl_ack_off; /* replication ack offset, if this is a slave */
+    long long repl_ack_time;/* replication ack time, if this is a slave */
+    // 执行 FULLRESYNC 时，附属节点所对应的复制偏移量
+    long long psync_initial_offset; /* FULLRESYNC reply offset other slaves
+                                       copying this slave output buffer
+                                       should use. */
+    char replrunid[REDIS_RUN_ID_SIZE+1]; /* master run id if this is a master */
+    // 附属节点的能力，由 REPLCONF capa 告知
+    int slave_capa;         /* Slave capabilities: REDIS_SLAVE_CAPA_* bitwise OR. */
+    // 无盘复制：收到附属节点的第一个 ACK 之后才开始发送复制流
+    int repl_put_online_on_ack; /* Install slave write handler on ACK. */
 
     // 事务实现
     multiState mstate;      /* MULTI/EXEC state */
@@ -561,12 +708,12 @@ struct saveparam {
 struct sharedObjectsStruct {
     robj *crlf, *ok, *err, *emptybulk, *czero, *cone, *cnegone, *pong, *space,
     *colon, *nullbulk, *nullmultibulk, *queued,
-    *emptymultibulk, *wrongtypeerr, *nokeyerr, *syntaxerr, *sameobjecterr,
+    *emptymultibulk, *emptyscan, *wrongtypeerr, *nokeyerr, *syntaxerr, *sameobjecterr,
     *outofrangeerr, *noscripterr, *loadingerr, *slowscripterr, *bgsaveerr,
     *masterdownerr, *roslaveerr, *execaborterr,
     *oomerr, *plus, *messagebulk, *pmessagebulk, *subscribebulk,
     *unsubscribebulk, *psubscribebulk, *punsubscribebulk, *del, *rpop, *lpop,
-    *lpush,
+    *lpush, *minstring, *maxstring,
     *select[REDIS_SHARED_SELECT_CMDS],
     *integers[REDIS_SHARED_INTEGERS],
     *mbulkhdr[REDIS_SHARED_BULKHDR_LEN], /* "*<value>\r\n" */
@@ -790,8 +937,7 @@ struct redisServer {
     aeEventLoop *el;
 
     // LRU
-    unsigned lruclock:22;       /* Clock incrementing every minute, for LRU */
-    unsigned lruclock_padding:10;
+    unsigned lruclock:REDIS_LRU_BITS; /* Clock for LRU eviction */
 
     // 关闭标志
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
@@ -835,6 +981,10 @@ struct redisServer {
     list *clients;              /* List of active clients */
     // 所有等待关闭的客户端
     list *clients_to_close;     /* Clients to close asynchronously */
+    // 有回复等待发送的客户端
+    list *clients_pending_write; /* There is to write or install handler. */
+    // 有数据等待 I/O 线程读入的客户端
+    list *clients_pending_read;  /* Client has pending read socket buffers. */
     // 所有附属节点和 MONITOR
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     // 当前客户端，只在创建崩溃报告时使用
@@ -848,10 +998,14 @@ struct redisServer {
     off_t loading_total_bytes;
     off_t loading_loaded_bytes;
     time_t loading_start_time;
+    // 是否正在异步载入主节点发来的 RDB （旧数据集仍然可读）
+    int async_loading;          /* Loading the master RDB in the background */
+    // 是否由后台线程释放 DEL 、过期和覆盖等操作删除的大对象
+    int lazyfree_lazy_server_del; /* Free deleted values in background */
 
     /* Fast pointers to often looked up command */
     struct redisCommand *delCommand, *multiCommand, *lpushCommand, *lpopCommand,
-                        *rpopCommand;
+                        *rpopCommand, *xreadgroupCommand;
 
     /* Fields used only for stats */
     time_t stat_starttime;          /* Server start time */
@@ -859,11 +1013,19 @@ struct redisServer {
     long long stat_numconnections;  /* Number of connections received */
     long long stat_expiredkeys;     /* Number of expired keys */
     long long stat_evictedkeys;     /* Number of evicted keys (maxmemory) */
+    double stat_expired_stale_perc; /* Percentage of keys probably expired */
+    long long stat_expired_time_cap_reached_count; /* Early expire cycle stops.*/
+    long long stat_expire_cycle_time_used; /* Cumulative microseconds used. */
     long long stat_keyspace_hits;   /* Number of successful lookups of keys */
     long long stat_keyspace_misses; /* Number of failed lookups of keys */
     size_t stat_peak_memory;        /* Max used memory record */
     long long stat_fork_time;       /* Time needed to perform latets fork() */
     long long stat_rejected_conn;   /* Clients rejected because of maxclients */
+    long long stat_sync_full;       /* Number of full resyncs with slaves. */
+    long long stat_sync_partial_ok; /* Number of accepted PSYNC requests. */
+    long long stat_sync_partial_err;/* Number of unaccepted PSYNC requests. */
+    long long stat_io_reads_processed;  /* Reads performed by I/O threads. */
+    long long stat_io_writes_processed; /* Writes performed by I/O threads. */
 
     // 保存慢查询日志的链表
     list *slowlog;                  /* SLOWLOG list of commands */
@@ -916,6 +1078,10 @@ struct redisServer {
     long long dirty;                /* Changes to DB from the last save */
     long long dirty_before_bgsave;  /* Used to restore dirty on failed BGSAVE */
     pid_t rdb_child_pid;            /* PID of RDB saving child */
+    // 子进程的类型：写入磁盘，还是直接写入附属节点的套接字
+    int rdb_child_type;             /* Type of save by active child. */
+    int rdb_pipe_write_result_to_child; /* RDB pipes used to return the state */
+    int rdb_pipe_read_result_from_child; /* of each slave in diskless SYNC. */
     struct saveparam *saveparams;   /* Save points array for RDB */
     int saveparamslen;              /* Number of saving points */
     char *rdb_filename;             /* Name of RDB file */
@@ -935,6 +1101,25 @@ struct redisServer {
     char *syslog_ident;             /* Syslog ident */
     int syslog_facility;            /* Syslog facility */
 
+    /* Replication (master) */
+    // 最后一次向附属节点发送的 SELECT 命令所指定的数据库
+    int slaveseldb;                 /* Last SELECTed DB in replication output */
+    // 全局复制偏移量
+    long long master_repl_offset;   /* Global replication offset */
+    // 复制积压缓冲区（环形），用于部分重同步
+    char *repl_backlog;             /* Replication backlog for partial syncs */
+    long long repl_backlog_size;    /* Backlog circular buffer size */
+    long long repl_backlog_histlen; /* Backlog actual data length */
+    long long repl_backlog_idx;     /* Backlog circular buffer current offset */
+    long long repl_backlog_off;     /* Replication offset of first byte in the
+                                       backlog buffer. */
+    time_t repl_backlog_time_limit; /* Time without slaves after the backlog
+                                       gets released. */
+    time_t repl_no_slaves_since;    /* We have no slaves since that time.
+                                       Only valid if server.slaves len is 0. */
+    // 是否使用无盘复制：子进程直接将 RDB 写入附属节点的套接字
+    int repl_diskless_sync;         /* Send RDB to slaves sockets directly. */
+    int repl_diskless_sync_delay;   /* Delay to start a diskless repl BGSAVE. */
     /* Slave specific fields */
     char *masterauth;               /* AUTH with this password with master */
     char *masterhost;               /* Hostname of master */
@@ -952,15 +1137,37 @@ struct redisServer {
     char *repl_transfer_tmpfile; /* Slave-> master SYNC temp file name */
     time_t repl_transfer_lastio; /* Unix time of the latest read, for timeout */
     int repl_serve_stale_data; /* Serve stale data when link is down? */
+    // 是否在事件循环中分步载入主节点发来的 RDB
+    int repl_slave_async_load;  /* Load master RDB without blocking reads? */
+    long long repl_async_load_timer; /* Time event id driving the async load */
+    // 完整重同步时是否在后台线程释放旧数据集
+    int repl_slave_lazy_flush;  /* Lazy FLUSHALL before loading master data */
     int repl_slave_ro;          /* Slave is read only? */
     time_t repl_down_since; /* Unix time at which link with master went down */
     int slave_priority;             /* Reported in INFO and used by Sentinel. */
+    /* The following two fields is where we store master PSYNC runid and offset
+     * while the PSYNC is in progress. At the end we'll copy the fields into
+     * the server->master client structure. */
+    char repl_master_runid[REDIS_RUN_ID_SIZE+1];  /* Master run id for PSYNC. */
+    long long repl_master_initial_offset;         /* Master PSYNC offset. */
+    // 连接断开后被缓存起来的主节点客户端，用于部分重同步
+    redisClient *cached_master; /* Cached master to be reused for PSYNC. */
 
     /* Limits */
     unsigned int maxclients;        /* Max number of simultaneous clients */
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key evition */
     int maxmemory_samples;          /* Pricision of random sampling */
+    // LFU 计数器的对数因子
+    int lfu_log_factor;             /* LFU logarithmic counter factor. */
+    // LFU 计数器衰减周期（分钟）
+    int lfu_decay_time;             /* LFU counter decay factor. */
+
+    /* Threaded I/O */
+    // I/O 线程数量，包括主线程，1 表示不使用 I/O 线程
+    int io_threads_num;         /* Number of I/O threads to use. */
+    // 是否也使用 I/O 线程读入和解析命令
+    int io_threads_do_reads;    /* Read and parse from I/O threads? */
 
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
@@ -977,11 +1184,14 @@ struct redisServer {
     /* Zip structure config, see redis.conf for more information  */
     size_t hash_max_ziplist_entries;
     size_t hash_max_ziplist_value;
-    size_t list_max_ziplist_entries;
-    size_t list_max_ziplist_value;
+    int list_max_ziplist_size;
+    int list_compress_depth;
     size_t set_max_intset_entries;
     size_t zset_max_ziplist_entries;
     size_t zset_max_ziplist_value;
+    size_t hll_sparse_max_bytes;
+    size_t stream_node_max_bytes;
+    size_t stream_node_max_entries;
     time_t unixtime;        /* Unix time sampled every second. */
 
     /* Pubsub */
@@ -1080,15 +1290,13 @@ typedef struct {
     robj *subject;
     unsigned char encoding;
     unsigned char direction; /* Iteration direction */
-    unsigned char *zi;
-    listNode *ln;
+    quicklistIter *iter;
 } listTypeIterator;
 
 /* Structure for an entry while iterating over a list. */
 typedef struct {
     listTypeIterator *li;
-    unsigned char *zi;  /* Entry in ziplist */
-    listNode *ln;       /* Entry in linked list */
+    quicklistEntry entry; /* Entry in quicklist */
 } listTypeEntry;
 
 /* Structure to hold set iteration abstraction. */
@@ -1129,8 +1337,10 @@ extern struct redisServer server;
 extern struct sharedObjectsStruct shared;
 extern dictType setDictType;
 extern dictType zsetDictType;
+extern dictType streamNamesDictType;
+extern dictType objectKeyPointerValueDictType;
 extern dictType clusterNodesDictType;
-extern dictType dbDictType;
+extern kvtableType dbKvtableType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
@@ -1150,8 +1360,12 @@ void exitFromChild(int retcode);
 redisClient *createClient(int fd);
 void closeTimedoutClients(void);
 void freeClient(redisClient *c);
+void freeClientAsync(redisClient *c);
 void resetClient(redisClient *c);
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
+int writeToClient(int fd, redisClient *c, int handler_installed);
+int clientHasPendingReplies(redisClient *c);
+int handleClientsWithPendingWrites(void);
 void addReply(redisClient *c, robj *obj);
 void *addDeferredMultiBulkLength(redisClient *c);
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length);
@@ -1174,14 +1388,20 @@ void addReplyLongLong(redisClient *c, long long ll);
 void addReplyMultiBulkLen(redisClient *c, long length);
 void copyClientOutputBuffer(redisClient *dst, redisClient *src);
 void *dupClientReplyValue(void *o);
+size_t getStringObjectSdsUsedMemory(robj *o);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 sds getClientInfoString(redisClient *client);
 sds getAllClientsInfoString(void);
 void rewriteClientCommandVector(redisClient *c, int argc, ...);
 void rewriteClientCommandArgument(redisClient *c, int i, robj *newval);
+void replaceClientCommandVector(redisClient *c, int argc, robj **argv);
 unsigned long getClientOutputBufferMemoryUsage(redisClient *c);
 void freeClientsInAsyncFreeQueue(void);
+int processEventsWhileBlocked(void);
+void initThreadedIO(void);
+int handleClientsWithPendingReadsUsingThreads(void);
+int handleClientsWithPendingWritesUsingThreads(void);
 void asyncCloseClientOnOutputBufferLimitReached(redisClient *c);
 int getClientLimitClassByName(char *name);
 char *getClientLimitClassName(int class);
@@ -1199,7 +1419,6 @@ void addReplyStatusFormat(redisClient *c, const char *fmt, ...);
 #endif
 
 /* List data type */
-void listTypeTryConversion(robj *subject, robj *value);
 void listTypePush(robj *subject, robj *value, int where);
 robj *listTypePop(robj *subject, int where);
 unsigned long listTypeLength(robj *subject);
@@ -1210,9 +1429,11 @@ robj *listTypeGet(listTypeEntry *entry);
 void listTypeInsert(listTypeEntry *entry, robj *value, int where);
 int listTypeEqual(listTypeEntry *entry, robj *o);
 void listTypeDelete(listTypeEntry *entry);
-void listTypeConvert(robj *subject, int enc);
+void blockForKeys(redisClient *c, int btype, robj **keys, int numkeys, long long timeout, robj *target, streamID *ids);
 void unblockClientWaitingData(redisClient *c);
-void handleClientsBlockedOnLists(void);
+void signalKeyAsReady(redisClient *c, robj *key);
+void handleClientsBlockedOnKeys(void);
+int getTimeoutFromObjectOrReply(redisClient *c, robj *object, long long *timeout, int unit);
 void popGenericCommand(redisClient *c, int where);
 
 /* MULTI/EXEC/WATCH... */
@@ -1234,22 +1455,27 @@ void freeListObject(robj *o);
 void freeSetObject(robj *o);
 void freeZsetObject(robj *o);
 void freeHashObject(robj *o);
+void freeStreamObject(robj *o);
 robj *createObject(int type, void *ptr);
 robj *createStringObject(char *ptr, size_t len);
+robj *createRawStringObject(char *ptr, size_t len);
+robj *createEmbeddedStringObject(char *ptr, size_t len);
 robj *dupStringObject(robj *o);
 int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
 robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
+void roaringObjectToRaw(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value);
-robj *createListObject(void);
-robj *createZiplistObject(void);
+robj *createQuicklistObject(void);
 robj *createSetObject(void);
 robj *createIntsetObject(void);
 robj *createHashObject(void);
 robj *createZsetObject(void);
-robj *createZsetZiplistObject(void);
+robj *createZsetListpackObject(void);
+robj *createRoaringObject(void);
+robj *createStreamObject(void);
 int getLongFromObjectOrReply(redisClient *c, robj *o, long *target, const char *msg);
 int checkType(redisClient *c, robj *o, int type);
 int getLongLongFromObjectOrReply(redisClient *c, robj *o, long long *target, const char *msg);
@@ -1260,7 +1486,7 @@ int getLongDoubleFromObjectOrReply(redisClient *c, robj *o, long double *target,
 char *strEncoding(int encoding);
 int compareStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
-unsigned long estimateObjectIdleTime(robj *o);
+unsigned long long estimateObjectIdleTime(robj *o);
 
 /* Synchronous I/O with timeout */
 ssize_t syncWrite(int fd, char *ptr, ssize_t size, long long timeout);
@@ -1270,8 +1496,16 @@ ssize_t syncReadLine(int fd, char *ptr, ssize_t size, long long timeout);
 /* Replication */
 void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc);
 void replicationFeedMonitors(redisClient *c, list *monitors, int dictid, robj **argv, int argc);
-void updateSlavesWaitingBgsave(int bgsaveerr);
+void updateSlavesWaitingBgsave(int bgsaveerr, int type);
 void replicationCron(void);
+void replicationHandleMasterDisconnection(void);
+void replicationCacheMaster(redisClient *c);
+void resizeReplicationBacklog(long long newsize);
+void replicationDiscardCachedMaster(void);
+void replicationResurrectCachedMaster(int newfd);
+void replicationSendAck(void);
+int replicationSetupSlaveForFullResync(redisClient *slave, long long offset);
+void putSlaveOnline(redisClient *slave);
 
 /* Generic persistence functions */
 void startLoading(FILE *fp);
@@ -1305,20 +1539,40 @@ typedef struct {
     int minex, maxex; /* are min or max exclusive? */
 } zrangespec;
 
+/* Struct to hold an inclusive/exclusive range spec by lexicographic
+ * comparison. */
+/*
+ * 用于保存字典序范围的结构
+ */
+typedef struct {
+    // min 和 max 可以是 shared.minstring 或者 shared.maxstring ，
+    // 表示负无穷和正无穷
+    robj *min, *max;  /* May be set to shared.(minstring|maxstring) */
+    // min 和 max 是否包括在内？
+    int minex, maxex; /* are min or max exclusive? */
+} zlexrangespec;
+
 zskiplist *zslCreate(void);
+int zslRandomLevel(void);
 void zslFree(zskiplist *zsl);
 zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj);
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score);
 int zslDelete(zskiplist *zsl, double score, robj *obj);
 zskiplistNode *zslFirstInRange(zskiplist *zsl, zrangespec range);
+unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range);
 double zzlGetScore(unsigned char *sptr);
 void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
 void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
 unsigned int zsetLength(robj *zobj);
+int zsetScore(robj *zobj, robj *member, double *score);
 void zsetConvert(robj *zobj, int encoding);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
+struct evictionPoolEntry *evictionPoolAlloc(void);
+unsigned long LFUGetTimeInMinutes(void);
+unsigned long LFUDecrAndReturn(robj *o);
+void updateLFU(robj *val);
 int processCommand(redisClient *c);
 void setupSignalHandlers(void);
 struct redisCommand *lookupCommand(sds name);
@@ -1362,7 +1616,7 @@ unsigned long hashTypeLength(robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll);
@@ -1370,6 +1624,10 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst);
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what);
 robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key);
 
+/* Stream data type */
+robj *createObjectFromStreamID(streamID *id);
+void serveClientsBlockedOnStreamKey(robj *o, readyList *rl);
+
 /* Pub / Sub */
 int pubsubUnsubscribeAllChannels(redisClient *c, int notify);
 int pubsubUnsubscribeAllPatterns(redisClient *c, int notify);
@@ -1386,6 +1644,7 @@ void resetServerSaveParams();
 int removeExpire(redisDb *db, robj *key);
 void propagateExpire(redisDb *db, robj *key);
 int expireIfNeeded(redisDb *db, robj *key);
+int expireIfNeededAt(redisDb *db, robj *key, long long when);
 long long getExpire(redisDb *db, robj *key);
 void setExpire(redisDb *db, robj *key, long long when);
 robj *lookupKey(redisDb *db, robj *key);
@@ -1395,16 +1654,32 @@ robj *lookupKeyReadOrReply(redisClient *c, robj *key, robj *reply);
 robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply);
 void dbAdd(redisDb *db, robj *key, robj *val);
 void dbOverwrite(redisDb *db, robj *key, robj *val);
+robj *dbUnshareStringValue(redisDb *db, robj *key, robj *o);
 void setKey(redisDb *db, robj *key, robj *val);
 int dbExists(redisDb *db, robj *key);
 robj *dbRandomKey(redisDb *db);
 int dbDelete(redisDb *db, robj *key);
-long long emptyDb();
+int dbSyncDelete(redisDb *db, robj *key);
+#define REDIS_EMPTYDB_NO_FLAGS 0    /* No flags. */
+#define REDIS_EMPTYDB_ASYNC (1<<0)  /* Reclaim memory in another thread. */
+long long emptyDb(int flags);
 int selectDb(redisClient *c, int id);
+int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor);
+void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor);
 void signalModifiedKey(redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
 unsigned int GetKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
 
+/* lazyfree.c -- Background freeing of big values and databases */
+size_t lazyfreeGetFreeEffort(robj *obj);
+size_t lazyfreeGetPendingObjectsCount(void);
+void freeObjAsync(robj *o);
+int dbAsyncDelete(redisDb *db, robj *key);
+void emptyDbAsync(redisDb *db);
+void lazyfreeFreeKeyspaceAsync(kvtable *t);
+void lazyfreeFreeObjectFromBioThread(robj *o);
+void lazyfreeFreeDatabaseFromBioThread(kvtable *t);
+
 /* API to get key arguments from commands */
 #define REDIS_GETKEYS_ALL 0
 #define REDIS_GETKEYS_PRELOAD 1
@@ -1413,6 +1688,7 @@ void getKeysFreeResult(int *result);
 int *noPreloadGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
 int *renameGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
 int *zunionInterGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
+int *xreadGetKeys(struct redisCommand *cmd,robj **argv, int argc, int *numkeys, int flags);
 
 /* Cluster */
 void clusterInit(void);
@@ -1449,6 +1725,7 @@ void setexCommand(redisClient *c);
 void psetexCommand(redisClient *c);
 void getCommand(redisClient *c);
 void delCommand(redisClient *c);
+void unlinkCommand(redisClient *c);
 void existsCommand(redisClient *c);
 void setbitCommand(redisClient *c);
 void getbitCommand(redisClient *c);
@@ -1462,6 +1739,7 @@ void incrbyfloatCommand(redisClient *c);
 void selectCommand(redisClient *c);
 void randomkeyCommand(redisClient *c);
 void keysCommand(redisClient *c);
+void scanCommand(redisClient *c);
 void dbsizeCommand(redisClient *c);
 void lastsaveCommand(redisClient *c);
 void saveCommand(redisClient *c);
@@ -1529,6 +1807,10 @@ void zcardCommand(redisClient *c);
 void zremCommand(redisClient *c);
 void zscoreCommand(redisClient *c);
 void zremrangebyscoreCommand(redisClient *c);
+void zrangebylexCommand(redisClient *c);
+void zrevrangebylexCommand(redisClient *c);
+void zlexcountCommand(redisClient *c);
+void zremrangebylexCommand(redisClient *c);
 void multiCommand(redisClient *c);
 void execCommand(redisClient *c);
 void discardCommand(redisClient *c);
@@ -1550,6 +1832,9 @@ void zremrangebyrankCommand(redisClient *c);
 void zunionstoreCommand(redisClient *c);
 void zinterstoreCommand(redisClient *c);
 void hkeysCommand(redisClient *c);
+void hscanCommand(redisClient *c);
+void sscanCommand(redisClient *c);
+void zscanCommand(redisClient *c);
 void hvalsCommand(redisClient *c);
 void hgetallCommand(redisClient *c);
 void hexistsCommand(redisClient *c);
@@ -1576,6 +1861,31 @@ void scriptCommand(redisClient *c);
 void timeCommand(redisClient *c);
 void bitopCommand(redisClient *c);
 void bitcountCommand(redisClient *c);
+void bitposCommand(redisClient *c);
+void pfselftestCommand(redisClient *c);
+void pfaddCommand(redisClient *c);
+void pfcountCommand(redisClient *c);
+void pfmergeCommand(redisClient *c);
+void pfdebugCommand(redisClient *c);
+void geoaddCommand(redisClient *c);
+void georadiusCommand(redisClient *c);
+void georadiusByMemberCommand(redisClient *c);
+void geohashCommand(redisClient *c);
+void geoposCommand(redisClient *c);
+void geodistCommand(redisClient *c);
+void xaddCommand(redisClient *c);
+void xrangeCommand(redisClient *c);
+void xrevrangeCommand(redisClient *c);
+void xlenCommand(redisClient *c);
+void xdelCommand(redisClient *c);
+void xtrimCommand(redisClient *c);
+void xsetidCommand(redisClient *c);
+void xreadCommand(redisClient *c);
+void xgroupCommand(redisClient *c);
+void xackCommand(redisClient *c);
+void xpendingCommand(redisClient *c);
+void xclaimCommand(redisClient *c);
+void xinfoCommand(redisClient *c);
 void replconfCommand(redisClient *c);
 
 #if defined(__GNUC__)
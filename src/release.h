@@ -0,0 +1,3 @@
+#define REDIS_GIT_SHA1 "4929ac73"
+#define REDIS_GIT_DIRTY "1694"
+#define REDIS_BUILD_ID "vm-1792133457"
@@ -39,11 +39,197 @@
 
 /* ---------------------------------- MASTER -------------------------------- */
 
+/*
+ * 创建复制积压缓冲区
+ */
+void createReplicationBacklog(void) {
+    redisAssert(server.repl_backlog == NULL);
+    server.repl_backlog = zmalloc(server.repl_backlog_size);
+    server.repl_backlog_histlen = 0;
+    server.repl_backlog_idx = 0;
+    /* When a new backlog buffer is created, we increment the replication
+     * offset by one to make sure we'll not be able to PSYNC with any
+     * previous slave. This is needed because we avoid incrementing the
+     * master_repl_offset if no backlog exists nor slaves are attached. */
+    server.master_repl_offset++;
+
+    /* We don't have any data inside our buffer, but virtually the first
+     * byte we have is the next byte that will be generated for the
+     * replication stream. */
+    server.repl_backlog_off = server.master_repl_offset+1;
+}
+
+/* This function is called when the user modifies the replication backlog
+ * size at runtime. It is up to the function to both update the
+ * server.repl_backlog_size and to resize the buffer and setup it so that
+ * it contains the same data as the previous one (possibly less data, but
+ * the most recent bytes, or the same data and more free space in case the
+ * buffer is enlarged). */
+/*
+ * 调整复制积压缓冲区的大小
+ */
+void resizeReplicationBacklog(long long newsize) {
+    if (newsize < REDIS_REPL_BACKLOG_MIN_SIZE)
+        newsize = REDIS_REPL_BACKLOG_MIN_SIZE;
+    if (server.repl_backlog_size == newsize) return;
+
+    server.repl_backlog_size = newsize;
+    if (server.repl_backlog != NULL) {
+        /* What we actually do is to flush the old buffer and realloc a new
+         * empty one. It will refill with new data incrementally.
+         * The reason is that copying a few gigabytes adds latency and even
+         * worse often we need to alloc additional space before freeing the
+         * old buffer. */
+        zfree(server.repl_backlog);
+        server.repl_backlog = zmalloc(server.repl_backlog_size);
+        server.repl_backlog_histlen = 0;
+        server.repl_backlog_idx = 0;
+        /* Next byte we have is... the next since the buffer is emtpy. */
+        server.repl_backlog_off = server.master_repl_offset+1;
+    }
+}
+
+/*
+ * 释放复制积压缓冲区
+ */
+void freeReplicationBacklog(void) {
+    redisAssert(listLength(server.slaves) == 0);
+    zfree(server.repl_backlog);
+    server.repl_backlog = NULL;
+}
+
+/* Add data to the replication backlog.
+ * This function also increments the global replication offset stored at
+ * server.master_repl_offset, because there is no case where we want to feed
+ * the backlog without incrementing the buffer. */
+/*
+ * 将 len 字节的数据写入到环形的复制积压缓冲区中，
+ * 并相应地增加全局复制偏移量。
+ */
+void feedReplicationBacklog(void *ptr, size_t len) {
+    unsigned char *p = ptr;
+
+    server.master_repl_offset += len;
+
+    /* This is a circular buffer, so write as much data we can at every
+     * iteration and rewind the "idx" index if we reach the limit. */
+    while(len) {
+        size_t thislen = server.repl_backlog_size - server.repl_backlog_idx;
+        if (thislen > len) thislen = len;
+        memcpy(server.repl_backlog+server.repl_backlog_idx,p,thislen);
+        server.repl_backlog_idx += thislen;
+        if (server.repl_backlog_idx == server.repl_backlog_size)
+            server.repl_backlog_idx = 0;
+        len -= thislen;
+        p += thislen;
+        server.repl_backlog_histlen += thislen;
+    }
+    if (server.repl_backlog_histlen > server.repl_backlog_size)
+        server.repl_backlog_histlen = server.repl_backlog_size;
+    /* Set the offset of the first byte we have in the backlog. */
+    server.repl_backlog_off = server.master_repl_offset -
+                              server.repl_backlog_histlen + 1;
+}
+
+/* Wrapper for feedReplicationBacklog() that takes Redis string objects
+ * as input. */
+void feedReplicationBacklogWithObject(robj *o) {
+    char llstr[REDIS_LONGSTR_SIZE];
+    void *p;
+    size_t len;
+
+    if (o->encoding == REDIS_ENCODING_INT) {
+        len = ll2string(llstr,sizeof(llstr),(long)o->ptr);
+        p = llstr;
+    } else {
+        len = sdslen(o->ptr);
+        p = o->ptr;
+    }
+    feedReplicationBacklog(p,len);
+}
+
+/*
+ * 将命令传播给所有附属节点，并写入到复制积压缓冲区
+ */
 void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
     listNode *ln;
     listIter li;
-    int j;
+    int j, len;
+    char llstr[REDIS_LONGSTR_SIZE];
+
+    /* If there aren't slaves, and there is no backlog buffer to populate,
+     * we can return ASAP, this function is called only if there is
+     * something useful to do. */
+    if (server.repl_backlog == NULL && listLength(slaves) == 0) return;
+
+    /* We can't have slaves attached and no backlog. */
+    redisAssert(!(listLength(slaves) != 0 && server.repl_backlog == NULL));
+
+    /* Send SELECT command to every slave if needed. */
+    // 复制流中最后一个 SELECT 的数据库和当前数据库不同时，
+    // 先发送一个 SELECT 命令
+    if (server.slaveseldb != dictid) {
+        robj *selectcmd;
+
+        /* For a few DBs we have pre-computed SELECT command. */
+        if (dictid >= 0 && dictid < REDIS_SHARED_SELECT_CMDS) {
+            selectcmd = shared.select[dictid];
+        } else {
+            int dictid_len;
+
+            dictid_len = ll2string(llstr,sizeof(llstr),dictid);
+            selectcmd = createObject(REDIS_STRING,
+                sdscatprintf(sdsempty(),
+                "*2\r\n$6\r\nSELECT\r\n$%d\r\n%s\r\n",
+                dictid_len, llstr));
+        }
+
+        /* Add the SELECT command into the backlog. */
+        if (server.repl_backlog) feedReplicationBacklogWithObject(selectcmd);
+
+        /* Send it to slaves. */
+        listRewind(slaves,&li);
+        while((ln = listNext(&li))) {
+            redisClient *slave = ln->value;
+            // 不要向还在等待 BGSAVE 的附属节点发送命令
+            if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) continue;
+            addReply(slave,selectcmd);
+        }
 
+        if (dictid < 0 || dictid >= REDIS_SHARED_SELECT_CMDS)
+            decrRefCount(selectcmd);
+    }
+    server.slaveseldb = dictid;
+
+    /* Write the command to the replication backlog if any. */
+    // 将命令以协议格式写入到复制积压缓冲区
+    if (server.repl_backlog) {
+        char aux[REDIS_LONGSTR_SIZE+3];
+
+        /* Add the multi bulk reply length. */
+        aux[0] = '*';
+        len = ll2string(aux+1,sizeof(aux)-1,argc);
+        aux[len+1] = '\r';
+        aux[len+2] = '\n';
+        feedReplicationBacklog(aux,len+3);
+
+        for (j = 0; j < argc; j++) {
+            long objlen = stringObjectLen(argv[j]);
+
+            /* We need to feed the buffer with the object as a bulk reply
+             * not just as a plain string, so create the $..CRLF payload len
+             * ad add the final CRLF */
+            aux[0] = '$';
+            len = ll2string(aux+1,sizeof(aux)-1,objlen);
+            aux[len+1] = '\r';
+            aux[len+2] = '\n';
+            feedReplicationBacklog(aux,len+3);
+            feedReplicationBacklogWithObject(argv[j]);
+            feedReplicationBacklog(aux+len+1,2);
+        }
+    }
+
+    /* Write the command to every slave. */
     listRewind(slaves,&li);
     while((ln = listNext(&li))) {
         redisClient *slave = ln->value;
@@ -55,20 +241,6 @@ void replicationFeedSlaves(list *slaves, int dictid, robj **argv, int argc) {
         /* Feed slaves that are waiting for the initial SYNC (so these commands
          * are queued in the output buffer until the intial SYNC completes),
          * or are already in sync with the master. */
-        if (slave->slaveseldb != dictid) {
-            robj *selectcmd;
-
-            if (dictid >= 0 && dictid < REDIS_SHARED_SELECT_CMDS) {
-                selectcmd = shared.select[dictid];
-                incrRefCount(selectcmd);
-            } else {
-                selectcmd = createObject(REDIS_STRING,
-                    sdscatprintf(sdsempty(),"select %d\r\n",dictid));
-            }
-            addReply(slave,selectcmd);
-            decrRefCount(selectcmd);
-            slave->slaveseldb = dictid;
-        }
         addReplyMultiBulkLen(slave,argc);
         for (j = 0; j < argc; j++) addReplyBulk(slave,argv[j]);
     }
@@ -115,8 +287,227 @@ void replicationFeedMonitors(redisClient *c, list *monitors, int dictid, robj **
     decrRefCount(cmdobj);
 }
 
+/* Feed the slave 'c' with the replication backlog starting from the
+ * specified 'offset' up to the end of the backlog. */
 /*
- * 
+ * 将复制积压缓冲区中，从 offset 开始直到缓冲区末尾的数据发送给附属节点 c
+ *
+ * 返回发送数据的字节长度
+ */
+long long addReplyReplicationBacklog(redisClient *c, long long offset) {
+    long long j, skip, len;
+
+    redisLog(REDIS_DEBUG, "[PSYNC] Slave request offset: %lld", offset);
+
+    if (server.repl_backlog_histlen == 0) {
+        redisLog(REDIS_DEBUG, "[PSYNC] Backlog history len is zero");
+        return 0;
+    }
+
+    /* Compute the amount of bytes we need to discard. */
+    skip = offset - server.repl_backlog_off;
+    redisLog(REDIS_DEBUG, "[PSYNC] Skipping: %lld", skip);
+
+    /* Point j to the oldest byte, that is actaully our
+     * server.repl_backlog_off byte. */
+    j = (server.repl_backlog_idx +
+        (server.repl_backlog_size-server.repl_backlog_histlen)) %
+        server.repl_backlog_size;
+
+    /* Discard the amount of data to seek to the specified 'offset'. */
+    j = (j + skip) % server.repl_backlog_size;
+
+    /* Feed slave with data. Since it is a circular buffer we have to
+     * split the reply in two parts if we are cross-boundary. */
+    len = server.repl_backlog_histlen - skip;
+    redisLog(REDIS_DEBUG, "[PSYNC] Reply total length: %lld", len);
+    while(len) {
+        long long thislen =
+            ((server.repl_backlog_size - j) < len) ?
+            (server.repl_backlog_size - j) : len;
+
+        redisLog(REDIS_DEBUG, "[PSYNC] addReply() length: %lld", thislen);
+        addReplySds(c,sdsnewlen(server.repl_backlog + j, thislen));
+        len -= thislen;
+        j = 0;
+    }
+    return server.repl_backlog_histlen - skip;
+}
+
+/* This function handles the PSYNC command from the point of view of a
+ * master receiving a request for partial resynchronization.
+ *
+ * On success return REDIS_OK, otherwise REDIS_ERR is returned and we proceed
+ * with the usual full resync. */
+/*
+ * 尝试对发送 PSYNC 命令的附属节点进行部分重同步
+ *
+ * 成功返回 REDIS_OK ，
+ * 失败返回 REDIS_ERR ，调用者需要执行完整重同步。
+ */
+int masterTryPartialResynchronization(redisClient *c) {
+    long long psync_offset, psync_len;
+    char *master_runid = c->argv[1]->ptr;
+    char buf[128];
+    int buflen;
+
+    /* Is the runid of this master the same advertised by the wannabe slave
+     * via PSYNC? If runid changed this master is a different instance and
+     * there is no way to continue. */
+    // 附属节点之前复制的不是本节点，只能执行完整重同步
+    if (strcasecmp(master_runid, server.runid)) {
+        /* Run id "?" is used by slaves that want to force a full resync. */
+        if (master_runid[0] != '?') {
+            redisLog(REDIS_NOTICE,"Partial resynchronization not accepted: "
+                "Runid mismatch (Client asked for '%s', I'm '%s')",
+                master_runid, server.runid);
+        } else {
+            redisLog(REDIS_NOTICE,"Full resync requested by slave.");
+        }
+        goto need_full_resync;
+    }
+
+    /* We still have the data our slave is asking for? */
+    // 附属节点所需的数据是否仍然保存在复制积压缓冲区中？
+    if (getLongLongFromObject(c->argv[2],&psync_offset) != REDIS_OK)
+        goto need_full_resync;
+    if (!server.repl_backlog ||
+        psync_offset < server.repl_backlog_off ||
+        psync_offset > (server.repl_backlog_off + server.repl_backlog_histlen))
+    {
+        redisLog(REDIS_NOTICE,
+            "Unable to partial resync with the slave for lack of backlog (Slave request was: %lld).", psync_offset);
+        if (psync_offset > server.master_repl_offset) {
+            redisLog(REDIS_WARNING,
+                "Warning: slave tried to PSYNC with an offset that is greater than the master replication offset.");
+        }
+        goto need_full_resync;
+    }
+
+    /* If we reached this point, we are able to perform a partial resync:
+     * 1) Set client state to make it a slave.
+     * 2) Inform the client we can continue with +CONTINUE
+     * 3) Send the backlog data (from the offset to the end) to the slave. */
+    c->flags |= REDIS_SLAVE;
+    c->replstate = REDIS_REPL_ONLINE;
+    c->repl_ack_time = server.unixtime;
+    listAddNodeTail(server.slaves,c);
+    /* We can't use the connection buffers since they are used to accumulate
+     * new commands at this stage. But we are sure the socket send buffer is
+     * emtpy so this write will never fail actually. */
+    buflen = snprintf(buf,sizeof(buf),"+CONTINUE\r\n");
+    if (write(c->fd,buf,buflen) != buflen) {
+        freeClientAsync(c);
+        return REDIS_OK;
+    }
+    psync_len = addReplyReplicationBacklog(c,psync_offset);
+    redisLog(REDIS_NOTICE,
+        "Partial resynchronization request accepted. Sending %lld bytes of backlog starting from offset %lld.", psync_len, psync_offset);
+    return REDIS_OK; /* The caller can return, no full resync needed. */
+
+need_full_resync:
+    /* We need a full resync for some reason... Note that we can't
+     * reply to PSYNC right now if a full SYNC is needed. The reply
+     * must include the master offset at the time the RDB file we transfer
+     * is generated, so we need to delay the reply to that moment. */
+    return REDIS_ERR;
+}
+
+/* Setup the slave for a full resynchronization: the slave is put in the
+ * REDIS_REPL_WAIT_BGSAVE_END state, and, if it supports PSYNC, the
+ * +FULLRESYNC <runid> <offset> reply is sent to it.
+ *
+ * 'offset' is the replication offset of the master at the moment the
+ * RDB that will be transferred to the slave is generated: commands
+ * accumulated into the slave output buffer since then follow that offset.
+ *
+ * On error the slave is scheduled for asynchronous freeing and REDIS_ERR
+ * is returned. */
+/*
+ * 为附属节点设置完整重同步所需的状态，
+ * 并向支持 PSYNC 的附属节点发送 +FULLRESYNC 回复。
+ */
+int replicationSetupSlaveForFullResync(redisClient *slave, long long offset) {
+    char buf[128];
+    int buflen;
+
+    slave->psync_initial_offset = offset;
+    slave->replstate = REDIS_REPL_WAIT_BGSAVE_END;
+    /* We are going to accumulate the incremental changes for this
+     * slave as well. Set slaveseldb to -1 in order to force to re-emit
+     * a SLEECT statement in the replication stream. */
+    server.slaveseldb = -1;
+
+    /* Don't send this reply to slaves that approached us with
+     * the old SYNC command. */
+    if (!(slave->flags & REDIS_PRE_PSYNC)) {
+        buflen = snprintf(buf,sizeof(buf),"+FULLRESYNC %s %lld\r\n",
+                          server.runid,offset);
+        if (write(slave->fd,buf,buflen) != buflen) {
+            freeClientAsync(slave);
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+}
+
+/* Start a BGSAVE for replication and setup every slave waiting for it
+ * (that is, in the REDIS_REPL_WAIT_BGSAVE_START state) for the full
+ * resynchronization. If the BGSAVE can't be started the waiting slaves
+ * are disconnected.
+ *
+ * 'mincapa' is the bitwise AND of the capabilities of the waiting slaves:
+ * the RDB is streamed directly to the slave sockets only if diskless
+ * replication is enabled and every slave is able to parse the EOF format.
+ *
+ * Returns REDIS_OK on success, REDIS_ERR otherwise. */
+/*
+ * 为复制执行 BGSAVE ，并设置所有等待 BGSAVE 开始的附属节点
+ *
+ * 如果开启了无盘复制，并且所有附属节点都支持 EOF 格式，
+ * 那么 RDB 会被直接写入附属节点的套接字，否则写入磁盘。
+ */
+int startBgsaveForReplication(int mincapa) {
+    int retval;
+    int socket_target = server.repl_diskless_sync &&
+                        (mincapa & REDIS_SLAVE_CAPA_EOF);
+    listIter li;
+    listNode *ln;
+
+    redisLog(REDIS_NOTICE,"Starting BGSAVE for SYNC with target: %s",
+        socket_target ? "slaves sockets" : "disk");
+
+    /* The sockets target sets up the slaves for the full resync by
+     * itself, before forking. */
+    if (socket_target)
+        retval = rdbSaveToSlavesSockets();
+    else
+        retval = rdbSaveBackground(server.rdb_filename);
+
+    listRewind(server.slaves,&li);
+    while((ln = listNext(&li))) {
+        redisClient *slave = ln->value;
+
+        if (slave->replstate != REDIS_REPL_WAIT_BGSAVE_START) continue;
+        if (retval == REDIS_OK) {
+            if (!socket_target)
+                replicationSetupSlaveForFullResync(slave,
+                    server.master_repl_offset);
+        } else {
+            slave->flags &= ~REDIS_SLAVE;
+            listDelNode(server.slaves,ln);
+            addReplyError(slave,"BGSAVE failed, replication can't continue");
+            slave->flags |= REDIS_CLOSE_AFTER_REPLY;
+        }
+    }
+    if (retval != REDIS_OK)
+        redisLog(REDIS_WARNING,"BGSAVE for replication failed");
+    return retval;
+}
+
+/* SYNC ad PSYNC command implemenation. */
+/*
+ * SYNC 和 PSYNC 命令的实现
  */
 void syncCommand(redisClient *c) {
     /* ignore SYNC if aleady slave or in monitor mode */
@@ -136,17 +527,65 @@ void syncCommand(redisClient *c) {
      * buffer registering the differences between the BGSAVE and the current
      * dataset, so that we can copy to other slaves if needed. */
     // 有回复等待时，不进行 SYNC
-    if (listLength(c->reply) != 0) {
-        addReplyError(c,"SYNC is invalid with pending input");
+    if (listLength(c->reply) != 0 || c->bufpos != 0) {
+        addReplyError(c,"SYNC and PSYNC are invalid with pending output");
         return;
     }
 
-    redisLog(REDIS_NOTICE,"Slave ask for synchronization");
+    redisLog(REDIS_NOTICE,"Slave asks for synchronization");
+
+    /* Try a partial resynchronization if this is a PSYNC command.
+     * If it fails, we continue with usual full resynchronization, however
+     * when this happens masterTryPartialResynchronization() already
+     * replied with:
+     *
+     * +FULLRESYNC <runid> <offset>
+     *
+     * So the slave knows the new runid and offset to try a PSYNC later
+     * if the connection with the master is lost. */
+    // 如果命令是 PSYNC ，那么先尝试进行部分重同步
+    if (!strcasecmp(c->argv[0]->ptr,"psync")) {
+        if (masterTryPartialResynchronization(c) == REDIS_OK) {
+            server.stat_sync_partial_ok++;
+            return; /* No full resync needed, return. */
+        } else {
+            char *master_runid = c->argv[1]->ptr;
+
+            /* Increment stats for failed PSYNCs, but only if the
+             * runid is not "?", as this is used by slaves to force a full
+             * resync on purpose when they are not albe to partially
+             * resync. */
+            if (master_runid[0] != '?') server.stat_sync_partial_err++;
+        }
+    } else {
+        /* If a slave uses SYNC, we are dealing with an old implementation
+         * of the replication protocol (like redis-cli --slave). Flag the
+         * client so that we don't expect to receive REPLCONF ACK feedbacks. */
+        c->flags |= REDIS_PRE_PSYNC;
+    }
+
+    /* Full resynchronization. */
+    // 执行完整重同步
+    server.stat_sync_full++;
+
+    /* Setup the slave as one waiting for BGSAVE to start. The following code
+     * paths will change the state if we handle the slave differently. */
+    c->replstate = REDIS_REPL_WAIT_BGSAVE_START;
+    c->repldbfd = -1;
+    c->flags |= REDIS_SLAVE;
+    listAddNodeTail(server.slaves,c);
+
+    /* Create the replication backlog if needed. */
+    // 第一个附属节点连入时，创建复制积压缓冲区
+    if (listLength(server.slaves) == 1 && server.repl_backlog == NULL)
+        createReplicationBacklog();
 
     /* Here we need to check if there is a background saving operation
      * in progress, or if it is required to start one */
     // 检查是否已经有 BGSAVE 在执行，否则就创建一个新的 BGSAVE 任务
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 &&
+        server.rdb_child_type == REDIS_RDB_CHILD_TYPE_DISK)
+    {
         /* Ok a background save is in progress. Let's check if it is a good
          * one for replication, i.e. if there is another slave that is
          * registering differences since the server forked to save */
@@ -166,33 +605,40 @@ void syncCommand(redisClient *c) {
              * another slave. Set the right state, and copy the buffer. */
             // 找到一个同样在等到 SYNC 的客户端
             // 设置当前客户端的状态，并复制 buffer 。
+            // 两者使用同一个 RDB 文件，所以复制偏移量也一样。
             copyClientOutputBuffer(c,slave);
-            c->replstate = REDIS_REPL_WAIT_BGSAVE_END;
+            replicationSetupSlaveForFullResync(c,slave->psync_initial_offset);
             redisLog(REDIS_NOTICE,"Waiting for end of BGSAVE for SYNC");
         } else {
             /* No way, we need to wait for the next BGSAVE in order to
              * register differences */
             // 没有客户端在等待 SYNC ，当前客户端只能等待下次 BGSAVE 进行
-            c->replstate = REDIS_REPL_WAIT_BGSAVE_START;
             redisLog(REDIS_NOTICE,"Waiting for next BGSAVE for SYNC");
         }
+    } else if (server.rdb_child_pid != -1 &&
+               server.rdb_child_type == REDIS_RDB_CHILD_TYPE_SOCKET)
+    {
+        /* There is an RDB child process but it is writing directly to
+         * children sockets. We need to wait for the next BGSAVE
+         * in order to synchronize. */
+        // 正在进行的无盘传输无法复用，等待下次 BGSAVE
+        redisLog(REDIS_NOTICE,"Waiting for next BGSAVE for SYNC");
     } else {
-        // 没有 BGSAVE 在进行，自己启动一个。
-        /* Ok we don't have a BGSAVE in progress, let's start one */
-        redisLog(REDIS_NOTICE,"Starting BGSAVE for SYNC");
-        if (rdbSaveBackground(server.rdb_filename) != REDIS_OK) {
-            redisLog(REDIS_NOTICE,"Replication failed, can't BGSAVE");
-            addReplyError(c,"Unable to perform background save");
-            return;
+        if (server.repl_diskless_sync &&
+            (c->slave_capa & REDIS_SLAVE_CAPA_EOF) &&
+            server.repl_diskless_sync_delay)
+        {
+            /* Diskless replication RDB child is created inside
+             * replicationCron() since we want to delay its start a
+             * few seconds to wait for more slaves to arrive. */
+            // 延迟一段时间再开始无盘传输，让更多附属节点可以共享同一次 BGSAVE
+            redisLog(REDIS_NOTICE,"Delay next BGSAVE for SYNC");
+        } else {
+            // 没有 BGSAVE 在进行，自己启动一个。
+            /* Ok we don't have a BGSAVE in progress, let's start one */
+            startBgsaveForReplication(c->slave_capa);
         }
-        // 等待 BGSAVE 结束
-        c->replstate = REDIS_REPL_WAIT_BGSAVE_END;
     }
-    c->repldbfd = -1;
-    c->flags |= REDIS_SLAVE;
-    c->slaveseldb = 0;
-    listAddNodeTail(server.slaves,c);
-
     return;
 }
 
@@ -208,6 +654,12 @@ void syncCommand(redisClient *c) {
  * In the future the same command can be used in order to configure
  * the replication to initiate an incremental replication instead of a
  * full resync. */
+/*
+ * 附属节点在执行 SYNC / PSYNC 之前，使用 REPLCONF 对复制过程进行设置。
+ *
+ * 在复制开始之后，附属节点每秒会向主节点发送一次 REPLCONF ACK <offset> ，
+ * 告知主节点自己已经处理的复制偏移量。
+ */
 void replconfCommand(redisClient *c) {
     int j;
 
@@ -227,6 +679,29 @@ void replconfCommand(redisClient *c) {
                     &port,NULL) != REDIS_OK))
                 return;
             c->slave_listening_port = port;
+        } else if (!strcasecmp(c->argv[j]->ptr,"capa")) {
+            /* Ignore capabilities not understood by this master. */
+            if (!strcasecmp(c->argv[j+1]->ptr,"eof"))
+                c->slave_capa |= REDIS_SLAVE_CAPA_EOF;
+        } else if (!strcasecmp(c->argv[j]->ptr,"ack")) {
+            /* REPLCONF ACK is used by slave to inform the master the amount
+             * of replication stream that it processed so far. It is an
+             * internal only command that normal clients should never use. */
+            long long offset;
+
+            if (!(c->flags & REDIS_SLAVE)) return;
+            if ((getLongLongFromObject(c->argv[j+1], &offset) != REDIS_OK))
+                return;
+            if (offset > c->repl_ack_off)
+                c->repl_ack_off = offset;
+            c->repl_ack_time = server.unixtime;
+            /* If this was a diskless replication, we need to really put
+             * the slave online when the first ACK is received (which
+             * confirms slave is online and ready to get more data). */
+            if (c->repl_put_online_on_ack && c->replstate == REDIS_REPL_ONLINE)
+                putSlaveOnline(c);
+            /* Note: this command does not reply anything! */
+            return;
         } else {
             addReplyErrorFormat(c,"Unrecognized REPLCONF option: %s",
                 (char*)c->argv[j]->ptr);
@@ -236,6 +711,34 @@ void replconfCommand(redisClient *c) {
     addReply(c,shared.ok);
 }
 
+/* This function puts a slave in the online state, and should be called just
+ * after a slave received the RDB file for the initial synchronization, and
+ * we are finally ready to send the incremental stream of commands.
+ *
+ * It does a few things:
+ *
+ * 1) Put the slave in ONLINE state (useless when the function is called
+ *    because state is already ONLINE but repl_put_online_on_ack is true).
+ * 2) Make sure the writable event is re-installed, since calling the SYNC
+ *    command disables it, so that we can accumulate output buffer without
+ *    sending it to the slave.
+ * 3) Update the count of good slaves. */
+/*
+ * 将附属节点设置为在线状态，并开始向它发送积累的复制流
+ */
+void putSlaveOnline(redisClient *slave) {
+    slave->replstate = REDIS_REPL_ONLINE;
+    slave->repl_put_online_on_ack = 0;
+    slave->repl_ack_time = server.unixtime;
+    if (aeCreateFileEvent(server.el, slave->fd, AE_WRITABLE,
+        sendReplyToClient, slave) == AE_ERR) {
+        redisLog(REDIS_WARNING,"Unable to register writable event for slave bulk transfer: %s", strerror(errno));
+        freeClient(slave);
+        return;
+    }
+    redisLog(REDIS_NOTICE,"Synchronization with slave succeeded");
+}
+
 /*
  * 将主节点的 .rdb 文件内容发送到附属节点
  *
@@ -302,15 +805,8 @@ void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
         slave->repldbfd = -1;
         // 删除发送事件
         aeDeleteFileEvent(server.el,slave->fd,AE_WRITABLE);
-        // 更新附属节点状态
-        slave->replstate = REDIS_REPL_ONLINE;
-        // TODO：
-        if (aeCreateFileEvent(server.el, slave->fd, AE_WRITABLE,
-            sendReplyToClient, slave) == AE_ERR) {
-            freeClient(slave);
-            return;
-        }
-        redisLog(REDIS_NOTICE,"Synchronization with slave succeeded");
+        // 更新附属节点状态，开始发送积累的复制流
+        putSlaveOnline(slave);
     }
 }
 
@@ -329,9 +825,10 @@ void sendBulkToSlave(aeEventLoop *el, int fd, void *privdata, int mask) {
  *
  * 这个函数用于实现附属节点的非阻塞同步。
  */
-void updateSlavesWaitingBgsave(int bgsaveerr) {
+void updateSlavesWaitingBgsave(int bgsaveerr, int type) {
     listNode *ln;
     int startbgsave = 0;
+    int mincapa = -1;
     listIter li;
 
     // 遍历所有附属节点
@@ -340,9 +837,10 @@ void updateSlavesWaitingBgsave(int bgsaveerr) {
         redisClient *slave = ln->value;
 
         if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) {
-            // 告诉那些这次不能同步的客户端，可以等待下次 BGSAVE 了。
+            // 这些客户端没能赶上这次 BGSAVE ，为它们再执行一次 BGSAVE
             startbgsave = 1;
-            slave->replstate = REDIS_REPL_WAIT_BGSAVE_END;
+            mincapa = (mincapa == -1) ? slave->slave_capa :
+                                        (mincapa & slave->slave_capa);
         } else if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_END) {
             // 这些是本次可以同步的客户端
 
@@ -354,6 +852,27 @@ void updateSlavesWaitingBgsave(int bgsaveerr) {
                 redisLog(REDIS_WARNING,"SYNC failed. BGSAVE child returned an error");
                 continue;
             }
+
+            /* If this was an RDB on disk save, we have to prepare to send
+             * the RDB from disk to the slave socket. Otherwise if this was
+             * already an RDB -> Slaves socket transfer, used in the case of
+             * diskless replication, our work is trivial, we can just put
+             * the slave online. */
+            // 无盘复制：RDB 已经发送完毕，等待附属节点载入之后发来的第一个 ACK
+            if (type == REDIS_RDB_CHILD_TYPE_SOCKET) {
+                redisLog(REDIS_NOTICE,
+                    "Streamed RDB transfer with slave succeeded (socket). "
+                    "Waiting for REPLCONF ACK from slave to enable streaming");
+                /* Note: we wait for a REPLCONF ACK message from slave in
+                 * order to really put it online (install the write handler
+                 * so that the accumulated data can be transfered). However
+                 * we change the replication state ASAP, since our slave
+                 * is technically online now. */
+                slave->replstate = REDIS_REPL_ONLINE;
+                slave->repl_put_online_on_ack = 1;
+                slave->repl_ack_time = server.unixtime;
+                continue;
+            }
             // 打开 .rdb 文件
             if ((slave->repldbfd = open(server.rdb_filename,O_RDONLY)) == -1 ||
                 // 如果打开失败，释放并清除
@@ -379,22 +898,8 @@ void updateSlavesWaitingBgsave(int bgsaveerr) {
     }
 
     // 有客户端没有在这次 BGSAVE 中成功同步
-    if (startbgsave) {
-        // 再启动一次 BGSAVE
-        if (rdbSaveBackground(server.rdb_filename) != REDIS_OK) {
-            // 如果 BGSAVE 失败，清空附属节点
-            listIter li;
-
-            listRewind(server.slaves,&li);
-            redisLog(REDIS_WARNING,"SYNC failed. BGSAVE failed");
-            while((ln = listNext(&li))) {
-                redisClient *slave = ln->value;
-
-                if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START)
-                    freeClient(slave);
-            }
-        }
-    }
+    // 再启动一次 BGSAVE
+    if (startbgsave) startBgsaveForReplication(mincapa);
 }
 
 /* ----------------------------------- SLAVE -------------------------------- */
@@ -403,6 +908,14 @@ void updateSlavesWaitingBgsave(int bgsaveerr) {
 void replicationAbortSyncTransfer(void) {
     redisAssert(server.repl_state == REDIS_REPL_TRANSFER);
 
+    // 丢弃已经异步载入的部分数据，继续使用旧数据集
+    if (server.async_loading) {
+        if (server.repl_async_load_timer != -1) {
+            aeDeleteTimeEvent(server.el,server.repl_async_load_timer);
+            server.repl_async_load_timer = -1;
+        }
+        rdbAsyncLoadAbort();
+    }
     aeDeleteFileEvent(server.el,server.repl_transfer_s,AE_READABLE);
     close(server.repl_transfer_s);
     close(server.repl_transfer_fd);
@@ -411,12 +924,88 @@ void replicationAbortSyncTransfer(void) {
     server.repl_state = REDIS_REPL_CONNECT;
 }
 
+/* Final setup of the connected slave <- master link, called once the
+ * payload received from the master was loaded. */
+// 载入主节点发来的 RDB 之后，为主节点创建客户端，完成同步
+static void replicationFinishSync(void) {
+    zfree(server.repl_transfer_tmpfile);
+    close(server.repl_transfer_fd);
+    server.master = createClient(server.repl_transfer_s);
+    server.master->flags |= REDIS_MASTER;
+    server.master->authenticated = 1;
+    server.repl_state = REDIS_REPL_CONNECTED;
+    // 记录主节点的运行 ID 和复制偏移量，供之后的 PSYNC 使用
+    server.master->reploff = server.repl_master_initial_offset;
+    memcpy(server.master->replrunid, server.repl_master_runid,
+        sizeof(server.repl_master_runid));
+    /* If master offset is set to -1, this master is old and is not
+     * PSYNC capable, so we flag it accordingly. */
+    if (server.master->reploff == -1)
+        server.master->flags |= REDIS_PRE_PSYNC;
+    redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Finished with success");
+    /* Restart the AOF subsystem now that we finished the sync. This
+     * will trigger an AOF rewrite, and when done will start appending
+     * to the new file. */
+    if (server.aof_state != REDIS_AOF_OFF) {
+        int retry = 10;
+
+        stopAppendOnly();
+        while (retry-- && startAppendOnly() == REDIS_ERR) {
+            redisLog(REDIS_WARNING,"Failed enabling the AOF after successful master synchrnization! Trying it again in one second.");
+            sleep(1);
+        }
+        if (!retry) {
+            redisLog(REDIS_WARNING,"FATAL: this slave instance finished the synchronization with its master, but the AOF can't be turned on. Exiting now.");
+            exit(1);
+        }
+    }
+}
+
+/* Time event loading the master payload a step at a time when
+ * slave-async-load is enabled. When the whole payload is loaded the new
+ * data set replaces the old one and the link with the master is set up. */
+// 分步载入主节点发来的 RDB ，载入完成后替换旧数据集
+int replicationAsyncLoadProc(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    int retval;
+    REDIS_NOTUSED(eventLoop);
+    REDIS_NOTUSED(id);
+    REDIS_NOTUSED(clientData);
+
+    retval = rdbAsyncLoadStep(REDIS_ASYNC_LOAD_STEP_USEC);
+    /* We are busy loading what the master sent, don't time it out. */
+    server.repl_transfer_lastio = server.unixtime;
+    if (retval == REDIS_RDB_ENTRY_OK) return REDIS_ASYNC_LOAD_PERIOD;
+
+    // 载入已经结束（成功或者失败），这个时间事件不再需要
+    server.repl_async_load_timer = -1;
+    if (retval == REDIS_RDB_ENTRY_ERR) {
+        redisLog(REDIS_WARNING,"Short read or corrupted payload loading the MASTER synchronization DB asynchronously");
+        replicationAbortSyncTransfer();
+        return AE_NOMORE;
+    }
+
+    /* Same as the synchronous load: slaves and backlog refer to the old
+     * data set that is going away. */
+    disconnectSlaves();
+    if (server.repl_backlog) freeReplicationBacklog();
+    rdbAsyncLoadSwap();
+    redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Swapped the asynchronously loaded DB in");
+    replicationFinishSync();
+    return AE_NOMORE;
+}
+
 /* Asynchronously read the SYNC payload we receive from a master */
 #define REPL_MAX_WRITTEN_BEFORE_FSYNC (1024*1024*8) /* 8 MB */
 void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
     char buf[4096];
     ssize_t nread, readlen;
     off_t left;
+    /* Static vars used to hold the EOF mark, and the last bytes received
+     * form the server: when they match, we reached the end of the transfer. */
+    static char eofmark[REDIS_EOF_MARK_SIZE];
+    static char lastbytes[REDIS_EOF_MARK_SIZE];
+    static int usemark = 0;
+    int eof_reached = 0;
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(privdata);
     REDIS_NOTUSED(mask);
@@ -446,16 +1035,48 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
             redisLog(REDIS_WARNING,"Bad protocol from MASTER, the first byte is not '$', are you sure the host and port are right?");
             goto error;
         }
-        server.repl_transfer_size = strtol(buf+1,NULL,10);
-        redisLog(REDIS_NOTICE,
-            "MASTER <-> SLAVE sync: receiving %ld bytes from master",
-            server.repl_transfer_size);
+
+        /* There are two possible forms for the bulk payload. One is the
+         * usual $<count> bulk format. The other is used for diskless
+         * transfers when the master does not know beforehand the size of
+         * the file to transfer. In the latter case, the following format
+         * is used:
+         *
+         * $EOF:<40 bytes delimiter>
+         *
+         * At the end of the file the announced delimiter is transmitted. The
+         * delimiter is long and random enough that the probability of a
+         * collision with the actual file content can be ignored. */
+        // 无盘复制：RDB 的长度未知，以 40 字节的随机标记作为结束符
+        if (strncmp(buf+1,"EOF:",4) == 0 &&
+            strlen(buf+5) >= REDIS_EOF_MARK_SIZE)
+        {
+            usemark = 1;
+            memcpy(eofmark,buf+5,REDIS_EOF_MARK_SIZE);
+            memset(lastbytes,0,REDIS_EOF_MARK_SIZE);
+            /* Set any repl_transfer_size to avoid entering this code path
+             * at the next call. */
+            server.repl_transfer_size = 0;
+            redisLog(REDIS_NOTICE,
+                "MASTER <-> SLAVE sync: receiving streamed RDB from master");
+        } else {
+            usemark = 0;
+            server.repl_transfer_size = strtol(buf+1,NULL,10);
+            redisLog(REDIS_NOTICE,
+                "MASTER <-> SLAVE sync: receiving %ld bytes from master",
+                server.repl_transfer_size);
+        }
         return;
     }
 
     /* Read bulk data */
-    left = server.repl_transfer_size - server.repl_transfer_read;
-    readlen = (left < (signed)sizeof(buf)) ? left : (signed)sizeof(buf);
+    if (usemark) {
+        readlen = sizeof(buf);
+    } else {
+        left = server.repl_transfer_size - server.repl_transfer_read;
+        readlen = (left < (signed)sizeof(buf)) ? left : (signed)sizeof(buf);
+    }
+
     nread = read(fd,buf,readlen);
     if (nread <= 0) {
         redisLog(REDIS_WARNING,"I/O error trying to sync with MASTER: %s",
@@ -463,6 +1084,24 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
         replicationAbortSyncTransfer();
         return;
     }
+
+    /* When a mark is used, we want to detect EOF asap in order to avoid
+     * writing the EOF mark into the file... */
+    if (usemark) {
+        /* Update the last bytes array, and check if it matches our
+         * delimiter. */
+        if (nread >= REDIS_EOF_MARK_SIZE) {
+            memcpy(lastbytes,buf+nread-REDIS_EOF_MARK_SIZE,
+                REDIS_EOF_MARK_SIZE);
+        } else {
+            int rem = REDIS_EOF_MARK_SIZE-nread;
+            memmove(lastbytes,lastbytes+nread,rem);
+            memcpy(lastbytes+rem,buf,nread);
+        }
+        if (memcmp(lastbytes,eofmark,REDIS_EOF_MARK_SIZE) == 0)
+            eof_reached = 1;
+    }
+
     server.repl_transfer_lastio = server.unixtime;
     if (write(server.repl_transfer_fd,buf,nread) != nread) {
         redisLog(REDIS_WARNING,"Write error or short write writing to the DB dump file needed for MASTER <-> SLAVE synchronization: %s", strerror(errno));
@@ -470,6 +1109,17 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
     server.repl_transfer_read += nread;
 
+    /* Delete the last 40 bytes from the file if we reached EOF. */
+    // 从文件中删除结尾的 EOF 标记
+    if (usemark && eof_reached) {
+        if (ftruncate(server.repl_transfer_fd,
+            server.repl_transfer_read - REDIS_EOF_MARK_SIZE) == -1)
+        {
+            redisLog(REDIS_WARNING,"Error truncating the RDB file received from the master for SYNC: %s", strerror(errno));
+            goto error;
+        }
+    }
+
     /* Sync data on disk from time to time, otherwise at the end of the transfer
      * we may suffer a big delay as the memory buffers are copied into the
      * actual disk. */
@@ -484,48 +1134,55 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
 
     /* Check if the transfer is now complete */
-    if (server.repl_transfer_read == server.repl_transfer_size) {
+    if (!usemark) {
+        if (server.repl_transfer_read == server.repl_transfer_size)
+            eof_reached = 1;
+    }
+
+    if (eof_reached) {
         if (rename(server.repl_transfer_tmpfile,server.rdb_filename) == -1) {
             redisLog(REDIS_WARNING,"Failed trying to rename the temp DB into dump.rdb in MASTER <-> SLAVE synchronization: %s", strerror(errno));
             replicationAbortSyncTransfer();
             return;
         }
-        redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Loading DB in memory");
-        emptyDb();
-        /* Before loading the DB into memory we need to delete the readable
-         * handler, otherwise it will get called recursively since
-         * rdbLoad() will call the event loop to process events from time to
-         * time for non blocking loading. */
+        /* Stop reading from the master while loading: rdbLoad() processes
+         * events from time to time and the asynchronous load returns to
+         * the event loop, so the handler would be called again. What the
+         * master sends after the payload is read once it is loaded. */
         aeDeleteFileEvent(server.el,server.repl_transfer_s,AE_READABLE);
+
+        /* Load the payload into a fresh data set from the event loop,
+         * serving reads from the old one meanwhile. The key-slot mapping
+         * of cluster mode is bound to the served data set, so cluster
+         * nodes always load synchronously. */
+        // 在事件循环中分步载入 RDB ，同时继续使用旧数据集处理读请求
+        if (server.repl_slave_async_load && !server.cluster_enabled) {
+            if (rdbAsyncLoadStart(server.rdb_filename) != REDIS_OK) {
+                redisLog(REDIS_WARNING,"Failed trying to load the MASTER synchronization DB from disk");
+                replicationAbortSyncTransfer();
+                return;
+            }
+            redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Loading DB in memory asynchronously");
+            server.repl_async_load_timer = aeCreateTimeEvent(server.el,
+                REDIS_ASYNC_LOAD_PERIOD,replicationAsyncLoadProc,NULL,NULL);
+            return;
+        }
+
+        /* Our data set is about to be replaced: the slaves attached to us
+         * and our replication backlog refer to the old one, so drop both.
+         * Slaves will reconnect and perform a full resync. */
+        // 数据集即将被替换，附属节点和复制积压缓冲区中的数据都已经失效
+        disconnectSlaves();
+        if (server.repl_backlog) freeReplicationBacklog();
+        redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Loading DB in memory");
+        emptyDb(server.repl_slave_lazy_flush ? REDIS_EMPTYDB_ASYNC :
+                                               REDIS_EMPTYDB_NO_FLAGS);
         if (rdbLoad(server.rdb_filename) != REDIS_OK) {
             redisLog(REDIS_WARNING,"Failed trying to load the MASTER synchronization DB from disk");
             replicationAbortSyncTransfer();
             return;
         }
-        /* Final setup of the connected slave <- master link */
-        zfree(server.repl_transfer_tmpfile);
-        close(server.repl_transfer_fd);
-        server.master = createClient(server.repl_transfer_s);
-        server.master->flags |= REDIS_MASTER;
-        server.master->authenticated = 1;
-        server.repl_state = REDIS_REPL_CONNECTED;
-        redisLog(REDIS_NOTICE, "MASTER <-> SLAVE sync: Finished with success");
-        /* Restart the AOF subsystem now that we finished the sync. This
-         * will trigger an AOF rewrite, and when done will start appending
-         * to the new file. */
-        if (server.aof_state != REDIS_AOF_OFF) {
-            int retry = 10;
-
-            stopAppendOnly();
-            while (retry-- && startAppendOnly() == REDIS_ERR) {
-                redisLog(REDIS_WARNING,"Failed enabling the AOF after successful master synchrnization! Trying it again in one second.");
-                sleep(1);
-            }
-            if (!retry) {
-                redisLog(REDIS_WARNING,"FATAL: this slave instance finished the synchronization with its master, but the AOF can't be turned on. Exiting now.");
-                exit(1);
-            }
-        }
+        replicationFinishSync();
     }
 
     return;
@@ -581,10 +1238,150 @@ char *sendSynchronousCommand(int fd, ...) {
     return NULL; /* No errors. */
 }
 
+/* Send the PSYNC command to the master. If we have a cached master we
+ * ask to continue from its run id and offset, otherwise we send
+ * "PSYNC ? -1" to force a full resynchronization that still provides us
+ * with the master run id and offset.
+ *
+ * The reply is read later, in a non blocking way, by
+ * slaveReadPSyncReply(). Returns REDIS_ERR on write error. */
+/*
+ * 向主节点发送 PSYNC 命令
+ *
+ * 命令的回复会在之后由 slaveReadPSyncReply() 以非阻塞的方式读取。
+ */
+int slaveSendPSync(int fd) {
+    char *psync_runid;
+    char psync_offset[REDIS_LONGSTR_SIZE];
+    sds cmd;
+    int retval;
+
+    // 使用缓存的主节点进行部分重同步
+    if (server.cached_master) {
+        psync_runid = server.cached_master->replrunid;
+        ll2string(psync_offset,sizeof(psync_offset),
+            server.cached_master->reploff+1);
+        redisLog(REDIS_NOTICE,"Trying a partial resynchronization (request %s:%s).", psync_runid, psync_offset);
+    // 没有缓存的主节点，请求完整重同步
+    } else {
+        redisLog(REDIS_NOTICE,"Partial resynchronization not possible (no cached master)");
+        psync_runid = "?";
+        memcpy(psync_offset,"-1",3);
+    }
+
+    cmd = sdscatprintf(sdsempty(),"PSYNC %s %s\r\n",psync_runid,psync_offset);
+    retval = syncWrite(fd,cmd,sdslen(cmd),server.repl_syncio_timeout*1000);
+    sdsfree(cmd);
+    return (retval == -1) ? REDIS_ERR : REDIS_OK;
+}
+
+#define PSYNC_WAIT_REPLY 0
+#define PSYNC_CONTINUE 1
+#define PSYNC_FULLRESYNC 2
+#define PSYNC_NOT_SUPPORTED 3
+#define PSYNC_TRY_LATER 4
+
+/* Read the reply to the PSYNC command sent by slaveSendPSync().
+ *
+ * PSYNC_CONTINUE: the master accepted the partial resync, the cached
+ *                 master was turned again into our master.
+ * PSYNC_FULLRESYNC: the master will send us an RDB payload, its run id
+ *                   and offset were saved for the next PSYNC.
+ * PSYNC_NOT_SUPPORTED: the master does not understand PSYNC, SYNC must
+ *                      be used instead.
+ * PSYNC_WAIT_REPLY: the master only sent a newline to keep the link alive
+ *                   while preparing the BGSAVE, try again later.
+ * PSYNC_TRY_LATER: the master can't serve us right now (or I/O error). */
+/*
+ * 读取并处理主节点对 PSYNC 命令的回复
+ */
+int slaveReadPSyncReply(int fd) {
+    char buf[1024];
+
+    buf[0] = '\0';
+    if (syncReadLine(fd,buf,sizeof(buf),
+        server.repl_syncio_timeout*1000) == -1)
+    {
+        redisLog(REDIS_WARNING,"I/O error reading PSYNC reply from master: %s",
+            strerror(errno));
+        return PSYNC_TRY_LATER;
+    }
+
+    /* The master may send empty newlines after it receives PSYNC
+     * and before to reply, just to keep the connection alive. */
+    if (buf[0] == '\0') {
+        server.repl_transfer_lastio = server.unixtime;
+        return PSYNC_WAIT_REPLY;
+    }
+
+    if (!strncmp(buf,"+FULLRESYNC",11)) {
+        char *runid = NULL, *offset = NULL;
+
+        /* FULL RESYNC, parse the reply in order to extract the run id
+         * and the replication offset. */
+        runid = strchr(buf,' ');
+        if (runid) {
+            runid++;
+            offset = strchr(runid,' ');
+            if (offset) offset++;
+        }
+        if (!runid || !offset || (offset-runid-1) != REDIS_RUN_ID_SIZE) {
+            redisLog(REDIS_WARNING,
+                "Master replied with wrong +FULLRESYNC syntax.");
+            /* This is an unexpected condition, actually the +FULLRESYNC
+             * reply means that the master supports PSYNC, but the reply
+             * format seems wrong. To stay safe we blank the master
+             * runid to make sure next PSYNCs will fail. */
+            memset(server.repl_master_runid,0,REDIS_RUN_ID_SIZE+1);
+        } else {
+            memcpy(server.repl_master_runid, runid, offset-runid-1);
+            server.repl_master_runid[REDIS_RUN_ID_SIZE] = '\0';
+            server.repl_master_initial_offset = strtoll(offset,NULL,10);
+            redisLog(REDIS_NOTICE,"Full resync from master: %s:%lld",
+                server.repl_master_runid,
+                server.repl_master_initial_offset);
+        }
+        /* We are going to full resync, discard the cached master structure. */
+        replicationDiscardCachedMaster();
+        return PSYNC_FULLRESYNC;
+    }
+
+    if (!strncmp(buf,"+CONTINUE",9)) {
+        /* Partial resync was accepted, set the replication state accordingly */
+        redisLog(REDIS_NOTICE,
+            "Successful partial resynchronization with master.");
+        replicationResurrectCachedMaster(fd);
+        return PSYNC_CONTINUE;
+    }
+
+    /* An error other than "unknown command" means the master is not able
+     * to serve us right now (for instance it is itself a slave that is
+     * not connected to its master): retry later keeping our cached state. */
+    if (buf[0] == '-' && !strstr(buf,"unknown command")) {
+        redisLog(REDIS_WARNING,
+            "Unexpected reply to PSYNC from master: %s", buf);
+        return PSYNC_TRY_LATER;
+    }
+
+    /* If we reach this point we receied either an error since the master does
+     * not understand PSYNC, or an unexpected reply from the master.
+     * Return PSYNC_NOT_SUPPORTED to the caller in both cases. */
+    if (strncmp(buf,"-ERR",4)) {
+        redisLog(REDIS_WARNING,
+            "Unexpected reply to PSYNC from master: %s", buf);
+    } else {
+        redisLog(REDIS_NOTICE,
+            "Master does not support PSYNC or is in "
+            "error state (reply: %s)", buf);
+    }
+    replicationDiscardCachedMaster();
+    return PSYNC_NOT_SUPPORTED;
+}
+
 void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
     char tmpfile[256], *err;
     int dfd, maxtries = 5;
-    int sockerr = 0;
+    int sockerr = 0, psync_result;
     socklen_t errlen = sizeof(sockerr);
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(privdata);
@@ -623,6 +1420,70 @@ void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
         return;
     }
 
+    /* Receive the reply to PSYNC. The master may need some time before
+     * replying (a BGSAVE has to be started first), so this state is
+     * handled without blocking: we are called again every time there is
+     * something to read. */
+    // 读取 PSYNC 命令的回复
+    if (server.repl_state == REDIS_REPL_RECEIVE_PSYNC) {
+        psync_result = slaveReadPSyncReply(fd);
+        if (psync_result == PSYNC_WAIT_REPLY) return;
+        if (psync_result == PSYNC_TRY_LATER) goto error;
+
+        /* Partial resync accepted: the resurrected master client already
+         * replaced this handler with readQueryFromClient(). */
+        // 部分重同步成功，无须再做其他事情
+        if (psync_result == PSYNC_CONTINUE) return;
+
+        /* We no longer need this handler, the bulk payload reader will
+         * be installed in its place. */
+        aeDeleteFileEvent(server.el,fd,AE_READABLE);
+
+        /* Fall back to SYNC if needed. Otherwise psync_result ==
+         * PSYNC_FULLRESYNC and server.repl_master_* were already set. */
+        // 主节点不支持 PSYNC ，使用 SYNC 进行同步
+        if (psync_result == PSYNC_NOT_SUPPORTED) {
+            redisLog(REDIS_NOTICE,"Retrying with SYNC...");
+            if (syncWrite(fd,"SYNC\r\n",6,server.repl_syncio_timeout*1000) == -1) {
+                redisLog(REDIS_WARNING,"I/O error writing to MASTER: %s",
+                    strerror(errno));
+                goto error;
+            }
+            server.repl_master_initial_offset = -1;
+        }
+
+        /* Prepare a suitable temp file for bulk transfer */
+        while(maxtries--) {
+            snprintf(tmpfile,256,
+                "temp-%d.%ld.rdb",(int)server.unixtime,(long int)getpid());
+            dfd = open(tmpfile,O_CREAT|O_WRONLY|O_EXCL,0644);
+            if (dfd != -1) break;
+            sleep(1);
+        }
+        if (dfd == -1) {
+            redisLog(REDIS_WARNING,"Opening the temp file needed for MASTER <-> SLAVE synchronization: %s",strerror(errno));
+            goto error;
+        }
+
+        /* Setup the non blocking download of the bulk file. */
+        if (aeCreateFileEvent(server.el,fd, AE_READABLE,readSyncBulkPayload,NULL)
+                == AE_ERR)
+        {
+            redisLog(REDIS_WARNING,"Can't create readable event for SYNC");
+            close(dfd);
+            goto error;
+        }
+
+        server.repl_state = REDIS_REPL_TRANSFER;
+        server.repl_transfer_size = -1;
+        server.repl_transfer_read = 0;
+        server.repl_transfer_last_fsync_off = 0;
+        server.repl_transfer_fd = dfd;
+        server.repl_transfer_lastio = server.unixtime;
+        server.repl_transfer_tmpfile = zstrdup(tmpfile);
+        return;
+    }
+
     /* Receive the PONG command. */
     if (server.repl_state == REDIS_REPL_RECEIVE_PONG) {
         char buf[1024];
@@ -679,44 +1540,39 @@ void syncWithMaster(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
     }
 
-    /* Issue the SYNC command */
-    if (syncWrite(fd,"SYNC\r\n",6,server.repl_syncio_timeout*1000) == -1) {
-        redisLog(REDIS_WARNING,"I/O error writing to MASTER: %s",
-            strerror(errno));
-        goto error;
+    /* Inform the master of our capabilities. While we currently send
+     * just one capability, it is possible to chain new capabilities here
+     * in the form of REPLCONF capa X capa Y capa Z ...
+     * The master will ignore capabilities it does not understand. */
+    // 告知主节点本节点可以接收 EOF 格式的 RDB（无盘复制）
+    err = sendSynchronousCommand(fd,"REPLCONF","capa","eof",NULL);
+    /* Ignore the error if any, not all the Redis versions support
+     * REPLCONF capa. */
+    if (err) {
+        redisLog(REDIS_NOTICE,"(non critical): Master does not understand REPLCONF capa: %s", err);
+        sdsfree(err);
     }
 
-    /* Prepare a suitable temp file for bulk transfer */
-    while(maxtries--) {
-        snprintf(tmpfile,256,
-            "temp-%d.%ld.rdb",(int)server.unixtime,(long int)getpid());
-        dfd = open(tmpfile,O_CREAT|O_WRONLY|O_EXCL,0644);
-        if (dfd != -1) break;
-        sleep(1);
-    }
-    if (dfd == -1) {
-        redisLog(REDIS_WARNING,"Opening the temp file needed for MASTER <-> SLAVE synchronization: %s",strerror(errno));
+    /* Try a partial resynchonization. The reply is read by this same
+     * handler once the master is ready to reply. */
+    // 发送 PSYNC 命令，并等待主节点的回复
+    if (slaveSendPSync(fd) == REDIS_ERR) {
+        redisLog(REDIS_WARNING,"I/O error writing to MASTER: %s",
+            strerror(errno));
         goto error;
     }
-
-    /* Setup the non blocking download of the bulk file. */
-    if (aeCreateFileEvent(server.el,fd, AE_READABLE,readSyncBulkPayload,NULL)
+    if (aeCreateFileEvent(server.el,fd,AE_READABLE,syncWithMaster,NULL)
             == AE_ERR)
     {
         redisLog(REDIS_WARNING,"Can't create readable event for SYNC");
         goto error;
     }
-
-    server.repl_state = REDIS_REPL_TRANSFER;
-    server.repl_transfer_size = -1;
-    server.repl_transfer_read = 0;
-    server.repl_transfer_last_fsync_off = 0;
-    server.repl_transfer_fd = dfd;
+    server.repl_state = REDIS_REPL_RECEIVE_PSYNC;
     server.repl_transfer_lastio = server.unixtime;
-    server.repl_transfer_tmpfile = zstrdup(tmpfile);
     return;
 
 error:
+    aeDeleteFileEvent(server.el,fd,AE_READABLE|AE_WRITABLE);
     close(fd);
     server.repl_transfer_s = -1;
     server.repl_state = REDIS_REPL_CONNECT;
@@ -753,13 +1609,39 @@ void undoConnectWithMaster(void) {
     int fd = server.repl_transfer_s;
 
     redisAssert(server.repl_state == REDIS_REPL_CONNECTING ||
-                server.repl_state == REDIS_REPL_RECEIVE_PONG);
+                server.repl_state == REDIS_REPL_RECEIVE_PONG ||
+                server.repl_state == REDIS_REPL_RECEIVE_PSYNC);
     aeDeleteFileEvent(server.el,fd,AE_READABLE|AE_WRITABLE);
     close(fd);
     server.repl_transfer_s = -1;
     server.repl_state = REDIS_REPL_CONNECT;
 }
 
+/* This function aborts a non blocking replication attempt if there is one
+ * in progress, by canceling the non-blocking connect attempt or
+ * the initial bulk transfer.
+ *
+ * If there was a replication handshake in progress 1 is returned and
+ * the replication state (server.repl_state) set to REDIS_REPL_CONNECT.
+ *
+ * Otherwise zero is returned and no operation is perforemd at all. */
+/*
+ * 取消正在进行中的复制握手或者 RDB 传输
+ */
+int cancelReplicationHandshake(void) {
+    if (server.repl_state == REDIS_REPL_TRANSFER) {
+        replicationAbortSyncTransfer();
+    } else if (server.repl_state == REDIS_REPL_CONNECTING ||
+             server.repl_state == REDIS_REPL_RECEIVE_PONG ||
+             server.repl_state == REDIS_REPL_RECEIVE_PSYNC)
+    {
+        undoConnectWithMaster();
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
 void slaveofCommand(redisClient *c) {
     if (!strcasecmp(c->argv[1]->ptr,"no") &&
         !strcasecmp(c->argv[2]->ptr,"one")) {
@@ -767,11 +1649,8 @@ void slaveofCommand(redisClient *c) {
             sdsfree(server.masterhost);
             server.masterhost = NULL;
             if (server.master) freeClient(server.master);
-            if (server.repl_state == REDIS_REPL_TRANSFER)
-                replicationAbortSyncTransfer();
-            else if (server.repl_state == REDIS_REPL_CONNECTING ||
-                     server.repl_state == REDIS_REPL_RECEIVE_PONG)
-                undoConnectWithMaster();
+            replicationDiscardCachedMaster();
+            cancelReplicationHandshake();
             server.repl_state = REDIS_REPL_NONE;
             redisLog(REDIS_NOTICE,"MASTER MODE enabled (user request)");
         }
@@ -794,9 +1673,9 @@ void slaveofCommand(redisClient *c) {
         server.masterhost = sdsdup(c->argv[1]->ptr);
         server.masterport = port;
         if (server.master) freeClient(server.master);
+        replicationDiscardCachedMaster(); /* Don't try a PSYNC. */
         disconnectSlaves(); /* Force our slaves to resync with us as well. */
-        if (server.repl_state == REDIS_REPL_TRANSFER)
-            replicationAbortSyncTransfer();
+        cancelReplicationHandshake();
         server.repl_state = REDIS_REPL_CONNECT;
         redisLog(REDIS_NOTICE,"SLAVE OF %s:%d enabled (user request)",
             server.masterhost, server.masterport);
@@ -804,13 +1683,149 @@ void slaveofCommand(redisClient *c) {
     addReply(c,shared.ok);
 }
 
+/* Send a REPLCONF ACK command to the master to inform it about the current
+ * processed offset. If we are not connected with a master, the command has
+ * no effects. */
+/*
+ * 向主节点发送 REPLCONF ACK <offset> ，告知主节点自己的复制偏移量
+ */
+void replicationSendAck(void) {
+    redisClient *c = server.master;
+
+    if (c != NULL) {
+        c->flags |= REDIS_MASTER_FORCE_REPLY;
+        addReplyMultiBulkLen(c,3);
+        addReplyBulkCString(c,"REPLCONF");
+        addReplyBulkCString(c,"ACK");
+        addReplyBulkLongLong(c,c->reploff);
+        c->flags &= ~REDIS_MASTER_FORCE_REPLY;
+    }
+}
+
+/* ---------------------- MASTER CACHING FOR PSYNC -------------------------- */
+
+/* In order to implement partial synchronization we need to be able to cache
+ * our master's client structure after a transient disconnection.
+ * It is cached into server.cached_master and flushed away using the following
+ * functions. */
+
+/* This function is called by freeClient() in order to cache the master
+ * client structure instead of destryoing it. freeClient() will return
+ * ASAP after this function returns, so every action needed to avoid problems
+ * with a client that is really "suspended" has to be done by this function.
+ *
+ * The other functions that will deal with the cached master are:
+ *
+ * replicationDiscardCachedMaster() that will make sure to kill the client
+ * as for some reason we don't want to use it in the future.
+ *
+ * replicationResurrectCachedMaster() that is used after a successful PSYNC
+ * handshake in order to reactivate the cached master.
+ */
+/*
+ * 缓存断线的主节点客户端，以便在重连之后尝试进行部分重同步
+ *
+ * 注意查询缓存会被保留：c->reploff 已经包含了其中尚未处理完的部分命令，
+ * 部分重同步之后主节点会从 reploff+1 开始继续发送数据，补全这些命令。
+ */
+void replicationCacheMaster(redisClient *c) {
+    listNode *ln;
+
+    redisAssert(server.master != NULL && server.cached_master == NULL);
+    redisLog(REDIS_NOTICE,"Caching the disconnected master state.");
+
+    /* Remove from the list of clients, we don't want this client to be
+     * listed by CLIENT LIST or processed in any way by batch operations. */
+    ln = listSearchKey(server.clients,c);
+    redisAssert(ln != NULL);
+    listDelNode(server.clients,ln);
+
+    /* Save the master. Server.master will be set to null later by
+     * replicationHandleMasterDisconnection(). */
+    server.cached_master = server.master;
+
+    /* Remove the event handlers and close the socket. We'll later reuse
+     * the socket of the new connection with the master during PSYNC. */
+    aeDeleteFileEvent(server.el,c->fd,AE_READABLE);
+    aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+    close(c->fd);
+
+    /* Set fd to -1 so that we can safely call freeClient(c) later. */
+    c->fd = -1;
+
+    /* Pending REPLCONF ACK replies are meaningless for the new link. */
+    while(listLength(c->reply)) listDelNode(c->reply,listFirst(c->reply));
+    c->bufpos = 0;
+    c->sentlen = 0;
+
+    /* Caching the master happens instead of the actual freeClient() call,
+     * so make sure to adjust the replication state as needed. */
+    replicationHandleMasterDisconnection();
+}
+
+/* Free a cached master, called when there are no longer the conditions for
+ * a partial resync on reconnection. */
+/*
+ * 释放缓存的主节点
+ */
+void replicationDiscardCachedMaster(void) {
+    if (server.cached_master == NULL) return;
+
+    redisLog(REDIS_NOTICE,"Discarding previously cached master state.");
+    server.cached_master->flags &= ~REDIS_MASTER;
+    freeClient(server.cached_master);
+    server.cached_master = NULL;
+}
+
+/* Turn the cached master into the current master, using the file descriptor
+ * passed as argument as the socket for the new master.
+ *
+ * This funciton is called when successfully setup a partial resynchronization
+ * so the stream of data that we'll receive will start from were this
+ * master left. */
+/*
+ * 使用新的套接字 newfd 重新激活缓存的主节点
+ */
+void replicationResurrectCachedMaster(int newfd) {
+    server.master = server.cached_master;
+    server.cached_master = NULL;
+    server.master->fd = newfd;
+    server.master->flags &= ~(REDIS_CLOSE_AFTER_REPLY|REDIS_CLOSE_ASAP);
+    server.master->authenticated = 1;
+    server.master->lastinteraction = server.unixtime;
+    server.repl_state = REDIS_REPL_CONNECTED;
+
+    /* Re-add to the list of clients. */
+    listAddNodeTail(server.clients,server.master);
+    if (aeCreateFileEvent(server.el, newfd, AE_READABLE,
+                          readQueryFromClient, server.master)) {
+        redisLog(REDIS_WARNING,"Error resurrecting the cached master, impossible to add the readable handler: %s", strerror(errno));
+        freeClientAsync(server.master); /* Close ASAP. */
+    }
+}
+
+/* Called by freeClient() and replicationCacheMaster() when the link with
+ * the master is lost. */
+/*
+ * 处理与主节点的连接断开
+ */
+void replicationHandleMasterDisconnection(void) {
+    server.master = NULL;
+    server.repl_state = REDIS_REPL_CONNECT;
+    server.repl_down_since = server.unixtime;
+    /* We lost connection with our master, don't disconnect slaves yet,
+     * maybe we'll be able to PSYNC with our master later. We'll disconnect
+     * the slaves only if we'll have to do a full resync with our master. */
+}
+
 /* --------------------------- REPLICATION CRON  ---------------------------- */
 
 void replicationCron(void) {
     /* Non blocking connection timeout? */
     if (server.masterhost &&
         (server.repl_state == REDIS_REPL_CONNECTING ||
-         server.repl_state == REDIS_REPL_RECEIVE_PONG) &&
+         server.repl_state == REDIS_REPL_RECEIVE_PONG ||
+         server.repl_state == REDIS_REPL_RECEIVE_PSYNC) &&
         (time(NULL)-server.repl_transfer_lastio) > server.repl_timeout)
     {
         redisLog(REDIS_WARNING,"Timeout connecting to the MASTER...");
@@ -840,7 +1855,15 @@ void replicationCron(void) {
             redisLog(REDIS_NOTICE,"MASTER <-> SLAVE sync started");
         }
     }
-    
+
+    /* Send ACK to master from time to time.
+     * Note that we do not send periodic acks to masters that don't
+     * support PSYNC and replication offsets. */
+    // 定期向主节点报告复制偏移量
+    if (server.masterhost && server.master &&
+        !(server.master->flags & REDIS_PRE_PSYNC))
+        replicationSendAck();
+
     /* If we have attached slaves, PING them from time to time.
      * So slaves can implement an explicit timeout to masters, and will
      * be able to detect a link disconnection even if the TCP connection
@@ -848,27 +1871,114 @@ void replicationCron(void) {
     if (!(server.cronloops % (server.repl_ping_slave_period * REDIS_HZ))) {
         listIter li;
         listNode *ln;
+        robj *ping_argv[1];
+
+        /* First, send PING. It goes through the replication backlog as
+         * well, so that the offsets of master and slaves stay aligned. */
+        // PING 也会被写入复制积压缓冲区，以保证主从之间的偏移量一致
+        if (listLength(server.slaves)) {
+            ping_argv[0] = createStringObject("PING",4);
+            replicationFeedSlaves(server.slaves, server.slaveseldb,
+                ping_argv, 1);
+            decrRefCount(ping_argv[0]);
+        }
 
+        /* Second, send a newline to all the slaves in pre-synchronization
+         * stage, that is, slaves waiting for the master to create the RDB
+         * file. Just a newline will do the work of refreshing the
+         * connection last interaction time, and at the same time we'll be
+         * sure that being a single char there are no short-write
+         * problems. */
         listRewind(server.slaves,&li);
         while((ln = listNext(&li))) {
             redisClient *slave = ln->value;
 
-            /* Don't ping slaves that are in the middle of a bulk transfer
-             * with the master for first synchronization. */
-            if (slave->replstate == REDIS_REPL_SEND_BULK) continue;
-            if (slave->replstate == REDIS_REPL_ONLINE) {
-                /* If the slave is online send a normal ping */
-                addReplySds(slave,sdsnew("*1\r\n$4\r\nPING\r\n"));
-            } else {
-                /* Otherwise we are in the pre-synchronization stage.
-                 * Just a newline will do the work of refreshing the
-                 * connection last interaction time, and at the same time
-                 * we'll be sure that being a single char there are no
-                 * short-write problems. */
+            /* Slaves receiving a diskless transfer share the socket
+             * with the RDB child: never write to them in the meantime. */
+            if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START ||
+                (slave->replstate == REDIS_REPL_WAIT_BGSAVE_END &&
+                 server.rdb_child_type != REDIS_RDB_CHILD_TYPE_SOCKET))
+            {
                 if (write(slave->fd, "\n", 1) == -1) {
                     /* Don't worry, it's just a ping. */
                 }
             }
         }
     }
+
+    /* Disconnect timedout slaves. */
+    // 断开超时未发送 REPLCONF ACK 的附属节点
+    if (listLength(server.slaves)) {
+        listIter li;
+        listNode *ln;
+
+        listRewind(server.slaves,&li);
+        while((ln = listNext(&li))) {
+            redisClient *slave = ln->value;
+
+            if (slave->replstate != REDIS_REPL_ONLINE) continue;
+            if (slave->flags & REDIS_PRE_PSYNC) continue;
+            if ((server.unixtime - slave->repl_ack_time) > server.repl_timeout)
+            {
+                char ip[32];
+                int port;
+
+                if (anetPeerToString(slave->fd,ip,&port) != -1) {
+                    redisLog(REDIS_WARNING,
+                        "Disconnecting timedout slave: %s:%d",
+                        ip, slave->slave_listening_port);
+                }
+                freeClient(slave);
+            }
+        }
+    }
+
+    /* If diskless replication is enabled, the BGSAVE is not started as
+     * soon as a slave asks for SYNC: we wait a few seconds so that more
+     * slaves can arrive and share the same RDB transfer. Start it here if
+     * the oldest waiting slave waited enough. */
+    // 无盘复制：等待 repl-diskless-sync-delay 秒之后，才开始 BGSAVE
+    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+        time_t idle, max_idle = 0;
+        int slaves_waiting = 0;
+        int mincapa = -1;
+        listNode *ln;
+        listIter li;
+
+        listRewind(server.slaves,&li);
+        while((ln = listNext(&li))) {
+            redisClient *slave = ln->value;
+
+            if (slave->replstate == REDIS_REPL_WAIT_BGSAVE_START) {
+                idle = server.unixtime - slave->lastinteraction;
+                if (idle > max_idle) max_idle = idle;
+                slaves_waiting++;
+                mincapa = (mincapa == -1) ? slave->slave_capa :
+                                            (mincapa & slave->slave_capa);
+            }
+        }
+
+        if (slaves_waiting && max_idle > server.repl_diskless_sync_delay) {
+            /* Start a BGSAVE. Usually with socket target, or with disk
+             * target if there was a recent socket -> disk config change. */
+            startBgsaveForReplication(mincapa);
+        }
+    }
+
+    /* If we have no attached slaves and there is a replication backlog
+     * using memory, free it after some (configured) time. */
+    // 在没有附属节点连接一段时间之后，释放复制积压缓冲区
+    if (listLength(server.slaves) == 0 && server.repl_backlog_time_limit &&
+        server.repl_backlog)
+    {
+        time_t idle = server.unixtime - server.repl_no_slaves_since;
+
+        if (idle > server.repl_backlog_time_limit) {
+            freeReplicationBacklog();
+            redisLog(REDIS_NOTICE,
+                "Replication backlog freed after %d seconds "
+                "without connected slaves.",
+                (int) server.repl_backlog_time_limit);
+        }
+    }
 }
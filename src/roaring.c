@@ -0,0 +1,1205 @@
+/* Roaring bitmaps -- compressed bitmaps used as the encoding of sparse
+ * strings built with SETBIT.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* OVERVIEW
+ * ========
+ *
+ * A string used as a bitmap with SETBIT is usually very sparse: setting
+ * the bit 4294967295 of an empty key allocates 512MB for a single bit.
+ * A roaring bitmap splits the 2^32 bits space in chunks of 65536 bits,
+ * selected by the 16 high bits of the offset, and represents every
+ * non empty chunk with the smallest of three containers:
+ *
+ * ARRAY   a sorted array of the 16 low bits of the set bits, used up to
+ *         ROARING_ARRAY_MAX (4096) bits, that is, up to 8k of memory.
+ * BITMAP  a plain 8k bitmap. The bits are in the same order as in a Redis
+ *         string (bit 0 is the most significant bit of the first byte), so
+ *         the container is a verbatim copy of 8k of the string.
+ * RUN     a sorted array of (start, length-1) pairs of 16 bit integers,
+ *         that is used when it is the smallest representation. Runs are
+ *         never adjacent: there is always at least a clear bit between two
+ *         runs.
+ *
+ * The containers are kept in an array sorted by key, so every operation
+ * starts with a binary search of the chunk. The structure also remembers
+ * the length, in bytes, of the string it represents, since SETBIT can
+ * extend a string clearing a bit.
+ *
+ * 稀疏的位图按 65536 位分块，每个非空的块用三种容器中最小的一种表示：
+ * 有序的 16 位整数数组、 8k 的普通位图，或者行程（run）数组。
+ * 位图容器中位的顺序和 Redis 字符串一致，所以可以直接和字符串互相复制。 */
+
+#include <stdlib.h>
+#include <string.h>
+#include "roaring.h"
+#include "zmalloc.h"
+
+#define ROARING_CHUNK_BITS 65536
+
+/* ----------------------------- Bit helpers ------------------------------ */
+
+#define rcBitmapGet(bm,v) (((bm)[(v)>>3] >> (7-((v)&7))) & 1)
+#define rcBitmapSet(bm,v) ((bm)[(v)>>3] |= (1<<(7-((v)&7))))
+#define rcBitmapClear(bm,v) ((bm)[(v)>>3] &= ~(1<<(7-((v)&7))))
+
+/* Last bit of the i-th run of a run container. */
+#define rcRunEnd(runs,i) ((uint32_t)(runs)[(i)*2]+(runs)[(i)*2+1])
+
+/* Count the set bits in 'len' bytes at 'p'. */
+static uint32_t rcPopcount(const unsigned char *p, uint32_t len) {
+    uint32_t bits = 0;
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w,p,sizeof(w));
+        bits += __builtin_popcountll(w);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) bits += __builtin_popcount(*p++);
+    return bits;
+}
+
+/* Load 8 bytes as a big endian integer, so that the first bit of the
+ * string is the most significant bit of the word. */
+static uint64_t rcLoad64(const unsigned char *p) {
+    uint64_t w = 0;
+    int j;
+
+    for (j = 0; j < 8; j++) w = (w << 8) | p[j];
+    return w;
+}
+
+/* Set the bits from 'start' to 'end' (both inclusive) of 'bm'. */
+static void rcBitmapSetRange(unsigned char *bm, uint32_t start, uint32_t end) {
+    while (start <= end && (start & 7)) {
+        rcBitmapSet(bm,start);
+        start++;
+    }
+    if (start <= end && end-start+1 >= 8) {
+        uint32_t n = (end-start+1)/8;
+
+        memset(bm+(start>>3),0xff,n);
+        start += n*8;
+    }
+    while (start <= end) {
+        rcBitmapSet(bm,start);
+        start++;
+    }
+}
+
+/* Count the set bits from 'lo' to 'hi' (both inclusive) of 'bm'. */
+static uint32_t rcBitmapCountRange(const unsigned char *bm, uint32_t lo, uint32_t hi) {
+    uint32_t bits = 0;
+
+    while (lo <= hi && (lo & 7)) {
+        bits += rcBitmapGet(bm,lo);
+        lo++;
+    }
+    if (lo <= hi && hi-lo+1 >= 8) {
+        uint32_t n = (hi-lo+1)/8;
+
+        bits += rcPopcount(bm+(lo>>3),n);
+        lo += n*8;
+    }
+    while (lo <= hi) {
+        bits += rcBitmapGet(bm,lo);
+        lo++;
+    }
+    return bits;
+}
+
+/* Return the first bit set to 'bit' from 'lo' to 'hi' (both inclusive)
+ * of 'bm', or -1. Whole bytes that can't contain it are skipped. */
+static int32_t rcBitmapFirst(const unsigned char *bm, uint32_t lo, uint32_t hi, int bit) {
+    unsigned char skip = bit ? 0 : 0xff;
+
+    while (lo <= hi) {
+        if ((lo & 7) == 0 && hi-lo >= 7 && bm[lo>>3] == skip) {
+            lo += 8;
+            continue;
+        }
+        if ((int)rcBitmapGet(bm,lo) == bit) return lo;
+        lo++;
+    }
+    return -1;
+}
+
+/* Store in 'a' the positions of the set bits of the 'len' bytes at 'p',
+ * in ascending order. Returns the number of positions stored. */
+static uint32_t rcBytesToArray(const unsigned char *p, uint32_t len, uint16_t *a) {
+    uint32_t i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        unsigned int b = p[i];
+
+        while (b) {
+            int lead = __builtin_clz(b) - (int)(sizeof(unsigned int)*8-8);
+
+            a[n++] = i*8+lead;
+            b &= ~(0x80u >> lead);
+        }
+    }
+    return n;
+}
+
+/* Return the position of the first value >= v of the sorted array 'a'. */
+static uint32_t rcArrayLowerBound(const uint16_t *a, uint32_t len, uint32_t v) {
+    uint32_t lo = 0, hi = len;
+
+    while (lo < hi) {
+        uint32_t mid = (lo+hi)/2;
+
+        if (a[mid] < v) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Return the index of the last run starting at or before 'v', or -1. */
+static int32_t rcRunSeek(const uint16_t *runs, uint32_t len, uint32_t v) {
+    int32_t lo = 0, hi = (int32_t)len-1, res = -1;
+
+    while (lo <= hi) {
+        int32_t mid = (lo+hi)/2;
+
+        if (runs[mid*2] <= v) {
+            res = mid;
+            lo = mid+1;
+        } else {
+            hi = mid-1;
+        }
+    }
+    return res;
+}
+
+/* ------------------------------ Containers ------------------------------ */
+
+/* Bytes used by the data of the container. */
+static size_t rcDataSize(roaringContainer *c) {
+    switch(c->type) {
+    case ROARING_ARRAY: return c->len*sizeof(uint16_t);
+    case ROARING_BITMAP: return ROARING_BITMAP_BYTES;
+    default: return c->len*sizeof(uint16_t)*2;
+    }
+}
+
+/* Initialize 'c' as an empty array container. */
+static void rcInit(roaringContainer *c, uint16_t key) {
+    c->key = key;
+    c->type = ROARING_ARRAY;
+    c->card = 0;
+    c->len = 0;
+    c->alloc = 4;
+    c->data = zmalloc(sizeof(uint16_t)*c->alloc);
+}
+
+/* Initialize 'dst' as a copy of 'src'. */
+static void rcDup(roaringContainer *dst, roaringContainer *src) {
+    size_t size = rcDataSize(src);
+
+    *dst = *src;
+    dst->data = zmalloc(size);
+    memcpy(dst->data,src->data,size);
+    dst->alloc = dst->len;
+}
+
+static int rcContains(roaringContainer *c, uint32_t v) {
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+        uint32_t pos = rcArrayLowerBound(a,c->len,v);
+
+        return pos < c->len && a[pos] == v;
+    } else if (c->type == ROARING_BITMAP) {
+        return rcBitmapGet((unsigned char*)c->data,v);
+    } else {
+        uint16_t *runs = c->data;
+        int32_t i = rcRunSeek(runs,c->len,v);
+
+        return i >= 0 && v <= rcRunEnd(runs,i);
+    }
+}
+
+/* OR the bits of the container into the 8k bitmap 'bm'. */
+static void rcFill(roaringContainer *c, unsigned char *bm) {
+    uint32_t i;
+
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+
+        for (i = 0; i < c->len; i++) rcBitmapSet(bm,a[i]);
+    } else if (c->type == ROARING_BITMAP) {
+        unsigned char *src = c->data;
+
+        for (i = 0; i < ROARING_BITMAP_BYTES; i++) bm[i] |= src[i];
+    } else {
+        uint16_t *runs = c->data;
+
+        for (i = 0; i < c->len; i++)
+            rcBitmapSetRange(bm,runs[i*2],rcRunEnd(runs,i));
+    }
+}
+
+/* Number of runs needed to represent the container. */
+static uint32_t rcNumRuns(roaringContainer *c) {
+    uint32_t i, runs = 0;
+
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+
+        for (i = 0; i < c->len; i++)
+            if (i == 0 || a[i] != a[i-1]+1) runs++;
+    } else if (c->type == ROARING_BITMAP) {
+        unsigned char *bm = c->data;
+        uint64_t w, prev = 0;
+
+        /* A run starts at every set bit whose previous bit is clear. With
+         * big endian words the previous bit is the next more significant
+         * one, or the last bit of the previous word. */
+        for (i = 0; i < ROARING_BITMAP_BYTES; i += 8) {
+            w = rcLoad64(bm+i);
+            runs += __builtin_popcountll(w & ~((w >> 1) | (prev << 63)));
+            prev = w & 1;
+        }
+    } else {
+        runs = c->len;
+    }
+    return runs;
+}
+
+static void rcToBitmap(roaringContainer *c) {
+    unsigned char *bm;
+
+    if (c->type == ROARING_BITMAP) return;
+    bm = zcalloc(ROARING_BITMAP_BYTES);
+    rcFill(c,bm);
+    zfree(c->data);
+    c->data = bm;
+    c->type = ROARING_BITMAP;
+    c->len = c->alloc = 0;
+}
+
+/* Convert to an array container. The caller makes sure the cardinality
+ * is small enough (it may be ROARING_ARRAY_MAX+1 when a bit is about to
+ * be removed). */
+static void rcToArray(roaringContainer *c) {
+    uint16_t *a;
+    uint32_t i, n = 0;
+
+    if (c->type == ROARING_ARRAY) return;
+    a = zmalloc(sizeof(uint16_t)*c->card);
+    if (c->type == ROARING_BITMAP) {
+        n = rcBytesToArray(c->data,ROARING_BITMAP_BYTES,a);
+    } else {
+        uint16_t *runs = c->data;
+
+        for (i = 0; i < c->len; i++) {
+            uint32_t v, end = rcRunEnd(runs,i);
+
+            for (v = runs[i*2]; v <= end; v++) a[n++] = v;
+        }
+    }
+    zfree(c->data);
+    c->data = a;
+    c->type = ROARING_ARRAY;
+    c->len = c->alloc = n;
+}
+
+static void rcToRun(roaringContainer *c) {
+    uint32_t i, n = 0, nruns;
+    uint16_t *runs;
+
+    if (c->type == ROARING_RUN) return;
+    nruns = rcNumRuns(c);
+    runs = zmalloc(sizeof(uint16_t)*2*nruns);
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+
+        for (i = 0; i < c->len; i++) {
+            if (n && a[i] == rcRunEnd(runs,n-1)+1) {
+                runs[n*2-1]++;
+            } else {
+                runs[n*2] = a[i];
+                runs[n*2+1] = 0;
+                n++;
+            }
+        }
+    } else {
+        unsigned char *bm = c->data;
+        int32_t start, end;
+        uint32_t v = 0;
+
+        while (v < ROARING_CHUNK_BITS &&
+               (start = rcBitmapFirst(bm,v,ROARING_CHUNK_BITS-1,1)) != -1)
+        {
+            end = rcBitmapFirst(bm,start,ROARING_CHUNK_BITS-1,0);
+            end = (end == -1) ? ROARING_CHUNK_BITS-1 : end-1;
+            runs[n*2] = start;
+            runs[n*2+1] = end-start;
+            n++;
+            v = end+1;
+        }
+    }
+    zfree(c->data);
+    c->data = runs;
+    c->type = ROARING_RUN;
+    c->len = c->alloc = n;
+}
+
+/* Convert the container to its smallest representation. */
+static void rcOptimize(roaringContainer *c) {
+    size_t runsize = (size_t)rcNumRuns(c)*sizeof(uint16_t)*2;
+    size_t othersize = (c->card <= ROARING_ARRAY_MAX) ?
+                       c->card*sizeof(uint16_t) : ROARING_BITMAP_BYTES;
+
+    if (runsize < othersize) rcToRun(c);
+    else if (c->card <= ROARING_ARRAY_MAX) rcToArray(c);
+    else rcToBitmap(c);
+}
+
+/* Set the bit 'v'. Returns 1 if it was clear, 0 if it was already set.
+ * Run containers are not updated in place: they are converted back to
+ * an array or a bitmap first. */
+static int rcAdd(roaringContainer *c, uint32_t v) {
+    unsigned char *bm;
+
+    if (c->type == ROARING_RUN) {
+        if (rcContains(c,v)) return 0;
+        if (c->card < ROARING_ARRAY_MAX) rcToArray(c);
+        else rcToBitmap(c);
+    }
+
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+        uint32_t pos = rcArrayLowerBound(a,c->len,v);
+
+        if (pos < c->len && a[pos] == v) return 0;
+        if (c->len < ROARING_ARRAY_MAX) {
+            if (c->len == c->alloc) {
+                c->alloc = c->alloc ? c->alloc*2 : 4;
+                if (c->alloc > ROARING_ARRAY_MAX) c->alloc = ROARING_ARRAY_MAX;
+                c->data = a = zrealloc(a,sizeof(uint16_t)*c->alloc);
+            }
+            memmove(a+pos+1,a+pos,sizeof(uint16_t)*(c->len-pos));
+            a[pos] = v;
+            c->len++;
+            c->card++;
+            return 1;
+        }
+        /* The array is full: switch to a bitmap. */
+        rcToBitmap(c);
+    }
+
+    bm = c->data;
+    if (rcBitmapGet(bm,v)) return 0;
+    rcBitmapSet(bm,v);
+    c->card++;
+    /* A full chunk is a single run. */
+    if (c->card == ROARING_CHUNK_BITS) rcToRun(c);
+    return 1;
+}
+
+/* Clear the bit 'v'. Returns 1 if it was set, 0 if it was already clear. */
+static int rcRemove(roaringContainer *c, uint32_t v) {
+    if (c->type == ROARING_RUN) {
+        if (!rcContains(c,v)) return 0;
+        if (c->card <= ROARING_ARRAY_MAX+1) rcToArray(c);
+        else rcToBitmap(c);
+    }
+
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+        uint32_t pos = rcArrayLowerBound(a,c->len,v);
+
+        if (pos == c->len || a[pos] != v) return 0;
+        memmove(a+pos,a+pos+1,sizeof(uint16_t)*(c->len-pos-1));
+        c->len--;
+        c->card--;
+        /* Give memory back when most of the array is unused. */
+        if (c->len && c->len < c->alloc/4) {
+            c->alloc = c->len*2;
+            c->data = zrealloc(a,sizeof(uint16_t)*c->alloc);
+        }
+        return 1;
+    } else {
+        unsigned char *bm = c->data;
+
+        if (!rcBitmapGet(bm,v)) return 0;
+        rcBitmapClear(bm,v);
+        c->card--;
+        if (c->card <= ROARING_ARRAY_MAX) rcToArray(c);
+        return 1;
+    }
+}
+
+/* Count the set bits from 'lo' to 'hi' (both inclusive). */
+static uint32_t rcCountRange(roaringContainer *c, uint32_t lo, uint32_t hi) {
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+
+        return rcArrayLowerBound(a,c->len,hi+1) -
+               rcArrayLowerBound(a,c->len,lo);
+    } else if (c->type == ROARING_BITMAP) {
+        return rcBitmapCountRange(c->data,lo,hi);
+    } else {
+        uint16_t *runs = c->data;
+        int32_t i = rcRunSeek(runs,c->len,lo);
+        uint32_t bits = 0;
+
+        if (i < 0) i = 0;
+        for (; (uint32_t)i < c->len && runs[i*2] <= hi; i++) {
+            uint32_t s = runs[i*2], e = rcRunEnd(runs,i);
+
+            if (s < lo) s = lo;
+            if (e > hi) e = hi;
+            if (s <= e) bits += e-s+1;
+        }
+        return bits;
+    }
+}
+
+/* Return the first bit set to 'bit' from 'lo' to 'hi' (both inclusive),
+ * or -1 if there is none. */
+static int32_t rcFirst(roaringContainer *c, uint32_t lo, uint32_t hi, int bit) {
+    if (c->type == ROARING_ARRAY) {
+        uint16_t *a = c->data;
+        uint32_t pos = rcArrayLowerBound(a,c->len,lo), v = lo;
+
+        if (bit) return (pos < c->len && a[pos] <= hi) ? a[pos] : -1;
+        while (pos < c->len && a[pos] == v) {
+            pos++;
+            v++;
+        }
+        return v <= hi ? (int32_t)v : -1;
+    } else if (c->type == ROARING_BITMAP) {
+        return rcBitmapFirst(c->data,lo,hi,bit);
+    } else {
+        uint16_t *runs = c->data;
+        int32_t i = rcRunSeek(runs,c->len,lo);
+        int inside = i >= 0 && lo <= rcRunEnd(runs,i);
+
+        if (bit) {
+            if (inside) return lo;
+            i++;
+            return ((uint32_t)i < c->len && runs[i*2] <= hi) ? runs[i*2] : -1;
+        } else {
+            /* Runs are never adjacent, so the bit after a run is clear. */
+            uint32_t v = inside ? rcRunEnd(runs,i)+1 : lo;
+
+            return v <= hi ? (int32_t)v : -1;
+        }
+    }
+}
+
+/* Compute 'op' between two containers with the same key, initializing
+ * 'dst' with the result. Returns 0, without allocating anything, when the
+ * result is empty. */
+static int rcBitop(int op, roaringContainer *a, roaringContainer *b, roaringContainer *dst) {
+    unsigned char *bm, *tmp = NULL;
+    const unsigned char *other;
+    uint32_t i, card;
+
+    dst->key = a->key;
+
+    /* Two arrays are merged directly. */
+    if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY) {
+        uint16_t *x = a->data, *y = b->data, *res;
+        uint32_t j = 0, n = 0;
+
+        res = zmalloc(sizeof(uint16_t)*(a->len+b->len));
+        i = 0;
+        while (i < a->len && j < b->len) {
+            if (x[i] < y[j]) {
+                if (op != ROARING_AND) res[n++] = x[i];
+                i++;
+            } else if (x[i] > y[j]) {
+                if (op != ROARING_AND) res[n++] = y[j];
+                j++;
+            } else {
+                if (op != ROARING_XOR) res[n++] = x[i];
+                i++;
+                j++;
+            }
+        }
+        if (op != ROARING_AND) {
+            while (i < a->len) res[n++] = x[i++];
+            while (j < b->len) res[n++] = y[j++];
+        }
+        if (n == 0) {
+            zfree(res);
+            return 0;
+        }
+        if (n < a->len+b->len) res = zrealloc(res,sizeof(uint16_t)*n);
+        dst->type = ROARING_ARRAY;
+        dst->data = res;
+        dst->card = dst->len = dst->alloc = n;
+        if (n > ROARING_ARRAY_MAX) rcToBitmap(dst);
+        return 1;
+    }
+
+    /* Otherwise work on two 8k bitmaps. */
+    bm = zcalloc(ROARING_BITMAP_BYTES);
+    rcFill(a,bm);
+    if (b->type == ROARING_BITMAP) {
+        other = b->data;
+    } else {
+        tmp = zcalloc(ROARING_BITMAP_BYTES);
+        rcFill(b,tmp);
+        other = tmp;
+    }
+    switch(op) {
+    case ROARING_AND:
+        for (i = 0; i < ROARING_BITMAP_BYTES; i++) bm[i] &= other[i];
+        break;
+    case ROARING_OR:
+        for (i = 0; i < ROARING_BITMAP_BYTES; i++) bm[i] |= other[i];
+        break;
+    case ROARING_XOR:
+        for (i = 0; i < ROARING_BITMAP_BYTES; i++) bm[i] ^= other[i];
+        break;
+    }
+    zfree(tmp);
+
+    card = rcPopcount(bm,ROARING_BITMAP_BYTES);
+    if (card == 0) {
+        zfree(bm);
+        return 0;
+    }
+    dst->type = ROARING_BITMAP;
+    dst->data = bm;
+    dst->card = card;
+    dst->len = dst->alloc = 0;
+    if (card <= ROARING_ARRAY_MAX) rcToArray(dst);
+    return 1;
+}
+
+/* ------------------------------- Bitmaps -------------------------------- */
+
+roaring *roaringNew(void) {
+    roaring *r = zmalloc(sizeof(*r));
+
+    r->bytes = 0;
+    r->len = 0;
+    r->alloc = 0;
+    r->c = NULL;
+    return r;
+}
+
+void roaringFree(roaring *r) {
+    uint32_t i;
+
+    for (i = 0; i < r->len; i++) zfree(r->c[i].data);
+    zfree(r->c);
+    zfree(r);
+}
+
+/* Return the position of the first container with key >= 'key'. */
+static uint32_t roaringSeek(roaring *r, uint32_t key) {
+    uint32_t lo = 0, hi = r->len;
+
+    while (lo < hi) {
+        uint32_t mid = (lo+hi)/2;
+
+        if (r->c[mid].key < key) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Make room for a container at position 'pos' and return it. The caller
+ * initializes it. */
+static roaringContainer *roaringInsert(roaring *r, uint32_t pos) {
+    if (r->len == r->alloc) {
+        r->alloc = r->alloc ? r->alloc*2 : 4;
+        r->c = zrealloc(r->c,sizeof(roaringContainer)*r->alloc);
+    }
+    memmove(r->c+pos+1,r->c+pos,sizeof(roaringContainer)*(r->len-pos));
+    r->len++;
+    return r->c+pos;
+}
+
+/* Append a container, taking ownership of its data. */
+static void roaringAppend(roaring *r, roaringContainer *c) {
+    *roaringInsert(r,r->len) = *c;
+}
+
+static void roaringDelete(roaring *r, uint32_t pos) {
+    zfree(r->c[pos].data);
+    memmove(r->c+pos,r->c+pos+1,sizeof(roaringContainer)*(r->len-pos-1));
+    r->len--;
+}
+
+roaring *roaringDup(roaring *r) {
+    roaring *dup = roaringNew();
+    uint32_t i;
+
+    dup->bytes = r->bytes;
+    dup->alloc = dup->len = r->len;
+    if (r->len) dup->c = zmalloc(sizeof(roaringContainer)*r->len);
+    for (i = 0; i < r->len; i++) rcDup(dup->c+i,r->c+i);
+    return dup;
+}
+
+int roaringGetBit(roaring *r, uint64_t bit) {
+    uint32_t key = bit >> 16, pos = roaringSeek(r,key);
+
+    if (pos == r->len || r->c[pos].key != key) return 0;
+    return rcContains(r->c+pos,bit & 0xffff);
+}
+
+/* Set or clear the bit at offset 'bit' (that must be < 2^32) and return its
+ * old value. Like SETBIT does with strings, the bitmap is extended to
+ * include the bit even when it is cleared.
+ *
+ * 设置或清除 bit 位，并返回它原来的值。
+ * 和 SETBIT 处理字符串时一样，即使是清除位，位图的长度也会被扩展。 */
+int roaringSetBit(roaring *r, uint64_t bit, int on) {
+    uint32_t key = bit >> 16, pos = roaringSeek(r,key);
+    roaringContainer *c = NULL;
+    int old;
+
+    if (bit/8+1 > r->bytes) r->bytes = bit/8+1;
+    if (pos < r->len && r->c[pos].key == key) c = r->c+pos;
+
+    if (on) {
+        if (c == NULL) {
+            c = roaringInsert(r,pos);
+            rcInit(c,key);
+        }
+        return !rcAdd(c,bit & 0xffff);
+    }
+
+    if (c == NULL) return 0;
+    old = rcRemove(c,bit & 0xffff);
+    if (c->card == 0) roaringDelete(r,pos);
+    return old;
+}
+
+/* Number of set bits. */
+uint64_t roaringCount(roaring *r) {
+    uint64_t count = 0;
+    uint32_t i;
+
+    for (i = 0; i < r->len; i++) count += r->c[i].card;
+    return count;
+}
+
+/* Number of set bits from 'start' to 'end' (both inclusive). */
+uint64_t roaringCountRange(roaring *r, uint64_t start, uint64_t end) {
+    uint64_t count = 0;
+    uint32_t pos;
+
+    if (start > end) return 0;
+    for (pos = roaringSeek(r,start >> 16);
+         pos < r->len && r->c[pos].key <= (end >> 16); pos++)
+    {
+        roaringContainer *c = r->c+pos;
+        uint64_t base = (uint64_t)c->key << 16;
+        uint32_t lo = start > base ? start-base : 0;
+        uint32_t hi = end-base < ROARING_CHUNK_BITS-1 ?
+                      end-base : ROARING_CHUNK_BITS-1;
+
+        if (lo == 0 && hi == ROARING_CHUNK_BITS-1)
+            count += c->card;
+        else
+            count += rcCountRange(c,lo,hi);
+    }
+    return count;
+}
+
+/* Return the offset of the first bit set to 'bit' from 'start' to 'end'
+ * (both inclusive), or -1 if there is none. Chunks without a container
+ * are all clear. */
+int64_t roaringFirst(roaring *r, uint64_t start, uint64_t end, int bit) {
+    uint64_t p = start;
+    uint32_t pos;
+
+    if (start > end) return -1;
+    for (pos = roaringSeek(r,start >> 16); pos < r->len; pos++) {
+        roaringContainer *c = r->c+pos;
+        uint64_t base = (uint64_t)c->key << 16;
+        uint32_t lo, hi;
+        int32_t v;
+
+        if (base > end) break;
+        /* 'p' falls in a chunk with no container before this one. */
+        if (bit == 0 && base > p) return p;
+        lo = p > base ? p-base : 0;
+        hi = end-base < ROARING_CHUNK_BITS-1 ? end-base : ROARING_CHUNK_BITS-1;
+        v = rcFirst(c,lo,hi,bit);
+        if (v != -1) return base+v;
+        p = base+ROARING_CHUNK_BITS;
+    }
+    if (bit == 0 && p <= end) return p;
+    return -1;
+}
+
+/* Create a bitmap from the 'len' bytes of a string at 'p'. */
+roaring *roaringFromBytes(const unsigned char *p, size_t len) {
+    roaring *r = roaringNew();
+    size_t off;
+
+    r->bytes = len;
+    for (off = 0; off < len; off += ROARING_BITMAP_BYTES) {
+        uint32_t chunk = (len-off < ROARING_BITMAP_BYTES) ?
+                         len-off : ROARING_BITMAP_BYTES;
+        uint32_t card = rcPopcount(p+off,chunk);
+        roaringContainer c;
+
+        if (card == 0) continue;
+        c.key = off/ROARING_BITMAP_BYTES;
+        c.card = card;
+        if (card <= ROARING_ARRAY_MAX) {
+            c.type = ROARING_ARRAY;
+            c.data = zmalloc(sizeof(uint16_t)*card);
+            c.len = c.alloc = rcBytesToArray(p+off,chunk,c.data);
+        } else {
+            c.type = ROARING_BITMAP;
+            c.data = zcalloc(ROARING_BITMAP_BYTES);
+            memcpy(c.data,p+off,chunk);
+            c.len = c.alloc = 0;
+        }
+        roaringAppend(r,&c);
+    }
+    return r;
+}
+
+/* Write the string represented by the bitmap, r->bytes bytes, at 'dst'. */
+void roaringToBytes(roaring *r, unsigned char *dst) {
+    uint32_t i, j;
+
+    memset(dst,0,r->bytes);
+    for (i = 0; i < r->len; i++) {
+        roaringContainer *c = r->c+i;
+        size_t base = (size_t)c->key*ROARING_BITMAP_BYTES;
+        unsigned char *p = dst+base;
+
+        /* No bit is set past r->bytes, but the last chunk may be short. */
+        if (c->type == ROARING_ARRAY) {
+            uint16_t *a = c->data;
+
+            for (j = 0; j < c->len; j++) rcBitmapSet(p,a[j]);
+        } else if (c->type == ROARING_BITMAP) {
+            size_t room = r->bytes-base;
+
+            memcpy(p,c->data,room < ROARING_BITMAP_BYTES ?
+                             room : ROARING_BITMAP_BYTES);
+        } else {
+            uint16_t *runs = c->data;
+
+            for (j = 0; j < c->len; j++)
+                rcBitmapSetRange(p,runs[j*2],rcRunEnd(runs,j));
+        }
+    }
+}
+
+/* Return a new bitmap with the result of 'op' (ROARING_AND, ROARING_OR or
+ * ROARING_XOR) between 'a' and 'b'. Like BITOP, the result is as long as
+ * the longest input. */
+roaring *roaringBitop(int op, roaring *a, roaring *b) {
+    roaring *r = roaringNew();
+    uint32_t i = 0, j = 0;
+
+    r->bytes = a->bytes > b->bytes ? a->bytes : b->bytes;
+    while (i < a->len || j < b->len) {
+        roaringContainer *ca = (i < a->len) ? a->c+i : NULL;
+        roaringContainer *cb = (j < b->len) ? b->c+j : NULL;
+        roaringContainer c;
+
+        if (cb == NULL || (ca && ca->key < cb->key)) {
+            if (op != ROARING_AND) {
+                rcDup(&c,ca);
+                roaringAppend(r,&c);
+            }
+            i++;
+        } else if (ca == NULL || cb->key < ca->key) {
+            if (op != ROARING_AND) {
+                rcDup(&c,cb);
+                roaringAppend(r,&c);
+            }
+            j++;
+        } else {
+            if (rcBitop(op,ca,cb,&c)) roaringAppend(r,&c);
+            i++;
+            j++;
+        }
+    }
+    return r;
+}
+
+/* Return a new bitmap with all the a->bytes*8 bits of 'a' inverted. */
+roaring *roaringNot(roaring *a) {
+    roaring *r = roaringNew();
+    uint64_t nbits = (uint64_t)a->bytes*8;
+    uint32_t key, pos = 0, i;
+
+    r->bytes = a->bytes;
+    if (nbits == 0) return r;
+    for (key = 0; key <= (nbits-1) >> 16; key++) {
+        uint64_t base = (uint64_t)key << 16;
+        uint32_t hi = (nbits-1-base < ROARING_CHUNK_BITS-1) ?
+                      nbits-1-base : ROARING_CHUNK_BITS-1;
+        roaringContainer c;
+
+        c.key = key;
+        if (pos < a->len && a->c[pos].key == key) {
+            unsigned char *bm = zcalloc(ROARING_BITMAP_BYTES);
+
+            /* hi+1 is always a multiple of 8: strings are made of bytes. */
+            rcFill(a->c+pos,bm);
+            for (i = 0; i < (hi+1)/8; i++) bm[i] ^= 0xff;
+            pos++;
+            c.card = rcPopcount(bm,ROARING_BITMAP_BYTES);
+            if (c.card == 0) {
+                zfree(bm);
+                continue;
+            }
+            c.type = ROARING_BITMAP;
+            c.data = bm;
+            c.len = c.alloc = 0;
+            if (c.card <= ROARING_ARRAY_MAX) rcToArray(&c);
+        } else {
+            /* A missing chunk becomes a single run. */
+            uint16_t *runs = zmalloc(sizeof(uint16_t)*2);
+
+            runs[0] = 0;
+            runs[1] = hi;
+            c.type = ROARING_RUN;
+            c.data = runs;
+            c.card = hi+1;
+            c.len = c.alloc = 1;
+        }
+        roaringAppend(r,&c);
+    }
+    return r;
+}
+
+/* Convert every container to its smallest representation, including run
+ * containers, that are never created by single bit updates. */
+void roaringRunOptimize(roaring *r) {
+    uint32_t i;
+
+    for (i = 0; i < r->len; i++) rcOptimize(r->c+i);
+}
+
+/* ---------------------------- Serialization ----------------------------- */
+
+/* The serialized format, all integers little endian:
+ *
+ * <bytes:32><count:32> then for every container
+ * <key:16><type:8><card:32><len:32><data>
+ *
+ * where data is 'len' 16 bit values for arrays, 8192 bytes for bitmaps and
+ * 'len' pairs of 16 bit values for runs. */
+#define ROARING_HDR_SIZE 8
+#define ROARING_CONTAINER_HDR_SIZE 11
+
+static void rcWrite16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void rcWrite32(unsigned char *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+static uint16_t rcRead16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t rcRead32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Size of the serialized bitmap. */
+size_t roaringBlobLen(roaring *r) {
+    size_t len = ROARING_HDR_SIZE;
+    uint32_t i;
+
+    for (i = 0; i < r->len; i++)
+        len += ROARING_CONTAINER_HDR_SIZE+rcDataSize(r->c+i);
+    return len;
+}
+
+/* Serialize the bitmap at 'buf', that must be roaringBlobLen() bytes. */
+void roaringSerialize(roaring *r, unsigned char *buf) {
+    unsigned char *p = buf;
+    uint32_t i, j;
+
+    rcWrite32(p,r->bytes);
+    rcWrite32(p+4,r->len);
+    p += ROARING_HDR_SIZE;
+    for (i = 0; i < r->len; i++) {
+        roaringContainer *c = r->c+i;
+
+        rcWrite16(p,c->key);
+        p[2] = c->type;
+        rcWrite32(p+3,c->card);
+        rcWrite32(p+7,c->len);
+        p += ROARING_CONTAINER_HDR_SIZE;
+        if (c->type == ROARING_BITMAP) {
+            memcpy(p,c->data,ROARING_BITMAP_BYTES);
+            p += ROARING_BITMAP_BYTES;
+        } else {
+            uint16_t *v = c->data;
+            uint32_t count = (c->type == ROARING_ARRAY) ? c->len : c->len*2;
+
+            for (j = 0; j < count; j++) {
+                rcWrite16(p,v[j]);
+                p += 2;
+            }
+        }
+    }
+}
+
+/* Load a bitmap serialized with roaringSerialize(). The blob may come from
+ * the outside (RESTORE), so it is fully validated: NULL is returned if it
+ * is not a valid bitmap.
+ *
+ * 载入 roaringSerialize() 序列化的位图。因为数据可能来自外部（ RESTORE ），
+ * 所以会进行完整的检查，数据无效时返回 NULL 。 */
+roaring *roaringDeserialize(const unsigned char *buf, size_t len) {
+    const unsigned char *p = buf, *end = buf+len;
+    roaring *r;
+    uint32_t count, i, j;
+
+    if (len < ROARING_HDR_SIZE) return NULL;
+    r = roaringNew();
+    r->bytes = rcRead32(p);
+    count = rcRead32(p+4);
+    p += ROARING_HDR_SIZE;
+    if (r->bytes > 512*1024*1024) goto err;
+
+    for (i = 0; i < count; i++) {
+        roaringContainer c;
+        uint32_t maxbit = 0;
+        uint16_t *v;
+
+        if ((size_t)(end-p) < ROARING_CONTAINER_HDR_SIZE) goto err;
+        c.key = rcRead16(p);
+        c.type = p[2];
+        c.card = rcRead32(p+3);
+        c.len = c.alloc = rcRead32(p+7);
+        p += ROARING_CONTAINER_HDR_SIZE;
+        if (r->len && c.key <= r->c[r->len-1].key) goto err;
+        if (c.card == 0 || c.card > ROARING_CHUNK_BITS) goto err;
+
+        if (c.type == ROARING_ARRAY) {
+            if (c.len != c.card || c.len > ROARING_ARRAY_MAX ||
+                (size_t)(end-p) < c.len*2) goto err;
+            c.data = v = zmalloc(sizeof(uint16_t)*c.len);
+            for (j = 0; j < c.len; j++) {
+                v[j] = rcRead16(p+j*2);
+                if (j && v[j] <= v[j-1]) goto cerr;
+            }
+            p += c.len*2;
+            maxbit = v[c.len-1];
+        } else if (c.type == ROARING_BITMAP) {
+            unsigned char *bm;
+
+            if (c.len != 0 || (size_t)(end-p) < ROARING_BITMAP_BYTES) goto err;
+            if (rcPopcount(p,ROARING_BITMAP_BYTES) != c.card) goto err;
+            c.data = bm = zmalloc(ROARING_BITMAP_BYTES);
+            memcpy(bm,p,ROARING_BITMAP_BYTES);
+            p += ROARING_BITMAP_BYTES;
+            for (j = ROARING_BITMAP_BYTES-1; bm[j] == 0; j--);
+            maxbit = j*8+7-__builtin_ctz(bm[j]);
+        } else if (c.type == ROARING_RUN) {
+            uint32_t card = 0;
+
+            if (c.len == 0 || c.len > ROARING_CHUNK_BITS/2 ||
+                (size_t)(end-p) < c.len*4) goto err;
+            c.data = v = zmalloc(sizeof(uint16_t)*2*c.len);
+            for (j = 0; j < c.len*2; j++) v[j] = rcRead16(p+j*2);
+            p += c.len*4;
+            for (j = 0; j < c.len; j++) {
+                if (rcRunEnd(v,j) >= ROARING_CHUNK_BITS) goto cerr;
+                if (j && v[j*2] <= rcRunEnd(v,j-1)+1) goto cerr;
+                card += v[j*2+1]+1;
+            }
+            if (card != c.card) goto cerr;
+            maxbit = rcRunEnd(v,c.len-1);
+        } else {
+            goto err;
+        }
+        /* No bit may be set past the end of the string. */
+        if (((uint64_t)c.key << 16)+maxbit >= (uint64_t)r->bytes*8) goto cerr;
+        roaringAppend(r,&c);
+        continue;
+
+cerr:
+        zfree(c.data);
+        goto err;
+    }
+    if (p != end) goto err;
+    return r;
+
+err:
+    roaringFree(r);
+    return NULL;
+}
+
+#ifdef ROARING_TEST_MAIN
+#include <stdio.h>
+#include <assert.h>
+#include "testhelp.h"
+
+/* Randomized tests against a plain string bitmap. Build with:
+ * cc -O2 -DROARING_TEST_MAIN roaring.c zmalloc.c -o roaring-test */
+
+#define TEST_BYTES 37500 /* Not a multiple of the chunk size. */
+
+/* Set or clear random bits, some of them in dense clusters, so that all
+ * the container types and conversions are exercised. */
+static void testFill(roaring *r, unsigned char *s, int ops, int on) {
+    int j, k;
+
+    for (j = 0; j < ops; j++) {
+        uint32_t bit = rand() % (TEST_BYTES*8);
+        int cluster = (rand() % 10 == 0) ? rand() % 6000 : 1;
+
+        for (k = 0; k < cluster && bit < TEST_BYTES*8; k++, bit++) {
+            int set = on == -1 ? rand() & 1 : on;
+            int old = (s[bit>>3] >> (7-(bit&7))) & 1;
+
+            assert(roaringSetBit(r,bit,set) == old);
+            if (set) s[bit>>3] |= 1<<(7-(bit&7));
+            else s[bit>>3] &= ~(1<<(7-(bit&7)));
+        }
+    }
+}
+
+/* Check every query against the plain bitmap 's'. */
+static int testCheck(roaring *r, unsigned char *s) {
+    static unsigned char buf[TEST_BYTES];
+    unsigned char *blob;
+    roaring *copy;
+    int j, ok = 1;
+
+    roaringToBytes(r,buf);
+    if (r->bytes != TEST_BYTES || memcmp(buf,s,TEST_BYTES)) return 0;
+    for (j = 0; j < 200; j++) {
+        uint32_t a = rand() % (TEST_BYTES*8), b = rand() % (TEST_BYTES*8);
+        uint64_t count = 0, k;
+        int64_t first1 = -1, first0 = -1;
+
+        if (a > b) { uint32_t t = a; a = b; b = t; }
+        for (k = a; k <= b; k++) {
+            int bit = (s[k>>3] >> (7-(k&7))) & 1;
+
+            count += bit;
+            if (bit && first1 == -1) first1 = k;
+            if (!bit && first0 == -1) first0 = k;
+        }
+        if (roaringCountRange(r,a,b) != count ||
+            roaringFirst(r,a,b,1) != first1 ||
+            roaringFirst(r,a,b,0) != first0 ||
+            roaringGetBit(r,a) != ((s[a>>3] >> (7-(a&7))) & 1)) ok = 0;
+    }
+
+    blob = malloc(roaringBlobLen(r));
+    roaringSerialize(r,blob);
+    copy = roaringDeserialize(blob,roaringBlobLen(r));
+    if (copy == NULL) {
+        ok = 0;
+    } else {
+        roaringToBytes(copy,buf);
+        if (memcmp(buf,s,TEST_BYTES)) ok = 0;
+        roaringFree(copy);
+        /* Truncated blobs are refused. */
+        if (roaringDeserialize(blob,roaringBlobLen(r)-1) != NULL) ok = 0;
+    }
+    free(blob);
+    return ok;
+}
+
+int main(void) {
+    static unsigned char s1[TEST_BYTES], s2[TEST_BYTES], exp[TEST_BYTES];
+    static unsigned char buf[TEST_BYTES];
+    roaring *r1, *r2, *res;
+    int iter, op, ok, j;
+
+    srand(1234);
+    for (iter = 0; iter < 20; iter++) {
+        memset(s1,0,TEST_BYTES);
+        memset(s2,0,TEST_BYTES);
+        r1 = roaringNew();
+        r2 = roaringNew();
+        roaringSetBit(r1,TEST_BYTES*8-1,0);
+        roaringSetBit(r2,TEST_BYTES*8-1,0);
+        testFill(r1,s1,200,1);
+        testFill(r1,s1,100,-1);
+        testFill(r2,s2,50,1);
+        testFill(r2,s2,50,0);
+
+        ok = testCheck(r1,s1) && testCheck(r2,s2);
+        roaringRunOptimize(r1);
+        ok = ok && testCheck(r1,s1);
+        testFill(r1,s1,50,-1);
+        ok = ok && testCheck(r1,s1);
+
+        for (op = ROARING_AND; op <= ROARING_XOR; op++) {
+            res = roaringBitop(op,r1,r2);
+            for (j = 0; j < TEST_BYTES; j++) {
+                exp[j] = op == ROARING_AND ? s1[j] & s2[j] :
+                         op == ROARING_OR ? s1[j] | s2[j] : s1[j] ^ s2[j];
+            }
+            ok = ok && testCheck(res,exp);
+            roaringFree(res);
+        }
+        res = roaringNot(r1);
+        for (j = 0; j < TEST_BYTES; j++) exp[j] = ~s1[j];
+        ok = ok && testCheck(res,exp);
+        roaringRunOptimize(res);
+        ok = ok && testCheck(res,exp);
+        roaringFree(res);
+
+        res = roaringFromBytes(s2,TEST_BYTES);
+        roaringToBytes(res,buf);
+        ok = ok && roaringCount(res) == roaringCount(r2) &&
+             !memcmp(buf,s2,TEST_BYTES);
+        roaringFree(res);
+
+        res = roaringDup(r1);
+        ok = ok && testCheck(res,s1);
+        roaringFree(res);
+
+        test_cond("Random operations match a plain bitmap",ok);
+        roaringFree(r1);
+        roaringFree(r2);
+    }
+    test_report();
+    return 0;
+}
+#endif
@@ -0,0 +1,113 @@
+/* Roaring bitmaps -- compressed bitmaps used as the encoding of sparse
+ * strings built with SETBIT.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ROARING_H
+#define __ROARING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Container types. */
+#define ROARING_ARRAY 0     /* Sorted array of 16 bit values. */
+#define ROARING_BITMAP 1    /* Plain 65536 bits bitmap. */
+#define ROARING_RUN 2       /* Sorted array of (start, length-1) pairs. */
+
+/* An array container never holds more than ROARING_ARRAY_MAX values: past
+ * this point a bitmap container (8k) is smaller. */
+#define ROARING_ARRAY_MAX 4096
+#define ROARING_BITMAP_BYTES 8192
+
+/* roaringBitop() operations, the same values as BITOP_* in bitops.c. */
+#define ROARING_AND 0
+#define ROARING_OR 1
+#define ROARING_XOR 2
+
+/* A container holds the bits of one 65536 bits chunk of the bitmap, the
+ * one selected by the 16 high bits of the bit offset. Containers are never
+ * empty.
+ *
+ * 每个容器保存位图中的一个 65536 位的块，块由位偏移量的高 16 位选出。
+ * 容器不会为空。 */
+typedef struct roaringContainer {
+
+    // 块编号，也即是位偏移量的高 16 位
+    uint16_t key;
+
+    // 容器类型： ROARING_ARRAY 、 ROARING_BITMAP 或 ROARING_RUN
+    uint8_t type;
+
+    // 容器中被设置的位的数量
+    uint32_t card;
+
+    // 数组容器的值数量，或者行程容器的行程数量
+    uint32_t len;
+
+    // data 已分配的项数（位图容器不使用）
+    uint32_t alloc;
+
+    void *data;
+
+} roaringContainer;
+
+typedef struct roaring {
+
+    // 位图所表示的字符串的长度（字节），STRLEN 和 GET 看到的就是它
+    uint32_t bytes;
+
+    // 容器数量
+    uint32_t len;
+
+    // 已分配的容器数量
+    uint32_t alloc;
+
+    // 按 key 排序的容器数组
+    roaringContainer *c;
+
+} roaring;
+
+roaring *roaringNew(void);
+void roaringFree(roaring *r);
+roaring *roaringDup(roaring *r);
+int roaringGetBit(roaring *r, uint64_t bit);
+int roaringSetBit(roaring *r, uint64_t bit, int on);
+uint64_t roaringCount(roaring *r);
+uint64_t roaringCountRange(roaring *r, uint64_t start, uint64_t end);
+int64_t roaringFirst(roaring *r, uint64_t start, uint64_t end, int bit);
+roaring *roaringFromBytes(const unsigned char *p, size_t len);
+void roaringToBytes(roaring *r, unsigned char *dst);
+roaring *roaringBitop(int op, roaring *a, roaring *b);
+roaring *roaringNot(roaring *a);
+void roaringRunOptimize(roaring *r);
+size_t roaringBlobLen(roaring *r);
+void roaringSerialize(roaring *r, unsigned char *buf);
+roaring *roaringDeserialize(const unsigned char *buf, size_t len);
+
+#endif
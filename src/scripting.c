@@ -474,7 +474,7 @@ void luaMaskCountHook(lua_State *lua, lua_Debug *ar) {
     }
     if (server.lua_timedout)
         // 在脚本上下文中，启动文件事件处理（等待 SCRIPT KILL 或 SHUTDOWN NOSAVE）
-        aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
+        processEventsWhileBlocked();
     if (server.lua_kill) {
         // 杀死脚本
         redisLog(REDIS_WARNING,"Lua script killed by user with SCRIPT KILL.");
@@ -33,44 +33,114 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <limits.h>
 #include "sds.h"
 #include "zmalloc.h"
 
+/*
+ * 返回给定类型的 sds 头部的长度
+ */
+int sdsHdrSize(char type) {
+    switch(type&SDS_TYPE_MASK) {
+        case SDS_TYPE_8:
+            return sizeof(struct sdshdr8);
+        case SDS_TYPE_16:
+            return sizeof(struct sdshdr16);
+        case SDS_TYPE_32:
+            return sizeof(struct sdshdr32);
+        case SDS_TYPE_64:
+            return sizeof(struct sdshdr64);
+    }
+    return 0;
+}
+
+/*
+ * 返回可以保存长度为 string_size 的字符串的最小头部类型
+ */
+char sdsReqType(size_t string_size) {
+    if (string_size < 1<<8)
+        return SDS_TYPE_8;
+    if (string_size < 1<<16)
+        return SDS_TYPE_16;
+#if (LONG_MAX == LLONG_MAX)
+    if (string_size < 1ll<<32)
+        return SDS_TYPE_32;
+    return SDS_TYPE_64;
+#else
+    return SDS_TYPE_32;
+#endif
+}
+
 /*
  * 创建一个指定长度的 sds 
  * 如果给定了初始化值 init 的话，那么将 init 复制到 sds 的 buf 当中
  *
+ * 头部的类型根据 initlen 自动选择。
+ *
  * T = O(N)
  */
 sds sdsnewlen(const void *init, size_t initlen) {
-
-    struct sdshdr *sh;
+    void *sh;
+    sds s;
+    char type = sdsReqType(initlen);
+    int hdrlen = sdsHdrSize(type);
+    unsigned char *fp; /* flags pointer. */
 
     // 有 init ？
     // O(N)
     if (init) {
-        sh = zmalloc(sizeof(struct sdshdr)+initlen+1);
+        sh = zmalloc(hdrlen+initlen+1);
     } else {
-        sh = zcalloc(sizeof(struct sdshdr)+initlen+1);
+        sh = zcalloc(hdrlen+initlen+1);
     }
 
     // 内存不足，分配失败
     if (sh == NULL) return NULL;
 
-    sh->len = initlen;
-    sh->free = 0;
+    s = (char*)sh+hdrlen;
+    fp = ((unsigned char*)s)-1;
+    switch(type) {
+        case SDS_TYPE_8: {
+            SDS_HDR_VAR(8,s);
+            sh->len = initlen;
+            sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_16: {
+            SDS_HDR_VAR(16,s);
+            sh->len = initlen;
+            sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_32: {
+            SDS_HDR_VAR(32,s);
+            sh->len = initlen;
+            sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+        case SDS_TYPE_64: {
+            SDS_HDR_VAR(64,s);
+            sh->len = initlen;
+            sh->alloc = initlen;
+            *fp = type;
+            break;
+        }
+    }
 
     // 如果给定了 init 且 initlen 不为 0 的话
     // 那么将 init 的内容复制至 sds buf
     // O(N)
     if (initlen && init)
-        memcpy(sh->buf, init, initlen);
+        memcpy(s, init, initlen);
 
     // 加上终结符
-    sh->buf[initlen] = '\0';
+    s[initlen] = '\0';
 
     // 返回 buf 而不是整个 sdshdr
-    return (char*)sh->buf;
+    return s;
 }
 
 /*
@@ -112,24 +182,21 @@ sds sdsdup(const sds s) {
  */
 void sdsfree(sds s) {
     if (s == NULL) return;
-    zfree(s-sizeof(struct sdshdr));
+    zfree((char*)s-sdsHdrSize(s[-1]));
 }
 
 /*
- * 更新给定 sds 所对应的 sdshdr 结构的 free 和 len 属性
+ * 根据 strlen() 的结果更新给定 sds 的 len 属性
  *
  * T = O(n)
  */
 void sdsupdatelen(sds s) {
 
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-
     // 计算正确的 buf 长度
-    int reallen = strlen(s);
+    size_t reallen = strlen(s);
 
     // 更新属性
-    sh->free += (sh->len-reallen);
-    sh->len = reallen;
+    sdssetlen(s, reallen);
 }
 
 /*
@@ -138,12 +205,8 @@ void sdsupdatelen(sds s) {
  * T = O(1)
  */
 void sdsclear(sds s) {
-
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-
-    sh->free += sh->len;
-    sh->len = 0;
-    sh->buf[0] = '\0';
+    sdssetlen(s, 0);
+    s[0] = '\0';
 }
 
 /* Enlarge the free space at the end of the sds string so that the caller
@@ -162,17 +225,18 @@ sds sdsMakeRoomFor(
     size_t addlen   // 需要增加的空间长度
 ) 
 {
-    struct sdshdr *sh, *newsh;
-    size_t free = sdsavail(s);
+    void *sh, *newsh;
+    size_t avail = sdsavail(s);
     size_t len, newlen;
+    char type, oldtype = s[-1] & SDS_TYPE_MASK;
+    int hdrlen;
 
     // 剩余空间可以满足需求，无须扩展
-    if (free >= addlen) return s;
-
-    sh = (void*) (s-(sizeof(struct sdshdr)));
+    if (avail >= addlen) return s;
 
     // 目前 buf 长度
     len = sdslen(s);
+    sh = (char*)s-sdsHdrSize(oldtype);
     // 新 buf 长度
     newlen = (len+addlen);
     // 如果新 buf 长度小于 SDS_MAX_PREALLOC 长度
@@ -182,50 +246,88 @@ sds sdsMakeRoomFor(
     else
         newlen += SDS_MAX_PREALLOC;
 
-    // 扩展长度
-    newsh = zrealloc(sh, sizeof(struct sdshdr)+newlen+1);
-
-    if (newsh == NULL) return NULL;
-
-    newsh->free = newlen - len;
-
-    return newsh->buf;
+    // 新长度所需的头部类型
+    type = sdsReqType(newlen);
+    hdrlen = sdsHdrSize(type);
+    if (oldtype==type) {
+        // 头部类型不变，原地扩展
+        newsh = zrealloc(sh, hdrlen+newlen+1);
+        if (newsh == NULL) return NULL;
+        s = (char*)newsh+hdrlen;
+    } else {
+        /* Since the header size changes, need to move the string forward,
+         * and can't use realloc */
+        // 头部变大了，需要把字符串移到新的位置，不能使用 realloc
+        newsh = zmalloc(hdrlen+newlen+1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh+hdrlen, s, len+1);
+        zfree(sh);
+        s = (char*)newsh+hdrlen;
+        s[-1] = type;
+        sdssetlen(s, len);
+    }
+    sdssetalloc(s, newlen);
+    return s;
 }
 
 /* Reallocate the sds string so that it has no free space at the end. The
  * contained string remains not altered, but next concatenation operations
- * will require a reallocation. */
+ * will require a reallocation.
+ *
+ * After the call, the passed sds string is no longer valid and all the
+ * references must be substituted with the new pointer returned by the call. */
 /*
  * 在不改动 sds buf 内容的情况下，将 buf 内多余的空间释放出去。
  * 在对 sds 执行这个函数之后，下一次对这个 sds 的拼接操作必然需要一次内存分配。
  *
+ * 如果缩小后的长度可以使用更小的头部，那么同时更换头部类型。
+ *
  * T = O(N)
  */
 sds sdsRemoveFreeSpace(sds s) {
-
-    struct sdshdr *sh;
-
-    sh = (void*) (s-(sizeof(struct sdshdr)));
-
-    // 修改 buf 长度为 sh->len + 1 
-    // 不保留任何多余空间
-    sh = zrealloc(sh, sizeof(struct sdshdr)+sh->len+1);
-
-    sh->free = 0;
-
-    return sh->buf;
+    void *sh, *newsh;
+    char type, oldtype = s[-1] & SDS_TYPE_MASK;
+    int hdrlen, oldhdrlen = sdsHdrSize(oldtype);
+    size_t len = sdslen(s);
+
+    sh = (char*)s-oldhdrlen;
+
+    type = sdsReqType(len);
+    hdrlen = sdsHdrSize(type);
+    if (oldtype==type) {
+        // 修改 buf 长度为 len + 1 
+        // 不保留任何多余空间
+        newsh = zrealloc(sh, oldhdrlen+len+1);
+        if (newsh == NULL) return NULL;
+        s = (char*)newsh+oldhdrlen;
+    } else {
+        newsh = zmalloc(hdrlen+len+1);
+        if (newsh == NULL) return NULL;
+        memcpy((char*)newsh+hdrlen, s, len+1);
+        zfree(sh);
+        s = (char*)newsh+hdrlen;
+        s[-1] = type;
+        sdssetlen(s, len);
+    }
+    sdssetalloc(s, len);
+    return s;
 }
 
 /*
- * 计算给定 sds buf 的内存长度（包括已使用和未使用的）
+ * 计算给定 sds 的内存长度（包括头部、已使用和未使用的空间以及终结符）
  *
  * T = O(1)
  */
 size_t sdsAllocSize(sds s) {
+    size_t alloc = sdsalloc(s);
+    return sdsHdrSize(s[-1])+alloc+1;
+}
 
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-
-    return sizeof(*sh)+sh->len+sh->free+1;
+/* Return the pointer of the actual SDS allocation (normally SDS strings
+ * are referenced by the start of the string buffer). */
+// 返回 sds 实际分配的内存的起始地址（也即头部的地址）
+void *sdsAllocPtr(sds s) {
+    return (void*) (s-sdsHdrSize(s[-1]));
 }
 
 /* Increment the sds length and decrements the left free space at the
@@ -282,15 +384,17 @@ size_t sdsAllocSize(sds s) {
  *
  * T = O(1)
  */
-void sdsIncrLen(sds s, int incr) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
+void sdsIncrLen(sds s, ssize_t incr) {
+    size_t len = sdslen(s);
 
-    assert(sh->free >= incr);
-    sh->len += incr;
-    sh->free -= incr;
-    assert(sh->free >= 0);
+    if (incr >= 0)
+        assert(sdsavail(s) >= (size_t)incr);
+    else
+        assert(len >= (size_t)(-incr));
+    len += incr;
+    sdssetlen(s, len);
 
-    s[sh->len] = '\0';
+    s[len] = '\0';
 }
 
 /* Grow the sds to have the specified length. Bytes that were not part of
@@ -301,10 +405,7 @@ void sdsIncrLen(sds s, int incr) {
  * T = O(N)
  */
 sds sdsgrowzero(sds s, size_t len) {
-
-    struct sdshdr *sh = (void*)(s-(sizeof(struct sdshdr)));
-
-    size_t totlen, curlen = sh->len;
+    size_t curlen = sdslen(s);
 
     // 现有长度比给定长度要大，无须扩展
     if (len <= curlen) return s;
@@ -315,13 +416,10 @@ sds sdsgrowzero(sds s, size_t len) {
 
     /* Make sure added region doesn't contain garbage */
     // 使用 \0 来填充空位，确保空位中不包含垃圾数据
-    sh = (void*)(s-(sizeof(struct sdshdr)));
     memset(s+curlen,0,(len-curlen+1)); /* also set trailing \0 byte */
 
-    // 更新 len 和 free 属性
-    totlen = sh->len + sh->free;
-    sh->len = len;
-    sh->free = totlen - sh->len;
+    // 更新 len 属性
+    sdssetlen(s, len);
 
     return s;
 }
@@ -332,9 +430,6 @@ sds sdsgrowzero(sds s, size_t len) {
  * T = O(N)
  */
 sds sdscatlen(sds s, const void *t, size_t len) {
-
-    struct sdshdr *sh;
-
     size_t curlen = sdslen(s);
 
     // O(N)
@@ -345,11 +440,9 @@ sds sdscatlen(sds s, const void *t, size_t len) {
     // O(N)
     memcpy(s+curlen, t, len);
 
-    // 更新 len 和 free 属性
+    // 更新 len 属性
     // O(1)
-    sh = (void*) (s-(sizeof(struct sdshdr)));
-    sh->len = curlen+len;
-    sh->free = sh->free-len;
+    sdssetlen(s, curlen+len);
 
     // 终结符
     // O(1)
@@ -385,26 +478,20 @@ sds sdscatsds(sds s, const sds t) {
  */
 sds sdscpylen(sds s, const char *t, size_t len) {
 
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
-
     // 是否需要扩展 buf ？
-    size_t totlen = sh->free+sh->len;
-    if (totlen < len) {
+    if (sdsalloc(s) < len) {
         // 扩展 buf 长度，让它的长度大于等于 len
         // 具体的大小请参考 sdsMakeRoomFor 的注释
         // T = O(N)
-        s = sdsMakeRoomFor(s,len-sh->len);
+        s = sdsMakeRoomFor(s,len-sdslen(s));
         if (s == NULL) return NULL;
-        sh = (void*) (s-(sizeof(struct sdshdr)));
-        totlen = sh->free+sh->len;
     }
 
     // O(N)
     memcpy(s, t, len);
     s[len] = '\0';
 
-    sh->len = len;
-    sh->free = totlen-len;
+    sdssetlen(s, len);
 
     return s;
 }
@@ -449,7 +536,6 @@ sds sdscatprintf(sds s, const char *fmt, ...) {
 }
 
 sds sdstrim(sds s, const char *cset) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     char *start, *end, *sp, *ep;
     size_t len;
 
@@ -458,15 +544,13 @@ sds sdstrim(sds s, const char *cset) {
     while(sp <= end && strchr(cset, *sp)) sp++;
     while(ep > start && strchr(cset, *ep)) ep--;
     len = (sp > ep) ? 0 : ((ep-sp)+1);
-    if (sh->buf != sp) memmove(sh->buf, sp, len);
-    sh->buf[len] = '\0';
-    sh->free = sh->free+(sh->len-len);
-    sh->len = len;
+    if (s != sp) memmove(s, sp, len);
+    s[len] = '\0';
+    sdssetlen(s,len);
     return s;
 }
 
 sds sdsrange(sds s, int start, int end) {
-    struct sdshdr *sh = (void*) (s-(sizeof(struct sdshdr)));
     size_t newlen, len = sdslen(s);
 
     if (len == 0) return s;
@@ -489,10 +573,9 @@ sds sdsrange(sds s, int start, int end) {
     } else {
         start = 0;
     }
-    if (start && newlen) memmove(sh->buf, sh->buf+start, newlen);
-    sh->buf[newlen] = 0;
-    sh->free = sh->free+(sh->len-newlen);
-    sh->len = newlen;
+    if (start && newlen) memmove(s, s+start, newlen);
+    s[newlen] = 0;
+    sdssetlen(s,newlen);
     return s;
 }
 
@@ -817,11 +900,89 @@ sds sdsmapchars(sds s, const char *from, const char *to, size_t setlen) {
 
 #ifdef SDS_TEST_MAIN
 #include <stdio.h>
+#include <sys/time.h>
 #include "testhelp.h"
 
-int main(void) {
+/* Unit tests, microbenchmark and memory report. Build with:
+ * cc -O2 -DSDS_TEST_MAIN sds.c zmalloc.c -o sds-test
+ * and run "./sds-test bench" to also run the benchmark. */
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Memory used by a keyspace of 'keys' keys, from 10 to 20 bytes each,
+ * extrapolated from the allocator usage of a 1M keys sample, with the
+ * current headers and with the old fixed 8 bytes header. */
+#define SDS_BENCH_SAMPLE 1000000
+
+static void sdsMemoryReport(long long keys) {
+    sds *v = zmalloc(sizeof(sds)*SDS_BENCH_SAMPLE);
+    size_t before, sdsmem, oldmem;
+    char buf[32];
+    int j;
+
+    before = zmalloc_used_memory();
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) {
+        int len = snprintf(buf,sizeof(buf),"key:%0*d",6+j%11,j);
+        v[j] = sdsnewlen(buf,len);
+    }
+    sdsmem = zmalloc_used_memory()-before;
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) sdsfree(v[j]);
+
+    before = zmalloc_used_memory();
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) {
+        int len = snprintf(buf,sizeof(buf),"key:%0*d",6+j%11,j);
+        v[j] = zmalloc(8+len+1); /* Old header: int len, int free. */
+        memcpy((char*)v[j]+8,buf,len+1);
+    }
+    oldmem = zmalloc_used_memory()-before;
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) zfree(v[j]);
+    zfree(v);
+
+    printf("Memory for %lld keys of 10-20 bytes: "
+           "%.2f GB (fixed 8 bytes header: %.2f GB, saved %.1f%%)\n",
+        keys,
+        (double)sdsmem*(keys/SDS_BENCH_SAMPLE)/(1024*1024*1024),
+        (double)oldmem*(keys/SDS_BENCH_SAMPLE)/(1024*1024*1024),
+        100.0*(oldmem-sdsmem)/oldmem);
+}
+
+static void sdsBenchmark(void) {
+    sds *v = zmalloc(sizeof(sds)*SDS_BENCH_SAMPLE);
+    long long start, lensum = 0;
+    int j, k;
+    sds s;
+
+    start = usec();
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) v[j] = sdsnewlen("key:123456789",13);
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) sdsfree(v[j]);
+    printf("sdsnewlen()+sdsfree() of %d short strings: %lld usec\n",
+        SDS_BENCH_SAMPLE, usec()-start);
+
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) v[j] = sdsnewlen(NULL,j%300);
+    start = usec();
+    for (k = 0; k < 10; k++)
+        for (j = 0; j < SDS_BENCH_SAMPLE; j++) lensum += sdslen(v[j]);
+    printf("sdslen() x %d (mixed header types): %lld usec (%lld)\n",
+        SDS_BENCH_SAMPLE*10, usec()-start, lensum);
+    for (j = 0; j < SDS_BENCH_SAMPLE; j++) sdsfree(v[j]);
+    zfree(v);
+
+    start = usec();
+    s = sdsempty();
+    for (j = 0; j < 10*SDS_BENCH_SAMPLE; j++) s = sdscatlen(s,"abcdefgh",8);
+    printf("sdscatlen() growing a string to %zu bytes: %lld usec\n",
+        sdslen(s), usec()-start);
+    sdsfree(s);
+
+    sdsMemoryReport(100000000LL);
+}
+
+int main(int argc, char **argv) {
     {
-        struct sdshdr *sh;
         sds x = sdsnew("foo"), y;
 
         test_cond("Create a string and obtain the length",
@@ -903,24 +1064,48 @@ int main(void) {
         test_cond("sdscmp(bar,bar)", sdscmp(x,y) < 0)
 
         {
-            int oldfree;
+            size_t oldfree;
+            int j;
 
             sdsfree(x);
             x = sdsnew("0");
-            sh = (void*) (x-(sizeof(struct sdshdr)));
-            test_cond("sdsnew() free/len buffers", sh->len == 1 && sh->free == 0);
+            test_cond("sdsnew() free/len buffers",
+                sdslen(x) == 1 && sdsavail(x) == 0);
             x = sdsMakeRoomFor(x,1);
-            sh = (void*) (x-(sizeof(struct sdshdr)));
-            test_cond("sdsMakeRoomFor()", sh->len == 1 && sh->free > 0);
-            oldfree = sh->free;
+            test_cond("sdsMakeRoomFor()", sdslen(x) == 1 && sdsavail(x) > 0);
+            oldfree = sdsavail(x);
             x[1] = '1';
             sdsIncrLen(x,1);
             test_cond("sdsIncrLen() -- content", x[0] == '0' && x[1] == '1');
-            test_cond("sdsIncrLen() -- len", sh->len == 2);
-            test_cond("sdsIncrLen() -- free", sh->free == oldfree-1);
+            test_cond("sdsIncrLen() -- len", sdslen(x) == 2);
+            test_cond("sdsIncrLen() -- free", sdsavail(x) == oldfree-1);
+            sdsfree(x);
+
+            x = sdsnew("foo");
+            test_cond("Short strings use the 8 bit header",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_8 &&
+                sdsAllocSize(x) == 3+3+1);
+            for (j = 0; j < 1000; j++) x = sdscatlen(x,"0123456789",10);
+            test_cond("sdscatlen() upgrades the header when growing",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_16 &&
+                sdslen(x) == 10003 && memcmp(x,"foo0123",7) == 0 &&
+                memcmp(x+9993,"0123456789\0",11) == 0);
+            sdsrange(x,0,9);
+            x = sdsRemoveFreeSpace(x);
+            test_cond("sdsRemoveFreeSpace() downgrades the header",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_8 &&
+                sdslen(x) == 10 && sdsavail(x) == 0 &&
+                memcmp(x,"foo0123456\0",11) == 0);
+            sdsfree(x);
+
+            x = sdsnewlen(NULL,70000);
+            test_cond("sdsnewlen() picks the 32 bit header for 70000 bytes",
+                (x[-1]&SDS_TYPE_MASK) == SDS_TYPE_32 && sdslen(x) == 70000);
+            sdsfree(x);
         }
     }
     test_report()
+    if (argc == 2 && !strcasecmp(argv[1],"bench")) sdsBenchmark();
     return 0;
 }
 #endif
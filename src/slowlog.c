@@ -79,7 +79,7 @@ slowlogEntry *slowlogCreateEntry(robj **argv, int argc, long long duration) {
             /* Trim too long strings as well... */
             // 如果参数太长，那么进行截断
             if (argv[j]->type == REDIS_STRING &&
-                argv[j]->encoding == REDIS_ENCODING_RAW &&
+                sdsEncodedObject(argv[j]) &&
                 sdslen(argv[j]->ptr) > SLOWLOG_ENTRY_MAX_STRING)
             {
                 sds s = sdsnewlen(argv[j]->ptr, SLOWLOG_ENTRY_MAX_STRING);
@@ -0,0 +1,164 @@
+/* Stream data type: an append only log of field-value entries.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <stdint.h>
+#include "dict.h"
+#include "sds.h"
+
+/* Stream item ID: a 128 bit number composed of a milliseconds time and a
+ * sequence number. IDs generated by XADD are always greater than the ID of
+ * the last entry of the stream.
+ *
+ * 流中每一项的 ID ：由毫秒时间和序列号组成的 128 位数字。 */
+typedef struct streamID {
+    uint64_t ms;        /* Unix time in milliseconds. */
+    uint64_t seq;       /* Sequence number. */
+} streamID;
+
+/* Bytes needed to format an ID as <ms>-<seq>, null term included. */
+#define STREAM_ID_STR_SIZE 42
+
+/* An ordered map from stream IDs to pointers, implemented as a skiplist
+ * like the one used by sorted sets. It indexes the listpack blocks of a
+ * stream by the ID of their first entry, and the pending entries of the
+ * consumer groups.
+ *
+ * 以流 ID 为键的有序映射，使用和有序集一样的跳跃表实现。
+ * 它用于按首个 ID 索引流的 listpack 块，以及消费者组的待确认项。 */
+typedef struct streamIndexNode {
+    streamID id;
+    void *value;
+    struct streamIndexNode *backward;
+    struct streamIndexLevel {
+        struct streamIndexNode *forward;
+    } level[];
+} streamIndexNode;
+
+typedef struct streamIndex {
+    struct streamIndexNode *header, *tail;
+    unsigned long length;
+    int level;
+} streamIndex;
+
+/* The stream itself. */
+typedef struct stream {
+    streamIndex *index;     /* Listpack blocks, by ID of the first entry. */
+    uint64_t length;        /* Number of entries, deleted ones excluded. */
+    streamID last_id;       /* Greatest ID ever added to the stream. */
+    dict *cgroups;          /* Consumer groups by name, NULL if none. */
+} stream;
+
+/* A consumer group. Entries delivered to the consumers of the group are
+ * tracked in the pending entries list (PEL) until they are acknowledged
+ * with XACK.
+ *
+ * 消费者组。交付给组内消费者的项会被记录在待确认列表（PEL）中，
+ * 直到被 XACK 确认为止。 */
+typedef struct streamCG {
+    streamID last_id;       /* Last ID delivered to the group's consumers. */
+    streamIndex *pel;       /* Pending entries: ID -> streamNACK. */
+    dict *consumers;        /* Consumers by name -> streamConsumer. */
+} streamCG;
+
+/* A consumer of a group. Its PEL shares the streamNACK structures of the
+ * group PEL, that owns them. */
+typedef struct streamConsumer {
+    long long seen_time;    /* Last time the consumer was active. */
+    sds name;
+    streamIndex *pel;       /* Entries delivered to this consumer. */
+} streamConsumer;
+
+/* Pending entry of a consumer group: delivered, not yet acknowledged. */
+typedef struct streamNACK {
+    long long delivery_time;    /* Last time the entry was delivered. */
+    uint64_t delivery_count;    /* Number of times it was delivered. */
+    streamConsumer *consumer;   /* Consumer that owns the entry. */
+} streamNACK;
+
+/* Iterator over a range of IDs, see streamIteratorStart(). */
+typedef struct streamIterator {
+    stream *stream;             /* The stream we are iterating. */
+    streamID master_id;         /* ID of the first entry of the block. */
+    uint64_t master_fields_count;
+    unsigned char *master_fields_start; /* First master field. */
+    unsigned char *master_fields_ptr;   /* Master field to return next. */
+    int entry_flags;            /* Flags of the current entry. */
+    int rev;                    /* Iterating in reverse order? */
+    streamID start, end;        /* Range to iterate, both inclusive. */
+    streamIndexNode *node;      /* Current block. */
+    unsigned char *lp;          /* Current listpack. */
+    unsigned char *lp_ele;      /* Next field or value to return. */
+    unsigned char *lp_flags;    /* Flags of the current entry. */
+    unsigned char *lp_seek;     /* Where to seek the next entry from. */
+    /* Buffers used to return the integer encoded fields and values. */
+    unsigned char field_buf[21];
+    unsigned char value_buf[21];
+} streamIterator;
+
+/* ID index API */
+streamIndex *streamIndexCreate(void);
+void streamIndexFree(streamIndex *si, void (*free_value)(void *));
+int streamIndexInsert(streamIndex *si, streamID *id, void *value);
+void *streamIndexRemove(streamIndex *si, streamID *id);
+streamIndexNode *streamIndexFind(streamIndex *si, streamID *id);
+streamIndexNode *streamIndexSeekGE(streamIndex *si, streamID *id);
+streamIndexNode *streamIndexSeekLE(streamIndex *si, streamID *id);
+#define streamIndexFirst(si) ((si)->header->level[0].forward)
+#define streamIndexLast(si) ((si)->tail)
+#define streamIndexNext(n) ((n)->level[0].forward)
+#define streamIndexPrev(n) ((n)->backward)
+
+/* Stream API */
+stream *streamNew(void);
+void freeStream(stream *s);
+int streamCompareID(streamID *a, streamID *b);
+int streamAppendItem(stream *s, robj **argv, int64_t numfields,
+                     streamID *added_id, streamID *use_id);
+int64_t streamTrimByLength(stream *s, size_t maxlen, int approx);
+int streamValidateListpack(unsigned char *lp, size_t size, int64_t *count);
+void streamEncodeID(void *buf, streamID *id);
+void streamDecodeID(void *buf, streamID *id);
+void streamIteratorStart(streamIterator *si, stream *s, streamID *start,
+                         streamID *end, int rev);
+int streamIteratorGetID(streamIterator *si, streamID *id, int64_t *numfields);
+void streamIteratorGetField(streamIterator *si, unsigned char **fieldptr,
+                            unsigned char **valueptr, int64_t *fieldlen,
+                            int64_t *valuelen);
+void streamIteratorRemoveEntry(streamIterator *si, streamID *current);
+void streamIteratorStop(streamIterator *si);
+streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id);
+streamCG *streamLookupCG(stream *s, sds groupname);
+streamConsumer *streamLookupConsumer(streamCG *cg, sds name, int create);
+streamNACK *streamCreateNACK(streamConsumer *consumer);
+
+#endif
@@ -37,7 +37,7 @@
 /*
  * 对 argv 数组中的对象进行检查，
  * 看保存它们是否需要将 o 的编码从
- * REDIS_ENCODING_ZIPLIST 转换为 REDIS_ENCODING_HT
+ * REDIS_ENCODING_LISTPACK 转换为 REDIS_ENCODING_HT
  *
  * 复杂度：O(N)
  *
@@ -46,13 +46,13 @@
 void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
     int i;
 
-    // 如果对象不是 ziplist 编码（的hash），直接返回
-    if (o->encoding != REDIS_ENCODING_ZIPLIST) return;
+    // 如果对象不是 listpack 编码（的hash），直接返回
+    if (o->encoding != REDIS_ENCODING_LISTPACK) return;
 
     // 检查所有字符串参数的长度，看是否超过 server.hash_max_ziplist_value
     // 如果有一个结果为真的话，就对 o 进行转换
     for (i = start; i <= end; i++) {
-        if (argv[i]->encoding == REDIS_ENCODING_RAW &&
+        if (sdsEncodedObject(argv[i]) &&
             sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
         {
             // 转换
@@ -77,10 +77,10 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2) {
     }
 }
 
-/* Get the value from a ziplist encoded hash, identified by field.
+/* Get the value from a listpack encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
 /*
- * 从 ziplist 中取出和 field 相对应的值
+ * 从 listpack 中取出和 field 相对应的值
  *
  * 复杂度：O(n)
  *
@@ -93,7 +93,7 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2) {
  * 返回值：
  *  查找失败返回 -1 ，否则返回 0 。
  */
-int hashTypeGetFromZiplist(robj *o, robj *field,
+int hashTypeGetFromListpack(robj *o, robj *field,
                            unsigned char **vstr,
                            unsigned int *vlen,
                            long long *vll)
@@ -103,30 +103,30 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
                   *vptr = NULL;
     int ret;
 
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
     
-    // 解码域，因为 ziplist 不能使用对象
+    // 解码域，因为 listpack 不能使用对象
     field = getDecodedObject(field);
 
-    // 遍历 ziplist ，定位域的位置
+    // 遍历 listpack ，定位域的位置
     zl = o->ptr;
-    fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+    fptr = lpFirst(zl);
     if (fptr != NULL) {
         // 定位域节点的位置
-        fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+        fptr = lpFind(zl, fptr, field->ptr, sdslen(field->ptr), 1);
         if (fptr != NULL) {
             /* Grab pointer to the value (fptr points to the field) */
             // 定位值节点的位置
-            vptr = ziplistNext(zl, fptr);
+            vptr = lpNext(zl, fptr);
             redisAssert(vptr != NULL);
         }
     }
 
     decrRefCount(field);
 
-    // 从 ziplist 节点中取出值
+    // 从 listpack 节点中取出值
     if (vptr != NULL) {
-        ret = ziplistGet(vptr, vstr, vlen, vll);
+        ret = lpGetValue(vptr, vstr, vlen, vll);
         redisAssert(ret);
         return 0;
     }
@@ -176,13 +176,13 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
 robj *hashTypeGetObject(robj *o, robj *field) {
     robj *value = NULL;
 
-    // 从 ziplist 中获取
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 从 listpack 中获取
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) {
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) {
             if (vstr) {
                 // 将字面值包装成对象再返回
                 value = createStringObject((char*)vstr, vlen);
@@ -220,13 +220,13 @@ robj *hashTypeGetObject(robj *o, robj *field) {
  */
 int hashTypeExists(robj *o, robj *field) {
 
-    // 检查 ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 检查 listpack
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) return 1;
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) return 1;
 
     // 检查字典
     } else if (o->encoding == REDIS_ENCODING_HT) {
@@ -256,48 +256,46 @@ int hashTypeExists(robj *o, robj *field) {
 int hashTypeSet(robj *o, robj *field, robj *value) {
     int update = 0;
     
-    // 添加到 ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 添加到 listpack
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr, *vptr;
 
         // 解码成字符串或者数字
         field = getDecodedObject(field);
         value = getDecodedObject(value);
 
-        // 遍历整个 ziplist ，尝试查找并更新 field （如果它已经存在）
+        // 遍历整个 listpack ，尝试查找并更新 field （如果它已经存在）
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpFirst(zl);
         if (fptr != NULL) {
             // 定位到域，O(N)
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(zl, fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
                 /* Grab pointer to the value (fptr points to the field) */
                 // 定位到值
-                vptr = ziplistNext(zl, fptr);
+                vptr = lpNext(zl, fptr);
                 redisAssert(vptr != NULL);
 
                 // 标识这次操作为更新操作
                 update = 1;
 
-                // 删除旧值
-                zl = ziplistDelete(zl, &vptr);
-
-                // 插入新值
-                zl = ziplistInsert(zl, vptr, value->ptr, sdslen(value->ptr));
+                // 原地用新值替换旧值
+                zl = lpInsert(zl, value->ptr, sdslen(value->ptr), vptr,
+                              LP_REPLACE, NULL);
             }
         }
 
         // 如果这不是更新操作，那么这就是一个添加操作
         if (!update) {
-            // 将新的域/值对 push 到 ziplist 的末尾
-            zl = ziplistPush(zl, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            zl = ziplistPush(zl, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            // 将新的域/值对 push 到 listpack 的末尾
+            zl = lpAppend(zl, field->ptr, sdslen(field->ptr));
+            zl = lpAppend(zl, value->ptr, sdslen(value->ptr));
         }
         o->ptr = zl;
         decrRefCount(field);
         decrRefCount(value);
 
-        /* Check if the ziplist needs to be converted to a hash table */
+        /* Check if the listpack needs to be converted to a hash table */
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
 
@@ -332,21 +330,21 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 int hashTypeDelete(robj *o, robj *field) {
     int deleted = 0;
 
-    // ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr;
 
         field = getDecodedObject(field);
 
-        // 遍历 ziplist ，尝试删除 field-value 对
+        // 遍历 listpack ，尝试删除 field-value 对
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpFirst(zl);
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(zl, fptr, field->ptr, sdslen(field->ptr), 1);
             // 找到目标 field
             if (fptr != NULL) {
-                zl = ziplistDelete(zl,&fptr);
-                zl = ziplistDelete(zl,&fptr);
+                zl = lpDelete(zl,fptr,&fptr);
+                zl = lpDelete(zl,fptr,&fptr);
                 o->ptr = zl;
                 deleted = 1;
             }
@@ -381,10 +379,10 @@ int hashTypeDelete(robj *o, robj *field) {
 unsigned long hashTypeLength(robj *o) {
     unsigned long length = ULONG_MAX;
 
-    // ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         // 一个 field-value 对占用两个节点
-        length = ziplistLen(o->ptr) / 2;
+        length = lpLength(o->ptr) / 2;
 
     // dict
     } else if (o->encoding == REDIS_ENCODING_HT) {
@@ -413,8 +411,8 @@ hashTypeIterator *hashTypeInitIterator(robj *subject) {
     hi->subject = subject;
     hi->encoding = subject->encoding;
 
-    // ziplist 编码
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack 编码
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         hi->fptr = NULL;
         hi->vptr = NULL;
 
@@ -442,7 +440,7 @@ void hashTypeReleaseIterator(hashTypeIterator *hi) {
         dictReleaseIterator(hi->di);
     }
 
-    // 释放 ziplist 的迭代器
+    // 释放 listpack 的迭代器
     zfree(hi);
 }
 
@@ -458,8 +456,8 @@ void hashTypeReleaseIterator(hashTypeIterator *hi) {
  *  如果已经没有元素可获取，那么返回 REDIS_ERR 。
  */
 int hashTypeNext(hashTypeIterator *hi) {
-    // 迭代 ziplist 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 迭代 listpack 
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl;
         unsigned char *fptr, *vptr;
 
@@ -471,19 +469,19 @@ int hashTypeNext(hashTypeIterator *hi) {
         if (fptr == NULL) {
             /* Initialize cursor */
             redisAssert(vptr == NULL);
-            fptr = ziplistIndex(zl, 0);
+            fptr = lpFirst(zl);
        
         // 获取下一个迭代节点
         } else {
             /* Advance cursor */
             redisAssert(vptr != NULL);
-            fptr = ziplistNext(zl, vptr);
+            fptr = lpNext(zl, vptr);
         }
         // 迭代完
         if (fptr == NULL) return REDIS_ERR;
 
         /* Grab pointer to the value (fptr points to the field) */
-        vptr = ziplistNext(zl, fptr);
+        vptr = lpNext(zl, fptr);
         redisAssert(vptr != NULL);
 
         /* fptr, vptr now point to the first or next pair */
@@ -503,32 +501,32 @@ int hashTypeNext(hashTypeIterator *hi) {
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromZiplist`. */
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromListpack`. */
 /*
- * 根据迭代器的指针，从 ziplist 中取出所指向的节点 field 或者 value 。
+ * 根据迭代器的指针，从 listpack 中取出所指向的节点 field 或者 value 。
  *
  * 复杂度：O(1)
  */
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll)
 {
     int ret;
 
-    redisAssert(hi->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(hi->encoding == REDIS_ENCODING_LISTPACK);
 
     if (what & REDIS_HASH_KEY) {
-        ret = ziplistGet(hi->fptr, vstr, vlen, vll);
+        ret = lpGetValue(hi->fptr, vstr, vlen, vll);
         redisAssert(ret);
     } else {
-        ret = ziplistGet(hi->vptr, vstr, vlen, vll);
+        ret = lpGetValue(hi->vptr, vstr, vlen, vll);
         redisAssert(ret);
     }
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromHashTable`. */
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromHashTable`. */
 /*
  * 根据迭代器的指针，从字典中取出所指向节点的 field 或者 value 。
  *
@@ -557,13 +555,13 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     robj *dst;
 
-    // ziplist
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             // 总是返回值对象
             dst = createStringObject((char*)vstr, vlen);
@@ -614,15 +612,15 @@ robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key) {
 }
 
 /*
- * 将一个 ziplist 编码的哈希对象 o 转换成其他编码
+ * 将一个 listpack 编码的哈希对象 o 转换成其他编码
  * （比如 dict）
  *
  * 复杂度：O(N)
  */
-void hashTypeConvertZiplist(robj *o, int enc) {
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+void hashTypeConvertListpack(robj *o, int enc) {
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
 
-    if (enc == REDIS_ENCODING_ZIPLIST) {
+    if (enc == REDIS_ENCODING_LISTPACK) {
         /* Nothing to do... */
 
     } else if (enc == REDIS_ENCODING_HT) {
@@ -635,30 +633,30 @@ void hashTypeConvertZiplist(robj *o, int enc) {
         // 创建新字典
         dict = dictCreate(&hashDictType, NULL);
 
-        // 遍历整个 ziplist 
+        // 遍历整个 listpack 
         while (hashTypeNext(hi) != REDIS_ERR) {
             robj *field, *value;
 
-            // 取出 ziplist 里的键
+            // 取出 listpack 里的键
             field = hashTypeCurrentObject(hi, REDIS_HASH_KEY);
             field = tryObjectEncoding(field);
 
-            // 取出 ziplist 里的值
+            // 取出 listpack 里的值
             value = hashTypeCurrentObject(hi, REDIS_HASH_VALUE);
             value = tryObjectEncoding(value);
 
             // 将键值对添加到字典
             ret = dictAdd(dict, field, value);
             if (ret != DICT_OK) {
-                redisLogHexDump(REDIS_WARNING,"ziplist with dup elements dump",
-                    o->ptr,ziplistBlobLen(o->ptr));
+                redisLogHexDump(REDIS_WARNING,"listpack with dup elements dump",
+                    o->ptr,lpBytes(o->ptr));
                 redisAssert(ret == DICT_OK);
             }
         }
 
-        // 释放 ziplist 的迭代器
+        // 释放 listpack 的迭代器
         hashTypeReleaseIterator(hi);
-        // 释放 ziplist
+        // 释放 listpack
         zfree(o->ptr);
 
         // 更新 key 对象的编码和值
@@ -673,13 +671,13 @@ void hashTypeConvertZiplist(robj *o, int enc) {
 /*
  * 对 hash 对象 o 的编码方式进行转换
  *
- * 目前只支持从 ziplist 转换为 dict
+ * 目前只支持从 listpack 转换为 dict
  *
  * 复杂度：O(N)
  */
 void hashTypeConvert(robj *o, int enc) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        hashTypeConvertZiplist(o, enc);
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        hashTypeConvertListpack(o, enc);
     } else if (o->encoding == REDIS_ENCODING_HT) {
         redisPanic("Not implemented");
     } else {
@@ -907,14 +905,14 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
         return;
     }
 
-    // ziplist
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
         // 取出值，O(N)
-        ret = hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll);
+        ret = hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll);
         if (ret < 0) {
             addReply(c, shared.nullbulk);
         } else {
@@ -1037,14 +1035,14 @@ void hlenCommand(redisClient *c) {
  * T = O(1)
  */
 static void addHashIteratorCursorToReply(redisClient *c, hashTypeIterator *hi, int what) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        // 从 ziplist 的节点中取出 field 所对应的值
+        // 从 listpack 的节点中取出 field 所对应的值
         // O(1)
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             addReplyBulkCBuffer(c, vstr, vlen);
         } else {
@@ -1151,3 +1149,16 @@ void hexistsCommand(redisClient *c) {
     // 测试给定域是否存在
     addReply(c, hashTypeExists(o,c->argv[2]) ? shared.cone : shared.czero);
 }
+
+/*
+ * HSCAN 命令的实现
+ */
+void hscanCommand(redisClient *c) {
+    robj *o;
+    unsigned long cursor;
+
+    if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
+    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
+        checkType(c,o,REDIS_HASH)) return;
+    scanGenericCommand(c,o,cursor);
+}
@@ -29,37 +29,16 @@
 
 #include "redis.h"
 
-void signalListAsReady(redisClient *c, robj *key);
+void signalKeyAsReady(redisClient *c, robj *key);
 
 /*-----------------------------------------------------------------------------
  * List API
  *----------------------------------------------------------------------------*/
 
-/* Check the argument length to see if it requires us to convert the ziplist
- * to a real list. Only check raw-encoded objects because integer encoded
- * objects are never too long. */
-/*
- * 检查 value ，如果它是一个字符串的话，看看 ziplist 能否满足储存它的长度要求
- * 如果不能的话，将 subject 转换为双端链表
- *
- * 如果 value 为整数类型，那么不必对它检查，因为整数对象最长只能是 long 类型
- *
- * T = O(N)
- */
-void listTypeTryConversion(robj *subject, robj *value) {
-
-    // 已经是 LINKEDLIST
-    if (subject->encoding != REDIS_ENCODING_ZIPLIST) return;
-
-    if (value->encoding == REDIS_ENCODING_RAW &&
-        sdslen(value->ptr) > server.list_max_ziplist_value)
-            listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
-}
-
-/* The function pushes an elmenet to the specified list object 'subject',
+/* The function pushes an element to the specified list object 'subject',
  * at head or tail position as specified by 'where'.
  *
- * There is no need for the caller to incremnet the refcount of 'value' as
+ * There is no need for the caller to increment the refcount of 'value' as
  * the function takes care of it if needed. */
 /*
  * 多态推入函数
@@ -68,113 +47,60 @@ void listTypeTryConversion(robj *subject, robj *value) {
  *
  * 调用者不必对 value 进行计数，这个函数会处理它
  *
- * T = O(N^2)
+ * T = O(1)
  */
 void listTypePush(robj *subject, robj *value, int where) {
-    /* Check if we need to convert the ziplist */
-    // 检查是否需要对列表进行编码转换
-    // O(N)
-    listTypeTryConversion(subject,value);
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-        ziplistLen(subject->ptr) >= server.list_max_ziplist_entries)
-            listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
-
-    // ziplist
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        int pos = (where == REDIS_HEAD) ? ZIPLIST_HEAD : ZIPLIST_TAIL;
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        int pos = (where == REDIS_HEAD) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
         value = getDecodedObject(value);
-        // O(N^2)
-        subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
+        // 只需要处理表头或表尾节点的 ziplist ，O(1)
+        quicklistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
         decrRefCount(value);
-    // 双端链表
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // O(1)
-        if (where == REDIS_HEAD) {
-            listAddNodeHead(subject->ptr,value);
-        } else {
-            listAddNodeTail(subject->ptr,value);
-        }
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
+/*
+ * quicklistPopCustom() 使用的回调函数，
+ * 为被弹出的字符串值创建字符串对象
+ */
+void *listPopSaver(unsigned char *data, unsigned int sz) {
+    return createStringObject((char*)data,sz);
+}
+
 /*
  * 多态 pop 对象
  *
  * T = O(1)
  */
 robj *listTypePop(robj *subject, int where) {
-
+    long long vlong;
     robj *value = NULL;
 
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        // 从 ziplist 中 pop
-        unsigned char *p;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        // pop 表头或表尾？
-        int pos = (where == REDIS_HEAD) ? 0 : -1;
-        // O(1)
-        p = ziplistIndex(subject->ptr,pos);
-        // 元素获取成功？
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
-            // 取出值
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
-            } else {
+    // pop 表头或表尾？
+    int ql_where = where == REDIS_HEAD ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        if (quicklistPopCustom(subject->ptr,ql_where,(unsigned char **)&value,
+                               NULL,&vlong,listPopSaver)) {
+            // 整数值没有经过 saver ，在这里为它创建对象
+            if (!value)
                 value = createStringObjectFromLongLong(vlong);
-            }
-            /* We only need to delete an element when it exists */
-            // 删除它
-            subject->ptr = ziplistDelete(subject->ptr,&p);
-        }
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // O(1)
-
-        // 从双端列表中 pop
-        list *list = subject->ptr;
-        listNode *ln;
-        // 取出表头节点
-        if (where == REDIS_HEAD) {
-            ln = listFirst(list);
-        // 取出表尾节点
-        } else {
-            ln = listLast(list);
-        }
-
-        if (ln != NULL) {
-            // 取出节点的值
-            value = listNodeValue(ln);
-
-            incrRefCount(value);
-            
-            // 删除节点
-            listDelNode(list,ln);
         }
     } else {
         redisPanic("Unknown list encoding");
     }
-
     return value;
 }
 
 /*
- * 多态列表长度获取函数
+ * 返回列表的长度
  *
- * T = O(N)
+ * T = O(1)
  */
 unsigned long listTypeLength(robj *subject) {
-    // ziplist
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        // O(N)
-        return ziplistLen(subject->ptr);
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // adlist
-        // O(1)
-        return listLength((list*)subject->ptr);
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        return quicklistCount(subject->ptr);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -182,41 +108,38 @@ unsigned long listTypeLength(robj *subject) {
 
 /* Initialize an iterator at the specified index. */
 /*
- * 创建多态列表迭代器
+ * 创建一个列表迭代器，从 index 开始，向 direction 方向进行迭代
  *
- * T = O(1)
+ * direction 为 REDIS_TAIL 时从表头向表尾迭代，为 REDIS_HEAD 时从表尾向表头迭代
+ *
+ * T = O(N)
  */
-listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char direction) {
-
-    // 创建迭代器，并初始化各个属性
+listTypeIterator *listTypeInitIterator(robj *subject, long index,
+                                       unsigned char direction) {
     listTypeIterator *li = zmalloc(sizeof(listTypeIterator));
-
     li->subject = subject;
     li->encoding = subject->encoding;
     li->direction = direction;
-
-    // 迭代 ziplist
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        li->zi = ziplistIndex(subject->ptr,index);
-
-    // 迭代双端链表
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        li->ln = listIndex(subject->ptr,index);
-
+    li->iter = NULL;
+    /* REDIS_HEAD means start at TAIL and move *towards* head.
+     * REDIS_TAIL means start at HEAD and move *towards tail. */
+    int iter_direction =
+        direction == REDIS_HEAD ? AL_START_TAIL : AL_START_HEAD;
+    if (li->encoding == REDIS_ENCODING_QUICKLIST) {
+        li->iter = quicklistGetIteratorAtIdx(li->subject->ptr,
+                                             iter_direction, index);
     } else {
         redisPanic("Unknown list encoding");
     }
-
     return li;
 }
 
 /* Clean up the iterator. */
 /*
- * 释放迭代器
- *
- * T = O(1)
+ * 释放迭代器，迭代期间被解压的节点会在这里重新压缩
  */
 void listTypeReleaseIterator(listTypeIterator *li) {
+    if (li->iter) quicklistReleaseIterator(li->iter);
     zfree(li);
 }
 
@@ -224,9 +147,9 @@ void listTypeReleaseIterator(listTypeIterator *li) {
  * and advances the position of the iterator. Returns 1 when the current
  * entry is in fact an entry, 0 otherwise. */
 /*
- * 将当前迭代到的节点保存到 entry ，并将迭代器的指针向前推移一步。
+ * 取出迭代器当前指向的元素，并将迭代器指向下一个元素
  *
- * 获取节点成功返回 1 ，否则返回 0 。
+ * 迭代完毕时返回 0 ，否则返回 1
  *
  * T = O(1)
  */
@@ -235,111 +158,56 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
     redisAssert(li->subject->encoding == li->encoding);
 
     entry->li = li;
-
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        // ziplist, O(1)
-        entry->zi = li->zi;
-        if (entry->zi != NULL) {
-            if (li->direction == REDIS_TAIL)
-                li->zi = ziplistNext(li->subject->ptr,li->zi);
-            else
-                li->zi = ziplistPrev(li->subject->ptr,li->zi);
-            return 1;
-        }
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // adlist, O(1)
-        entry->ln = li->ln;
-        if (entry->ln != NULL) {
-            if (li->direction == REDIS_TAIL)
-                li->ln = li->ln->next;
-            else
-                li->ln = li->ln->prev;
-            return 1;
-        }
+    if (li->encoding == REDIS_ENCODING_QUICKLIST) {
+        if (li->iter == NULL) return 0;
+        return quicklistNext(li->iter, &entry->entry);
     } else {
         redisPanic("Unknown list encoding");
     }
-
     return 0;
 }
 
 /* Return entry or NULL at the current position of the iterator. */
 /*
- * 返回迭代器当前节点的值，如果迭代已经完成，返回 NULL 
+ * 以字符串对象的形式返回迭代器当前指向的元素
  *
  * T = O(1)
  */
 robj *listTypeGet(listTypeEntry *entry) {
-
-    listTypeIterator *li = entry->li;
-
     robj *value = NULL;
-
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        redisAssert(entry->zi != NULL);
-        // O(1)
-        if (ziplistGet(entry->zi,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
-            } else {
-                value = createStringObjectFromLongLong(vlong);
-            }
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        if (entry->entry.value) {
+            value = createStringObject((char *)entry->entry.value,
+                                       entry->entry.sz);
+        } else {
+            value = createStringObjectFromLongLong(entry->entry.longval);
         }
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        redisAssert(entry->ln != NULL);
-        // O(1)
-        value = listNodeValue(entry->ln);
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
-
     return value;
 }
 
 /*
- * 多态插入函数 
+ * 将 value 插入到 entry 之前（where 为 REDIS_HEAD）或之后（where 为 REDIS_TAIL）
  *
- * T = O(N^2)
+ * 插入之后 entry 和迭代器都不能再继续使用
+ *
+ * T = O(N)
  */
 void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
-
-    robj *subject = entry->li->subject;
-
-    if (entry->li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
         value = getDecodedObject(value);
+        sds str = value->ptr;
+        size_t len = sdslen(str);
         if (where == REDIS_TAIL) {
-            // 插入到表尾
-
-            // O(1)
-            unsigned char *next = ziplistNext(subject->ptr,entry->zi);
-
-            /* When we insert after the current element, but the current element
-             * is the tail of the list, we need to do a push. */
-            // 找到 next 就将节点插入在 next 之后，没找到就将节点放到表尾
-            if (next == NULL) {
-                // O(N^2)
-                subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),REDIS_TAIL);
-            } else {
-                // O(N^2)
-                subject->ptr = ziplistInsert(subject->ptr,next,value->ptr,sdslen(value->ptr));
-            }
-        } else {
-            // 插入到表头，O(N^2)
-            subject->ptr = ziplistInsert(subject->ptr,entry->zi,value->ptr,sdslen(value->ptr));
+            quicklistInsertAfter((quicklist *)entry->entry.quicklist,
+                                 &entry->entry, str, len);
+        } else if (where == REDIS_HEAD) {
+            quicklistInsertBefore((quicklist *)entry->entry.quicklist,
+                                  &entry->entry, str, len);
         }
         decrRefCount(value);
-    } else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // O(1)
-        if (where == REDIS_TAIL) {
-            listInsertNode(subject->ptr,entry->ln,value,AL_START_TAIL);
-        } else {
-            listInsertNode(subject->ptr,entry->ln,value,AL_START_HEAD);
-        }
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -347,21 +215,14 @@ void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
 
 /* Compare the given object with the entry at the current position. */
 /*
- * 对比 entry 的值和对象 o
+ * 检查 entry 的值是否和对象 o 相等
  *
  * T = O(N)
  */
 int listTypeEqual(listTypeEntry *entry, robj *o) {
-
-    listTypeIterator *li = entry->li;
-
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-        // O(1)
-        return ziplistCompare(entry->zi,o->ptr,sdslen(o->ptr));
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // O(N) 
-        return equalStringObjects(o,listNodeValue(entry->ln));
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        redisAssertWithInfo(NULL,o,sdsEncodedObject(o));
+        return quicklistCompare(entry->entry.zi,o->ptr,sdslen(o->ptr));
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -369,74 +230,18 @@ int listTypeEqual(listTypeEntry *entry, robj *o) {
 
 /* Delete the element pointed to. */
 /*
- * 多态删除 entry 指向的元素
+ * 删除 entry 所指向的元素，迭代器会被调整，以便继续迭代
  *
- * T = O(N^2)
+ * T = O(N)
  */
 void listTypeDelete(listTypeEntry *entry) {
-
-    listTypeIterator *li = entry->li;
-
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p = entry->zi;
-        // O(N^2)
-        li->subject->ptr = ziplistDelete(li->subject->ptr,&p);
-
-        /* Update position of the iterator depending on the direction */
-        if (li->direction == REDIS_TAIL)
-            li->zi = p;
-        else
-            li->zi = ziplistPrev(li->subject->ptr,p);
-    } else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // O(1)
-        listNode *next;
-        if (li->direction == REDIS_TAIL)
-            next = entry->ln->next;
-        else
-            next = entry->ln->prev;
-        listDelNode(li->subject->ptr,entry->ln);
-        li->ln = next;
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistDelEntry(entry->li->iter, &entry->entry);
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
-/*
- * 将列表转换为给定的编码类型
- *
- * 目前只支持将 ziplist 转换为双端链表
- *
- * T = O(N)
- */
-void listTypeConvert(robj *subject, int enc) {
-    listTypeIterator *li;
-    listTypeEntry entry;
-    redisAssertWithInfo(NULL,subject,subject->type == REDIS_LIST);
-
-    if (enc == REDIS_ENCODING_LINKEDLIST) {
-        // 创建双端列表
-        list *l = listCreate();
-        listSetFreeMethod(l,decrRefCount);
-
-        /* listTypeGet returns a robj with incremented refcount */
-        // 取出 ziplist 中的所有元素
-        // 并将它们添加到双端列表中
-        // O(N)
-        li = listTypeInitIterator(subject,0,REDIS_TAIL);
-        while (listTypeNext(li,&entry)) listAddNodeTail(l,listTypeGet(&entry));
-        listTypeReleaseIterator(li);
-
-        // 更新编码
-        subject->encoding = REDIS_ENCODING_LINKEDLIST;
-        // 释放 ziplist
-        zfree(subject->ptr);
-        // 指向双端链表
-        subject->ptr = l;
-    } else {
-        redisPanic("Unsupported list conversion");
-    }
-}
-
 /*-----------------------------------------------------------------------------
  * List Commands
  *----------------------------------------------------------------------------*/
@@ -444,7 +249,7 @@ void listTypeConvert(robj *subject, int enc) {
 /*
  * [LR]PUSH 命令的实现
  *
- * T = O(N^3)
+ * T = O(N)
  */
 void pushGenericCommand(redisClient *c, int where) {
     int j, waiting = 0, pushed = 0;
@@ -464,18 +269,18 @@ void pushGenericCommand(redisClient *c, int where) {
     // 检查是否有客户端在等待这个列表
     // 如果是的话，告知服务器和客户端，这个列表已经就绪
     // O(1)
-    if (may_have_waiting_clients) signalListAsReady(c,c->argv[1]);
+    if (may_have_waiting_clients) signalKeyAsReady(c,c->argv[1]);
 
     // 将所有输入元素推入列表
-    // O(N^3)
+    // O(N)
     for (j = 2; j < c->argc; j++) {
         c->argv[j] = tryObjectEncoding(c->argv[j]);
         // 如果列表不存在，那么创建新列表
         if (!lobj) {
-            lobj = createZiplistObject();   // 默认使用 ziplist 编码
+            lobj = createQuicklistObject();   // 列表使用 quicklist 编码
             dbAdd(c->db,c->argv[1],lobj);
         }
-        // 将元素推入列表，O(N^2)
+        // 将元素推入列表，O(1)
         listTypePush(lobj,c->argv[j],where);
         pushed++;
     }
@@ -488,7 +293,7 @@ void pushGenericCommand(redisClient *c, int where) {
 /*
  * LPUSH 命令的实现
  *
- * T = O(N^3)
+ * T = O(N)
  */
 void lpushCommand(redisClient *c) {
     pushGenericCommand(c,REDIS_HEAD);
@@ -497,7 +302,7 @@ void lpushCommand(redisClient *c) {
 /*
  * RPUSH 命令的实现
  *
- * T = O(N^3)
+ * T = O(N)
  */
 void rpushCommand(redisClient *c) {
     pushGenericCommand(c,REDIS_TAIL);
@@ -506,7 +311,7 @@ void rpushCommand(redisClient *c) {
 /*
  * PUSHX 命令的实现
  *
- * T = O(N^2)
+ * T = O(N)
  */
 void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
     robj *subject;
@@ -522,24 +327,15 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
     if (refval != NULL) {
         /* Note: we expect refval to be string-encoded because it is *not* the
          * last argument of the multi-bulk LINSERT. */
-        redisAssertWithInfo(c,refval,refval->encoding == REDIS_ENCODING_RAW);
-
-        /* We're not sure if this value can be inserted yet, but we cannot
-         * convert the list inside the iterator. We don't want to loop over
-         * the list twice (once to see if the value can be inserted and once
-         * to do the actual insert), so we assume this value can be inserted
-         * and convert the ziplist to a regular list if necessary. */
-        // 检查添加 value 是否需要对 subject 进行编码转换
-        // O(N)
-        listTypeTryConversion(subject,val);
+        redisAssertWithInfo(c,refval,sdsEncodedObject(refval));
 
         /* Seek refval from head to tail */
         // 从表头开始，向表尾查找包含 refval 的节点
-        // O(N^2)
+        // O(N)
         iter = listTypeInitIterator(subject,0,REDIS_TAIL);
         while (listTypeNext(iter,&entry)) {
             if (listTypeEqual(&entry,refval)) {
-                // 找到，插入 val, O(N^2)
+                // 找到，插入 val ，只需要修改一个节点的 ziplist
                 listTypeInsert(&entry,val,where);
                 inserted = 1;
                 break;
@@ -549,11 +345,6 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
 
         // value 已经插入成功？
         if (inserted) {
-            /* Check if the length exceeds the ziplist length threshold. */
-            // 检查是否需要对列表进行编码转换, O(N)
-            if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-                ziplistLen(subject->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
             signalModifiedKey(c->db,c->argv[1]);
             server.dirty++;
         } else {
@@ -563,7 +354,7 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
         }
     } else {
         // 简单地将 value 推入到列表的之前或之后
-        // O(N^2)
+        // O(1)
         listTypePush(subject,val,where);
 
         signalModifiedKey(c->db,c->argv[1]);
@@ -576,7 +367,7 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
 /*
  * LPUSHX 命令的实现
  *
- * T = O(N^2)
+ * T = O(1)
  */
 void lpushxCommand(redisClient *c) {
     c->argv[2] = tryObjectEncoding(c->argv[2]);
@@ -586,7 +377,7 @@ void lpushxCommand(redisClient *c) {
 /*
  * RPUSHX 命令的实现
  *
- * T = O(N^2)
+ * T = O(1)
  */
 void rpushxCommand(redisClient *c) {
     c->argv[2] = tryObjectEncoding(c->argv[2]);
@@ -596,7 +387,7 @@ void rpushxCommand(redisClient *c) {
 /*
  * LINSERT 命令的实现
  *
- * T = O(N^2)
+ * T = O(N)
  */
 void linsertCommand(redisClient *c) {
 
@@ -645,36 +436,25 @@ void lindexCommand(redisClient *c) {
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // 从 ziplist 中获取
-        unsigned char *p;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        // O(1)
-        p = ziplistIndex(o->ptr,index);
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        // 跳过不包含 index 的节点，只需要遍历节点数量次，O(N)
+        // 通过迭代器读取元素，这样被解压的节点在释放迭代器时会重新压缩
+        quicklistEntry entry;
+        quicklistIter *iter =
+            quicklistGetIteratorAtIdx(o->ptr,AL_START_HEAD,index);
+        if (iter && quicklistNext(iter,&entry)) {
             // 取出值
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
+            if (entry.value) {
+                value = createStringObject((char*)entry.value,entry.sz);
             } else {
-                value = createStringObjectFromLongLong(vlong);
+                value = createStringObjectFromLongLong(entry.longval);
             }
             addReplyBulk(c,value);
             decrRefCount(value);
         } else {
             addReply(c,shared.nullbulk);
         }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // 从双端列表中取出值
-        // O(N)
-        listNode *ln = listIndex(o->ptr,index);
-        if (ln != NULL) {
-            value = listNodeValue(ln);
-            addReplyBulk(c,value);
-        } else {
-            addReply(c,shared.nullbulk);
-        }
+        if (iter) quicklistReleaseIterator(iter);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -683,7 +463,7 @@ void lindexCommand(redisClient *c) {
 /*
  * LSET 命令的实现
  *
- * T = O(N^2)
+ * T = O(N)
  */
 void lsetCommand(redisClient *c) {
     // 查找对象，或者返回不存在错误
@@ -700,46 +480,19 @@ void lsetCommand(redisClient *c) {
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    // 如果有需要，转换列表的编码,O(N)
-    listTypeTryConversion(o,value);
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklist *ql = o->ptr;
+        int replaced;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // 更新到 ziplist
-        unsigned char *p, *zl = o->ptr;
-        p = ziplistIndex(zl,index);
-        if (p == NULL) {
+        // 在节点的 ziplist 中先删除旧值，再插入新值
+        value = getDecodedObject(value);
+        replaced = quicklistReplaceAtIndex(ql,index,value->ptr,
+                                           sdslen(value->ptr));
+        decrRefCount(value);
+        if (!replaced) {
             // index 越界
             addReply(c,shared.outofrangeerr);
         } else {
-            // 先删除 ziplist 里指定 index 的值
-            // O(N^2)
-            o->ptr = ziplistDelete(o->ptr,&p);
-            // 再将新值添加到 ziplist 的末尾
-            value = getDecodedObject(value);
-            // O(N^2)
-            o->ptr = ziplistInsert(o->ptr,p,value->ptr,sdslen(value->ptr));
-
-            decrRefCount(value);
-
-            addReply(c,shared.ok);
-            signalModifiedKey(c->db,c->argv[1]);
-            server.dirty++;
-        }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // 添加到双端链表
-        // O(N)
-        listNode *ln = listIndex(o->ptr,index);
-        if (ln == NULL) {
-            addReply(c,shared.outofrangeerr);
-        } else {
-            // 删除 ln 原有的值
-            // O(1)
-            decrRefCount((robj*)listNodeValue(ln));
-            // 在用新值替换它
-            listNodeValue(ln) = value;
-
-            incrRefCount(value);
-
             addReply(c,shared.ok);
             signalModifiedKey(c->db,c->argv[1]);
             server.dirty++;
@@ -829,50 +582,40 @@ void lrangeCommand(redisClient *c) {
 
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c,rangelen);
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // 处理 ziplist
-        unsigned char *p = ziplistIndex(o->ptr,start);
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-
-        // O(N)
-        while(rangelen--) {
-            ziplistGet(p,&vstr,&vlen,&vlong);
-            if (vstr) {
-                addReplyBulkCBuffer(c,vstr,vlen);
-            } else {
-                addReplyBulkLongLong(c,vlong);
-            }
-            p = ziplistNext(o->ptr,p);
-        }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        // 处理双端链表
-        listNode *ln;
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        listTypeIterator *iter;
 
         /* If we are nearest to the end of the list, reach the element
          * starting from tail and going backward, as it is faster. */
+        // 定位起始元素时，从距离较近的一端开始查找节点
         if (start > llen/2) start -= llen;
-        ln = listIndex(o->ptr,start);
+        iter = listTypeInitIterator(o,start,REDIS_TAIL);
 
         // O(N)
         while(rangelen--) {
-            addReplyBulk(c,ln->value);
-            ln = ln->next;
+            listTypeEntry entry;
+            quicklistEntry *qe;
+
+            listTypeNext(iter,&entry);
+            qe = &entry.entry;
+            if (qe->value) {
+                addReplyBulkCBuffer(c,qe->value,qe->sz);
+            } else {
+                addReplyBulkLongLong(c,qe->longval);
+            }
         }
+        listTypeReleaseIterator(iter);
     } else {
-        redisPanic("List encoding is not LINKEDLIST nor ZIPLIST!");
+        redisPanic("List encoding is not QUICKLIST!");
     }
 }
 
 /*
- * T = O(N^2)
+ * T = O(N)
  */
 void ltrimCommand(redisClient *c) {
     robj *o;
-    long start, end, llen, j, ltrim, rtrim;
-    list *list;
-    listNode *ln;
+    long start, end, llen, ltrim, rtrim;
 
     if ((getLongFromObjectOrReply(c, c->argv[2], &start, NULL) != REDIS_OK) ||
         (getLongFromObjectOrReply(c, c->argv[3], &end, NULL) != REDIS_OK)) return;
@@ -900,23 +643,11 @@ void ltrimCommand(redisClient *c) {
 
     /* Remove list elements to perform the trim */
     // 删除
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        // O(N^2)
-        o->ptr = ziplistDeleteRange(o->ptr,0,ltrim);
-        // O(N^2)
-        o->ptr = ziplistDeleteRange(o->ptr,-rtrim,rtrim);
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        list = o->ptr;
-        // 从表头向表尾删除, O(N)
-        for (j = 0; j < ltrim; j++) {
-            ln = listFirst(list);
-            listDelNode(list,ln);
-        }
-        // 从表尾向表头删除, O(N)
-        for (j = 0; j < rtrim; j++) {
-            ln = listLast(list);
-            listDelNode(list,ln);
-        }
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        // 从表头向表尾删除，完全位于范围内的节点会被整个释放
+        quicklistDelRange(o->ptr,0,ltrim);
+        // 从表尾向表头删除
+        quicklistDelRange(o->ptr,-rtrim,rtrim);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -930,7 +661,7 @@ void ltrimCommand(redisClient *c) {
 }
 
 /*
- * T = O(N^3)
+ * T = O(N^2)
  */
 void lremCommand(redisClient *c) {
     robj *subject, *obj;
@@ -952,8 +683,7 @@ void lremCommand(redisClient *c) {
     if (subject == NULL || checkType(c,subject,REDIS_LIST)) return;
 
     /* Make sure obj is raw when we're dealing with a ziplist */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
-        obj = getDecodedObject(obj);
+    obj = getDecodedObject(obj);
 
     // 根据 toremove ，决定是迭代器遍历的方式（从头到尾或者从尾到头）
     listTypeIterator *li;
@@ -968,7 +698,7 @@ void lremCommand(redisClient *c) {
     // 遍历, O(N)
     while (listTypeNext(li,&entry)) {
         if (listTypeEqual(&entry,obj)) {
-            // 删除, O(N^2)
+            // 删除, O(N)
             listTypeDelete(&entry);
             server.dirty++;
             removed++;
@@ -978,8 +708,7 @@ void lremCommand(redisClient *c) {
     listTypeReleaseIterator(li);
 
     /* Clean up raw encoded object */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
-        decrRefCount(obj);
+    decrRefCount(obj);
 
     // 列表为空？删除它
     if (listTypeLength(subject) == 0) dbDelete(c->db,c->argv[1]);
@@ -1008,24 +737,24 @@ void lremCommand(redisClient *c) {
  * 将 value 添加到 dstkey 列表里
  * 如果 dstkey 为空，那么创建一个新列表，然后执行添加动作
  *
- * T = O(N^2)
+ * T = O(1)
  */
 void rpoplpushHandlePush(redisClient *c, robj *dstkey, robj *dstobj, robj *value) {
     /* Create the list if the key does not exist */
     // 列表不存在，创建列表
     if (!dstobj) {
-        // 创建 ziplist
-        dstobj = createZiplistObject();
+        // 创建 quicklist
+        dstobj = createQuicklistObject();
         // 添加到 db
         dbAdd(c->db,dstkey,dstobj);
         // 将 dstkey 添加到 server.ready_keys 列表里
-        signalListAsReady(c,dstkey);
+        signalKeyAsReady(c,dstkey);
     }
 
     signalModifiedKey(c->db,dstkey);
 
     // 添加 value 到 dstobj
-    // O(N^2)
+    // O(1)
     listTypePush(dstobj,value,REDIS_HEAD);
 
     /* Always send the pushed value to the client. */
@@ -1033,7 +762,7 @@ void rpoplpushHandlePush(redisClient *c, robj *dstkey, robj *dstobj, robj *value
 }
 
 /*
- * T = O(N^2)
+ * T = O(1)
  */
 void rpoplpushCommand(redisClient *c) {
     robj *sobj, *value;
@@ -1064,7 +793,7 @@ void rpoplpushCommand(redisClient *c) {
          * may change the client command argument vector (it does not
          * currently). */
         incrRefCount(touchedkey);
-        // O(N^2)
+        // O(1)
         rpoplpushHandlePush(c,c->argv[2],dobj,value);
 
         /* listTypePop returns an object with its refcount incremented */
@@ -1121,18 +850,25 @@ void rpoplpushCommand(redisClient *c) {
  * 参数：
  *  keys    多个 key
  *  numkeys key 的数量
- *  timeout 阻塞的最长时限
+ *  btype   阻塞的类型， REDIS_BPOP_LIST 或者 REDIS_BPOP_STREAM
+ *  timeout 阻塞的最长时限（毫秒级 UNIX 时间），0 表示永不超时
  *  target  在解除阻塞时，将结果保存到这个 key 对象，而不是返回给客户端
  *          只用于 BRPOPLPUSH 命令
+ *  ids     对于流，客户端等待的每个 key 的 ID
+ *
+ * The same machinery serves BLPOP & co. and XREAD: for streams 'ids' is
+ * an array of 'numkeys' IDs, the client is served when one of the keys
+ * gets an entry with a greater ID.
  *
  * T = O(N)
  */
-void blockForKeys(redisClient *c, robj **keys, int numkeys, time_t timeout, robj *target) {
+void blockForKeys(redisClient *c, int btype, robj **keys, int numkeys, long long timeout, robj *target, streamID *ids) {
     dictEntry *de;
     list *l;
     int j;
 
-    // 设置阻塞状态的超时和目标选项
+    // 设置阻塞状态的类型、超时和目标选项
+    c->bpop.btype = btype;
     c->bpop.timeout = timeout;
     c->bpop.target = target;
 
@@ -1140,9 +876,20 @@ void blockForKeys(redisClient *c, robj **keys, int numkeys, time_t timeout, robj
 
     // 将所有 key 加入到 client.bpop.keys 字典里，O(N)
     for (j = 0; j < numkeys; j++) {
+        streamID *key_data = NULL;
+
+        /* For streams we also remember the ID we are waiting for. */
+        if (btype == REDIS_BPOP_STREAM) {
+            key_data = zmalloc(sizeof(streamID));
+            *key_data = ids[j];
+        }
+
         /* If the key already exists in the dict ignore it. */
         // 记录阻塞 key 到客户端, O(1)
-        if (dictAdd(c->bpop.keys,keys[j],NULL) != DICT_OK) continue;
+        if (dictAdd(c->bpop.keys,keys[j],key_data) != DICT_OK) {
+            zfree(key_data);
+            continue;
+        }
         incrRefCount(keys[j]);
 
         /* And in the other "side", to map keys -> clients */
@@ -1214,6 +961,12 @@ void unblockClientWaitingData(redisClient *c) {
         decrRefCount(c->bpop.target);
         c->bpop.target = NULL;
     }
+    if (c->bpop.xread_group) {
+        decrRefCount(c->bpop.xread_group);
+        decrRefCount(c->bpop.xread_consumer);
+        c->bpop.xread_group = NULL;
+        c->bpop.xread_consumer = NULL;
+    }
 
     // 取消客户端的阻塞状态
     c->flags &= ~REDIS_BLOCKED;
@@ -1226,13 +979,14 @@ void unblockClientWaitingData(redisClient *c) {
     listAddNodeTail(server.unblocked_clients,c);
 }
 
-/* If the specified key has clients blocked waiting for list pushes, this
+/* If the specified key has clients blocked waiting for list pushes or
+ * stream entries, this
  * function will put the key reference into the server.ready_keys list.
  * Note that db->ready_keys is an hash table that allows us to avoid putting
  * the same key agains and again in the list in case of multiple pushes
  * made by a script or in the context of MULTI/EXEC.
  *
- * The list will be finally processed by handleClientsBlockedOnLists()
+ * The list will be finally processed by handleClientsBlockedOnKeys()
  *
  * 如果有客户端正因为等待给定 key 被 push 而阻塞，
  * 那么将这个 key 的引用放进 server.ready_keys 列表里面。
@@ -1240,11 +994,11 @@ void unblockClientWaitingData(redisClient *c) {
  * 注意 db->ready_keys 是一个哈希表，
  * 这可以避免在事务或者脚本中，将同一个 key 一次又一次添加到列表的情况出现。
  * 
- * 列表最终会被 handleClientsBlockedOnLists() 函数处理
+ * 列表最终会被 handleClientsBlockedOnKeys() 函数处理
  *
  * T = O(1)
  */
-void signalListAsReady(redisClient *c, robj *key) {
+void signalKeyAsReady(redisClient *c, robj *key) {
     readyList *rl;
 
     /* No clients blocking for this key? No need to queue it. */
@@ -1275,7 +1029,7 @@ void signalListAsReady(redisClient *c, robj *key) {
     redisAssert(dictAdd(c->db->ready_keys,key,NULL) == DICT_OK);
 }
 
-/* This is an helper function for handleClientsBlockedOnLists(). It's work
+/* This is an helper function for handleClientsBlockedOnKeys(). It's work
  * is to serve a specific client (receiver) that is blocked on 'key'
  * in the context of the specified 'db', doing the following:
  *
@@ -1395,14 +1149,14 @@ int serveClientBlockedOnList(redisClient *receiver, robj *key, robj *dstkey, red
  * 函数会一次又一次地进行迭代，
  * 因此它在执行 BRPOPLPUSH 命令的情况下也可以正常获取到正确的新被阻塞客户端。
  */
-void handleClientsBlockedOnLists(void) {
+void handleClientsBlockedOnKeys(void) {
     // 遍历直到整个列表为空为止，O(N^3)
     while(listLength(server.ready_keys) != 0) {
         list *l;
 
         /* Point server.ready_keys to a fresh list and save the current one
          * locally. This way as we run the old list we are free to call
-         * signalListAsReady() that may push new elements in server.ready_keys
+         * signalKeyAsReady() that may push new elements in server.ready_keys
          * when handling clients blocked into BRPOPLPUSH. */
         // 备份旧的 ready_keys ，再给服务器端赋值一个新的
         l = server.ready_keys;
@@ -1416,7 +1170,7 @@ void handleClientsBlockedOnLists(void) {
             readyList *rl = ln->value;
 
             /* First of all remove this key from db->ready_keys so that
-             * we can safely call signalListAsReady() against this key. */
+             * we can safely call signalKeyAsReady() against this key. */
             // 从 db->ready_keys 中删除给定 key
             dictDelete(rl->db->ready_keys,rl->key);
 
@@ -1435,17 +1189,21 @@ void handleClientsBlockedOnLists(void) {
                 if (de) {
                     // 返回所有因为 key 而阻塞的客户端
                     list *clients = dictGetVal(de);
-                    // 计算被阻塞客户端的数量
-                    int numclients = listLength(clients);
+                    listNode *clientnode;
+                    listIter li;
 
                     // 遍历所有客户端，为它们取出阻塞 key 的值
                     // 直到阻塞 key 的值被全部取出，
                     // 或者所有客户端都被处理完为止
-                    while(numclients--) {
-                        // 取出链表中的首个客户端
-                        listNode *clientnode = listFirst(clients);
+                    // 因为 XREAD 而阻塞的客户端会被跳过
+                    listRewind(clients,&li);
+                    while((clientnode = listNext(&li)) != NULL) {
                         redisClient *receiver = clientnode->value;
 
+                        /* Clients blocked by XREAD on a key that is now
+                         * a list are left blocked. */
+                        if (receiver->bpop.btype != REDIS_BPOP_LIST) continue;
+
                         // 设置弹出的目标（只用于 BRPOPLPUSH）
                         robj *dstkey = receiver->bpop.target;
 
@@ -1498,6 +1256,9 @@ void handleClientsBlockedOnLists(void) {
                 if (listTypeLength(o) == 0) dbDelete(rl->db,rl->key);
                 /* We don't call signalModifiedKey() as it was already called
                  * when an element was pushed on the list. */
+            } else if (o != NULL && o->type == REDIS_STREAM) {
+                /* Serve the clients blocked by XREAD on the stream. */
+                serveClientsBlockedOnStreamKey(o,rl);
             }
 
             /* Free this item. */
@@ -1509,10 +1270,17 @@ void handleClientsBlockedOnLists(void) {
     }
 }
 
-int getTimeoutFromObjectOrReply(redisClient *c, robj *object, time_t *timeout) {
-    long tval;
+/* Get a timeout value from an object and store it into 'timeout'.
+ * The final timeout is always stored as milliseconds as a time where the
+ * timeout will expire, however the parsing is performed according to
+ * the 'unit' that can be seconds (BLPOP & co.) or milliseconds (XREAD).
+ *
+ * 从对象中取出超时时间，保存为毫秒精度的过期时间。
+ * unit 指定参数的单位：秒（BLPOP 等）或者毫秒（XREAD）。 */
+int getTimeoutFromObjectOrReply(redisClient *c, robj *object, long long *timeout, int unit) {
+    long long tval;
 
-    if (getLongFromObjectOrReply(c,object,&tval,
+    if (getLongLongFromObjectOrReply(c,object,&tval,
         "timeout is not an integer or out of range") != REDIS_OK)
         return REDIS_ERR;
 
@@ -1521,7 +1289,10 @@ int getTimeoutFromObjectOrReply(redisClient *c, robj *object, time_t *timeout) {
         return REDIS_ERR;
     }
 
-    if (tval > 0) tval += server.unixtime;
+    if (tval > 0) {
+        if (unit == REDIS_UNIT_SECONDS) tval *= 1000;
+        tval += mstime();
+    }
     *timeout = tval;
 
     return REDIS_OK;
@@ -1533,11 +1304,11 @@ int getTimeoutFromObjectOrReply(redisClient *c, robj *object, time_t *timeout) {
  */
 void blockingPopGenericCommand(redisClient *c, int where) {
     robj *o;
-    time_t timeout;
+    long long timeout;
     int j;
 
     // 获取 timeout 参数
-    if (getTimeoutFromObjectOrReply(c,c->argv[c->argc-1],&timeout) != REDIS_OK)
+    if (getTimeoutFromObjectOrReply(c,c->argv[c->argc-1],&timeout,REDIS_UNIT_SECONDS) != REDIS_OK)
         return;
 
     // 遍历所有 key 
@@ -1593,7 +1364,7 @@ void blockingPopGenericCommand(redisClient *c, int where) {
 
     /* If the list is empty or the key does not exists we must block */
     // 所有给定 key 都为空，进行 block
-    blockForKeys(c, c->argv + 1, c->argc - 2, timeout, NULL);
+    blockForKeys(c, REDIS_BPOP_LIST, c->argv + 1, c->argc - 2, timeout, NULL, NULL);
 }
 
 void blpopCommand(redisClient *c) {
@@ -1605,10 +1376,10 @@ void brpopCommand(redisClient *c) {
 }
 
 void brpoplpushCommand(redisClient *c) {
-    time_t timeout;
+    long long timeout;
 
     // 获取 timeout 参数
-    if (getTimeoutFromObjectOrReply(c,c->argv[3],&timeout) != REDIS_OK)
+    if (getTimeoutFromObjectOrReply(c,c->argv[3],&timeout,REDIS_UNIT_SECONDS) != REDIS_OK)
         return;
 
     // 查找 key 对象
@@ -1623,7 +1394,7 @@ void brpoplpushCommand(redisClient *c) {
         } else {
             /* The list is empty and the client blocks. */
             // 直接等待元素 push 到 key
-            blockForKeys(c, c->argv + 1, 1, timeout, c->argv[2]);
+            blockForKeys(c, REDIS_BPOP_LIST, c->argv + 1, 1, timeout, c->argv[2], NULL);
         }
     } else {
         if (key->type != REDIS_LIST) {
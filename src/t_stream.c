@@ -0,0 +1,2313 @@
+/* Streams: an append only log data type, with consumer groups.
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "endianconv.h"
+#include <errno.h>
+
+/* A stream is a sequence of entries, each made of an ID and of a set of
+ * field-value pairs. The entries are stored in listpack blocks, indexed by
+ * the ID of their first entry (the "master ID" of the block) in a skiplist
+ * keyed by stream ID. New entries are always appended to the last block,
+ * until it reaches stream-node-max-bytes or stream-node-max-entries.
+ *
+ * 流是一个由项组成的序列，每个项由一个 ID 和一组域值对组成。
+ * 项被保存在多个 listpack 块中，这些块以各自首个项的 ID （块的主 ID）
+ * 为键，保存在一个以流 ID 为键的跳跃表里。
+ * 新项总是被追加到最后一个块，直到它的大小达到 stream-node-max-bytes
+ * 或者项数量达到 stream-node-max-entries 为止。
+ *
+ * Every block starts with a master entry, followed by the entries:
+ *
+ *   +-------+---------+------------+---------+--/--+---------+---------+-+
+ *   | count | deleted | num-fields | field_1 | ... | field_N | 0 |
+ *   +-------+---------+------------+---------+--/--+---------+---------+-+
+ *
+ *   +-------+--------+---------+------------+-------+-------+--/--+----------+
+ *   | flags | ms-diff | seq-diff | num-fields | field | value | ... | lp-count |
+ *   +-------+--------+---------+------------+-------+-------+--/--+----------+
+ *
+ * 'count' and 'deleted' are the number of valid and of deleted entries of
+ * the block. The master fields are the fields of the first entry: entries
+ * with exactly the same fields have the STREAM_ITEM_FLAG_SAMEFIELDS flag and
+ * store just their values, without 'num-fields' and field names, that is
+ * the common case of a log of records with the same schema.
+ *
+ * The ID of an entry is stored as the difference from the master ID, that
+ * is usually small and encoded in a few bytes. 'lp-count' is the number of
+ * elements of the entry, itself excluded: it allows to iterate the block
+ * backward. Deleted entries are just flagged as such, a block is released
+ * when all its entries are deleted.
+ *
+ * 主项的域就是块中首个项的域：域和主项完全相同的项带有 SAMEFIELDS 标志，
+ * 只保存值，不保存域的名字。项的 ID 以和主 ID 的差值保存。
+ * lp-count 是项占用的元素数量（不包括它自己），用于反向遍历块。
+ * 被删除的项只是打上删除标志，块中的所有项都被删除时才释放整个块。 */
+
+#define STREAM_ITEM_FLAG_NONE 0             /* No special flags. */
+#define STREAM_ITEM_FLAG_DELETED (1<<0)     /* Entry is deleted. Skip it. */
+#define STREAM_ITEM_FLAG_SAMEFIELDS (1<<1)  /* Same fields as master entry. */
+
+/* Flags for streamReplyWithRange(). */
+#define STREAM_RWR_NOACK (1<<0)         /* Do not create entries in the PEL. */
+#define STREAM_RWR_RAWENTRIES (1<<1)    /* Do not emit the outer array. */
+
+/* Count used by XREAD BLOCK without COUNT, so that a client blocking with
+ * an old ID is not served a huge number of entries at once. */
+#define XREAD_BLOCKED_DEFAULT_COUNT 1000
+
+/* -----------------------------------------------------------------------------
+ * Skiplist index keyed by stream ID
+ * -------------------------------------------------------------------------- */
+
+int streamCompareID(streamID *a, streamID *b) {
+    if (a->ms > b->ms) return 1;
+    else if (a->ms < b->ms) return -1;
+    /* The ms part is the same. Check the sequence part. */
+    else if (a->seq > b->seq) return 1;
+    else if (a->seq < b->seq) return -1;
+    /* Everything is the same: IDs are equal. */
+    return 0;
+}
+
+static streamIndexNode *streamIndexCreateNode(int level, streamID *id,
+                                              void *value)
+{
+    streamIndexNode *n = zmalloc(sizeof(*n)+level*sizeof(struct streamIndexLevel));
+
+    if (id) n->id = *id;
+    n->value = value;
+    return n;
+}
+
+streamIndex *streamIndexCreate(void) {
+    streamIndex *si = zmalloc(sizeof(*si));
+    int j;
+
+    si->level = 1;
+    si->length = 0;
+    si->header = streamIndexCreateNode(ZSKIPLIST_MAXLEVEL,NULL,NULL);
+    for (j = 0; j < ZSKIPLIST_MAXLEVEL; j++)
+        si->header->level[j].forward = NULL;
+    si->header->backward = NULL;
+    si->tail = NULL;
+    return si;
+}
+
+/* Free the index, calling 'free_value' (if not NULL) for every value. */
+void streamIndexFree(streamIndex *si, void (*free_value)(void *)) {
+    streamIndexNode *node = si->header->level[0].forward, *next;
+
+    zfree(si->header);
+    while(node) {
+        next = node->level[0].forward;
+        if (free_value) free_value(node->value);
+        zfree(node);
+        node = next;
+    }
+    zfree(si);
+}
+
+/* Fill 'update' with the rightmost node of every level with an ID smaller
+ * than 'id', and return the first node with an ID greater or equal. */
+static streamIndexNode *streamIndexSearch(streamIndex *si, streamID *id,
+                                          streamIndexNode **update)
+{
+    streamIndexNode *x = si->header;
+    int i;
+
+    for (i = si->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+               streamCompareID(&x->level[i].forward->id,id) < 0)
+            x = x->level[i].forward;
+        if (update) update[i] = x;
+    }
+    return x->level[0].forward;
+}
+
+/* Insert 'value' with the given ID. Returns 0 if the ID already exists,
+ * otherwise 1. */
+int streamIndexInsert(streamIndex *si, streamID *id, void *value) {
+    streamIndexNode *update[ZSKIPLIST_MAXLEVEL], *x;
+    int i, level;
+
+    x = streamIndexSearch(si,id,update);
+    if (x && streamCompareID(&x->id,id) == 0) return 0;
+
+    level = zslRandomLevel();
+    if (level > si->level) {
+        for (i = si->level; i < level; i++) update[i] = si->header;
+        si->level = level;
+    }
+    x = streamIndexCreateNode(level,id,value);
+    for (i = 0; i < level; i++) {
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+    }
+    x->backward = (update[0] == si->header) ? NULL : update[0];
+    if (x->level[0].forward)
+        x->level[0].forward->backward = x;
+    else
+        si->tail = x;
+    si->length++;
+    return 1;
+}
+
+/* Remove the node with the given ID. Returns its value, or NULL if the ID
+ * was not found. */
+void *streamIndexRemove(streamIndex *si, streamID *id) {
+    streamIndexNode *update[ZSKIPLIST_MAXLEVEL], *x;
+    void *value;
+    int i;
+
+    x = streamIndexSearch(si,id,update);
+    if (x == NULL || streamCompareID(&x->id,id) != 0) return NULL;
+
+    for (i = 0; i < si->level; i++) {
+        if (update[i]->level[i].forward == x)
+            update[i]->level[i].forward = x->level[i].forward;
+    }
+    if (x->level[0].forward)
+        x->level[0].forward->backward = x->backward;
+    else
+        si->tail = x->backward;
+    while(si->level > 1 && si->header->level[si->level-1].forward == NULL)
+        si->level--;
+    si->length--;
+    value = x->value;
+    zfree(x);
+    return value;
+}
+
+streamIndexNode *streamIndexFind(streamIndex *si, streamID *id) {
+    streamIndexNode *x = streamIndexSearch(si,id,NULL);
+
+    return (x && streamCompareID(&x->id,id) == 0) ? x : NULL;
+}
+
+/* Return the first node with ID >= 'id', or NULL. */
+streamIndexNode *streamIndexSeekGE(streamIndex *si, streamID *id) {
+    return streamIndexSearch(si,id,NULL);
+}
+
+/* Return the last node with ID <= 'id', or NULL. */
+streamIndexNode *streamIndexSeekLE(streamIndex *si, streamID *id) {
+    streamIndexNode *x = streamIndexSearch(si,id,NULL);
+
+    if (x && streamCompareID(&x->id,id) == 0) return x;
+    return x ? x->backward : si->tail;
+}
+
+/* -----------------------------------------------------------------------------
+ * Low level stream encoding
+ * -------------------------------------------------------------------------- */
+
+/* Stream IDs are serialized as 128 bit big endian numbers, so that the
+ * lexicographical order of the serialized IDs is the numerical order. */
+void streamEncodeID(void *buf, streamID *id) {
+    uint64_t e[2];
+
+    e[0] = htonu64(id->ms);
+    e[1] = htonu64(id->seq);
+    memcpy(buf,e,sizeof(e));
+}
+
+void streamDecodeID(void *buf, streamID *id) {
+    uint64_t e[2];
+
+    memcpy(e,buf,sizeof(e));
+    id->ms = ntohu64(e[0]);
+    id->seq = ntohu64(e[1]);
+}
+
+/* Set 'id' to the smallest ID greater than 'id'. */
+static void streamIncrID(streamID *id) {
+    if (id->seq == UINT64_MAX) {
+        if (id->ms == UINT64_MAX) {
+            /* Special case where 'id' is the last possible streamID... */
+            id->ms = id->seq = 0;
+        } else {
+            id->ms++;
+            id->seq = 0;
+        }
+    } else {
+        id->seq++;
+    }
+}
+
+/* Generate the ID of a new entry: the current time in milliseconds, or
+ * the next sequence number of 'last_id' if the clock did not advance (or
+ * went backward). */
+static void streamNextID(streamID *last_id, streamID *new_id) {
+    uint64_t ms = mstime();
+
+    if (ms > last_id->ms) {
+        new_id->ms = ms;
+        new_id->seq = 0;
+    } else {
+        *new_id = *last_id;
+        streamIncrID(new_id);
+    }
+}
+
+static unsigned char *lpAppendInteger(unsigned char *lp, int64_t value) {
+    char buf[LONG_STR_SIZE];
+    int slen = ll2string(buf,sizeof(buf),value);
+
+    return lpAppend(lp,(unsigned char*)buf,slen);
+}
+
+/* Replace the integer at '*pos', that is updated to point to the new
+ * element since the listpack may be reallocated. */
+static unsigned char *lpReplaceInteger(unsigned char *lp, unsigned char **pos,
+                                       int64_t value)
+{
+    char buf[LONG_STR_SIZE];
+    int slen = ll2string(buf,sizeof(buf),value);
+
+    return lpInsert(lp,(unsigned char*)buf,slen,*pos,LP_REPLACE,pos);
+}
+
+/* Return the integer at 'ele'. The stream code only calls it against
+ * elements that were stored as integers. */
+static int64_t lpGetInteger(unsigned char *ele) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long v;
+
+    lpGetValue(ele,&vstr,&vlen,&v);
+    if (vstr) redisAssert(string2ll((char*)vstr,vlen,&v));
+    return v;
+}
+
+/* Return the string at 'ele', integers are converted into 'buf', that
+ * must be at least LONG_STR_SIZE bytes. */
+static unsigned char *lpGetString(unsigned char *ele, int64_t *len,
+                                  unsigned char *buf)
+{
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long v;
+
+    lpGetValue(ele,&vstr,&vlen,&v);
+    if (vstr) {
+        *len = vlen;
+        return vstr;
+    }
+    *len = ll2string((char*)buf,LONG_STR_SIZE,v);
+    return buf;
+}
+
+/* Append the string object 'o', raw or integer encoded. */
+static unsigned char *lpAppendObject(unsigned char *lp, robj *o) {
+    char buf[LONG_STR_SIZE];
+
+    if (sdsEncodedObject(o))
+        return lpAppend(lp,o->ptr,sdslen(o->ptr));
+    return lpAppend(lp,(unsigned char*)buf,
+                    ll2string(buf,sizeof(buf),(long)o->ptr));
+}
+
+static int lpCompareObject(unsigned char *p, robj *o) {
+    char buf[LONG_STR_SIZE];
+
+    if (sdsEncodedObject(o))
+        return lpCompare(p,o->ptr,sdslen(o->ptr));
+    return lpCompare(p,(unsigned char*)buf,
+                     ll2string(buf,sizeof(buf),(long)o->ptr));
+}
+
+static void streamFreeListpack(void *lp) {
+    lpFree(lp);
+}
+
+static void streamFreeNACK(void *nack) {
+    zfree(nack);
+}
+
+static void streamFreeConsumer(streamConsumer *consumer) {
+    /* The NACKs are owned by the group PEL. */
+    streamIndexFree(consumer->pel,NULL);
+    sdsfree(consumer->name);
+    zfree(consumer);
+}
+
+static void streamFreeCG(streamCG *cg) {
+    dictIterator *di = dictGetIterator(cg->consumers);
+    dictEntry *de;
+
+    while((de = dictNext(di)) != NULL)
+        streamFreeConsumer(dictGetVal(de));
+    dictReleaseIterator(di);
+    dictRelease(cg->consumers);
+    streamIndexFree(cg->pel,streamFreeNACK);
+    zfree(cg);
+}
+
+stream *streamNew(void) {
+    stream *s = zmalloc(sizeof(*s));
+
+    s->index = streamIndexCreate();
+    s->length = 0;
+    s->last_id.ms = 0;
+    s->last_id.seq = 0;
+    s->cgroups = NULL;
+    return s;
+}
+
+void freeStream(stream *s) {
+    streamIndexFree(s->index,streamFreeListpack);
+    if (s->cgroups) {
+        dictIterator *di = dictGetIterator(s->cgroups);
+        dictEntry *de;
+
+        while((de = dictNext(di)) != NULL)
+            streamFreeCG(dictGetVal(de));
+        dictReleaseIterator(di);
+        dictRelease(s->cgroups);
+    }
+    zfree(s);
+}
+
+/* Append a new entry with the 'numfields' field-value pairs at 'argv'.
+ * With 'use_id' the entry gets that ID, otherwise a new one is generated.
+ * The ID is returned in 'added_id' if not NULL.
+ *
+ * Returns REDIS_ERR, without adding the entry, if the ID is not greater
+ * than the last ID of the stream.
+ *
+ * 添加一个新项到流的末尾，新项的 ID 必须大于流的最后一个 ID 。 */
+int streamAppendItem(stream *s, robj **argv, int64_t numfields,
+                     streamID *added_id, streamID *use_id)
+{
+    streamIndexNode *node;
+    unsigned char *lp = NULL, *p;
+    streamID id, master_id;
+    int flags = STREAM_ITEM_FLAG_NONE;
+    int64_t j, lp_count;
+
+    if (use_id)
+        id = *use_id;
+    else
+        streamNextID(&s->last_id,&id);
+    if (streamCompareID(&id,&s->last_id) <= 0) return REDIS_ERR;
+
+    /* Append to the last block, unless it is already full. */
+    node = streamIndexLast(s->index);
+    if (node) {
+        size_t totelelen = 0;
+        int64_t count, deleted;
+
+        lp = node->value;
+        for (j = 0; j < numfields*2; j++)
+            totelelen += stringObjectLen(argv[j]);
+        p = lpFirst(lp);
+        count = lpGetInteger(p);
+        deleted = lpGetInteger(lpNext(lp,p));
+        if ((server.stream_node_max_bytes &&
+             lpBytes(lp)+totelelen >= server.stream_node_max_bytes) ||
+            (server.stream_node_max_entries &&
+             (size_t)(count+deleted) >= server.stream_node_max_entries))
+        {
+            lp = NULL;
+        }
+    }
+
+    if (lp == NULL) {
+        /* Create a new block, whose master entry has the fields of the
+         * entry we are adding. */
+        master_id = id;
+        lp = lpNew();
+        lp = lpAppendInteger(lp,1); /* The entry we are adding. */
+        lp = lpAppendInteger(lp,0); /* Zero deleted so far. */
+        lp = lpAppendInteger(lp,numfields);
+        for (j = 0; j < numfields; j++)
+            lp = lpAppendObject(lp,argv[j*2]);
+        lp = lpAppendInteger(lp,0); /* Master entry zero terminator. */
+        redisAssert(streamIndexInsert(s->index,&id,lp));
+        node = streamIndexLast(s->index);
+        flags |= STREAM_ITEM_FLAG_SAMEFIELDS;
+    } else {
+        int64_t master_fields_count;
+
+        master_id = node->id;
+
+        /* Update the count of valid entries. */
+        p = lpFirst(lp);
+        lp = lpReplaceInteger(lp,&p,lpGetInteger(p)+1);
+
+        /* Check if the entry has the same fields of the master entry. */
+        p = lpNext(lp,lpNext(lp,lpFirst(lp)));
+        master_fields_count = lpGetInteger(p);
+        if (master_fields_count == numfields) {
+            p = lpNext(lp,p);
+            for (j = 0; j < numfields; j++) {
+                if (!lpCompareObject(p,argv[j*2])) break;
+                p = lpNext(lp,p);
+            }
+            if (j == numfields) flags |= STREAM_ITEM_FLAG_SAMEFIELDS;
+        }
+    }
+
+    /* Append the entry. */
+    lp = lpAppendInteger(lp,flags);
+    lp = lpAppendInteger(lp,id.ms-master_id.ms);
+    lp = lpAppendInteger(lp,id.seq-master_id.seq);
+    if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS))
+        lp = lpAppendInteger(lp,numfields);
+    for (j = 0; j < numfields; j++) {
+        if (!(flags & STREAM_ITEM_FLAG_SAMEFIELDS))
+            lp = lpAppendObject(lp,argv[j*2]);
+        lp = lpAppendObject(lp,argv[j*2+1]);
+    }
+    /* Number of elements of the entry, so that it is possible to jump
+     * backward to its flags. */
+    lp_count = (flags & STREAM_ITEM_FLAG_SAMEFIELDS) ? 3+numfields :
+                                                       4+numfields*2;
+    lp = lpAppendInteger(lp,lp_count);
+    node->value = lp;
+
+    s->length++;
+    s->last_id = id;
+    if (added_id) *added_id = id;
+    return REDIS_OK;
+}
+
+/* Skip the master entry of the block 'lp', returning its zero terminator.
+ * The number of master fields is stored in '*master_fields_count', and the
+ * first master field in '*master_fields_start'. */
+static unsigned char *streamSkipMasterEntry(unsigned char *lp,
+                                            int64_t *master_fields_count,
+                                            unsigned char **master_fields_start)
+{
+    unsigned char *p = lpFirst(lp); /* Count. */
+    int64_t j;
+
+    p = lpNext(lp,p);               /* Deleted. */
+    p = lpNext(lp,p);               /* Number of master fields. */
+    *master_fields_count = lpGetInteger(p);
+    p = lpNext(lp,p);               /* First master field. */
+    *master_fields_start = p;
+    for (j = 0; j < *master_fields_count; j++) p = lpNext(lp,p);
+    return p;
+}
+
+/* Sanity check the listpack block of 'size' bytes loaded from an RDB file
+ * or a RESTORE payload: the size must match, and the block must start with
+ * a master entry with at least one valid entry, since empty blocks are
+ * always released. On success 1 is returned and the number of valid
+ * entries is stored in '*count', otherwise 0 is returned. */
+int streamValidateListpack(unsigned char *lp, size_t size, int64_t *count) {
+    unsigned char *p, *vstr;
+    unsigned int vlen;
+    long long v[3];
+    int j;
+
+    if (size < 7 || lpBytes(lp) != size || lp[size-1] != 0xFF) return 0;
+
+    /* Valid entries, deleted entries, and number of master fields. */
+    p = lpFirst(lp);
+    for (j = 0; j < 3; j++) {
+        if (p == NULL) return 0;
+        lpGetValue(p,&vstr,&vlen,&v[j]);
+        if (vstr != NULL || v[j] < 0) return 0;
+        p = lpNext(lp,p);
+    }
+    if (v[0] == 0) return 0;
+    *count = v[0];
+    return 1;
+}
+
+/* Trim the stream to 'maxlen' entries, deleting the oldest ones. With
+ * 'approx' only whole blocks are deleted, so the stream may remain a bit
+ * longer than 'maxlen', but trimming is much cheaper. Returns the number
+ * of deleted entries.
+ *
+ * 将流修剪至最多 maxlen 个项，删除最旧的项。
+ * approx 为真时只删除整个块，流的长度可能稍大于 maxlen ，但代价更低。 */
+int64_t streamTrimByLength(stream *s, size_t maxlen, int approx) {
+    streamIndexNode *node;
+    int64_t deleted = 0;
+
+    while (s->length > maxlen && (node = streamIndexFirst(s->index))) {
+        unsigned char *lp = node->value, *p;
+        int64_t entries = lpGetInteger(lpFirst(lp));
+        int64_t master_fields_count, marked = 0;
+        unsigned char *master_fields_start;
+
+        /* Delete the whole block if we can. */
+        if (s->length - entries >= maxlen) {
+            streamIndexRemove(s->index,&node->id);
+            lpFree(lp);
+            s->length -= entries;
+            deleted += entries;
+            continue;
+        }
+
+        /* Otherwise, unless trimming is approximated, flag the oldest
+         * entries of the block as deleted. */
+        if (approx) break;
+        p = streamSkipMasterEntry(lp,&master_fields_count,
+                                  &master_fields_start);
+        p = lpNext(lp,p);
+        while (p && s->length > maxlen) {
+            int64_t flags = lpGetInteger(p), to_skip;
+
+            if (!(flags & STREAM_ITEM_FLAG_DELETED)) {
+                flags |= STREAM_ITEM_FLAG_DELETED;
+                lp = lpReplaceInteger(lp,&p,flags);
+                marked++;
+                s->length--;
+            }
+
+            /* Skip to the flags of the next entry. */
+            p = lpNext(lp,p);   /* ms-diff */
+            p = lpNext(lp,p);   /* seq-diff */
+            p = lpNext(lp,p);   /* num-fields or first value */
+            if (flags & STREAM_ITEM_FLAG_SAMEFIELDS) {
+                to_skip = master_fields_count;
+            } else {
+                to_skip = lpGetInteger(p)*2;
+                p = lpNext(lp,p);
+            }
+            while(to_skip--) p = lpNext(lp,p);
+            p = lpNext(lp,p);   /* Skip lp-count. */
+        }
+
+        /* Update the valid and deleted counters. */
+        p = lpFirst(lp);
+        lp = lpReplaceInteger(lp,&p,entries-marked);
+        p = lpNext(lp,p);
+        lp = lpReplaceInteger(lp,&p,lpGetInteger(p)+marked);
+        node->value = lp;
+        deleted += marked;
+        break;
+    }
+    return deleted;
+}
+
+/* -----------------------------------------------------------------------------
+ * Stream iterator
+ * -------------------------------------------------------------------------- */
+
+/* Initialize the iterator 'si' to return the entries of 's' with IDs in
+ * the range [start, end], in reverse order if 'rev' is true. A NULL start
+ * or end means the minimum or maximum ID. Use it like this:
+ *
+ *  streamIterator myiterator;
+ *  streamIteratorStart(&myiterator,...);
+ *  int64_t numfields;
+ *  while(streamIteratorGetID(&myiterator,&ID,&numfields)) {
+ *      while(numfields--) {
+ *          unsigned char *key, *value;
+ *          int64_t key_len, value_len;
+ *          streamIteratorGetField(&myiterator,&key,&value,&key_len,&value_len);
+ *
+ *          ... do what you want with key and value ...
+ *      }
+ *  }
+ *  streamIteratorStop(&myiterator); */
+void streamIteratorStart(streamIterator *si, stream *s, streamID *start,
+                         streamID *end, int rev)
+{
+    if (start) {
+        si->start = *start;
+    } else {
+        si->start.ms = 0;
+        si->start.seq = 0;
+    }
+    if (end) {
+        si->end = *end;
+    } else {
+        si->end.ms = UINT64_MAX;
+        si->end.seq = UINT64_MAX;
+    }
+
+    /* Seek the block where the range starts. */
+    if (!rev) {
+        /* The first entry >= start is in the last block with a master ID
+         * <= start, or in the first block if there is none. */
+        si->node = streamIndexSeekLE(s->index,&si->start);
+        if (si->node == NULL) si->node = streamIndexFirst(s->index);
+    } else {
+        si->node = streamIndexSeekLE(s->index,&si->end);
+    }
+    si->stream = s;
+    si->lp = NULL;
+    si->lp_ele = NULL;
+    si->lp_flags = NULL;
+    si->lp_seek = NULL;
+    si->rev = rev;
+}
+
+/* Return 1 and store the ID and the number of fields of the next entry of
+ * the range, or 0 when there are no more entries. The fields of the entry
+ * are then returned by streamIteratorGetField(). */
+int streamIteratorGetID(streamIterator *si, streamID *id, int64_t *numfields) {
+    while(1) {
+        unsigned char *p;
+        int64_t flags, count;
+        int cmp;
+
+        /* Load the next block if needed. */
+        if (si->lp == NULL) {
+            if (si->node == NULL) return 0;
+            si->lp = si->node->value;
+            si->master_id = si->node->id;
+            si->lp_seek = streamSkipMasterEntry(si->lp,&count,
+                                                &si->master_fields_start);
+            si->master_fields_count = count;
+            if (si->rev) si->lp_seek = lpLast(si->lp);
+        }
+
+        /* Seek the flags of the next entry. Going forward 'lp_seek' is the
+         * last element before it, going backward it is its 'lp-count', or
+         * the master entry terminator when there are no more entries. */
+        if (!si->rev) {
+            p = lpNext(si->lp,si->lp_seek);
+        } else {
+            count = lpGetInteger(si->lp_seek);
+            p = si->lp_seek;
+            if (count == 0) {
+                p = NULL;
+            } else {
+                while(count--) p = lpPrev(si->lp,p);
+            }
+        }
+        if (p == NULL) {
+            /* End of the block: continue with the next one. */
+            si->lp = NULL;
+            si->node = si->rev ? streamIndexPrev(si->node) :
+                                 streamIndexNext(si->node);
+            continue;
+        }
+
+        /* Decode the entry. */
+        si->lp_flags = p;
+        flags = lpGetInteger(p);
+        p = lpNext(si->lp,p);
+        id->ms = si->master_id.ms + (uint64_t)lpGetInteger(p);
+        p = lpNext(si->lp,p);
+        id->seq = si->master_id.seq + (uint64_t)lpGetInteger(p);
+        p = lpNext(si->lp,p);
+        if (flags & STREAM_ITEM_FLAG_SAMEFIELDS) {
+            *numfields = si->master_fields_count;
+        } else {
+            *numfields = lpGetInteger(p);
+            p = lpNext(si->lp,p);
+        }
+        si->lp_ele = p;
+        si->master_fields_ptr = si->master_fields_start;
+        si->entry_flags = flags;
+
+        /* Remember where to continue the scan. */
+        if (!si->rev) {
+            count = (flags & STREAM_ITEM_FLAG_SAMEFIELDS) ? *numfields :
+                                                            *numfields*2;
+            while(count--) p = lpNext(si->lp,p);
+            si->lp_seek = p;
+        } else {
+            si->lp_seek = lpPrev(si->lp,si->lp_flags);
+        }
+
+        /* Check the range. Since entries are sorted, once we are past the
+         * range there is nothing more to return. */
+        if (!si->rev) {
+            if ((cmp = streamCompareID(id,&si->end)) > 0) break;
+            if (streamCompareID(id,&si->start) < 0) continue;
+        } else {
+            if ((cmp = streamCompareID(id,&si->start)) < 0) break;
+            if (streamCompareID(id,&si->end) > 0) continue;
+        }
+        if (flags & STREAM_ITEM_FLAG_DELETED) continue;
+        return 1;
+    }
+
+    /* Out of range: make sure next calls return 0 as well. */
+    si->lp = NULL;
+    si->node = NULL;
+    return 0;
+}
+
+/* Return the next field and value of the current entry. Must be called
+ * at most 'numfields' times after streamIteratorGetID(). The pointers are
+ * valid until the stream is modified. */
+void streamIteratorGetField(streamIterator *si, unsigned char **fieldptr,
+                            unsigned char **valueptr, int64_t *fieldlen,
+                            int64_t *valuelen)
+{
+    if (si->entry_flags & STREAM_ITEM_FLAG_SAMEFIELDS) {
+        *fieldptr = lpGetString(si->master_fields_ptr,fieldlen,si->field_buf);
+        si->master_fields_ptr = lpNext(si->lp,si->master_fields_ptr);
+    } else {
+        *fieldptr = lpGetString(si->lp_ele,fieldlen,si->field_buf);
+        si->lp_ele = lpNext(si->lp,si->lp_ele);
+    }
+    *valueptr = lpGetString(si->lp_ele,valuelen,si->value_buf);
+    si->lp_ele = lpNext(si->lp,si->lp_ele);
+}
+
+/* Delete the entry just returned by streamIteratorGetID(), whose ID is
+ * 'current'. The iterator remains valid and continues with the entry
+ * after the deleted one.
+ *
+ * 删除迭代器刚刚返回的项，迭代器在删除之后仍然有效。 */
+void streamIteratorRemoveEntry(streamIterator *si, streamID *current) {
+    unsigned char *lp = si->lp, *p;
+    int64_t aux;
+    streamID start, end;
+
+    /* Flag the entry as deleted. */
+    p = si->lp_flags;
+    aux = lpGetInteger(p);
+    lp = lpReplaceInteger(lp,&p,aux|STREAM_ITEM_FLAG_DELETED);
+
+    /* Update the counters of the block, releasing it if this was its
+     * last valid entry. */
+    p = lpFirst(lp);
+    aux = lpGetInteger(p);
+    if (aux == 1) {
+        streamIndexRemove(si->stream->index,&si->master_id);
+        lpFree(lp);
+    } else {
+        lp = lpReplaceInteger(lp,&p,aux-1);
+        p = lpNext(lp,p);
+        lp = lpReplaceInteger(lp,&p,lpGetInteger(p)+1);
+        si->node->value = lp;
+    }
+    si->stream->length--;
+
+    /* The block may have been reallocated or released: seek again the
+     * iterator from the deleted entry, that is now skipped. */
+    start = si->rev ? si->start : *current;
+    end = si->rev ? *current : si->end;
+    streamIteratorStart(si,si->stream,&start,&end,si->rev);
+}
+
+void streamIteratorStop(streamIterator *si) {
+    REDIS_NOTUSED(si);
+}
+
+/* Delete the entry with the given ID. Returns 1 if it was found. */
+static int streamDeleteItem(stream *s, streamID *id) {
+    streamIterator si;
+    streamID myid;
+    int64_t numfields;
+    int deleted = 0;
+
+    streamIteratorStart(&si,s,id,id,0);
+    if (streamIteratorGetID(&si,&myid,&numfields)) {
+        streamIteratorRemoveEntry(&si,&myid);
+        deleted = 1;
+    }
+    streamIteratorStop(&si);
+    return deleted;
+}
+
+/* Store in 'id' the ID of the last valid entry: the last ID of the stream
+ * may belong to a deleted entry. The stream must not be empty. */
+static void streamLastValidID(stream *s, streamID *id) {
+    streamIterator si;
+    int64_t numfields;
+
+    streamIteratorStart(&si,s,NULL,NULL,1);
+    redisAssert(streamIteratorGetID(&si,id,&numfields));
+    streamIteratorStop(&si);
+}
+
+/* -----------------------------------------------------------------------------
+ * Consumer groups
+ * -------------------------------------------------------------------------- */
+
+/* Create a group with the given name and last delivered ID. Returns NULL
+ * if a group with the same name already exists. */
+streamCG *streamCreateCG(stream *s, char *name, size_t namelen, streamID *id) {
+    streamCG *cg;
+    sds key;
+
+    if (s->cgroups == NULL) s->cgroups = dictCreate(&streamNamesDictType,NULL);
+    key = sdsnewlen(name,namelen);
+    if (dictFind(s->cgroups,key) != NULL) {
+        sdsfree(key);
+        return NULL;
+    }
+    cg = zmalloc(sizeof(*cg));
+    cg->pel = streamIndexCreate();
+    cg->consumers = dictCreate(&streamNamesDictType,NULL);
+    cg->last_id = *id;
+    dictAdd(s->cgroups,key,cg);
+    return cg;
+}
+
+streamCG *streamLookupCG(stream *s, sds groupname) {
+    if (s->cgroups == NULL) return NULL;
+    return dictFetchValue(s->cgroups,groupname);
+}
+
+/* Lookup the consumer 'name' of the group, creating it if 'create' is
+ * true. The consumer is marked as active. */
+streamConsumer *streamLookupConsumer(streamCG *cg, sds name, int create) {
+    streamConsumer *consumer = dictFetchValue(cg->consumers,name);
+
+    if (consumer == NULL) {
+        if (!create) return NULL;
+        consumer = zmalloc(sizeof(*consumer));
+        consumer->name = sdsdup(name);
+        consumer->pel = streamIndexCreate();
+        dictAdd(cg->consumers,sdsdup(name),consumer);
+    }
+    consumer->seen_time = mstime();
+    return consumer;
+}
+
+/* Delete the consumer 'name' and its pending entries. Returns the number
+ * of pending entries it had. */
+static long long streamDelConsumer(streamCG *cg, sds name) {
+    streamConsumer *consumer = dictFetchValue(cg->consumers,name);
+    streamIndexNode *node;
+    long long pending;
+
+    if (consumer == NULL) return 0;
+    pending = consumer->pel->length;
+    for (node = streamIndexFirst(consumer->pel); node;
+         node = streamIndexNext(node))
+    {
+        zfree(streamIndexRemove(cg->pel,&node->id));
+    }
+    dictDelete(cg->consumers,name);
+    streamFreeConsumer(consumer);
+    return pending;
+}
+
+streamNACK *streamCreateNACK(streamConsumer *consumer) {
+    streamNACK *nack = zmalloc(sizeof(*nack));
+
+    nack->delivery_time = mstime();
+    nack->delivery_count = 1;
+    nack->consumer = consumer;
+    return nack;
+}
+
+/* -----------------------------------------------------------------------------
+ * Replies and argument parsing
+ * -------------------------------------------------------------------------- */
+
+static int streamFormatID(char *buf, size_t len, streamID *id) {
+    return snprintf(buf,len,"%llu-%llu",
+                    (unsigned long long)id->ms,(unsigned long long)id->seq);
+}
+
+static void addReplyStreamID(redisClient *c, streamID *id) {
+    char buf[STREAM_ID_STR_SIZE];
+
+    addReplyBulkCBuffer(c,buf,streamFormatID(buf,sizeof(buf),id));
+}
+
+robj *createObjectFromStreamID(streamID *id) {
+    char buf[STREAM_ID_STR_SIZE];
+
+    return createStringObject(buf,streamFormatID(buf,sizeof(buf),id));
+}
+
+/* Reply with the entry just returned by the iterator: a two elements
+ * array with the ID and the array of field-value pairs. */
+static void streamReplyEntry(redisClient *c, streamIterator *si,
+                             streamID *id, int64_t numfields)
+{
+    addReplyMultiBulkLen(c,2);
+    addReplyStreamID(c,id);
+    addReplyMultiBulkLen(c,numfields*2);
+    while(numfields--) {
+        unsigned char *field, *value;
+        int64_t field_len, value_len;
+
+        streamIteratorGetField(si,&field,&value,&field_len,&value_len);
+        addReplyBulkCBuffer(c,field,field_len);
+        addReplyBulkCBuffer(c,value,value_len);
+    }
+}
+
+/* Reply with the entries in the range [start, end] (NULL means the
+ * minimum or the maximum ID), in reverse order if 'rev', and at most
+ * 'count' entries if 'count' is not zero. Returns the number of entries.
+ *
+ * With a consumer group, the entries are delivered to 'consumer': the
+ * last delivered ID of the group is updated and, unless STREAM_RWR_NOACK
+ * is given, the entries are added to the group and consumer PELs.
+ *
+ * With STREAM_RWR_RAWENTRIES the entries are not wrapped into an array.
+ *
+ * 回复给定范围内的项。
+ * 给定了消费者组时，这些项被交付给 consumer ：更新组的最后交付 ID ，
+ * 并且（除非给定了 NOACK）将这些项添加到组和消费者的待确认列表中。 */
+size_t streamReplyWithRange(redisClient *c, stream *s, streamID *start,
+                            streamID *end, size_t count, int rev,
+                            streamCG *group, streamConsumer *consumer,
+                            int flags)
+{
+    void *arraylen_ptr = NULL;
+    size_t arraylen = 0;
+    streamIterator si;
+    int64_t numfields;
+    streamID id;
+
+    if (!(flags & STREAM_RWR_RAWENTRIES))
+        arraylen_ptr = addDeferredMultiBulkLength(c);
+
+    streamIteratorStart(&si,s,start,end,rev);
+    while(streamIteratorGetID(&si,&id,&numfields)) {
+        streamReplyEntry(c,&si,&id,numfields);
+
+        if (group) {
+            if (streamCompareID(&id,&group->last_id) > 0)
+                group->last_id = id;
+
+            if (!(flags & STREAM_RWR_NOACK)) {
+                streamNACK *nack = streamCreateNACK(consumer);
+                streamIndexNode *node = streamIndexFind(group->pel,&id);
+
+                if (node) {
+                    /* The entry was already delivered: this is possible
+                     * after XGROUP SETID moved the group back. Assign it
+                     * to the new consumer. */
+                    streamNACK *old = node->value;
+
+                    streamIndexRemove(old->consumer->pel,&id);
+                    zfree(old);
+                    node->value = nack;
+                } else {
+                    streamIndexInsert(group->pel,&id,nack);
+                }
+                streamIndexInsert(consumer->pel,&id,nack);
+            }
+        }
+
+        arraylen++;
+        if (count && count == arraylen) break;
+    }
+    streamIteratorStop(&si);
+    if (arraylen_ptr) setDeferredMultiBulkLength(c,arraylen_ptr,arraylen);
+    return arraylen;
+}
+
+/* Reply with the entries of the consumer PEL with ID >= start, at most
+ * 'count' if not zero: this is the history of the entries delivered and
+ * not yet acknowledged. Entries deleted meanwhile are returned with a
+ * null array instead of the fields. */
+static size_t streamReplyWithRangeFromConsumerPEL(redisClient *c, stream *s,
+                                                  streamID *start,
+                                                  size_t count,
+                                                  streamConsumer *consumer)
+{
+    void *arraylen_ptr = addDeferredMultiBulkLength(c);
+    size_t arraylen = 0;
+    streamIndexNode *node = streamIndexSeekGE(consumer->pel,start);
+
+    while(node && (!count || arraylen < count)) {
+        streamNACK *nack = node->value;
+        streamIterator si;
+        streamID id;
+        int64_t numfields;
+
+        streamIteratorStart(&si,s,&node->id,&node->id,0);
+        if (streamIteratorGetID(&si,&id,&numfields)) {
+            streamReplyEntry(c,&si,&id,numfields);
+        } else {
+            addReplyMultiBulkLen(c,2);
+            addReplyStreamID(c,&node->id);
+            addReply(c,shared.nullmultibulk);
+        }
+        streamIteratorStop(&si);
+
+        /* Update the delivery attempts. */
+        nack->delivery_time = mstime();
+        nack->delivery_count++;
+        arraylen++;
+        node = streamIndexNext(node);
+    }
+    setDeferredMultiBulkLength(c,arraylen_ptr,arraylen);
+    return arraylen;
+}
+
+/* Parse an unsigned 64 bit integer, digits only. */
+static int streamParseUint64(char *s, size_t len, uint64_t *value) {
+    char buf[32], *eptr;
+    unsigned long long v;
+    size_t j;
+
+    if (len == 0 || len >= sizeof(buf)) return 0;
+    for (j = 0; j < len; j++)
+        if (s[j] < '0' || s[j] > '9') return 0;
+    memcpy(buf,s,len);
+    buf[len] = '\0';
+    errno = 0;
+    v = strtoull(buf,&eptr,10);
+    if (errno == ERANGE) return 0;
+    *value = v;
+    return 1;
+}
+
+/* Parse a stream ID in the form <ms>-<seq> or just <ms>, in which case the
+ * sequence is 'missing_seq'. Unless 'strict', "-" and "+" are accepted as
+ * the minimum and maximum IDs. On error an error is replied to 'c', that
+ * may be NULL to just check the ID.
+ *
+ * 解析 <ms>-<seq> 格式的流 ID ，序列号缺失时设为 missing_seq 。 */
+static int streamGenericParseIDOrReply(redisClient *c, robj *o, streamID *id,
+                                       uint64_t missing_seq, int strict)
+{
+    char *s = o->ptr, *dot;
+    size_t len = sdslen(o->ptr);
+
+    if (!sdsEncodedObject(o)) goto invalid;
+    if (!strict && len == 1 && (s[0] == '-' || s[0] == '+')) {
+        id->ms = id->seq = (s[0] == '-') ? 0 : UINT64_MAX;
+        return REDIS_OK;
+    }
+    if ((dot = memchr(s,'-',len)) != NULL) {
+        if (!streamParseUint64(s,dot-s,&id->ms) ||
+            !streamParseUint64(dot+1,len-(dot-s)-1,&id->seq))
+            goto invalid;
+    } else {
+        if (!streamParseUint64(s,len,&id->ms)) goto invalid;
+        id->seq = missing_seq;
+    }
+    return REDIS_OK;
+
+invalid:
+    if (c) addReplyError(c,"Invalid stream ID specified as stream "
+                           "command argument");
+    return REDIS_ERR;
+}
+
+static int streamParseIDOrReply(redisClient *c, robj *o, streamID *id,
+                                uint64_t missing_seq)
+{
+    return streamGenericParseIDOrReply(c,o,id,missing_seq,0);
+}
+
+static int streamParseStrictIDOrReply(redisClient *c, robj *o, streamID *id,
+                                      uint64_t missing_seq)
+{
+    return streamGenericParseIDOrReply(c,o,id,missing_seq,1);
+}
+
+/* Reply with a NOGROUP error about the group and key. */
+static void addReplyNoGroup(redisClient *c, robj *key, robj *group) {
+    addReplySds(c,sdscatprintf(sdsempty(),
+        "-NOGROUP No such key '%s' or consumer group '%s'\r\n",
+        (char*)key->ptr,(char*)group->ptr));
+}
+
+/* Parse "MAXLEN [~|=] <count>" at argv[i]. Returns the index of the last
+ * parsed argument, or -1 after replying with an error. */
+static int streamParseMaxlenOrReply(redisClient *c, int i, long long *maxlen,
+                                    int *approx)
+{
+    int moreargs = c->argc-1-i;
+    char *next;
+
+    if (moreargs == 0) {
+        addReply(c,shared.syntaxerr);
+        return -1;
+    }
+    next = c->argv[i+1]->ptr;
+    *approx = 0;
+    if (moreargs >= 2 && (next[0] == '~' || next[0] == '=') &&
+        next[1] == '\0')
+    {
+        *approx = (next[0] == '~');
+        i++;
+    }
+    if (getLongLongFromObjectOrReply(c,c->argv[i+1],maxlen,NULL) != REDIS_OK)
+        return -1;
+    if (*maxlen < 0) {
+        addReplyError(c,"The MAXLEN argument must be >= 0.");
+        return -1;
+    }
+    return i+1;
+}
+
+/* After an approximated trimming rewrite "MAXLEN ~ <count>" as the exact
+ * "MAXLEN = <length>", so that replicas and the AOF trim the same entries
+ * even if their blocks are not the same. */
+static void streamRewriteApproxMaxlen(redisClient *c, stream *s, int idx) {
+    robj *equal = createStringObject("=",1);
+    robj *maxlen = createStringObjectFromLongLong(s->length);
+
+    rewriteClientCommandArgument(c,idx-1,equal);
+    rewriteClientCommandArgument(c,idx,maxlen);
+    decrRefCount(equal);
+    decrRefCount(maxlen);
+}
+
+/* -----------------------------------------------------------------------------
+ * Stream commands
+ * -------------------------------------------------------------------------- */
+
+/* Lookup the stream at 'key', creating it if it does not exist. Returns
+ * NULL after replying with an error if the key is of another type. */
+static robj *streamTypeLookupWriteOrCreate(redisClient *c, robj *key) {
+    robj *o = lookupKeyWrite(c->db,key);
+
+    if (o == NULL) {
+        o = createStreamObject();
+        dbAdd(c->db,key,o);
+    } else if (o->type != REDIS_STREAM) {
+        addReply(c,shared.wrongtypeerr);
+        return NULL;
+    }
+    return o;
+}
+
+/* XADD key [MAXLEN [~|=] <count>] <ID or *> [field value] [field value] ... */
+void xaddCommand(redisClient *c) {
+    streamID id;
+    int id_given = 0;       /* Was an ID different than "*" specified? */
+    long long maxlen = -1;  /* If left to -1 no trimming is performed. */
+    int approx_maxlen = 0;  /* If 1 only delete whole blocks. */
+    int maxlen_arg_idx = 0; /* Index of the count in MAXLEN, for rewriting. */
+    int i, field_pos;
+    robj *o, *idarg;
+    stream *s;
+
+    /* Parse options. */
+    for (i = 2; i < c->argc; i++) {
+        char *opt = c->argv[i]->ptr;
+
+        if (opt[0] == '*' && opt[1] == '\0') {
+            /* Common case of auto generated ID. */
+            break;
+        } else if (!strcasecmp(opt,"maxlen")) {
+            if ((i = streamParseMaxlenOrReply(c,i,&maxlen,
+                                              &approx_maxlen)) == -1) return;
+            maxlen_arg_idx = i;
+        } else {
+            /* If we are here is a syntax error or a valid ID. */
+            if (streamParseStrictIDOrReply(c,c->argv[i],&id,0) != REDIS_OK)
+                return;
+            id_given = 1;
+            break;
+        }
+    }
+    field_pos = i+1;
+
+    /* Check arity. */
+    if ((c->argc - field_pos) < 2 || ((c->argc-field_pos) % 2) == 1) {
+        addReplyError(c,"wrong number of arguments for XADD");
+        return;
+    }
+
+    /* Return ASAP if the minimal ID was given, without creating the key. */
+    if (id_given && id.ms == 0 && id.seq == 0) {
+        addReplyError(c,"The ID specified in XADD must be greater than 0-0");
+        return;
+    }
+
+    if ((o = streamTypeLookupWriteOrCreate(c,c->argv[1])) == NULL) return;
+    s = o->ptr;
+
+    if (streamAppendItem(s,c->argv+field_pos,(c->argc-field_pos)/2,
+        &id, id_given ? &id : NULL) == REDIS_ERR)
+    {
+        addReplyError(c,"The ID specified in XADD is equal or smaller than "
+                        "the target stream top item");
+        return;
+    }
+    addReplyStreamID(c,&id);
+
+    signalModifiedKey(c->db,c->argv[1]);
+    server.dirty++;
+
+    /* Remove older entries if MAXLEN was specified. */
+    if (maxlen >= 0) {
+        streamTrimByLength(s,maxlen,approx_maxlen);
+        if (approx_maxlen) streamRewriteApproxMaxlen(c,s,maxlen_arg_idx);
+    }
+
+    /* Propagate the ID actually generated. */
+    idarg = createObjectFromStreamID(&id);
+    rewriteClientCommandArgument(c,i,idarg);
+    decrRefCount(idarg);
+
+    /* Serve the clients blocked with XREAD on this key. */
+    signalKeyAsReady(c,c->argv[1]);
+}
+
+/* XRANGE/XREVRANGE implementation. */
+static void xrangeGenericCommand(redisClient *c, int rev) {
+    robj *o;
+    streamID startid, endid;
+    long long count = -1;
+    robj *startarg = rev ? c->argv[3] : c->argv[2];
+    robj *endarg = rev ? c->argv[2] : c->argv[3];
+    int j;
+
+    if (streamParseIDOrReply(c,startarg,&startid,0) == REDIS_ERR) return;
+    if (streamParseIDOrReply(c,endarg,&endid,UINT64_MAX) == REDIS_ERR) return;
+
+    /* Parse the COUNT option if any. */
+    for (j = 4; j < c->argc; j++) {
+        int additional = c->argc-j-1;
+
+        if (!strcasecmp(c->argv[j]->ptr,"COUNT") && additional >= 1) {
+            if (getLongLongFromObjectOrReply(c,c->argv[j+1],&count,NULL)
+                != REDIS_OK) return;
+            if (count < 0) count = 0;
+            j++;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptymultibulk)) == NULL
+        || checkType(c,o,REDIS_STREAM)) return;
+
+    if (count == 0) {
+        addReply(c,shared.emptymultibulk);
+    } else {
+        if (count == -1) count = 0;
+        streamReplyWithRange(c,o->ptr,&startid,&endid,count,rev,NULL,NULL,0);
+    }
+}
+
+/* XRANGE key start end [COUNT <n>] */
+void xrangeCommand(redisClient *c) {
+    xrangeGenericCommand(c,0);
+}
+
+/* XREVRANGE key end start [COUNT <n>] */
+void xrevrangeCommand(redisClient *c) {
+    xrangeGenericCommand(c,1);
+}
+
+/* XLEN key */
+void xlenCommand(redisClient *c) {
+    robj *o;
+
+    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.czero)) == NULL
+        || checkType(c,o,REDIS_STREAM)) return;
+    addReplyLongLong(c,((stream*)o->ptr)->length);
+}
+
+/* XDEL key ID [ID ...] */
+void xdelCommand(redisClient *c) {
+    robj *o;
+    stream *s;
+    streamID id;
+    long long deleted = 0;
+    int j;
+
+    if ((o = lookupKeyWriteOrReply(c,c->argv[1],shared.czero)) == NULL
+        || checkType(c,o,REDIS_STREAM)) return;
+    s = o->ptr;
+
+    /* Check that all the IDs are valid before deleting anything. */
+    for (j = 2; j < c->argc; j++) {
+        if (streamParseStrictIDOrReply(c,c->argv[j],&id,0) != REDIS_OK)
+            return;
+    }
+
+    for (j = 2; j < c->argc; j++) {
+        streamParseStrictIDOrReply(c,c->argv[j],&id,0);
+        deleted += streamDeleteItem(s,&id);
+    }
+
+    if (deleted) {
+        signalModifiedKey(c->db,c->argv[1]);
+        server.dirty += deleted;
+    }
+    addReplyLongLong(c,deleted);
+}
+
+/* XTRIM key MAXLEN [~|=] <count> */
+void xtrimCommand(redisClient *c) {
+    robj *o;
+    stream *s;
+    long long maxlen = -1, deleted;
+    int approx_maxlen = 0, maxlen_arg_idx = 0, i;
+
+    if ((o = lookupKeyWriteOrReply(c,c->argv[1],shared.czero)) == NULL
+        || checkType(c,o,REDIS_STREAM)) return;
+    s = o->ptr;
+
+    for (i = 2; i < c->argc; i++) {
+        if (!strcasecmp(c->argv[i]->ptr,"maxlen")) {
+            if ((i = streamParseMaxlenOrReply(c,i,&maxlen,
+                                              &approx_maxlen)) == -1) return;
+            maxlen_arg_idx = i;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+    if (maxlen == -1) {
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+
+    deleted = streamTrimByLength(s,maxlen,approx_maxlen);
+    if (deleted) {
+        signalModifiedKey(c->db,c->argv[1]);
+        server.dirty += deleted;
+        if (approx_maxlen) streamRewriteApproxMaxlen(c,s,maxlen_arg_idx);
+    }
+    addReplyLongLong(c,deleted);
+}
+
+/* XSETID key <ID>
+ *
+ * Set the last ID of the stream, that must not be smaller than the ID of
+ * its last entry. Used by the AOF rewrite, since deleted entries may leave
+ * the last ID ahead of the last entry. */
+void xsetidCommand(redisClient *c) {
+    robj *o;
+    stream *s;
+    streamID id;
+
+    if ((o = lookupKeyWriteOrReply(c,c->argv[1],shared.nokeyerr)) == NULL
+        || checkType(c,o,REDIS_STREAM)) return;
+    if (streamParseStrictIDOrReply(c,c->argv[2],&id,0) != REDIS_OK) return;
+    s = o->ptr;
+
+    if (s->length > 0) {
+        streamID maxid;
+
+        streamLastValidID(s,&maxid);
+        if (streamCompareID(&id,&maxid) < 0) {
+            addReplyError(c,"The ID specified in XSETID is smaller than the "
+                            "target stream top item");
+            return;
+        }
+    }
+    s->last_id = id;
+    addReply(c,shared.ok);
+    signalModifiedKey(c->db,c->argv[1]);
+    server.dirty++;
+}
+
+/* Propagate a served XREADGROUP as a non blocking XREADGROUP of the single
+ * stream 'key' with the ">" ID: replicas and the AOF deliver the same
+ * entries, since the group is in the same state. */
+static void streamPropagateXREADGROUP(redisClient *c, robj *key,
+                                      robj *group, robj *consumer,
+                                      size_t count, int noack)
+{
+    robj *argv[10];
+    int argc = 0, j;
+
+    argv[argc++] = createStringObject("XREADGROUP",10);
+    argv[argc++] = createStringObject("GROUP",5);
+    argv[argc++] = group;
+    argv[argc++] = consumer;
+    if (count) {
+        argv[argc++] = createStringObject("COUNT",5);
+        argv[argc++] = createStringObjectFromLongLong(count);
+    }
+    if (noack) argv[argc++] = createStringObject("NOACK",5);
+    argv[argc++] = createStringObject("STREAMS",7);
+    argv[argc++] = key;
+    argv[argc++] = createStringObject(">",1);
+    incrRefCount(group);
+    incrRefCount(consumer);
+    incrRefCount(key);
+
+    propagate(server.xreadgroupCommand,c->db->id,argv,argc,
+              REDIS_PROPAGATE_AOF|REDIS_PROPAGATE_REPL);
+    for (j = 0; j < argc; j++) decrRefCount(argv[j]);
+}
+
+/* XREAD [BLOCK <milliseconds>] [COUNT <count>] STREAMS key_1 key_2 ... key_N
+ *       ID_1 ID_2 ... ID_N
+ *
+ * XREADGROUP GROUP group consumer [BLOCK <milliseconds>] [COUNT <count>]
+ *       [NOACK] STREAMS key_1 key_2 ... key_N ID_1 ID_2 ... ID_N
+ *
+ * Return the entries with IDs greater than the given ones. If there are
+ * none and BLOCK is given, the client blocks until new entries arrive, see
+ * blockForKeys() and serveClientsBlockedOnStreamKey().
+ *
+ * 返回 ID 大于给定 ID 的项。如果没有这样的项并且给定了 BLOCK ，
+ * 那么阻塞客户端，直到有新的项到达为止。 */
+void xreadCommand(redisClient *c) {
+    long long timeout = -1; /* -1 means, no BLOCK argument given. */
+    long long count = 0;
+    int streams_count = 0;
+    int streams_arg = 0;
+    int noack = 0;          /* True if NOACK option was specified. */
+#define STREAMID_STATIC_VECTOR_LEN 8
+    streamID static_ids[STREAMID_STATIC_VECTOR_LEN];
+    streamID *ids = static_ids;
+    streamCG **groups = NULL;
+    int xreadgroup = sdslen(c->argv[0]->ptr) == 10; /* XREAD or XREADGROUP? */
+    robj *groupname = NULL;
+    robj *consumername = NULL;
+    size_t arraylen = 0;
+    void *arraylen_ptr = NULL;
+    long long dirty = server.dirty;
+    int i;
+
+    /* Parse arguments. */
+    for (i = 1; i < c->argc; i++) {
+        int moreargs = c->argc-i-1;
+        char *o = c->argv[i]->ptr;
+
+        if (!strcasecmp(o,"BLOCK") && moreargs) {
+            i++;
+            if (getTimeoutFromObjectOrReply(c,c->argv[i],&timeout,
+                REDIS_UNIT_MILLISECONDS) != REDIS_OK) return;
+        } else if (!strcasecmp(o,"COUNT") && moreargs) {
+            i++;
+            if (getLongLongFromObjectOrReply(c,c->argv[i],&count,NULL)
+                != REDIS_OK) return;
+            if (count < 0) count = 0;
+        } else if (!strcasecmp(o,"STREAMS") && moreargs) {
+            streams_arg = i+1;
+            streams_count = (c->argc-streams_arg);
+            if ((streams_count % 2) != 0) {
+                addReplyError(c,"Unbalanced XREAD list of streams: for each "
+                                "stream key an ID or '$' must be specified.");
+                return;
+            }
+            streams_count /= 2; /* We have two arguments for each stream. */
+            break;
+        } else if (!strcasecmp(o,"GROUP") && moreargs >= 2) {
+            if (!xreadgroup) {
+                addReplyError(c,"The GROUP option is only supported by "
+                                "XREADGROUP. You called XREAD instead.");
+                return;
+            }
+            groupname = c->argv[i+1];
+            consumername = c->argv[i+2];
+            i += 2;
+        } else if (!strcasecmp(o,"NOACK")) {
+            if (!xreadgroup) {
+                addReplyError(c,"The NOACK option is only supported by "
+                                "XREADGROUP. You called XREAD instead.");
+                return;
+            }
+            noack = 1;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    /* STREAMS option is mandatory. */
+    if (streams_arg == 0) {
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+
+    /* If the user specified XREADGROUP then it must also provide the GROUP
+     * option. */
+    if (xreadgroup && groupname == NULL) {
+        addReplyError(c,"Missing GROUP option for XREADGROUP");
+        return;
+    }
+
+    /* Parse the IDs and resolve the group name. */
+    if (streams_count > STREAMID_STATIC_VECTOR_LEN)
+        ids = zmalloc(sizeof(streamID)*streams_count);
+    if (groupname) groups = zmalloc(sizeof(streamCG*)*streams_count);
+
+    for (i = streams_arg + streams_count; i < c->argc; i++) {
+        int id_idx = i - streams_arg - streams_count;
+        robj *key = c->argv[i-streams_count];
+        robj *o = lookupKeyRead(c->db,key);
+        char *idstr = c->argv[i]->ptr;
+
+        if (o && checkType(c,o,REDIS_STREAM)) goto cleanup;
+
+        /* If a group was specified, than we need to be sure that the key
+         * and group actually exist. */
+        if (groupname) {
+            streamCG *group = NULL;
+
+            if (o) group = streamLookupCG(o->ptr,groupname->ptr);
+            if (group == NULL) {
+                addReplyNoGroup(c,key,groupname);
+                goto cleanup;
+            }
+            groups[id_idx] = group;
+        }
+
+        if (strcmp(idstr,"$") == 0) {
+            /* "$" means only the entries added from now on. */
+            if (xreadgroup) {
+                addReplyError(c,"The $ ID is meaningless in the context of "
+                                "XREADGROUP: you want to read the history of "
+                                "this consumer by specifying a proper ID, or "
+                                "use the > ID to get new messages. The $ ID "
+                                "would just return an empty result set.");
+                goto cleanup;
+            }
+            if (o) {
+                ids[id_idx] = ((stream*)o->ptr)->last_id;
+            } else {
+                ids[id_idx].ms = 0;
+                ids[id_idx].seq = 0;
+            }
+            continue;
+        } else if (strcmp(idstr,">") == 0) {
+            /* ">" means the entries never delivered to the group. The
+             * maximum ID flags it: the actual ID is the last delivered ID
+             * of the group, that may change while the client is blocked. */
+            if (!xreadgroup) {
+                addReplyError(c,"The > ID can be specified only when calling "
+                                "XREADGROUP using the GROUP <group> "
+                                "<consumer> option.");
+                goto cleanup;
+            }
+            ids[id_idx].ms = UINT64_MAX;
+            ids[id_idx].seq = UINT64_MAX;
+            continue;
+        }
+        if (streamParseStrictIDOrReply(c,c->argv[i],ids+id_idx,0) != REDIS_OK)
+            goto cleanup;
+    }
+
+    /* Try to serve the client synchronously. */
+    for (i = 0; i < streams_count; i++) {
+        robj *o = lookupKeyRead(c->db,c->argv[streams_arg+i]);
+        streamID *gt = ids+i; /* ID must be greater than this. */
+        int serve_synchronously = 0;
+        int serve_history = 0; /* True for XREADGROUP with ID != ">". */
+        streamConsumer *consumer = NULL;
+        streamID start, maxid;
+        stream *s;
+
+        if (o == NULL) continue;
+        s = o->ptr;
+
+        if (groups) {
+            if (gt->ms != UINT64_MAX || gt->seq != UINT64_MAX) {
+                /* An explicit ID reads the history of the consumer, that
+                 * is always served synchronously. */
+                serve_synchronously = 1;
+                serve_history = 1;
+            } else if (s->length) {
+                /* Serve synchronously if the stream has entries never
+                 * delivered to the group. */
+                streamLastValidID(s,&maxid);
+                if (streamCompareID(&maxid,&groups[i]->last_id) > 0) {
+                    serve_synchronously = 1;
+                    *gt = groups[i]->last_id;
+                }
+            }
+        } else if (s->length) {
+            /* Without a group serve synchronously if we can provide at
+             * least one entry. */
+            streamLastValidID(s,&maxid);
+            if (streamCompareID(&maxid,gt) > 0) serve_synchronously = 1;
+        }
+
+        if (!serve_synchronously) continue;
+        if (++arraylen == 1) arraylen_ptr = addDeferredMultiBulkLength(c);
+
+        /* The ranges are inclusive: start from the ID after 'gt'. */
+        start = *gt;
+        streamIncrID(&start);
+
+        /* Emit the key and its entries. */
+        addReplyMultiBulkLen(c,2);
+        addReplyBulk(c,c->argv[streams_arg+i]);
+        if (groups) consumer = streamLookupConsumer(groups[i],
+                                                    consumername->ptr,1);
+        if (serve_history) {
+            streamReplyWithRangeFromConsumerPEL(c,s,&start,count,consumer);
+        } else {
+            streamReplyWithRange(c,s,&start,NULL,count,0,
+                                 groups ? groups[i] : NULL,consumer,
+                                 noack ? STREAM_RWR_NOACK : 0);
+            if (groups) server.dirty++;
+        }
+    }
+
+    /* We replied synchronously? Set the array length and return. */
+    if (arraylen) {
+        setDeferredMultiBulkLength(c,arraylen_ptr,arraylen);
+
+        /* XREADGROUP changed the group state: make sure it is propagated
+         * without the BLOCK option, so that it never blocks replicas or
+         * the AOF loading. */
+        if (server.dirty != dirty && timeout != -1) {
+            robj **argv = zmalloc(sizeof(robj*)*(c->argc-2));
+            int argc = 0, j;
+
+            for (j = 0; j < c->argc; j++) {
+                if (j < streams_arg && !strcasecmp(c->argv[j]->ptr,"BLOCK")) {
+                    j++;
+                    continue;
+                }
+                argv[argc++] = c->argv[j];
+                incrRefCount(c->argv[j]);
+            }
+            replaceClientCommandVector(c,argc,argv);
+        }
+        goto cleanup;
+    }
+
+    /* Block if needed. */
+    if (timeout != -1) {
+        /* Inside MULTI/EXEC or a script we can't block: treat it like a
+         * timeout (even with timeout 0). */
+        if (c->flags & (REDIS_MULTI|REDIS_LUA_CLIENT)) {
+            addReply(c,shared.nullmultibulk);
+            goto cleanup;
+        }
+        blockForKeys(c,REDIS_BPOP_STREAM,c->argv+streams_arg,streams_count,
+                     timeout,NULL,ids);
+        c->bpop.xread_count = count ? count : XREAD_BLOCKED_DEFAULT_COUNT;
+
+        /* Remember the group and the consumer, to deliver the entries when
+         * one of the keys receives new data. */
+        if (groupname) {
+            incrRefCount(groupname);
+            incrRefCount(consumername);
+            c->bpop.xread_group = groupname;
+            c->bpop.xread_consumer = consumername;
+            c->bpop.xread_group_noack = noack;
+        } else {
+            c->bpop.xread_group = NULL;
+            c->bpop.xread_consumer = NULL;
+        }
+        goto cleanup;
+    }
+
+    /* No BLOCK option, nor any stream we can serve. Reply as with a
+     * timeout happened. */
+    addReply(c,shared.nullmultibulk);
+
+cleanup:
+    if (ids != static_ids) zfree(ids);
+    zfree(groups);
+}
+
+/* Serve the clients blocked by XREAD or XREADGROUP on the key 'rl', whose
+ * value is the stream 'o': called by handleClientsBlockedOnKeys() after a
+ * command added entries to the stream.
+ *
+ * 为因为 XREAD 或 XREADGROUP 而阻塞在 rl 键上的客户端提供数据。 */
+void serveClientsBlockedOnStreamKey(robj *o, readyList *rl) {
+    dictEntry *de = dictFind(rl->db->blocking_keys,rl->key);
+    stream *s = o->ptr;
+    listNode *ln;
+    listIter li;
+    list *clients;
+
+    if (de == NULL) return;
+    clients = dictGetVal(de);
+
+    /* We serve clients in the same order they blocked for this key. Note
+     * that listNext() already moved to the next node when the client is
+     * unblocked and removed from the list. */
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        redisClient *receiver = listNodeValue(ln);
+        streamID *gt, start;
+        streamCG *group = NULL;
+        streamConsumer *consumer = NULL;
+        int noack = 0;
+
+        if (receiver->bpop.btype != REDIS_BPOP_STREAM) continue;
+        gt = dictFetchValue(receiver->bpop.keys,rl->key);
+
+        /* In a consumer group the client waits for the entries after the
+         * last delivered ID of the group. */
+        if (receiver->bpop.xread_group) {
+            group = streamLookupCG(s,receiver->bpop.xread_group->ptr);
+            if (group == NULL) {
+                /* The group was destroyed while the client was blocked. */
+                addReplySds(receiver,sdsnew("-NOGROUP the consumer group "
+                    "this client was blocked on no longer exists\r\n"));
+                unblockClientWaitingData(receiver);
+                continue;
+            }
+            *gt = group->last_id;
+        }
+
+        if (streamCompareID(&s->last_id,gt) <= 0) continue;
+
+        start = *gt;
+        streamIncrID(&start);
+        if (group) {
+            consumer = streamLookupConsumer(group,
+                receiver->bpop.xread_consumer->ptr,1);
+            noack = receiver->bpop.xread_group_noack;
+        }
+
+        /* Reply with the key and its entries, like a synchronous XREAD. */
+        addReplyMultiBulkLen(receiver,1);
+        addReplyMultiBulkLen(receiver,2);
+        addReplyBulk(receiver,rl->key);
+        streamReplyWithRange(receiver,s,&start,NULL,
+                             receiver->bpop.xread_count,0,group,consumer,
+                             noack ? STREAM_RWR_NOACK : 0);
+
+        if (group) {
+            streamPropagateXREADGROUP(receiver,rl->key,
+                receiver->bpop.xread_group,receiver->bpop.xread_consumer,
+                receiver->bpop.xread_count,noack);
+            server.dirty++;
+        }
+
+        /* The bpop state is released when the client is unblocked: do it
+         * as the last thing. */
+        unblockClientWaitingData(receiver);
+    }
+}
+
+/* XGROUP CREATE <key> <groupname> <id or $> [MKSTREAM]
+ * XGROUP SETID <key> <groupname> <id or $>
+ * XGROUP DESTROY <key> <groupname>
+ * XGROUP DELCONSUMER <key> <groupname> <consumername> */
+void xgroupCommand(redisClient *c) {
+    char *opt = c->argv[1]->ptr; /* Subcommand name. */
+    int mkstream = 0;
+    robj *o = NULL;
+    stream *s = NULL;
+    streamCG *cg = NULL;
+    sds grpname = NULL;
+
+    if (c->argc >= 4) {
+        if (!strcasecmp(opt,"CREATE") && c->argc == 6 &&
+            !strcasecmp(c->argv[5]->ptr,"MKSTREAM")) mkstream = 1;
+
+        o = lookupKeyWrite(c->db,c->argv[2]);
+        if (o == NULL && !mkstream) {
+            addReplyError(c,"The XGROUP subcommand requires the key to exist. "
+                            "Note that for CREATE you may want to use the "
+                            "MKSTREAM option to create an empty stream "
+                            "automatically.");
+            return;
+        }
+        if (o && checkType(c,o,REDIS_STREAM)) return;
+        if (o) s = o->ptr;
+        grpname = c->argv[3]->ptr;
+        if (s) cg = streamLookupCG(s,grpname);
+
+        /* Certain subcommands require the group to exist. */
+        if (cg == NULL && (!strcasecmp(opt,"SETID") ||
+                           !strcasecmp(opt,"DELCONSUMER")))
+        {
+            addReplyNoGroup(c,c->argv[2],c->argv[3]);
+            return;
+        }
+    }
+
+    if (!strcasecmp(opt,"CREATE") && (c->argc == 5 || mkstream)) {
+        streamID id;
+
+        if (!strcmp(c->argv[4]->ptr,"$")) {
+            if (s) {
+                id = s->last_id;
+            } else {
+                id.ms = 0;
+                id.seq = 0;
+            }
+        } else if (streamParseStrictIDOrReply(c,c->argv[4],&id,0) != REDIS_OK) {
+            return;
+        }
+
+        if (s == NULL) {
+            o = createStreamObject();
+            dbAdd(c->db,c->argv[2],o);
+            s = o->ptr;
+        }
+        if (streamCreateCG(s,grpname,sdslen(grpname),&id) == NULL) {
+            addReplySds(c,sdsnew("-BUSYGROUP Consumer Group name already "
+                                 "exists\r\n"));
+            return;
+        }
+        addReply(c,shared.ok);
+        signalModifiedKey(c->db,c->argv[2]);
+        server.dirty++;
+    } else if (!strcasecmp(opt,"SETID") && c->argc == 5) {
+        streamID id;
+
+        if (!strcmp(c->argv[4]->ptr,"$")) {
+            id = s->last_id;
+        } else if (streamParseStrictIDOrReply(c,c->argv[4],&id,0) != REDIS_OK) {
+            return;
+        }
+        cg->last_id = id;
+        addReply(c,shared.ok);
+        signalModifiedKey(c->db,c->argv[2]);
+        server.dirty++;
+    } else if (!strcasecmp(opt,"DESTROY") && c->argc == 4) {
+        if (cg) {
+            dictDelete(s->cgroups,grpname);
+            streamFreeCG(cg);
+            addReply(c,shared.cone);
+            signalModifiedKey(c->db,c->argv[2]);
+            server.dirty++;
+            /* Unblock the clients waiting on this group with an error. */
+            signalKeyAsReady(c,c->argv[2]);
+        } else {
+            addReply(c,shared.czero);
+        }
+    } else if (!strcasecmp(opt,"DELCONSUMER") && c->argc == 5) {
+        long long pending = streamDelConsumer(cg,c->argv[4]->ptr);
+
+        addReplyLongLong(c,pending);
+        signalModifiedKey(c->db,c->argv[2]);
+        server.dirty++;
+    } else {
+        addReplyErrorFormat(c,"Unknown XGROUP subcommand or wrong number of "
+                              "arguments for '%s'",opt);
+    }
+}
+
+/* XACK <key> <group> <id> <id> ... <id>
+ *
+ * Acknowledge the entries, removing them from the PELs. Returns the number
+ * of entries that were pending. */
+void xackCommand(redisClient *c) {
+    streamCG *group = NULL;
+    robj *o = lookupKeyRead(c->db,c->argv[1]);
+    long long acknowledged = 0;
+    streamID id;
+    int j;
+
+    if (o) {
+        if (checkType(c,o,REDIS_STREAM)) return;
+        group = streamLookupCG(o->ptr,c->argv[2]->ptr);
+    }
+
+    /* Check that all the IDs are valid before acknowledging anything. */
+    for (j = 3; j < c->argc; j++) {
+        if (streamParseStrictIDOrReply(c,c->argv[j],&id,0) != REDIS_OK)
+            return;
+    }
+
+    /* No key or group? Nothing to acknowledge. */
+    if (group == NULL) {
+        addReply(c,shared.czero);
+        return;
+    }
+
+    for (j = 3; j < c->argc; j++) {
+        streamNACK *nack;
+
+        streamParseStrictIDOrReply(c,c->argv[j],&id,0);
+        if ((nack = streamIndexRemove(group->pel,&id)) != NULL) {
+            streamIndexRemove(nack->consumer->pel,&id);
+            zfree(nack);
+            acknowledged++;
+            server.dirty++;
+        }
+    }
+    addReplyLongLong(c,acknowledged);
+}
+
+/* XPENDING <key> <group> [<start> <stop> <count> [<consumer>]]
+ *
+ * Without the range, reply with a summary of the pending entries: their
+ * number, the smallest and greatest ID, and the number of pending entries
+ * of every consumer. With the range, reply with the ID, the consumer, the
+ * idle time and the delivery count of every pending entry in the range. */
+void xpendingCommand(redisClient *c) {
+    int justinfo = c->argc == 3; /* Without the range, just the summary. */
+    robj *key = c->argv[1];
+    robj *groupname = c->argv[2];
+    robj *consumername = (c->argc == 7) ? c->argv[6] : NULL;
+    streamID startid, endid;
+    long long count = 0;
+    streamCG *group = NULL;
+    robj *o;
+
+    /* Start and stop, and the consumer, can be omitted. */
+    if (c->argc != 3 && c->argc != 6 && c->argc != 7) {
+        addReply(c,shared.syntaxerr);
+        return;
+    }
+
+    /* Parse start/end/count arguments ASAP if needed, in order to report
+     * syntax errors before any other error. */
+    if (c->argc >= 6) {
+        if (getLongLongFromObjectOrReply(c,c->argv[5],&count,NULL) == REDIS_ERR)
+            return;
+        if (count < 0) count = 0;
+        if (streamParseIDOrReply(c,c->argv[3],&startid,0) == REDIS_ERR)
+            return;
+        if (streamParseIDOrReply(c,c->argv[4],&endid,UINT64_MAX) == REDIS_ERR)
+            return;
+    }
+
+    /* Lookup the key and the group inside the stream. */
+    o = lookupKeyRead(c->db,c->argv[1]);
+    if (o && checkType(c,o,REDIS_STREAM)) return;
+    if (o) group = streamLookupCG(o->ptr,groupname->ptr);
+    if (group == NULL) {
+        addReplyNoGroup(c,key,groupname);
+        return;
+    }
+
+    if (justinfo) {
+        addReplyMultiBulkLen(c,4);
+        addReplyLongLong(c,group->pel->length);
+        if (group->pel->length == 0) {
+            addReply(c,shared.nullbulk); /* Start. */
+            addReply(c,shared.nullbulk); /* End. */
+            addReply(c,shared.nullmultibulk); /* Clients. */
+        } else {
+            dictIterator *di = dictGetIterator(group->consumers);
+            void *arraylen_ptr;
+            size_t arraylen = 0;
+            dictEntry *de;
+
+            addReplyStreamID(c,&streamIndexFirst(group->pel)->id);
+            addReplyStreamID(c,&streamIndexLast(group->pel)->id);
+
+            /* Consumers with pending entries and their number. */
+            arraylen_ptr = addDeferredMultiBulkLength(c);
+            while((de = dictNext(di)) != NULL) {
+                streamConsumer *consumer = dictGetVal(de);
+
+                if (consumer->pel->length == 0) continue;
+                addReplyMultiBulkLen(c,2);
+                addReplyBulkCBuffer(c,consumer->name,sdslen(consumer->name));
+                addReplyBulkLongLong(c,consumer->pel->length);
+                arraylen++;
+            }
+            dictReleaseIterator(di);
+            setDeferredMultiBulkLength(c,arraylen_ptr,arraylen);
+        }
+    } else {
+        streamConsumer *consumer = NULL;
+        streamIndex *pel = group->pel;
+        streamIndexNode *node;
+        long long now = mstime();
+        void *arraylen_ptr = addDeferredMultiBulkLength(c);
+        size_t arraylen = 0;
+
+        if (consumername) {
+            consumer = streamLookupConsumer(group,consumername->ptr,0);
+            pel = consumer ? consumer->pel : NULL;
+        }
+        node = pel ? streamIndexSeekGE(pel,&startid) : NULL;
+        while(node && count--) {
+            streamNACK *nack = node->value;
+            long long idle = now - nack->delivery_time;
+
+            if (streamCompareID(&node->id,&endid) > 0) break;
+            addReplyMultiBulkLen(c,4);
+            addReplyStreamID(c,&node->id);
+            addReplyBulkCBuffer(c,nack->consumer->name,
+                                sdslen(nack->consumer->name));
+            addReplyLongLong(c,idle < 0 ? 0 : idle);
+            addReplyLongLong(c,nack->delivery_count);
+            arraylen++;
+            node = streamIndexNext(node);
+        }
+        setDeferredMultiBulkLength(c,arraylen_ptr,arraylen);
+    }
+}
+
+/* XCLAIM <key> <group> <consumer> <min-idle-time> <ID-1> <ID-2> ...
+ *        [IDLE <milliseconds>] [TIME <mstime>] [RETRYCOUNT <count>]
+ *        [FORCE] [JUSTID]
+ *
+ * Change the owner of the pending entries idle for at least min-idle-time
+ * milliseconds to 'consumer', for instance because their consumer failed.
+ *
+ * IDLE and TIME set the delivery time of the claimed entries, RETRYCOUNT
+ * their delivery count, that is otherwise incremented (unless JUSTID).
+ * FORCE creates the pending entries that do not exist yet, if the entries
+ * exist in the stream: it is used by the AOF rewrite. JUSTID replies with
+ * the IDs only.
+ *
+ * The command is propagated with the IDs actually claimed, a zero
+ * min-idle-time and an explicit TIME, so that replicas and the AOF claim
+ * the same entries regardless of their clock.
+ *
+ * 将空闲时间至少为 min-idle-time 毫秒的待确认项转移给 consumer ，
+ * 比如在原来的消费者失效的时候。 */
+void xclaimCommand(redisClient *c) {
+    streamCG *group = NULL;
+    robj *o = lookupKeyRead(c->db,c->argv[1]);
+    long long minidle; /* Minimum idle time argument. */
+    long long retrycount = -1;   /* -1 means RETRYCOUNT option not given. */
+    long long deliverytime = -1; /* -1 means IDLE/TIME options not given. */
+    int force = 0, justid = 0;
+    int j, last_id_arg;
+    long long now = mstime();
+    streamConsumer *consumer = NULL;
+    void *arraylen_ptr;
+    size_t arraylen = 0;
+    robj **claimed;
+    int numclaimed = 0;
+    stream *s;
+
+    if (o) {
+        if (checkType(c,o,REDIS_STREAM)) return;
+        group = streamLookupCG(o->ptr,c->argv[2]->ptr);
+    }
+
+    /* No key or group? Send an error given that the group creation is
+     * mandatory. */
+    if (o == NULL || group == NULL) {
+        addReplyNoGroup(c,c->argv[1],c->argv[2]);
+        return;
+    }
+    s = o->ptr;
+
+    if (getLongLongFromObjectOrReply(c,c->argv[4],&minidle,
+        "Invalid min-idle-time argument for XCLAIM") != REDIS_OK) return;
+    if (minidle < 0) minidle = 0;
+
+    /* The IDs go up to the first argument that is not an ID. */
+    for (j = 5; j < c->argc; j++) {
+        streamID id;
+
+        if (streamParseStrictIDOrReply(NULL,c->argv[j],&id,0) != REDIS_OK)
+            break;
+    }
+    last_id_arg = j-1; /* Next time we iterate the IDs we now the range. */
+
+    /* If we stopped because some IDs cannot be parsed, perhaps they are
+     * trailing options. */
+    for (; j < c->argc; j++) {
+        int moreargs = (c->argc-1) - j;
+        char *opt = c->argv[j]->ptr;
+
+        if (!strcasecmp(opt,"FORCE")) {
+            force = 1;
+        } else if (!strcasecmp(opt,"JUSTID")) {
+            justid = 1;
+        } else if (!strcasecmp(opt,"IDLE") && moreargs) {
+            j++;
+            if (getLongLongFromObjectOrReply(c,c->argv[j],&deliverytime,
+                "Invalid IDLE option argument for XCLAIM") != REDIS_OK)
+                return;
+            deliverytime = now - deliverytime;
+        } else if (!strcasecmp(opt,"TIME") && moreargs) {
+            j++;
+            if (getLongLongFromObjectOrReply(c,c->argv[j],&deliverytime,
+                "Invalid TIME option argument for XCLAIM") != REDIS_OK)
+                return;
+        } else if (!strcasecmp(opt,"RETRYCOUNT") && moreargs) {
+            j++;
+            if (getLongLongFromObjectOrReply(c,c->argv[j],&retrycount,
+                "Invalid RETRYCOUNT option argument for XCLAIM") != REDIS_OK)
+                return;
+        } else {
+            addReplyErrorFormat(c,"Unrecognized XCLAIM option '%s'",opt);
+            return;
+        }
+    }
+
+    /* A delivery time in the future, or negative, is clamped to now. */
+    if (deliverytime < 0 || deliverytime > now) deliverytime = now;
+
+    claimed = zmalloc(sizeof(robj*)*(last_id_arg-4));
+    arraylen_ptr = addDeferredMultiBulkLength(c);
+    for (j = 5; j <= last_id_arg; j++) {
+        streamIndexNode *node;
+        streamNACK *nack;
+        streamID id;
+
+        streamParseStrictIDOrReply(NULL,c->argv[j],&id,0);
+        node = streamIndexFind(group->pel,&id);
+        nack = node ? node->value : NULL;
+
+        /* With FORCE create the pending entry, if the entry exists. */
+        if (force && nack == NULL) {
+            streamIterator si;
+            streamID myid;
+            int64_t numfields;
+            int found;
+
+            streamIteratorStart(&si,s,&id,&id,0);
+            found = streamIteratorGetID(&si,&myid,&numfields);
+            streamIteratorStop(&si);
+            if (!found) continue;
+            nack = streamCreateNACK(NULL);
+            streamIndexInsert(group->pel,&id,nack);
+        }
+        if (nack == NULL) continue;
+
+        /* Check the minimum idle time requested. */
+        if (minidle && nack->consumer && now - nack->delivery_time < minidle)
+            continue;
+
+        if (consumer == NULL)
+            consumer = streamLookupConsumer(group,c->argv[3]->ptr,1);
+        if (nack->consumer != consumer) {
+            /* The consumer is NULL if the entry was just created. */
+            if (nack->consumer) streamIndexRemove(nack->consumer->pel,&id);
+            streamIndexInsert(consumer->pel,&id,nack);
+            nack->consumer = consumer;
+        }
+        nack->delivery_time = deliverytime;
+        if (retrycount >= 0)
+            nack->delivery_count = retrycount;
+        else if (!justid)
+            nack->delivery_count++;
+
+        /* Reply with the entry, or a null if it was deleted. */
+        if (justid) {
+            addReplyStreamID(c,&id);
+        } else if (streamReplyWithRange(c,s,&id,&id,1,0,NULL,NULL,
+                                        STREAM_RWR_RAWENTRIES) == 0)
+        {
+            addReply(c,shared.nullbulk);
+        }
+        arraylen++;
+        claimed[numclaimed++] = c->argv[j];
+    }
+    setDeferredMultiBulkLength(c,arraylen_ptr,arraylen);
+
+    /* Rewrite the command for the propagation, with just the claimed
+     * IDs: <key> <group> <consumer> 0 <IDs> TIME <time> [RETRYCOUNT <n>]
+     * [FORCE] [JUSTID]. */
+    if (numclaimed) {
+        int argc = 0;
+        robj **argv = zmalloc(sizeof(robj*)*(numclaimed+12));
+
+        for (j = 0; j < 4; j++) argv[argc++] = c->argv[j];
+        argv[argc++] = createStringObjectFromLongLong(0);
+        for (j = 0; j < numclaimed; j++) argv[argc++] = claimed[j];
+        argv[argc++] = createStringObject("TIME",4);
+        argv[argc++] = createStringObjectFromLongLong(deliverytime);
+        if (retrycount >= 0) {
+            argv[argc++] = createStringObject("RETRYCOUNT",10);
+            argv[argc++] = createStringObjectFromLongLong(retrycount);
+        }
+        if (force) argv[argc++] = createStringObject("FORCE",5);
+        if (justid) argv[argc++] = createStringObject("JUSTID",6);
+        for (j = 0; j < 4; j++) incrRefCount(argv[j]);
+        for (j = 0; j < numclaimed; j++) incrRefCount(claimed[j]);
+        replaceClientCommandVector(c,argc,argv);
+        server.dirty += numclaimed;
+    }
+    zfree(claimed);
+}
+
+/* XINFO STREAM <key>
+ * XINFO GROUPS <key>
+ * XINFO CONSUMERS <key> <group>
+ *
+ * Reply with information about the stream, its consumer groups, or the
+ * consumers of a group. */
+void xinfoCommand(redisClient *c) {
+    char *opt = c->argv[1]->ptr;
+    robj *key = c->argv[2];
+    stream *s;
+    robj *o;
+
+    if ((!strcasecmp(opt,"CONSUMERS") && c->argc != 4) ||
+        (strcasecmp(opt,"CONSUMERS") && c->argc != 3))
+    {
+        addReplyErrorFormat(c,"Unknown XINFO subcommand or wrong number of "
+                              "arguments for '%s'",opt);
+        return;
+    }
+
+    if ((o = lookupKeyReadOrReply(c,key,shared.nokeyerr)) == NULL ||
+        checkType(c,o,REDIS_STREAM)) return;
+    s = o->ptr;
+
+    if (!strcasecmp(opt,"CONSUMERS")) {
+        streamCG *cg = streamLookupCG(s,c->argv[3]->ptr);
+        long long now = mstime();
+        dictIterator *di;
+        dictEntry *de;
+
+        if (cg == NULL) {
+            addReplyNoGroup(c,key,c->argv[3]);
+            return;
+        }
+        addReplyMultiBulkLen(c,dictSize(cg->consumers));
+        di = dictGetIterator(cg->consumers);
+        while((de = dictNext(di)) != NULL) {
+            streamConsumer *consumer = dictGetVal(de);
+
+            addReplyMultiBulkLen(c,6);
+            addReplyBulkCString(c,"name");
+            addReplyBulkCBuffer(c,consumer->name,sdslen(consumer->name));
+            addReplyBulkCString(c,"pending");
+            addReplyLongLong(c,consumer->pel->length);
+            addReplyBulkCString(c,"idle");
+            addReplyLongLong(c,now - consumer->seen_time);
+        }
+        dictReleaseIterator(di);
+    } else if (!strcasecmp(opt,"GROUPS")) {
+        dictIterator *di;
+        dictEntry *de;
+
+        if (s->cgroups == NULL) {
+            addReply(c,shared.emptymultibulk);
+            return;
+        }
+        addReplyMultiBulkLen(c,dictSize(s->cgroups));
+        di = dictGetIterator(s->cgroups);
+        while((de = dictNext(di)) != NULL) {
+            sds name = dictGetKey(de);
+            streamCG *cg = dictGetVal(de);
+
+            addReplyMultiBulkLen(c,8);
+            addReplyBulkCString(c,"name");
+            addReplyBulkCBuffer(c,name,sdslen(name));
+            addReplyBulkCString(c,"consumers");
+            addReplyLongLong(c,dictSize(cg->consumers));
+            addReplyBulkCString(c,"pending");
+            addReplyLongLong(c,cg->pel->length);
+            addReplyBulkCString(c,"last-delivered-id");
+            addReplyStreamID(c,&cg->last_id);
+        }
+        dictReleaseIterator(di);
+    } else if (!strcasecmp(opt,"STREAM")) {
+        addReplyMultiBulkLen(c,12);
+        addReplyBulkCString(c,"length");
+        addReplyLongLong(c,s->length);
+        addReplyBulkCString(c,"blocks");
+        addReplyLongLong(c,s->index->length);
+        addReplyBulkCString(c,"last-generated-id");
+        addReplyStreamID(c,&s->last_id);
+        addReplyBulkCString(c,"groups");
+        addReplyLongLong(c,s->cgroups ? dictSize(s->cgroups) : 0);
+
+        /* To emit the first/last entry we use streamReplyWithRange(). */
+        addReplyBulkCString(c,"first-entry");
+        if (streamReplyWithRange(c,s,NULL,NULL,1,0,NULL,NULL,
+                                 STREAM_RWR_RAWENTRIES) == 0)
+            addReply(c,shared.nullbulk);
+        addReplyBulkCString(c,"last-entry");
+        if (streamReplyWithRange(c,s,NULL,NULL,1,1,NULL,NULL,
+                                 STREAM_RWR_RAWENTRIES) == 0)
+            addReply(c,shared.nullbulk);
+    } else {
+        addReplyErrorFormat(c,"Unknown XINFO subcommand or wrong number of "
+                              "arguments for '%s'",opt);
+    }
+}
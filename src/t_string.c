@@ -175,6 +175,8 @@ int getGenericCommand(redisClient *c) {
         addReply(c,shared.wrongtypeerr);
         return REDIS_ERR;
     } else {
+        // 位图需要先转换为 raw 编码
+        roaringObjectToRaw(o);
         addReplyBulk(c,o);
         return REDIS_OK;
     }
@@ -275,7 +277,7 @@ void setrangeCommand(redisClient *c) {
         // 当 o 是共享对象或者编码对象时，创建它的一个副本
         if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
             robj *decoded = getDecodedObject(o);
-            o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
+            o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
             decrRefCount(decoded);
             dbOverwrite(c->db,c->argv[1],o);
         }
@@ -323,6 +325,7 @@ void getrangeCommand(redisClient *c) {
         checkType(c,o,REDIS_STRING)) return;
 
     // 获取字符串，以及它的长度
+    roaringObjectToRaw(o);
     if (o->encoding == REDIS_ENCODING_INT) {
         str = llbuf;
         strlen = ll2string(llbuf,sizeof(llbuf),(long)o->ptr);
@@ -368,6 +371,7 @@ void mgetCommand(redisClient *c) {
             if (o->type != REDIS_STRING) {
                 addReply(c,shared.nullbulk);
             } else {
+                roaringObjectToRaw(o);
                 addReplyBulk(c,o);
             }
         }
@@ -458,6 +462,7 @@ void incrDecrCommand(redisClient *c, long long incr) {
 
     // 如果 key 非空且 key 类型错误，直接返回
     if (o != NULL && checkType(c,o,REDIS_STRING)) return;
+    if (o != NULL) roaringObjectToRaw(o);
 
     // 如果值不能转换为数字，直接返回
     if (getLongLongFromObjectOrReply(c,o,&value,NULL) != REDIS_OK) return;
@@ -559,6 +564,7 @@ void incrbyfloatCommand(redisClient *c) {
 
     // 如果对象存在且不为字符串类型，直接返回
     if (o != NULL && checkType(c,o,REDIS_STRING)) return;
+    if (o != NULL) roaringObjectToRaw(o);
 
     // 如果对象 o 或者传入增量参数不能转换为浮点数，直接返回
     if (getLongDoubleFromObjectOrReply(c,o,&value,NULL) != REDIS_OK ||
@@ -632,7 +638,7 @@ void appendCommand(redisClient *c) {
         // 如果 key 对象是被共享或未被编码的，那么创建一个副本
         if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
             robj *decoded = getDecodedObject(o);
-            o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
+            o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
             decrRefCount(decoded);
             dbOverwrite(c->db,c->argv[1],o);
         }
@@ -550,7 +550,7 @@ unsigned long zslGetRank(zskiplist *zsl, double score, robj *o) {
     int i;
 
     x = zsl->header;
-    // 遍历 ziplist ，并累积沿途的 span 到 rank ，找到目标元素时返回 rank
+    // 遍历 listpack ，并累积沿途的 span 到 rank ，找到目标元素时返回 rank
     // O(N)
     for (i = zsl->level-1; i >= 0; i--) {
         while (x->level[i].forward &&
@@ -643,12 +643,261 @@ static int zslParseRange(robj *min, robj *max, zrangespec *spec) {
     return REDIS_OK;
 }
 
+/* ------------------------ Lexicographic ranges ---------------------------- */
+
+/* Parse max or min argument of ZRANGEBYLEX.
+ * (foo means foo (open interval)
+ * [foo means foo (closed interval)
+ * - means the min string possible
+ * + means the max string possible
+ *
+ * If the string is valid the *dest pointer is set to the redis object
+ * that will be used for the comparison, and ex will be set to 0 or 1
+ * respectively if the item is exclusive or inclusive. REDIS_OK will be
+ * returned.
+ *
+ * If the string is not a valid range REDIS_ERR is returned, and the value
+ * of *dest and *ex is undefined. */
+/*
+ * 解释 ZRANGEBYLEX 的 min 或者 max 参数：
+ *
+ * (foo 表示开区间， [foo 表示闭区间，
+ * - 表示最小的字符串， + 表示最大的字符串。
+ *
+ * 解释成功时，将用于对比的对象保存到 *dest ，
+ * 将 *ex 设为 1 （开区间）或者 0 （闭区间），并返回 REDIS_OK 。
+ * 参数不合法时返回 REDIS_ERR 。
+ *
+ * T = O(N)
+ */
+int zslParseLexRangeItem(robj *item, robj **dest, int *ex) {
+    char *c = item->ptr;
+
+    if (!sdsEncodedObject(item)) return REDIS_ERR;
+    switch(c[0]) {
+    case '+':
+        if (c[1] != '\0') return REDIS_ERR;
+        *ex = 0;
+        *dest = shared.maxstring;
+        incrRefCount(shared.maxstring);
+        return REDIS_OK;
+    case '-':
+        if (c[1] != '\0') return REDIS_ERR;
+        *ex = 0;
+        *dest = shared.minstring;
+        incrRefCount(shared.minstring);
+        return REDIS_OK;
+    case '(':
+        *ex = 1;
+        *dest = createStringObject(c+1,sdslen(c)-1);
+        return REDIS_OK;
+    case '[':
+        *ex = 0;
+        *dest = createStringObject(c+1,sdslen(c)-1);
+        return REDIS_OK;
+    default:
+        return REDIS_ERR;
+    }
+}
+
+/* Populate the rangespec according to the objects min and max.
+ *
+ * Return REDIS_OK on success. On error REDIS_ERR is returned.
+ * When OK is returned the structure must be freed with zslFreeLexRange(),
+ * otherwise no release is needed. */
+/*
+ * 根据 min 和 max 对象，将字典序范围保存到 spec 上。
+ *
+ * 成功时返回 REDIS_OK ，之后需要用 zslFreeLexRange() 释放 spec ；
+ * 失败时返回 REDIS_ERR ，不需要释放。
+ */
+static int zslParseLexRange(robj *min, robj *max, zlexrangespec *spec) {
+    /* The range can't be valid if objects are integer encoded.
+     * Every item must start with ( or [. */
+    if (min->encoding == REDIS_ENCODING_INT ||
+        max->encoding == REDIS_ENCODING_INT) return REDIS_ERR;
+
+    spec->min = spec->max = NULL;
+    if (zslParseLexRangeItem(min, &spec->min, &spec->minex) == REDIS_ERR ||
+        zslParseLexRangeItem(max, &spec->max, &spec->maxex) == REDIS_ERR) {
+        if (spec->min) decrRefCount(spec->min);
+        if (spec->max) decrRefCount(spec->max);
+        return REDIS_ERR;
+    } else {
+        return REDIS_OK;
+    }
+}
+
+/* Free a lex range structure, must be called only after zslParseLexRange()
+ * populated the structure with success (REDIS_OK returned). */
+/*
+ * 释放 zslParseLexRange() 创建的字典序范围
+ */
+static void zslFreeLexRange(zlexrangespec *spec) {
+    decrRefCount(spec->min);
+    decrRefCount(spec->max);
+}
+
+/* This is just a wrapper to compareStringObjects() that is able to
+ * handle shared.minstring and shared.maxstring as the equivalent of
+ * -inf and +inf for strings */
+/*
+ * compareStringObjects() 的包装，
+ * 将 shared.minstring 和 shared.maxstring 视为字符串的负无穷和正无穷。
+ */
+static int compareStringObjectsForLexRange(robj *a, robj *b) {
+    if (a == b) return 0; /* This makes sure that we handle inf,inf and
+                             -inf,-inf ASAP. One special case less. */
+    if (a == shared.minstring || b == shared.maxstring) return -1;
+    if (a == shared.maxstring || b == shared.minstring) return 1;
+    return compareStringObjects(a,b);
+}
+
+/*
+ * 检查 value 是否大于（或等于） spec 的最小值
+ */
+static int zslLexValueGteMin(robj *value, zlexrangespec *spec) {
+    return spec->minex ?
+        (compareStringObjectsForLexRange(value,spec->min) > 0) :
+        (compareStringObjectsForLexRange(value,spec->min) >= 0);
+}
+
+/*
+ * 检查 value 是否小于（或等于） spec 的最大值
+ */
+static int zslLexValueLteMax(robj *value, zlexrangespec *spec) {
+    return spec->maxex ?
+        (compareStringObjectsForLexRange(value,spec->max) < 0) :
+        (compareStringObjectsForLexRange(value,spec->max) <= 0);
+}
+
+/* Returns if there is a part of the zset is in the lex range. */
+/*
+ * 检查 zset 中是否有元素位于给定的字典序范围之内
+ *
+ * T = O(1)
+ */
+int zslIsInLexRange(zskiplist *zsl, zlexrangespec *range) {
+    zskiplistNode *x;
+
+    int cmp;
+
+    /* Test for ranges that will always be empty. */
+    cmp = compareStringObjectsForLexRange(range->min,range->max);
+    if (cmp > 0 || (cmp == 0 && (range->minex || range->maxex)))
+        return 0;
+    x = zsl->tail;
+    if (x == NULL || !zslLexValueGteMin(x->obj,range))
+        return 0;
+    x = zsl->header->level[0].forward;
+    if (x == NULL || !zslLexValueLteMax(x->obj,range))
+        return 0;
+    return 1;
+}
+
+/* Find the first node that is contained in the specified lex range.
+ * Returns NULL when no element is contained in the range. */
+/*
+ * 找到跳跃表中第一个位于给定字典序范围内的节点
+ *
+ * T_worst = O(N) , T_average = O(log N)
+ */
+zskiplistNode *zslFirstInLexRange(zskiplist *zsl, zlexrangespec range) {
+    zskiplistNode *x;
+    int i;
+
+    /* If everything is out of range, return early. */
+    if (!zslIsInLexRange(zsl,&range)) return NULL;
+
+    x = zsl->header;
+    for (i = zsl->level-1; i >= 0; i--) {
+        /* Go forward while *OUT* of range. */
+        while (x->level[i].forward &&
+            !zslLexValueGteMin(x->level[i].forward->obj,&range))
+                x = x->level[i].forward;
+    }
+
+    /* This is an inner range, so the next node cannot be NULL. */
+    x = x->level[0].forward;
+    redisAssert(x != NULL);
+
+    /* Check if obj <= max. */
+    if (!zslLexValueLteMax(x->obj,&range)) return NULL;
+    return x;
+}
+
+/* Find the last node that is contained in the specified lex range.
+ * Returns NULL when no element is contained in the range. */
+/*
+ * 找到跳跃表中最后一个位于给定字典序范围内的节点
+ *
+ * T_worst = O(N) , T_average = O(log N)
+ */
+zskiplistNode *zslLastInLexRange(zskiplist *zsl, zlexrangespec range) {
+    zskiplistNode *x;
+    int i;
+
+    /* If everything is out of range, return early. */
+    if (!zslIsInLexRange(zsl,&range)) return NULL;
+
+    x = zsl->header;
+    for (i = zsl->level-1; i >= 0; i--) {
+        /* Go forward while *IN* range. */
+        while (x->level[i].forward &&
+            zslLexValueLteMax(x->level[i].forward->obj,&range))
+                x = x->level[i].forward;
+    }
+
+    /* This is an inner range, so this node cannot be NULL. */
+    redisAssert(x != NULL);
+
+    /* Check if obj >= min. */
+    if (!zslLexValueGteMin(x->obj,&range)) return NULL;
+    return x;
+}
+
+/* Delete all the elements with member between min and max from the
+ * skiplist, according to the lex range. */
+/*
+ * 删除跳跃表中所有位于给定字典序范围内的元素
+ *
+ * T = O(log N + M) ， M 为被删除元素的数量
+ */
+unsigned long zslDeleteRangeByLex(zskiplist *zsl, zlexrangespec range, dict *dict) {
+    zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *x;
+    unsigned long removed = 0;
+    int i;
+
+    // 记录沿途的节点
+    x = zsl->header;
+    for (i = zsl->level-1; i >= 0; i--) {
+        while (x->level[i].forward &&
+            !zslLexValueGteMin(x->level[i].forward->obj,&range))
+                x = x->level[i].forward;
+        update[i] = x;
+    }
+
+    /* Current node is the last with obj < or <= min. */
+    x = x->level[0].forward;
+
+    /* Delete nodes while in range. */
+    while (x && zslLexValueLteMax(x->obj,&range)) {
+        zskiplistNode *next = x->level[0].forward;
+        zslDeleteNode(zsl,x,update);
+        dictDelete(dict,x->obj);
+        zslFreeNode(x);
+        removed++;
+        x = next;
+    }
+    return removed;
+}
+
 /*-----------------------------------------------------------------------------
- * Ziplist-backed sorted set API
+ * Listpack-backed sorted set API
  *----------------------------------------------------------------------------*/
 
 /*
- * 取出 sptr 所指向的 ziplist 节点的 score 值
+ * 取出 sptr 所指向的 listpack 节点的 score 值
  *
  * T = O(1)
  */
@@ -660,7 +909,7 @@ double zzlGetScore(unsigned char *sptr) {
     double score;
 
     redisAssert(sptr != NULL);
-    redisAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGetValue(sptr,&vstr,&vlen,&vlong));
     
     if (vstr) {
         // 字符串值
@@ -691,7 +940,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
     unsigned char vbuf[32];
     int minlen, cmp;
 
-    redisAssert(ziplistGet(eptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGetValue(eptr,&vstr,&vlen,&vlong));
     if (vstr == NULL) {
         /* Store string representation of long long in buf. */
         // 如果节点保存的是整数值，
@@ -709,14 +958,14 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
 }
 
 /*
- * 返回 ziplist 表示的有序集的长度
+ * 返回 listpack 表示的有序集的长度
  *
  * T = O(N)
  */
 unsigned int zzlLength(unsigned char *zl) {
-    // 每个有序集用两个 ziplist 节点表示
+    // 每个有序集用两个 listpack 节点表示
     // O(N)
-    return ziplistLen(zl)/2;
+    return lpLength(zl)/2;
 }
 
 /* Move to next entry based on the values in eptr and sptr. Both are set to
@@ -727,7 +976,7 @@ unsigned int zzlLength(unsigned char *zl) {
   * 其中 eptr 指向下个节点的 member 域，
   * sptr 指向下个节点的 score 域。
   *
-  * 当整个 ziplist 遍历完时，返回 NULL
+  * 当整个 listpack 遍历完时，返回 NULL
   *
   * T = O(1)
   */
@@ -736,10 +985,10 @@ void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     redisAssert(*eptr != NULL && *sptr != NULL);
 
     // 指向下一节点的 member 域
-    _eptr = ziplistNext(zl,*sptr);
+    _eptr = lpNext(zl,*sptr);
     if (_eptr != NULL) {
         // 指向下一节点的 score 域
-        _sptr = ziplistNext(zl,_eptr);
+        _sptr = lpNext(zl,_eptr);
         redisAssert(_sptr != NULL);
     } else {
         /* No next entry. */
@@ -766,10 +1015,10 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     redisAssert(*eptr != NULL && *sptr != NULL);
 
     // 指向前一节点的 score 域
-    _sptr = ziplistPrev(zl,*eptr);
+    _sptr = lpPrev(zl,*eptr);
     if (_sptr != NULL) {
         // 指向前一节点的 memeber 域
-        _eptr = ziplistPrev(zl,_sptr);
+        _eptr = lpPrev(zl,_sptr);
         redisAssert(_eptr != NULL);
     } else {
         /* No previous entry. */
@@ -798,7 +1047,7 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
         return 0;
 
     // 取出有序集中最小的 score 值
-    p = ziplistIndex(zl,-1); /* Last score. */
+    p = lpLast(zl); /* Last score. */
     if (p == NULL) return 0; /* Empty sorted set */
     score = zzlGetScore(p);
     // 如果 score 值不位于给定边界之内，返回 0
@@ -806,7 +1055,7 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
         return 0;
 
     // 取出有序集中最大的 score 值
-    p = ziplistIndex(zl,1); /* First score. */
+    p = lpSeek(zl,1); /* First score. */
     redisAssert(p != NULL);
     score = zzlGetScore(p);
     // 如果 score 值不位于给定边界之内，返回 0
@@ -827,7 +1076,7 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
  */
 unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
     // 从表头开始遍历
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpFirst(zl), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
@@ -835,7 +1084,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
 
     // 从表头向表尾遍历
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         // 获取 score 值
@@ -850,7 +1099,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
 
         /* Move to next element. */
         // 后移指针
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     return NULL;
@@ -867,15 +1116,15 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
  */
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec range) {
     // 从表尾开始遍历
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+    unsigned char *eptr = lpSeek(zl,-2), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInRange(zl,&range)) return NULL;
 
-    // 在有序的 ziplist 里从表尾到表头遍历
+    // 在有序的 listpack 里从表尾到表头遍历
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         // 获取节点的 score 值
@@ -891,9 +1140,132 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec range) {
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
         // 前移指针
-        sptr = ziplistPrev(zl,eptr);
+        sptr = lpPrev(zl,eptr);
+        if (sptr != NULL)
+            redisAssert((eptr = lpPrev(zl,sptr)) != NULL);
+        else
+            eptr = NULL;
+    }
+
+    return NULL;
+}
+
+/* Compare the member pointed by 'p' with the lex range item 'item', that
+ * can be shared.minstring or shared.maxstring. */
+/*
+ * 对比 p 所指向的 member 和字典序范围的边界 item
+ */
+static int zzlLexCompare(unsigned char *p, robj *item) {
+    if (item == shared.minstring) return 1;
+    if (item == shared.maxstring) return -1;
+    return zzlCompareElements(p,item->ptr,sdslen(item->ptr));
+}
+
+/*
+ * 检查 p 所指向的 member 是否大于（或等于） spec 的最小值
+ */
+static int zzlLexValueGteMin(unsigned char *p, zlexrangespec *spec) {
+    int cmp = zzlLexCompare(p,spec->min);
+    return spec->minex ? (cmp > 0) : (cmp >= 0);
+}
+
+/*
+ * 检查 p 所指向的 member 是否小于（或等于） spec 的最大值
+ */
+static int zzlLexValueLteMax(unsigned char *p, zlexrangespec *spec) {
+    int cmp = zzlLexCompare(p,spec->max);
+    return spec->maxex ? (cmp < 0) : (cmp <= 0);
+}
+
+/* Returns if there is a part of the zset is in range. Should only be used
+ * internally by zzlFirstInLexRange and zzlLastInLexRange. */
+/*
+ * 检查有序集中是否有元素位于给定的字典序范围之内
+ *
+ * T = O(1)
+ */
+int zzlIsInLexRange(unsigned char *zl, zlexrangespec *range) {
+    unsigned char *p;
+    int cmp;
+
+    /* Test for ranges that will always be empty. */
+    cmp = compareStringObjectsForLexRange(range->min,range->max);
+    if (cmp > 0 || (cmp == 0 && (range->minex || range->maxex)))
+        return 0;
+
+    p = lpSeek(zl,-2); /* Last element. */
+    if (p == NULL) return 0;
+    if (!zzlLexValueGteMin(p,range))
+        return 0;
+
+    p = lpFirst(zl); /* First element. */
+    redisAssert(p != NULL);
+    if (!zzlLexValueLteMax(p,range))
+        return 0;
+
+    return 1;
+}
+
+/* Find pointer to the first element contained in the specified lex range.
+ * Returns NULL when no element is contained in the range. */
+/*
+ * 返回第一个位于给定字典序范围内的节点
+ *
+ * 如果没有节点位于给定范围，返回 NULL 。
+ *
+ * T = O(N)
+ */
+unsigned char *zzlFirstInLexRange(unsigned char *zl, zlexrangespec range) {
+    unsigned char *eptr = lpFirst(zl), *sptr;
+
+    /* If everything is out of range, return early. */
+    if (!zzlIsInLexRange(zl,&range)) return NULL;
+
+    while (eptr != NULL) {
+        if (zzlLexValueGteMin(eptr,&range)) {
+            /* Check if obj <= max. */
+            if (zzlLexValueLteMax(eptr,&range))
+                return eptr;
+            return NULL;
+        }
+
+        /* Move to next element. */
+        sptr = lpNext(zl,eptr); /* This element score. Skip it. */
+        redisAssert(sptr != NULL);
+        eptr = lpNext(zl,sptr); /* Next element. */
+    }
+
+    return NULL;
+}
+
+/* Find pointer to the last element contained in the specified lex range.
+ * Returns NULL when no element is contained in the range. */
+/*
+ * 返回最后一个位于给定字典序范围内的节点
+ *
+ * 如果没有节点位于给定范围，返回 NULL 。
+ *
+ * T = O(N)
+ */
+unsigned char *zzlLastInLexRange(unsigned char *zl, zlexrangespec range) {
+    unsigned char *eptr = lpSeek(zl,-2), *sptr;
+
+    /* If everything is out of range, return early. */
+    if (!zzlIsInLexRange(zl,&range)) return NULL;
+
+    while (eptr != NULL) {
+        if (zzlLexValueLteMax(eptr,&range)) {
+            /* Check if obj >= min. */
+            if (zzlLexValueGteMin(eptr,&range))
+                return eptr;
+            return NULL;
+        }
+
+        /* Move to previous element by moving to the score of previous element.
+         * When this returns NULL, we know there also is no element. */
+        sptr = lpPrev(zl,eptr);
         if (sptr != NULL)
-            redisAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
+            redisAssert((eptr = lpPrev(zl,sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -902,27 +1274,27 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec range) {
 }
 
 /*
- * 在 ziplist 里查找给定元素 ele ，如果找到了，
- * 将元素的点数保存到 score ，并返回该元素在 ziplist 的指针。
+ * 在 listpack 里查找给定元素 ele ，如果找到了，
+ * 将元素的点数保存到 score ，并返回该元素在 listpack 的指针。
  *
  * T = O(N^2)
  */
 unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
 
     // 迭代器
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpFirst(zl), *sptr;
 
     // 解码
     ele = getDecodedObject(ele);
 
-    // 遍历整个 ziplist ， O(N^2)
+    // 遍历整个 listpack ， O(N^2)
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,ele,sptr != NULL);
 
         // 对比元素 ele 的值和 eptr 所保存的值
         // O(N)
-        if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
+        if (lpCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
             /* Matching element, pull out score. */
             // 将匹配元素的指针保存到 score 里
             if (score != NULL) *score = zzlGetScore(sptr);
@@ -934,17 +1306,17 @@ unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     decrRefCount(ele);
     return NULL;
 }
 
-/* Delete (element,score) pair from ziplist. Use local copy of eptr because we
+/* Delete (element,score) pair from listpack. Use local copy of eptr because we
  * don't want to modify the one given as argument. */
 /*
- * 从 ziplist 中删除 element-score 对。
+ * 从 listpack 中删除 element-score 对。
  * 使用一个副本保存 eptr 的值。
  *
  * T = O(N^2)
@@ -952,11 +1324,10 @@ unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
 unsigned char *zzlDelete(unsigned char *zl, unsigned char *eptr) {
     unsigned char *p = eptr;
 
-    /* TODO: add function to ziplist API to delete N elements from offset. */
-    // 删除 member 域 ，O(N^2)
-    zl = ziplistDelete(zl,&p);
-    // 删除 score 域 ，O(N^2)
-    zl = ziplistDelete(zl,&p);
+    // 删除 member 域 ，O(N)
+    zl = lpDelete(zl,p,&p);
+    // 删除 score 域 ，O(N)
+    zl = lpDelete(zl,p,&p);
 
     return zl;
 }
@@ -970,57 +1341,52 @@ unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, robj *ele, do
     unsigned char *sptr;
     char scorebuf[128];
     int scorelen;
-    size_t offset;
 
-    redisAssertWithInfo(NULL,ele,ele->encoding == REDIS_ENCODING_RAW);
+    redisAssertWithInfo(NULL,ele,sdsEncodedObject(ele));
     // 将 score 值转换为字符串
     scorelen = d2string(scorebuf,sizeof(scorebuf),score);
     if (eptr == NULL) {
-        // 插入到 ziplist 的最后, O(N^2)
-        // ziplist 的第一个节点保存有序集的 member
-        zl = ziplistPush(zl,ele->ptr,sdslen(ele->ptr),ZIPLIST_TAIL);
-        // ziplist 的第二个节点保存有序集的 score
-        zl = ziplistPush(zl,(unsigned char*)scorebuf,scorelen,ZIPLIST_TAIL);
+        // 插入到 listpack 的最后
+        // listpack 的第一个节点保存有序集的 member
+        zl = lpAppend(zl,ele->ptr,sdslen(ele->ptr));
+        // listpack 的第二个节点保存有序集的 score
+        zl = lpAppend(zl,(unsigned char*)scorebuf,scorelen);
     } else {
-        // 插入到给定位置, O(N^2)
-        /* Keep offset relative to zl, as it might be re-allocated. */
-        // 记录 ziplist 的相对偏移量（而不是指针），避免内存重分配之后位置丢失
-        offset = eptr-zl;
-        // 保存 member
-        zl = ziplistInsert(zl,eptr,ele->ptr,sdslen(ele->ptr));
-        eptr = zl+offset;
-
-        /* Insert score after the element. */
-        redisAssertWithInfo(NULL,ele,(sptr = ziplistNext(zl,eptr)) != NULL);
+        // 插入到给定位置
+        /* Insert member before the element 'eptr'. */
+        // 保存 member ， sptr 指向新插入的 member
+        zl = lpInsert(zl,ele->ptr,sdslen(ele->ptr),eptr,LP_BEFORE,&sptr);
+
+        /* Insert score after the member. */
         // 保存 score
-        zl = ziplistInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
+        zl = lpInsert(zl,(unsigned char*)scorebuf,scorelen,sptr,LP_AFTER,NULL);
     }
 
     return zl;
 }
 
-/* Insert (element,score) pair in ziplist. This function assumes the element is
+/* Insert (element,score) pair in listpack. This function assumes the element is
  * not yet present in the list. */
 /*
- * 将 ele 成员和它的分值 score 添加到 ziplist 里面
+ * 将 ele 成员和它的分值 score 添加到 listpack 里面
  *
- * ziplist 里的各个节点按 score 值从小到大排列
+ * listpack 里的各个节点按 score 值从小到大排列
  *
  * 这个函数假设 elem 不存在于有序集
  *
  * T = O(N^2)
  */
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
-    // 指向 ziplist 第一个节点（也即是有序集的 member 域）
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    // 指向 listpack 第一个节点（也即是有序集的 member 域）
+    unsigned char *eptr = lpFirst(zl), *sptr;
     double s;
 
     // 解码值
     ele = getDecodedObject(ele);
-    // 遍历整个 ziplist
+    // 遍历整个 listpack
     while (eptr != NULL) {
         // 指向 score 域
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,ele,sptr != NULL);
         // 取出 score 值
         s = zzlGetScore(sptr);
@@ -1031,7 +1397,7 @@ unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
              * maintain ordering. */
             // 遇到第一个 score 值比输入 score 大的节点
             // 将新节点插入在这个节点的前面，
-            // 让节点在 ziplist 里根据 score 从小到大排列
+            // 让节点在 listpack 里根据 score 从小到大排列
             // O(N^2)
             zl = zzlInsertAt(zl,eptr,ele,score);
             break;
@@ -1049,12 +1415,12 @@ unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
         /* Move to next element. */
         // 输入 score 比节点的 score 值要大
         // 移动到下一个节点
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     /* Push on tail of list when it was not yet inserted. */
     // 如果有序集里目前没有一个节点的 score 值比输入 score 大
-    // 那么将新节点添加到 ziplist 的最后
+    // 那么将新节点添加到 listpack 的最后
     if (eptr == NULL)
         // O(N^2)
         zl = zzlInsertAt(zl,NULL,ele,score);
@@ -1079,18 +1445,18 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec range, unsign
     eptr = zzlFirstInRange(zl,range);
     if (eptr == NULL) return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
+    /* When the tail of the listpack is deleted, eptr will be set to NULL
+     * by lpDelete(). */
     // 一直进行删除，直到碰到 score 值比 range->max 更大的节点为止
-    // O(N^3)
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
+    // O(N^2)
+    while (eptr && (sptr = lpNext(zl,eptr)) != NULL) {
         score = zzlGetScore(sptr);
         if (zslValueLteMax(score,&range)) {
             /* Delete both the element and the score. */
-            // O(N^2)
-            zl = ziplistDelete(zl,&eptr);
-            // O(N^2)
-            zl = ziplistDelete(zl,&eptr);
+            // O(N)
+            zl = lpDelete(zl,eptr,&eptr);
+            // O(N)
+            zl = lpDelete(zl,eptr,&eptr);
             num++;
         } else {
             /* No longer in range. */
@@ -1102,6 +1468,33 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec range, unsign
     return zl;
 }
 
+/*
+ * 删除给定字典序范围内的节点
+ *
+ * T = O(N)
+ */
+unsigned char *zzlDeleteRangeByLex(unsigned char *zl, zlexrangespec range, unsigned long *deleted) {
+    unsigned char *eptr;
+    unsigned long num = 0;
+
+    if (deleted != NULL) *deleted = 0;
+
+    eptr = zzlFirstInLexRange(zl,range);
+    if (eptr == NULL) return zl;
+
+    /* When the tail of the listpack is deleted, eptr will be set to NULL
+     * by lpDelete(). */
+    while (eptr && zzlLexValueLteMax(eptr,&range)) {
+        /* Delete both the element and the score. */
+        zl = lpDelete(zl,eptr,&eptr);
+        zl = lpDelete(zl,eptr,&eptr);
+        num++;
+    }
+
+    if (deleted != NULL) *deleted = num;
+    return zl;
+}
+
 /* Delete all the elements with rank between start and end from the skiplist.
  * Start and end are inclusive. Note that start and end need to be 1-based */
 /*
@@ -1114,7 +1507,7 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
     unsigned int num = (end-start)+1;
     if (deleted) *deleted = num;
     // 删除
-    zl = ziplistDeleteRange(zl,2*(start-1),2*num);
+    zl = lpDeleteRange(zl,2*(start-1),2*num);
     return zl;
 }
 
@@ -1130,7 +1523,7 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
 unsigned int zsetLength(robj *zobj) {
     int length = -1;
     // O(N)
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         length = zzlLength(zobj->ptr);
     // O(1)
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
@@ -1155,8 +1548,8 @@ void zsetConvert(robj *zobj, int encoding) {
     // 编码相同，无须转换
     if (zobj->encoding == encoding) return;
 
-    // 将 ziplist 编码转换成 skiplist 编码
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // 将 listpack 编码转换成 skiplist 编码
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -1172,19 +1565,19 @@ void zsetConvert(robj *zobj, int encoding) {
         zs->zsl = zslCreate();
 
         // 指向第一个节点的 member 域
-        eptr = ziplistIndex(zl,0);
+        eptr = lpFirst(zl);
         redisAssertWithInfo(NULL,zobj,eptr != NULL);
         // 指向第一个节点的 score 域
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,zobj,sptr != NULL);
 
-        // 遍历整个 ziplist ，将它的 member 和 score 添加到 zset
+        // 遍历整个 listpack ，将它的 member 和 score 添加到 zset
         // O(N^2)
         while (eptr != NULL) {
             // 取出 score 值
             score = zzlGetScore(sptr);
             // 取出 member 值
-            redisAssertWithInfo(NULL,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(NULL,zobj,lpGetValue(eptr,&vstr,&vlen,&vlong));
 
             // 为 member 值创建 robj 对象
             if (vstr == NULL)
@@ -1209,15 +1602,15 @@ void zsetConvert(robj *zobj, int encoding) {
         zobj->ptr = zs;
         zobj->encoding = REDIS_ENCODING_SKIPLIST;
 
-    // 将 skiplist 转换为 ziplist
+    // 将 skiplist 转换为 listpack
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
-        unsigned char *zl = ziplistNew();
+        unsigned char *zl = lpNew();
 
-        if (encoding != REDIS_ENCODING_ZIPLIST)
+        if (encoding != REDIS_ENCODING_LISTPACK)
             redisPanic("Unknown target encoding");
 
         /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
+         * the same time as creating the listpack. */
         zs = zobj->ptr;
         // 释放整个字典
         dictRelease(zs->dict);
@@ -1227,11 +1620,11 @@ void zsetConvert(robj *zobj, int encoding) {
         zfree(zs->zsl->header);
         zfree(zs->zsl);
 
-        // 将所有元素保存到 ziplist , O(N^3)
+        // 将所有元素保存到 listpack , O(N^3)
         while (node) {
             // 取出解码后的 member
             ele = getDecodedObject(node->obj);
-            // 插入 member 和 score 到 ziplist, O(N^2)
+            // 插入 member 和 score 到 listpack, O(N^2)
             zl = zzlInsertAt(zl,NULL,ele,node->score);
             decrRefCount(ele);
 
@@ -1242,7 +1635,7 @@ void zsetConvert(robj *zobj, int encoding) {
 
         zfree(zs);
         zobj->ptr = zl;
-        zobj->encoding = REDIS_ENCODING_ZIPLIST;
+        zobj->encoding = REDIS_ENCODING_LISTPACK;
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -1302,9 +1695,9 @@ void zaddGenericCommand(redisClient *c, int incr) {
             server.zset_max_ziplist_value < sdslen(c->argv[3]->ptr))
         {
             zobj = createZsetObject();
-        // 创建 ziplist 编码的 zset
+        // 创建 listpack 编码的 zset
         } else {
-            zobj = createZsetZiplistObject();
+            zobj = createZsetListpackObject();
         }
 
         // 添加新有序集到 db
@@ -1323,11 +1716,11 @@ void zaddGenericCommand(redisClient *c, int incr) {
     for (j = 0; j < elements; j++) {
         score = scores[j];
 
-        // 添加元素到 ziplist 编码的有序集, O(N^3)
-        if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+        // 添加元素到 listpack 编码的有序集, O(N^3)
+        if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
             unsigned char *eptr;
 
-            /* Prefer non-encoded element when dealing with ziplists. */
+            /* Prefer non-encoded element when dealing with listpacks. */
             // 获取元素
             ele = c->argv[3+j*2];
             // 如果元素存在，那么取出它
@@ -1361,11 +1754,11 @@ void zaddGenericCommand(redisClient *c, int incr) {
             } else {
                 /* Optimize: check if the element is too large or the list
                  * becomes too long *before* executing zzlInsert. */
-                // 添加元素到 ziplist
+                // 添加元素到 listpack
                 // O(N^2)
                 zobj->ptr = zzlInsert(zobj->ptr,ele,score);
 
-                // 如果有需要，将 ziplist 转换为 skiplist 编码
+                // 如果有需要，将 listpack 转换为 skiplist 编码
                 if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries)
                     // O(N^3)
                     zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
@@ -1414,7 +1807,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 /* Remove and re-insert when score changed. We can safely
                  * delete the key object from the skiplist, since the
                  * dictionary still has a reference to it. */
-                // 新旧 score 值不同，先将旧元素（和分值）删除，再重新添加到 ziplist
+                // 新旧 score 值不同，先将旧元素（和分值）删除，再重新添加到 listpack
                 if (score != curscore) {
                     // 删除 zset 旧节点, O(N)
                     redisAssertWithInfo(c,curobj,zslDelete(zs->zsl,curscore,curobj));
@@ -1482,8 +1875,8 @@ void zremCommand(redisClient *c) {
     if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    // ziplist
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *eptr;
 
         // O(N^3)
@@ -1566,11 +1959,11 @@ void zremrangebyscoreCommand(redisClient *c) {
     if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    // ziplist
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         // O(N^3)
         zobj->ptr = zzlDeleteRangeByScore(zobj->ptr,range,&deleted);
-        // 删除空 ziplist
+        // 删除空 listpack
         if (zzlLength(zobj->ptr) == 0) dbDelete(c->db,key);
     // skiplist
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
@@ -1591,6 +1984,55 @@ void zremrangebyscoreCommand(redisClient *c) {
     addReplyLongLong(c,deleted);
 }
 
+/*
+ * 多态地移除给定字典序范围内的元素
+ *
+ * T = O(log N + M) ， M 为被删除元素的数量
+ */
+void zremrangebylexCommand(redisClient *c) {
+    robj *key = c->argv[1];
+    robj *zobj;
+    zlexrangespec range;
+    unsigned long deleted;
+
+    /* Parse the range arguments. */
+    if (zslParseLexRange(c->argv[2],c->argv[3],&range) != REDIS_OK) {
+        addReplyError(c,"min or max not valid string range item");
+        return;
+    }
+
+    // 查找 key ，检查类型
+    if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
+        checkType(c,zobj,REDIS_ZSET))
+    {
+        zslFreeLexRange(&range);
+        return;
+    }
+
+    // listpack
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        zobj->ptr = zzlDeleteRangeByLex(zobj->ptr,range,&deleted);
+        // 删除空 listpack
+        if (zzlLength(zobj->ptr) == 0) dbDelete(c->db,key);
+    // skiplist
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = zobj->ptr;
+        deleted = zslDeleteRangeByLex(zs->zsl,range,zs->dict);
+        // 紧缩空间
+        if (htNeedsResize(zs->dict)) dictResize(zs->dict);
+        // 删除空字典
+        if (dictSize(zs->dict) == 0) dbDelete(c->db,key);
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+
+    zslFreeLexRange(&range);
+    if (deleted) signalModifiedKey(c->db,key);
+
+    server.dirty += deleted;
+    addReplyLongLong(c,deleted);
+}
+
 /*
  * 删除给定排序范围内的所有元素
  *
@@ -1625,8 +2067,8 @@ void zremrangebyrankCommand(redisClient *c) {
     }
     if (end >= llen) end = llen-1;
 
-    // ziplist
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         /* Correct for 1-based rank. */
         // O(N^2)
         zobj->ptr = zzlDeleteRangeByRank(zobj->ptr,start+1,end+1,&deleted);
@@ -1680,7 +2122,7 @@ typedef struct {
         /* Sorted set iterators. */
         // 有序集迭代器
         union _iterzset {
-            // ziplist 编码
+            // listpack 编码
             struct {
                 unsigned char *zl;
                 unsigned char *eptr, *sptr;
@@ -1745,11 +2187,11 @@ void zuiInitIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             it->zl.zl = op->subject->ptr;
-            it->zl.eptr = ziplistIndex(it->zl.zl,0);
+            it->zl.eptr = lpFirst(it->zl.zl);
             if (it->zl.eptr != NULL) {
-                it->zl.sptr = ziplistNext(it->zl.zl,it->zl.eptr);
+                it->zl.sptr = lpNext(it->zl.zl,it->zl.eptr);
                 redisAssert(it->zl.sptr != NULL);
             }
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
@@ -1781,7 +2223,7 @@ void zuiClearIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             REDIS_NOTUSED(it); /* skip */
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             REDIS_NOTUSED(it); /* skip */
@@ -1811,7 +2253,7 @@ int zuiLength(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             return zzlLength(it->zl.zl);
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             return it->sl.zs->zsl->length;
@@ -1879,13 +2321,13 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
     // 输入是有序集
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        // ziplist 编码, O(N)
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        // listpack 编码, O(N)
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             /* No need to check both, but better be explicit. */
             if (it->zl.eptr == NULL || it->zl.sptr == NULL)
                 return 0;
             // 取出 member
-            redisAssert(ziplistGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
+            redisAssert(lpGetValue(it->zl.eptr,&val->estr,&val->elen,&val->ell));
             // 取出 score
             val->score = zzlGetScore(it->zl.sptr);
 
@@ -1929,7 +2371,7 @@ int zuiLongLongFromValue(zsetopval *val) {
                 val->ell = (long)val->ele->ptr;
                 val->flags |= OPVAL_VALID_LL;
             // 从 sds 里取出
-            } else if (val->ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(val->ele)) {
                 if (string2ll(val->ele->ptr,sdslen(val->ele->ptr),&val->ell))
                     val->flags |= OPVAL_VALID_LL;
             } else {
@@ -1975,7 +2417,7 @@ int zuiBufferFromValue(zsetopval *val) {
             if (val->ele->encoding == REDIS_ENCODING_INT) {
                 val->elen = ll2string((char*)val->_buf,sizeof(val->_buf),(long)val->ele->ptr);
                 val->estr = val->_buf;
-            } else if (val->ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(val->ele)) {
                 val->elen = sdslen(val->ele->ptr);
                 val->estr = val->ele->ptr;
             } else {
@@ -2029,7 +2471,7 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
         iterzset *it = &op->iter.zset;
         zuiObjectFromValue(val);
 
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             // O(N)
             if (zzlFind(it->zl.zl,val->ele,score) != NULL) {
                 /* Score is already set by zzlFind. */
@@ -2253,7 +2695,7 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                     dictAdd(dstzset->dict,tmp,&znode->score);
                     incrRefCount(tmp); /* added to dictionary */
 
-                    if (tmp->encoding == REDIS_ENCODING_RAW)
+                    if (sdsEncodedObject(tmp))
                         if (sdslen(tmp->ptr) > maxelelen)
                             maxelelen = sdslen(tmp->ptr);
                 }
@@ -2308,7 +2750,7 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 dictAdd(dstzset->dict,tmp,&znode->score);
                 incrRefCount(zval.ele); /* added to dictionary */
 
-                if (tmp->encoding == REDIS_ENCODING_RAW)
+                if (sdsEncodedObject(tmp))
                     if (sdslen(tmp->ptr) > maxelelen)
                         maxelelen = sdslen(tmp->ptr);
             }
@@ -2330,10 +2772,10 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
 
     // 保存聚合结果到 dstkey
     if (dstzset->zsl->length) {
-        /* Convert to ziplist when in limits. */
+        /* Convert to listpack when in limits. */
         if (dstzset->zsl->length <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(dstobj,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(dstobj,REDIS_ENCODING_LISTPACK);
 
         dbAdd(c->db,dstkey,dstobj);
         addReplyLongLong(c,zsetLength(dstobj));
@@ -2399,8 +2841,8 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c, withscores ? (rangelen*2) : rangelen);
 
-    // ziplist 编码, O(N)
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    // listpack 编码, O(N)
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -2411,20 +2853,20 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
         // 并指向第一个 member
         // O(1)
         if (reverse)
-            eptr = ziplistIndex(zl,-2-(2*start));
+            eptr = lpSeek(zl,-2-(2*start));
         else
-            eptr = ziplistIndex(zl,2*start);
+            eptr = lpSeek(zl,2*start);
 
         redisAssertWithInfo(c,zobj,eptr != NULL);
         // 指向第一个 score
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         // 取出元素, O(N)
         while (rangelen--) {
             // 元素不为空？
             redisAssertWithInfo(c,zobj,eptr != NULL && sptr != NULL);
             // 取出 member 
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(c,zobj,lpGetValue(eptr,&vstr,&vlen,&vlong));
             if (vstr == NULL)
                 addReplyBulkLongLong(c,vlong);
             else
@@ -2545,7 +2987,7 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
         checkType(c,zobj,REDIS_ZSET)) return;
 
     // O(N)
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -2569,7 +3011,7 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
 
         /* Get score pointer for the first element. */
         redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
@@ -2599,9 +3041,9 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
                 if (!zslValueLteMax(score,&range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always succeed */
+            /* We know the element exists, so lpGetValue should always succeed */
             // 取出 member
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(c,zobj,lpGetValue(eptr,&vstr,&vlen,&vlong));
 
             rangelen++;
             if (vstr == NULL) {
@@ -2727,7 +3169,7 @@ void zcountCommand(redisClient *c) {
         checkType(c, zobj, REDIS_ZSET)) return;
 
     // O(N)
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         double score;
@@ -2745,7 +3187,7 @@ void zcountCommand(redisClient *c) {
 
         /* First element is in range */
         // 指向 score 域
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         // 取出 score 值
         score = zzlGetScore(sptr);
         redisAssertWithInfo(c,zobj,zslValueLteMax(score,&range));
@@ -2798,55 +3240,338 @@ void zcountCommand(redisClient *c) {
 }
 
 /*
- * 返回有序集的基数
+ * 返回有序集在给定字典序范围内的元素数量
  *
- * T = O(N)
+ * T = O(log N) 或者 O(N)（listpack）
  */
-void zcardCommand(redisClient *c) {
+void zlexcountCommand(redisClient *c) {
     robj *key = c->argv[1];
     robj *zobj;
+    zlexrangespec range;
+    int count = 0;
 
-    if ((zobj = lookupKeyReadOrReply(c,key,shared.czero)) == NULL ||
-        checkType(c,zobj,REDIS_ZSET)) return;
+    /* Parse the range arguments */
+    if (zslParseLexRange(c->argv[2],c->argv[3],&range) != REDIS_OK) {
+        addReplyError(c,"min or max not valid string range item");
+        return;
+    }
 
-    addReplyLongLong(c,zsetLength(zobj));
+    /* Lookup the sorted set */
+    if ((zobj = lookupKeyReadOrReply(c, key, shared.czero)) == NULL ||
+        checkType(c, zobj, REDIS_ZSET))
+    {
+        zslFreeLexRange(&range);
+        return;
+    }
+
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *zl = zobj->ptr;
+        unsigned char *eptr, *sptr;
+
+        /* Use the first element in range as the starting point */
+        eptr = zzlFirstInLexRange(zl,range);
+
+        /* No "first" element */
+        if (eptr == NULL) {
+            zslFreeLexRange(&range);
+            addReply(c, shared.czero);
+            return;
+        }
+
+        /* First element is in range */
+        sptr = lpNext(zl,eptr);
+        redisAssertWithInfo(c,zobj,zzlLexValueLteMax(eptr,&range));
+
+        /* Iterate over elements in range */
+        while (eptr) {
+            /* Abort when the node is no longer in range. */
+            if (!zzlLexValueLteMax(eptr,&range)) {
+                break;
+            } else {
+                count++;
+                zzlNext(zl,&eptr,&sptr);
+            }
+        }
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = zobj->ptr;
+        zskiplist *zsl = zs->zsl;
+        zskiplistNode *zn;
+        unsigned long rank;
+
+        /* Find first element in range */
+        zn = zslFirstInLexRange(zsl, range);
+
+        /* Use rank of first element, if any, to determine preliminary count */
+        if (zn != NULL) {
+            rank = zslGetRank(zsl, zn->score, zn->obj);
+            count = (zsl->length - (rank - 1));
+
+            /* Find last element in range */
+            zn = zslLastInLexRange(zsl, range);
+
+            /* Use rank of last element, if any, to determine the actual count */
+            if (zn != NULL) {
+                rank = zslGetRank(zsl, zn->score, zn->obj);
+                count -= (zsl->length - rank);
+            }
+        }
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+
+    zslFreeLexRange(&range);
+    addReplyLongLong(c, count);
 }
 
+/* This command implements ZRANGEBYLEX, ZREVRANGEBYLEX. */
 /*
- * 找出给定元素的 score 值
+ * T = O(log N + M) ， M 为返回元素的数量
+ */
+void genericZrangebylexCommand(redisClient *c, int reverse) {
+    zlexrangespec range;
+    robj *key = c->argv[1];
+    robj *zobj;
+    long offset = 0, limit = -1;
+    unsigned long rangelen = 0;
+    void *replylen = NULL;
+    int minidx, maxidx;
+
+    /* Parse the range arguments. */
+    if (reverse) {
+        /* Range is given as [max,min] */
+        maxidx = 2; minidx = 3;
+    } else {
+        /* Range is given as [min,max] */
+        minidx = 2; maxidx = 3;
+    }
+
+    if (zslParseLexRange(c->argv[minidx],c->argv[maxidx],&range) != REDIS_OK) {
+        addReplyError(c,"min or max not valid string range item");
+        return;
+    }
+
+    /* Parse optional extra arguments. Note that ZCOUNT will exactly have
+     * 4 arguments, so we'll never enter the following code path. */
+    if (c->argc > 4) {
+        int remaining = c->argc - 4;
+        int pos = 4;
+
+        while (remaining) {
+            if (remaining >= 3 && !strcasecmp(c->argv[pos]->ptr,"limit")) {
+                if ((getLongFromObjectOrReply(c, c->argv[pos+1], &offset, NULL) != REDIS_OK) ||
+                    (getLongFromObjectOrReply(c, c->argv[pos+2], &limit, NULL) != REDIS_OK)) {
+                    zslFreeLexRange(&range);
+                    return;
+                }
+                pos += 3; remaining -= 3;
+            } else {
+                zslFreeLexRange(&range);
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+        }
+    }
+
+    /* Ok, lookup the key and get the range */
+    if ((zobj = lookupKeyReadOrReply(c,key,shared.emptymultibulk)) == NULL ||
+        checkType(c,zobj,REDIS_ZSET))
+    {
+        zslFreeLexRange(&range);
+        return;
+    }
+
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
+        unsigned char *zl = zobj->ptr;
+        unsigned char *eptr, *sptr;
+        unsigned char *vstr;
+        unsigned int vlen;
+        long long vlong;
+
+        /* If reversed, get the last node in range as starting point. */
+        if (reverse) {
+            eptr = zzlLastInLexRange(zl,range);
+        } else {
+            eptr = zzlFirstInLexRange(zl,range);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (eptr == NULL) {
+            addReply(c, shared.emptymultibulk);
+            zslFreeLexRange(&range);
+            return;
+        }
+
+        /* Get score pointer for the first element. */
+        redisAssertWithInfo(c,zobj,eptr != NULL);
+        sptr = lpNext(zl,eptr);
+
+        /* We don't know in advance how many matching elements there are in the
+         * list, so we push this object that will represent the multi-bulk
+         * length in the output buffer, and will "fix" it later */
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* If there is an offset, just traverse the number of elements without
+         * checking the score because that is done in the next loop. */
+        while (eptr && offset--) {
+            if (reverse) {
+                zzlPrev(zl,&eptr,&sptr);
+            } else {
+                zzlNext(zl,&eptr,&sptr);
+            }
+        }
+
+        while (eptr && limit--) {
+            /* Abort when the node is no longer in range. */
+            if (reverse) {
+                if (!zzlLexValueGteMin(eptr,&range)) break;
+            } else {
+                if (!zzlLexValueLteMax(eptr,&range)) break;
+            }
+
+            /* We know the element exists, so lpGetValue should always
+             * succeed. */
+            redisAssertWithInfo(c,zobj,lpGetValue(eptr,&vstr,&vlen,&vlong));
+
+            rangelen++;
+            if (vstr == NULL) {
+                addReplyBulkLongLong(c,vlong);
+            } else {
+                addReplyBulkCBuffer(c,vstr,vlen);
+            }
+
+            /* Move to next node */
+            if (reverse) {
+                zzlPrev(zl,&eptr,&sptr);
+            } else {
+                zzlNext(zl,&eptr,&sptr);
+            }
+        }
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zset *zs = zobj->ptr;
+        zskiplist *zsl = zs->zsl;
+        zskiplistNode *ln;
+
+        /* If reversed, get the last node in range as starting point. */
+        if (reverse) {
+            ln = zslLastInLexRange(zsl,range);
+        } else {
+            ln = zslFirstInLexRange(zsl,range);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (ln == NULL) {
+            addReply(c, shared.emptymultibulk);
+            zslFreeLexRange(&range);
+            return;
+        }
+
+        /* We don't know in advance how many matching elements there are in the
+         * list, so we push this object that will represent the multi-bulk
+         * length in the output buffer, and will "fix" it later */
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* If there is an offset, just traverse the number of elements without
+         * checking the score because that is done in the next loop. */
+        while (ln && offset--) {
+            if (reverse) {
+                ln = ln->backward;
+            } else {
+                ln = ln->level[0].forward;
+            }
+        }
+
+        while (ln && limit--) {
+            /* Abort when the node is no longer in range. */
+            if (reverse) {
+                if (!zslLexValueGteMin(ln->obj,&range)) break;
+            } else {
+                if (!zslLexValueLteMax(ln->obj,&range)) break;
+            }
+
+            rangelen++;
+            addReplyBulk(c,ln->obj);
+
+            /* Move to next node */
+            if (reverse) {
+                ln = ln->backward;
+            } else {
+                ln = ln->level[0].forward;
+            }
+        }
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+
+    zslFreeLexRange(&range);
+    setDeferredMultiBulkLength(c, replylen, rangelen);
+}
+
+void zrangebylexCommand(redisClient *c) {
+    genericZrangebylexCommand(c,0);
+}
+
+void zrevrangebylexCommand(redisClient *c) {
+    genericZrangebylexCommand(c,1);
+}
+
+/*
+ * 返回有序集的基数
  *
  * T = O(N)
  */
-void zscoreCommand(redisClient *c) {
+void zcardCommand(redisClient *c) {
     robj *key = c->argv[1];
     robj *zobj;
-    double score;
 
-    if ((zobj = lookupKeyReadOrReply(c,key,shared.nullbulk)) == NULL ||
+    if ((zobj = lookupKeyReadOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    addReplyLongLong(c,zsetLength(zobj));
+}
+
+/* Store the score of 'member' in '*score'. Returns REDIS_OK if the member
+ * exists, REDIS_ERR otherwise.
+ *
+ * 将 member 的 score 值保存到 *score 中。
+ * 成员存在时返回 REDIS_OK ，否则返回 REDIS_ERR 。
+ *
+ * T = O(N)
+ */
+int zsetScore(robj *zobj, robj *member, double *score) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         // O(N)
-        if (zzlFind(zobj->ptr,c->argv[2],&score) != NULL)
-            addReplyDouble(c,score);
-        else
-            addReply(c,shared.nullbulk);
+        if (zzlFind(zobj->ptr,member,score) == NULL) return REDIS_ERR;
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         zset *zs = zobj->ptr;
         dictEntry *de;
 
         // O(1)
-        c->argv[2] = tryObjectEncoding(c->argv[2]);
-        de = dictFind(zs->dict,c->argv[2]);
-        if (de != NULL) {
-            score = *(double*)dictGetVal(de);
-            addReplyDouble(c,score);
-        } else {
-            addReply(c,shared.nullbulk);
-        }
+        de = dictFind(zs->dict,member);
+        if (de == NULL) return REDIS_ERR;
+        *score = *(double*)dictGetVal(de);
     } else {
         redisPanic("Unknown sorted set encoding");
     }
+    return REDIS_OK;
+}
+
+/*
+ * 找出给定元素的 score 值
+ *
+ * T = O(N)
+ */
+void zscoreCommand(redisClient *c) {
+    robj *key = c->argv[1];
+    robj *zobj;
+    double score;
+
+    if ((zobj = lookupKeyReadOrReply(c,key,shared.nullbulk)) == NULL ||
+        checkType(c,zobj,REDIS_ZSET)) return;
+
+    if (zsetScore(zobj,c->argv[2],&score) == REDIS_OK)
+        addReplyDouble(c,score);
+    else
+        addReply(c,shared.nullbulk);
 }
 
 /*
@@ -2865,20 +3590,20 @@ void zrankGenericCommand(redisClient *c, int reverse) {
         checkType(c,zobj,REDIS_ZSET)) return;
     llen = zsetLength(zobj);
 
-    redisAssertWithInfo(c,ele,ele->encoding == REDIS_ENCODING_RAW);
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    redisAssertWithInfo(c,ele,sdsEncodedObject(ele));
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpFirst(zl);
         redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(c,zobj,sptr != NULL);
 
         // 遍历指针，一路计算越过的节点数量
         rank = 1;
         while(eptr != NULL) {
-            if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr)))
+            if (lpCompare(eptr,ele->ptr,sdslen(ele->ptr)))
                 break;
             rank++;
             zzlNext(zl,&eptr,&sptr);
@@ -2925,3 +3650,16 @@ void zrankCommand(redisClient *c) {
 void zrevrankCommand(redisClient *c) {
     zrankGenericCommand(c, 1);
 }
+
+/*
+ * ZSCAN 命令的实现
+ */
+void zscanCommand(redisClient *c) {
+    robj *o;
+    unsigned long cursor;
+
+    if (parseScanCursorOrReply(c,c->argv[2],&cursor) == REDIS_ERR) return;
+    if ((o = lookupKeyReadOrReply(c,c->argv[1],shared.emptyscan)) == NULL ||
+        checkType(c,o,REDIS_ZSET)) return;
+    scanGenericCommand(c,o,cursor);
+}
@@ -30,6 +30,9 @@
 #ifndef __REDIS_UTIL_H
 #define __REDIS_UTIL_H
 
+/* Bytes needed for long -> str + '\0' */
+#define LONG_STR_SIZE 21
+
 int stringmatchlen(const char *p, int plen, const char *s, int slen, int nocase);
 int stringmatch(const char *p, const char *s, int nocase);
 long long memtoll(const char *p, int *err);
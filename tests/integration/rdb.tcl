@@ -21,5 +21,13 @@ start_server [list overrides [list "dir" $server_path "dbfilename" "encodings.rd
 "zset","zset","a","1","b","2","c","3","aa","10","bb","20","cc","30","aaa","100","bbb","200","ccc","300","aaaa","1000","cccc","123456789","bbbb","5000000000",
 "zset_zipped","zset","a","1","b","2","c","3",
 }
+
+  test "RDB load ziplist hash and zset: converts to listpack" {
+    r select 0
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    assert_equal {1 2 3} [r hmget hash_zipped a b c]
+    assert_equal {a 1 b 2 c 3} [r zrange zset_zipped 0 -1 withscores]
+  }
 }
 
@@ -0,0 +1,69 @@
+proc start_write_load {host port seconds} {
+    exec tclsh8.5 tests/helpers/gen_write_load.tcl $host $port $seconds &
+}
+
+proc stop_write_load {handle} {
+    catch {exec /bin/kill -9 $handle}
+}
+
+# Return the ip:port of the first slave attached to the master 'r'
+proc slave_addr r {
+    foreach line [split [$r client list] "\n"] {
+        if {[string match {*flags=S*} $line]} {
+            regexp {addr=([^ ]+)} $line - addr
+            return $addr
+        }
+    }
+    return {}
+}
+
+start_server {tags {"repl"}} {
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set slave [srv 0 client]
+
+        $master config set repl-backlog-size 100000000
+        set load_handle [start_write_load $master_host $master_port 10]
+
+        test {Slave should be able to sync with master using PSYNC} {
+            $slave slaveof $master_host $master_port
+            wait_for_sync $slave
+            after 1000
+            list [status $master sync_full] [status $master repl_backlog_active]
+        } {1 1}
+
+        test {Master link drop is recovered with a partial resync} {
+            for {set j 1} {$j <= 3} {incr j} {
+                $master client kill [slave_addr $master]
+                set retry 50
+                while {$retry && [status $master sync_partial_ok] != $j} {
+                    after 100
+                    incr retry -1
+                }
+                wait_for_sync $slave
+            }
+            list [status $master sync_full] [status $master sync_partial_ok]
+        } {1 3}
+
+        test {MASTER and SLAVE dataset should be identical after partial resyncs} {
+            stop_write_load $load_handle
+            set retry 10
+            while {$retry && ([$master debug digest] ne [$slave debug digest])}\
+            {
+                after 1000
+                incr retry -1
+            }
+            assert {[$master dbsize] > 0}
+            assert_equal [$master debug digest] [$slave debug digest]
+        }
+
+        test {Slave acknowledges the master replication offset} {
+            after 2000
+            set offset [status $master master_repl_offset]
+            assert {$offset > 0}
+            assert_equal $offset [status $slave slave_repl_offset]
+        }
+    }
+}
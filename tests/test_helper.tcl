@@ -15,12 +15,14 @@ set ::all_tests {
     unit/auth
     unit/protocol
     unit/basic
+    unit/scan
     unit/type/list
     unit/type/list-2
     unit/type/list-3
     unit/type/set
     unit/type/zset
     unit/type/hash
+    unit/type/stream
     unit/sort
     unit/expire
     unit/other
@@ -31,6 +33,7 @@ set ::all_tests {
     integration/replication-2
     integration/replication-3
     integration/replication-4
+    integration/replication-psync
     integration/aof
     integration/rdb
     integration/convert-zipmap-hash-on-load
@@ -38,10 +41,14 @@ set ::all_tests {
     unit/slowlog
     unit/scripting
     unit/maxmemory
+    unit/lazyfree
+    unit/threaded-io
     unit/introspection
     unit/limits
     unit/obuf-limits
     unit/bitops
+    unit/hyperloglog
+    unit/geo
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -662,6 +662,31 @@ start_server {tags {"basic"}} {
         assert_equal "1234\0002" [r get mykey]
     }
 
+    test "Short strings are embstr encoded, long ones raw" {
+        r set mykey [string repeat x 44]
+        assert_encoding embstr mykey
+        r set mykey [string repeat x 45]
+        assert_encoding raw mykey
+    }
+
+    test "APPEND and SETRANGE convert embstr strings to raw" {
+        r set mykey foo
+        assert_encoding embstr mykey
+        assert_equal 6 [r append mykey bar]
+        assert_encoding raw mykey
+        assert_equal foobar [r get mykey]
+
+        r set mykey foo
+        assert_equal 3 [r setrange mykey 0 b]
+        assert_encoding raw mykey
+        assert_equal boo [r get mykey]
+
+        r set mykey foo
+        r setbit mykey 0 0
+        assert_encoding raw mykey
+        assert_equal foo [r get mykey]
+    }
+
     test "SETRANGE against key with wrong type" {
         r del mykey
         r lpush mykey "foo"
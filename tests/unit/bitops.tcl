@@ -60,6 +60,19 @@ start_server {tags {"bitops"}} {
         }
     }
 
+    test {BITCOUNT fuzzing with big strings and ranges} {
+        for {set j 0} {$j < 20} {incr j} {
+            set str [randstring 0 20000]
+            r set str $str
+            assert {[r bitcount str] == [count_bits $str]}
+            set l [string length $str]
+            set start [randomInt [expr {$l+1}]]
+            set end [expr {$start+[randomInt 5000]}]
+            assert {[r bitcount str $start $end] ==
+                    [count_bits [string range $str $start $end]]}
+        }
+    }
+
     test {BITCOUNT with start, end} {
         r set s "foobar"
         assert_equal [r bitcount s 0 -1] [count_bits "foobar"]
@@ -146,6 +159,29 @@ start_server {tags {"bitops"}} {
         }
     }
 
+    test "BITOP fuzzing with many long keys" {
+        foreach op {and or xor} {
+            r flushall
+            set vec {}
+            set veckeys {}
+            set numvec [expr {[randomInt 10]+17}]
+            set len [expr {[randomInt 4000]+1000}]
+            for {set j 0} {$j < $numvec} {incr j} {
+                # Mostly ones, so that AND does not quickly become zero.
+                set str [string repeat "\xff" $len]
+                for {set k 0} {$k < 100} {incr k} {
+                    set pos [randomInt $len]
+                    set str [string replace $str $pos $pos [randstring 1 1]]
+                }
+                lappend vec $str
+                lappend veckeys vector_$j
+                r set vector_$j $str
+            }
+            r bitop $op target {*}$veckeys
+            assert_equal [r get target] [simulate_bit_op $op {*}$vec]
+        }
+    }
+
     test {BITOP NOT fuzzing} {
         for {set i 0} {$i < 10} {incr i} {
             r flushall
@@ -177,4 +213,278 @@ start_server {tags {"bitops"}} {
         r set a "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
         r bitop or x a b
     } {32}
+
+    test {BITPOS bit=0 with empty key returns 0} {
+        r del str
+        r bitpos str 0
+    } {0}
+
+    test {BITPOS bit=1 with empty key returns -1} {
+        r del str
+        r bitpos str 1
+    } {-1}
+
+    test {BITPOS bit=0 with string less than 1 word works} {
+        r set str "\xff\xf0\x00"
+        r bitpos str 0
+    } {12}
+
+    test {BITPOS bit=1 with string less than 1 word works} {
+        r set str "\x00\x0f\x00"
+        r bitpos str 1
+    } {12}
+
+    test {BITPOS bit=0 starting at unaligned address} {
+        r set str "\xff\xf0\x00"
+        r bitpos str 0 1
+    } {12}
+
+    test {BITPOS bit=1 starting at unaligned address} {
+        r set str "\x00\x0f\xff"
+        r bitpos str 1 1
+    } {12}
+
+    test {BITPOS bit=0 unaligned+full word+reminder} {
+        r del str
+        r set str "\xff\xff\xff" ; # Prefix
+        # Followed by two (or four in 32 bit systems) full words
+        r append str "\xff\xff\xff\xff\xff\xff\xff\xff"
+        r append str "\xff\xff\xff\xff\xff\xff\xff\xff"
+        r append str "\xff\xff\xff\xff\xff\xff\xff\xff"
+        # First zero bit.
+        r append str "\x0f"
+        assert {[r bitpos str 0] == 216}
+        assert {[r bitpos str 0 1] == 216}
+        assert {[r bitpos str 0 2] == 216}
+        assert {[r bitpos str 0 3] == 216}
+        assert {[r bitpos str 0 4] == 216}
+        assert {[r bitpos str 0 5] == 216}
+        assert {[r bitpos str 0 6] == 216}
+        assert {[r bitpos str 0 7] == 216}
+        assert {[r bitpos str 0 8] == 216}
+    }
+
+    test {BITPOS bit=1 unaligned+full word+reminder} {
+        r del str
+        r set str "\x00\x00\x00" ; # Prefix
+        # Followed by two (or four in 32 bit systems) full words
+        r append str "\x00\x00\x00\x00\x00\x00\x00\x00"
+        r append str "\x00\x00\x00\x00\x00\x00\x00\x00"
+        r append str "\x00\x00\x00\x00\x00\x00\x00\x00"
+        # First zero bit.
+        r append str "\xf0"
+        assert {[r bitpos str 1] == 216}
+        assert {[r bitpos str 1 1] == 216}
+        assert {[r bitpos str 1 2] == 216}
+        assert {[r bitpos str 1 3] == 216}
+        assert {[r bitpos str 1 4] == 216}
+        assert {[r bitpos str 1 5] == 216}
+        assert {[r bitpos str 1 6] == 216}
+        assert {[r bitpos str 1 7] == 216}
+        assert {[r bitpos str 1 8] == 216}
+    }
+
+    test {BITPOS bit=1 returns -1 if string is all 0 bits} {
+        r set str ""
+        for {set j 0} {$j < 20} {incr j} {
+            assert {[r bitpos str 1] == -1}
+            r append str "\x00"
+        }
+    }
+
+    test {BITPOS bit=0 works with intervals} {
+        r set str "\x00\xff\x00"
+        list [r bitpos str 0 0 -1] \
+             [r bitpos str 0 1 -1] \
+             [r bitpos str 0 1 1] \
+             [r bitpos str 0 2 -1] \
+             [r bitpos str 0 2 200] \
+             [r bitpos str 0 1 1]
+    } {0 16 -1 16 16 -1}
+
+    test {BITPOS bit=1 works with intervals} {
+        r set str "\x00\xff\x00"
+        list [r bitpos str 1 0 -1] \
+             [r bitpos str 1 1 -1] \
+             [r bitpos str 1 2 -1] \
+             [r bitpos str 1 2 200] \
+             [r bitpos str 1 1 1]
+    } {8 8 -1 -1 8}
+
+    test {BITPOS bit=0 changes behavior if end is given} {
+        r set str "\xff\xff\xff"
+        list [r bitpos str 0] \
+             [r bitpos str 0 0] \
+             [r bitpos str 0 0 -1]
+    } {24 24 -1}
+
+    test {BITPOS with an invalid bit argument} {
+        r set str "\xff"
+        catch {r bitpos str 2} e
+        set e
+    } {*bit argument*}
+
+    test {BITPOS bit=1 fuzzy testing using SETBIT} {
+        r del str
+        set max 524288; # 64k
+        set first_one_pos -1
+        for {set j 0} {$j < 1000} {incr j} {
+            assert {[r bitpos str 1] == $first_one_pos}
+            set pos [randomInt $max]
+            r setbit str $pos 1
+            if {$first_one_pos == -1 || $first_one_pos > $pos} {
+                # Update the position of the first 1 bit in the array
+                # if the bit we set is on the left of the previous one.
+                set first_one_pos $pos
+            }
+        }
+    }
+
+    test {BITPOS bit=0 fuzzy testing using SETBIT} {
+        set max 524288; # 64k
+        set first_zero_pos $max
+        r set str [string repeat "\xff" [expr $max/8]]
+        for {set j 0} {$j < 1000} {incr j} {
+            assert {[r bitpos str 0] == $first_zero_pos}
+            set pos [randomInt $max]
+            r setbit str $pos 0
+            if {$first_zero_pos > $pos} {
+                # Update the position of the first 0 bit in the array
+                # if the bit we clear is on the left of the previous one.
+                set first_zero_pos $pos
+            }
+        }
+    }
+
+    test {SETBIT on a missing key creates a roaring bitmap} {
+        r del bm str
+        r setbit bm 100 1
+        r set str ""
+        r setbit str 100 1
+        assert_encoding roaring bm
+        assert_encoding raw str
+        list [r strlen bm] [r getbit bm 100] [r getbit bm 101] [r bitcount bm]
+    } {13 1 0 1}
+
+    test {SETBIT at the last offset of a roaring bitmap stays small} {
+        r del bm
+        r setbit bm 4294967295 1
+        r setbit bm 0 1
+        assert_encoding roaring bm
+        regexp {serializedlength:(\d+)} [r debug object bm] - len
+        assert {$len < 100}
+        list [r strlen bm] [r bitcount bm] [r bitcount bm 1 -2] \
+             [r bitpos bm 1 1] [r bitpos bm 0] [r getbit bm 4294967295]
+    } {536870912 2 0 4294967295 1 1}
+
+    test {Roaring bitmaps and plain strings agree (SETBIT fuzzing)} {
+        r del bm str
+        r set str ""
+        set max 300000
+        # BITOP NOT turns the sparse bitmap into a dense one, so that
+        # array, bitmap and run containers are all exercised.
+        foreach round {0 1 2} {
+            for {set j 0} {$j < 1000} {incr j} {
+                set pos [randomInt $max]
+                set val [randomInt 2]
+                assert_equal [r setbit str $pos $val] [r setbit bm $pos $val]
+            }
+            assert_encoding roaring bm
+            set len [r strlen str]
+            assert_equal $len [r strlen bm]
+            for {set j 0} {$j < 50} {incr j} {
+                set start [expr {[randomInt [expr {$len*2}]]-$len}]
+                set end [expr {[randomInt [expr {$len*2}]]-$len}]
+                set pos [randomInt $max]
+                assert_equal [r bitcount str $start $end] [r bitcount bm $start $end]
+                assert_equal [r bitpos str 1 $start $end] [r bitpos bm 1 $start $end]
+                assert_equal [r bitpos str 0 $start $end] [r bitpos bm 0 $start $end]
+                assert_equal [r bitpos str 0 $start] [r bitpos bm 0 $start]
+                assert_equal [r getbit str $pos] [r getbit bm $pos]
+            }
+            assert_equal [r bitcount str] [r bitcount bm]
+            assert_equal [r bitpos str 0] [r bitpos bm 0]
+            r bitop not str str
+            r bitop not bm bm
+        }
+        assert_encoding roaring bm
+        assert_equal [r get str] [r get bm]
+    }
+
+    test {BITOP with roaring and plain sources} {
+        r del a b ra rb
+        r set ra ""
+        r set rb ""
+        for {set j 0} {$j < 500} {incr j} {
+            set pos [randomInt 200000]
+            r setbit a $pos 1
+            r setbit ra $pos 1
+            set pos [randomInt 100000]
+            r setbit b $pos 1
+            r setbit rb $pos 1
+        }
+        foreach op {and or xor} {
+            r bitop $op dest a b
+            r bitop $op mixed a rb
+            r bitop $op rdest ra rb
+            assert_encoding roaring dest
+            assert_encoding roaring mixed
+            assert_equal [r bitcount rdest] [r bitcount dest]
+            assert_equal [r get rdest] [r get dest]
+            assert_equal [r get rdest] [r get mixed]
+        }
+        r bitop not dest a
+        r bitop not rdest ra
+        assert_encoding roaring dest
+        assert_equal [r get rdest] [r get dest]
+    }
+
+    test {Roaring bitmap container transitions} {
+        r del bm
+        for {set j 0} {$j < 5000} {incr j} {
+            r setbit bm [expr {$j*3}] 1
+        }
+        set count [r bitcount bm]
+        for {set j 0} {$j < 5000} {incr j} {
+            r setbit bm [expr {$j*3}] 0
+        }
+        assert_encoding roaring bm
+        list $count [r bitcount bm] [r strlen bm] [r bitpos bm 1]
+    } {5000 0 1875 -1}
+
+    test {Byte level commands convert roaring bitmaps to plain strings} {
+        r del bm
+        r setbit bm 10 1
+        assert_equal [r getrange bm 1 1] "\x20"
+        assert_encoding raw bm
+        r del bm
+        r setbit bm 10 1
+        r append bm "foo"
+        assert_encoding raw bm
+        r del bm
+        r setbit bm 10 1
+        list [r get bm] [r strlen bm]
+    } [list "\x00\x20" 2]
+
+    test {Roaring bitmaps survive DEBUG RELOAD, AOF rewrite and DUMP/RESTORE} {
+        r flushdb
+        r setbit sparse 10000000 1
+        r setbit sparse 7 1
+        r setbit sparse 20000000 0
+        r setbit dense 0 1
+        r bitop not dense dense
+        set digest [r debug digest]
+        r debug reload
+        assert_encoding roaring sparse
+        assert_equal $digest [r debug digest]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_encoding roaring sparse
+        assert_equal $digest [r debug digest]
+        r restore copy 0 [r dump sparse]
+        assert_encoding roaring copy
+        list [r strlen sparse] [r bitcount sparse] [r bitcount copy] \
+             [r get dense]
+    } [list 2500001 2 2 "\x7f"]
 }
@@ -160,6 +160,53 @@ start_server {tags {"expire"}} {
         list $size1 $size2
     } {3 0}
 
+    test {Redis should actively expire keys in every DB} {
+        r flushall
+        foreach db {9 10} {
+            r select $db
+            r multi
+            for {set j 0} {$j < 10000} {incr j} {
+                r psetex key:$j 100 a
+            }
+            r exec
+        }
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Keys not expired in DB 10"
+        }
+        r select 9
+        wait_for_condition 50 100 {
+            [r dbsize] == 0
+        } else {
+            fail "Keys not expired in DB 9"
+        }
+        assert_match {*expired_stale_perc:*} [r info stats]
+        assert_match {*expire_cycle_cpu_milliseconds:*} [r info stats]
+        assert {[status r expired_keys] >= 20000}
+    }
+
+    test {Active expire handles many keys in a sparse expires dict} {
+        r flushall
+        r config resetstat
+        # While the keys expire, the expires dict becomes sparse and
+        # sampling it can return the same entry twice: it must still be
+        # expired (and counted) only once.
+        for {set round 0} {$round < 3} {incr round} {
+            r multi
+            for {set j 0} {$j < 10000} {incr j} {
+                r psetex key:$j 100 a
+            }
+            r exec
+            wait_for_condition 50 100 {
+                [r dbsize] == 0
+            } else {
+                fail "Keys not expired"
+            }
+        }
+        status r expired_keys
+    } {30000}
+
     test {5 keys in, 5 keys out} {
         r flushdb
         r set a c
@@ -170,4 +217,68 @@ start_server {tags {"expire"}} {
         r set foo b
         lsort [r keys *]
     } {a e foo s t}
+
+    test {INFO keyspace expires count follows every TTL change} {
+        proc expires_count {} {
+            if {![regexp {db9:keys=\d+,expires=(\d+)} [r info keyspace] - n]} {
+                return 0
+            }
+            return $n
+        }
+        r flushall
+        r set a 1
+        r setex b 100 1
+        r setex c 100 1
+        set res [expires_count]
+        r set b 2
+        lappend res [expires_count] [r ttl b]
+        r persist c
+        r expire a 100
+        lappend res [expires_count]
+        r rename a d
+        lappend res [expires_count] [expr {[r ttl d] > 90}]
+        r setex e 100 1
+        r move e 10
+        lappend res [expires_count]
+        r del d
+        lappend res [expires_count]
+        r psetex f 1 1
+        after 10
+        lappend res [r get f] [expires_count]
+        r setex g 100 1
+        r flushdb
+        lappend res [expires_count]
+    } {2 1 -1 1 1 1 1 0 {} 0 0}
+
+    test {KEYS deletes the expired keys it walks over} {
+        r flushdb
+        r multi
+        for {set j 0} {$j < 1000} {incr j} {
+            r psetex vol:$j 1 a
+            r set key:$j a
+        }
+        r exec
+        after 10
+        set keys [r keys *]
+        list [llength $keys] [r dbsize] [llength [r keys vol:*]]
+    } {1000 1000 0}
+
+    test {Expires are tracked right after deleting most volatile keys} {
+        r flushdb
+        r multi
+        for {set j 0} {$j < 5000} {incr j} {
+            r setex long:$j 1000 a
+            if {$j % 50 == 0} {r psetex short:$j 100 a}
+        }
+        r exec
+        for {set j 0} {$j < 5000} {incr j} {
+            if {$j % 10} {r del long:$j}
+        }
+        wait_for_condition 50 100 {
+            [llength [r keys short:*]] == 0
+        } else {
+            fail "Short lived keys not expired"
+        }
+        list [r dbsize] [expr {[r ttl long:4990] > 990}]
+    } {500 1}
 }
@@ -0,0 +1,66 @@
+start_server {tags {"lazyfree"}} {
+    test "UNLINK can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        assert {[r unlink myset] == 1}
+        assert {$peak_mem > $orig_mem+1000000}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2 &&
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by UNLINK"
+        }
+    }
+
+    test "FLUSHDB ASYNC can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        set args {}
+        for {set i 0} {$i < 100000} {incr i} {
+            lappend args $i
+        }
+        r sadd myset {*}$args
+        assert {[r scard myset] == 100000}
+        set peak_mem [s used_memory]
+        r flushdb async
+        assert {[r dbsize] == 0}
+        assert {$peak_mem > $orig_mem+1000000}
+        wait_for_condition 50 100 {
+            [s used_memory] < $peak_mem &&
+            [s used_memory] < $orig_mem*2 &&
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Memory is not reclaimed by FLUSHDB ASYNC"
+        }
+    }
+
+    test "FLUSHALL and FLUSHDB reject unknown options" {
+        catch {r flushall foo} e1
+        catch {r flushdb async foo} e2
+        list [string match "*syntax*" $e1] [string match "*syntax*" $e2]
+    } {1 1}
+
+    test "lazyfree-lazy-server-del frees deleted and overwritten values" {
+        r config set lazyfree-lazy-server-del yes
+        r debug populate 1000
+        r rpush mylist {*}[lrange $args 0 9999]
+        r sadd myset {*}[lrange $args 0 9999]
+        r set mylist foo
+        assert {[r del myset] == 1}
+        assert {[r get mylist] eq {foo}}
+        r del mylist
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Lazy freed objects not reclaimed"
+        }
+        r config set lazyfree-lazy-server-del no
+        list [r dbsize] [r exists myset]
+    } {1000 0}
+}
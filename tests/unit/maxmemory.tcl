@@ -117,4 +117,82 @@ start_server {tags {"maxmemory"}} {
             }
         }
     }
+
+    test "maxmemory - allkeys-lru evicts the least recently used keys" {
+        r flushall
+        r config set maxmemory 0
+        for {set j 0} {$j < 1000} {incr j} {
+            r set old:$j [string repeat x 50]
+        }
+        # The LRU clock has a resolution of one second.
+        after 2100
+        for {set j 0} {$j < 1000} {incr j 2} {
+            r get old:$j
+        }
+        r config set maxmemory [expr {[s used_memory]+10*1024}]
+        r config set maxmemory-policy allkeys-lru
+        for {set j 0} {$j < 500} {incr j} {
+            r set new:$j [string repeat x 50]
+        }
+        set touched 0
+        set untouched 0
+        for {set j 0} {$j < 1000} {incr j} {
+            if {![r exists old:$j]} {
+                if {$j % 2} {incr untouched} else {incr touched}
+            }
+        }
+        # Evictions must hit the keys that were not accessed recently.
+        assert {$untouched > 100}
+        assert {$touched*4 < $untouched}
+        r config set maxmemory 0
+    }
+
+    test "OBJECT FREQ is only available with LFU policies" {
+        r config set maxmemory-policy allkeys-lru
+        r set foo bar
+        assert_error {*LFU*not selected*} {r object freq foo}
+        r config set maxmemory-policy volatile-lfu
+        assert_error {*LFU*idle time not tracked*} {r object idletime foo}
+        r config set maxmemory-policy volatile-lru
+    }
+
+    test "LFU counter is incremented logarithmically on access" {
+        r config set maxmemory-policy allkeys-lfu
+        r del foo
+        r set foo bar
+        assert_equal 5 [r object freq foo]
+        for {set j 0} {$j < 100} {incr j} {r get foo}
+        set freq [r object freq foo]
+        assert {$freq > 5 && $freq < 30}
+        r config set lfu-log-factor 0
+        for {set j 0} {$j < 100} {incr j} {r get foo}
+        assert {[r object freq foo] >= $freq+100}
+        r config set lfu-log-factor 10
+        r config set maxmemory-policy volatile-lru
+    }
+
+    test "maxmemory - allkeys-lfu keeps the hot keys during a scan" {
+        r flushall
+        r config set maxmemory 0
+        r config set maxmemory-policy allkeys-lfu
+        for {set j 0} {$j < 100} {incr j} {
+            r set hot:$j [string repeat x 50]
+        }
+        for {set i 0} {$i < 20} {incr i} {
+            for {set j 0} {$j < 100} {incr j} {r get hot:$j}
+        }
+        # Fill the memory with keys accessed once, like a scan would do.
+        r config set maxmemory [expr {[s used_memory]+20*1024}]
+        for {set j 0} {$j < 2000} {incr j} {
+            r set cold:$j [string repeat x 50]
+        }
+        assert {[r dbsize] < 1000}
+        set survivors 0
+        for {set j 0} {$j < 100} {incr j} {
+            if {[r exists hot:$j]} {incr survivors}
+        }
+        assert {$survivors >= 95}
+        r config set maxmemory 0
+        r config set maxmemory-policy volatile-lru
+    }
 }
@@ -0,0 +1,217 @@
+start_server {tags {"scan"}} {
+    test "SCAN basic" {
+        r flushdb
+        r debug populate 1000
+
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r scan $cur]
+            set cur [lindex $res 0]
+            set k [lindex $res 1]
+            lappend keys {*}$k
+            if {$cur == 0} break
+        }
+
+        set keys [lsort -unique $keys]
+        assert_equal 1000 [llength $keys]
+    }
+
+    foreach count {1 5 10 50 100} {
+        test "SCAN COUNT $count" {
+            r flushdb
+            r debug populate 1000
+
+            set cur 0
+            set keys {}
+            while 1 {
+                set res [r scan $cur count $count]
+                set cur [lindex $res 0]
+                set k [lindex $res 1]
+                lappend keys {*}$k
+                if {$cur == 0} break
+            }
+
+            set keys [lsort -unique $keys]
+            assert_equal 1000 [llength $keys]
+        }
+    }
+
+    test "SCAN MATCH" {
+        r flushdb
+        r debug populate 1000
+
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r scan $cur match "key:1??"]
+            set cur [lindex $res 0]
+            set k [lindex $res 1]
+            lappend keys {*}$k
+            if {$cur == 0} break
+        }
+
+        set keys [lsort -unique $keys]
+        assert_equal 100 [llength $keys]
+    }
+
+    test "SCAN guarantees elements present for the whole iteration" {
+        r flushdb
+        r debug populate 1000
+
+        # Keys added and removed during the iteration force the keyspace
+        # to resize: the original keys must be returned anyway.
+        set cur 0
+        set keys {}
+        set j 0
+        while 1 {
+            set res [r scan $cur count 20]
+            set cur [lindex $res 0]
+            set k [lindex $res 1]
+            lappend keys {*}$k
+            for {set i 0} {$i < 200} {incr i} {
+                r set tmp:$j:$i x
+            }
+            if {$j >= 3} {r del {*}[r keys tmp:[expr {$j-3}]:*]}
+            incr j
+            if {$cur == 0} break
+        }
+
+        set found 0
+        foreach k [lsort -unique $keys] {
+            if {[string match key:* $k]} {incr found}
+        }
+        assert_equal 1000 $found
+    }
+
+    test "SCAN with invalid cursor or options" {
+        catch {r scan abc} e1
+        catch {r scan 0 count 0} e2
+        catch {r scan 0 foo bar} e3
+        list [string match "*invalid cursor*" $e1] \
+             [string match "*syntax*" $e2] \
+             [string match "*syntax*" $e3]
+    } {1 1 1}
+
+    foreach enc {intset hashtable} {
+        test "SSCAN with encoding $enc" {
+            r del set
+            if {$enc eq {intset}} {
+                set prefix ""
+            } else {
+                set prefix "ele:"
+            }
+            set elements {}
+            for {set j 0} {$j < 100} {incr j} {
+                lappend elements ${prefix}${j}
+            }
+            r sadd set {*}$elements
+
+            # Verify that the encoding matches.
+            assert {[r object encoding set] eq $enc}
+
+            # Test SSCAN
+            set cur 0
+            set keys {}
+            while 1 {
+                set res [r sscan set $cur]
+                set cur [lindex $res 0]
+                set k [lindex $res 1]
+                lappend keys {*}$k
+                if {$cur == 0} break
+            }
+
+            set keys [lsort -unique $keys]
+            assert_equal 100 [llength $keys]
+        }
+    }
+
+    foreach enc {listpack hashtable} {
+        test "HSCAN with encoding $enc" {
+            r del hash
+            if {$enc eq {listpack}} {
+                set count 30
+            } else {
+                set count 1000
+            }
+            set elements {}
+            for {set j 0} {$j < $count} {incr j} {
+                lappend elements key:$j $j
+            }
+            r hmset hash {*}$elements
+
+            # Verify that the encoding matches.
+            assert {[r object encoding hash] eq $enc}
+
+            # Test HSCAN
+            set cur 0
+            set keys {}
+            set vals {}
+            while 1 {
+                set res [r hscan hash $cur]
+                set cur [lindex $res 0]
+                set k [lindex $res 1]
+                foreach {field value} $k {
+                    lappend keys $field
+                    lappend vals $value
+                    assert_equal "key:$value" $field
+                }
+                if {$cur == 0} break
+            }
+
+            set keys [lsort -unique $keys]
+            assert_equal $count [llength $keys]
+        }
+    }
+
+    foreach enc {listpack skiplist} {
+        test "ZSCAN with encoding $enc" {
+            r del zset
+            if {$enc eq {listpack}} {
+                set count 30
+            } else {
+                set count 1000
+            }
+            set elements {}
+            for {set j 0} {$j < $count} {incr j} {
+                lappend elements $j key:$j
+            }
+            r zadd zset {*}$elements
+
+            # Verify that the encoding matches.
+            assert {[r object encoding zset] eq $enc}
+
+            # Test ZSCAN
+            set cur 0
+            set keys {}
+            while 1 {
+                set res [r zscan zset $cur]
+                set cur [lindex $res 0]
+                set k [lindex $res 1]
+                foreach {member score} $k {
+                    lappend keys $member
+                    assert_equal "key:$score" $member
+                }
+                if {$cur == 0} break
+            }
+
+            set keys [lsort -unique $keys]
+            assert_equal $count [llength $keys]
+        }
+    }
+
+    test "SSCAN with MATCH and a missing key" {
+        r del set
+        r sadd set foo fab fiz foobar 1 2 3 4
+        set res [r sscan set 0 match "foo*" count 10000]
+        set missing [r sscan nokey 0]
+        list [lsort -unique [lindex $res 1]] $missing
+    } {{foo foobar} {0 {}}}
+
+    test "HSCAN with MATCH filters fields, not values" {
+        r del hash
+        r hmset hash foo 1 fab 2 fiz 3 foobar 4
+        set res [r hscan hash 0 match "foo*" count 10000]
+        lsort -unique [lindex $res 1]
+    } {1 4 foo foobar}
+}
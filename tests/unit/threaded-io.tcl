@@ -0,0 +1,114 @@
+start_server {tags {"threaded-io"} overrides {io-threads 4 io-threads-do-reads yes}} {
+    test {CONFIG GET io-threads} {
+        list [lindex [r config get io-threads] 1] \
+             [lindex [r config get io-threads-do-reads] 1]
+    } {4 yes}
+
+    test {Many pipelining clients served by the I/O threads} {
+        set clients {}
+        for {set j 0} {$j < 20} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        r del counter
+        for {set round 0} {$round < 50} {incr round} {
+            set id 0
+            foreach rd $clients {
+                for {set k 0} {$k < 10} {incr k} {
+                    $rd set key:$id:$k $round:$k
+                    $rd get key:$id:$k
+                    $rd incr counter
+                }
+                incr id
+            }
+            set id 0
+            foreach rd $clients {
+                for {set k 0} {$k < 10} {incr k} {
+                    assert_equal OK [$rd read]
+                    assert_equal $round:$k [$rd read]
+                    $rd read
+                }
+                incr id
+            }
+        }
+        foreach rd $clients {$rd close}
+        assert {[status r io_threaded_reads_processed] > 0}
+        assert {[status r io_threaded_writes_processed] > 0}
+        r get counter
+    } {10000}
+
+    test {Big replies are written by the I/O threads} {
+        r set bigval [string repeat x 1000000]
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        foreach rd $clients {
+            for {set k 0} {$k < 5} {incr k} {$rd get bigval}
+        }
+        foreach rd $clients {
+            for {set k 0} {$k < 5} {incr k} {
+                assert_equal 1000000 [string length [$rd read]]
+            }
+            $rd close
+        }
+        r ping
+    } {PONG}
+
+    test {Blocking operations and MULTI/EXEC with I/O threads} {
+        r del mylist
+        set rd [redis_deferring_client]
+        $rd blpop mylist 0
+        after 100
+        r multi
+        r rpush mylist foo
+        r rpush mylist bar
+        assert_equal {1 2} [r exec]
+        assert_equal {mylist foo} [$rd read]
+        $rd close
+        r lrange mylist 0 -1
+    } {bar}
+
+    test {Protocol errors and QUIT with I/O threads} {
+        set s [socket [srv 0 host] [srv 0 port]]
+        fconfigure $s -translation binary
+        puts -nonewline $s "*1\r\n\$-5\r\n"
+        flush $s
+        set reply [gets $s]
+        close $s
+        set rd [redis_deferring_client]
+        $rd quit
+        set quit [$rd read]
+        $rd close
+        list [string match {*Protocol error*} $reply] $quit [r ping]
+    } {1 OK PONG}
+
+    start_server {} {
+        test {Slaves of a master with I/O threads get every write} {
+            r slaveof [srv -1 host] [srv -1 port]
+            wait_for_condition 50 100 {
+                [s master_link_status] eq {up}
+            } else {
+                fail "Replication not started"
+            }
+            set clients {}
+            for {set j 0} {$j < 20} {incr j} {
+                lappend clients [redis_deferring_client -1]
+            }
+            for {set round 0} {$round < 20} {incr round} {
+                foreach rd $clients {
+                    for {set k 0} {$k < 10} {incr k} {$rd incr slavecounter}
+                }
+                foreach rd $clients {
+                    for {set k 0} {$k < 10} {incr k} {$rd read}
+                }
+            }
+            foreach rd $clients {$rd close}
+            wait_for_condition 50 100 {
+                [r get slavecounter] eq {4000}
+            } else {
+                fail "The slave did not receive all the writes"
+            }
+            assert_equal [r -1 debug digest] [r debug digest]
+        }
+    }
+}
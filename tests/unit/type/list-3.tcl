@@ -1,8 +1,7 @@
 start_server {
     tags {list ziplist}
     overrides {
-        "list-max-ziplist-value" 200000
-        "list-max-ziplist-entries" 256
+        "list-max-ziplist-size" 16
     }
 } {
     test {Explicit regression for a list bug} {
@@ -76,4 +75,115 @@ start_server {
             }
         }
     }
+    # Reference implementation of LREM against a Tcl list.
+    proc lrem_model {l count v} {
+        set reverse [expr {$count < 0}]
+        if {$reverse} {
+            set l [lreverse $l]
+            set count [expr {-$count}]
+        }
+        set res {}
+        set removed 0
+        foreach e $l {
+            if {$e eq $v && ($count == 0 || $removed < $count)} {
+                incr removed
+            } else {
+                lappend res $e
+            }
+        }
+        if {$reverse} {set res [lreverse $res]}
+        return $res
+    }
+
+    foreach {size depth} {4 0 4 1 -1 2} {
+        test "Quicklist stress testing - size $size, compress depth $depth" {
+            r config set list-max-ziplist-size $size
+            r config set list-compress-depth $depth
+            r del l
+            set l {}
+            if {$::accurate} {set ops 20000} else {set ops 3000}
+            for {set j 0} {$j < $ops} {incr j} {
+                set v "[randomInt 20][string repeat x [randomInt 40]]"
+                set len [llength $l]
+                randpath {
+                    r rpush l $v
+                    lappend l $v
+                } {
+                    r lpush l $v
+                    set l [linsert $l 0 $v]
+                } {
+                    if {$len} {
+                        assert_equal [lindex $l 0] [r lpop l]
+                        set l [lrange $l 1 end]
+                    }
+                } {
+                    if {$len} {
+                        assert_equal [lindex $l end] [r rpop l]
+                        set l [lrange $l 0 end-1]
+                    }
+                } {
+                    if {$len} {
+                        set pivot [lindex $l [randomInt $len]]
+                        set idx [lsearch -exact $l $pivot]
+                        if {rand() < 0.5} {
+                            r linsert l before $pivot $v
+                        } else {
+                            r linsert l after $pivot $v
+                            incr idx
+                        }
+                        set l [linsert $l $idx $v]
+                    }
+                } {
+                    set count [expr {[randomInt 5]-2}]
+                    r lrem l $count $v
+                    set l [lrem_model $l $count $v]
+                } {
+                    if {$len} {
+                        set idx [randomInt $len]
+                        r lset l $idx $v
+                        lset l $idx $v
+                    }
+                } {
+                    if {$len > 10} {
+                        r ltrim l 1 -2
+                        set l [lrange $l 1 end-1]
+                    }
+                }
+                if {$j % 500 == 0} {
+                    assert_equal $l [r lrange l 0 -1]
+                }
+            }
+            assert_equal [llength $l] [r llen l]
+            assert_equal $l [r lrange l 0 -1]
+            assert_equal [lreverse $l] [lreverse [r lrange l 0 -1]]
+            r debug reload
+            assert_equal $l [r lrange l 0 -1]
+        }
+    }
+
+    test {Quicklist interior nodes are compressed} {
+        r config set list-max-ziplist-size 16
+        r config set list-compress-depth 1
+        r del l
+        for {set j 0} {$j < 200} {incr j} {
+            r rpush l [string repeat a 32]-$j
+        }
+        assert_match {*ql_nodes:13 *} [r debug object l]
+        assert_match {*ql_compressed_nodes:11 *} [r debug object l]
+
+        # Access to compressed nodes decompresses them only temporarily.
+        assert_equal [string repeat a 32]-100 [r lindex l 100]
+        r lset l 100 foo
+        assert_equal foo [r lindex l 100]
+        assert_match {*ql_compressed_nodes:11 *} [r debug object l]
+
+        # The compressed nodes survive a reload.
+        r debug reload
+        assert_equal 200 [r llen l]
+        assert_equal foo [r lindex l 100]
+        assert_equal [string repeat a 32]-199 [r lindex l -1]
+        assert_match {*ql_compressed_nodes:11 *} [r debug object l]
+        r config set list-max-ziplist-size 16
+        r config set list-compress-depth 0
+    }
 }
@@ -1,5 +1,6 @@
-# We need a value larger than list-max-ziplist-value to make sure
-# the list has the right encoding when it is swapped in again.
+# Lists are always encoded as quicklists: use a value larger than the size
+# of a single quicklist node so that it is stored in a node on its own,
+# exercising lists made of nodes of very different sizes.
 array set largevalue {}
 set largevalue(ziplist) "hello"
-set largevalue(linkedlist) [string repeat "hello" 4]
+set largevalue(linkedlist) [string repeat "hello" 2000]
@@ -1,8 +1,7 @@
 start_server {
     tags {"list"}
     overrides {
-        "list-max-ziplist-value" 16
-        "list-max-ziplist-entries" 256
+        "list-max-ziplist-size" 4
     }
 } {
     source "tests/unit/type/list-common.tcl"
@@ -19,7 +18,7 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal c [r rpop myziplist1]
         assert_equal a [r lpop myziplist1]
-        assert_encoding ziplist myziplist1
+        assert_encoding quicklist myziplist1
 
         # first rpush then lpush
         assert_equal 1 [r rpush myziplist2 a]
@@ -32,13 +31,13 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal a [r rpop myziplist2]
         assert_equal c [r lpop myziplist2]
-        assert_encoding ziplist myziplist2
+        assert_encoding quicklist myziplist2
     }
 
     test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - regular list} {
         # first lpush then rpush
         assert_equal 1 [r lpush mylist1 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist1
+        assert_encoding quicklist mylist1
         assert_equal 2 [r rpush mylist1 b]
         assert_equal 3 [r rpush mylist1 c]
         assert_equal 3 [r llen mylist1]
@@ -51,7 +50,7 @@ start_server {
 
         # first rpush then lpush
         assert_equal 1 [r rpush mylist2 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist2
+        assert_encoding quicklist mylist2
         assert_equal 2 [r lpush mylist2 b]
         assert_equal 3 [r lpush mylist2 c]
         assert_equal 3 [r llen mylist2]
@@ -89,13 +88,13 @@ start_server {
     proc create_ziplist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding ziplist $key
+        assert_encoding quicklist $key
     }
 
     proc create_linkedlist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding linkedlist $key
+        assert_encoding quicklist $key
     }
 
     foreach {type large} [array get largevalue] {
@@ -524,52 +523,47 @@ start_server {
         set e
     } {*ERR*syntax*error*}
 
-    test {LPUSHX, RPUSHX convert from ziplist to list} {
+    test {LPUSHX, RPUSHX with large values} {
         set large $largevalue(linkedlist)
 
-        # convert when a large value is pushed
+        # a large value gets a quicklist node of its own
         create_ziplist xlist a
         assert_equal 2 [r rpushx xlist $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
-        assert_equal 2 [r lpushx xlist $large]
-        assert_encoding linkedlist xlist
+        assert_equal 3 [r lpushx xlist $large]
+        assert_equal "$large a $large" [r lrange xlist 0 -1]
+        assert_encoding quicklist xlist
 
-        # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r rpushx xlist b]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r lpushx xlist b]
-        assert_encoding linkedlist xlist
+        # pushing against full head and tail nodes
+        create_ziplist xlist [lrepeat 8 a]
+        assert_equal 9 [r rpushx xlist b]
+        assert_equal 10 [r lpushx xlist c]
+        assert_equal "c [lrepeat 8 a] b" [r lrange xlist 0 -1]
     }
 
-    test {LINSERT convert from ziplist to list} {
+    test {LINSERT against full quicklist nodes} {
         set large $largevalue(linkedlist)
 
-        # convert when a large value is inserted
-        create_ziplist xlist a
-        assert_equal 2 [r linsert xlist before a $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
-        assert_equal 2 [r linsert xlist after a $large]
-        assert_encoding linkedlist xlist
-
-        # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r linsert xlist before a a]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r linsert xlist after a a]
-        assert_encoding linkedlist xlist
-
-        # don't convert when the value could not be inserted
-        create_ziplist xlist [lrepeat 256 a]
+        # With four elements per node every insert below hits a full node
+        # and has to use a new node, a neighbour node, or split the node.
+        create_ziplist xlist {a b c d e f g h}
+        assert_equal 9 [r linsert xlist before a x1]
+        assert_equal 10 [r linsert xlist after d x2]
+        assert_equal 11 [r linsert xlist after b x3]
+        assert_equal 12 [r linsert xlist before h x4]
+        assert_equal {x1 a b x3 c d x2 e f g x4 h} [r lrange xlist 0 -1]
+
+        # a large value in the middle of a node splits it
+        assert_equal 13 [r linsert xlist after e $large]
+        assert_equal 14 [r linsert xlist before $large y]
+        assert_equal "x1 a b x3 c d x2 e y $large f g x4 h" \
+            [r lrange xlist 0 -1]
+        assert_equal $large [r lindex xlist 9]
+        assert_equal f [r lindex xlist -4]
+
+        # nothing changes when the pivot is not found
         assert_equal -1 [r linsert xlist before foo a]
-        assert_encoding ziplist xlist
-        create_ziplist xlist [lrepeat 256 a]
         assert_equal -1 [r linsert xlist after foo a]
-        assert_encoding ziplist xlist
+        assert_equal 14 [r llen xlist]
     }
 
     foreach {type num} {ziplist 250 linkedlist 500} {
@@ -595,18 +589,18 @@ start_server {
             for {set i 0} {$i < $num} {incr i} {
                 r rpush mylist $i
             }
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_numbered_list_consistency mylist
         }
 
         test "LINDEX random access - $type" {
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_random_access_consistency mylist
         }
 
         test "Check if list is still ok after a DEBUG RELOAD - $type" {
             r debug reload
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_numbered_list_consistency mylist
             check_random_access_consistency mylist
         }
@@ -646,7 +640,7 @@ start_server {
             assert_equal c [r rpoplpush mylist1 mylist2]
             assert_equal "a $large" [r lrange mylist1 0 -1]
             assert_equal "c d" [r lrange mylist2 0 -1]
-            assert_encoding ziplist mylist2
+            assert_encoding quicklist mylist2
         }
 
         test "RPOPLPUSH with the same list as src and dst - $type" {
@@ -664,12 +658,7 @@ start_server {
                 assert_equal c [r rpoplpush srclist dstlist]
                 assert_equal "a b" [r lrange srclist 0 -1]
                 assert_equal "c $large $otherlarge" [r lrange dstlist 0 -1]
-
-                # When we rpoplpush'ed a large value, dstlist should be
-                # converted to the same encoding as srclist.
-                if {$type eq "linkedlist"} {
-                    assert_encoding linkedlist dstlist
-                }
+                assert_encoding quicklist dstlist
             }
         }
     }
@@ -730,7 +719,7 @@ start_server {
                 r lpush mylist $i
                 incr sum1 $i
             }
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             set sum2 0
             for {set i 0} {$i < [expr $num/2]} {incr i} {
                 incr sum2 [r lpop mylist]
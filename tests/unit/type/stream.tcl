@@ -0,0 +1,725 @@
+# return value is like strcmp() and similar.
+proc streamCompareID {a b} {
+    if {$a eq $b} {return 0}
+    lassign [split $a -] a_ms a_seq
+    lassign [split $b -] b_ms b_seq
+    if {$a_ms > $b_ms} {return 1}
+    if {$a_ms < $b_ms} {return -1}
+    # Same ms case, compare seq.
+    if {$a_seq > $b_seq} {return 1}
+    if {$a_seq < $b_seq} {return -1}
+}
+
+# Fill the stream 'key' with 'count' entries with a single random field.
+proc streamFill {key count} {
+    for {set j 0} {$j < $count} {incr j} {
+        r xadd $key * item $j otherfield [randstring 0 16 alpha]
+    }
+}
+
+start_server {tags {"stream"}} {
+    test {XADD can add entries into a stream that XRANGE can fetch} {
+        r XADD mystream * item 1 value a
+        r XADD mystream * item 2 value b
+        assert_equal 2 [r XLEN mystream]
+        set items [r XRANGE mystream - +]
+        assert_equal [lindex $items 0 1] {item 1 value a}
+        assert_equal [lindex $items 1 1] {item 2 value b}
+    }
+
+    test {XADD IDs are incremental} {
+        set id1 [r XADD mystream * item 1 value a]
+        set id2 [r XADD mystream * item 2 value b]
+        set id3 [r XADD mystream * item 3 value c]
+        assert {[streamCompareID $id1 $id2] == -1}
+        assert {[streamCompareID $id2 $id3] == -1}
+    }
+
+    test {XADD with explicit IDs} {
+        r del mystream
+        assert_equal 5-1 [r XADD mystream 5-1 a 1]
+        assert_equal 5-2 [r XADD mystream 5-2 a 2]
+        assert_equal 7-0 [r XADD mystream 7 a 3]
+        assert_error "*equal or smaller*" {r XADD mystream 7-0 a 4}
+        assert_error "*equal or smaller*" {r XADD mystream 6-5 a 4}
+        assert_error "*greater than 0-0*" {r XADD otherstream 0-0 a 4}
+        assert_equal 0 [r EXISTS otherstream]
+        # An auto generated ID is always greater than the last one.
+        assert {[streamCompareID [r XADD mystream * a 5] 7-0] == 1}
+    }
+
+    test {XADD argument errors} {
+        assert_error "*wrong number*" {r XADD mystream * a}
+        assert_error "*wrong number*" {r XADD mystream * a 1 b}
+        assert_error "*Invalid stream ID*" {r XADD mystream foo a 1}
+        assert_error "*Invalid stream ID*" {r XADD mystream 1-foo a 1}
+        assert_error "*Invalid stream ID*" {r XADD mystream - a 1}
+        r set foo bar
+        assert_error "WRONGTYPE*" {r XADD foo * a 1}
+    }
+
+    test {XADD with MAXLEN option} {
+        r DEL mystream
+        for {set j 0} {$j < 1000} {incr j} {
+            if {rand() < 0.9} {
+                r XADD mystream MAXLEN 5 * xitem $j
+            } else {
+                r XADD mystream MAXLEN 5 * yitem $j
+            }
+        }
+        assert_equal 5 [r XLEN mystream]
+        set res [r xrange mystream - +]
+        set expected 995
+        foreach r $res {
+            assert {[lindex $r 1 1] == $expected}
+            incr expected
+        }
+    }
+
+    test {XADD with MAXLEN ~ option only trims whole blocks} {
+        r DEL mystream
+        r config set stream-node-max-entries 10
+        for {set j 0} {$j < 100} {incr j} {
+            r XADD mystream MAXLEN ~ 55 * item $j
+        }
+        set len [r XLEN mystream]
+        assert {$len >= 55 && $len < 65}
+        assert_equal [expr {100-$len}] [lindex [r XRANGE mystream - + COUNT 1] 0 1 1]
+        r config set stream-node-max-entries 100
+    }
+
+    test {XADD mass insertion and XLEN} {
+        r DEL mystream
+        r multi
+        for {set j 0} {$j < 10000} {incr j} {
+            # From time to time insert a field with a different set
+            # of fields in order to stress the stream compression code.
+            if {rand() < 0.9} {
+                r XADD mystream * item $j
+            } else {
+                r XADD mystream * item $j otherfield foo
+            }
+        }
+        r exec
+
+        set items [r XRANGE mystream - +]
+        for {set j 0} {$j < 10000} {incr j} {
+            assert {[lrange [lindex $items $j 1] 0 1] eq [list item $j]}
+        }
+        assert_equal 10000 [r XLEN mystream]
+        assert {[lindex [r XINFO STREAM mystream] 3] > 1}
+    }
+
+    test {XRANGE COUNT works as expected} {
+        assert {[llength [r xrange mystream - + COUNT 10]] == 10}
+    }
+
+    test {XREVRANGE COUNT works as expected} {
+        assert {[llength [r xrevrange mystream + - COUNT 10]] == 10}
+    }
+
+    test {XRANGE can be used to iterate the whole stream} {
+        set last_id "-"
+        set j 0
+        while 1 {
+            set elements [r xrange mystream $last_id + COUNT 100]
+            if {[llength $elements] == 0} break
+            foreach e $elements {
+                assert {[lrange [lindex $e 1] 0 1] eq [list item $j]}
+                incr j;
+            }
+            set last_id [lindex $elements end 0]
+            lassign [split $last_id -] ms seq
+            set last_id "$ms-[expr {$seq+1}]"
+        }
+        assert {$j == 10000}
+    }
+
+    test {XREVRANGE returns the reverse of XRANGE} {
+        assert {[r xrange mystream - +] == [lreverse [r xrevrange mystream + -]]}
+    }
+
+    test {XRANGE and XREVRANGE with incomplete IDs and ranges} {
+        r del mystream
+        r xadd mystream 1-0 a 1
+        r xadd mystream 1-5 a 2
+        r xadd mystream 2-0 a 3
+        r xadd mystream 3-1 a 4
+        assert_equal {1-0 1-5} [lmap e [r xrange mystream 1 1] {lindex $e 0}]
+        assert_equal {1-5 2-0} [lmap e [r xrange mystream 1-1 2] {lindex $e 0}]
+        assert_equal {3-1 2-0} [lmap e [r xrevrange mystream + 2] {lindex $e 0}]
+        assert_equal {} [r xrange mystream 4 +]
+        assert_equal {} [r xrange mystream 3 2]
+        assert_equal {} [r xrange nokey - +]
+        assert_equal {} [r xrange mystream - + COUNT 0]
+    }
+
+    test {XDEL basic and iteration over deleted entries} {
+        r del mystream
+        for {set j 0} {$j < 250} {incr j} {
+            r xadd mystream 1-[expr {$j+1}] item $j
+        }
+        # Delete every other entry, and a whole block.
+        set deleted 0
+        for {set j 1} {$j <= 250} {incr j 2} {
+            incr deleted [r xdel mystream 1-$j]
+        }
+        for {set j 102} {$j <= 200} {incr j 2} {
+            incr deleted [r xdel mystream 1-$j]
+        }
+        assert_equal 175 $deleted
+        assert_equal 75 [r xlen mystream]
+        assert_equal 0 [r xdel mystream 1-1 1-1000]
+        set ids [lmap e [r xrange mystream - +] {lindex $e 0}]
+        assert_equal 75 [llength $ids]
+        assert_equal {1-2 1-4} [lrange $ids 0 1]
+        assert_equal {1-100 1-202} [lrange $ids 49 50]
+        assert_equal [lreverse $ids] [lmap e [r xrevrange mystream + -] {lindex $e 0}]
+        # Deleted entries don't change the last ID.
+        r xdel mystream 1-250
+        assert_error "*equal or smaller*" {r xadd mystream 1-249 a b}
+    }
+
+    test {XDEL of all the entries leaves an empty stream} {
+        r del mystream
+        r xadd mystream 1-1 a 1
+        r xadd mystream 1-2 a 2
+        assert_equal 2 [r xdel mystream 1-1 1-2]
+        assert_equal 0 [r xlen mystream]
+        assert_equal {} [r xrange mystream - +]
+        assert_equal stream [r type mystream]
+        assert_equal 1-3 [r xadd mystream 1-3 a 3]
+    }
+
+    test {XTRIM with MAXLEN} {
+        r del mystream
+        for {set j 0} {$j < 500} {incr j} {
+            r xadd mystream * item $j
+        }
+        assert_equal 0 [r xtrim mystream MAXLEN 1000]
+        assert_equal 400 [r xtrim mystream MAXLEN = 100]
+        assert_equal 100 [r xlen mystream]
+        assert_equal 400 [lindex [r xrange mystream - + COUNT 1] 0 1 1]
+        assert_error "*syntax*" {r xtrim mystream}
+        assert_error "*syntax*" {r xtrim mystream FOO 10}
+    }
+
+    test {XSETID can set a greater ID, not a smaller one} {
+        r del mystream
+        r xadd mystream 1-1 a 1
+        r xadd mystream 1-2 a 2
+        assert_equal OK [r xsetid mystream 5-0]
+        assert_error "*smaller*" {r xsetid mystream 1-1}
+        r xdel mystream 1-2
+        assert_equal OK [r xsetid mystream 1-1]
+        assert_equal 1-2 [r xadd mystream 1-2 a 3]
+        assert_error "*no such key*" {r xsetid nokey 1-1}
+    }
+
+    test {Blocking XREAD waiting new data} {
+        r del s1 s2 s3
+        r XADD s2 * old abcd1234
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 20000 STREAMS s1 s2 s3 $ $ $
+        r XADD s2 * new abcd1234
+        set res [$rd read]
+        assert {[lindex $res 0 0] eq {s2}}
+        assert {[lindex $res 0 1 0 1] eq {new abcd1234}}
+        $rd close
+    }
+
+    test {Blocking XREAD waiting old data} {
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 20000 STREAMS s1 s2 s3 $ 0-0 $
+        r XADD s2 * foo abcd1234
+        set res [$rd read]
+        assert {[lindex $res 0 0] eq {s2}}
+        assert {[lindex $res 0 1 0 1] eq {old abcd1234}}
+        $rd close
+    }
+
+    test {Blocking XREAD times out} {
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 100 STREAMS s1 $
+        assert_equal {} [$rd read]
+        $rd close
+    }
+
+    test {XREAD without BLOCK and with COUNT} {
+        r del mystream
+        r xadd mystream 1-1 a 1
+        r xadd mystream 1-2 a 2
+        r xadd mystream 1-3 a 3
+        assert_equal {{mystream {{1-2 {a 2}}}}} \
+            [r xread COUNT 1 STREAMS mystream nokey 1-1 0]
+        assert_equal {} [r xread STREAMS mystream 1-3]
+        assert_error "*Unbalanced*" {r xread STREAMS mystream nokey 0}
+        assert_error "*only supported by XREADGROUP*" \
+            {r xread GROUP g c STREAMS mystream 0}
+    }
+
+    test {XREAD with same stream name multiple times should work} {
+        r XADD s2 * old abcd1234
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 20000 STREAMS s2 s2 s2 $ $ $
+        r XADD s2 * new abcd1234
+        set res [$rd read]
+        assert {[lindex $res 0 0] eq {s2}}
+        assert {[lindex $res 0 1 0 1] eq {new abcd1234}}
+        $rd close
+    }
+
+    test {XREAD + multiple XADD inside transaction} {
+        r XADD s2 * old abcd1234
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 20000 STREAMS s2 s2 s2 $ $ $
+        r MULTI
+        r XADD s2 * field one
+        r XADD s2 * field two
+        r XADD s2 * field three
+        r EXEC
+        set res [$rd read]
+        assert {[lindex $res 0 0] eq {s2}}
+        assert {[lindex $res 0 1 0 1] eq {field one}}
+        assert {[lindex $res 0 1 1 1] eq {field two}}
+        $rd close
+    }
+
+    test {Blocking XREAD is not served by a list with the same name} {
+        r del mykey
+        set rd [redis_deferring_client]
+        $rd XREAD BLOCK 20000 STREAMS mykey $
+        r rpush mykey a
+        r del mykey
+        r xadd mykey 1-1 a 1
+        assert_equal {{mykey {{1-1 {a 1}}}}} [$rd read]
+        $rd close
+    }
+
+    test {XREAD BLOCK inside MULTI returns a null reply} {
+        r del mystream
+        r multi
+        r xread BLOCK 0 STREAMS mystream $
+        assert_equal {{}} [r exec]
+    }
+
+    test {XGROUP CREATE: creation and duplicate group name detection} {
+        r DEL mystream
+        r XADD mystream * foo bar
+        r XGROUP CREATE mystream mygroup $
+        catch {r XGROUP CREATE mystream mygroup $} err
+        set err
+    } {BUSYGROUP*}
+
+    test {XGROUP CREATE: automatic stream creation with MKSTREAM} {
+        r DEL newstream
+        assert_error "*requires the key to exist*" \
+            {r XGROUP CREATE newstream mygroup $}
+        r XGROUP CREATE newstream mygroup $ MKSTREAM
+        assert_equal 0 [r XLEN newstream]
+        assert_equal stream [r TYPE newstream]
+    }
+
+    test {XREADGROUP will return only new elements} {
+        r XADD mystream * a 1
+        r XADD mystream * b 2
+        # XREADGROUP should return only the new elements "a 1" "b 1"
+        # and not the element "foo bar" which was pre existing in the
+        # stream (see previous test)
+        set reply [r XREADGROUP GROUP mygroup client-1 STREAMS mystream ">"]
+        assert {[llength [lindex $reply 0 1]] == 2}
+        lindex $reply 0 1 0 1
+    } {a 1}
+
+    test {XREADGROUP can read the history of the elements we own} {
+        # Add a few more elements
+        r XADD mystream * c 3
+        r XADD mystream * d 4
+        # Read a few elements using a different consumer name
+        set reply [r XREADGROUP GROUP mygroup client-2 STREAMS mystream ">"]
+        assert {[llength [lindex $reply 0 1]] == 2}
+        assert {[lindex $reply 0 1 0 1] eq {c 3}}
+
+        set r1 [r XREADGROUP GROUP mygroup client-1 COUNT 10 STREAMS mystream 0]
+        set r2 [r XREADGROUP GROUP mygroup client-2 COUNT 10 STREAMS mystream 0]
+        assert {[lindex $r1 0 1 0 1] eq {a 1}}
+        assert {[lindex $r2 0 1 0 1] eq {c 3}}
+    }
+
+    test {XREADGROUP argument errors} {
+        assert_error "NOGROUP*" {r XREADGROUP GROUP nogroup c STREAMS mystream >}
+        assert_error "NOGROUP*" {r XREADGROUP GROUP mygroup c STREAMS nokey >}
+        assert_error "*meaningless*" {r XREADGROUP GROUP mygroup c STREAMS mystream $}
+        assert_error "*can be specified only*" {r XREAD STREAMS mystream >}
+        assert_error "*Missing GROUP*" {r XREADGROUP COUNT 1 COUNT 1 STREAMS mystream >}
+    }
+
+    test {XPENDING is able to return pending items} {
+        set pending [r XPENDING mystream mygroup - + 10]
+        assert {[llength $pending] == 4}
+        for {set j 0} {$j < 4} {incr j} {
+            set item [lindex $pending $j]
+            if {$j < 2} {
+                set owner client-1
+            } else {
+                set owner client-2
+            }
+            assert {[lindex $item 1] eq $owner}
+            assert {[lindex $item 1] eq $owner}
+        }
+    }
+
+    test {XPENDING can return single consumer items} {
+        set pending [r XPENDING mystream mygroup - + 10 client-1]
+        assert {[llength $pending] == 2}
+        assert_equal {} [r XPENDING mystream mygroup - + 10 nobody]
+    }
+
+    test {XPENDING summary form} {
+        set ids [lmap e [r XPENDING mystream mygroup - + 10] {lindex $e 0}]
+        set summary [r XPENDING mystream mygroup]
+        assert_equal 4 [lindex $summary 0]
+        assert_equal [lindex $ids 0] [lindex $summary 1]
+        assert_equal [lindex $ids 3] [lindex $summary 2]
+        assert_equal {{client-1 2} {client-2 2}} [lsort [lindex $summary 3]]
+        r XGROUP CREATE mystream emptygroup $
+        assert_equal {0 {} {} {}} [r XPENDING mystream emptygroup]
+    }
+
+    test {XACK is able to remove items from the client/group PEL} {
+        set pending [r XPENDING mystream mygroup - + 10 client-1]
+        set id1 [lindex $pending 0 0]
+        set id2 [lindex $pending 1 0]
+        assert {[r XACK mystream mygroup $id1] eq 1}
+        set pending [r XPENDING mystream mygroup - + 10 client-1]
+        assert {[llength $pending] == 1}
+        set id [lindex $pending 0 0]
+        assert {$id eq $id2}
+        set global_pel [r XPENDING mystream mygroup - + 10]
+        assert {[llength $global_pel] == 3}
+        assert_equal 0 [r XACK mystream mygroup $id1]
+        assert_equal 0 [r XACK nokey mygroup $id1]
+    }
+
+    test {XACK can't remove the same item multiple times} {
+        assert {[r XACK mystream mygroup $id1] eq 0}
+    }
+
+    test {XACK is able to accept multiple arguments} {
+        # One of the IDs was already removed, so it should ack
+        # just one of the two.
+        assert {[r XACK mystream mygroup $id1 $id2] eq 1}
+    }
+
+    test {XREADGROUP with NOACK does not create pending entries} {
+        r del mystream
+        r xadd mystream 1-1 a 1
+        r xgroup create mystream mygroup 0
+        set res [r xreadgroup GROUP mygroup c NOACK STREAMS mystream >]
+        assert_equal {{mystream {{1-1 {a 1}}}}} $res
+        assert_equal 0 [lindex [r xpending mystream mygroup] 0]
+        assert_equal {} [r xreadgroup GROUP mygroup c STREAMS mystream >]
+    }
+
+    test {XREADGROUP history returns deleted entries with a null body} {
+        r del mystream
+        r xadd mystream 1-1 a 1
+        r xadd mystream 1-2 a 2
+        r xgroup create mystream mygroup 0
+        r xreadgroup GROUP mygroup c STREAMS mystream >
+        r xdel mystream 1-1
+        set res [r xreadgroup GROUP mygroup c STREAMS mystream 0]
+        assert_equal {{mystream {{1-1 {}} {1-2 {a 2}}}}} $res
+        # Every history read counts as a new delivery.
+        assert_equal 2 [lindex [r xpending mystream mygroup - + 10] 0 3]
+    }
+
+    test {Blocking XREADGROUP will not reply with an empty array} {
+        r del mystream
+        r XGROUP CREATE mystream mygroup $ MKSTREAM
+        r XADD mystream 666 f v
+        set res [r XREADGROUP GROUP mygroup Alice BLOCK 10 STREAMS mystream ">"]
+        assert {[lindex $res 0 1 0] == {666-0 {f v}}}
+        r XADD mystream 667 f2 v2
+        r XDEL mystream 667
+        set rd [redis_deferring_client]
+        $rd XREADGROUP GROUP mygroup Alice BLOCK 10 STREAMS mystream ">"
+        after 20
+        assert {[$rd read] == {}} ;# before the fix, client didn't even block, but was served synchronously with {mystream {}}
+        $rd close
+    }
+
+    test {Blocking XREADGROUP is served when new entries arrive} {
+        r del mystream
+        r XGROUP CREATE mystream mygroup $ MKSTREAM
+        set rd [redis_deferring_client]
+        $rd XREADGROUP GROUP mygroup Bob BLOCK 20000 STREAMS mystream ">"
+        r XADD mystream 1-1 f v
+        assert_equal {{mystream {{1-1 {f v}}}}} [$rd read]
+        assert_equal {{1-1 Bob}} [lmap e [r XPENDING mystream mygroup - + 10] {lrange $e 0 1}]
+        $rd close
+    }
+
+    test {Blocking XREADGROUP gets NOGROUP when the group is destroyed} {
+        r del mystream
+        r XGROUP CREATE mystream mygroup $ MKSTREAM
+        set rd [redis_deferring_client]
+        $rd XREADGROUP GROUP mygroup Alice BLOCK 20000 STREAMS mystream ">"
+        after 20
+        assert_equal 1 [r XGROUP DESTROY mystream mygroup]
+        assert_error "NOGROUP*" {$rd read}
+        assert_equal 0 [r XGROUP DESTROY mystream mygroup]
+        $rd close
+    }
+
+    test {XCLAIM can claim PEL items from another consumer} {
+        # Add 3 items into the stream, and create a consumer group
+        r del mystream
+        set id1 [r XADD mystream * a 1]
+        set id2 [r XADD mystream * b 2]
+        set id3 [r XADD mystream * c 3]
+        r XGROUP CREATE mystream mygroup 0
+
+        # Client 1 reads item 1 from the stream without acknowledgements.
+        # Client 2 then claims pending item 1 from the PEL of client 1
+        set reply [r XREADGROUP GROUP mygroup client1 count 1 STREAMS mystream >]
+        assert {[llength [lindex $reply 0 1 0 1]] == 2}
+        assert {[lindex $reply 0 1 0 1] eq {a 1}}
+        after 200
+        set reply [r XCLAIM mystream mygroup client2 10 $id1]
+        assert {[llength [lindex $reply 0 1]] == 2}
+        assert {[lindex $reply 0 1] eq {a 1}}
+
+        # Client 1 reads another 2 items from stream
+        r XREADGROUP GROUP mygroup client1 count 2 STREAMS mystream >
+        r XDEL mystream $id2
+        after 200
+
+        # Client 2 claims both the deleted item 2 and item 3:
+        # the deleted one is returned as a null.
+        set reply [r XCLAIM mystream mygroup client2 10 $id2 $id3]
+        assert {[llength $reply] == 2}
+        assert {[lindex $reply 0] eq {}}
+        assert {[lindex $reply 1 1] eq {c 3}}
+
+        # The items are not claimed again if they were not idle enough.
+        assert_equal {} [r XCLAIM mystream mygroup client1 100000 $id1 $id3]
+        assert_equal {} [r XPENDING mystream mygroup - + 10 client1]
+        assert_error "NOGROUP*" {r XCLAIM mystream nogroup c 0 $id1}
+    }
+
+    test {XCLAIM options IDLE, RETRYCOUNT, JUSTID and FORCE} {
+        r del mystream
+        r XADD mystream 1-1 a 1
+        r XADD mystream 1-2 a 2
+        r XGROUP CREATE mystream mygroup 0
+        r XREADGROUP GROUP mygroup c1 STREAMS mystream >
+        set reply [r XCLAIM mystream mygroup c2 0 1-1 IDLE 50000 RETRYCOUNT 7 JUSTID]
+        assert_equal {1-1} $reply
+        set item [lindex [r XPENDING mystream mygroup - + 10 c2] 0]
+        assert_equal {1-1 c2} [lrange $item 0 1]
+        assert {[lindex $item 2] >= 50000}
+        assert_equal 7 [lindex $item 3]
+
+        # FORCE creates a PEL entry only for existing entries.
+        r XADD mystream 1-3 a 3
+        assert_equal {} [r XCLAIM mystream mygroup c2 0 1-3 JUSTID]
+        assert_equal {1-3} [r XCLAIM mystream mygroup c2 0 1-3 1-9 FORCE JUSTID]
+        assert_equal 3 [lindex [r XPENDING mystream mygroup] 0]
+        assert_error "*Unrecognized XCLAIM option*" {r XCLAIM mystream mygroup c2 0 1-1 FOO}
+    }
+
+    test {XGROUP SETID and DELCONSUMER} {
+        r del mystream
+        r XADD mystream 1-1 a 1
+        r XADD mystream 1-2 a 2
+        r XGROUP CREATE mystream mygroup $
+        assert_equal {} [r XREADGROUP GROUP mygroup c1 STREAMS mystream >]
+        r XGROUP SETID mystream mygroup 0
+        set reply [r XREADGROUP GROUP mygroup c1 STREAMS mystream >]
+        assert_equal 2 [llength [lindex $reply 0 1]]
+        # Reading again after moving back the group moves the entries to
+        # the new consumer.
+        r XGROUP SETID mystream mygroup 1-1
+        r XREADGROUP GROUP mygroup c2 STREAMS mystream >
+        assert_equal {{c1 1} {c2 1}} [lsort [lindex [r XPENDING mystream mygroup] 3]]
+        assert_equal 1 [r XGROUP DELCONSUMER mystream mygroup c1]
+        assert_equal 1 [lindex [r XPENDING mystream mygroup] 0]
+        assert_error "NOGROUP*" {r XGROUP SETID mystream nogroup 0}
+        assert_error "*Unknown XGROUP subcommand*" {r XGROUP FOO mystream mygroup}
+    }
+
+    test {XINFO GROUPS and CONSUMERS} {
+        set groups [r XINFO GROUPS mystream]
+        assert_equal 1 [llength $groups]
+        array set g [lindex $groups 0]
+        assert_equal mygroup $g(name)
+        assert_equal 1 $g(consumers)
+        assert_equal 1 $g(pending)
+        assert_equal 1-2 $g(last-delivered-id)
+        set consumers [r XINFO CONSUMERS mystream mygroup]
+        array set c [lindex $consumers 0]
+        assert_equal c2 $c(name)
+        assert_equal 1 $c(pending)
+        assert_error "NOGROUP*" {r XINFO CONSUMERS mystream nogroup}
+        assert_error "*no such key*" {r XINFO STREAM nokey}
+    }
+
+    test {XINFO STREAM} {
+        r del mystream
+        r XADD mystream 1-1 a 1
+        r XADD mystream 1-2 b 2
+        r XDEL mystream 1-2
+        array set info [r XINFO STREAM mystream]
+        assert_equal 1 $info(length)
+        assert_equal 1 $info(blocks)
+        assert_equal 1-2 $info(last-generated-id)
+        assert_equal 0 $info(groups)
+        assert_equal {1-1 {a 1}} $info(first-entry)
+        assert_equal {1-1 {a 1}} $info(last-entry)
+    }
+
+    start_server {} {
+        set master [srv -1 client]
+        set master_host [srv -1 host]
+        set master_port [srv -1 port]
+        set slave [srv 0 client]
+
+        test {XADD, XREADGROUP, XCLAIM and XTRIM ~ are replicated consistently} {
+            $slave slaveof $master_host $master_port
+            wait_for_condition 50 100 {
+                [string match {*master_link_status:up*} [$slave info replication]]
+            } else {
+                fail "Replication not started."
+            }
+            $master del repl
+            $master config set stream-node-max-entries 10
+            for {set j 0} {$j < 100} {incr j} {
+                $master xadd repl * item $j
+            }
+            $master xtrim repl MAXLEN ~ 50
+            $master xgroup create repl g 0
+            $master xreadgroup GROUP g c1 COUNT 5 STREAMS repl >
+            $master xclaim repl g c2 0 [lindex [$master xpending repl g] 1]
+            set rd [redis_deferring_client -1]
+            $rd xreadgroup GROUP g c3 BLOCK 20000 STREAMS repl >
+            $rd read
+            $rd xreadgroup GROUP g c4 BLOCK 20000 STREAMS repl >
+            after 20
+            $master xadd repl * item new
+            $rd read
+            $rd close
+            $master config set stream-node-max-entries 100
+            wait_for_condition 50 100 {
+                [$master debug digest] eq [$slave debug digest] &&
+                [lsort [lindex [$master xpending repl g] 3]] eq
+                [lsort [lindex [$slave xpending repl g] 3]]
+            } else {
+                fail "Master and slave have different streams"
+            }
+            assert_equal [lsort [$master xinfo groups repl]] \
+                [lsort [$slave xinfo groups repl]]
+        }
+    }
+
+    test {DEBUG RELOAD preserves streams and consumer groups} {
+        r del mystream
+        r config set stream-node-max-entries 10
+        streamFill mystream 100
+        r config set stream-node-max-entries 100
+        r xdel mystream [lindex [r xrange mystream - + COUNT 1] 0 0]
+        r xgroup create mystream g1 0
+        r xgroup create mystream g2 $
+        r xreadgroup GROUP g1 c1 COUNT 10 STREAMS mystream >
+        r xreadgroup GROUP g1 c2 COUNT 5 STREAMS mystream >
+        r xack mystream g1 [lindex [r xpending mystream g1] 1]
+        set digest [r debug digest]
+        set pending [r xpending mystream g1 - + 100]
+        set groups [r xinfo groups mystream]
+        set sinfo [r xinfo stream mystream]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_equal [lsort $groups] [lsort [r xinfo groups mystream]]
+        assert_equal $sinfo [r xinfo stream mystream]
+        assert_equal [lmap e $pending {lrange $e 0 1}] \
+            [lmap e [r xpending mystream g1 - + 100] {lrange $e 0 1}]
+    }
+
+    test {DEBUG RELOAD preserves an empty stream and its last ID} {
+        r del mystream
+        r xadd mystream 5-5 a 1
+        r xdel mystream 5-5
+        r xgroup create emptystream g $ MKSTREAM
+        r debug reload
+        assert_equal 0 [r xlen mystream]
+        assert_error "*equal or smaller*" {r xadd mystream 5-5 a 1}
+        assert_equal stream [r type emptystream]
+    }
+
+    test {RESTORE rejects corrupted stream payloads} {
+        r del mystream
+        r xadd mystream 1-1 a 1
+        set dump [r dump mystream]
+        r del mystream
+        r restore mystream 0 $dump
+        assert_equal {{1-1 {a 1}}} [r xrange mystream - +]
+        r del mystream
+        # Truncate the payload, keeping the version and checksum trailer.
+        set bad [string range $dump 0 10][string range $dump end-9 end]
+        catch {r restore mystream 0 $bad} err
+        assert_match "*ERR*" $err
+        assert_equal 0 [r exists mystream]
+    }
+}
+
+start_server {tags {"stream"} overrides {appendonly yes appendfsync always}} {
+    test {XADD with MAXLEN ~ and XREADGROUP are rewritten for the AOF} {
+        r config set stream-node-max-entries 10
+        for {set j 0} {$j < 25} {incr j} {
+            r xadd mystream MAXLEN ~ 10 * item $j
+        }
+        r xgroup create mystream g 0
+        r xreadgroup GROUP g c BLOCK 0 COUNT 3 STREAMS mystream >
+        set dir [lindex [r config get dir] 1]
+        set fp [open [file join $dir appendonly.aof] r]
+        fconfigure $fp -translation binary
+        set content [read $fp]
+        close $fp
+        assert_match "*MAXLEN\r\n\$1\r\n=\r\n*" $content
+        assert {![string match "*BLOCK*" $content]}
+
+        set digest [r debug digest]
+        set pending [r xpending mystream g]
+        r debug loadaof
+        assert_equal $digest [r debug digest]
+        assert_equal $pending [r xpending mystream g]
+        r config set stream-node-max-entries 100
+    }
+
+    test {AOF rewrite of streams with consumer groups} {
+        r flushall
+        streamFill mystream 300
+        r xdel mystream [lindex [r xrange mystream - + COUNT 1] 0 0]
+        r xadd mystream 999999999999999-0 last entry
+        r xdel mystream 999999999999999-0
+        r xgroup create mystream g1 0
+        r xgroup create mystream g2 $
+        r xreadgroup GROUP g1 c1 COUNT 10 STREAMS mystream >
+        r xreadgroup GROUP g1 c2 COUNT 5 STREAMS mystream >
+        r xgroup create emptystream g $ MKSTREAM
+        set digest [r debug digest]
+        set pending [r xpending mystream g1 - + 100]
+        set groups [r xinfo groups mystream]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $digest [r debug digest]
+        assert_equal [lsort $groups] [lsort [r xinfo groups mystream]]
+        assert_equal [lmap e $pending {lrange $e 0 1}] \
+            [lmap e [r xpending mystream g1 - + 100] {lrange $e 0 1}]
+        assert_equal [lmap e $pending {lindex $e 3}] \
+            [lmap e [r xpending mystream g1 - + 100] {lindex $e 3}]
+        assert_equal 0 [r xlen emptystream]
+        assert_equal 1 [llength [r xinfo groups emptystream]]
+    }
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env tclsh8.5
+# Eviction hit ratio benchmark.
+#
+# Redis is used as a cache in front of a fake backend: every request does
+# a GET of a key picked with a skewed distribution, and on a miss the key
+# is SET, so that maxmemory has to evict some other key. The hit ratio is
+# compared with the one of a perfect LRU cache holding the same number of
+# keys, replaying the very same access sequence.
+#
+# Usage: ./test-lru.tcl [host] [port] [policy] [keys] [requests]
+#
+# Run it against different builds (or policies) to compare how close to a
+# true LRU the approximated algorithm is. Warning: the target instance is
+# flushed and its maxmemory settings are changed.
+#
+# Copyright (C) 2013 Salvatore Sanfilippo
+# Released under the BSD license like Redis itself
+
+source [file dirname [info script]]/../../tests/support/redis.tcl
+
+set ::host [expr {$argc > 0 ? [lindex $argv 0] : "127.0.0.1"}]
+set ::port [expr {$argc > 1 ? [lindex $argv 1] : 6379}]
+set ::policy [expr {$argc > 2 ? [lindex $argv 2] : "allkeys-lru"}]
+set ::keys [expr {$argc > 3 ? [lindex $argv 3] : 50000}]
+set ::requests [expr {$argc > 4 ? [lindex $argv 4] : 500000}]
+set ::value [string repeat x 64]
+set ::batch 100
+set ::cache_perc 50 ;# Percentage of the keys that fit in memory.
+
+proc used_memory r {
+    regexp {used_memory:([0-9]+)} [$r info memory] -> mem
+    return $mem
+}
+
+# Keys are picked with a power law distribution, so that a few keys are
+# accessed very often and most of the others rarely.
+proc random_key {} {
+    expr {int(pow(rand(),4)*$::keys)}
+}
+
+# Perfect LRU with the specified number of slots, for reference. Tcl dicts
+# keep insertion order, so the first key is always the least recently used.
+proc simulate_lru {sequence slots} {
+    set lru [dict create]
+    set hits 0
+    set counted 0
+    set half [expr {[llength $sequence]/2}]
+    set i 0
+    foreach k $sequence {
+        if {[dict exists $lru $k]} {
+            if {$i >= $half} {incr hits}
+            dict unset lru $k
+        } elseif {[dict size $lru] >= $slots} {
+            dict for {old _} $lru break
+            dict unset lru $old
+        }
+        dict set lru $k 1
+        if {$i >= $half} {incr counted}
+        incr i
+    }
+    expr {double($hits)*100/$counted}
+}
+
+set r [redis $::host $::port]
+set rd [redis $::host $::port 1]
+
+# Estimate how much memory a key uses, then size maxmemory so that only
+# a fraction of the keys fit.
+$r config set maxmemory 0
+$r flushall
+set base [used_memory $r]
+for {set j 0} {$j < $::keys} {incr j $::batch} {
+    set args {}
+    for {set i $j} {$i < $j+$::batch && $i < $::keys} {incr i} {
+        lappend args key:$i $::value
+    }
+    $r mset {*}$args
+}
+set perkey [expr {double([used_memory $r]-$base)/$::keys}]
+$r flushall
+set maxmemory [expr {int($base+$perkey*$::keys*$::cache_perc/100)}]
+$r config set maxmemory $maxmemory
+$r config set maxmemory-policy $::policy
+
+puts "Policy: $::policy, keys: $::keys, requests: $::requests"
+puts "Bytes per key: [format %.1f $perkey], maxmemory: $maxmemory"
+
+# Run the workload. Only the second half of the requests is accounted, so
+# that the cache is warm.
+set sequence {}
+set hits 0
+set counted 0
+set half [expr {$::requests/2}]
+set start [clock milliseconds]
+for {set j 0} {$j < $::requests} {incr j $::batch} {
+    set pending {}
+    for {set i 0} {$i < $::batch} {incr i} {
+        set k [random_key]
+        lappend pending $k
+        lappend sequence $k
+        $rd get key:$k
+    }
+    set misses {}
+    foreach k $pending {
+        if {[$rd read] eq {}} {
+            lappend misses $k
+        } elseif {$j >= $half} {
+            incr hits
+        }
+    }
+    foreach k $misses {$rd set key:$k $::value}
+    foreach k $misses {$rd read}
+    if {$j >= $half} {incr counted $::batch}
+}
+set elapsed [expr {[clock milliseconds]-$start}]
+
+set slots [$r dbsize]
+set ratio [expr {double($hits)*100/$counted}]
+puts "Elapsed: $elapsed ms, keys in memory: $slots"
+puts "Hit ratio: [format %.2f $ratio]%"
+puts "Perfect LRU with $slots keys: [format %.2f [simulate_lru $sequence $slots]]%"